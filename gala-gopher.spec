@@ -32,7 +32,7 @@ BuildRequires: java-1.8.0-openjdk-devel
 Requires:      bash glibc elfutils bpftool dmidecode iproute cjson
 Requires:      libbpf >= 2:0.3 kmod net-tools ethtool
 %if 0%{?without_flamegraph}?0:1
-Requires:      flamegraph libcurl
+Requires:      libcurl
 %endif
 %if 0%{?without_opengauss_sli}?0:1
 Requires:      python3-psycopg2 python3-yaml
@@ -189,6 +189,14 @@ static int __period_arg_parse(char opt, char *arg, struct probe_params *params)
                 (void)snprintf(params->tgids, sizeof(params->tgids), "%s", arg);
             }
             break;
+        case 'a':
+            interval = (unsigned int)atoi(arg);
+            if (interval > OUT_PUT_PERIOD_MAX) {
+                ERROR("Please check arg(a), val shold inside 0~120.\n");
+                return -1;
+            }
+            params->aggr_window = interval;
+            break;
         default:
             return -1;
     }
@@ -37,7 +37,7 @@
 
 #define MAX_TGIDS_LEN       64
 
-#define __OPT_S "t:s:T:J:O:D:F:lU:L:c:p:w:d:P:Ck:i:m:e:f:"
+#define __OPT_S "t:s:T:J:O:D:F:lU:L:c:p:w:d:P:Ck:i:m:e:f:a:"
 struct probe_params {
     unsigned int period;          // [-t <>] Report period, unit second, default is 5 seconds
     unsigned int sample_period;   // [-s <>] Sampling period, unit milliseconds, default is 100 milliseconds
@@ -64,6 +64,7 @@ struct probe_params {
     char target_comm[MAX_COMM_LEN]; // [-F <>] Process comm name, default is null
     char host_ip_list[MAX_IP_NUM][MAX_IP_LEN]; // [-i <>] Host ip fields list, default is null
     char tgids[MAX_TGIDS_LEN];    // [-f <>] Filter tgids, default is null
+    unsigned int aggr_window;     // [-a <>] Window of in-kernel event aggregation, unit second, default is 0 (no aggregation)
     /*
         [-P <>]
         L7 probe monitoring protocol flags, Refer to the below definitions(default is 0):
@@ -72,10 +73,10 @@ struct probe_params {
         0x0004  REDIS
         0x0008  MYSQL
         0x0010  PGSQL
-        0x0012  KAFKA
-        0x0014  MONGODB
-        0x0018  Cassandra
-        0x0020  NATS
+        0x0020  KAFKA
+        0x0040  MONGODB
+        0x0080  Cassandra
+        0x0100  NATS
     */
     unsigned int l7_probe_proto_flags;
 };
@@ -0,0 +1,348 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2023. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: block device table
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/sysmacros.h>
+#include <linux/netlink.h>
+
+#include "blk_dev.h"
+
+#define SYS_DEV_BLOCK       "/sys/dev/block"
+#define SYS_CLASS_BLOCK     "/sys/class/block"
+#define UEVENT_BUF_LEN      8192
+#define UEVENT_BLOCK        "SUBSYSTEM=block"
+#define BLK_DEV_DEPTH_MAX   8       // partition -> dm -> md -> ... -> disk
+
+static int read_sys_line(const char *path, char *buf, size_t size)
+{
+    FILE *f;
+
+    buf[0] = 0;
+    f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    if (fgets(buf, (int)size, f) == NULL) {
+        (void)fclose(f);
+        return -1;
+    }
+    (void)fclose(f);
+    SPLIT_NEWLINE_SYMBOL(buf);
+    return 0;
+}
+
+// dm devices are shown by their mapped names as lsblk does
+static void get_blk_name(const char *kname, char *name, size_t size)
+{
+    char path[PATH_LEN];
+
+    path[0] = 0;
+    (void)snprintf(path, sizeof(path), SYS_CLASS_BLOCK "/%s/dm/name", kname);
+    if (read_sys_line(path, name, size) == 0 && name[0] != 0) {
+        return;
+    }
+    (void)snprintf(name, size, "%s", kname);
+}
+
+// The first slave in name order, so a dm on several disks always has the same disk
+static int get_first_slave(const char *kname, char *slave, size_t size)
+{
+    DIR *dir;
+    struct dirent *entry;
+    char path[PATH_LEN];
+
+    slave[0] = 0;
+    path[0] = 0;
+    (void)snprintf(path, sizeof(path), SYS_CLASS_BLOCK "/%s/slaves", kname);
+    dir = opendir(path);
+    if (dir == NULL) {
+        return -1;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        if (slave[0] == 0 || strcmp(entry->d_name, slave) < 0) {
+            (void)snprintf(slave, size, "%s", entry->d_name);
+        }
+    }
+    (void)closedir(dir);
+    return (slave[0] != 0) ? 0 : -1;
+}
+
+// /sys/class/block/sda1 -> ../../devices/.../block/sda/sda1
+static int get_part_parent(const char *kname, char *parent, size_t size)
+{
+    char path[PATH_LEN];
+    char link[PATH_LEN];
+    char *p;
+    ssize_t len;
+
+    path[0] = 0;
+    (void)snprintf(path, sizeof(path), SYS_CLASS_BLOCK "/%s", kname);
+    len = readlink(path, link, sizeof(link) - 1);
+    if (len <= 0) {
+        return -1;
+    }
+    link[len] = 0;
+
+    p = strrchr(link, '/');
+    if (p == NULL) {
+        return -1;
+    }
+    *p = 0;
+    p = strrchr(link, '/');
+    (void)snprintf(parent, size, "%s", (p != NULL) ? p + 1 : link);
+    return 0;
+}
+
+static void get_blk_disk_name(const char *kname, char is_part, char *disk_name, size_t size)
+{
+    char cur[DISK_NAME_LEN];
+    char next[DISK_NAME_LEN];
+    char path[PATH_LEN];
+    char part = is_part;
+
+    (void)snprintf(cur, sizeof(cur), "%s", kname);
+    for (int i = 0; i < BLK_DEV_DEPTH_MAX; i++) {
+        if (part) {
+            if (get_part_parent(cur, next, sizeof(next))) {
+                break;
+            }
+        } else if (get_first_slave(cur, next, sizeof(next))) {
+            break;
+        }
+        (void)snprintf(cur, sizeof(cur), "%s", next);
+
+        path[0] = 0;
+        (void)snprintf(path, sizeof(path), SYS_CLASS_BLOCK "/%s/partition", cur);
+        part = (access(path, F_OK) == 0) ? 1 : 0;
+    }
+    get_blk_name(cur, disk_name, size);
+}
+
+static struct blk_dev_s *blk_dev_load(struct blk_dev_tbl_s *tbl, int major, int minor)
+{
+    FILE *f;
+    char path[PATH_LEN];
+    char line[LINE_BUF_LEN];
+    struct blk_dev_s *dev;
+
+    path[0] = 0;
+    (void)snprintf(path, sizeof(path), SYS_DEV_BLOCK "/%d:%d/uevent", major, minor);
+    f = fopen(path, "r");
+    if (f == NULL) {
+        return NULL;
+    }
+
+    dev = (struct blk_dev_s *)calloc(1, sizeof(struct blk_dev_s));
+    if (dev == NULL) {
+        (void)fclose(f);
+        return NULL;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        SPLIT_NEWLINE_SYMBOL(line);
+        if (strncmp(line, "DEVNAME=", strlen("DEVNAME=")) == 0) {
+            (void)snprintf(dev->kname, sizeof(dev->kname), "%s", line + strlen("DEVNAME="));
+        } else if (strcmp(line, "DEVTYPE=partition") == 0) {
+            dev->is_part = 1;
+        }
+    }
+    (void)fclose(f);
+
+    if (dev->kname[0] == 0) {
+        free(dev);
+        return NULL;
+    }
+
+    dev->major = major;
+    dev->minor = minor;
+    dev->devt = makedev((unsigned int)major, (unsigned int)minor);
+    get_blk_name(dev->kname, dev->name, sizeof(dev->name));
+    get_blk_disk_name(dev->kname, dev->is_part, dev->disk_name, sizeof(dev->disk_name));
+
+    H_ADD(tbl->devs, devt, sizeof(dev_t), dev);
+    return dev;
+}
+
+static void blk_dev_clear(struct blk_dev_tbl_s *tbl)
+{
+    struct blk_dev_s *dev, *tmp;
+
+    H_ITER(tbl->devs, dev, tmp) {
+        H_DEL(tbl->devs, dev);
+        free(dev);
+    }
+    tbl->devs = NULL;
+}
+
+static void blk_dev_build(struct blk_dev_tbl_s *tbl)
+{
+    DIR *dir;
+    struct dirent *entry;
+    int major, minor;
+
+    blk_dev_clear(tbl);
+    tbl->gen++;
+
+    dir = opendir(SYS_DEV_BLOCK);
+    if (dir == NULL) {
+        ERROR("[BLK_DEV] open %s failed.\n", SYS_DEV_BLOCK);
+        return;
+    }
+    while ((entry = readdir(dir)) != NULL) {
+        if (sscanf(entry->d_name, "%d:%d", &major, &minor) != 2) {
+            continue;
+        }
+        (void)blk_dev_load(tbl, major, minor);
+    }
+    (void)closedir(dir);
+}
+
+static int open_uevent_sock(void)
+{
+    int fd;
+    struct sockaddr_nl addr = {0};
+
+    fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (fd < 0) {
+        return -1;
+    }
+
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = 1;     // kernel uevents, udev rebroadcasts them to group 2 after its rules
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        (void)close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// "add@/devices/.../block/sdb\0ACTION=add\0...\0SUBSYSTEM=block\0..."
+static char is_blk_uevent(const char *buf, size_t len)
+{
+    size_t pos = 0;
+
+    while (pos < len) {
+        if (strcmp(buf + pos, UEVENT_BLOCK) == 0) {
+            return 1;
+        }
+        pos += strlen(buf + pos) + 1;
+    }
+    return 0;
+}
+
+struct blk_dev_tbl_s *blk_dev_tbl_new(void)
+{
+    struct blk_dev_tbl_s *tbl = (struct blk_dev_tbl_s *)calloc(1, sizeof(struct blk_dev_tbl_s));
+    if (tbl == NULL) {
+        return NULL;
+    }
+
+    // open the socket first, a device added while reading sysfs is read again
+    tbl->uevent_fd = open_uevent_sock();
+    if (tbl->uevent_fd < 0) {
+        INFO("[BLK_DEV] uevent socket is not available, removed block devices are kept in the table.\n");
+    }
+    blk_dev_build(tbl);
+    return tbl;
+}
+
+void blk_dev_tbl_free(struct blk_dev_tbl_s **ptbl)
+{
+    struct blk_dev_tbl_s *tbl = *ptbl;
+
+    if (tbl == NULL) {
+        return;
+    }
+    blk_dev_clear(tbl);
+    if (tbl->uevent_fd >= 0) {
+        (void)close(tbl->uevent_fd);
+    }
+    free(tbl);
+    *ptbl = NULL;
+}
+
+/*
+ * Drain the uevents received, the table is rebuilt if any block device is added, removed or changed.
+ * Return 1 if rebuilt.
+ */
+int blk_dev_tbl_sync(struct blk_dev_tbl_s *tbl)
+{
+    char buf[UEVENT_BUF_LEN];
+    ssize_t len;
+    char changed = 0;
+
+    if (tbl->uevent_fd < 0) {
+        return 0;
+    }
+
+    while (1) {
+        len = recv(tbl->uevent_fd, buf, sizeof(buf) - 1, MSG_DONTWAIT);
+        if (len < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == ENOBUFS) {     // uevents are lost
+                changed = 1;
+                continue;
+            }
+            break;
+        }
+        buf[len] = 0;
+        if (!changed && is_blk_uevent(buf, (size_t)len)) {
+            changed = 1;
+        }
+    }
+
+    if (changed) {
+        blk_dev_build(tbl);
+    }
+    return changed;
+}
+
+struct blk_dev_s *blk_dev_find(struct blk_dev_tbl_s *tbl, int major, int minor)
+{
+    struct blk_dev_s *dev = NULL;
+    dev_t devt = makedev((unsigned int)major, (unsigned int)minor);
+
+    (void)blk_dev_tbl_sync(tbl);
+
+    H_FIND(tbl->devs, &devt, sizeof(dev_t), dev);
+    if (dev == NULL) {
+        dev = blk_dev_load(tbl, major, minor);
+    }
+    return dev;
+}
+
+// name is the kernel name or the name shown by lsblk
+struct blk_dev_s *blk_dev_find_by_name(struct blk_dev_tbl_s *tbl, const char *name)
+{
+    struct blk_dev_s *dev, *tmp;
+
+    (void)blk_dev_tbl_sync(tbl);
+
+    H_ITER(tbl->devs, dev, tmp) {
+        if (strcmp(dev->kname, name) == 0 || strcmp(dev->name, name) == 0) {
+            return dev;
+        }
+    }
+    return NULL;
+}
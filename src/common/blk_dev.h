@@ -0,0 +1,52 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2023. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: block device table
+ ******************************************************************************/
+#ifndef __GOPHER_BLK_DEV_H__
+#define __GOPHER_BLK_DEV_H__
+
+#pragma once
+
+#include <sys/types.h>
+#include "common.h"
+#include "hash.h"
+
+/*
+ * Block devices by major:minor, read from /sys/dev/block/<maj>:<min>/uevent. The table is rebuilt when
+ * the kernel sends a uevent of the block subsystem(NETLINK_KOBJECT_UEVENT), a device not in the table
+ * yet is read from sysfs when it is looked up, e.g. the uevent socket can not be bound in a container.
+ */
+struct blk_dev_s {
+    H_HANDLE;
+    dev_t devt;                         // key
+    int major;
+    int minor;
+    char is_part;                       // a partition of disk_name
+    char kname[DISK_NAME_LEN];          // kernel name, e.g. dm-0
+    char name[DISK_NAME_LEN];           // the name shown by lsblk, e.g. openeuler-root for dm-0
+    char disk_name[DISK_NAME_LEN];      // the whole disk under the device, through partitions and slaves
+};
+
+struct blk_dev_tbl_s {
+    struct blk_dev_s *devs;
+    int uevent_fd;
+    u32 gen;                            // increased when the table is rebuilt
+};
+
+struct blk_dev_tbl_s *blk_dev_tbl_new(void);
+void blk_dev_tbl_free(struct blk_dev_tbl_s **ptbl);
+int blk_dev_tbl_sync(struct blk_dev_tbl_s *tbl);
+struct blk_dev_s *blk_dev_find(struct blk_dev_tbl_s *tbl, int major, int minor);
+struct blk_dev_s *blk_dev_find_by_name(struct blk_dev_tbl_s *tbl, const char *name);
+
+#endif
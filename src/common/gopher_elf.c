@@ -454,3 +454,42 @@ err:
     return ret;
 }
 
+/* Pass .eh_frame of the elf to 'cb', or .debug_frame if it has no .eh_frame. */
+int gopher_get_elf_frame(const char *elf_file, elf_frame_cb cb, void *ctx)
+{
+    int ret = -1, elf_fd = -1;
+    Elf *e = NULL;
+    Elf_Scn *sec;
+    Elf_Data *data;
+    GElf_Shdr header;
+    char is_eh_frame = 1;
+
+    if (open_elf(elf_file, &e, &elf_fd)) {
+        goto err;
+    }
+
+    sec = gopher_get_elf_section(e, ".eh_frame");
+    if (sec == NULL) {
+        is_eh_frame = 0;
+        sec = gopher_get_elf_section(e, ".debug_frame");
+    }
+    if (sec == NULL || !gelf_getshdr(sec, &header) || header.sh_type == SHT_NOBITS) {
+        goto err;
+    }
+
+    data = elf_getdata(sec, NULL);
+    if (data == NULL || data->d_buf == NULL || data->d_size == 0) {
+        goto err;
+    }
+
+    ret = cb((const char *)data->d_buf, data->d_size, (u64)header.sh_addr, is_eh_frame, ctx);
+
+err:
+    if (e) {
+        elf_end(e);
+    }
+    if (elf_fd >= 0) {
+        close(elf_fd);
+    }
+    return ret;
+}
@@ -51,4 +51,8 @@ int gopher_get_elf_symb(const char *elf_file, char *symb_name, u64 *symb_offset)
 int gopher_get_elf_build_id(const char *elf_file, char build_id[], size_t len);
 int gopher_get_elf_debug_link(const char *elf_file, char debug_link[], size_t len);
 
+/* 'sec_addr' is the virtual address of the section, 'data' is not valid after return. */
+typedef int (*elf_frame_cb)(const char *data, size_t len, u64 sec_addr, char is_eh_frame, void *ctx);
+int gopher_get_elf_frame(const char *elf_file, elf_frame_cb cb, void *ctx);
+
 #endif
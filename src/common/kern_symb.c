@@ -27,6 +27,7 @@
 
 #include "common.h"
 #include "kern_symb.h"
+#include "symb_cache.h"
 
 // example: ffff800009294000 t __nft_trace_packet   [nf_tables]
 #if defined(__TARGET_ARCH_x86)
@@ -132,6 +133,7 @@ void destroy_ksymbs_tbl(struct ksymb_tbl_s *ksym_tbl)
     for(int i = 0; i < ksym_tbl->ksym_size; i++) {
         destroy_ksymbs(&(ksym_tbl->ksyms[i]));
     }
+    symb_cache_free(&ksym_tbl->cache);
 }
 
 struct ksymb_tbl_s* create_ksymbs_tbl(void)
@@ -143,12 +145,13 @@ struct ksymb_tbl_s* create_ksymbs_tbl(void)
     }
     (void)memset(tbl, 0, size);
     tbl->ksym_size = 0;
+    tbl->cache = symb_cache_new(KERN_SYMB_CACHE_BITS);    // Runs without cache if failed
     return tbl;
 }
 
 static char __kern_unknow_symb[] = "[kernel]";
 
-int search_kern_addr_symb(struct ksymb_tbl_s *ksymbs, u64 addr, struct addr_symb_s *addr_symb)
+static int __search_kern_addr_symb(struct ksymb_tbl_s *ksymbs, u64 addr, struct addr_symb_s *addr_symb)
 {
     int start, end;
     int result;
@@ -202,6 +205,31 @@ int search_kern_addr_symb(struct ksymb_tbl_s *ksymbs, u64 addr, struct addr_symb
     return -1;
 }
 
+int search_kern_addr_symb(struct ksymb_tbl_s *ksymbs, u64 addr, struct addr_symb_s *addr_symb)
+{
+    int ret;
+
+    if (!ksymbs) {
+        return -1;
+    }
+
+    // init data, kept as is by a cached failure
+    addr_symb->orign_addr = addr;
+    addr_symb->sym = NULL;
+    addr_symb->mod = __kern_unknow_symb;
+    addr_symb->offset = 0;
+
+    if (ksymbs->cache && symb_cache_lookup(ksymbs->cache, addr, addr_symb, &ret)) {
+        return ret;
+    }
+
+    ret = __search_kern_addr_symb(ksymbs, addr, addr_symb);
+    if (ksymbs->cache) {
+        symb_cache_update(ksymbs->cache, addr, addr_symb, ret);
+    }
+    return ret;
+}
+
 static int __ksymb_cmp(const void *key1, const void *key2)
 {
     struct ksymb_s *symb1 = ((struct ksymb_s *)key1);
@@ -26,8 +26,11 @@ struct ksymb_s {
     char *kmod;
 };
 
+struct symb_cache_s;
+
 struct ksymb_tbl_s {
     u32 ksym_size;
+    struct symb_cache_s *cache;
     struct ksymb_s ksyms[];
 };
 
@@ -0,0 +1,610 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2023. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: mergeable quantile sketch
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "qsketch.h"
+
+/*
+ * Everything in src/common is linked into all probes without libm, so log2()/exp2() are replaced by
+ * frexp()/ldexp() (in libc) and the series below, used on a mantissa in [1, 2) only.
+ */
+#define QS_LN2      0.69314718055994530942
+#define QS_EPSILON  1e-17
+
+#if 1 // Math
+
+// log2(m), m in [1, 2): ln(m) = 2 * atanh((m - 1) / (m + 1)), |z| <= 1/3
+static double qs_log2_frac(double m)
+{
+    double z = (m - 1) / (m + 1);
+    double z2 = z * z;
+    double term = z;
+    double sum = 0;
+
+    for (int k = 1; term > QS_EPSILON; k += 2) {
+        sum += term / k;
+        term *= z2;
+    }
+    return 2 * sum / QS_LN2;
+}
+
+// 2^f, f in [0, 1): taylor series of e^(f * ln2)
+static double qs_exp2_frac(double f)
+{
+    double x = f * QS_LN2;
+    double term = 1;
+    double sum = 1;
+
+    for (int k = 1; term > QS_EPSILON; k++) {
+        term = term * x / k;
+        sum += term;
+    }
+    return sum;
+}
+
+// floor(index / 2^shift), right shift of a negative int is implementation defined
+static int qs_shift_down(int index, int shift)
+{
+    if (index >= 0) {
+        return index >> shift;
+    }
+    return -((-index - 1) >> shift) - 1;
+}
+
+// index of the bucket holding v (v > 0), same as the OTLP exponential histogram
+static int qs_index(int scale, double v)
+{
+    int exp, frac;
+    double m = frexp(v, &exp);
+
+    // v = m * 2^exp, m in [1, 2)
+    m *= 2;
+    exp -= 1;
+
+    if (scale <= 0) {
+        // the power of 2 is the upper bound of the previous bucket
+        return qs_shift_down(m == 1.0 ? (exp - 1) : exp, -scale);
+    }
+
+    if (m == 1.0) {
+        return exp * (1 << scale) - 1;
+    }
+    frac = (int)(qs_log2_frac(m) * (1 << scale));
+    if (frac >= (1 << scale)) {
+        frac = (1 << scale) - 1;
+    }
+    return exp * (1 << scale) + frac;
+}
+
+double qsketch_bucket_lower(int scale, int index)
+{
+    int k;
+
+    if (scale <= 0) {
+        return ldexp(1.0, index * (1 << -scale));
+    }
+
+    k = qs_shift_down(index, scale);
+    return ldexp(qs_exp2_frac((double)(index - k * (1 << scale)) / (1 << scale)), k);
+}
+
+#endif
+
+#if 1 // Buckets
+
+static void qs_downscale(struct qsketch_s *sk, int shift)
+{
+    int offset;
+    u32 i, j;
+    u64 n;
+
+    if (shift <= 0) {
+        return;
+    }
+    sk->scale -= shift;
+    if (sk->len == 0) {
+        return;
+    }
+
+    // buckets only move to lower positions, so merge them in place
+    offset = qs_shift_down(sk->offset, shift);
+    for (i = 0; i < sk->len; i++) {
+        n = sk->counts[i];
+        sk->counts[i] = 0;
+        j = (u32)(qs_shift_down(sk->offset + (int)i, shift) - offset);
+        sk->counts[j] += n;
+    }
+    sk->len = (u32)(qs_shift_down(sk->offset + (int)sk->len - 1, shift) - offset + 1);
+    sk->offset = offset;
+}
+
+/*
+ * Make buckets [lo, hi] of the current scale fit into the sketch together with those in use,
+ * return how much the scale is reduced.
+ */
+static int qs_fit(struct qsketch_s *sk, int lo, int hi)
+{
+    int shift = 0;
+    int first, last;
+
+    if (sk->len > 0) {
+        lo = (lo < sk->offset) ? lo : sk->offset;
+        hi = (hi > sk->offset + (int)sk->len - 1) ? hi : sk->offset + (int)sk->len - 1;
+    }
+    while (sk->scale - shift > QSKETCH_SCALE_MIN &&
+           (s64)qs_shift_down(hi, shift) - qs_shift_down(lo, shift) + 1 > sk->max_buckets) {
+        shift++;
+    }
+    qs_downscale(sk, shift);
+
+    lo = qs_shift_down(lo, shift);
+    hi = qs_shift_down(hi, shift);
+    if (sk->len == 0) {
+        sk->offset = lo;
+        sk->len = 1;
+    }
+    first = sk->offset;
+    last = sk->offset + (int)sk->len - 1;
+
+    // out of range even at QSKETCH_SCALE_MIN, values beyond are clamped into the edge buckets
+    if ((s64)last - lo + 1 > sk->max_buckets) {
+        lo = last - (int)sk->max_buckets + 1;
+    }
+    if ((s64)hi - ((lo < first) ? lo : first) + 1 > sk->max_buckets) {
+        hi = ((lo < first) ? lo : first) + (int)sk->max_buckets - 1;
+    }
+
+    if (lo < first) {
+        (void)memmove(sk->counts + (first - lo), sk->counts, sk->len * sizeof(u64));
+        (void)memset(sk->counts, 0, (size_t)(first - lo) * sizeof(u64));
+        sk->len += (u32)(first - lo);
+        sk->offset = lo;
+    }
+    if (hi > last) {
+        sk->len += (u32)(hi - last);
+    }
+    return shift;
+}
+
+static void qs_add_bucket(struct qsketch_s *sk, int index, u64 n)
+{
+    int pos = index - sk->offset;
+
+    if (pos < 0) {
+        pos = 0;
+    } else if (pos >= (int)sk->len) {
+        pos = (int)sk->len - 1;
+    }
+    sk->counts[pos] += n;
+}
+
+static void qs_add_stats(struct qsketch_s *sk, u64 count, double sum, double min, double max)
+{
+    if (sk->count == 0) {
+        sk->min = min;
+        sk->max = max;
+    } else {
+        sk->min = (min < sk->min) ? min : sk->min;
+        sk->max = (max > sk->max) ? max : sk->max;
+    }
+    sk->count += count;
+    sk->sum += sum;
+}
+
+#endif
+
+struct qsketch_s *qsketch_new(int scale, u32 max_buckets)
+{
+    struct qsketch_s *sk;
+
+    if (scale > QSKETCH_SCALE_MAX) {
+        scale = QSKETCH_SCALE_MAX;
+    } else if (scale < QSKETCH_SCALE_MIN) {
+        scale = QSKETCH_SCALE_MIN;
+    }
+    if (max_buckets == 0) {
+        max_buckets = QSKETCH_BUCKETS_DEFAULT;
+    } else if (max_buckets < QSKETCH_BUCKETS_MIN) {
+        max_buckets = QSKETCH_BUCKETS_MIN;
+    }
+
+    sk = (struct qsketch_s *)calloc(1, sizeof(struct qsketch_s));
+    if (sk == NULL) {
+        return NULL;
+    }
+    sk->counts = (u64 *)calloc(max_buckets, sizeof(u64));
+    if (sk->counts == NULL) {
+        free(sk);
+        return NULL;
+    }
+    sk->scale = scale;
+    sk->init_scale = scale;
+    sk->max_buckets = max_buckets;
+    return sk;
+}
+
+void qsketch_free(struct qsketch_s *sk)
+{
+    if (sk == NULL) {
+        return;
+    }
+    free(sk->counts);
+    free(sk);
+}
+
+void qsketch_reset(struct qsketch_s *sk)
+{
+    (void)memset(sk->counts, 0, sk->len * sizeof(u64));
+    sk->scale = sk->init_scale;
+    sk->offset = 0;
+    sk->len = 0;
+    sk->zero_count = 0;
+    sk->count = 0;
+    sk->sum = 0;
+    sk->min = 0;
+    sk->max = 0;
+}
+
+void qsketch_add_n(struct qsketch_s *sk, double value, u64 n)
+{
+    int index;
+
+    if (n == 0 || !isfinite(value)) {
+        return;
+    }
+
+    qs_add_stats(sk, n, value * (double)n, value, value);
+    if (value <= 0) {
+        sk->zero_count += n;
+        return;
+    }
+
+    index = qs_index(sk->scale, value);
+    index = qs_shift_down(index, qs_fit(sk, index, index));
+    qs_add_bucket(sk, index, n);
+}
+
+int qsketch_merge(struct qsketch_s *dst, const struct qsketch_s *src)
+{
+    int shift, lo, hi;
+
+    if (src->count == 0) {
+        return 0;
+    }
+
+    if (src->len > 0) {
+        if (dst->scale > src->scale) {
+            qs_downscale(dst, dst->scale - src->scale);
+        }
+        shift = src->scale - dst->scale;
+        lo = qs_shift_down(src->offset, shift);
+        hi = qs_shift_down(src->offset + (int)src->len - 1, shift);
+        shift += qs_fit(dst, lo, hi);
+
+        for (u32 i = 0; i < src->len; i++) {
+            if (src->counts[i] != 0) {
+                qs_add_bucket(dst, qs_shift_down(src->offset + (int)i, shift), src->counts[i]);
+            }
+        }
+    }
+
+    dst->zero_count += src->zero_count;
+    qs_add_stats(dst, src->count, src->sum, src->min, src->max);
+    return 0;
+}
+
+double qsketch_quantile(const struct qsketch_s *sk, double q)
+{
+    double rank, lower, upper, v;
+    u64 cum;
+
+    if (sk->count == 0) {
+        return 0;
+    }
+    if (q <= 0) {
+        return sk->min;
+    }
+    if (q >= 1) {
+        return sk->max;
+    }
+
+    rank = q * (double)(sk->count - 1);
+    cum = sk->zero_count;
+    if ((double)cum > rank) {
+        v = 0;
+        goto out;
+    }
+
+    for (u32 i = 0; i < sk->len; i++) {
+        cum += sk->counts[i];
+        if ((double)cum > rank) {
+            // the value with the same relative error to both bounds
+            lower = qsketch_bucket_lower(sk->scale, sk->offset + (int)i);
+            upper = qsketch_bucket_lower(sk->scale, sk->offset + (int)i + 1);
+            v = 2 * lower * upper / (lower + upper);
+            goto out;
+        }
+    }
+    v = sk->max;
+out:
+    if (v < sk->min) {
+        v = sk->min;
+    }
+    if (v > sk->max) {
+        v = sk->max;
+    }
+    return v;
+}
+
+u64 qsketch_count_le(const struct qsketch_s *sk, double le)
+{
+    u64 cum;
+
+    if (le < 0 || sk->count == 0) {
+        return 0;
+    }
+    if (le >= sk->max) {
+        return sk->count;
+    }
+
+    cum = sk->zero_count;
+    for (u32 i = 0; i < sk->len; i++) {
+        if (qsketch_bucket_lower(sk->scale, sk->offset + (int)i + 1) > le) {
+            break;
+        }
+        cum += sk->counts[i];
+    }
+    return cum;
+}
+
+#if 1 // Serialization
+
+static int qs_put_byte(unsigned char *buf, size_t size, size_t *pos, unsigned char c)
+{
+    if (*pos >= size) {
+        return -1;
+    }
+    buf[(*pos)++] = c;
+    return 0;
+}
+
+static int qs_put_varint(unsigned char *buf, size_t size, size_t *pos, u64 v)
+{
+    while (v >= 0x80) {
+        if (qs_put_byte(buf, size, pos, (unsigned char)(v | 0x80)) != 0) {
+            return -1;
+        }
+        v >>= 7;
+    }
+    return qs_put_byte(buf, size, pos, (unsigned char)v);
+}
+
+static int qs_put_double(unsigned char *buf, size_t size, size_t *pos, double d)
+{
+    u64 v;
+
+    (void)memcpy(&v, &d, sizeof(v));
+    for (size_t i = 0; i < sizeof(v); i++) {
+        if (qs_put_byte(buf, size, pos, (unsigned char)(v >> (i * 8))) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int qs_get_varint(const unsigned char *buf, size_t size, size_t *pos, u64 *v)
+{
+    int bits = 0;
+
+    *v = 0;
+    while (*pos < size && bits < 64) {
+        unsigned char c = buf[(*pos)++];
+        *v |= (u64)(c & 0x7f) << bits;
+        if ((c & 0x80) == 0) {
+            return 0;
+        }
+        bits += 7;
+    }
+    return -1;
+}
+
+static int qs_get_double(const unsigned char *buf, size_t size, size_t *pos, double *d)
+{
+    u64 v = 0;
+
+    if (*pos + sizeof(v) > size) {
+        return -1;
+    }
+    for (size_t i = 0; i < sizeof(v); i++) {
+        v |= (u64)buf[(*pos)++] << (i * 8);
+    }
+    (void)memcpy(d, &v, sizeof(v));
+    return 0;
+}
+
+#define QS_ZIGZAG(v)    (((u64)(s64)(v) << 1) ^ (u64)((s64)(v) >> 63))
+#define QS_UNZIGZAG(v)  ((s64)((v) >> 1) ^ -(s64)((v) & 1))
+
+int qsketch_serialize(const struct qsketch_s *sk, unsigned char *buf, size_t size)
+{
+    size_t pos = 0;
+    int ret = 0;
+
+    ret |= qs_put_byte(buf, size, &pos, QSKETCH_VERSION);
+    ret |= qs_put_byte(buf, size, &pos, (unsigned char)(s8)sk->scale);
+    ret |= qs_put_varint(buf, size, &pos, sk->count);
+    ret |= qs_put_varint(buf, size, &pos, sk->zero_count);
+    ret |= qs_put_double(buf, size, &pos, sk->sum);
+    ret |= qs_put_double(buf, size, &pos, sk->min);
+    ret |= qs_put_double(buf, size, &pos, sk->max);
+    ret |= qs_put_varint(buf, size, &pos, QS_ZIGZAG(sk->offset));
+    ret |= qs_put_varint(buf, size, &pos, sk->len);
+    for (u32 i = 0; i < sk->len && ret == 0; i++) {
+        ret |= qs_put_varint(buf, size, &pos, sk->counts[i]);
+    }
+
+    return (ret != 0) ? -1 : (int)pos;
+}
+
+struct qsketch_s *qsketch_deserialize(const unsigned char *buf, size_t size, u32 max_buckets)
+{
+    struct qsketch_s src = {0};
+    struct qsketch_s *sk = NULL;
+    size_t pos = 0;
+    u64 v, zero_count, offset, len;
+    int ret = 0;
+
+    if (size < QSKETCH_SER_HEAD_LEN || buf[0] != QSKETCH_VERSION) {
+        return NULL;
+    }
+    src.scale = (s8)buf[1];
+    pos = 2;
+    if (src.scale > QSKETCH_SCALE_MAX || src.scale < QSKETCH_SCALE_MIN) {
+        return NULL;
+    }
+
+    ret |= qs_get_varint(buf, size, &pos, &src.count);
+    ret |= qs_get_varint(buf, size, &pos, &zero_count);
+    ret |= qs_get_double(buf, size, &pos, &src.sum);
+    ret |= qs_get_double(buf, size, &pos, &src.min);
+    ret |= qs_get_double(buf, size, &pos, &src.max);
+    ret |= qs_get_varint(buf, size, &pos, &offset);
+    ret |= qs_get_varint(buf, size, &pos, &len);
+    // every count takes one byte at least
+    if (ret != 0 || len > size - pos) {
+        return NULL;
+    }
+    src.zero_count = zero_count;
+    src.offset = (int)QS_UNZIGZAG(offset);
+    src.len = (u32)len;
+
+    if (src.len > 0) {
+        src.counts = (u64 *)calloc(src.len, sizeof(u64));
+        if (src.counts == NULL) {
+            return NULL;
+        }
+        for (u32 i = 0; i < src.len; i++) {
+            if (qs_get_varint(buf, size, &pos, &v) != 0) {
+                goto out;
+            }
+            src.counts[i] = v;
+        }
+    }
+
+    sk = qsketch_new(src.scale, max_buckets);
+    if (sk != NULL) {
+        (void)qsketch_merge(sk, &src);
+    }
+out:
+    free(src.counts);
+    return sk;
+}
+
+static const char qs_b64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static int qs_b64_val(char c)
+{
+    const char *p;
+
+    if (c == '\0') {
+        return -1;
+    }
+    p = strchr(qs_b64, c);
+    return (p == NULL) ? -1 : (int)(p - qs_b64);
+}
+
+int qsketch_to_str(const struct qsketch_s *sk, char *str, size_t size)
+{
+    unsigned char *buf;
+    int len, i;
+    size_t pos = 0;
+    u32 v;
+
+    buf = (unsigned char *)malloc(QSKETCH_SER_MAX(sk->len));
+    if (buf == NULL) {
+        return -1;
+    }
+    len = qsketch_serialize(sk, buf, QSKETCH_SER_MAX(sk->len));
+    if (len < 0 || ((size_t)len + 2) / 3 * 4 + 1 > size) {
+        free(buf);
+        return -1;
+    }
+
+    for (i = 0; i + 2 < len; i += 3) {
+        v = ((u32)buf[i] << 16) | ((u32)buf[i + 1] << 8) | buf[i + 2];
+        str[pos++] = qs_b64[(v >> 18) & 0x3f];
+        str[pos++] = qs_b64[(v >> 12) & 0x3f];
+        str[pos++] = qs_b64[(v >> 6) & 0x3f];
+        str[pos++] = qs_b64[v & 0x3f];
+    }
+    if (i < len) {
+        v = (u32)buf[i] << 16;
+        if (i + 1 < len) {
+            v |= (u32)buf[i + 1] << 8;
+        }
+        str[pos++] = qs_b64[(v >> 18) & 0x3f];
+        str[pos++] = qs_b64[(v >> 12) & 0x3f];
+        str[pos++] = (i + 1 < len) ? qs_b64[(v >> 6) & 0x3f] : '=';
+        str[pos++] = '=';
+    }
+    str[pos] = 0;
+
+    free(buf);
+    return (int)pos;
+}
+
+struct qsketch_s *qsketch_from_str(const char *str, u32 max_buckets)
+{
+    struct qsketch_s *sk;
+    unsigned char *buf;
+    size_t slen = strlen(str);
+    size_t len = 0;
+    int c[4];
+
+    if (slen == 0 || slen % 4 != 0) {
+        return NULL;
+    }
+    buf = (unsigned char *)malloc(slen / 4 * 3);
+    if (buf == NULL) {
+        return NULL;
+    }
+
+    for (size_t i = 0; i < slen; i += 4) {
+        for (int j = 0; j < 4; j++) {
+            c[j] = qs_b64_val(str[i + j]);
+        }
+        if (c[0] < 0 || c[1] < 0 || (c[2] < 0 && str[i + 2] != '=') ||
+            (c[3] < 0 && str[i + 3] != '=')) {
+            free(buf);
+            return NULL;
+        }
+        buf[len++] = (unsigned char)((c[0] << 2) | (c[1] >> 4));
+        if (c[2] >= 0) {
+            buf[len++] = (unsigned char)(((c[1] & 0xf) << 4) | (c[2] >> 2));
+        }
+        if (c[2] >= 0 && c[3] >= 0) {
+            buf[len++] = (unsigned char)(((c[2] & 0x3) << 6) | c[3]);
+        }
+    }
+
+    sk = qsketch_deserialize(buf, len, max_buckets);
+    free(buf);
+    return sk;
+}
+
+#endif
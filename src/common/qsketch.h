@@ -0,0 +1,103 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2023. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: mergeable quantile sketch
+ ******************************************************************************/
+#ifndef __GOPHER_QSKETCH_H__
+#define __GOPHER_QSKETCH_H__
+
+#pragma once
+
+#include "common.h"
+
+/*
+ * Exponential buckets of base 2^(2^-scale), the same layout as the OTLP exponential histogram and
+ * the prometheus native histogram (schema == scale), so a sketch is exported without re-bucketing.
+ * Bucket i holds the values in (base^i, base^(i+1)], a quantile is answered with a relative error
+ * of (base - 1) / (base + 1) at most, 0.54% at the default scale.
+ *
+ * A sketch keeps QSKETCH_BUCKETS_DEFAULT buckets at most, when the values span more buckets than that
+ * the scale is reduced (every 2 neighbour buckets are merged into one) until they fit again.
+ * E.g. 320 buckets at scale 4 span 20 powers of 2(1us ~ 1s) with a relative error of 2.2%.
+ *
+ * Only non-negative values are kept, negative values are counted as zero.
+ */
+#define QSKETCH_SCALE_MAX           8
+#define QSKETCH_SCALE_MIN           (-4)
+#define QSKETCH_SCALE_DEFAULT       6
+#define QSKETCH_BUCKETS_DEFAULT     320
+#define QSKETCH_BUCKETS_MIN         8
+
+#define QSKETCH_VERSION             1
+#define QSKETCH_SER_HEAD_LEN        (2 + 3 * sizeof(double))
+#define QSKETCH_VARINT_MAX          10
+#define QSKETCH_SER_MAX(max_buckets) \
+    (QSKETCH_SER_HEAD_LEN + (4 + (max_buckets)) * QSKETCH_VARINT_MAX)
+#define QSKETCH_STR_MAX(max_buckets) \
+    ((QSKETCH_SER_MAX(max_buckets) + 2) / 3 * 4 + 1)
+
+/*
+ * counts[i] is OTLP bucket 'offset + i', the same bucket is numbered 'offset + i + 1' in prometheus
+ * native histograms whose buckets are (base^(i-1), base^i].
+ */
+struct qsketch_s {
+    int scale;
+    int init_scale;             // scale restored by qsketch_reset()
+    int offset;                 // bucket index of counts[0]
+    u32 len;                    // buckets in use, counts[0 .. len - 1]
+    u32 max_buckets;
+    u64 zero_count;
+    u64 count;
+    double sum;
+    double min;
+    double max;
+    u64 *counts;
+};
+
+struct qsketch_s *qsketch_new(int scale, u32 max_buckets);
+void qsketch_free(struct qsketch_s *sk);
+void qsketch_reset(struct qsketch_s *sk);
+
+void qsketch_add_n(struct qsketch_s *sk, double value, u64 n);
+static inline void qsketch_add(struct qsketch_s *sk, double value)
+{
+    qsketch_add_n(sk, value, 1);
+}
+
+/* Merge src into dst, src is not changed. */
+int qsketch_merge(struct qsketch_s *dst, const struct qsketch_s *src);
+
+/* q in [0, 1], return 0 for an empty sketch */
+double qsketch_quantile(const struct qsketch_s *sk, double q);
+
+/* Lower bound of bucket 'index' at 'scale', the upper bound is the lower bound of index + 1. */
+double qsketch_bucket_lower(int scale, int index);
+
+/*
+ * Count of values <= le, for the classic histograms whose bounds are not bucket bounds of the sketch.
+ * A bucket is counted when its upper bound is <= le, so the result is an under-estimate by at most
+ * the bucket containing le.
+ */
+u64 qsketch_count_le(const struct qsketch_s *sk, double le);
+
+/*
+ * Compact binary form: version, scale, count, zero count, sum/min/max, offset and counts, integers are
+ * LEB128 varints (signed ones zigzag encoded). Return the bytes written, -1 if buf is too small.
+ */
+int qsketch_serialize(const struct qsketch_s *sk, unsigned char *buf, size_t size);
+struct qsketch_s *qsketch_deserialize(const unsigned char *buf, size_t size, u32 max_buckets);
+
+/* base64 of the binary form, fit for the '|' separated tables output by probes */
+int qsketch_to_str(const struct qsketch_s *sk, char *str, size_t size);
+struct qsketch_s *qsketch_from_str(const char *str, u32 max_buckets);
+
+#endif
@@ -0,0 +1,129 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: address to symbol cache
+ ******************************************************************************/
+#ifndef __SYMB_CACHE_H__
+#define __SYMB_CACHE_H__
+
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include "common.h"
+#include "kern_symb.h"
+
+/*
+ * Direct-mapped cache in front of the binary searches of symbol tables. Samples hit mostly
+ * the same hot addresses, a slot holds the result of the last address mapped to it, failed
+ * searches included. Address 0 is never searched, it marks an empty slot.
+ */
+#define KERN_SYMB_CACHE_BITS    12
+#define PROC_SYMB_CACHE_BITS    10
+
+struct symb_cache_entry_s {
+    u64 addr;
+    char *sym;
+    char *mod;
+    u64 offset;
+    int ret;
+};
+
+struct symb_cache_s {
+    u32 bits;
+    u64 hits;
+    u64 misses;
+    struct symb_cache_entry_s entries[];
+};
+
+static inline __maybe_unused struct symb_cache_s *symb_cache_new(u32 bits)
+{
+    size_t size = sizeof(struct symb_cache_s) + ((size_t)1 << bits) * sizeof(struct symb_cache_entry_s);
+    struct symb_cache_s *cache = (struct symb_cache_s *)malloc(size);
+
+    if (cache == NULL) {
+        return NULL;
+    }
+    (void)memset(cache, 0, size);
+    cache->bits = bits;
+    return cache;
+}
+
+static inline __maybe_unused void symb_cache_free(struct symb_cache_s **ptr_cache)
+{
+    if (*ptr_cache != NULL) {
+        (void)free(*ptr_cache);
+        *ptr_cache = NULL;
+    }
+}
+
+/* Drop the cached results when the symbols change, the counters are kept. */
+static inline __maybe_unused void symb_cache_reset(struct symb_cache_s *cache)
+{
+    if (cache != NULL) {
+        (void)memset(cache->entries, 0, ((size_t)1 << cache->bits) * sizeof(struct symb_cache_entry_s));
+    }
+}
+
+static inline __maybe_unused struct symb_cache_entry_s *symb_cache_slot(struct symb_cache_s *cache, u64 addr)
+{
+    /* Fibonacci hashing, neighbouring addresses spread over the slots */
+    u64 idx = (addr * 0x9E3779B97F4A7C15ULL) >> (64 - cache->bits);
+    return &cache->entries[idx];
+}
+
+/* Return 1 on hit and fill 'addr_symb' and 'ret' as the search did. */
+static inline __maybe_unused int symb_cache_lookup(struct symb_cache_s *cache, u64 addr,
+    struct addr_symb_s *addr_symb, int *ret)
+{
+    struct symb_cache_entry_s *entry = symb_cache_slot(cache, addr);
+
+    if (entry->addr != addr) {
+        cache->misses++;
+        return 0;
+    }
+
+    cache->hits++;
+    *ret = entry->ret;
+    addr_symb->orign_addr = addr;
+    if (entry->ret == 0) {
+        addr_symb->sym = entry->sym;
+        addr_symb->mod = entry->mod;
+        addr_symb->offset = entry->offset;
+    }
+    return 1;
+}
+
+static inline __maybe_unused void symb_cache_update(struct symb_cache_s *cache, u64 addr,
+    const struct addr_symb_s *addr_symb, int ret)
+{
+    struct symb_cache_entry_s *entry = symb_cache_slot(cache, addr);
+
+    entry->addr = addr;
+    entry->ret = ret;
+    entry->sym = addr_symb->sym;
+    entry->mod = addr_symb->mod;
+    entry->offset = addr_symb->offset;
+}
+
+/* Read and clear the counters, used by per-period statistics. */
+static inline __maybe_unused void symb_cache_take_stats(struct symb_cache_s *cache, u64 *hits, u64 *misses)
+{
+    if (cache != NULL) {
+        *hits += cache->hits;
+        *misses += cache->misses;
+        cache->hits = 0;
+        cache->misses = 0;
+    }
+}
+
+#endif
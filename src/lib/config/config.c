@@ -475,6 +475,13 @@ static int ConfigMgrLoadWebServerConfig(void *config, config_setting_t *settings
     }
     webServerConfig->port = (uint16_t)intVal;
 
+    ret = config_setting_lookup_string(settings, "flamegraph_dir", &strVal);
+    if (ret == 0) {
+        INFO("[CONFIG] flamegraph_dir of webServerConfig not set, flame graphs are not served.\n");
+    } else {
+        (void)strncpy(webServerConfig->flamegraphDir, strVal, PATH_LEN - 1);
+    }
+
     return 0;
 }
 
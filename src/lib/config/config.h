@@ -87,6 +87,7 @@ typedef struct  {
 
 typedef struct {
     uint16_t port;
+    char flamegraphDir[PATH_LEN];
 } WebServerConfig;
 
 typedef struct {
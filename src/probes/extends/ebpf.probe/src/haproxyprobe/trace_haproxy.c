@@ -28,6 +28,7 @@
 
 #include "bpf.h"
 #include "args.h"
+#include "map_batch.h"
 #include "trace_haproxy.skel.h"
 #include "trace_haproxy.h"
 
@@ -77,10 +78,10 @@ static void update_collect_count(struct collect_value *dd)
     return;
 }
 
-static void update_haproxy_collect_map(struct link_key *k, struct link_value *v, int map_fd)
+static void update_haproxy_collect(const struct link_key *k, const struct link_value *v, struct map_agg_s *collect)
 {
     struct collect_key      key = {0};
-    struct collect_value    val = {0};
+    struct collect_value    *val;
 
     /* build key */
     memcpy((char *)&key.c_addr, (char *)&k->c_addr, sizeof(struct ip));
@@ -89,88 +90,82 @@ static void update_haproxy_collect_map(struct link_key *k, struct link_value *v,
     key.p_port = k->p_port;
     key.s_port = k->s_port;
     /* lookup value */
-    (void)bpf_map_lookup_elem(map_fd, &key, &val);
+    val = (struct collect_value *)map_agg_lookup_or_init(collect, &key);
+    if (val == NULL) {
+        return;
+    }
     /* update value */
-    update_collect_count(&val);
-    val.family = v->family;
-    val.protocol = v->type;
-    val.pid = v->pid;
-    /* update hash map */
-    (void)bpf_map_update_elem(map_fd, &key, &val, BPF_ANY);
+    update_collect_count(val);
+    val->family = v->family;
+    val->protocol = v->type;
+    val->pid = v->pid;
 
     return;
 }
 
-static void pull_probe_data(int fd, int collect_fd)
+static int pull_link(const void *k, const void *v, void *ctx)
 {
-    int ret = 0;
-    struct link_key     key = {0};
-    struct link_key     next_key = {0};
-    struct link_value   value = {0};
+    const struct link_key *key = (const struct link_key *)k;
+    const struct link_value *value = (const struct link_value *)v;
     unsigned char cli_ip_str[INET6_ADDRSTRLEN];
     unsigned char lb_ip_str[INET6_ADDRSTRLEN];
     unsigned char src_ip_str[INET6_ADDRSTRLEN];
 
-    while (bpf_map_get_next_key(fd, &key, &next_key) == 0) {
-        ret = bpf_map_lookup_elem(fd, &next_key, &value);
-        if (ret == 0) {
-            ip_str(value.family, (unsigned char *)&(next_key.c_addr), cli_ip_str, INET6_ADDRSTRLEN);
-            ip_str(value.family, (unsigned char *)&(next_key.p_addr), lb_ip_str, INET6_ADDRSTRLEN);
-            ip_str(value.family, (unsigned char *)&(next_key.s_addr), src_ip_str, INET6_ADDRSTRLEN);
-            if (next_key.p_addr.ip4 == 0x0) {
-                get_host_ip(lb_ip_str, value.family);
-            }
-        DEBUG("---- new connect protocol[%s] type[%s] c[%s:%d]--lb[%s:%d]--s[%s:%d] state[%d]. \n",
-                (value.type == PR_MODE_TCP) ? "TCP" : "HTTP",
-                (value.family == AF_INET) ? "IPv4" : "IPv6",
-                cli_ip_str,
-                ntohs(next_key.c_port),
-                lb_ip_str,
-                ntohs(next_key.p_port),
-                src_ip_str,
-                ntohs(next_key.s_port),
-                value.state);
-            /* update collect map */
-            update_haproxy_collect_map(&next_key, &value, collect_fd);
-        }
-        if (value.state == SI_ST_CLO) {
-            (void)bpf_map_delete_elem(fd, &next_key);
-        } else {
-            key = next_key;
-        }
+    ip_str(value->family, (unsigned char *)&(key->c_addr), cli_ip_str, INET6_ADDRSTRLEN);
+    ip_str(value->family, (unsigned char *)&(key->p_addr), lb_ip_str, INET6_ADDRSTRLEN);
+    ip_str(value->family, (unsigned char *)&(key->s_addr), src_ip_str, INET6_ADDRSTRLEN);
+    if (key->p_addr.ip4 == 0x0) {
+        get_host_ip(lb_ip_str, value->family);
     }
+    DEBUG("---- new connect protocol[%s] type[%s] c[%s:%d]--lb[%s:%d]--s[%s:%d] state[%d]. \n",
+        (value->type == PR_MODE_TCP) ? "TCP" : "HTTP",
+        (value->family == AF_INET) ? "IPv4" : "IPv6",
+        cli_ip_str,
+        ntohs(key->c_port),
+        lb_ip_str,
+        ntohs(key->p_port),
+        src_ip_str,
+        ntohs(key->s_port),
+        value->state);
+    /* update collect table */
+    update_haproxy_collect(key, value, (struct map_agg_s *)ctx);
+
+    return (value->state == SI_ST_CLO) ? MAP_BATCH_DEL : MAP_BATCH_KEEP;
 }
 
-static void print_haproxy_collect(int map_fd)
+static void pull_probe_data(struct map_batch_s *batch, struct map_agg_s *collect)
 {
-    int ret = 0;
-    struct collect_key  key = {0};
-    struct collect_key  next_key = {0};
-    struct collect_value    value = {0};
+    (void)map_batch_walk(batch, pull_link, (void *)collect);
+}
+
+static void print_haproxy_collect(struct map_agg_s *collect)
+{
+    struct collect_key  *key;
+    struct collect_value    *value;
     unsigned char cli_ip_str[INET6_ADDRSTRLEN];
     unsigned char lb_ip_str[INET6_ADDRSTRLEN];
     unsigned char src_ip_str[INET6_ADDRSTRLEN];
 
-    while (bpf_map_get_next_key(map_fd, &key, &next_key) != -1) {
-        ret = bpf_map_lookup_elem(map_fd, &next_key, &value);
-        if (ret == 0) {
-            ip_str(value.family, (unsigned char *)&(next_key.c_addr), cli_ip_str, INET6_ADDRSTRLEN);
-            ip_str(value.family, (unsigned char *)&(next_key.p_addr), lb_ip_str, INET6_ADDRSTRLEN);
-            ip_str(value.family, (unsigned char *)&(next_key.s_addr), src_ip_str, INET6_ADDRSTRLEN);
+    for (__u32 i = 0; i < collect->num; i++) {
+        key = (struct collect_key *)map_agg_key(collect, i);
+        value = (struct collect_value *)map_agg_value(collect, i);
+
+        ip_str(value->family, (unsigned char *)&(key->c_addr), cli_ip_str, INET6_ADDRSTRLEN);
+        ip_str(value->family, (unsigned char *)&(key->p_addr), lb_ip_str, INET6_ADDRSTRLEN);
+        ip_str(value->family, (unsigned char *)&(key->s_addr), src_ip_str, INET6_ADDRSTRLEN);
         fprintf(stdout,
                 "|%s|%s|%s|%s|%u|%u|%u|%llu|\n",
                 METRIC_NAME_HAPROXY_LINK,
                 cli_ip_str,
                 lb_ip_str,
                 src_ip_str,
-                ntohs(next_key.p_port),
-                ntohs(next_key.s_port),
-                value.protocol,
-                value.link_count);
-        }
-        (void)bpf_map_delete_elem(map_fd, &next_key);
+                ntohs(key->p_port),
+                ntohs(key->s_port),
+                value->protocol,
+                value->link_count);
     }
     (void)fflush(stdout);
+    map_agg_reset(collect);
     return;
 }
 
@@ -178,7 +173,8 @@ static void print_haproxy_collect(int map_fd)
 int main(int argc, char **argv)
 {
     int err = -1;
-    int collect_map_fd = -1;
+    struct map_batch_s *batch = NULL;
+    struct map_agg_s *collect = NULL;
     char *elf[PATH_NUM] = {0};
     int elf_num = -1;
     int attach_flag = 0;
@@ -219,27 +215,23 @@ int main(int argc, char **argv)
     if (attach_flag == 0)
         goto err;
 
-    /* create collect hash map */
-#if (CURRENT_LIBBPF_VERSION  >= LIBBPF_VERSION(0, 8))
-    collect_map_fd =
-        bpf_map_create(BPF_MAP_TYPE_HASH, NULL, sizeof(struct collect_key), sizeof(struct collect_value), METRIC_ENTRIES, NULL);
-#else
-    collect_map_fd =
-        bpf_create_map(BPF_MAP_TYPE_HASH, sizeof(struct collect_key), sizeof(struct collect_value), METRIC_ENTRIES, 0);
-#endif
-    if (collect_map_fd < 0) {
-        fprintf(stderr, "Haproxy Failed to create map.\n");
+    batch = map_batch_new(GET_MAP_FD(trace_haproxy, haproxy_link_map), sizeof(struct link_key), sizeof(struct link_value));
+    collect = map_agg_new(sizeof(struct collect_key), sizeof(struct collect_value), METRIC_ENTRIES);
+    if (batch == NULL || collect == NULL) {
+        fprintf(stderr, "Haproxy Failed to create collect table.\n");
         goto err;
     }
 
     while (!g_stop) {
-        pull_probe_data(GET_MAP_FD(trace_haproxy, haproxy_link_map), collect_map_fd);
-        print_haproxy_collect(collect_map_fd);
+        pull_probe_data(batch, collect);
+        print_haproxy_collect(collect);
         sleep(params.period);
     }
 
 err:
 /* Clean up */
+    map_batch_free(&batch);
+    map_agg_free(&collect);
     UNLOAD(trace_haproxy);
     return 0;
 }
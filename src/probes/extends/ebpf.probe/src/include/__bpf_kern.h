@@ -234,17 +234,23 @@ static __always_inline __maybe_unused char is_compat_task(struct task_struct *ta
 #endif
 
 
-static __always_inline __maybe_unused struct sock *sock_get_by_fd(int fd, struct task_struct *task)
+static __always_inline __maybe_unused struct file *file_get_by_fd(int fd, struct task_struct *task)
 {
     struct file *f;
     struct file **ff = BPF_CORE_READ(task, files, fdt, fd);
     unsigned int max_fds = BPF_CORE_READ(task, files, fdt, max_fds);
 
-    if (fd >= max_fds) {
+    if (fd < 0 || fd >= max_fds) {
         return 0;
     }
 
     bpf_probe_read_kernel(&f, sizeof(struct file *), (struct file *)(ff + fd));
+    return f;
+}
+
+static __always_inline __maybe_unused struct sock *sock_get_by_fd(int fd, struct task_struct *task)
+{
+    struct file *f = file_get_by_fd(fd, task);
     if (!f) {
         return 0;
     }
@@ -287,6 +293,159 @@ static __always_inline __maybe_unused struct sock *sock_get_by_fd(int fd, struct
     bpf_section("kretprobe/" #func) \
     int __kprobe_ret_bpf_##func(struct type *ctx)
 
+#if 1 // Programs attached by fentry/fexit/tp_btf if the kernel supports, otherwise by kprobe/kretprobe/raw_tracepoint
+
+/*
+ * The body is written once with the typed parameters of the kernel function, both variants call it and
+ * the loader keeps one of them(see btf_attach_select()). 'ctx' in the body is only good for helpers
+ * taking an opaque context, e.g. bpf_perf_event_output.
+ *
+ *   KPROBE_FENTRY(tcp_sendmsg, struct sock *sk, struct msghdr *msg, size_t size) {...}
+ *   KPROBE_RET_FEXIT(tcp_check_oom, CTX_KERNEL, bool ret, struct sock *sk, int shift) {...}
+ *   KRAWTRACE_BTF(tcp_probe, struct sock *sk, struct sk_buff *skb) {...}
+ *
+ * fexit finds the return value after the last parameter, so KPROBE_RET_FEXIT must list all of them,
+ * its kretprobe variant gets them stashed at entry like KPROBE_RET. KRETPROBE_FEXIT is for a body reading
+ * neither of them(e.g. timing the function with an entry probe), its parameters are only counted:
+ *
+ *   KRETPROBE_FEXIT(ext4_sync_file, struct file *file, loff_t start, loff_t end, int datasync) {...}
+ *
+ * The number of parameters is a part of the fentry/fexit/tp_btf program name, so the loader checks
+ * it against the kernel BTF before choosing them.
+ */
+#define __PROG_NARG(params...) ___PROG_NARG(_, ##params, 6, 5, 4, 3, 2, 1, 0)
+#define ___PROG_NARG(_, a1, a2, a3, a4, a5, a6, N, ...) N
+#define __PROG_CONCAT(a, b) ___PROG_CONCAT(a, b)
+#define ___PROG_CONCAT(a, b) a##b
+#define __PROG_NAME(prefix, func, params...) __PROG_CONCAT(__PROG_CONCAT(prefix, __PROG_NARG(params)), _##func)
+
+#define __PROG_ARG_REGS(regs, i) __PROG_CONCAT(__PROG_ARG_REGS, i)(regs)
+#define __PROG_ARG_REGS0(regs) PT_REGS_PARM1(regs)
+#define __PROG_ARG_REGS1(regs) PT_REGS_PARM2(regs)
+#define __PROG_ARG_REGS2(regs) PT_REGS_PARM3(regs)
+#define __PROG_ARG_REGS3(regs) PT_REGS_PARM4(regs)
+#define __PROG_ARG_REGS4(regs) PT_REGS_PARM5(regs)
+#define __PROG_ARG_REGS5(regs) PT_REGS_PARM6(regs)
+#define __PROG_ARG_ARRAY(array, i) ((array)[i])
+#define __PROG_ARG_STASH(probe_val, i) ((probe_val).val.params[i])
+
+// ", arg0, arg1, ..." of the parameters, casted like BPF_PROG() of libbpf
+#define __PROG_ARGS(get, src, params...) __PROG_CONCAT(__PROG_ARGS, __PROG_NARG(params))(get, src)
+#define __PROG_ARGS0(get, src)
+#define __PROG_ARGS1(get, src) __PROG_ARGS0(get, src), (void *)get(src, 0)
+#define __PROG_ARGS2(get, src) __PROG_ARGS1(get, src), (void *)get(src, 1)
+#define __PROG_ARGS3(get, src) __PROG_ARGS2(get, src), (void *)get(src, 2)
+#define __PROG_ARGS4(get, src) __PROG_ARGS3(get, src), (void *)get(src, 3)
+#define __PROG_ARGS5(get, src) __PROG_ARGS4(get, src), (void *)get(src, 4)
+#define __PROG_ARGS6(get, src) __PROG_ARGS5(get, src), (void *)get(src, 5)
+
+#define __PROG_CALL(call) \
+    ({ \
+        _Pragma("GCC diagnostic push") \
+        _Pragma("GCC diagnostic ignored \"-Wint-conversion\"") \
+        int __ret = call; \
+        _Pragma("GCC diagnostic pop") \
+        __ret; \
+    })
+
+#if defined(GOPHER_BTF_ATTACH_ENABLE)
+#define __FENTRY_PROG(func, params...) \
+    bpf_section("fentry/" #func) \
+    int __PROG_NAME(bpf_fentry, func, ##params)(unsigned long long *ctx) \
+    { \
+        return __PROG_CALL(__fentry_body_##func(ctx __PROG_ARGS(__PROG_ARG_ARRAY, ctx, ##params))); \
+    }
+
+#define __FEXIT_PROG(func, params...) \
+    bpf_section("fexit/" #func) \
+    int __PROG_NAME(bpf_fexit, func, ##params)(unsigned long long *ctx) \
+    { \
+        return __PROG_CALL(__fexit_body_##func(ctx, (void *)ctx[__PROG_NARG(params)] \
+                                                __PROG_ARGS(__PROG_ARG_ARRAY, ctx, ##params))); \
+    }
+
+#define __FEXIT_NOARGS_PROG(func, params...) \
+    bpf_section("fexit/" #func) \
+    int __PROG_NAME(bpf_fexit, func, ##params)(unsigned long long *ctx) \
+    { \
+        return __fexit_body_##func(ctx); \
+    }
+
+#define __TP_BTF_PROG(tp, params...) \
+    bpf_section("tp_btf/" #tp) \
+    int __PROG_NAME(bpf_tp_btf, tp, ##params)(unsigned long long *ctx) \
+    { \
+        return __PROG_CALL(__tp_btf_body_##tp(ctx __PROG_ARGS(__PROG_ARG_ARRAY, ctx, ##params))); \
+    }
+#else
+#define __FENTRY_PROG(func, params...)
+#define __FEXIT_PROG(func, params...)
+#define __FEXIT_NOARGS_PROG(func, params...)
+#define __TP_BTF_PROG(tp, params...)
+#endif
+
+#define KPROBE_FENTRY(func, params...) \
+    static __always_inline int __fentry_body_##func(void *ctx, ##params); \
+    \
+    bpf_section("kprobe/" #func) \
+    int bpf_##func(struct pt_regs *ctx) \
+    { \
+        return __PROG_CALL(__fentry_body_##func(ctx __PROG_ARGS(__PROG_ARG_REGS, ctx, ##params))); \
+    } \
+    \
+    __FENTRY_PROG(func, ##params) \
+    static __always_inline int __fentry_body_##func(void *ctx, ##params)
+
+#define KPROBE_RET_FEXIT(func, caller_type, ret, params...) \
+    static __always_inline int __fexit_body_##func(void *ctx, ret, ##params); \
+    \
+    bpf_section("kprobe/" #func) \
+    int bpf_stash_##func(struct pt_regs *ctx) \
+    { \
+        KPROBE_PARMS_STASH(func, ctx, caller_type); \
+        return 0; \
+    } \
+    \
+    bpf_section("kretprobe/" #func) \
+    int bpf_ret_##func(struct pt_regs *ctx) \
+    { \
+        struct probe_val __val; \
+        if (PROBE_GET_PARMS(func, ctx, __val, caller_type) < 0) { \
+            return 0; \
+        } \
+        return __PROG_CALL(__fexit_body_##func(ctx, (void *)PT_REGS_RC(ctx) \
+                                                __PROG_ARGS(__PROG_ARG_STASH, __val, ##params))); \
+    } \
+    \
+    __FEXIT_PROG(func, ##params) \
+    static __always_inline int __fexit_body_##func(void *ctx, ret, ##params)
+
+#define KRETPROBE_FEXIT(func, params...) \
+    static __always_inline int __fexit_body_##func(void *ctx); \
+    \
+    bpf_section("kretprobe/" #func) \
+    int bpf_ret_##func(struct pt_regs *ctx) \
+    { \
+        return __fexit_body_##func(ctx); \
+    } \
+    \
+    __FEXIT_NOARGS_PROG(func, ##params) \
+    static __always_inline int __fexit_body_##func(void *ctx)
+
+#define KRAWTRACE_BTF(tp, params...) \
+    static __always_inline int __tp_btf_body_##tp(void *ctx, ##params); \
+    \
+    bpf_section("raw_tracepoint/" #tp) \
+    int bpf_raw_trace_##tp(struct bpf_raw_tracepoint_args *ctx) \
+    { \
+        return __PROG_CALL(__tp_btf_body_##tp(ctx __PROG_ARGS(__PROG_ARG_ARRAY, ctx->args, ##params))); \
+    } \
+    \
+    __TP_BTF_PROG(tp, ##params) \
+    static __always_inline int __tp_btf_body_##tp(void *ctx, ##params)
+
+#endif
+
 #endif
 
 #endif
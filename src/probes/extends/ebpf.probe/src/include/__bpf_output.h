@@ -0,0 +1,119 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: output channel of bpf prog
+ ******************************************************************************/
+#ifndef __GOPHER_BPF_OUTPUT_H__
+#define __GOPHER_BPF_OUTPUT_H__
+
+#pragma once
+
+#if defined(BPF_PROG_KERN) || defined(BPF_PROG_USER)
+
+/*
+ * Output channel declared by BPF_OUTPUT_MAP, user space reads it by create_bpf_buffer().
+ *
+ * With GOPHER_RINGBUF_ENABLE it is a BPF ring buffer shared by all CPUs, records keep
+ * their order and big records are built in place (bpf_output_reserve/bpf_output_submit)
+ * rather than on the bpf stack. Otherwise it falls back to perf event array, and the
+ * reserved record lives in a per-cpu scratch map declared by BPF_OUTPUT_SCRATCH_MAP.
+ *
+ * Usage:
+ *     BPF_OUTPUT_MAP(output, BPF_OUTPUT_BUF_SIZE);
+ *     BPF_OUTPUT_SCRATCH_MAP(output_scratch, struct xxx_evt_s);
+ *
+ *     evt = bpf_output_reserve(&output, &output_scratch, struct xxx_evt_s);
+ *     if (evt) {
+ *         ... fill all fields of evt ...
+ *         bpf_output_submit(ctx, &output, evt);
+ *     }
+ */
+
+// Size of ring buffer, must be power of 2 and multiple of page size.
+#define BPF_OUTPUT_BUF_SIZE     (256 * 1024)
+
+// User space is waked up only when so many bytes are pending in ring buffer, 0 means every record.
+// Define it before including "bpf.h" to batch wakeups of a probe.
+#ifndef BPF_OUTPUT_WAKEUP_BYTES
+#define BPF_OUTPUT_WAKEUP_BYTES 0
+#endif
+
+#if defined(GOPHER_RINGBUF_ENABLE)
+
+#define BPF_OUTPUT_MAP(name, size) \
+    struct { \
+        __uint(type, BPF_MAP_TYPE_RINGBUF); \
+        __uint(max_entries, size); \
+    } name SEC(".maps")
+
+// Ring buffer reserves records in itself, no scratch is needed.
+#define BPF_OUTPUT_SCRATCH_MAP(name, type)
+
+static __always_inline __maybe_unused u64 __bpf_output_wakeup_flags(void *map)
+{
+#if (BPF_OUTPUT_WAKEUP_BYTES > 0)
+    if (bpf_ringbuf_query(map, BPF_RB_AVAIL_DATA) < BPF_OUTPUT_WAKEUP_BYTES) {
+        return BPF_RB_NO_WAKEUP;
+    }
+    return BPF_RB_FORCE_WAKEUP;
+#else
+    return 0;
+#endif
+}
+
+#define bpf_output(ctx, map, data, size) \
+    bpf_ringbuf_output(map, data, size, __bpf_output_wakeup_flags(map))
+
+#define bpf_output_reserve(map, scratch, type) \
+    ((type *)bpf_ringbuf_reserve(map, sizeof(type), 0))
+
+#define bpf_output_submit(ctx, map, data) \
+    bpf_ringbuf_submit(data, __bpf_output_wakeup_flags(map))
+
+#define bpf_output_discard(map, data) \
+    bpf_ringbuf_discard(data, 0)
+
+#else
+
+#define BPF_OUTPUT_MAP(name, size) \
+    struct { \
+        __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY); \
+        __uint(key_size, sizeof(u32)); \
+        __uint(value_size, sizeof(u32)); \
+    } name SEC(".maps")
+
+#define BPF_OUTPUT_SCRATCH_MAP(name, type) \
+    struct { \
+        __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY); \
+        __uint(key_size, sizeof(u32)); \
+        __uint(value_size, sizeof(type)); \
+        __uint(max_entries, 1); \
+    } name SEC(".maps")
+
+#define bpf_output(ctx, map, data, size) \
+    bpf_perf_event_output(ctx, map, BPF_F_CURRENT_CPU, data, size)
+
+#define bpf_output_reserve(map, scratch, type) \
+    ({ \
+        u32 __key = 0; \
+        (type *)bpf_map_lookup_elem(scratch, &__key); \
+    })
+
+#define bpf_output_submit(ctx, map, data) \
+    (void)bpf_perf_event_output(ctx, map, BPF_F_CURRENT_CPU, data, sizeof(*(data)))
+
+#define bpf_output_discard(map, data)
+
+#endif
+
+#endif
+#endif
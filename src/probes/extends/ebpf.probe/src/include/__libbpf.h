@@ -27,6 +27,7 @@
 #include "gopher_elf.h"
 #include "object.h"
 #include "common.h"
+#include "btf_attach.h"
 
 #define EBPF_RLIM_LIMITED  100*1024*1024 // 100M
 #define EBPF_RLIM_INFINITY (~0UL)
@@ -123,6 +124,7 @@ static __always_inline int set_memlock_rlimit(unsigned long limit)
             goto end; \
         } \
         __PIN_SHARE_MAP_ALL(probe_name); \
+        (void)btf_attach_select(probe_name##_skel->obj, #probe_name); \
         if (probe_name##_bpf__load(probe_name##_skel)) { \
             ERROR("Failed to load BPF " #probe_name " skeleton\n"); \
             goto end; \
@@ -162,12 +164,29 @@ static __always_inline int set_memlock_rlimit(unsigned long limit)
         } \
     } while (0)
     
+#if (CURRENT_LIBBPF_VERSION >= LIBBPF_VERSION(0, 8))
+#define __MAP_SET_MAX_ENTRIES(map, max_entries) bpf_map__set_max_entries(map, max_entries)
+#else
+#define __MAP_SET_MAX_ENTRIES(map, max_entries) bpf_map__resize(map, max_entries)
+#endif
+
+// Resize a map before it is loaded, all the progs sharing a pinned map must set the same size.
+#define MAP_SET_MAX_ENTRIES(probe_name, map_name, max_entries, load) \
+    do { \
+        if (load) \
+        { \
+            int ret = __MAP_SET_MAX_ENTRIES(GET_MAP_OBJ(probe_name, map_name), max_entries); \
+            DEBUG("======>map(" #map_name ") set max entries %u(ret=%d).\n", (u32)(max_entries), ret); \
+        } \
+    } while (0)
+
 #define LOAD_ATTACH(probe_name, end, load) \
     do { \
         if (load) \
         { \
             int err; \
             __PIN_SHARE_MAP_ALL(probe_name); \
+            (void)btf_attach_select(probe_name##_skel->obj, #probe_name); \
             if (probe_name##_bpf__load(probe_name##_skel)) { \
                 ERROR("Failed to load BPF " #probe_name " skeleton\n"); \
                 goto end; \
@@ -352,17 +371,18 @@ static __always_inline int set_memlock_rlimit(unsigned long limit)
 
 
 static __always_inline __maybe_unused struct perf_buffer* __do_create_pref_buffer(int map_fd,
-                perf_buffer_sample_fn cb, perf_buffer_lost_fn lost_cb)
+                perf_buffer_sample_fn cb, perf_buffer_lost_fn lost_cb, void *ctx)
 {
     struct perf_buffer *pb;
     int ret;
 
 #if (CURRENT_LIBBPF_VERSION  >= LIBBPF_VERSION(0, 8))
-    pb = perf_buffer__new(map_fd, 8, cb, lost_cb, NULL, NULL);
+    pb = perf_buffer__new(map_fd, 8, cb, lost_cb, ctx, NULL);
 #else
     struct perf_buffer_opts pb_opts = {};
     pb_opts.sample_cb = cb;
     pb_opts.lost_cb = lost_cb;
+    pb_opts.ctx = ctx;
     pb = perf_buffer__new(map_fd, 8, &pb_opts);
 #endif
     if (pb == NULL){
@@ -381,12 +401,28 @@ static __always_inline __maybe_unused struct perf_buffer* __do_create_pref_buffe
 static __always_inline __maybe_unused struct perf_buffer* create_pref_buffer2(int map_fd,
                 perf_buffer_sample_fn cb, perf_buffer_lost_fn lost_cb)
 {
-    return __do_create_pref_buffer(map_fd, cb, lost_cb);
+    return __do_create_pref_buffer(map_fd, cb, lost_cb, NULL);
 }
 
 static __always_inline __maybe_unused struct perf_buffer* create_pref_buffer(int map_fd, perf_buffer_sample_fn cb)
 {
-    return __do_create_pref_buffer(map_fd, cb, NULL);
+    return __do_create_pref_buffer(map_fd, cb, NULL, NULL);
+}
+
+static __always_inline __maybe_unused void __count_lost_samples(void *ctx, int cpu, __u64 cnt)
+{
+    __u64 *lost_cnt = (__u64 *)ctx;
+
+    if (lost_cnt != NULL) {
+        *lost_cnt += cnt;
+    }
+}
+
+/* Lost samples are accumulated into 'lost_cnt', which is passed as ctx of the perf buffer */
+static __always_inline __maybe_unused struct perf_buffer* create_pref_buffer3(int map_fd,
+                perf_buffer_sample_fn cb, __u64 *lost_cnt)
+{
+    return __do_create_pref_buffer(map_fd, cb, __count_lost_samples, (void *)lost_cnt);
 }
 
 static __always_inline __maybe_unused void poll_pb(struct perf_buffer *pb, int timeout_ms)
@@ -399,6 +435,123 @@ static __always_inline __maybe_unused void poll_pb(struct perf_buffer *pb, int t
     return;
 }
 
+/*
+ * User side of BPF_OUTPUT_MAP(see __bpf_output.h), a ring buffer with GOPHER_RINGBUF_ENABLE,
+ * otherwise a perf buffer. The sample callback keeps the perf buffer prototype, 'cpu' is
+ * always 0 for ring buffer.
+ */
+struct bpf_buffer_s {
+#if defined(GOPHER_RINGBUF_ENABLE)
+    struct ring_buffer *rb;
+    perf_buffer_sample_fn sample_cb;
+#else
+    struct perf_buffer *pb;
+#endif
+    __u64 lost;                 // only perf buffer reports lost samples
+};
+
+#if defined(GOPHER_RINGBUF_ENABLE)
+static __always_inline __maybe_unused int __bpf_buffer_sample(void *ctx, void *data, size_t size)
+{
+    struct bpf_buffer_s *buffer = (struct bpf_buffer_s *)ctx;
+
+    buffer->sample_cb(NULL, 0, data, (__u32)size);
+    return 0;
+}
+#endif
+
+static __always_inline __maybe_unused void free_bpf_buffer(struct bpf_buffer_s *buffer)
+{
+    if (buffer == NULL) {
+        return;
+    }
+#if defined(GOPHER_RINGBUF_ENABLE)
+    if (buffer->rb) {
+        ring_buffer__free(buffer->rb);
+    }
+#else
+    if (buffer->pb) {
+        perf_buffer__free(buffer->pb);
+    }
+#endif
+    (void)free(buffer);
+}
+
+static __always_inline __maybe_unused struct bpf_buffer_s* create_bpf_buffer(int map_fd, perf_buffer_sample_fn cb)
+{
+    struct bpf_buffer_s *buffer;
+
+    buffer = (struct bpf_buffer_s *)calloc(1, sizeof(struct bpf_buffer_s));
+    if (buffer == NULL) {
+        return NULL;
+    }
+
+#if defined(GOPHER_RINGBUF_ENABLE)
+    int ret;
+
+    buffer->sample_cb = cb;
+    buffer->rb = ring_buffer__new(map_fd, __bpf_buffer_sample, (void *)buffer, NULL);
+    ret = libbpf_get_error(buffer->rb);
+    if (buffer->rb == NULL || ret) {
+        fprintf(stderr, "ERROR: failed to setup ring_buffer: %d\n", ret);
+        buffer->rb = NULL;
+        free_bpf_buffer(buffer);
+        return NULL;
+    }
+#else
+    buffer->pb = create_pref_buffer3(map_fd, cb, &buffer->lost);
+    if (buffer->pb == NULL) {
+        free_bpf_buffer(buffer);
+        return NULL;
+    }
+#endif
+    return buffer;
+}
+
+static __always_inline __maybe_unused int bpf_buffer_epoll_fd(struct bpf_buffer_s *buffer)
+{
+#if defined(GOPHER_RINGBUF_ENABLE)
+    return ring_buffer__epoll_fd(buffer->rb);
+#elif (CURRENT_LIBBPF_VERSION >= LIBBPF_VERSION(0, 2))
+    return perf_buffer__epoll_fd(buffer->pb);
+#else
+    return -1;
+#endif
+}
+
+/* Consume the records committed without wakeup(see BPF_OUTPUT_WAKEUP_BYTES), never blocks */
+static __always_inline __maybe_unused int drain_bpf_buffer(struct bpf_buffer_s *buffer)
+{
+#if defined(GOPHER_RINGBUF_ENABLE)
+    return ring_buffer__consume(buffer->rb);
+#else
+    return 0;
+#endif
+}
+
+static __always_inline __maybe_unused int consume_bpf_buffer(struct bpf_buffer_s *buffer, int timeout_ms)
+{
+#if defined(GOPHER_RINGBUF_ENABLE)
+    int ret = ring_buffer__poll(buffer->rb, timeout_ms);
+    if (ret == 0) {
+        ret = drain_bpf_buffer(buffer);
+    }
+    return ret;
+#else
+    return perf_buffer__poll(buffer->pb, timeout_ms);
+#endif
+}
+
+static __always_inline __maybe_unused void poll_bpf_buffer(struct bpf_buffer_s *buffer, int timeout_ms)
+{
+    int ret;
+
+    while ((ret = consume_bpf_buffer(buffer, timeout_ms)) >= 0) {
+        ;
+    }
+    return;
+}
+
 #define SKEL_MAX_NUM  20
 typedef void (*skel_destroy_fn)(void *);
 
@@ -411,6 +564,9 @@ struct __bpf_skel_s {
 struct bpf_prog_s {
     struct perf_buffer* pb;
     struct perf_buffer* pbs[SKEL_MAX_NUM];  // 支持每个探针拥有各自的perf_buffer，目前tcpprobe使用
+    __u64 pb_lost;                          // perf_buffer丢失的事件数，由create_pref_buffer3创建时统计
+    __u64 pbs_lost[SKEL_MAX_NUM];
+    struct bpf_buffer_s *buffers[SKEL_MAX_NUM];    // 探针的BPF_OUTPUT_MAP输出通道
     pthread_t msg_evt_thd[SKEL_MAX_NUM];
     struct __bpf_skel_s skels[SKEL_MAX_NUM];
     size_t num;
@@ -455,6 +611,8 @@ static __always_inline __maybe_unused void unload_bpf_prog(struct bpf_prog_s **u
         if (prog->pbs[i]) {
             perf_buffer__free(prog->pbs[i]);
         }
+
+        free_bpf_buffer(prog->buffers[i]);
     }
 
     if (prog->pb) {
@@ -25,8 +25,19 @@
 #define LIBBPF_VERSION(a, b) (((a) << 8) + (b))
 #define CURRENT_LIBBPF_VERSION LIBBPF_VERSION(LIBBPF_VER_MAJOR, LIBBPF_VER_MINOR)
 
+/* BPF ring buffer needs kernel 5.8+, its epoll fd is exported since libbpf 0.3 */
+#if (CURRENT_KERNEL_VERSION >= KERNEL_VERSION(5, 8, 0)) && (CURRENT_LIBBPF_VERSION >= LIBBPF_VERSION(0, 3))
+#define GOPHER_RINGBUF_ENABLE
+#endif
+
+/* fentry/fexit/tp_btf need kernel 5.5+, programs are loaded selectively(set_autoload) since libbpf 0.8 */
+#if (CURRENT_KERNEL_VERSION >= KERNEL_VERSION(5, 5, 0)) && (CURRENT_LIBBPF_VERSION >= LIBBPF_VERSION(0, 8))
+#define GOPHER_BTF_ATTACH_ENABLE
+#endif
+
 #include "__bpf_kern.h"
 #include "__bpf_usr.h"
+#include "__bpf_output.h"
 #include "__libbpf.h"
 #include "__share_map_match.h"
 #include "__obj_map.h"
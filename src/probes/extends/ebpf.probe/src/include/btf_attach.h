@@ -0,0 +1,30 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2023. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: choose fentry/fexit/tp_btf or kprobe/kretprobe/raw_tracepoint programs at load time
+ ******************************************************************************/
+#ifndef __GOPHER_BTF_ATTACH_H__
+#define __GOPHER_BTF_ATTACH_H__
+
+#pragma once
+
+struct bpf_object;
+
+/*
+ * Called between open and load of a bpf object, for each program built by KPROBE_FENTRY/KPROBE_RET_FEXIT/
+ * KRAWTRACE_BTF(see __bpf_kern.h) keep the fentry/fexit/tp_btf variant if the kernel can attach it,
+ * otherwise the kprobe/kretprobe/raw_tracepoint one. The mode of each program is logged.
+ * Return the number of programs in fentry/fexit/tp_btf mode.
+ */
+int btf_attach_select(struct bpf_object *obj, const char *probe_name);
+
+#endif
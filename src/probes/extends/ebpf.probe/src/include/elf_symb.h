@@ -29,6 +29,7 @@ enum sym_file_t {
 struct elf_symbo_s* update_symb_from_jvm_sym_file(const char* elf);
 struct elf_symbo_s* get_symb_from_file(const char* elf, enum sym_file_t sym_file_type);
 void rm_elf_symb(struct elf_symbo_s* elf_symb);
+int get_elf_symb_text_section(struct elf_symbo_s* elf_symb, const char *elf, u64 *addr, u64 *offset);
 int search_elf_symb(struct elf_symbo_s* elf_symb,
         u64 orign_addr, u64 target_addr, const char* comm, struct addr_symb_s* addr_symb);
 void deinit_elf_symbs(void);
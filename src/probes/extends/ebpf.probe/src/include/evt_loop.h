@@ -0,0 +1,60 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: event loop for all perf buffers and bpf buffers of a probe
+ ******************************************************************************/
+#ifndef __GOPHER_EVT_LOOP_H__
+#define __GOPHER_EVT_LOOP_H__
+
+#pragma once
+
+#include "bpf.h"
+
+#define EVT_LOOP_PB_MAX     (2 * SKEL_MAX_NUM)
+#define EVT_LOOP_TIMER_MAX  8
+#define EVT_LOOP_NAME_LEN   32
+
+typedef void (*evt_loop_timer_fn)(void *ctx);
+
+struct evt_loop_pb_s {
+    struct perf_buffer *pb;
+    struct bpf_buffer_s *buffer;    // either 'pb' or 'buffer' is set
+    __u64 *lost;                // fed by the lost callback of perf buffer, may be NULL
+    __u64 last_lost;
+    __u64 err_cnt;
+    char name[EVT_LOOP_NAME_LEN];
+};
+
+struct evt_loop_timer_s {
+    evt_loop_timer_fn fn;
+    void *ctx;
+    __u64 interval_ms;
+    __u64 next_ms;
+};
+
+struct evt_loop_s {
+    int epoll_fd;
+    int pb_num;
+    int timer_num;
+    struct evt_loop_pb_s pbs[EVT_LOOP_PB_MAX];
+    struct evt_loop_timer_s timers[EVT_LOOP_TIMER_MAX];
+};
+
+struct evt_loop_s *evt_loop_new(void);
+void evt_loop_free(struct evt_loop_s **ploop);
+int evt_loop_add_pb(struct evt_loop_s *loop, struct perf_buffer *pb, __u64 *lost_cnt, const char *name);
+int evt_loop_add_buffer(struct evt_loop_s *loop, struct bpf_buffer_s *buffer, const char *name);
+int evt_loop_add_prog(struct evt_loop_s *loop, struct bpf_prog_s *prog, const char *name);
+int evt_loop_add_timer(struct evt_loop_s *loop, unsigned int interval_ms, evt_loop_timer_fn fn, void *ctx);
+int evt_loop_poll(struct evt_loop_s *loop, int timeout_ms);
+
+#endif
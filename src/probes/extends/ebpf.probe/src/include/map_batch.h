@@ -0,0 +1,90 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: batched walk of bpf map and flat aggregation table
+ ******************************************************************************/
+#ifndef __GOPHER_MAP_BATCH_H__
+#define __GOPHER_MAP_BATCH_H__
+
+#pragma once
+
+#include "bpf.h"
+#include "hash.h"
+
+#define MAP_BATCH_SIZE      1024
+
+/* Return value of map_batch_fn */
+#define MAP_BATCH_KEEP      0
+#define MAP_BATCH_DEL       1
+
+typedef int (*map_batch_fn)(const void *key, const void *value, void *ctx);
+
+struct map_batch_s {
+    int map_fd;
+    char batch_off;             // kernel does not support batch ops, walk the map one by one
+    __u32 key_size;
+    __u32 value_size;
+    void *keys;                 // MAP_BATCH_SIZE keys
+    void *values;               // MAP_BATCH_SIZE values
+    void *in_token;
+    void *out_token;
+    void *del_keys;
+    __u32 del_num;
+    __u32 del_max;
+};
+
+struct map_batch_s *map_batch_new(int map_fd, __u32 key_size, __u32 value_size);
+void map_batch_free(struct map_batch_s **pbatch);
+int map_batch_walk(struct map_batch_s *batch, map_batch_fn fn, void *ctx);
+int map_batch_drain(struct map_batch_s *batch, map_batch_fn fn, void *ctx);
+
+/*
+ * Aggregation table in user space. Items live in one flat array allocated at creation,
+ * indexed by a hash of their keys, and are all dropped by map_agg_reset().
+ */
+struct map_agg_item_s {
+    H_HANDLE;
+    char data[];                // key followed by value
+};
+
+struct map_agg_s {
+    __u32 key_size;
+    __u32 value_size;
+    __u32 value_off;            // offset of value in item data, keeps value aligned
+    __u32 item_size;
+    __u32 max_num;
+    __u32 num;
+    char *items;
+    struct map_agg_item_s *head;
+};
+
+struct map_agg_s *map_agg_new(__u32 key_size, __u32 value_size, __u32 max_num);
+void map_agg_free(struct map_agg_s **pagg);
+void *map_agg_lookup_or_init(struct map_agg_s *agg, const void *key);
+void map_agg_reset(struct map_agg_s *agg);
+
+static __always_inline __maybe_unused struct map_agg_item_s *map_agg_item(struct map_agg_s *agg, __u32 i)
+{
+    return (struct map_agg_item_s *)(agg->items + (size_t)i * agg->item_size);
+}
+
+static __always_inline __maybe_unused void *map_agg_key(struct map_agg_s *agg, __u32 i)
+{
+    return (void *)map_agg_item(agg, i)->data;
+}
+
+static __always_inline __maybe_unused void *map_agg_value(struct map_agg_s *agg, __u32 i)
+{
+    return (void *)(map_agg_item(agg, i)->data + agg->value_off);
+}
+
+#endif
@@ -0,0 +1,164 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2023. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: latency histograms of sli probes, recorded in kernel and merged in user space
+ ******************************************************************************/
+#ifndef __GOPHER_SLI_HISTO_H__
+#define __GOPHER_SLI_HISTO_H__
+
+#pragma once
+
+/*
+ * Log-linear buckets: values below 2^SLI_HISTO_SUB_BITS units have one bucket each, every power of 2
+ * above is split into SLI_HISTO_SUB_NUM linear buckets, so a quantile is off by 1/SLI_HISTO_SUB_NUM at most.
+ * Unit is 1024ns, the last bucket holds everything above 2^SLI_HISTO_MAX_BITS units(about 68s).
+ */
+#define SLI_HISTO_UNIT_SHIFT    10
+#define SLI_HISTO_SUB_BITS      3
+#define SLI_HISTO_SUB_NUM       (1 << SLI_HISTO_SUB_BITS)
+#define SLI_HISTO_MAX_BITS      26
+#define SLI_HISTO_BUCKETS       ((SLI_HISTO_MAX_BITS - SLI_HISTO_SUB_BITS + 1) * SLI_HISTO_SUB_NUM)
+
+#define SLI_HISTO_MAX           512     // histograms kept in kernel within a period
+#define SLI_CMD_CLASS_LEN       16
+
+struct sli_histo_key_s {
+    __u32 tgid;
+    __u16 family;
+    __u16 server_port;
+    __u8 server_ip[IP6_LEN];
+    char command[SLI_CMD_CLASS_LEN];    // command class, e.g. the method of http
+    __u32 app;                          // protocol, for probes tracing more than one
+};
+
+struct sli_histo_s {
+    __u64 count;
+    __u64 sum;                          // unit ns
+    __u64 max;                          // unit ns
+    __u32 buckets[SLI_HISTO_BUCKETS];
+};
+
+static __always_inline __maybe_unused __u32 sli_histo_bucket(__u64 nsec)
+{
+    __u64 v = nsec >> SLI_HISTO_UNIT_SHIFT;
+    __u32 msb = 0;
+
+    if (v < SLI_HISTO_SUB_NUM) {
+        return (__u32)v;
+    }
+    if (v >= (1ULL << SLI_HISTO_MAX_BITS)) {
+        return SLI_HISTO_BUCKETS - 1;
+    }
+
+    // v < 2^26, log2 in 5 steps
+    if (v >> 16) {
+        v >>= 16;
+        msb += 16;
+    }
+    if (v >> 8) {
+        v >>= 8;
+        msb += 8;
+    }
+    if (v >> 4) {
+        v >>= 4;
+        msb += 4;
+    }
+    if (v >> 2) {
+        v >>= 2;
+        msb += 2;
+    }
+    if (v >> 1) {
+        msb += 1;
+    }
+
+    v = nsec >> SLI_HISTO_UNIT_SHIFT;
+    return (msb - SLI_HISTO_SUB_BITS + 1) * SLI_HISTO_SUB_NUM +
+           (__u32)((v >> (msb - SLI_HISTO_SUB_BITS)) & (SLI_HISTO_SUB_NUM - 1));
+}
+
+#ifdef BPF_PROG_KERN
+
+/*
+ * Per-CPU histograms, plus an all-zero value to create new ones with, it is too big for the bpf stack.
+ * Define by SLI_HISTO_MAPS(xxx) and record by sli_histo_record(xxx, key, nsec), which returns -1 if
+ * there is no histogram for the key and the map is full.
+ */
+#define SLI_HISTO_MAPS(name) \
+    struct { \
+        __uint(type, BPF_MAP_TYPE_PERCPU_HASH); \
+        __uint(key_size, sizeof(struct sli_histo_key_s)); \
+        __uint(value_size, sizeof(struct sli_histo_s)); \
+        __uint(max_entries, SLI_HISTO_MAX); \
+    } name SEC(".maps"); \
+    struct { \
+        __uint(type, BPF_MAP_TYPE_ARRAY); \
+        __uint(key_size, sizeof(u32)); \
+        __uint(value_size, sizeof(struct sli_histo_s)); \
+        __uint(max_entries, 1); \
+    } name##_zero SEC(".maps")
+
+#define sli_histo_record(name, key, nsec) __sli_histo_record(&name, &name##_zero, key, nsec)
+
+static __always_inline __maybe_unused int __sli_histo_record(void *map, void *zero_map,
+    const void *key, u64 nsec)
+{
+    u32 zero = 0;
+    u32 idx;
+    void *init;
+    struct sli_histo_s *histo;
+
+    histo = (struct sli_histo_s *)bpf_map_lookup_elem(map, key);
+    if (histo == (void *)0) {
+        init = bpf_map_lookup_elem(zero_map, &zero);
+        if (init == (void *)0) {
+            return -1;
+        }
+        (void)bpf_map_update_elem(map, key, init, BPF_NOEXIST);
+        histo = (struct sli_histo_s *)bpf_map_lookup_elem(map, key);
+        if (histo == (void *)0) {
+            return -1;
+        }
+    }
+
+    histo->count++;
+    histo->sum += nsec;
+    if (histo->max < nsec) {
+        histo->max = nsec;
+    }
+    idx = sli_histo_bucket(nsec);
+    if (idx < SLI_HISTO_BUCKETS) {
+        histo->buckets[idx]++;
+    }
+    return 0;
+}
+
+#endif
+
+#if !defined(BPF_PROG_KERN) && !defined(BPF_PROG_USER)
+
+#include "map_batch.h"
+
+#define SLI_HISTO_TBL_FMT   "|%s|%u|%s|%s|%s|%u|%llu|%llu|%llu|%llu|%llu|%llu|\n"
+
+/* Called with the histogram merged from all CPUs */
+typedef void (*sli_histo_fn)(const struct sli_histo_key_s *key, const struct sli_histo_s *histo, void *ctx);
+
+struct map_batch_s *sli_histo_batch_new(int map_fd);
+void sli_histo_merge(struct sli_histo_s *merged, const struct sli_histo_s *percpu, int cpus);
+int sli_histo_drain(struct map_batch_s *batch, sli_histo_fn fn, void *ctx);
+__u64 sli_histo_quantile(const struct sli_histo_s *histo, double q);
+void sli_histo_output(const char *tbl, const char *app, const struct sli_histo_key_s *key,
+    const struct sli_histo_s *histo);
+
+#endif
+
+#endif
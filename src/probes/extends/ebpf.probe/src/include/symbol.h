@@ -58,6 +58,19 @@ struct mod_info_s {
     u64 inode;
 };
 
+struct elf_file_id_s {
+    u64 dev;
+    u64 inode;
+    s64 mtime;          // 0 for files growing in place, e.g. jvm symbol files
+};
+
+#define ELF_BUILD_ID_LEN    (2 * 32 + 1)
+struct elf_symb_key_s {
+    char build_id[ELF_BUILD_ID_LEN];    // empty if the elf has no build-id, file_id is used then
+    struct elf_file_id_s file_id;
+};
+
+struct symb_pool_s;
 struct elf_symbo_s {
     H_HANDLE;
     u32 i_inode;
@@ -67,6 +80,13 @@ struct elf_symbo_s {
     u32 symbs_count;
     u32 symbs_capability;
     struct symb_s** __symbs;
+
+    // Symbols of one elf are shared by all mods mapping it, across processes.
+    struct elf_symb_key_s key;
+    struct symb_pool_s *pool;   // symbols and their names, released at once
+    char text_valid;
+    u64 text_addr;
+    u64 text_offset;
 };
 
 #define MOD_ADDR_RANGE_COUNT 100
@@ -101,6 +121,7 @@ struct proc_symbs_s {
     int need_update; // update jvm symbols
     time_t update_time;
     u32 mods_count;
+    struct symb_cache_s *cache;     // addr -> symbol, reset when the symbols of JVM are updated
     struct mod_s* mods[MOD_MAX_COUNT];
 };
 
@@ -26,20 +26,14 @@
 char g_linsence[] SEC("license") = "GPL";
 
 #define __IO_COUNT_MAX      100
+// Bytes of every CPU, user space sums them up and outputs the deltas every period.
 struct {
-    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(type, BPF_MAP_TYPE_PERCPU_HASH);
     __uint(key_size, sizeof(struct io_entity_s));
     __uint(value_size, sizeof(struct io_count_s));
     __uint(max_entries, __IO_COUNT_MAX);
 } io_count_map SEC(".maps");
 
-struct {
-    __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
-    __uint(key_size, sizeof(u32));
-    __uint(value_size, sizeof(u32));
-    __uint(max_entries, __PERF_OUT_MAX);
-} io_count_channel_map SEC(".maps");
-
 
 struct block_bio_queue_args {
     struct trace_entry ent;
@@ -50,20 +44,6 @@ struct block_bio_queue_args {
     char comm[TASK_COMM_LEN];
 };
 
-static __always_inline void report_io_count(void *ctx, struct io_count_s* io_count)
-{
-    if (is_report_tmout(&(io_count->io_count_ts))) {
-        (void)bpf_perf_event_output(ctx,
-                                    &io_count_channel_map,
-                                    BPF_F_ALL_CPU,
-                                    io_count,
-                                    sizeof(struct io_count_s));
-        io_count->read_bytes = 0;
-        io_count->write_bytes = 0;
-        io_count->io_count_ts.ts = 0;
-    }
-}
-
 static __always_inline struct io_count_s* get_io_count(int major, int minor)
 {
     struct io_entity_s io_entity = {.major = major, .first_minor = minor};
@@ -80,7 +60,7 @@ static __always_inline struct io_count_s* get_io_count(int major, int minor)
     struct io_count_s new_io_count = {0};
     new_io_count.major = major;
     new_io_count.first_minor = minor;
-    bpf_map_update_elem(&io_count_map, &io_entity, &new_io_count, BPF_ANY);
+    bpf_map_update_elem(&io_count_map, &io_entity, &new_io_count, BPF_NOEXIST);
     return (struct io_count_s *)bpf_map_lookup_elem(&io_count_map, &io_entity);
 }
 
@@ -123,15 +103,14 @@ void tracepoint_block_bio_queue(struct block_bio_queue_args *ctx)
 
     bio_size = ctx->nr_sector * 512;
 
+    // Value of this CPU, no other CPU updates it
     if (is_read_bio(ctx)) {
-        __sync_fetch_and_add(&(io_count->read_bytes), bio_size);
-        report_io_count(ctx, io_count);
+        io_count->read_bytes += bio_size;
         return;
     }
 
     if (is_write_bio(ctx)) {
-        __sync_fetch_and_add(&(io_count->write_bytes), bio_size);
-        report_io_count(ctx, io_count);
+        io_count->write_bytes += bio_size;
         return;
     }
 }
@@ -20,13 +20,6 @@
 #define __PERF_OUT_MAX (64)
 #endif
 
-struct {
-    __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
-    __uint(key_size, sizeof(u32));
-    __uint(value_size, sizeof(u32));
-    __uint(max_entries, __PERF_OUT_MAX);
-} io_latency_channel_map SEC(".maps");
-
 // Data collection args
 struct {
     __uint(type, BPF_MAP_TYPE_ARRAY);
@@ -65,6 +58,19 @@ static __always_inline __maybe_unused u64 get_sample_interval()
     return interval;
 }
 
+static __always_inline __maybe_unused char is_cgrp_histo()
+{
+    u32 key = 0;
+
+    struct io_trace_args_s *args;
+    args = (struct io_trace_args_s *)bpf_map_lookup_elem(&io_args_map, &key);
+    if (args) {
+        return args->cgrp_histo ? 1 : 0;
+    }
+
+    return 0;
+}
+
 static __always_inline char is_target_dev(int major, int first_minor)
 {
     u32 key = 0;
@@ -93,22 +99,5 @@ static __always_inline __maybe_unused char is_report_tmout(struct io_report_s* i
     return 0;
 }
 
-static __always_inline __maybe_unused void report_io_latency(void *ctx, struct io_latency_s* io_latency)
-{
-    if (is_report_tmout(&(io_latency->io_latency_ts))) {
-        (void)bpf_perf_event_output(ctx,
-                                    &io_latency_channel_map,
-                                    BPF_F_ALL_CPU,
-                                    io_latency,
-                                    sizeof(struct io_latency_s));
-        io_latency->proc_id = 0;
-        io_latency->data_len = 0;
-        io_latency->io_latency_ts.ts = 0;
-        __builtin_memset(io_latency->comm, 0, sizeof(io_latency->comm));
-        __builtin_memset(io_latency->rwbs, 0, sizeof(io_latency->rwbs));
-        __builtin_memset(io_latency->latency, 0, sizeof(io_latency->latency));
-    }
-}
-
 #endif
 #endif
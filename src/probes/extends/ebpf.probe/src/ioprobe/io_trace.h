@@ -72,6 +72,13 @@ enum IO_STAGE_E {
     IO_STAGE_MAX
 };
 
+enum IO_OP_E {
+    IO_OP_READ = 0,
+    IO_OP_WRITE,
+    IO_OP_OTHER,        // discard, flush, ...
+    IO_OP_MAX
+};
+
 struct io_report_s {
     u64 ts;
 };
@@ -90,12 +97,14 @@ struct io_trace_s {
     u32 proc_id;
     char comm[TASK_COMM_LEN];
     char rwbs[RWBS_LEN];
+    char sampled;       // feeds io_latency too, the histograms take every request
     unsigned int data_len;
+    u32 op;             // IO_OP_E
+    u64 cgrp_id;        // cgroup the request is charged to, 0 if not broken down by cgroup
     u64 ts[IO_ISSUE_MAX];
 };
 
 struct io_count_s {
-    struct io_report_s io_count_ts;
     int major;
     int first_minor;
     u64 read_bytes;
@@ -119,7 +128,6 @@ struct io_req_s {
 };
 
 struct io_latency_s {
-    struct io_report_s io_latency_ts;
     int major;
     int first_minor;
     u32 proc_id;
@@ -134,6 +142,15 @@ struct io_entity_s {
     int first_minor;
 };
 
+// Key of the latency histograms(sli_histo_s), one per stage of the requests
+struct io_histo_key_s {
+    int major;
+    int first_minor;
+    u32 op;             // IO_OP_E
+    u32 stage;          // IO_STAGE_E
+    u64 cgrp_id;
+};
+
 struct pagecache_entity_s {
     int major;
     int first_minor;
@@ -154,6 +171,7 @@ struct io_trace_args_s {
     int target_first_minor;
     u64 report_period;      // unit: nanosecond
     u64 sample_interval;    // unit: nanosecond
+    u32 cgrp_histo;         // break the latency histograms down by cgroup
 };
 
 #endif
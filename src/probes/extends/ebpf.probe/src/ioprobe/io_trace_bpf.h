@@ -25,6 +25,7 @@
 
 #include "io_trace.h"
 #include "io_probe_channel.h"
+#include "sli_histo.h"
 
 #define REQ_OP_BITS 8
 #define REQ_OP_MASK ((1 << REQ_OP_BITS) - 1)
@@ -41,9 +42,11 @@ struct {
     __uint(max_entries, 1);
 } io_sample_map SEC(".maps");
 
-#define __IO_ENTRIES_MAX (5 * 1024)
+// Every in-flight request on the target devices is traced for the histograms. A request whose completion
+// is missed is never deleted, the least recently used ones make room for new requests.
+#define __IO_ENTRIES_MAX (16 * 1024)
 struct {
-    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
     __uint(key_size, sizeof(struct io_req_s));
     __uint(value_size, sizeof(struct io_trace_s));
     __uint(max_entries, __IO_ENTRIES_MAX);
@@ -58,6 +61,33 @@ struct {
     __uint(max_entries, __IO_LATENCY_ENTRIES_MAX);
 } io_latency_map SEC(".maps");
 
+/*
+ * Latency histograms of each device, op, stage(and cgroup), drained by user space every period.
+ * Allocated on use, a value is about 800 bytes per CPU. Resized by user space from the number of devices
+ * before loading, the records dropped when it is full are counted in io_histo_drops.
+ */
+#define __IO_HISTO_MAX (1024)
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_HASH);
+    __uint(key_size, sizeof(struct io_histo_key_s));
+    __uint(value_size, sizeof(struct sli_histo_s));
+    __uint(max_entries, __IO_HISTO_MAX);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+} io_histo_map SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(key_size, sizeof(u32));
+    __uint(value_size, sizeof(struct sli_histo_s));
+    __uint(max_entries, 1);
+} io_histo_map_zero SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(key_size, sizeof(u32));
+    __uint(value_size, sizeof(u64));
+    __uint(max_entries, 1);
+} io_histo_drops SEC(".maps");
 
 static __always_inline __maybe_unused char is_sample_tmout(u64 current_ts)
 {
@@ -149,6 +179,86 @@ static __always_inline __maybe_unused void get_io_req(struct io_req_s *io_req, s
         } \
     } while (0)
 
+static __always_inline u32 blk_io_op(unsigned int op)
+{
+    switch (op & REQ_OP_MASK) {
+    case REQ_OP_READ:
+        return IO_OP_READ;
+    case REQ_OP_WRITE:
+    case REQ_OP_WRITE_SAME:
+        return IO_OP_WRITE;
+    default:
+        return IO_OP_OTHER;
+    }
+}
+
+// The cgroup the bios of a request are charged to by blk-cgroup, not the task issuing it(e.g. a kworker).
+static __always_inline u64 get_io_cgrp_id(struct request *req)
+{
+#if (CURRENT_KERNEL_VERSION >= KERNEL_VERSION(4, 19, 0))
+    struct bio *bio = _(req->bio);
+    if (bio == NULL) {
+        return 0;
+    }
+
+    struct blkcg_gq *blkg = _(bio->bi_blkg);
+    if (blkg == NULL) {
+        return 0;
+    }
+
+    struct blkcg *blkcg = _(blkg->blkcg);
+    if (blkcg == NULL) {
+        return 0;
+    }
+
+    struct cgroup *cgroup = _(blkcg->css.cgroup);
+    if (cgroup == NULL) {
+        return 0;
+    }
+
+    struct kernfs_node *kn = _(cgroup->kn);
+    if (kn == NULL) {
+        return 0;
+    }
+
+#if (CURRENT_KERNEL_VERSION < KERNEL_VERSION(5, 5, 0))
+    return _(kn->id.ino);
+#else
+    return _(kn->id);
+#endif
+#else
+    return 0;
+#endif
+}
+
+static __always_inline void record_io_histo(struct io_trace_s *io_trace)
+{
+    struct io_histo_key_s key = {0};
+    u32 zero = 0;
+    int ret = 0;
+    u64 *drops;
+
+    key.major = io_trace->major;
+    key.first_minor = io_trace->first_minor;
+    key.op = io_trace->op;
+    key.cgrp_id = io_trace->cgrp_id;
+
+    key.stage = IO_STAGE_BLOCK;
+    ret |= sli_histo_record(io_histo_map, &key, io_trace->ts[IO_ISSUE_END] - io_trace->ts[IO_ISSUE_START]);
+    key.stage = IO_STAGE_DRIVER;
+    ret |= sli_histo_record(io_histo_map, &key, io_trace->ts[IO_ISSUE_DEVICE] - io_trace->ts[IO_ISSUE_START]);
+    key.stage = IO_STAGE_DEVICE;
+    ret |= sli_histo_record(io_histo_map, &key, io_trace->ts[IO_ISSUE_DEVICE_END] - io_trace->ts[IO_ISSUE_DEVICE]);
+    if (ret == 0) {
+        return;
+    }
+
+    drops = (u64 *)bpf_map_lookup_elem(&io_histo_drops, &zero);
+    if (drops != (void *)0) {
+        (*drops)++;
+    }
+}
+
 static __always_inline void blk_fill_rwbs(char *rwbs, unsigned int op)
 {
     switch (op & REQ_OP_MASK) {
@@ -259,10 +369,6 @@ static __always_inline struct io_trace_s* get_io_trace(struct request* req)
         return io_trace;
     }
 
-    if (!is_sample_tmout(bpf_ktime_get_ns())) {
-        return NULL;
-    }
-
     disk = _(req->rq_disk);
     if (disk == NULL) {
         return NULL;
@@ -274,15 +380,24 @@ static __always_inline struct io_trace_s* get_io_trace(struct request* req)
         return NULL;
     }
 
-    u32 proc_id = bpf_get_current_pid_tgid() >> INT_LEN;
-    if (proc_id) {
-        new_io_trace.proc_id = proc_id;
-        (void)bpf_get_current_comm(&new_io_trace.comm, sizeof(new_io_trace.comm));
+    unsigned int cmd_flags = _(req->cmd_flags);
+
+    // Sampling only applies to the details reported in io_latency.
+    new_io_trace.sampled = is_sample_tmout(bpf_ktime_get_ns());
+    if (new_io_trace.sampled) {
+        u32 proc_id = bpf_get_current_pid_tgid() >> INT_LEN;
+        if (proc_id) {
+            new_io_trace.proc_id = proc_id;
+            (void)bpf_get_current_comm(&new_io_trace.comm, sizeof(new_io_trace.comm));
+        }
+        blk_fill_rwbs(new_io_trace.rwbs, cmd_flags);
+        new_io_trace.data_len = _(req->__data_len);
     }
 
-    unsigned int cmd_flags = _(req->cmd_flags);
-    blk_fill_rwbs(new_io_trace.rwbs, cmd_flags);
-    new_io_trace.data_len = _(req->__data_len);
+    new_io_trace.op = blk_io_op(cmd_flags);
+    if (is_cgrp_histo()) {
+        new_io_trace.cgrp_id = get_io_cgrp_id(req);
+    }
     new_io_trace.major = major;
     new_io_trace.first_minor = first_minor;
 
@@ -365,16 +480,15 @@ KRAWTRACE(block_rq_complete, bpf_raw_tracepoint_args)
     if (io_trace == NULL) {
         return 0;
     }
-    io_latency = get_io_latency(io_trace);
-    if (io_latency == NULL) {
-        return 0;
-    }
 
     if (!error) {
         io_trace->ts[IO_ISSUE_END] = bpf_ktime_get_ns();
         if (is_normal_io_trace(io_trace)) {
-            CALC_LATENCY(io_latency, io_trace);
-            report_io_latency(ctx, io_latency);
+            record_io_histo(io_trace);
+            io_latency = io_trace->sampled ? get_io_latency(io_trace) : NULL;
+            if (io_latency != NULL) {
+                CALC_LATENCY(io_latency, io_trace);
+            }
         }
     }
     get_io_req(&io_req, req);
@@ -28,6 +28,8 @@
 #endif
 
 #include "bpf.h"
+#include "evt_loop.h"
+#include "map_batch.h"
 #include "args.h"
 #include "io_trace_scsi.skel.h"
 #include "io_trace_nvme.skel.h"
@@ -37,9 +39,12 @@
 #include "io_count.skel.h"
 #include "io_trace.h"
 #include "event.h"
+#include "blk_dev.h"
+#include "sli_histo.h"
 
 #define OO_NAME "block"  // Observation Object name
 #define IO_TBL_LATENCY    "io_latency"
+#define IO_TBL_LATENCY_HISTO  "io_latency_histo"
 #define IO_TBL_PAGECACHE  "io_pagecache"
 #define IO_TBL_ERR        "io_err"
 #define IO_TBL_COUNT      "io_count"
@@ -47,19 +52,56 @@
 /* Path to pin map */
 #define IO_ARGS_PATH            "/sys/fs/bpf/gala-gopher/__io_args"
 #define IO_SAMPLE_PATH          "/sys/fs/bpf/gala-gopher/__io_sample"
-#define IO_LATENCY_CHANNEL_PATH "/sys/fs/bpf/gala-gopher/__io_latency_channel"
 #define IO_TRACE_PATH           "/sys/fs/bpf/gala-gopher/__io_trace"
 #define IO_LATENCY_PATH         "/sys/fs/bpf/gala-gopher/__io_latency"
+#define IO_HISTO_PATH           "/sys/fs/bpf/gala-gopher/__io_histo"
+#define IO_HISTO_ZERO_PATH      "/sys/fs/bpf/gala-gopher/__io_histo_zero"
+#define IO_HISTO_DROPS_PATH     "/sys/fs/bpf/gala-gopher/__io_histo_drops"
 
 #define RM_IO_PATH              "/usr/bin/rm -rf /sys/fs/bpf/gala-gopher/__io*"
 
-#define __LOAD_IO_LATENCY(probe_name, end, load) \
+// Totals of a device summed up from io_count_map at last period
+struct io_count_hist_s {
+    H_HANDLE;
+    struct io_entity_s entity;
+    u64 read_bytes;
+    u64 write_bytes;
+};
+
+struct io_count_ctx_s {
+    int cpus;
+    struct map_batch_s *batch;
+    struct io_count_hist_s *hist;
+};
+
+// io_latency_map and io_histo_map are shared by all io_trace progs loaded, and drained every period
+struct io_latency_ctx_s {
+    int cpus;
+    struct map_batch_s *latency_batch;
+    struct map_batch_s *histo_batch;
+    struct sli_histo_s merged;
+    int histo_drops_fd;
+    u64 histo_drops;            // total at last period
+};
+
+/*
+ * io_histo_map holds a histogram per device, op and stage, and per cgroup if broken down by cgroup.
+ * Histograms are allocated on use, the size only bounds the number of them.
+ */
+#define IO_HISTO_CGRP_NUM       64
+#define IO_HISTO_MIN            1024
+#define IO_HISTO_LIMIT          (64 * 1024)
+
+#define __LOAD_IO_LATENCY(probe_name, end, load, histo_max) \
     OPEN(probe_name, end, load); \
     MAP_SET_PIN_PATH(probe_name, io_args_map, IO_ARGS_PATH, load); \
     MAP_SET_PIN_PATH(probe_name, io_sample_map, IO_SAMPLE_PATH, load); \
-    MAP_SET_PIN_PATH(probe_name, io_latency_channel_map, IO_LATENCY_CHANNEL_PATH, load); \
     MAP_SET_PIN_PATH(probe_name, io_trace_map, IO_TRACE_PATH, load); \
     MAP_SET_PIN_PATH(probe_name, io_latency_map, IO_LATENCY_PATH, load); \
+    MAP_SET_PIN_PATH(probe_name, io_histo_map, IO_HISTO_PATH, load); \
+    MAP_SET_PIN_PATH(probe_name, io_histo_map_zero, IO_HISTO_ZERO_PATH, load); \
+    MAP_SET_PIN_PATH(probe_name, io_histo_drops, IO_HISTO_DROPS_PATH, load); \
+    MAP_SET_MAX_ENTRIES(probe_name, io_histo_map, histo_max, load); \
     LOAD_ATTACH(probe_name, end, load)
 
 #define __LOAD_IO_PROBE(probe_name, end, load) \
@@ -70,6 +112,7 @@
 static volatile sig_atomic_t g_stop;
 static struct probe_params params = {.period = DEFAULT_PERIOD};
 static int io_args_fd;
+static struct blk_dev_tbl_s *g_blk_devs = NULL;
 
 struct scsi_err_desc_s {
     int scsi_ret_code;
@@ -162,121 +205,22 @@ static void sig_int(int signo)
     g_stop = 1;
 }
 
-/**
-lsblk -l | grep 8:0 | awk '{print $1}'
-sda
-*/
-#define LSBLK_LIST_CMD "lsblk -l | grep %d:%d | awk '{print $1}'"
-static void get_devname(int major, int minor, char dev_name[], size_t size)
-{
-    char cmd[COMMAND_LEN];
-
-    cmd[0] = 0;
-    (void)sprintf(cmd, LSBLK_LIST_CMD, major, minor);
-
-    (void)exec_cmd((const char *)cmd, dev_name, size);
-    return;
-}
-
-#define IS_LOWERCASE_LEETER(a) (((a) >= 'a') && ((a) <= 'z'))
-static char* __get_first_letter_pos(char *buf)
+// The names of a device, e.g. sda1 and sda, empty if the device does not exist any more
+static void get_blk_dev_name(int major, int minor, char *dev_name, char *disk_name)
 {
-    char *p;
-    size_t pos;
-    size_t len = strlen(buf);
-    if (len == 0) {
-        return NULL;
-    }
+    struct blk_dev_s *dev = NULL;
 
-    pos = 0;
-    p = buf + pos;
-    while ((pos < len) && (!IS_LOWERCASE_LEETER(*p))) {
-        pos++;
-        p = buf + pos;
-    }
-    
-    if (pos >= len) {
-        return NULL;
+    dev_name[0] = 0;
+    disk_name[0] = 0;
+    if (g_blk_devs != NULL) {
+        dev = blk_dev_find(g_blk_devs, major, minor);
     }
-    return p;
-}
-
-#define LSBLK_TREE_CMD "lsblk -t | awk 'NR > 1 {print $1}'"
-static void get_diskname(const char* dev_name, char *disk_name, size_t size)
-{
-    FILE *f = NULL;
-    char cmd[COMMAND_LEN];
-    char line[LINE_BUF_LEN];
-    char *p;
-    char last_disk_name[DISK_NAME_LEN];
-
-    cmd[0] = 0;
-    (void)strncpy(cmd, LSBLK_TREE_CMD, COMMAND_LEN);
-    f = popen(cmd, "r");
-    if (f == NULL) {
+    if (dev == NULL) {
         return;
     }
-    while (!feof(f)) {
-        line[0] = 0;
-        if (fgets(line, LINE_BUF_LEN, f) == NULL) {
-            break;
-        }
-        SPLIT_NEWLINE_SYMBOL(line);
-        p = __get_first_letter_pos(line);
-        if (p && (p == line)) {
-            // record last disk name
-            last_disk_name[0] = 0;
-            (void)strncpy(last_disk_name, p, DISK_NAME_LEN);
-        }
-
-        if (strcmp(dev_name, last_disk_name) == 0) {
-            (void)strncpy(disk_name, dev_name, size);
-        }
-
-        if (p && (p != line) && (strcmp(dev_name, p) == 0)) {
-            (void)strncpy(disk_name, last_disk_name, size);
-            break;
-        }
-    }
 
-    pclose(f);
-    return;
-}
-
-static int get_devt(char *dev_name, int *major, int *minor)
-{
-    char sys_file[PATH_LEN];
-    char cmd[COMMAND_LEN];
-    char dev[16];
-    FILE *fp;
-
-    sys_file[0] = 0;
-    (void)snprintf(sys_file, PATH_LEN, "/sys/block/%s/dev", dev_name);
-    if (access(sys_file, 0)) {
-        sys_file[0] = 0;
-        (void)snprintf(sys_file, PATH_LEN, "/sys/block/*/%s/../dev", dev_name);
-    }
-    if (access(sys_file, 0)) {
-        fprintf(stderr, "dev \'%s\' not exist.\n", dev_name);
-        return -1;
-    }
-
-    cmd[0] = 0;
-    (void)sprintf(cmd, "cat %s 2>/dev/null", sys_file);
-    if ((fp = popen(cmd, "r")) == NULL) {
-        fprintf(stderr, "exec \'%s\' fail\n", cmd);
-        return -1;
-    }
-
-    dev[0] = 0;
-    while (fgets(dev, sizeof(dev) - 1, fp)) {
-        if (sscanf(dev, "%d:%d", major, minor) != 2) {
-            pclose(fp);
-            return -1;
-        }
-    }
-    pclose(fp);
-    return 0;
+    (void)snprintf(dev_name, DISK_NAME_LEN, "%s", dev->name);
+    (void)snprintf(disk_name, DISK_NAME_LEN, "%s", dev->disk_name);
 }
 
 #define __ENTITY_ID_LEN 32
@@ -285,7 +229,7 @@ static void __build_entity_id(int major, int minor, char *buf, int buf_len)
     (void)snprintf(buf, buf_len, "%d_%d", major, minor);
 }
 
-static void rcv_io_latency_thr(struct io_latency_s *io_latency)
+static void rcv_io_latency_thr(const struct io_latency_s *io_latency)
 {
     char entityId[__ENTITY_ID_LEN];
     unsigned int latency_thr_us;
@@ -302,10 +246,7 @@ static void rcv_io_latency_thr(struct io_latency_s *io_latency)
         entityId[0] = 0;
         __build_entity_id(io_latency->major, io_latency->first_minor, entityId, __ENTITY_ID_LEN);
 
-        dev_name[0] = 0;
-        disk_name[0] = 0;
-        get_devname(io_latency->major, io_latency->first_minor, dev_name, DISK_NAME_LEN);
-        get_diskname((const char*)dev_name, disk_name, DISK_NAME_LEN);
+        get_blk_dev_name(io_latency->major, io_latency->first_minor, dev_name, disk_name);
 
         evt.entityName = OO_NAME;
         evt.entityId = entityId;
@@ -331,10 +272,7 @@ static void rcv_pagecache_stats(void *ctx, int cpu, void *data, __u32 size)
     char disk_name[DISK_NAME_LEN];
     struct pagecache_stats_s *pagecache_stats = data;
 
-    dev_name[0] = 0;
-    disk_name[0] = 0;
-    get_devname(pagecache_stats->major, pagecache_stats->first_minor, dev_name, DISK_NAME_LEN);
-    get_diskname((const char*)dev_name, disk_name, DISK_NAME_LEN);
+    get_blk_dev_name(pagecache_stats->major, pagecache_stats->first_minor, dev_name, disk_name);
 
     (void)fprintf(stdout, "|%s|%d|%d|%s|%s"
         "|%u|%u|%u|%u|\n",
@@ -352,43 +290,86 @@ static void rcv_pagecache_stats(void *ctx, int cpu, void *data, __u32 size)
     (void)fflush(stdout);
 }
 
-static void rcv_io_count(void *ctx, int cpu, void *data, __u32 size)
+static void output_io_count(const struct io_entity_s *entity, u64 read_bytes, u64 write_bytes)
 {
     char dev_name[DISK_NAME_LEN];
     char disk_name[DISK_NAME_LEN];
-    struct io_count_s *io_count = data;
 
-    dev_name[0] = 0;
-    disk_name[0] = 0;
-    get_devname(io_count->major, io_count->first_minor, dev_name, DISK_NAME_LEN);
-    get_diskname((const char*)dev_name, disk_name, DISK_NAME_LEN);
+    get_blk_dev_name(entity->major, entity->first_minor, dev_name, disk_name);
 
     (void)fprintf(stdout, "|%s|%d|%d|%s|%s"
         "|%llu|%llu|\n",
 
         IO_TBL_COUNT,
-        io_count->major,
-        io_count->first_minor,
+        entity->major,
+        entity->first_minor,
         dev_name,
         disk_name,
 
-        io_count->read_bytes,
-        io_count->write_bytes);
+        read_bytes,
+        write_bytes);
+}
+
+// Sum up the bytes of all CPUs, output the deltas since last period if the device has I/O
+static int pull_io_count(const void *key, const void *value, void *ctx)
+{
+    struct io_count_ctx_s *c = (struct io_count_ctx_s *)ctx;
+    const struct io_entity_s *entity = (const struct io_entity_s *)key;
+    const struct io_count_s *values = (const struct io_count_s *)value;
+    struct io_count_hist_s *hist = NULL;
+    u64 read_bytes = 0, write_bytes = 0;
+
+    for (int i = 0; i < c->cpus; i++) {
+        read_bytes += values[i].read_bytes;
+        write_bytes += values[i].write_bytes;
+    }
+
+    H_FIND(c->hist, entity, sizeof(struct io_entity_s), hist);
+    if (hist == NULL) {
+        hist = (struct io_count_hist_s *)calloc(1, sizeof(struct io_count_hist_s));
+        if (hist == NULL) {
+            return MAP_BATCH_KEEP;
+        }
+        hist->entity = *entity;
+        H_ADD(c->hist, entity, sizeof(struct io_entity_s), hist);
+    }
+
+    if (read_bytes != hist->read_bytes || write_bytes != hist->write_bytes) {
+        output_io_count(entity, read_bytes - hist->read_bytes, write_bytes - hist->write_bytes);
+        hist->read_bytes = read_bytes;
+        hist->write_bytes = write_bytes;
+    }
+    return MAP_BATCH_KEEP;
+}
+
+static void io_count_timer(void *ctx)
+{
+    struct io_count_ctx_s *c = (struct io_count_ctx_s *)ctx;
+
+    (void)map_batch_walk(c->batch, pull_io_count, c);
     (void)fflush(stdout);
 }
 
-static void rcv_io_latency(void *ctx, int cpu, void *data, __u32 size)
+static void io_count_free(struct io_count_ctx_s *c)
+{
+    struct io_count_hist_s *hist, *tmp;
+
+    H_ITER(c->hist, hist, tmp) {
+        H_DEL(c->hist, hist);
+        free(hist);
+    }
+    map_batch_free(&(c->batch));
+}
+
+static int pull_io_latency(const void *key, const void *value, void *ctx)
 {
     char dev_name[DISK_NAME_LEN];
     char disk_name[DISK_NAME_LEN];
-    struct io_latency_s *io_latency = data;
+    const struct io_latency_s *io_latency = (const struct io_latency_s *)value;
 
     rcv_io_latency_thr(io_latency);
 
-    dev_name[0] = 0;
-    disk_name[0] = 0;
-    get_devname(io_latency->major, io_latency->first_minor, dev_name, DISK_NAME_LEN);
-    get_diskname((const char*)dev_name, disk_name, DISK_NAME_LEN);
+    get_blk_dev_name(io_latency->major, io_latency->first_minor, dev_name, disk_name);
 
     (void)fprintf(stdout, "|%s|%d|%d|%s|%s"
         "|%llu|%llu|%llu|%llu|%u"
@@ -418,9 +399,90 @@ static void rcv_io_latency(void *ctx, int cpu, void *data, __u32 size)
         io_latency->latency[IO_STAGE_DEVICE].sum,
         io_latency->latency[IO_STAGE_DEVICE].jitter,
         io_latency->latency[IO_STAGE_DEVICE].count);
+    return MAP_BATCH_DEL;
+}
+
+static const char *io_op_names[IO_OP_MAX] = {"read", "write", "other"};
+static const char *io_stage_names[IO_STAGE_MAX] = {"block", "driver", "device"};
+
+// Merge the histogram of all CPUs, output the count, sum and quantiles of the period, unit ns
+static int pull_io_histo(const void *key, const void *value, void *ctx)
+{
+    char dev_name[DISK_NAME_LEN];
+    char disk_name[DISK_NAME_LEN];
+    struct io_latency_ctx_s *c = (struct io_latency_ctx_s *)ctx;
+    const struct io_histo_key_s *histo_key = (const struct io_histo_key_s *)key;
+    struct sli_histo_s *histo = &(c->merged);
+
+    if (histo_key->op >= IO_OP_MAX || histo_key->stage >= IO_STAGE_MAX) {
+        return MAP_BATCH_DEL;
+    }
+
+    sli_histo_merge(histo, (const struct sli_histo_s *)value, c->cpus);
+    if (histo->count == 0) {
+        return MAP_BATCH_DEL;
+    }
+
+    get_blk_dev_name(histo_key->major, histo_key->first_minor, dev_name, disk_name);
+
+    (void)fprintf(stdout, "|%s|%d|%d|%s|%s|%llu|%s|%s"
+        "|%llu|%llu|%llu|%llu|%llu|%llu|%llu|\n",
+
+        IO_TBL_LATENCY_HISTO,
+        histo_key->major,
+        histo_key->first_minor,
+        io_op_names[histo_key->op],
+        io_stage_names[histo_key->stage],
+        histo_key->cgrp_id,
+        dev_name,
+        disk_name,
+
+        histo->count,
+        histo->sum,
+        histo->max,
+        sli_histo_quantile(histo, 0.5),
+        sli_histo_quantile(histo, 0.9),
+        sli_histo_quantile(histo, 0.99),
+        sli_histo_quantile(histo, 0.999));
+    return MAP_BATCH_DEL;
+}
+
+// Requests not recorded in the histograms as io_histo_map was full, summed over all CPUs
+static void check_io_histo_drops(struct io_latency_ctx_s *c)
+{
+    u32 key = 0;
+    u64 drops = 0;
+    u64 values[c->cpus];
+
+    if (bpf_map_lookup_elem(c->histo_drops_fd, &key, values) != 0) {
+        return;
+    }
+    for (int i = 0; i < c->cpus; i++) {
+        drops += values[i];
+    }
+    if (drops != c->histo_drops) {
+        WARN("[IOPROBE] io_histo_map is full, %llu requests are not recorded in the histograms(total %llu).\n",
+            drops - c->histo_drops, drops);
+        c->histo_drops = drops;
+    }
+}
+
+static void io_latency_timer(void *ctx)
+{
+    struct io_latency_ctx_s *c = (struct io_latency_ctx_s *)ctx;
+
+    (void)map_batch_drain(c->latency_batch, pull_io_latency, c);
+    (void)map_batch_drain(c->histo_batch, pull_io_histo, c);
+    check_io_histo_drops(c);
     (void)fflush(stdout);
 }
 
+static void io_latency_free(struct io_latency_ctx_s *c)
+{
+    map_batch_free(&(c->latency_batch));
+    map_batch_free(&(c->histo_batch));
+}
+
 static void rcv_io_err(void *ctx, int cpu, void *data, __u32 size)
 {
     int blk_err = 0;
@@ -437,10 +499,7 @@ static void rcv_io_err(void *ctx, int cpu, void *data, __u32 size)
     entityId[0] = 0;
     __build_entity_id(io_err->major, io_err->first_minor, entityId, __ENTITY_ID_LEN);
 
-    dev_name[0] = 0;
-    disk_name[0] = 0;
-    get_devname(io_err->major, io_err->first_minor, dev_name, DISK_NAME_LEN);
-    get_diskname((const char*)dev_name, disk_name, DISK_NAME_LEN);
+    get_blk_dev_name(io_err->major, io_err->first_minor, dev_name, disk_name);
 
     evt.entityName = OO_NAME;
     evt.entityId = entityId;
@@ -487,28 +546,55 @@ static char is_load_probe(char *probe_name)
 static void load_io_args(int fd, struct probe_params* args)
 {
     u32 key = 0;
-    int major;
-    int minor;
+    struct blk_dev_s *dev;
     struct io_trace_args_s io_args = {0};
 
-    if ((args->target_dev[0] != 0) && (!get_devt(args->target_dev, &major, &minor))) {
-        io_args.target_major = major;
-        io_args.target_first_minor = minor;
+    if ((args->target_dev[0] != 0) && (g_blk_devs != NULL)) {
+        dev = blk_dev_find_by_name(g_blk_devs, args->target_dev);
+        if (dev != NULL) {
+            io_args.target_major = dev->major;
+            io_args.target_first_minor = dev->minor;
+        } else {
+            fprintf(stderr, "dev \'%s\' not exist.\n", args->target_dev);
+        }
     }
     io_args.report_period = NS(args->period);
     io_args.sample_interval = (u64)((u64)args->sample_period * 1000 * 1000);
+    io_args.cgrp_histo = (args->env_flags & SUPPORT_CONTAINER_ENV) ? 1 : 0;
 
     (void)bpf_map_update_elem(fd, &key, &io_args, BPF_ANY);
 }
 
+static u32 get_io_histo_max(const struct probe_params *args)
+{
+    u64 histo_max = 0;
+
+    if (g_blk_devs != NULL) {
+        histo_max = (u64)H_COUNT(g_blk_devs->devs) * IO_OP_MAX * IO_STAGE_MAX;
+    }
+    if (args->env_flags & SUPPORT_CONTAINER_ENV) {
+        histo_max *= IO_HISTO_CGRP_NUM;
+    }
+    if (histo_max < IO_HISTO_MIN) {
+        return IO_HISTO_MIN;
+    }
+    return (histo_max > IO_HISTO_LIMIT) ? IO_HISTO_LIMIT : (u32)histo_max;
+}
+
 int main(int argc, char **argv)
 {
     int ret = 0;
     char scsi_probe, nvme_probe, virtblk_probe;
     char is_load_err, is_load_count, is_load_pagecache;
     FILE *fp = NULL;
-    struct perf_buffer *io_err_pb = NULL, *io_latency_pb = NULL;
-    struct perf_buffer *page_cache_pb = NULL, *io_count_pb = NULL;
+    struct perf_buffer *io_err_pb = NULL;
+    struct perf_buffer *page_cache_pb = NULL;
+    u64 io_err_lost = 0, page_cache_lost = 0;
+    struct io_count_ctx_s io_count_ctx = {0};
+    struct io_latency_ctx_s io_latency_ctx = {0};
+    int io_latency_fd = -1, io_histo_fd = -1;
+    u32 io_histo_max;
+    struct evt_loop_s *loop = NULL;
 
     ret = args_parse(argc, argv, &params);
     if (ret != 0) {
@@ -529,51 +615,70 @@ int main(int argc, char **argv)
     is_load_count = IS_LOAD_PROBE(params.load_probe, IO_PROBE_COUNT);
     is_load_pagecache = IS_LOAD_PROBE(params.load_probe, IO_PROBE_PAGECACHE);
 
+    g_blk_devs = blk_dev_tbl_new();
+    io_histo_max = get_io_histo_max(&params);
+
     INIT_BPF_APP(ioprobe, EBPF_RLIM_LIMITED);
 
     __LOAD_IO_PROBE(io_count, err6, is_load_count);
     __LOAD_IO_PROBE(io_err, err5, is_load_err);
     __LOAD_IO_PROBE(page_cache, err4, is_load_pagecache);
-    __LOAD_IO_LATENCY(io_trace_scsi, err3, scsi_probe);
-    __LOAD_IO_LATENCY(io_trace_nvme, err2, nvme_probe);
-    __LOAD_IO_LATENCY(io_trace_virtblk, err, virtblk_probe);
+    __LOAD_IO_LATENCY(io_trace_scsi, err3, scsi_probe, io_histo_max);
+    __LOAD_IO_LATENCY(io_trace_nvme, err2, nvme_probe, io_histo_max);
+    __LOAD_IO_LATENCY(io_trace_virtblk, err, virtblk_probe, io_histo_max);
 
     if (is_load_pagecache) {
-        page_cache_pb = create_pref_buffer(GET_MAP_FD(page_cache, page_cache_channel_map),
-                                           rcv_pagecache_stats);
+        page_cache_pb = create_pref_buffer3(GET_MAP_FD(page_cache, page_cache_channel_map),
+                                            rcv_pagecache_stats, &page_cache_lost);
         io_args_fd = GET_MAP_FD(page_cache, io_args_map);
     }
 
     if (is_load_count) {
-        io_count_pb = create_pref_buffer(GET_MAP_FD(io_count, io_count_channel_map),
-                                           rcv_io_count);
+        io_count_ctx.cpus = libbpf_num_possible_cpus();
+        if (io_count_ctx.cpus > 0) {
+            io_count_ctx.batch = map_batch_new(GET_MAP_FD(io_count, io_count_map), sizeof(struct io_entity_s),
+                                               sizeof(struct io_count_s) * io_count_ctx.cpus);
+        }
         io_args_fd = GET_MAP_FD(io_count, io_args_map);
     }
 
     if (is_load_err) {
-        io_err_pb = create_pref_buffer(GET_MAP_FD(io_err, io_err_channel_map),
-                                           rcv_io_err);
+        io_err_pb = create_pref_buffer3(GET_MAP_FD(io_err, io_err_channel_map),
+                                        rcv_io_err, &io_err_lost);
         io_args_fd = GET_MAP_FD(io_err, io_args_map);
     }
 
     if (scsi_probe) {
-        io_latency_pb = create_pref_buffer(GET_MAP_FD(io_trace_scsi, io_latency_channel_map),
-                                           rcv_io_latency);
+        io_latency_fd = GET_MAP_FD(io_trace_scsi, io_latency_map);
+        io_histo_fd = GET_MAP_FD(io_trace_scsi, io_histo_map);
+        io_latency_ctx.histo_drops_fd = GET_MAP_FD(io_trace_scsi, io_histo_drops);
         io_args_fd = GET_MAP_FD(io_trace_scsi, io_args_map);
     } else if (nvme_probe) {
-        io_latency_pb = create_pref_buffer(GET_MAP_FD(io_trace_nvme, io_latency_channel_map),
-                                           rcv_io_latency);
+        io_latency_fd = GET_MAP_FD(io_trace_nvme, io_latency_map);
+        io_histo_fd = GET_MAP_FD(io_trace_nvme, io_histo_map);
+        io_latency_ctx.histo_drops_fd = GET_MAP_FD(io_trace_nvme, io_histo_drops);
         io_args_fd = GET_MAP_FD(io_trace_nvme, io_args_map);
     } else if (virtblk_probe) {
-        io_latency_pb = create_pref_buffer(GET_MAP_FD(io_trace_virtblk, io_latency_channel_map),
-                                           rcv_io_latency);
+        io_latency_fd = GET_MAP_FD(io_trace_virtblk, io_latency_map);
+        io_histo_fd = GET_MAP_FD(io_trace_virtblk, io_histo_map);
+        io_latency_ctx.histo_drops_fd = GET_MAP_FD(io_trace_virtblk, io_histo_drops);
         io_args_fd = GET_MAP_FD(io_trace_virtblk, io_args_map);
     }
 
+    if (scsi_probe || nvme_probe || virtblk_probe) {
+        io_latency_ctx.cpus = libbpf_num_possible_cpus();
+        io_latency_ctx.latency_batch = map_batch_new(io_latency_fd, sizeof(struct io_entity_s),
+                                                     sizeof(struct io_latency_s));
+        if (io_latency_ctx.cpus > 0) {
+            io_latency_ctx.histo_batch = map_batch_new(io_histo_fd, sizeof(struct io_histo_key_s),
+                                                       sizeof(struct sli_histo_s) * io_latency_ctx.cpus);
+        }
+    }
+
     load_io_args(io_args_fd, &params);
 
     if (scsi_probe || nvme_probe || virtblk_probe) {
-        if (io_latency_pb == NULL) {
+        if (io_latency_ctx.latency_batch == NULL || io_latency_ctx.histo_batch == NULL) {
             fprintf(stderr, "Load io latency prog failed.\n");
             goto err;
         }
@@ -587,7 +692,7 @@ int main(int argc, char **argv)
     }
 
     if (is_load_count) {
-        if (io_count_pb == NULL) {
+        if (io_count_ctx.batch == NULL) {
             fprintf(stderr, "Load io count prog failed.\n");
             goto err;
         }
@@ -605,48 +710,38 @@ int main(int argc, char **argv)
         goto err;
     }
 
+    loop = evt_loop_new();
+    if (loop == NULL) {
+        goto err;
+    }
+    if (evt_loop_add_pb(loop, io_err_pb, &io_err_lost, "io_err") ||
+        evt_loop_add_pb(loop, page_cache_pb, &page_cache_lost, "page_cache")) {
+        goto err;
+    }
+    if (is_load_count && evt_loop_add_timer(loop, params.period * THOUSAND, io_count_timer, &io_count_ctx)) {
+        goto err;
+    }
+    if ((scsi_probe || nvme_probe || virtblk_probe) &&
+        evt_loop_add_timer(loop, params.period * THOUSAND, io_latency_timer, &io_latency_ctx)) {
+        goto err;
+    }
+
     printf("Successfully started!\n");
 
     while (!g_stop) {
-        if (io_latency_pb) {
-            ret = perf_buffer__poll(io_latency_pb, THOUSAND);
-            if (ret < 0) {
-                break;
-            }
-        }
-
-        if (io_err_pb) {
-            ret = perf_buffer__poll(io_err_pb, THOUSAND);
-            if (ret < 0) {
-                break;
-            }
-        }
-
-        if (io_count_pb) {
-            ret = perf_buffer__poll(io_count_pb, THOUSAND);
-            if (ret < 0) {
-                break;
-            }
-        }
-
-        if (page_cache_pb) {
-            ret = perf_buffer__poll(page_cache_pb, THOUSAND);
-            if (ret < 0) {
-                break;
-            }
+        ret = evt_loop_poll(loop, THOUSAND);
+        if (ret < 0) {
+            break;
         }
     }
 
 err:
-    if (io_latency_pb) {
-        perf_buffer__free(io_latency_pb);
-    }
+    evt_loop_free(&loop);
+    io_latency_free(&io_latency_ctx);
     if (io_err_pb) {
         perf_buffer__free(io_err_pb);
     }
-    if (io_count_pb) {
-        perf_buffer__free(io_count_pb);
-    }
+    io_count_free(&io_count_ctx);
     if (page_cache_pb) {
         perf_buffer__free(page_cache_pb);
     }
@@ -673,6 +768,7 @@ err6:
     if (is_load_count) {
         UNLOAD(io_count);
     }
+    blk_dev_tbl_free(&g_blk_devs);
     return ret;
 }
 
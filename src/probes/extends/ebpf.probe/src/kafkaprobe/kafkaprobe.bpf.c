@@ -43,20 +43,14 @@ struct xdp_md {
 
 #endif
 
+// 按(客户端, topic, 类型)聚合，用户态每个输出周期读取并清空
 struct {
-    __uint(type, BPF_MAP_TYPE_ARRAY);
-    __uint(key_size, sizeof(__u32));
-    __uint(value_size, sizeof(struct KafkaData));
-    __uint(max_entries, MAP_MAX_ITEM);
+    __uint(type, BPF_MAP_TYPE_LRU_PERCPU_HASH);
+    __uint(key_size, sizeof(struct KafkaKey));
+    __uint(value_size, sizeof(struct KafkaValue));
+    __uint(max_entries, DATA_MAX_ITEM);
 } xdp_data_map SEC(".maps");
 
-struct {
-    __uint(type, BPF_MAP_TYPE_ARRAY);
-    __uint(key_size, sizeof(__u32));
-    __uint(value_size, sizeof(__u32));
-    __uint(max_entries, MAP_MAX_ITEM);
-} xdp_ctrl_map SEC(".maps");
-
 struct {
     __uint(type, BPF_MAP_TYPE_ARRAY);
     __uint(key_size, sizeof(__u32));
@@ -184,30 +178,18 @@ static __always_inline int parse_tcphdr(struct hdr_cursor *nh, void *data_end, _
     return 0;
 }
 
-static __always_inline int get_empty_data(int **ctrl, struct KafkaData **rec)
+static __always_inline struct KafkaValue *get_data_value(struct KafkaKey *key)
 {
-    __u32 i,j;
-    j = 0;
-    
-    #pragma unroll
-    for (i=0;i<MAP_MAX_ITEM;i++) {
-        *ctrl = bpf_map_lookup_elem(&xdp_ctrl_map, &j);
-        if (!*ctrl){
-            j+=1;
-            continue;
-        }
-            
-        if(**ctrl == 0){
-            *rec = bpf_map_lookup_elem(&xdp_data_map, &j);
-            if (!rec)
-                return 0;
-            **ctrl = 1;
-            return 1;
-        }
-        j += 1;
+    struct KafkaValue *val;
+    struct KafkaValue zero = {0};
+
+    val = bpf_map_lookup_elem(&xdp_data_map, key);
+    if (val) {
+        return val;
     }
 
-    return 0;
+    (void)bpf_map_update_elem(&xdp_data_map, key, &zero, BPF_NOEXIST);
+    return bpf_map_lookup_elem(&xdp_data_map, key);
 }
 
 static __always_inline int copy_data(__u8 *dst, int len, __u8 *src, void *data_end)
@@ -235,8 +217,9 @@ static __always_inline int copy_data(__u8 *dst, int len, __u8 *src, void *data_e
 
 static __always_inline int parse_consumer(struct hdr_cursor *nh, void *data_end, __u32 *src_ip, __u16* src_port, __u16* dst_port)
 {
-    int *ctrl;
-    struct KafkaData *rec = 0;
+    struct KafkaKey key = {0};
+    struct KafkaValue *val;
+    __u32 offset;
 
     struct PacketParser3 *part_data;
     struct PacketParser3 *topic_data;
@@ -258,35 +241,32 @@ static __always_inline int parse_consumer(struct hdr_cursor *nh, void *data_end,
     if(pos_data + 1 > data_end)
         return 4;
 
-    if(!get_empty_data(&ctrl, &rec)){
-        bpf_printk("array is full!");
-        return 5; 
+    key.src_ip = *src_ip;
+    key.src_port = *src_port;
+    key.dst_port = *dst_port;
+    key.type = CONSUMER_MSG_TYPE;
+    key.len = topic_data->len;
+    if(key.len>SMALL_BUF_SIZE){
+        bpf_printk("Error: exceed buf, topic len: %d", key.len);
+        key.len = SMALL_BUF_SIZE;
     }
-        
-    if(!rec)
+    copy_data(key.data, key.len, topic_data->data, data_end);
+
+    val = get_data_value(&key);
+    if(!val)
         return 6;
 
-    rec->src_ip = *src_ip;
-    rec->src_port = *src_port;
-    rec->dst_port = *dst_port;
-    rec->type = CONSUMER_MSG_TYPE;
-    rec->len = topic_data->len;
-    if(rec->len>SMALL_BUF_SIZE){
-        bpf_printk("Error: exceed buf, topic len: %d", rec->len);
-        rec->len = SMALL_BUF_SIZE;
-    }
-    rec->num = hton32(pos_data->param1);
-    copy_data(rec->data, rec->len, topic_data->data, data_end);
-    // bpf_skb_load_bytes
-    *ctrl = 2;
+    offset = hton32(pos_data->param1);
+    if(offset > val->offset)
+        val->offset = offset;
 
     return 0;    
 }
 
 static __always_inline int parse_producer(struct hdr_cursor *nh, void *data_end, __u32 *src_ip, __u16* src_port, __u16* dst_port)
 {    
-    int *ctrl;
-    struct KafkaData *rec = 0;
+    struct KafkaKey key = {0};
+    struct KafkaValue *val;
 
     struct PacketParser3 *part_data;
     struct PacketParser3 *topic_data;
@@ -306,27 +286,22 @@ static __always_inline int parse_producer(struct hdr_cursor *nh, void *data_end,
     if(topic_num + 1 > data_end)
         return 4;
 
-    if(!get_empty_data(&ctrl, &rec)){
-        bpf_printk("array is full!");
-        return 5; 
+    key.src_ip = *src_ip;
+    key.src_port = *src_port;
+    key.dst_port = *dst_port;
+    key.type = PRODUCER_MSG_TYPE;
+    key.len = topic_data->len;
+    if(key.len>SMALL_BUF_SIZE){
+        bpf_printk("Error: exceed buf, topic len: %d", key.len);
+        key.len = SMALL_BUF_SIZE;
     }
-        
-    if(!rec)
-        return 6;
+    copy_data(key.data, key.len, topic_data->data, data_end);
 
-    rec->src_ip = *src_ip;
-    rec->src_port = *src_port;
-    rec->dst_port = *dst_port;
-    rec->type = PRODUCER_MSG_TYPE;
-    rec->len = topic_data->len;
-    if(rec->len>SMALL_BUF_SIZE){
-        bpf_printk("Error: exceed buf, topic len: %d", rec->len);
-        rec->len = SMALL_BUF_SIZE;
-    }
-    rec->num = topic_num->param2;
-    copy_data(rec->data, rec->len, topic_data->data, data_end);
+    val = get_data_value(&key);
+    if(!val)
+        return 6;
 
-    *ctrl = 2;
+    val->num += topic_num->param2;
 
     return 0;
 }
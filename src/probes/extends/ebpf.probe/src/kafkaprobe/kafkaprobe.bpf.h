@@ -15,16 +15,26 @@
 
 #define VLAN_MAX_DEPTH 10
 
-struct KafkaData {
+// 内核中按(客户端, topic, 类型)聚合的最大条目数
+#define DATA_MAX_ITEM 1024
+
+// 聚合的key：客户端、topic与消息类型
+struct KafkaKey {
     __u16 type;
     __u16 len;
-    __u32 num;
     __u32 src_ip;
     __u16 src_port;
     __u16 dst_port;
     __u8 data[SMALL_BUF_SIZE];
 };
 
+// 每个CPU上的聚合值
+struct KafkaValue {
+    __u64 num;      // producer: 周期内生产的消息数
+    __u32 offset;   // consumer: 周期内读取的最大消息偏移
+    __u32 pad;
+};
+
 struct PacketParser1{
     __u32 param1;
     __u32 param2;
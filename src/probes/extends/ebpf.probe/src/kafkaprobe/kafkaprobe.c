@@ -40,10 +40,10 @@ void quit_handler(int sig){
     quit_flag = 1;
 }
 
-static void start_up(int ctrl_map_fd, int data_map_fd, int port_map_fd, struct KafkaConfig *cfg){
-    struct KafkaData client_array[CLIENT_MAX_ITEM];
-    __u32 topic_num[CLIENT_MAX_ITEM];
-    struct KafkaData new_data;
+static void start_up(int data_map_fd, int port_map_fd, struct KafkaConfig *cfg){
+    struct KafkaClient *clients = NULL;
+    struct map_batch_s *batch;
+    int cpus = libbpf_num_possible_cpus();
     int ret;
 
     // 将kafka_port写入xdp_port_map中，设计上支持监控多个端口，目前只实现监控一个端口
@@ -55,23 +55,31 @@ static void start_up(int ctrl_map_fd, int data_map_fd, int port_map_fd, struct K
         return;                
     }
 
-    __u64 start_time = gettime();
-    __u64 now;
+    if(cpus <= 0){
+        fprintf(stderr, "Error: get number of possible cpus fail, exit\n");
+        return;
+    }
+
+    // xdp程序在内核中按(client, topic, type)聚合，每个输出周期读取并清空一次
+    batch = map_batch_new(data_map_fd, sizeof(struct KafkaKey), sizeof(struct KafkaValue) * cpus);
+    if(!batch){
+        fprintf(stderr, "Error: create batch of xdp_data_map fail, exit\n");
+        return;
+    }
+
     while (!quit_flag) {
-        ret = collect(ctrl_map_fd, data_map_fd, &new_data);
-        if(ret){
-            sleep(0.01);            
-        }else{
-            refresh_array(&new_data, client_array, topic_num);
+        sleep(cfg->output_period);
+
+        ret = collect(batch, &clients);
+        if(ret < 0){
+            fprintf(stderr, "WARN: collect xdp_data_map fail\n");
         }
-    
-        now = gettime();
-        if((now-start_time)/NANOSEC_PER_SEC > cfg->output_period){
-            output_array_terminal(client_array, topic_num);
-            clean_array(client_array, topic_num);
-            start_time = now;
-        }    
+        output_clients_terminal(clients);
+        clean_clients(&clients);
     }
+
+    free_clients(&clients);
+    map_batch_free(&batch);
 }
 
 static struct probe_params params = { .period = DEFAULT_PERIOD };
@@ -133,15 +141,14 @@ int main(int argn, char** argv){
     }
 
     // 获取map的文件句柄
-    int data_map_fd, ctrl_map_fd, port_map_fd;
+    int data_map_fd, port_map_fd;
     open_bpf_map_file(&cfg, "xdp_data_map", &data_map_fd);
-    open_bpf_map_file(&cfg, "xdp_ctrl_map", &ctrl_map_fd);
     open_bpf_map_file(&cfg, "xdp_port_map", &port_map_fd);
 
 
     // 开始采集
     printf("Kafka Probe Start!\n");
-    start_up(ctrl_map_fd, data_map_fd, port_map_fd, &cfg);
+    start_up(data_map_fd, port_map_fd, &cfg);
 
 clean:
     ret = unpin_unlink_unload(&cfg, obj);
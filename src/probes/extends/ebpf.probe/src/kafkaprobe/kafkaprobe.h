@@ -1,6 +1,8 @@
 #ifndef __KAFKAPROBE_H
 #define __KAFKAPROBE_H
 
+#include "hash.h"
+#include "map_batch.h"
 #include "kafkaprobe.bpf.h"
 
 // bpf内核程序中Map的数目
@@ -9,6 +11,15 @@
 // 用户态中存储kafka client的最大数目
 #define CLIENT_MAX_ITEM 256
 
+// 用户态中记录的kafka client
+struct KafkaClient {
+    H_HANDLE;
+    struct KafkaKey key;
+    __u64 num;          // 本周期内的消息数
+    __u32 offset;       // consumer最近一次读取的消息偏移
+    __u32 active;       // 本周期内是否出现
+};
+
 struct KafkaConfig {
     char ifname[MIDDLE_BUF_SIZE];
     __u32 ifindex;
@@ -43,11 +54,10 @@ const char *get_msg_type(__u32 index);
 int u8ncmp(const __u8* d1, const __u8* d2, __u32 len);
 
 
-int collect(int ctrl_map_fd, int data_map_fd, struct KafkaData *data);
-int kafka_data_cmp(struct KafkaData *d1, struct KafkaData *d2);
-int refresh_array(struct KafkaData *new_client, struct KafkaData *client_array, __u32 *topic_num);
-int output_array_terminal(struct KafkaData *client_array, __u32* topic_num);
-int clean_array(struct KafkaData *client_array, __u32* topic_num);
+int collect(struct map_batch_s *batch, struct KafkaClient **clients);
+int output_clients_terminal(struct KafkaClient *clients);
+int clean_clients(struct KafkaClient **clients);
+void free_clients(struct KafkaClient **clients);
 
 #endif
 
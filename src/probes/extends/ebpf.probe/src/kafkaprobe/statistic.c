@@ -14,124 +14,129 @@
 
 #include "kafkaprobe.h"
 
-/* 收集数据 */
-int collect(int ctrl_map_fd, int data_map_fd, struct KafkaData *data){
-    memset(data, 0, sizeof(struct KafkaData));
-    int ret;
-    __u32 ctrl;
+struct collect_ctx {
+    struct KafkaClient **clients;
+    int cpus;
+};
 
-    for(int i=0;i<MAP_MAX_ITEM;i++){
-        ctrl = 0;
-        ret = bpf_map_lookup_elem(ctrl_map_fd, &i, &ctrl);
-        if (ret){
-            fprintf(stderr,"WARN: read %d xdp_ctrl_map fail\n", i);
-            continue;
-        }
-            
-        if (ctrl==2){
-            ret = bpf_map_lookup_elem(data_map_fd, &i, data);
-            if(ret){
-                fprintf(stderr, "WARN: read %d xdp_data_map fail\n", i);
-                continue;
-            }
-                
-            ctrl = 0;
-            ret = bpf_map_update_elem(ctrl_map_fd, &i, &ctrl, BPF_ANY);
-            if(ret){
-                fprintf(stderr, "WARN: write %d xdp_ctrl_map fail\n", i);
-                continue;                
-            }
-            break;
-        }
+static struct KafkaClient *get_client(struct KafkaClient **clients, const struct KafkaKey *key, int *is_new)
+{
+    struct KafkaClient *client = NULL;
+
+    *is_new = 0;
+    H_FIND(*clients, key, sizeof(struct KafkaKey), client);
+    if (client) {
+        return client;
     }
 
-    if(data->src_ip == 0){
-        return 1;
+    if (H_COUNT(*clients) >= CLIENT_MAX_ITEM) {
+        return NULL;
     }
 
-    return 0;
+    client = (struct KafkaClient *)calloc(1, sizeof(struct KafkaClient));
+    if (!client) {
+        return NULL;
+    }
+    memcpy(&client->key, key, sizeof(struct KafkaKey));
+    H_ADD_KEYPTR(*clients, &client->key, sizeof(struct KafkaKey), client);
+    *is_new = 1;
+    return client;
 }
 
-int kafka_data_cmp(struct KafkaData *d1, struct KafkaData *d2){
-        if (d1->type!=d2->type)
-            return 1;        
-        if (d1->src_ip!=d2->src_ip)
-            return 1;
-        if (d1->src_port!=d2->src_port)
-            return 1;
-        if (d1->dst_port!=d2->dst_port)
-            return 1;    
-        if (d1->len!=d2->len)
-            return 1;            
-        if (u8ncmp(d1->data, d2->data, d1->len))
-            return 1;
+/* 合并xdp_data_map中一个client在各个CPU上的聚合值 */
+static int update_client(const void *key, const void *value, void *ctx)
+{
+    struct collect_ctx *c = (struct collect_ctx *)ctx;
+    const struct KafkaKey *k = (const struct KafkaKey *)key;
+    const struct KafkaValue *values = (const struct KafkaValue *)value;
+    struct KafkaClient *client;
+    __u64 num = 0;
+    __u32 offset = 0;
+    int is_new;
+
+    for (int i = 0; i < c->cpus; i++) {
+        num += values[i].num;
+        if (values[i].offset > offset) {
+            offset = values[i].offset;
+        }
+    }
 
-        return 0;    
+    client = get_client(c->clients, k, &is_new);
+    if (!client) {
+        fprintf(stderr, "WARN: kafka client table is full\n");
+        return MAP_BATCH_DEL;
+    }
+    client->active = 1;
+
+    if (k->type == PRODUCER_MSG_TYPE) {
+        client->num += num;
+    } else if (k->type == CONSUMER_MSG_TYPE) {
+        if (is_new) {
+            client->num = 1;
+            client->offset = offset;
+        } else if (offset > client->offset) {
+            client->num += offset - client->offset;
+            client->offset = offset;
+        }
+    }
+    return MAP_BATCH_DEL;
 }
 
-/* 将数据写入数组 */
-int refresh_array(struct KafkaData *new_client, struct KafkaData *client_array, __u32 *topic_num){
-    for(int i=0;i<CLIENT_MAX_ITEM;i++){
-        if (client_array[i].src_ip == 0){
-            memcpy(&client_array[i], new_client, sizeof(struct KafkaData));
+/* 读取并清空内核中本周期聚合的数据 */
+int collect(struct map_batch_s *batch, struct KafkaClient **clients)
+{
+    struct collect_ctx ctx = {.clients = clients, .cpus = libbpf_num_possible_cpus()};
 
-            if(new_client->type == PRODUCER_MSG_TYPE){
-                topic_num[i] += new_client->num;
-            }else if(new_client->type == CONSUMER_MSG_TYPE){
-                topic_num[i] = 1;
-            }
+    if (ctx.cpus <= 0) {
+        return -1;
+    }
+    return map_batch_drain(batch, update_client, &ctx);
+}
 
-            return 0;
-        }
+/* 本周期未出现的consumer与所有producer被移除，其余consumer保留读取偏移 */
+int clean_clients(struct KafkaClient **clients)
+{
+    struct KafkaClient *client, *tmp;
 
-        if(kafka_data_cmp(&client_array[i], new_client))
+    H_ITER(*clients, client, tmp) {
+        if (client->key.type != CONSUMER_MSG_TYPE || !client->active) {
+            H_DEL(*clients, client);
+            free(client);
             continue;
-
-        if(new_client->type == PRODUCER_MSG_TYPE){
-            topic_num[i] += new_client->num;
-        }else if(new_client->type == CONSUMER_MSG_TYPE){
-            if(new_client->num > client_array[i].num){
-                topic_num[i] += new_client->num - client_array[i].num;
-                client_array[i].num = new_client->num;
-            }
         }
-        
-        return 0;                    
+        client->num = 0;
+        client->active = 0;
     }
-    
-    return 1;
+    return 0;
 }
 
-int clean_array(struct KafkaData *client_array, __u32* topic_num){
-    struct KafkaData tmp_clinet_array[CLIENT_MAX_ITEM];
-    int consumer_num = 0;
-    for(int i=0;i<CLIENT_MAX_ITEM;i++){
-        if(client_array[i].type == CONSUMER_MSG_TYPE && topic_num[i] > 0){
-            memcpy(&tmp_clinet_array[consumer_num], &client_array[i], sizeof(struct KafkaData));
-            consumer_num += 1;
-        }
-    }
+void free_clients(struct KafkaClient **clients)
+{
+    struct KafkaClient *client, *tmp;
 
-    memset(client_array, 0, sizeof(struct KafkaData)*CLIENT_MAX_ITEM);
-    memset(topic_num, 0, sizeof(__u32)*CLIENT_MAX_ITEM);
-    memcpy(client_array, tmp_clinet_array, sizeof(struct KafkaData)*consumer_num);
-    return 0;
+    H_ITER(*clients, client, tmp) {
+        H_DEL(*clients, client);
+        free(client);
+    }
 }
 
-int output_array_terminal(struct KafkaData *client_array, __u32* topic_num){
-    for(int i=0;i<CLIENT_MAX_ITEM;i++){
-        if(topic_num[i] == 0)
-            break;
+int output_clients_terminal(struct KafkaClient *clients)
+{
+    struct KafkaClient *client, *tmp;
+
+    H_ITER(clients, client, tmp) {
+        if(client->num == 0)
+            continue;
 
-        fprintf(stderr, "|%s|%s|%s|%d|%d|%s|%s|%d|\n", 
+        fprintf(stderr, "|%s|%s|%s|%d|%llu|%s|%s|%d|\n", 
             "kafkaprobe",
-            get_msg_type(client_array[i].type),
-            IP_ntoh(client_array[i].src_ip),
-            htons(client_array[i].src_port),
-            topic_num[i],
-            client_array[i].data,
+            get_msg_type(client->key.type),
+            IP_ntoh(client->key.src_ip),
+            htons(client->key.src_port),
+            client->num,
+            client->key.data,
             get_local_ip(),
-            htons(client_array[i].dst_port));
+            htons(client->key.dst_port));
     }
 
     return 0;
@@ -179,7 +184,7 @@ const char *get_msg_type(__u32 index){
 
 const char *MAP_NAME[MAP_NUM] = {
     "xdp_data_map",
-    "xdp_ctrl_map",
+    "xdp_port_map",
 };
 
 const char *get_map_name(__u32 index){
@@ -19,6 +19,7 @@
 #include "bpf.h"
 #include <bpf/bpf_endian.h>
 #include "ksliprobe.h"
+#include "sli_histo.h"
 
 #define BPF_F_INDEX_MASK        0xffffffffULL
 #define BPF_F_CURRENT_CPU       BPF_F_INDEX_MASK
@@ -37,11 +38,8 @@ struct {
     __uint(max_entries, MAX_CONN_LEN);
 } conn_map SEC(".maps");
 
-struct {
-    __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
-    __uint(key_size, sizeof(u32));
-    __uint(value_size, sizeof(u32));
-} msg_event_map SEC(".maps");
+BPF_OUTPUT_MAP(msg_event_map, BPF_OUTPUT_BUF_SIZE);
+BPF_OUTPUT_SCRATCH_MAP(msg_event_scratch, struct msg_event_data_t);
 
 // Data collection args
 struct {
@@ -51,6 +49,8 @@ struct {
     __uint(max_entries, 1);
 } args_map SEC(".maps");
 
+SLI_HISTO_MAPS(sli_histo_map);
+
 enum samp_status_t {
     SAMP_INIT = 0,
     SAMP_READ_READY,
@@ -155,26 +155,6 @@ static __always_inline int update_conn_map_n_conn_samp_map(int fd, int tgid, str
     return init_conn_samp_data(sk);
 }
 
-// 关闭 tcp 连接
-KPROBE(__close_fd, pt_regs)
-{
-    int fd;
-    u32 tgid = bpf_get_current_pid_tgid() >> INT_LEN;
-    struct conn_key_t conn_key = {0};
-    struct conn_data_t *conn_data;
-
-    fd = (int)PT_REGS_PARM2(ctx);
-    init_conn_key(&conn_key, fd, tgid);
-    conn_data = (struct conn_data_t *)bpf_map_lookup_elem(&conn_map, &conn_key);
-    if (conn_data == (void *)0) {
-        return 0;
-    }
-    bpf_map_delete_elem(&conn_samp_map, &conn_data->sk);
-    bpf_map_delete_elem(&conn_map, &conn_key);
-
-    return 0;
-}
-
 static __always_inline void parse_msg_to_redis_cmd(char msg_char, int *j, char *command, unsigned short *find_state)
 {
     switch (*find_state) {
@@ -257,9 +237,21 @@ static __always_inline int parse_req(struct conn_data_t *conn_data, const unsign
     return PROTOCOL_NO_REDIS;
 }
 
+// Without raw sli, a connection is only reported when its sli is above the threshold.
+static __always_inline int report_raw_sli(struct conn_data_t *conn_data)
+{
+    u32 key = 0;
+    struct ksli_args_s *args = (struct ksli_args_s *)bpf_map_lookup_elem(&args_map, &key);
+
+    if (args == (void *)0 || args->period == 0 || args->raw_sli_flag) {
+        return 1;
+    }
+    return (args->latency_thr > 0) &&
+           (conn_data->latency.rtt_nsec > args->latency_thr || conn_data->max.rtt_nsec > args->latency_thr);
+}
+
 static __always_inline int periodic_report(u64 ts_nsec, struct conn_data_t *conn_data, struct pt_regs *ctx)
 {
-    long err;
     int ret = 0;
 
     // period cannot be 0, so it is considered that the user mode has not written to args_map by now.
@@ -277,17 +269,18 @@ static __always_inline int periodic_report(u64 ts_nsec, struct conn_data_t *conn
     if (ts_nsec > conn_data->last_report_ts_nsec &&
         ts_nsec - conn_data->last_report_ts_nsec >= period) {
         // rtt larger than period is considered an invalid value
-        if (conn_data->latency.rtt_nsec < period) {
-            struct msg_event_data_t msg_evt_data = {0};
-            msg_evt_data.conn_id = conn_data->id;
-            msg_evt_data.server_ip_info = conn_data->id.server_ip_info;
-            msg_evt_data.client_ip_info = conn_data->id.client_ip_info;
-            msg_evt_data.latency = conn_data->latency;
-            msg_evt_data.max = conn_data->max;
-            err = bpf_perf_event_output(ctx, &msg_event_map, BPF_F_CURRENT_CPU,
-                                        &msg_evt_data, sizeof(struct msg_event_data_t));
-            if (err < 0) {
+        if (conn_data->latency.rtt_nsec < period && report_raw_sli(conn_data)) {
+            struct msg_event_data_t *msg_evt_data;
+            msg_evt_data = bpf_output_reserve(&msg_event_map, &msg_event_scratch, struct msg_event_data_t);
+            if (msg_evt_data == NULL) {
                 bpf_printk("message event sent failed.\n");
+            } else {
+                msg_evt_data->conn_id = conn_data->id;
+                msg_evt_data->server_ip_info = conn_data->id.server_ip_info;
+                msg_evt_data->client_ip_info = conn_data->id.client_ip_info;
+                msg_evt_data->latency = conn_data->latency;
+                msg_evt_data->max = conn_data->max;
+                bpf_output_submit(ctx, &msg_event_map, msg_evt_data);
             }
         }
         conn_data->latency.rtt_nsec = 0;
@@ -298,8 +291,43 @@ static __always_inline int periodic_report(u64 ts_nsec, struct conn_data_t *conn
     return ret;
 }
 
+static __always_inline void record_sli_histo(struct conn_data_t *conn_data, struct conn_samp_data_t *csd)
+{
+    u32 key = 0;
+    struct sli_histo_key_s histo_key = {0};
+    struct ksli_args_s *args = (struct ksli_args_s *)bpf_map_lookup_elem(&args_map, &key);
+
+    if (args == (void *)0 || !args->histo_flag) {
+        return;
+    }
+
+    histo_key.tgid = (u32)conn_data->id.tgid;
+    histo_key.family = (u16)conn_data->id.client_ip_info.family;
+    histo_key.server_port = conn_data->id.server_ip_info.port;
+    __builtin_memcpy(histo_key.server_ip, conn_data->id.server_ip_info.ipaddr.ip6, IP6_LEN);
+    __builtin_memcpy(histo_key.command, csd->command, MAX_COMMAND_REQ_SIZE);
+    sli_histo_record(sli_histo_map, &histo_key, csd->rtt_ts_nsec);
+}
+
+/*
+ * The histograms take every request, so every request is sampled if they are on. The raw sli is still
+ * the first sample of each period without continuous sampling.
+ */
+static __always_inline char is_sampling_all(struct conn_data_t *conn_data)
+{
+    u32 key = 0;
+    struct ksli_args_s *args;
+
+    if (conn_data->continuous_sampling_flag) {
+        return 1;
+    }
+    args = (struct ksli_args_s *)bpf_map_lookup_elem(&args_map, &key);
+    return (args != (void *)0 && args->histo_flag);
+}
+
 static __always_inline void sample_finished(struct conn_data_t *conn_data, struct conn_samp_data_t *csd)
 {
+    record_sli_histo(conn_data, csd);
     if (conn_data->latency.rtt_nsec == 0) {
         conn_data->latency.rtt_nsec = csd->rtt_ts_nsec;
         __builtin_memcpy(&conn_data->latency.command, &csd->command, MAX_COMMAND_REQ_SIZE);
@@ -313,6 +341,33 @@ static __always_inline void sample_finished(struct conn_data_t *conn_data, struc
     csd->status = SAMP_INIT;
 }
 
+// 关闭 tcp 连接
+KPROBE(__close_fd, pt_regs)
+{
+    int fd;
+    u32 tgid = bpf_get_current_pid_tgid() >> INT_LEN;
+    struct conn_key_t conn_key = {0};
+    struct conn_data_t *conn_data;
+    struct conn_samp_data_t *csd;
+
+    fd = (int)PT_REGS_PARM2(ctx);
+    init_conn_key(&conn_key, fd, tgid);
+    conn_data = (struct conn_data_t *)bpf_map_lookup_elem(&conn_map, &conn_key);
+    if (conn_data == (void *)0) {
+        return 0;
+    }
+
+    // The last request is finished without a next read, it still goes into the histogram.
+    csd = (struct conn_samp_data_t *)bpf_map_lookup_elem(&conn_samp_map, &conn_data->sk);
+    if (csd != (void *)0 && csd->status == SAMP_FINISHED) {
+        record_sli_histo(conn_data, csd);
+    }
+    bpf_map_delete_elem(&conn_samp_map, &conn_data->sk);
+    bpf_map_delete_elem(&conn_map, &conn_key);
+
+    return 0;
+}
+
 static __always_inline void mark_no_redis_conn(struct conn_data_t *conn_data)
 {
     conn_data->id.protocol = PROTOCOL_NO_REDIS;
@@ -354,8 +409,8 @@ static __always_inline void process_rd_msg(u32 tgid, int fd, const char *buf, co
         return;
     }
 
-    // 非循环采样每次上报后就返回，等待下次上报周期再采样。这种方式无法获取周期内max sli
-    if (!conn_data->continuous_sampling_flag && reported)
+    // 非循环采样每次上报后就返回，等待下次上报周期再采样。这种方式无法获取周期内max sli（开启直方图时仍逐个采样）
+    if (reported && !is_sampling_all(conn_data))
         return;
 
     // 连接的协议类型未知时，连续3次read报文时解析不出是redis协议，就确认此条连接非redis请求连接，不做采样
@@ -408,7 +463,7 @@ KPROBE(ksys_read, pt_regs)
     if (conn_data->id.protocol == PROTOCOL_NO_REDIS)
         return 0;
 
-    if (!conn_data->continuous_sampling_flag) {
+    if (!is_sampling_all(conn_data)) {
         if (bpf_ktime_get_ns() - conn_data->last_report_ts_nsec < conn_data->report_period)
             return 0;
     }
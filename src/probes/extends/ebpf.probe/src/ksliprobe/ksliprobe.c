@@ -33,11 +33,13 @@
 #include "ksliprobe.skel.h"
 #include "tc_loader.h"
 #include "ksliprobe.h"
+#include "sli_histo.h"
 
 #define OO_NAME "sli"
 #define DEFAULT_REDIS_PROC_NAME "redis"
 #define SLI_TBL_NAME "redis_sli"
 #define MAX_SLI_TBL_NAME "redis_max_sli"
+#define PCT_SLI_TBL_NAME "redis_sli_percentile"
 
 static volatile sig_atomic_t stop;
 static struct probe_params params = {.period = DEFAULT_PERIOD, .continuous_sampling_flag = 0};
@@ -145,16 +147,16 @@ static void msg_event_handler(void *ctx, int cpu, void *data, unsigned int size)
 static void *msg_event_receiver(void *arg)
 {
     int fd = *(int *)arg;
-    struct perf_buffer *pb;
+    struct bpf_buffer_s *buffer;
 
-    pb = create_pref_buffer(fd, msg_event_handler);
-    if (pb == NULL) {
-        fprintf(stderr, "Failed to create perf buffer.\n");
+    buffer = create_bpf_buffer(fd, msg_event_handler);
+    if (buffer == NULL) {
+        fprintf(stderr, "Failed to create output buffer.\n");
         stop = 1;
         return NULL;
     }
 
-    poll_pb(pb, params.period * 1000);
+    poll_bpf_buffer(buffer, params.period * 1000);
 
     stop = 1;
     return NULL;
@@ -184,13 +186,22 @@ static void load_args(int args_fd, struct probe_params* params)
 
     args.period = NS(params->period);
     args.continuous_sampling_flag = params->continuous_sampling_flag;
+    args.latency_thr = MS2NS(params->latency_thr);
+    args.raw_sli_flag = (params->metrics_flags & SUPPORT_METRICS_RAW) ? 1 : 0;
+    args.histo_flag = (params->metrics_flags & SUPPORT_METRICS_TELEM) ? 1 : 0;
 
     (void)bpf_map_update_elem(args_fd, &key, &args, BPF_ANY);
 }
 
+static void output_sli_histo(const struct sli_histo_key_s *key, const struct sli_histo_s *histo, void *ctx)
+{
+    sli_histo_output(PCT_SLI_TBL_NAME, "REDIS", key, histo);
+}
+
 int main(int argc, char **argv)
 {
     int err;
+    struct map_batch_s *histo_batch = NULL;
 
     err = args_parse(argc, argv, &params);
     if (err != 0) {
@@ -221,13 +232,26 @@ int main(int argc, char **argv)
         goto err;
     }
 
+    if (params.metrics_flags & SUPPORT_METRICS_TELEM) {
+        histo_batch = sli_histo_batch_new(GET_MAP_FD(ksliprobe, sli_histo_map));
+        if (histo_batch == NULL) {
+            fprintf(stderr, "Failed to create batch of sli histograms.\n");
+            goto err;
+        }
+    }
+
     printf("SLI probe successfully started!\n");
 
     while (!stop) {
         sleep(params.period);
+        // 每个周期合并各CPU的时延直方图，输出分位数
+        if (histo_batch != NULL) {
+            (void)sli_histo_drain(histo_batch, output_sli_histo, NULL);
+        }
     }
 
 err:
+    map_batch_free(&histo_batch);
     UNLOAD(ksliprobe);
 #ifdef KERNEL_SUPPORT_TSTAMP
     offload_tc_bpf(TC_TYPE_INGRESS);
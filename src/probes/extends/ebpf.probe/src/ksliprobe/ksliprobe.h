@@ -36,7 +36,10 @@
 
 struct ksli_args_s {
     __u64 period;        // Sampling period, unit ns
+    __u64 latency_thr;   // unit ns, sli above it is always reported
     char continuous_sampling_flag;   // Enables the sampling of max sli within a period (which cause some performance degradation)
+    char raw_sli_flag;   // Report sli of each connection every period, otherwise only those above latency_thr
+    char histo_flag;     // Record the latency histograms of each server and command
 };
 
 enum msg_event_rw_t {
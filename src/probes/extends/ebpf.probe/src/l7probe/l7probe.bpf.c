@@ -0,0 +1,928 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2023. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: l7 probe bpf prog
+ ******************************************************************************/
+#ifdef BPF_PROG_USER
+#undef BPF_PROG_USER
+#endif
+#define BPF_PROG_KERN
+#include "bpf.h"
+#include <bpf/bpf_endian.h>
+#include "l7probe.h"
+#include "sli_histo.h"
+
+#define MAX_CONN_LEN            8192
+#define MAX_CHECK_TIMES         2
+#define L7_MSG_MIN              8       // shorter reads(e.g. the length prefix alone) are not parsed
+
+#define TCP_SKB_CB(__skb) ((struct tcp_skb_cb *)&((__skb)->cb[0]))
+
+char g_license[] SEC("license") = "GPL";
+
+enum samp_status_t {
+    SAMP_INIT = 0,
+    SAMP_READ_READY,
+    SAMP_SKB_READY,
+};
+
+struct conn_data_t {
+    struct conn_info_t conn_info;
+    void *sk;                               // tcp连接对应的 sk 地址
+    enum l7_proto_t proto;
+    char check_times;
+    char continuous_sampling_flag;
+    char closed;                            // fd 已关闭，等待最后一个应答被确认
+    struct rtt_cmd_t latency;
+    struct rtt_cmd_t max;
+    __u64 last_report_ts_nsec;              // 上一次上报完成的时间点
+};
+
+struct conn_samp_data_t {
+    struct conn_key_t conn_key;             // 应答确认时据此找到连接
+    enum samp_status_t status;
+    u32 end_seq;
+    u64 start_ts_nsec;
+    u64 rtt_ts_nsec;
+    char command[L7_CMD_LEN];
+};
+
+// The request being parsed, passed from the read hooks to the tail called parsers.
+struct l7_parse_ctx_s {
+    struct conn_key_t conn_key;
+    u32 count;
+    u32 proto_flags;
+    char command[L7_CMD_LEN];
+    char msg[L7_MSG_LEN];
+};
+
+// 关闭事件丢失的连接由 LRU 淘汰
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __uint(key_size, sizeof(struct conn_key_t));
+    __uint(value_size, sizeof(struct conn_data_t));
+    __uint(max_entries, MAX_CONN_LEN);
+} conn_map SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __uint(key_size, sizeof(struct sock *));
+    __uint(value_size, sizeof(struct conn_samp_data_t));
+    __uint(max_entries, MAX_CONN_LEN);
+} conn_samp_map SEC(".maps");
+
+// Data collection args
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(key_size, sizeof(u32)); // const value 0
+    __uint(value_size, sizeof(struct l7_args_s)); // args
+    __uint(max_entries, 1);
+} args_map SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(key_size, sizeof(u32));
+    __uint(value_size, sizeof(struct l7_parse_ctx_s));
+    __uint(max_entries, 1);
+} l7_parse_ctx SEC(".maps");
+
+// Parsers indexed by enum l7_proto_t, only the enabled ones are set by user space.
+struct {
+    __uint(type, BPF_MAP_TYPE_PROG_ARRAY);
+    __uint(key_size, sizeof(u32));
+    __uint(value_size, sizeof(u32));
+    __uint(max_entries, L7_PROTO_MAX);
+} l7_parsers SEC(".maps");
+
+SLI_HISTO_MAPS(sli_histo_map);
+
+BPF_OUTPUT_MAP(msg_event_map, BPF_OUTPUT_BUF_SIZE);
+BPF_OUTPUT_SCRATCH_MAP(msg_event_scratch, struct l7_sli_event_s);
+
+#ifndef __PERIOD
+#define __PERIOD NS(5)
+#endif
+
+#if 1 // Args
+static __always_inline struct l7_args_s *get_args(void)
+{
+    u32 key = 0;
+    return (struct l7_args_s *)bpf_map_lookup_elem(&args_map, &key);
+}
+
+// period cannot be 0, so it is considered that the user mode has not written to args_map by now.
+static __always_inline u64 get_period(void)
+{
+    struct l7_args_s *args = get_args();
+    return (args && args->period != 0) ? args->period : __PERIOD;
+}
+
+static __always_inline u32 get_proto_flags(void)
+{
+    struct l7_args_s *args = get_args();
+    return (args && args->proto_flags != 0) ? args->proto_flags : L7_PROTO_FLAG_DEFAULT;
+}
+
+// Only redis sli is sampled once per period by default, as ksliprobe did.
+static __always_inline char get_continuous_sampling_flag(u32 proto)
+{
+    struct l7_args_s *args = get_args();
+    if (proto != L7_PROTO_REDIS) {
+        return 1;
+    }
+    return args ? args->continuous_sampling_flag : 0;
+}
+
+static __always_inline u32 l7_proto_flag(u32 proto)
+{
+    switch (proto) {
+        case L7_PROTO_HTTP:
+            return L7_PROTO_FLAG_HTTP;
+        case L7_PROTO_REDIS:
+            return L7_PROTO_FLAG_REDIS;
+        case L7_PROTO_PGSQL:
+            return L7_PROTO_FLAG_PGSQL;
+        case L7_PROTO_MYSQL:
+            return L7_PROTO_FLAG_MYSQL;
+        case L7_PROTO_KAFKA:
+            return L7_PROTO_FLAG_KAFKA;
+        case L7_PROTO_MONGO:
+            return L7_PROTO_FLAG_MONGO;
+        default:
+            return 0;
+    }
+}
+
+// The enabled parser checked after 'proto', L7_PROTO_NONE if there is no more.
+static __always_inline u32 next_parser(u32 proto, u32 proto_flags)
+{
+#pragma clang loop unroll(full)
+    for (u32 i = L7_PROTO_HTTP; i < L7_PROTO_MAX; i++) {
+        if (i > proto && (proto_flags & l7_proto_flag(i))) {
+            return i;
+        }
+    }
+    return L7_PROTO_NONE;
+}
+#endif
+
+#if 1 // Connection tracking
+static __always_inline void init_conn_key(struct conn_key_t *conn_key, int fd, int tgid)
+{
+    conn_key->fd = fd;
+    conn_key->tgid = tgid;
+}
+
+static __always_inline int init_conn_info(struct conn_info_t *conn_info, struct sock *sk)
+{
+    conn_info->client_ip_info.family = _(sk->sk_family);
+    if (conn_info->client_ip_info.family == AF_INET) {
+        conn_info->server_ip_info.ipaddr.ip4 = _(sk->sk_rcv_saddr);
+        conn_info->client_ip_info.ipaddr.ip4 = _(sk->sk_daddr);
+    } else if (conn_info->client_ip_info.family == AF_INET6) {
+        bpf_probe_read(conn_info->server_ip_info.ipaddr.ip6, IP6_LEN, &sk->sk_v6_rcv_saddr);
+        bpf_probe_read(conn_info->client_ip_info.ipaddr.ip6, IP6_LEN, &sk->sk_v6_daddr);
+    } else {
+        return -1;
+    }
+    conn_info->server_ip_info.family = conn_info->client_ip_info.family;
+
+    conn_info->server_ip_info.port = _(sk->sk_num);
+    conn_info->client_ip_info.port = _(sk->sk_dport);
+    return 0;
+}
+
+static __always_inline int add_conn(int fd, int tgid, struct conn_key_t *conn_key)
+{
+    struct conn_data_t conn_data = {0};
+    struct conn_samp_data_t csd = {0};
+    struct task_struct *task = (struct task_struct *)bpf_get_current_task();
+    struct sock *sk = sock_get_by_fd(fd, task);
+    if (sk == (void *)0) {
+        return L7_ERR;
+    }
+    conn_data.sk = (void *)sk;
+
+    if (init_conn_info(&conn_data.conn_info, sk) < 0) {
+        return L7_ERR;
+    }
+
+    if (bpf_map_update_elem(&conn_map, conn_key, &conn_data, BPF_ANY) < 0) {
+        return L7_ERR;
+    }
+
+    csd.conn_key = *conn_key;
+    csd.status = SAMP_INIT;
+    return bpf_map_update_elem(&conn_samp_map, &sk, &csd, BPF_ANY);
+}
+
+static __always_inline void mark_no_l7_conn(struct conn_data_t *conn_data)
+{
+    conn_data->proto = L7_PROTO_NONE;
+    bpf_map_delete_elem(&conn_samp_map, &conn_data->sk);
+}
+
+#endif
+
+#if 1 // Sampling and report
+// Without raw sli, a connection is only reported when its sli is above the threshold.
+static __always_inline int report_raw_sli(struct conn_data_t *conn_data)
+{
+    struct l7_args_s *args = get_args();
+
+    if (args == (void *)0 || args->period == 0 || args->raw_sli_flag) {
+        return 1;
+    }
+    return (args->latency_thr > 0) &&
+           (conn_data->latency.rtt_nsec > args->latency_thr || conn_data->max.rtt_nsec > args->latency_thr);
+}
+
+static __always_inline void record_sli_histo(struct conn_data_t *conn_data, struct conn_samp_data_t *csd)
+{
+    struct sli_histo_key_s histo_key = {0};
+    struct l7_args_s *args = get_args();
+
+    if (args == (void *)0 || !args->histo_flag) {
+        return;
+    }
+
+    histo_key.tgid = csd->conn_key.tgid;
+    histo_key.family = (u16)conn_data->conn_info.server_ip_info.family;
+    histo_key.server_port = conn_data->conn_info.server_ip_info.port;
+    __builtin_memcpy(histo_key.server_ip, conn_data->conn_info.server_ip_info.ipaddr.ip6, IP6_LEN);
+    __builtin_memcpy(histo_key.command, csd->command, L7_CMD_LEN);
+    histo_key.app = conn_data->proto;
+    sli_histo_record(sli_histo_map, &histo_key, csd->rtt_ts_nsec);
+}
+
+// A closed connection reports what is left at once.
+static __always_inline int periodic_report(u64 ts_nsec, struct conn_key_t *conn_key, struct conn_data_t *conn_data,
+                                           struct pt_regs *ctx, char is_closed)
+{
+    u64 period = get_period();
+    struct l7_sli_event_s *evt;
+
+    // 表示没有任何采样数据，不上报
+    if (conn_data->latency.rtt_nsec == 0) {
+        return 0;
+    }
+
+    if (!is_closed &&
+        (ts_nsec <= conn_data->last_report_ts_nsec || ts_nsec - conn_data->last_report_ts_nsec < period)) {
+        return 0;
+    }
+
+    // rtt larger than period is considered an invalid value
+    if (conn_data->latency.rtt_nsec < period && report_raw_sli(conn_data)) {
+        evt = bpf_output_reserve(&msg_event_map, &msg_event_scratch, struct l7_sli_event_s);
+        if (evt == NULL) {
+            bpf_printk("message event sent failed.\n");
+        } else {
+            evt->tgid = conn_key->tgid;
+            evt->fd = conn_key->fd;
+            evt->proto = conn_data->proto;
+            evt->conn_info = conn_data->conn_info;
+            evt->latency = conn_data->latency;
+            evt->max = conn_data->max;
+            bpf_output_submit(ctx, &msg_event_map, evt);
+        }
+    }
+    conn_data->latency.rtt_nsec = 0;
+    conn_data->max.rtt_nsec = 0;
+    conn_data->last_report_ts_nsec = ts_nsec;
+    return 1;
+}
+
+/*
+ * The histograms take every request, so every request is sampled if they are on. The raw sli is still
+ * the first sample of each period without continuous sampling.
+ */
+static __always_inline char is_sampling_all(struct conn_data_t *conn_data)
+{
+    struct l7_args_s *args;
+
+    if (conn_data->continuous_sampling_flag) {
+        return 1;
+    }
+    args = get_args();
+    return (args != (void *)0 && args->histo_flag);
+}
+
+static __always_inline void sample_finished(struct conn_data_t *conn_data, struct conn_samp_data_t *csd)
+{
+    record_sli_histo(conn_data, csd);
+    if (conn_data->latency.rtt_nsec == 0) {
+        conn_data->latency.rtt_nsec = csd->rtt_ts_nsec;
+        __builtin_memcpy(&conn_data->latency.command, &csd->command, L7_CMD_LEN);
+    }
+    if (conn_data->continuous_sampling_flag) {
+        if (conn_data->max.rtt_nsec < csd->rtt_ts_nsec) {
+            conn_data->max.rtt_nsec = csd->rtt_ts_nsec;
+            __builtin_memcpy(&conn_data->max.command, &csd->command, L7_CMD_LEN);
+        }
+    }
+    csd->status = SAMP_INIT;
+}
+
+static __always_inline void del_conn(struct conn_key_t *conn_key, struct sock *sk)
+{
+    bpf_map_delete_elem(&conn_samp_map, &sk);
+    bpf_map_delete_elem(&conn_map, conn_key);
+}
+
+/*
+ * The sample is finished when the response is acked, not on the next read, so a connection closed after
+ * a single request(e.g. HTTP/1.0, Connection: close) is measured too.
+ */
+static __always_inline void ack_sample(struct pt_regs *ctx, struct sock *sk, struct conn_samp_data_t *csd)
+{
+    struct conn_key_t conn_key = csd->conn_key;
+    struct conn_data_t *conn_data;
+
+    conn_data = (struct conn_data_t *)bpf_map_lookup_elem(&conn_map, &conn_key);
+    if (conn_data == (void *)0 || conn_data->sk != (void *)sk) {
+        // 连接已删除，或 fd 已被新连接复用
+        bpf_map_delete_elem(&conn_samp_map, &sk);
+        return;
+    }
+
+    sample_finished(conn_data, csd);
+    if (conn_data->closed) {
+        (void)periodic_report(bpf_ktime_get_ns(), &conn_key, conn_data, ctx, 1);
+        del_conn(&conn_key, sk);
+    }
+}
+
+// 关闭 tcp 连接，应答未确认时等确认后再上报并删除
+KPROBE(__close_fd, pt_regs)
+{
+    int fd;
+    u32 tgid = bpf_get_current_pid_tgid() >> INT_LEN;
+    struct conn_key_t conn_key = {0};
+    struct conn_data_t *conn_data;
+    struct conn_samp_data_t *csd;
+
+    fd = (int)PT_REGS_PARM2(ctx);
+    init_conn_key(&conn_key, fd, tgid);
+    conn_data = (struct conn_data_t *)bpf_map_lookup_elem(&conn_map, &conn_key);
+    if (conn_data == (void *)0 || conn_data->closed) {
+        return 0;
+    }
+
+    csd = (struct conn_samp_data_t *)bpf_map_lookup_elem(&conn_samp_map, &conn_data->sk);
+    if (csd != (void *)0 && csd->status == SAMP_SKB_READY) {
+        conn_data->closed = 1;
+        return 0;
+    }
+    (void)periodic_report(bpf_ktime_get_ns(), &conn_key, conn_data, ctx, 1);
+    del_conn(&conn_key, (struct sock *)conn_data->sk);
+    return 0;
+}
+
+static __always_inline struct l7_parse_ctx_s *get_parse_ctx(void)
+{
+    u32 key = 0;
+    return (struct l7_parse_ctx_s *)bpf_map_lookup_elem(&l7_parse_ctx, &key);
+}
+
+static __always_inline void process_rd_msg(u32 tgid, int fd, const char *buf, const unsigned int count,
+                                           struct pt_regs *ctx)
+{
+    struct conn_key_t conn_key = {0};
+    struct conn_data_t *conn_data;
+    struct conn_samp_data_t *csd;
+    struct l7_parse_ctx_s *pctx;
+    u64 ts_nsec = bpf_ktime_get_ns();
+    volatile u32 copy_size;
+    u32 proto;
+    int reported;
+
+    init_conn_key(&conn_key, fd, tgid);
+    conn_data = (struct conn_data_t *)bpf_map_lookup_elem(&conn_map, &conn_key);
+    if (conn_data == (void *)0 || conn_data->proto == L7_PROTO_NONE) {
+        return;
+    }
+    csd = (struct conn_samp_data_t *)bpf_map_lookup_elem(&conn_samp_map, &conn_data->sk);
+    if (csd == (void *)0) {
+        return;
+    }
+
+    // 周期上报
+    reported = periodic_report(ts_nsec, &conn_key, conn_data, ctx, 0);
+
+    if (csd->status != SAMP_INIT) {
+        // 超过采样周期，则重置采样状态，避免采样状态一直处于不可达的情况
+        if (ts_nsec > csd->start_ts_nsec &&
+            ts_nsec - csd->start_ts_nsec >= __PERIOD) {
+            csd->status = SAMP_INIT;
+        }
+        return;
+    }
+
+    // 非循环采样每次上报后就返回，等待下次上报周期再采样。这种方式无法获取周期内max sli（开启直方图时仍逐个采样）
+    if (reported && !is_sampling_all(conn_data)) {
+        return;
+    }
+
+    if (count < L7_MSG_MIN) {
+        return;
+    }
+
+    pctx = get_parse_ctx();
+    if (pctx == (void *)0) {
+        return;
+    }
+    pctx->conn_key = conn_key;
+    pctx->count = count;
+    pctx->proto_flags = get_proto_flags();
+    __builtin_memset(pctx->command, 0, L7_CMD_LEN);
+    __builtin_memset(pctx->msg, 0, L7_MSG_LEN);
+    copy_size = count < L7_MSG_LEN ? count : (L7_MSG_LEN - 1);
+    if (bpf_probe_read(pctx->msg, copy_size & (L7_MSG_LEN - 1), buf) < 0) {
+        return;
+    }
+
+    // 已确认协议的连接只交给对应的解析器，未知协议的连接依次尝试所有使能的解析器
+    if (conn_data->proto != L7_PROTO_UNKNOWN) {
+        proto = conn_data->proto;
+    } else {
+        proto = next_parser(L7_PROTO_UNKNOWN, pctx->proto_flags);
+    }
+    if (proto >= L7_PROTO_MAX) {
+        mark_no_l7_conn(conn_data);
+        return;
+    }
+    bpf_tail_call(ctx, &l7_parsers, proto);
+    return;
+}
+
+/*
+ * Called by every parser. A request of an unknown connection not matched is passed to the next
+ * enabled parser, a matched one starts a sample of the connection.
+ */
+static __always_inline void l7_parse_done(struct pt_regs *ctx, struct l7_parse_ctx_s *pctx, u32 proto, int ret)
+{
+    struct conn_data_t *conn_data;
+    struct conn_samp_data_t *csd;
+    u32 next;
+
+    conn_data = (struct conn_data_t *)bpf_map_lookup_elem(&conn_map, &pctx->conn_key);
+    if (conn_data == (void *)0) {
+        return;
+    }
+
+    if (ret != L7_OK) {
+        if (conn_data->proto != L7_PROTO_UNKNOWN) {
+            return;
+        }
+        next = next_parser(proto, pctx->proto_flags);
+        if (next < L7_PROTO_MAX) {
+            bpf_tail_call(ctx, &l7_parsers, next);
+        }
+        // 连接的协议类型未知时，连续3次read报文时所有解析器都解析失败，就确认此条连接不需要观测，不做采样
+        // 一旦确认了协议类型则不会再修改
+        if (conn_data->check_times >= MAX_CHECK_TIMES) {
+            mark_no_l7_conn(conn_data);
+        } else {
+            conn_data->check_times++;
+        }
+        return;
+    }
+
+    if (conn_data->proto == L7_PROTO_UNKNOWN) {
+        conn_data->proto = proto;
+        conn_data->continuous_sampling_flag = get_continuous_sampling_flag(proto);
+    }
+
+    csd = (struct conn_samp_data_t *)bpf_map_lookup_elem(&conn_samp_map, &conn_data->sk);
+    if (csd == (void *)0) {
+        return;
+    }
+    __builtin_memcpy(&csd->command, pctx->command, L7_CMD_LEN);
+
+#ifndef KERNEL_SUPPORT_TSTAMP
+    csd->start_ts_nsec = bpf_ktime_get_ns();
+#else
+    if (csd->start_ts_nsec == 0) {
+        csd->start_ts_nsec = bpf_ktime_get_ns();
+    }
+#endif
+    csd->status = SAMP_READ_READY;
+}
+#endif
+
+#if 1 // Protocol parsers
+/*
+ * Each parser is a program in l7_parsers, it identifies the request in l7_parse_ctx and fills the
+ * command of it. Return L7_OK if the request is of its protocol.
+ */
+#define L7_PARSER(name, proto) \
+    static __always_inline int __parse_##name(struct l7_parse_ctx_s *pctx); \
+    SEC("kprobe/l7_parse_" #name) \
+    int l7_parse_##name(struct pt_regs *ctx) \
+    { \
+        struct l7_parse_ctx_s *pctx = get_parse_ctx(); \
+        if (pctx != (void *)0) { \
+            l7_parse_done(ctx, pctx, proto, __parse_##name(pctx)); \
+        } \
+        return 0; \
+    } \
+    static __always_inline int __parse_##name(struct l7_parse_ctx_s *pctx)
+
+static __always_inline u32 l7_be32(const char *p)
+{
+    return ((u32)(u8)p[0] << 24) | ((u32)(u8)p[1] << 16) | ((u32)(u8)p[2] << 8) | (u32)(u8)p[3];
+}
+
+static __always_inline u32 l7_le32(const char *p)
+{
+    return ((u32)(u8)p[3] << 24) | ((u32)(u8)p[2] << 16) | ((u32)(u8)p[1] << 8) | (u32)(u8)p[0];
+}
+
+static __always_inline s16 l7_be16(const char *p)
+{
+    return (s16)(((u16)(u8)p[0] << 8) | (u16)(u8)p[1]);
+}
+
+/* HTTP/1.x: request line starts with the method */
+#define HTTP_METHOD_LEN     8
+
+static __always_inline int is_http_method(const char *str)
+{
+    return (__builtin_memcmp(str, "GET ", 4) == 0) ||
+           (__builtin_memcmp(str, "HEAD", 4) == 0 && str[4] == ' ') ||
+           (__builtin_memcmp(str, "POST", 4) == 0 && str[4] == ' ') ||
+           (__builtin_memcmp(str, "PUT ", 4) == 0) ||
+           (__builtin_memcmp(str, "DELETE ", 7) == 0) ||
+           (__builtin_memcmp(str, "CONNECT ", 8) == 0) ||
+           (__builtin_memcmp(str, "OPTIONS ", 8) == 0) ||
+           (__builtin_memcmp(str, "TRACE ", 6) == 0) ||
+           (__builtin_memcmp(str, "PATCH ", 6) == 0);
+}
+
+L7_PARSER(http, L7_PROTO_HTTP)
+{
+    if (!is_http_method(pctx->msg)) {
+        return L7_ERR;
+    }
+
+#pragma clang loop unroll(full)
+    for (int i = 0; i < HTTP_METHOD_LEN; i++) {
+        if (pctx->msg[i] == ' ') {
+            break;
+        }
+        pctx->command[i] = pctx->msg[i];
+    }
+    return L7_OK;
+}
+
+/* RESP: *<argc>\r\n$<len>\r\n<command>..., the first 3 chars of command are kept as ksliprobe did */
+#define REDIS_CMD_LEN       3
+#define REDIS_PARSE_LEN     (16 - 3)
+
+#define FIND0_MSG_START 0
+#define FIND1_PARM_NUM 1
+#define FIND2_CMD_LEN 2
+#define FIND3_CMD_STR 3
+#define FIND_MSG_ERR_STOP 10
+#define FIND_MSG_OK_STOP 11
+
+static __always_inline void parse_msg_to_redis_cmd(char msg_char, int *j, char *command, unsigned short *find_state)
+{
+    switch (*find_state) {
+        case FIND0_MSG_START:
+            if (msg_char == '*') {
+                *find_state = FIND1_PARM_NUM;
+            } else {
+                *find_state = FIND_MSG_ERR_STOP;
+            }
+            break;
+        case FIND1_PARM_NUM:
+            if (msg_char == '$') {
+                *find_state = FIND2_CMD_LEN;
+            }
+            break;
+        case FIND2_CMD_LEN:
+            if (msg_char == '\n') {
+                *find_state = FIND3_CMD_STR;
+            }
+            break;
+        case FIND3_CMD_STR:
+            if (*j == REDIS_CMD_LEN) {
+                *find_state = FIND_MSG_OK_STOP;
+                break;
+            }
+            if (msg_char >= 'a') {
+                msg_char = msg_char - ('a' - 'A');
+            }
+            if (msg_char >= 'A' && msg_char <= 'Z') {
+                command[*j] = msg_char;
+                *j = *j + 1;
+            } else {
+                *find_state = FIND_MSG_ERR_STOP;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+L7_PARSER(redis, L7_PROTO_REDIS)
+{
+    int j = 0;
+    unsigned short find_state = FIND0_MSG_START;
+
+#pragma clang loop unroll(full)
+    for (int i = 0; i < REDIS_PARSE_LEN; i++) {
+        parse_msg_to_redis_cmd(pctx->msg[i], &j, pctx->command, &find_state);
+    }
+    if (find_state != FIND_MSG_OK_STOP) {
+        __builtin_memset(pctx->command, 0, L7_CMD_LEN);
+        return L7_ERR;
+    }
+    return L7_OK;
+}
+
+/* PG wire: <type><int32 length including itself>, simple query 'Q' or extended query starting by 'B' */
+L7_PARSER(pgsql, L7_PROTO_PGSQL)
+{
+    u32 len;
+    char type = pctx->msg[0];
+
+    if (type != 'Q' && type != 'B') {
+        return L7_ERR;
+    }
+    len = l7_be32(&pctx->msg[1]);
+    if (len < sizeof(u32) || len >= pctx->count) {
+        return L7_ERR;
+    }
+    pctx->command[0] = type;
+    return L7_OK;
+}
+
+/* MySQL: <int24 payload length><int8 sequence id><int8 command>, a command always starts sequence 0 */
+#define COM_QUERY           0x03
+#define COM_STMT_PREPARE    0x16
+#define COM_STMT_EXECUTE    0x17
+
+L7_PARSER(mysql, L7_PROTO_MYSQL)
+{
+    u32 len = ((u32)(u8)pctx->msg[2] << 16) | ((u32)(u8)pctx->msg[1] << 8) | (u32)(u8)pctx->msg[0];
+
+    if (pctx->msg[3] != 0 || len == 0 || len + sizeof(u32) > pctx->count) {
+        return L7_ERR;
+    }
+
+    switch (pctx->msg[4]) {
+        case COM_QUERY:
+            __builtin_memcpy(pctx->command, "QUERY", 6);
+            break;
+        case COM_STMT_PREPARE:
+            __builtin_memcpy(pctx->command, "PREPARE", 8);
+            break;
+        case COM_STMT_EXECUTE:
+            __builtin_memcpy(pctx->command, "EXECUTE", 8);
+            break;
+        default:
+            return L7_ERR;
+    }
+    return L7_OK;
+}
+
+/*
+ * Kafka: <int32 size><int16 api_key><int16 api_version><int32 correlation_id><int16 client_id length>...
+ * The broker reads the size alone first, so the header is checked with or without the size prefix.
+ */
+#define KAFKA_API_KEY_MAX       67
+#define KAFKA_API_VERSION_MAX   15
+#define KAFKA_CLIENT_ID_MAX     255
+
+static __always_inline int kafka_api_key(const char *hdr)
+{
+    s16 api_key = l7_be16(hdr);
+    s16 api_version = l7_be16(hdr + 2);
+    s16 client_id_len = l7_be16(hdr + 8);
+
+    if (api_key < 0 || api_key > KAFKA_API_KEY_MAX) {
+        return -1;
+    }
+    if (api_version < 0 || api_version > KAFKA_API_VERSION_MAX) {
+        return -1;
+    }
+    if (client_id_len < -1 || client_id_len > KAFKA_CLIENT_ID_MAX) {
+        return -1;
+    }
+    return api_key;
+}
+
+L7_PARSER(kafka, L7_PROTO_KAFKA)
+{
+    int api_key;
+
+    if (l7_be32(pctx->msg) + sizeof(u32) == pctx->count) {
+        api_key = kafka_api_key(&pctx->msg[sizeof(u32)]);
+    } else {
+        api_key = kafka_api_key(pctx->msg);
+    }
+
+    switch (api_key) {
+        case 0:
+            __builtin_memcpy(pctx->command, "PRODUCE", 8);
+            break;
+        case 1:
+            __builtin_memcpy(pctx->command, "FETCH", 6);
+            break;
+        case 3:
+            __builtin_memcpy(pctx->command, "METADATA", 9);
+            break;
+        default:
+            if (api_key < 0) {
+                return L7_ERR;
+            }
+            __builtin_memcpy(pctx->command, "OTHER", 6);
+            break;
+    }
+    return L7_OK;
+}
+
+/* MongoDB: <int32 messageLength><int32 requestID><int32 responseTo><int32 opCode>, little endian */
+#define MONGO_HDR_LEN       16
+#define MONGO_OP_QUERY      2004
+#define MONGO_OP_MSG        2013
+
+L7_PARSER(mongo, L7_PROTO_MONGO)
+{
+    u32 len = l7_le32(pctx->msg);
+    u32 response_to = l7_le32(&pctx->msg[8]);
+    u32 op_code = l7_le32(&pctx->msg[12]);
+
+    // responseTo of a request is always 0
+    if (len < MONGO_HDR_LEN || response_to != 0 || pctx->count < MONGO_HDR_LEN) {
+        return L7_ERR;
+    }
+
+    if (op_code == MONGO_OP_MSG) {
+        __builtin_memcpy(pctx->command, "OP_MSG", 7);
+    } else if (op_code == MONGO_OP_QUERY) {
+        __builtin_memcpy(pctx->command, "OP_QUERY", 9);
+    } else {
+        return L7_ERR;
+    }
+    return L7_OK;
+}
+#endif
+
+#if 1 // Socket hooks shared by all protocols
+static __always_inline int stash_read_parms(struct pt_regs *ctx, int fd)
+{
+    struct conn_key_t conn_key = {0};
+    struct conn_data_t *conn_data;
+    u32 tgid = bpf_get_current_pid_tgid() >> INT_LEN;
+
+    init_conn_key(&conn_key, fd, tgid);
+    conn_data = (struct conn_data_t *)bpf_map_lookup_elem(&conn_map, &conn_key);
+    if (conn_data == (void *)0 || conn_data->closed) {
+        // 首次读到的连接（或复用了已关闭连接的 fd）登记后即解析本次 read
+        return (add_conn(fd, tgid, &conn_key) == 0) ? 0 : -1;
+    }
+
+    if (conn_data->proto == L7_PROTO_NONE) {
+        return -1;
+    }
+
+    if (!is_sampling_all(conn_data)) {
+        if (bpf_ktime_get_ns() - conn_data->last_report_ts_nsec < get_period()) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static __always_inline void handle_read(struct pt_regs *ctx, int fd, const char *buf)
+{
+    int count = PT_REGS_RC(ctx);
+    u32 tgid = bpf_get_current_pid_tgid() >> INT_LEN;
+
+    if (count <= 0) {
+        return;
+    }
+    process_rd_msg(tgid, fd, buf, (unsigned int)count, ctx);
+}
+
+KPROBE(ksys_read, pt_regs)
+{
+    if (stash_read_parms(ctx, (int)PT_REGS_PARM1(ctx)) == 0) {
+        KPROBE_PARMS_STASH(ksys_read, ctx, CTX_USER);
+    }
+    return 0;
+}
+
+// 跟踪连接 read 读消息
+KRETPROBE(ksys_read, pt_regs)
+{
+    struct probe_val val;
+
+    if (PROBE_GET_PARMS(ksys_read, ctx, val, CTX_USER) < 0) {
+        return 0;
+    }
+    handle_read(ctx, (int)PROBE_PARM1(val), (const char *)PROBE_PARM2(val));
+    return 0;
+}
+
+KPROBE(__sys_recvfrom, pt_regs)
+{
+    if (stash_read_parms(ctx, (int)PT_REGS_PARM1(ctx)) == 0) {
+        KPROBE_PARMS_STASH(__sys_recvfrom, ctx, CTX_USER);
+    }
+    return 0;
+}
+
+// 跟踪连接 recvfrom 读消息
+KRETPROBE(__sys_recvfrom, pt_regs)
+{
+    struct probe_val val;
+
+    if (PROBE_GET_PARMS(__sys_recvfrom, ctx, val, CTX_USER) < 0) {
+        return 0;
+    }
+    handle_read(ctx, (int)PROBE_PARM1(val), (const char *)PROBE_PARM2(val));
+    return 0;
+}
+
+// static void tcp_event_new_data_sent(struct sock *sk, struct sk_buff *skb)
+KPROBE(tcp_event_new_data_sent, pt_regs)
+{
+    struct sock *sk;
+    struct sk_buff *skb;
+    struct conn_samp_data_t *csd;
+
+    sk = (struct sock *)PT_REGS_PARM1(ctx);
+    skb = (struct sk_buff *)PT_REGS_PARM2(ctx);
+
+    csd = (struct conn_samp_data_t *)bpf_map_lookup_elem(&conn_samp_map, &sk);
+    if (csd != (void *)0) {
+        if (csd->status == SAMP_READ_READY) {
+            csd->end_seq = _(TCP_SKB_CB(skb)->end_seq);
+            csd->status = SAMP_SKB_READY;
+        }
+    }
+    return 0;
+}
+
+KPROBE(tcp_clean_rtx_queue, pt_regs)
+{
+    struct sock *sk;
+    struct tcp_sock *tcp_sk;
+    u32 snd_una;
+    struct conn_samp_data_t *csd;
+
+    sk = (struct sock *)PT_REGS_PARM1(ctx);
+    tcp_sk = (struct tcp_sock *)sk;
+    snd_una = _(tcp_sk->snd_una);
+
+    csd = (struct conn_samp_data_t *)bpf_map_lookup_elem(&conn_samp_map, &sk);
+    if (csd != (void *)0) {
+        if (csd->status == SAMP_SKB_READY && csd->end_seq <= snd_una) {
+            u64 end_ts_nsec = bpf_ktime_get_ns();
+            if (end_ts_nsec < csd->start_ts_nsec) {
+                csd->status = SAMP_INIT;
+                return 0;
+            }
+            csd->rtt_ts_nsec = end_ts_nsec - csd->start_ts_nsec;
+            ack_sample(ctx, sk, csd);
+        }
+    }
+    return 0;
+}
+
+#ifdef KERNEL_SUPPORT_TSTAMP
+KPROBE(tcp_recvmsg, pt_regs)
+{
+    struct sock *sk;
+    struct conn_samp_data_t *csd;
+    sk = (struct sock *)PT_REGS_PARM1(ctx);
+
+    csd = (struct conn_samp_data_t *)bpf_map_lookup_elem(&conn_samp_map, &sk);
+    if (csd != (void *)0) {
+        if (csd->status == SAMP_INIT) {
+            if (sk != (void *)0) {
+                struct sk_buff *skb = _(sk->sk_receive_queue.next);
+                if (skb != (struct sk_buff *)(&sk->sk_receive_queue)) {
+                    csd->start_ts_nsec = _(skb->tstamp);
+                }
+            }
+        }
+    }
+    return 0;
+}
+#endif
+#endif
@@ -0,0 +1,360 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2023. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: l7 probe user prog
+ ******************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <pthread.h>
+
+#ifdef BPF_PROG_KERN
+#undef BPF_PROG_KERN
+#endif
+
+#ifdef BPF_PROG_USER
+#undef BPF_PROG_USER
+#endif
+
+#include "bpf.h"
+#include "args.h"
+#include "event.h"
+#include "l7probe.skel.h"
+#include "tc_loader.h"
+#include "l7probe.h"
+#include "sli_histo.h"
+
+#define OO_NAME "sli"
+#define L7_PARSER_PREFIX "l7_parse_"
+
+#define MS2NS(ms)   ((u64)(ms) * 1000000)
+#define __ENTITY_ID_LEN 128
+
+/*
+ * Tables of each protocol, the ones of http/redis/pgsql are the same as httpprobe, ksliprobe and pgsliprobe.
+ * max_sli of redis is only sampled with [-C].
+ */
+struct l7_proto_tbl_s {
+    const char *app;
+    const char *sli_tbl;
+    const char *max_sli_tbl;
+    const char *pct_sli_tbl;
+    char max_need_continuous;
+};
+
+static struct l7_proto_tbl_s l7_tbls[L7_PROTO_MAX] = {
+    [L7_PROTO_HTTP] = {"HTTP", "http_sli", "http_max_sli", "http_sli_percentile", 0},
+    [L7_PROTO_REDIS] = {"REDIS", "redis_sli", "redis_max_sli", "redis_sli_percentile", 1},
+    [L7_PROTO_PGSQL] = {"POSTGRE", "pg_sli", "pg_max_sli", "pg_sli_percentile", 0},
+    [L7_PROTO_MYSQL] = {"MYSQL", "mysql_sli", "mysql_max_sli", "mysql_sli_percentile", 0},
+    [L7_PROTO_KAFKA] = {"KAFKA", "kafka_sli", "kafka_max_sli", "kafka_sli_percentile", 0},
+    [L7_PROTO_MONGO] = {"MONGO", "mongo_sli", "mongo_max_sli", "mongo_sli_percentile", 0},
+};
+
+static volatile sig_atomic_t stop;
+static struct probe_params params = {.period = DEFAULT_PERIOD, .continuous_sampling_flag = 0};
+
+static void sig_int(int signo)
+{
+    stop = 1;
+}
+
+static void report_sli_event(struct l7_sli_event_s *evt_data, const char *ser_ip_str, const char *cli_ip_str)
+{
+    char entityId[__ENTITY_ID_LEN];
+    u64 latency_thr_ns = MS2NS(params.latency_thr);
+    struct event_info_s evt = {0};
+
+    if (params.logs == 0) {
+        return;
+    }
+
+    if ((latency_thr_ns == 0) || (latency_thr_ns >= evt_data->latency.rtt_nsec)) {
+        return;
+    }
+
+    entityId[0] = 0;
+    (void)snprintf(entityId, __ENTITY_ID_LEN, "%d_%d", evt_data->tgid, evt_data->fd);
+
+    evt.entityName = OO_NAME;
+    evt.entityId = entityId;
+    evt.metrics = "rtt_nsec";
+    evt.pid = evt_data->tgid;
+    (void)snprintf(evt.ip, EVT_IP_LEN, "CIP(%s:%u), SIP(%s:%u)",
+                    cli_ip_str,
+                    ntohs(evt_data->conn_info.client_ip_info.port),
+                    ser_ip_str,
+                    evt_data->conn_info.server_ip_info.port);
+
+    report_logs((const struct event_info_s *)&evt,
+                EVT_SEC_WARN,
+                "Process(TID:%d, CIP(%s:%u), SIP(%s:%u)) %s SLI(%s:%llu) exceed the threshold.",
+                evt_data->tgid,
+                cli_ip_str,
+                ntohs(evt_data->conn_info.client_ip_info.port),
+                ser_ip_str,
+                evt_data->conn_info.server_ip_info.port,
+                l7_tbls[evt_data->proto].app,
+                evt_data->latency.command,
+                evt_data->latency.rtt_nsec);
+}
+
+static void output_sli(const char *tbl, const char *app, struct l7_sli_event_s *evt_data, struct rtt_cmd_t *rtt,
+                       const char *ser_ip_str, const char *cli_ip_str)
+{
+    (void)fprintf(stdout,
+            "|%s|%d|%d|%s|%s|%s|%u|%s|%u|%llu|\n",
+            tbl,
+            evt_data->tgid,
+            evt_data->fd,
+            app,
+            rtt->command,
+            ser_ip_str,
+            evt_data->conn_info.server_ip_info.port,
+            cli_ip_str,
+            ntohs(evt_data->conn_info.client_ip_info.port),
+            rtt->rtt_nsec);
+}
+
+static void msg_event_handler(void *ctx, int cpu, void *data, unsigned int size)
+{
+    struct l7_sli_event_s *evt_data = (struct l7_sli_event_s *)data;
+    struct l7_proto_tbl_s *tbl;
+    unsigned char ser_ip_str[INET6_ADDRSTRLEN];
+    unsigned char cli_ip_str[INET6_ADDRSTRLEN];
+
+    if (evt_data->proto <= L7_PROTO_UNKNOWN || evt_data->proto >= L7_PROTO_MAX) {
+        return;
+    }
+    tbl = &l7_tbls[evt_data->proto];
+
+    ip_str(evt_data->conn_info.server_ip_info.family, (unsigned char *)&(evt_data->conn_info.server_ip_info.ipaddr),
+        ser_ip_str, INET6_ADDRSTRLEN);
+    ip_str(evt_data->conn_info.client_ip_info.family, (unsigned char *)&(evt_data->conn_info.client_ip_info.ipaddr),
+        cli_ip_str, INET6_ADDRSTRLEN);
+
+    report_sli_event(evt_data, (const char *)ser_ip_str, (const char *)cli_ip_str);
+
+    output_sli(tbl->sli_tbl, tbl->app, evt_data, &evt_data->latency,
+               (const char *)ser_ip_str, (const char *)cli_ip_str);
+    if (!tbl->max_need_continuous || params.continuous_sampling_flag) {
+        output_sli(tbl->max_sli_tbl, tbl->app, evt_data, &evt_data->max,
+                   (const char *)ser_ip_str, (const char *)cli_ip_str);
+    }
+
+    (void)fflush(stdout);
+    return;
+}
+
+static void *msg_event_receiver(void *arg)
+{
+    int fd = *(int *)arg;
+    struct bpf_buffer_s *buffer;
+
+    buffer = create_bpf_buffer(fd, msg_event_handler);
+    if (buffer == NULL) {
+        fprintf(stderr, "Failed to create output buffer.\n");
+        stop = 1;
+        return NULL;
+    }
+
+    poll_bpf_buffer(buffer, params.period * 1000);
+
+    stop = 1;
+    return NULL;
+}
+
+static int init_conn_mgt_process(int msg_evt_map_fd)
+{
+    int err;
+    pthread_t msg_evt_hdl_thd;
+    static int map_fd;
+
+    map_fd = msg_evt_map_fd;
+    // 启动读写消息事件处理程序
+    err = pthread_create(&msg_evt_hdl_thd, NULL, msg_event_receiver, (void *)&map_fd);
+    if (err != 0) {
+        fprintf(stderr, "Failed to create connection read/write message event handler thread.\n");
+        return -1;
+    }
+    (void)pthread_detach(msg_evt_hdl_thd);
+    printf("Connection read/write message event handler thread successfully started!\n");
+
+    return 0;
+}
+
+static unsigned int get_proto_flags(struct probe_params *params)
+{
+    unsigned int flags = params->l7_probe_proto_flags;
+
+    if (flags == 0) {
+        flags = L7_PROTO_FLAG_DEFAULT;
+    }
+    if (flags & L7_PROTO_FLAG_DNS) {
+        printf("DNS is over UDP and not supported by l7probe, ignored.\n");
+    }
+    return flags;
+}
+
+static void load_args(int args_fd, struct probe_params* params)
+{
+    __u32 key = 0;
+    struct l7_args_s args = {0};
+
+    args.period = NS(params->period);
+    args.proto_flags = get_proto_flags(params);
+    args.continuous_sampling_flag = params->continuous_sampling_flag;
+    args.latency_thr = MS2NS(params->latency_thr);
+    args.raw_sli_flag = (params->metrics_flags & SUPPORT_METRICS_RAW) ? 1 : 0;
+    args.histo_flag = (params->metrics_flags & SUPPORT_METRICS_TELEM) ? 1 : 0;
+
+    (void)bpf_map_update_elem(args_fd, &key, &args, BPF_ANY);
+}
+
+static void output_sli_histo(const struct sli_histo_key_s *key, const struct sli_histo_s *histo, void *ctx)
+{
+    if (key->app <= L7_PROTO_UNKNOWN || key->app >= L7_PROTO_MAX) {
+        return;
+    }
+    sli_histo_output(l7_tbls[key->app].pct_sli_tbl, l7_tbls[key->app].app, key, histo);
+}
+
+static int load_parsers(struct l7probe_bpf *skel, unsigned int proto_flags)
+{
+    int err;
+    int prog_fd;
+    __u32 key;
+    int parsers_fd = bpf_map__fd(skel->maps.l7_parsers);
+    struct {
+        __u32 proto;
+        unsigned int flag;
+        struct bpf_program *prog;
+    } parsers[] = {
+        {L7_PROTO_HTTP, L7_PROTO_FLAG_HTTP, skel->progs.l7_parse_http},
+        {L7_PROTO_REDIS, L7_PROTO_FLAG_REDIS, skel->progs.l7_parse_redis},
+        {L7_PROTO_PGSQL, L7_PROTO_FLAG_PGSQL, skel->progs.l7_parse_pgsql},
+        {L7_PROTO_MYSQL, L7_PROTO_FLAG_MYSQL, skel->progs.l7_parse_mysql},
+        {L7_PROTO_KAFKA, L7_PROTO_FLAG_KAFKA, skel->progs.l7_parse_kafka},
+        {L7_PROTO_MONGO, L7_PROTO_FLAG_MONGO, skel->progs.l7_parse_mongo},
+    };
+
+    for (int i = 0; i < sizeof(parsers) / sizeof(parsers[0]); i++) {
+        if (!(proto_flags & parsers[i].flag)) {
+            continue;
+        }
+        key = parsers[i].proto;
+        prog_fd = bpf_program__fd(parsers[i].prog);
+        err = bpf_map_update_elem(parsers_fd, &key, &prog_fd, BPF_ANY);
+        if (err) {
+            fprintf(stderr, "Failed to load %s parser: %d\n", l7_tbls[key].app, err);
+            return -1;
+        }
+        printf("%s parser loaded.\n", l7_tbls[key].app);
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int err = -1;
+    struct bpf_program *prog;
+    struct bpf_link *link;
+    struct map_batch_s *histo_batch = NULL;
+
+    err = args_parse(argc, argv, &params);
+    if (err != 0) {
+        return -1;
+    }
+    printf("arg parse interval time:%us\n", params.period);
+    printf("arg parse if cycle sampling:%s\n", params.continuous_sampling_flag ? "true": "false");
+    printf("arg parse l7 protocol flags:0x%x\n", get_proto_flags(&params));
+
+#ifdef KERNEL_SUPPORT_TSTAMP
+    load_tc_bpf(params.netcard_list, TC_PROG, TC_TYPE_INGRESS);
+#else
+    printf("The kernel version does not support loading the tc tstamp program\n");
+#endif
+
+    INIT_BPF_APP(l7probe, EBPF_RLIM_LIMITED);
+    OPEN(l7probe, err, 1);
+    if (l7probe_bpf__load(l7probe_skel)) {
+        fprintf(stderr, "Failed to load BPF l7probe skeleton\n");
+        err = -1;
+        goto err;
+    }
+
+    // Parsers are only tail called by the socket hooks, never attached.
+    bpf_object__for_each_program(prog, l7probe_skel->obj) {
+        if (strncmp(bpf_program__name(prog), L7_PARSER_PREFIX, strlen(L7_PARSER_PREFIX)) == 0) {
+            continue;
+        }
+        if (l7probe_link_current >= PATH_NUM) {
+            fprintf(stderr, "Too many programs of l7probe\n");
+            err = -1;
+            goto err;
+        }
+        link = bpf_program__attach(prog);
+        err = libbpf_get_error(link);
+        if (err) {
+            fprintf(stderr, "Failed to attach %s: %d\n", bpf_program__name(prog), err);
+            goto err;
+        }
+        l7probe_link[l7probe_link_current++] = link;
+    }
+
+    load_args(GET_MAP_FD(l7probe, args_map), &params);
+    err = load_parsers(l7probe_skel, get_proto_flags(&params));
+    if (err != 0) {
+        goto err;
+    }
+
+    if (signal(SIGINT, sig_int) == SIG_ERR) {
+        fprintf(stderr, "Can't set signal handler: %d\n", errno);
+        goto err;
+    }
+
+    // 初始化连接管理程序
+    err = init_conn_mgt_process(GET_MAP_FD(l7probe, msg_event_map));
+    if (err != 0) {
+        fprintf(stderr, "Init connection management process failed.\n");
+        goto err;
+    }
+
+    if (params.metrics_flags & SUPPORT_METRICS_TELEM) {
+        histo_batch = sli_histo_batch_new(GET_MAP_FD(l7probe, sli_histo_map));
+        if (histo_batch == NULL) {
+            fprintf(stderr, "Failed to create batch of sli histograms.\n");
+            err = -1;
+            goto err;
+        }
+    }
+
+    printf("L7 probe successfully started!\n");
+
+    while (!stop) {
+        sleep(params.period);
+        // 每个周期合并各CPU的时延直方图，输出分位数
+        if (histo_batch != NULL) {
+            (void)sli_histo_drain(histo_batch, output_sli_histo, NULL);
+        }
+    }
+
+err:
+    map_batch_free(&histo_batch);
+    UNLOAD(l7probe);
+#ifdef KERNEL_SUPPORT_TSTAMP
+    offload_tc_bpf(TC_TYPE_INGRESS);
+#endif
+    return -err;
+}
@@ -0,0 +1,102 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2023. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: l7 probe header file
+ ******************************************************************************/
+#ifndef __L7PROBE_H__
+#define __L7PROBE_H__
+
+#define TC_PROG "tc_tstamp.bpf.o"
+
+#define L7_CMD_LEN      16
+#define L7_MSG_LEN      32      // head of a request copied for protocol parsing
+
+#define L7_OK       0
+#define L7_ERR      (-1)
+
+#if ((CURRENT_KERNEL_VERSION == KERNEL_VERSION(4, 18, 0)) || (CURRENT_KERNEL_VERSION >= KERNEL_VERSION(5, 10, 0)))
+#define KERNEL_SUPPORT_TSTAMP
+#endif
+
+// Same bits as [-P <l7_probe_proto_flags>]
+#define L7_PROTO_FLAG_HTTP      0x0001
+#define L7_PROTO_FLAG_DNS       0x0002
+#define L7_PROTO_FLAG_REDIS     0x0004
+#define L7_PROTO_FLAG_MYSQL     0x0008
+#define L7_PROTO_FLAG_PGSQL     0x0010
+#define L7_PROTO_FLAG_KAFKA     0x0020
+#define L7_PROTO_FLAG_MONGO     0x0040
+#define L7_PROTO_FLAG_DEFAULT   (L7_PROTO_FLAG_HTTP | L7_PROTO_FLAG_REDIS | L7_PROTO_FLAG_PGSQL)
+
+/*
+ * Index of the parsers in l7_parsers, a connection of unknown protocol is checked by the enabled
+ * parsers in this order.
+ */
+enum l7_proto_t {
+    L7_PROTO_UNKNOWN = 0,
+    L7_PROTO_HTTP,
+    L7_PROTO_REDIS,
+    L7_PROTO_PGSQL,
+    L7_PROTO_MYSQL,
+    L7_PROTO_KAFKA,
+    L7_PROTO_MONGO,
+    L7_PROTO_MAX
+};
+#define L7_PROTO_NONE   L7_PROTO_MAX    // none of the enabled protocols, not sampled any more
+
+struct l7_args_s {
+    __u64 period;                       // Sampling period, unit ns
+    __u64 latency_thr;                  // unit ns, sli above it is always reported
+    __u32 proto_flags;                  // L7_PROTO_FLAG_*
+    char continuous_sampling_flag;      // Sample all requests of redis within a period to get the max sli
+    char raw_sli_flag;                  // Report sli of each connection every period, otherwise only those above latency_thr
+    char histo_flag;                    // Record the latency histograms of each server and command
+};
+
+struct ip {
+    union {
+        __u32 ip4;
+        __u8 ip6[IP6_LEN];
+    };
+};
+
+struct ip_info_t {
+    struct ip ipaddr;
+    __u16 port;
+    __u32 family;
+};
+
+struct conn_info_t {
+    struct ip_info_t server_ip_info;
+    struct ip_info_t client_ip_info;
+};
+
+struct conn_key_t {
+    int tgid;                           // 连接所属进程的 tgid
+    int fd;                             // 连接对应 socket 的文件描述符
+};
+
+struct rtt_cmd_t {
+    char command[L7_CMD_LEN];           // method of the request
+    __u64 rtt_nsec;                     // 收发时延
+};
+
+struct l7_sli_event_s {
+    int tgid;
+    int fd;
+    enum l7_proto_t proto;
+    struct conn_info_t conn_info;
+    struct rtt_cmd_t latency;
+    struct rtt_cmd_t max;
+};
+
+#endif
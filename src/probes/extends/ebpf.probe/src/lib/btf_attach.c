@@ -0,0 +1,241 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2023. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: choose fentry/fexit/tp_btf or kprobe/kretprobe/raw_tracepoint programs at load time
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#ifdef BPF_PROG_KERN
+#undef BPF_PROG_KERN
+#endif
+
+#ifdef BPF_PROG_USER
+#undef BPF_PROG_USER
+#endif
+
+#include "bpf.h"
+#include "btf_attach.h"
+
+#if defined(GOPHER_BTF_ATTACH_ENABLE)
+
+#include <bpf/btf.h>
+
+#define BTF_PROG_NAME_LEN   128
+#define BTF_TRACE_PREFIX    "btf_trace_"
+
+enum btf_prog_type_e {
+    BTF_PROG_FENTRY = 0,
+    BTF_PROG_FEXIT,
+    BTF_PROG_TP_BTF,
+
+    BTF_PROG_MAX
+};
+
+struct btf_prog_type_s {
+    const char *prefix;                 // followed by the number of parameters, '_' and the function
+    enum bpf_attach_type attach_type;
+    const char *mode;
+    const char *fallback_mode;
+    const char *fallbacks[2];           // prefixes of the programs it replaces, see __bpf_kern.h
+};
+
+static struct btf_prog_type_s btf_prog_types[BTF_PROG_MAX] = {
+    {"bpf_fentry", BPF_TRACE_FENTRY, "fentry", "kprobe", {"bpf_", NULL}},
+    {"bpf_fexit", BPF_TRACE_FEXIT, "fexit", "kretprobe", {"bpf_stash_", "bpf_ret_"}},
+    {"bpf_tp_btf", BPF_TRACE_RAW_TP, "tp_btf", "raw_tracepoint", {"bpf_raw_trace_", NULL}}
+};
+
+// "bpf_fentry3_tcp_sendmsg" --> BTF_PROG_FENTRY, 3, "tcp_sendmsg"
+static int parse_btf_prog(const char *name, unsigned int *nargs, const char **func)
+{
+    const char *p;
+    size_t len;
+
+    for (int i = 0; i < BTF_PROG_MAX; i++) {
+        len = strlen(btf_prog_types[i].prefix);
+        if (strncmp(name, btf_prog_types[i].prefix, len) != 0) {
+            continue;
+        }
+
+        p = name + len;
+        if (*p < '0' || *p > '9') {
+            continue;
+        }
+        *nargs = (unsigned int)(*p - '0');
+        if (p[1] != '_' || p[2] == 0) {
+            continue;
+        }
+        *func = p + 2;
+        return i;
+    }
+    return -1;
+}
+
+/*
+ * The attach point must exist in kernel BTF with the parameters used by the program: fentry reads the
+ * first 'nargs' of them, fexit finds the return value right after them, and the first parameter of a
+ * btf_trace_xxx prototype is the context of the tracepoint, not one of the tracepoint's.
+ */
+static int find_btf_attach_id(const struct btf *vmlinux_btf, enum btf_prog_type_e type,
+    const char *func, unsigned int nargs)
+{
+    char name[BTF_PROG_NAME_LEN];
+    const struct btf_type *t;
+    int id;
+    unsigned int vlen;
+
+    if (type == BTF_PROG_TP_BTF) {
+        (void)snprintf(name, sizeof(name), "%s%s", BTF_TRACE_PREFIX, func);
+        id = btf__find_by_name_kind(vmlinux_btf, name, BTF_KIND_TYPEDEF);
+    } else {
+        id = btf__find_by_name_kind(vmlinux_btf, func, BTF_KIND_FUNC);
+    }
+    if (id <= 0) {
+        return -1;
+    }
+
+    t = btf__type_by_id(vmlinux_btf, (unsigned int)id);
+    if (t != NULL && type == BTF_PROG_TP_BTF) {
+        t = btf__type_by_id(vmlinux_btf, t->type);      // pointer to the prototype
+    }
+    if (t != NULL) {
+        t = btf__type_by_id(vmlinux_btf, t->type);
+    }
+    if (t == NULL || !btf_is_func_proto(t)) {
+        return -1;
+    }
+
+    vlen = btf_vlen(t);
+    switch (type) {
+        case BTF_PROG_FENTRY:
+            return (nargs <= vlen) ? id : -1;
+        case BTF_PROG_FEXIT:
+            return (nargs == vlen) ? id : -1;
+        default:
+            return (nargs + 1 <= vlen) ? id : -1;
+    }
+}
+
+/*
+ * Load and attach an empty program to the same point, e.g. the trampolines of fentry/fexit are
+ * not implemented on aarch64 before kernel 6.0, while kernel BTF is there.
+ */
+static char btf_prog_can_attach(enum bpf_attach_type attach_type, int btf_id)
+{
+    struct bpf_insn insns[] = {
+        {.code = BPF_ALU64 | BPF_MOV | BPF_K, .dst_reg = BPF_REG_0, .imm = 0},
+        {.code = BPF_JMP | BPF_EXIT},
+    };
+    LIBBPF_OPTS(bpf_prog_load_opts, opts,
+        .expected_attach_type = attach_type,
+        .attach_btf_id = (__u32)btf_id,
+    );
+    int prog_fd, link_fd;
+
+    prog_fd = bpf_prog_load(BPF_PROG_TYPE_TRACING, NULL, "GPL", insns, sizeof(insns) / sizeof(insns[0]), &opts);
+    if (prog_fd < 0) {
+        return 0;
+    }
+
+    link_fd = bpf_raw_tracepoint_open(NULL, prog_fd);
+    if (link_fd >= 0) {
+        (void)close(link_fd);
+    }
+    (void)close(prog_fd);
+    return (link_fd >= 0) ? 1 : 0;
+}
+
+static void disable_fallbacks(struct bpf_object *obj, const struct btf_prog_type_s *type, const char *func)
+{
+    char name[BTF_PROG_NAME_LEN];
+    struct bpf_program *prog;
+
+    for (int i = 0; i < sizeof(type->fallbacks) / sizeof(type->fallbacks[0]); i++) {
+        if (type->fallbacks[i] == NULL) {
+            continue;
+        }
+        (void)snprintf(name, sizeof(name), "%s%s", type->fallbacks[i], func);
+        prog = bpf_object__find_program_by_name(obj, name);
+        if (prog != NULL) {
+            (void)bpf_program__set_autoload(prog, false);
+        }
+    }
+}
+
+// Parsing kernel BTF takes a few MB and tens of ms, only done for an object with such programs.
+static struct btf *load_vmlinux_btf(const char *probe_name)
+{
+    struct btf *vmlinux_btf = btf__load_vmlinux_btf();
+
+    if (libbpf_get_error(vmlinux_btf)) {
+        WARN("BPF %s: load kernel BTF failed.\n", probe_name);
+        return NULL;
+    }
+    return vmlinux_btf;
+}
+
+int btf_attach_select(struct bpf_object *obj, const char *probe_name)
+{
+    struct bpf_program *prog;
+    struct btf *vmlinux_btf = NULL;
+    const char *func;
+    unsigned int nargs;
+    int type, id, num = 0;
+    char fast, btf_loaded = 0;
+
+    bpf_object__for_each_program(prog, obj) {
+        // not loaded by the probe itself
+        if (!bpf_program__autoload(prog)) {
+            continue;
+        }
+
+        type = parse_btf_prog(bpf_program__name(prog), &nargs, &func);
+        if (type < 0) {
+            continue;
+        }
+
+        if (!btf_loaded) {
+            vmlinux_btf = load_vmlinux_btf(probe_name);
+            btf_loaded = 1;
+        }
+
+        fast = 0;
+        if (vmlinux_btf != NULL) {
+            id = find_btf_attach_id(vmlinux_btf, type, func, nargs);
+            fast = (id > 0) ? btf_prog_can_attach(btf_prog_types[type].attach_type, id) : 0;
+        }
+
+        if (fast) {
+            disable_fallbacks(obj, &btf_prog_types[type], func);
+            num++;
+        } else {
+            (void)bpf_program__set_autoload(prog, false);
+        }
+        INFO("BPF %s: %s is attached by %s.\n", probe_name, func,
+            fast ? btf_prog_types[type].mode : btf_prog_types[type].fallback_mode);
+    }
+
+    btf__free(vmlinux_btf);
+    return num;
+}
+
+#else
+
+int btf_attach_select(struct bpf_object *obj, const char *probe_name)
+{
+    return 0;
+}
+
+#endif
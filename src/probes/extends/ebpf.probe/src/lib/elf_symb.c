@@ -24,6 +24,7 @@
 #include <sys/ioctl.h>
 #include <sys/wait.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <fcntl.h>
 
 #ifdef BPF_PROG_KERN
@@ -39,7 +40,32 @@
 #include "gopher_elf.h"
 #include "elf_symb.h"
 
+/*
+ * Symbols of an elf are loaded once and shared by all mods mapping it, whatever process they
+ * belong to. Items are keyed by build-id, so copies of one binary in different containers
+ * share symbols too, or by file id(dev + inode + mtime) if the elf has no build-id.
+ * __files maps file ids to items, a file mapped again is resolved without opening the elf.
+ */
+struct elf_file_s {
+    H_HANDLE;
+    struct elf_file_id_s id;
+    struct elf_symbo_s *elf_symb;
+};
+
+#define SYMB_POOL_CHUNK_SIZE    (64 * 1024)
+struct symb_pool_chunk_s {
+    struct symb_pool_chunk_s *next;
+    size_t size;
+    size_t used;
+    char data[];
+};
+
+struct symb_pool_s {
+    struct symb_pool_chunk_s *chunks;
+};
+
 static struct elf_symbo_s* __head = NULL;
+static struct elf_file_s* __files = NULL;
 
 #ifdef symbs
 #undef symbs
@@ -47,39 +73,87 @@ static struct elf_symbo_s* __head = NULL;
 #define symbs   __symbs
 
 #if 1
-#define __STAT_INODE "/usr/bin/stat --format=%%i %s"
-int __get_inode(const char *elf, u32 *inode)
+static int __get_file_id(const char *elf, struct elf_file_id_s *id, char with_mtime)
 {
-    char command[COMMAND_LEN];
-    char inode_s[INT_LEN];
+    struct stat f_stat;
 
-    if (access(elf, 0) != 0) {
+    if (stat(elf, &f_stat) != 0) {
         return -1;
     }
 
-    command[0] = 0;
-    inode_s[0] = 0;
-    (void)snprintf(command, COMMAND_LEN, __STAT_INODE, elf);
+    (void)memset(id, 0, sizeof(struct elf_file_id_s));
+    id->dev = (u64)f_stat.st_dev;
+    id->inode = (u64)f_stat.st_ino;
+    if (with_mtime) {
+        id->mtime = (s64)f_stat.st_mtime;
+    }
+    return 0;
+}
 
-    if (exec_cmd((const char *)command, inode_s, INT_LEN) < 0) {
-        return -1;
+static void *__pool_alloc(struct symb_pool_s *pool, size_t size)
+{
+    struct symb_pool_chunk_s *chunk = pool->chunks;
+    size_t chunk_size;
+    void *p;
+
+    size = (size + 7) & ~(size_t)7;
+    if (chunk == NULL || chunk->used + size > chunk->size) {
+        chunk_size = max(size, (size_t)SYMB_POOL_CHUNK_SIZE);
+        chunk = (struct symb_pool_chunk_s *)malloc(sizeof(struct symb_pool_chunk_s) + chunk_size);
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        chunk->next = pool->chunks;
+        pool->chunks = chunk;
     }
 
-    *inode = (u32)atoi((const char *)inode_s);
-    return 0;
+    p = chunk->data + chunk->used;
+    chunk->used += size;
+    return p;
 }
 
-static void __symb_destroy(struct symb_s *symb)
+static void __pool_reset(struct symb_pool_s *pool)
 {
-    if (!symb) {
-        return;
+    struct symb_pool_chunk_s *chunk, *next;
+
+    for (chunk = pool->chunks; chunk != NULL; chunk = next) {
+        next = chunk->next;
+        (void)free(chunk);
+    }
+    pool->chunks = NULL;
+}
+
+/* A symbol and its name take one allocation from the pool of the elf. */
+static struct symb_s* __new_symb(struct elf_symbo_s* elf_symbo, const char *name, size_t name_len,
+    u64 start, u64 size)
+{
+    struct symb_s* new_symb;
+
+    new_symb = (struct symb_s*)__pool_alloc(elf_symbo->pool, sizeof(struct symb_s) + name_len + 1);
+    if (!new_symb) {
+        return NULL;
     }
 
-    if (symb->symb_name) {
-        (void)free(symb->symb_name);
-        symb->symb_name = NULL;
+    new_symb->start = start;
+    new_symb->size = size;
+    new_symb->symb_name = (char *)(new_symb + 1);
+    (void)memcpy(new_symb->symb_name, name, name_len);
+    new_symb->symb_name[name_len] = 0;
+    return new_symb;
+}
+
+static void __rm_elf_files(struct elf_symbo_s* elf_symbo)
+{
+    struct elf_file_s *file, *tmp;
+
+    H_ITER(__files, file, tmp) {
+        if (file->elf_symb == elf_symbo) {
+            H_DEL(__files, file);
+            (void)free(file);
+        }
     }
-    return;
 }
 
 static void __destroy_symbol(struct elf_symbo_s* elf_symbo)
@@ -93,18 +167,18 @@ static void __destroy_symbol(struct elf_symbo_s* elf_symbo)
         elf_symbo->elf = NULL;
     }
 
-    if (elf_symbo->symbs) {
-        for (int i = 0; i < elf_symbo->symbs_count; i++) {
-            __symb_destroy(elf_symbo->symbs[i]);
-            if (elf_symbo->symbs[i]) {
-                (void)free(elf_symbo->symbs[i]);
-                elf_symbo->symbs[i] = NULL;
-            }
-        }
+    if (elf_symbo->pool) {
+        __pool_reset(elf_symbo->pool);
+        (void)free(elf_symbo->pool);
+        elf_symbo->pool = NULL;
+    }
 
+    if (elf_symbo->symbs) {
         (void)free(elf_symbo->symbs);
         elf_symbo->symbs = NULL;
     }
+    elf_symbo->symbs_count = 0;
+    elf_symbo->symbs_capability = 0;
 
     return;
 }
@@ -114,7 +188,10 @@ static int __symb_cmp(const void *a, const void *b)
     struct symb_s **symb1 = (struct symb_s **)a;
     struct symb_s **symb2 = (struct symb_s **)b;
 
-    return (*symb1)->start - (*symb2)->start;
+    if ((*symb1)->start == (*symb2)->start) {
+        return 0;
+    }
+    return ((*symb1)->start > (*symb2)->start) ? 1 : -1;
 }
 
 static int __sort_symbol(struct elf_symbo_s* elf_symbo)
@@ -126,23 +203,69 @@ static int __sort_symbol(struct elf_symbo_s* elf_symbo)
     return 0;
 }
 
-static struct elf_symbo_s* __lkup_symb(u32 inode)
+static struct elf_symbo_s* __lkup_symb(const struct elf_symb_key_s *key)
 {
     struct elf_symbo_s *item = NULL;
 
-    H_FIND_I(__head, &inode, item);
+    H_FIND(__head, key, sizeof(struct elf_symb_key_s), item);
     return item;
 }
 
-static struct elf_symbo_s* __create_symbol(const char* elf, u32 inode)
+static struct elf_symbo_s* __lkup_symb_by_file(const struct elf_file_id_s *id)
+{
+    struct elf_file_s *file = NULL;
+
+    H_FIND(__files, id, sizeof(struct elf_file_id_s), file);
+    return file ? file->elf_symb : NULL;
+}
+
+static void __add_elf_file(const struct elf_file_id_s *id, struct elf_symbo_s* elf_symbo)
+{
+    struct elf_file_s *file;
+
+    file = (struct elf_file_s *)malloc(sizeof(struct elf_file_s));
+    if (!file) {
+        return;     // The elf is resolved by key next time.
+    }
+    (void)memset(file, 0, sizeof(struct elf_file_s));
+    (void)memcpy(&file->id, id, sizeof(struct elf_file_id_s));
+    file->elf_symb = elf_symbo;
+    H_ADD(__files, id, sizeof(struct elf_file_id_s), file);
+}
+
+static void __get_symb_key(const char *elf, const struct elf_file_id_s *id,
+    enum sym_file_t sym_file_type, struct elf_symb_key_s *key)
+{
+    char build_id[PATH_LEN];
+
+    (void)memset(key, 0, sizeof(struct elf_symb_key_s));
+    if (sym_file_type == ELF_SYM) {
+        build_id[0] = 0;
+        if (gopher_get_elf_build_id(elf, build_id, PATH_LEN) == 0 &&
+            build_id[0] != 0 && strlen(build_id) < ELF_BUILD_ID_LEN) {
+            (void)strcpy(key->build_id, build_id);
+            return;
+        }
+    }
+    (void)memcpy(&key->file_id, id, sizeof(struct elf_file_id_s));
+}
+
+static struct elf_symbo_s* __create_symbol(const char* elf, const struct elf_symb_key_s *key)
 {
     struct elf_symbo_s* elf_symbo = malloc(sizeof(struct elf_symbo_s));
     if (!elf_symbo) {
         return NULL;
     }
     (void)memset(elf_symbo, 0, sizeof(struct elf_symbo_s));
-    elf_symbo->i_inode = inode;
+    (void)memcpy(&elf_symbo->key, key, sizeof(struct elf_symb_key_s));
+    elf_symbo->i_inode = (u32)key->file_id.inode;
     elf_symbo->elf = strdup(elf);
+    elf_symbo->pool = (struct symb_pool_s *)calloc(1, sizeof(struct symb_pool_s));
+    if (!elf_symbo->elf || !elf_symbo->pool) {
+        __destroy_symbol(elf_symbo);
+        (void)free(elf_symbo);
+        return NULL;
+    }
     elf_symbo->refcnt += 1;
     return elf_symbo;
 }
@@ -151,29 +274,23 @@ static int __inc_symbs_capability(struct elf_symbo_s* elf_symbo)
 {
     u32 new_capa, old_capa;
     struct symb_s** new_symbs_capa;
-    struct symb_s** old_symbs_capa;
 
+    // Grow geometrically, loading a big elf must not copy the array for each step.
     old_capa = elf_symbo->symbs_capability;
-    new_capa = elf_symbo->symbs_capability + SYMBS_STEP_COUNT;
-    if (new_capa >= SYMBS_MAX_COUNT) {
+    new_capa = (old_capa == 0) ? SYMBS_STEP_COUNT : (old_capa * 2);
+    if (new_capa > SYMBS_MAX_COUNT) {
+        new_capa = SYMBS_MAX_COUNT;
+    }
+    if (new_capa <= old_capa) {
         return -1;
     }
 
-    old_symbs_capa = elf_symbo->symbs;
-
-    new_symbs_capa = (struct symb_s **)malloc(new_capa * sizeof(struct symb_s *));
+    new_symbs_capa = (struct symb_s **)realloc(elf_symbo->symbs, new_capa * sizeof(struct symb_s *));
     if (!new_symbs_capa) {
         return -1;
     }
 
-    (void)memset(new_symbs_capa, 0, new_capa * sizeof(struct symb_s *));
-    if (old_capa > 0 && old_symbs_capa != NULL) {
-        (void)memcpy(new_symbs_capa, old_symbs_capa, old_capa * sizeof(struct symb_s *));
-    }
-    if (old_symbs_capa != NULL) {
-        (void)free(old_symbs_capa);
-        old_symbs_capa = NULL;
-    }
+    (void)memset(new_symbs_capa + old_capa, 0, (new_capa - old_capa) * sizeof(struct symb_s *));
     elf_symbo->symbs = new_symbs_capa;
     elf_symbo->symbs_capability = new_capa;
     return 0;
@@ -191,73 +308,40 @@ static ELF_CB_RET __add_symbs(const char *symb, u64 addr_start, u64 size, void *
         }
     }
 
-    new_symb = (struct symb_s*)malloc(sizeof(struct symb_s));
+    new_symb = __new_symb(elf_symbo, symb, strlen(symb), addr_start, size);
     if (!new_symb) {
         return ELF_SYMB_CB_ERR;
     }
-
-    (void)memset(new_symb, 0, sizeof(struct symb_s));
-    new_symb->start = addr_start;
-    new_symb->size = size;
-    new_symb->symb_name = strdup(symb);
     SPLIT_NEWLINE_SYMBOL(new_symb->symb_name);
 
     elf_symbo->symbs[elf_symbo->symbs_count++] = new_symb;
     return ELF_SYMB_CB_OK;
 }
 
-static void __destroy_java_symbs(struct symb_s* new_symb)
-{
-    if (new_symb) {
-        if (new_symb->symb_name) {
-            (void)free(new_symb->symb_name);
-            new_symb->symb_name = NULL;
-        }
-        (void)free(new_symb);
-    }
-}
-
-static struct symb_s* resolve_java_symbs(char *s)
+static struct symb_s* resolve_java_symbs(struct elf_symbo_s* elf_symbo, char *s)
 {
-    char symb[JAVASYMB_NAME_LEN] = {0};
     char *code_size, *method_name;
     size_t name_len = 0;
-    struct symb_s* new_symb = NULL;
+    u64 start, size;
 
-    // 1. malloc new_symb
-    new_symb = (struct symb_s*)malloc(sizeof(struct symb_s));
-    if (!new_symb) {
-        goto err;
-    }
-    (void)memset(new_symb, 0, sizeof(struct symb_s));
+    // 1. get start_addr
+    start = strtoull(s, &code_size, 16);
 
-    // 2. set new_symb start_addr
-    new_symb->start = strtoull(s, &code_size, 16);
-
-    // 3. set new_symb code_size
+    // 2. get code_size
     code_size++;
-    new_symb->size = strtoull(code_size, &method_name, 16);
+    size = strtoull(code_size, &method_name, 16);
 
-    // 4. set new_symb method_name
+    // 3. get method_name
     method_name++;
-    while (*method_name != ' ' && *method_name != '\n' && name_len < JAVASYMB_NAME_LEN - 1) {
-        symb[name_len++] = *method_name;
-        method_name++;
+    while (method_name[name_len] != ' ' && method_name[name_len] != '\n' &&
+           method_name[name_len] != 0 && name_len < JAVASYMB_NAME_LEN - 1) {
+        name_len++;
     }
-    symb[name_len] = 0;
     if (name_len == 0) {
-        goto err;
-    }
-    new_symb->symb_name = (char *)malloc(name_len + 1);
-    if (!new_symb->symb_name) {
-        goto err;
+        return NULL;
     }
-    (void)memcpy(new_symb->symb_name, symb, name_len + 1);
-    return new_symb;
 
-err:
-    __destroy_java_symbs(new_symb);
-    return NULL;
+    return __new_symb(elf_symbo, method_name, name_len, start, size);
 }
 
 static void __reset_java_symbol(struct elf_symbo_s* elf_symbo)
@@ -266,12 +350,8 @@ static void __reset_java_symbol(struct elf_symbo_s* elf_symbo)
         return;
     }
 
-    for (int i = 0; i < elf_symbo->symbs_count; i++) {
-        __symb_destroy(elf_symbo->symbs[i]);
-        if (elf_symbo->symbs[i]) {
-            (void)free(elf_symbo->symbs[i]);
-            elf_symbo->symbs[i] = NULL;
-        }
+    if (elf_symbo->pool) {
+        __pool_reset(elf_symbo->pool);
     }
 
     if (elf_symbo->symbs) {
@@ -313,7 +393,7 @@ int __get_java_symb_from_file(const char *file, struct elf_symbo_s* elf_symbo)
                 goto err;
             }
         }
-        new_symb = resolve_java_symbs(line);
+        new_symb = resolve_java_symbs(elf_symbo, line);
         if (new_symb == NULL) {
             continue;
         }
@@ -420,21 +500,26 @@ static int __do_search_addr(struct elf_symbo_s* elf_symb,
 struct elf_symbo_s* update_symb_from_jvm_sym_file(const char* elf)
 {
     int ret;
-    u32 inode;
+    struct elf_file_id_s id;
+    struct elf_symb_key_s key;
     enum sym_file_t sym_file_type = JAVA_SYM;
     struct elf_symbo_s* item = NULL;
-    ret = __get_inode(elf, &inode);
+    char is_new = 0;
+
+    // The jvm symbol file grows in place, its mtime is not part of the key.
+    ret = __get_file_id(elf, &id, 0);
     if (ret != 0) {
         return NULL;
     }
+    __get_symb_key(elf, &id, sym_file_type, &key);
 
-    item = __lkup_symb(inode);
+    item = __lkup_symb(&key);
     if (!item) {
-        item = __create_symbol(elf, inode);
+        item = __create_symbol(elf, &key);
         if (!item) {
-            goto err;
+            return NULL;
         }
-        H_ADD_I(__head, i_inode, item);
+        is_new = 1;
     }
 
     ret = __load_symbol_from_file(item, sym_file_type);
@@ -445,34 +530,50 @@ struct elf_symbo_s* update_symb_from_jvm_sym_file(const char* elf)
 
     (void)__sort_symbol(item);
 
+    if (is_new) {
+        H_ADD(__head, key, sizeof(struct elf_symb_key_s), item);
+    }
     DEBUG("[ELF_SYMBOL]: Succeed to update JVM symbs %s(symbs_count = %u).\n", item->elf, item->symbs_count);
     return item;
 
 err:
-    if (item) {
+    if (is_new) {
         __destroy_symbol(item);
         (void)free(item);
+        return NULL;
     }
-    return NULL;
+    // Still referenced by mods, keep what was loaded before.
+    return item;
 }
 
 struct elf_symbo_s* get_symb_from_file(const char* elf, enum sym_file_t sym_file_type)
 {
     int ret;
-    u32 inode;
+    struct elf_file_id_s id;
+    struct elf_symb_key_s key;
     struct elf_symbo_s* item = NULL, *new_item = NULL;
-    ret = __get_inode(elf, &inode);
+
+    ret = __get_file_id(elf, &id, (sym_file_type == ELF_SYM));
     if (ret != 0) {
         return NULL;
     }
 
-    item = __lkup_symb(inode);
+    item = __lkup_symb_by_file(&id);
     if (item) {
         item->refcnt++;
         return item;
     }
 
-    new_item = __create_symbol(elf, inode);
+    // Another copy of the same binary, e.g. from another container image layer.
+    __get_symb_key(elf, &id, sym_file_type, &key);
+    item = __lkup_symb(&key);
+    if (item) {
+        item->refcnt++;
+        __add_elf_file(&id, item);
+        return item;
+    }
+
+    new_item = __create_symbol(elf, &key);
     if (!new_item) {
         goto err;
     }
@@ -484,7 +585,8 @@ struct elf_symbo_s* get_symb_from_file(const char* elf, enum sym_file_t sym_file
 
     (void)__sort_symbol(new_item);
 
-    H_ADD_I(__head, i_inode, new_item);
+    H_ADD(__head, key, sizeof(struct elf_symb_key_s), new_item);
+    __add_elf_file(&id, new_item);
     if (sym_file_type == JAVA_SYM) {
         INFO("[ELF_SYMBOL]: Succeed to init JVM symbs %s(symbs_count = %u).\n", new_item->elf, new_item->symbs_count);
     }
@@ -498,6 +600,27 @@ err:
     return NULL;
 }
 
+/* The text section of a shared elf is read once too. */
+int get_elf_symb_text_section(struct elf_symbo_s* elf_symb, const char *elf, u64 *addr, u64 *offset)
+{
+    if (elf_symb != NULL && elf_symb->text_valid) {
+        *addr = elf_symb->text_addr;
+        *offset = elf_symb->text_offset;
+        return 0;
+    }
+
+    if (gopher_get_elf_text_section(elf, addr, offset)) {
+        return -1;
+    }
+
+    if (elf_symb != NULL) {
+        elf_symb->text_addr = *addr;
+        elf_symb->text_offset = *offset;
+        elf_symb->text_valid = 1;
+    }
+    return 0;
+}
+
 void rm_elf_symb(struct elf_symbo_s* elf_symb)
 {
     struct elf_symbo_s *item = NULL;
@@ -506,7 +629,7 @@ void rm_elf_symb(struct elf_symbo_s* elf_symb)
         return;
     }
 
-    item = __lkup_symb(elf_symb->i_inode);
+    item = __lkup_symb(&elf_symb->key);
     if (!item) {
         return;
     }
@@ -521,6 +644,7 @@ void rm_elf_symb(struct elf_symbo_s* elf_symb)
 
     //INFO("[ELF_SYMBOL]: Succeed to delete elf %s.\n", item->elf);
 
+    __rm_elf_files(item);
     __destroy_symbol(item);
     H_DEL(__head, item);
     (void)free(item);
@@ -540,6 +664,13 @@ int search_elf_symb(struct elf_symbo_s* elf_symb,
 void deinit_elf_symbs(void)
 {
     struct elf_symbo_s *item, *tmp;
+    struct elf_file_s *file, *file_tmp;
+
+    H_ITER(__files, file, file_tmp) {
+        H_DEL(__files, file);
+        (void)free(file);
+    }
+    __files = NULL;
 
     if (!__head) {
         return;
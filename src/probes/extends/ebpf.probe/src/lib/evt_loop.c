@@ -0,0 +1,284 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: event loop for all perf buffers and bpf buffers of a probe
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/epoll.h>
+
+#ifdef BPF_PROG_KERN
+#undef BPF_PROG_KERN
+#endif
+
+#ifdef BPF_PROG_USER
+#undef BPF_PROG_USER
+#endif
+
+#include "bpf.h"
+#include "evt_loop.h"
+
+/*
+ * Every perf buffer owns an epoll fd over its per-cpu rings. The loop registers these
+ * fds into one epoll set, so a single wait covers all perf buffers of the probe and only
+ * the ready ones are consumed. Older libbpf does not export the epoll fd, in which case
+ * the perf buffers are polled one by one and share the wait time.
+ * Bpf buffers(see create_bpf_buffer) are registered the same way, backed by ring buffer
+ * they are also drained in every round since records may be committed without wakeup.
+ */
+#if (CURRENT_LIBBPF_VERSION >= LIBBPF_VERSION(0, 2))
+#define EVT_LOOP_EPOLL_ENABLE
+#endif
+
+static __u64 __get_mono_ms(void)
+{
+    struct timespec ts;
+
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (__u64)ts.tv_sec * MSEC_PER_SEC + (__u64)ts.tv_nsec / NSEC_PER_MSEC;
+}
+
+struct evt_loop_s *evt_loop_new(void)
+{
+    struct evt_loop_s *loop;
+
+    loop = (struct evt_loop_s *)malloc(sizeof(struct evt_loop_s));
+    if (loop == NULL) {
+        return NULL;
+    }
+    (void)memset(loop, 0, sizeof(struct evt_loop_s));
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0) {
+        ERROR("[EVT_LOOP] Create epoll fd failed(%d).\n", errno);
+        (void)free(loop);
+        return NULL;
+    }
+    return loop;
+}
+
+void evt_loop_free(struct evt_loop_s **ploop)
+{
+    struct evt_loop_s *loop = *ploop;
+
+    *ploop = NULL;
+    if (loop == NULL) {
+        return;
+    }
+
+    /* perf buffers are owned and freed by their bpf prog */
+    (void)close(loop->epoll_fd);
+    (void)free(loop);
+}
+
+static int __evt_loop_add(struct evt_loop_s *loop, struct perf_buffer *pb, struct bpf_buffer_s *buffer,
+    __u64 *lost_cnt, const char *name)
+{
+    struct evt_loop_pb_s *loop_pb;
+
+    if (loop->pb_num >= EVT_LOOP_PB_MAX) {
+        ERROR("[EVT_LOOP] Too many perf buffers, add %s failed.\n", name);
+        return -1;
+    }
+
+#ifdef EVT_LOOP_EPOLL_ENABLE
+    int fd = (buffer != NULL) ? bpf_buffer_epoll_fd(buffer) : perf_buffer__epoll_fd(pb);
+    struct epoll_event ev = {.events = EPOLLIN, .data.u32 = (__u32)loop->pb_num};
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        ERROR("[EVT_LOOP] Register perf buffer %s failed(%d).\n", name, errno);
+        return -1;
+    }
+#endif
+
+    loop_pb = &loop->pbs[loop->pb_num];
+    loop_pb->pb = pb;
+    loop_pb->buffer = buffer;
+    loop_pb->lost = lost_cnt;
+    loop_pb->last_lost = 0;
+    loop_pb->err_cnt = 0;
+    (void)snprintf(loop_pb->name, EVT_LOOP_NAME_LEN, "%s", name);
+    loop->pb_num++;
+    return 0;
+}
+
+int evt_loop_add_pb(struct evt_loop_s *loop, struct perf_buffer *pb, __u64 *lost_cnt, const char *name)
+{
+    if (pb == NULL) {
+        return 0;
+    }
+    return __evt_loop_add(loop, pb, NULL, lost_cnt, name);
+}
+
+int evt_loop_add_buffer(struct evt_loop_s *loop, struct bpf_buffer_s *buffer, const char *name)
+{
+    if (buffer == NULL) {
+        return 0;
+    }
+    return __evt_loop_add(loop, NULL, buffer, &buffer->lost, name);
+}
+
+int evt_loop_add_prog(struct evt_loop_s *loop, struct bpf_prog_s *prog, const char *name)
+{
+    char pb_name[EVT_LOOP_NAME_LEN];
+
+    if (prog == NULL) {
+        return 0;
+    }
+
+    if (evt_loop_add_pb(loop, prog->pb, &prog->pb_lost, name)) {
+        return -1;
+    }
+
+    for (int i = 0; i < prog->num; i++) {
+        pb_name[0] = 0;
+        (void)snprintf(pb_name, EVT_LOOP_NAME_LEN, "%s_%d", name, i);
+        if (evt_loop_add_pb(loop, prog->pbs[i], &prog->pbs_lost[i], (const char *)pb_name)) {
+            return -1;
+        }
+        if (evt_loop_add_buffer(loop, prog->buffers[i], (const char *)pb_name)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int evt_loop_add_timer(struct evt_loop_s *loop, unsigned int interval_ms, evt_loop_timer_fn fn, void *ctx)
+{
+    struct evt_loop_timer_s *timer;
+
+    if (loop->timer_num >= EVT_LOOP_TIMER_MAX || interval_ms == 0 || fn == NULL) {
+        return -1;
+    }
+
+    timer = &loop->timers[loop->timer_num];
+    timer->fn = fn;
+    timer->ctx = ctx;
+    timer->interval_ms = interval_ms;
+    timer->next_ms = __get_mono_ms() + interval_ms;
+    loop->timer_num++;
+    return 0;
+}
+
+static int __get_wait_ms(struct evt_loop_s *loop, int timeout_ms)
+{
+    __u64 now = __get_mono_ms();
+    int wait_ms = timeout_ms;
+
+    for (int i = 0; i < loop->timer_num; i++) {
+        if (loop->timers[i].next_ms <= now) {
+            return 0;
+        }
+        wait_ms = min(wait_ms, (int)(loop->timers[i].next_ms - now));
+    }
+    return wait_ms;
+}
+
+static void __run_timers(struct evt_loop_s *loop)
+{
+    struct evt_loop_timer_s *timer;
+    __u64 now = __get_mono_ms();
+
+    for (int i = 0; i < loop->timer_num; i++) {
+        timer = &loop->timers[i];
+        if (timer->next_ms > now) {
+            continue;
+        }
+        timer->fn(timer->ctx);
+
+        /* Skip the missed ticks rather than firing them in a burst */
+        timer->next_ms += timer->interval_ms;
+        if (timer->next_ms <= now) {
+            timer->next_ms = now + timer->interval_ms;
+        }
+    }
+}
+
+static void __consume_pb(struct evt_loop_pb_s *loop_pb, int timeout_ms)
+{
+    int ret;
+
+    if (loop_pb->buffer != NULL) {
+        ret = consume_bpf_buffer(loop_pb->buffer, timeout_ms);
+    } else {
+        ret = perf_buffer__poll(loop_pb->pb, timeout_ms);
+    }
+    if (ret < 0 && ret != -EINTR) {
+        /* One broken perf buffer must not stop the events of the others */
+        if (loop_pb->err_cnt == 0) {
+            ERROR("[EVT_LOOP] Poll perf buffer %s failed(%d).\n", loop_pb->name, ret);
+        }
+        loop_pb->err_cnt++;
+    }
+
+    if (loop_pb->lost != NULL && *(loop_pb->lost) != loop_pb->last_lost) {
+        WARN("[EVT_LOOP] Perf buffer %s lost %llu samples(total %llu).\n", loop_pb->name,
+            *(loop_pb->lost) - loop_pb->last_lost, *(loop_pb->lost));
+        loop_pb->last_lost = *(loop_pb->lost);
+    }
+}
+
+/*
+ * Wait at most 'timeout_ms' (less if a timer is due) for events of any perf buffer,
+ * consume the ready perf buffers and run the due timers.
+ * Return the number of ready perf buffers, or negative value if the loop is broken.
+ */
+int evt_loop_poll(struct evt_loop_s *loop, int timeout_ms)
+{
+    int wait_ms, num = 0;
+
+    wait_ms = __get_wait_ms(loop, timeout_ms);
+
+#ifdef EVT_LOOP_EPOLL_ENABLE
+    struct epoll_event events[EVT_LOOP_PB_MAX];
+
+    num = epoll_wait(loop->epoll_fd, events, EVT_LOOP_PB_MAX, wait_ms);
+    if (num < 0) {
+        if (errno != EINTR) {
+            ERROR("[EVT_LOOP] Wait events failed(%d).\n", errno);
+            return -errno;
+        }
+        num = 0;
+    }
+
+    for (int i = 0; i < num; i++) {
+        __u32 idx = events[i].data.u32;
+        if (idx < loop->pb_num) {
+            __consume_pb(&loop->pbs[idx], 0);
+        }
+    }
+
+    for (int i = 0; i < loop->pb_num; i++) {
+        if (loop->pbs[i].buffer != NULL) {
+            (void)drain_bpf_buffer(loop->pbs[i].buffer);
+        }
+    }
+#else
+    if (loop->pb_num == 0) {
+        if (wait_ms > 0) {
+            (void)usleep((useconds_t)wait_ms * USEC_PER_MSEC);
+        }
+    } else {
+        wait_ms = wait_ms / loop->pb_num;
+        for (int i = 0; i < loop->pb_num; i++) {
+            __consume_pb(&loop->pbs[i], wait_ms);
+        }
+        num = loop->pb_num;
+    }
+#endif
+
+    __run_timers(loop);
+    return num;
+}
@@ -0,0 +1,314 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: batched walk of bpf map and flat aggregation table
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef BPF_PROG_KERN
+#undef BPF_PROG_KERN
+#endif
+
+#ifdef BPF_PROG_USER
+#undef BPF_PROG_USER
+#endif
+
+#include "bpf.h"
+#include "map_batch.h"
+
+/*
+ * Batch ops of hash map are supported since kernel 5.6. A batch of MAP_BATCH_SIZE elements
+ * costs one syscall, instead of two syscalls(get_next_key + lookup) per element.
+ * The elements to be deleted are collected during the walk and deleted in batch at last,
+ * since the elements still in use must stay in the map, the map can not be drained by
+ * lookup_and_delete. Maps harvested as a whole are drained by lookup_and_delete instead.
+ */
+#if (CURRENT_KERNEL_VERSION >= KERNEL_VERSION(5, 6, 0))
+#define MAP_BATCH_ENABLE
+#endif
+
+#ifndef ENOTSUPP
+#define ENOTSUPP    524
+#endif
+
+#define __ALIGN8(x)     (((x) + 7) & ~7U)
+
+struct map_batch_s *map_batch_new(int map_fd, __u32 key_size, __u32 value_size)
+{
+    struct map_batch_s *batch;
+    __u32 token_size = max(key_size, (__u32)sizeof(__u64));
+
+    batch = (struct map_batch_s *)calloc(1, sizeof(struct map_batch_s));
+    if (batch == NULL) {
+        return NULL;
+    }
+
+    batch->map_fd = map_fd;
+    batch->key_size = key_size;
+    batch->value_size = value_size;
+    batch->keys = calloc(MAP_BATCH_SIZE, key_size);
+    batch->values = calloc(MAP_BATCH_SIZE, value_size);
+    batch->in_token = calloc(1, token_size);
+    batch->out_token = calloc(1, token_size);
+    if (batch->keys == NULL || batch->values == NULL || batch->in_token == NULL || batch->out_token == NULL) {
+        map_batch_free(&batch);
+        return NULL;
+    }
+#ifndef MAP_BATCH_ENABLE
+    batch->batch_off = 1;
+#endif
+    return batch;
+}
+
+void map_batch_free(struct map_batch_s **pbatch)
+{
+    struct map_batch_s *batch = *pbatch;
+
+    *pbatch = NULL;
+    if (batch == NULL) {
+        return;
+    }
+
+    free(batch->keys);
+    free(batch->values);
+    free(batch->in_token);
+    free(batch->out_token);
+    free(batch->del_keys);
+    free(batch);
+}
+
+static int __add_del_key(struct map_batch_s *batch, const void *key)
+{
+    void *del_keys;
+    __u32 del_max;
+
+    if (batch->del_num >= batch->del_max) {
+        del_max = (batch->del_max == 0) ? MAP_BATCH_SIZE : batch->del_max * 2;
+        del_keys = realloc(batch->del_keys, (size_t)del_max * batch->key_size);
+        if (del_keys == NULL) {
+            return -1;
+        }
+        batch->del_keys = del_keys;
+        batch->del_max = del_max;
+    }
+
+    (void)memcpy((char *)batch->del_keys + (size_t)batch->del_num * batch->key_size, key, batch->key_size);
+    batch->del_num++;
+    return 0;
+}
+
+static void __handle_elem(struct map_batch_s *batch, const void *key, const void *value,
+    map_batch_fn fn, void *ctx, char drain)
+{
+    if (fn(key, value, ctx) == MAP_BATCH_DEL || drain) {
+        /* Out of memory, the element stays in map and is met again in next walk */
+        (void)__add_del_key(batch, key);
+    }
+}
+
+static void __delete_elems(struct map_batch_s *batch)
+{
+    __u32 i = 0;
+    char *key;
+
+#ifdef MAP_BATCH_ENABLE
+    if (!batch->batch_off) {
+        __u32 count = batch->del_num;
+        /* Deleting stops at the first missing element, the rest are deleted one by one. */
+        (void)bpf_map_delete_batch(batch->map_fd, batch->del_keys, &count, NULL);
+        i = min(count, batch->del_num);
+    }
+#endif
+
+    for (; i < batch->del_num; i++) {
+        key = (char *)batch->del_keys + (size_t)i * batch->key_size;
+        (void)bpf_map_delete_elem(batch->map_fd, key);
+    }
+    batch->del_num = 0;
+}
+
+static int __walk_by_key(struct map_batch_s *batch, map_batch_fn fn, void *ctx, char drain)
+{
+    void *prev_key = NULL;
+    void *key = batch->keys;
+    void *value = batch->values;
+    void *tmp;
+
+    /* Reuse the first two slots of keys as previous and current key */
+    while (bpf_map_get_next_key(batch->map_fd, prev_key, key) == 0) {
+        if (bpf_map_lookup_elem(batch->map_fd, key, value) == 0) {
+            __handle_elem(batch, key, value, fn, ctx, drain);
+        }
+
+        tmp = (prev_key == NULL) ? ((char *)batch->keys + batch->key_size) : prev_key;
+        prev_key = key;
+        key = tmp;
+    }
+    return 0;
+}
+
+#ifdef MAP_BATCH_ENABLE
+/*
+ * Return 1 if the batch walk can not start, the map is not touched then.
+ * In drain mode the elements are removed by the kernel as they are looked up.
+ */
+static int __walk_by_batch(struct map_batch_s *batch, map_batch_fn fn, void *ctx, char drain)
+{
+    void *in = NULL, *tmp;
+    __u32 count;
+    int err, done = 0;
+
+    while (!done) {
+        count = MAP_BATCH_SIZE;
+        if (drain) {
+            err = bpf_map_lookup_and_delete_batch(batch->map_fd, in, batch->out_token,
+                batch->keys, batch->values, &count, NULL);
+        } else {
+            err = bpf_map_lookup_batch(batch->map_fd, in, batch->out_token,
+                batch->keys, batch->values, &count, NULL);
+        }
+        if (err) {
+            if (errno != ENOENT) {
+                if (in != NULL) {
+                    ERROR("[MAP_BATCH] Lookup batch failed in middle of walk(%d).\n", errno);
+                    return -1;
+                }
+                /* Nothing handled yet, caller walks the map one by one */
+                if (errno == EINVAL || errno == ENOTSUPP || errno == EOPNOTSUPP) {
+                    INFO("[MAP_BATCH] Batch ops not supported, walk map one by one.\n");
+                    batch->batch_off = 1;
+                }
+                return 1;
+            }
+            done = 1;       // ENOENT: no more elements, 'count' still holds the last ones
+        }
+
+        for (__u32 i = 0; i < count && i < MAP_BATCH_SIZE; i++) {
+            void *key = (char *)batch->keys + (size_t)i * batch->key_size;
+            void *value = (char *)batch->values + (size_t)i * batch->value_size;
+            if (drain) {
+                (void)fn(key, value, ctx);
+            } else {
+                __handle_elem(batch, key, value, fn, ctx, 0);
+            }
+        }
+
+        tmp = batch->in_token;
+        batch->in_token = batch->out_token;
+        batch->out_token = tmp;
+        in = batch->in_token;
+    }
+    return 0;
+}
+#endif
+
+/*
+ * Walk all elements of the map and call 'fn' for each, elements for which 'fn' returns
+ * MAP_BATCH_DEL are deleted after the walk.
+ */
+static int __map_batch_walk(struct map_batch_s *batch, map_batch_fn fn, void *ctx, char drain)
+{
+    int ret = 1;
+
+#ifdef MAP_BATCH_ENABLE
+    if (!batch->batch_off) {
+        ret = __walk_by_batch(batch, fn, ctx, drain);
+    }
+#endif
+    if (ret > 0) {
+        ret = __walk_by_key(batch, fn, ctx, drain);
+    }
+
+    __delete_elems(batch);
+    return ret;
+}
+
+int map_batch_walk(struct map_batch_s *batch, map_batch_fn fn, void *ctx)
+{
+    return __map_batch_walk(batch, fn, ctx, 0);
+}
+
+/*
+ * Call 'fn' for each element and remove all elements from the map, the return value of 'fn'
+ * is ignored. Used for maps aggregated by bpf prog and harvested once per period.
+ */
+int map_batch_drain(struct map_batch_s *batch, map_batch_fn fn, void *ctx)
+{
+    return __map_batch_walk(batch, fn, ctx, 1);
+}
+
+struct map_agg_s *map_agg_new(__u32 key_size, __u32 value_size, __u32 max_num)
+{
+    struct map_agg_s *agg;
+
+    agg = (struct map_agg_s *)calloc(1, sizeof(struct map_agg_s));
+    if (agg == NULL) {
+        return NULL;
+    }
+
+    agg->key_size = key_size;
+    agg->value_size = value_size;
+    agg->value_off = __ALIGN8(key_size);
+    agg->item_size = __ALIGN8(sizeof(struct map_agg_item_s) + agg->value_off + value_size);
+    agg->max_num = max_num;
+    agg->items = (char *)calloc(max_num, agg->item_size);
+    if (agg->items == NULL) {
+        free(agg);
+        return NULL;
+    }
+    return agg;
+}
+
+void map_agg_free(struct map_agg_s **pagg)
+{
+    struct map_agg_s *agg = *pagg;
+
+    *pagg = NULL;
+    if (agg == NULL) {
+        return;
+    }
+
+    map_agg_reset(agg);
+    free(agg->items);
+    free(agg);
+}
+
+/* Return the value of 'key', a new item is zeroed. Return NULL if the table is full. */
+void *map_agg_lookup_or_init(struct map_agg_s *agg, const void *key)
+{
+    struct map_agg_item_s *item = NULL;
+
+    H_FIND(agg->head, key, agg->key_size, item);
+    if (item != NULL) {
+        return (void *)(item->data + agg->value_off);
+    }
+
+    if (agg->num >= agg->max_num) {
+        return NULL;
+    }
+
+    item = map_agg_item(agg, agg->num);
+    (void)memset(item, 0, agg->item_size);
+    (void)memcpy(item->data, key, agg->key_size);
+    H_ADD_KEYPTR(agg->head, item->data, agg->key_size, item);
+    agg->num++;
+    return (void *)(item->data + agg->value_off);
+}
+
+void map_agg_reset(struct map_agg_s *agg)
+{
+    HASH_CLEAR(hh, agg->head);
+    agg->num = 0;
+}
@@ -0,0 +1,152 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2023. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: merge and export the latency histograms of sli probes
+ ******************************************************************************/
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#ifdef BPF_PROG_KERN
+#undef BPF_PROG_KERN
+#endif
+
+#ifdef BPF_PROG_USER
+#undef BPF_PROG_USER
+#endif
+
+#include "bpf.h"
+#include "sli_histo.h"
+
+struct sli_histo_drain_s {
+    int cpus;
+    sli_histo_fn fn;
+    void *ctx;
+    struct sli_histo_s merged;
+};
+
+struct map_batch_s *sli_histo_batch_new(int map_fd)
+{
+    int cpus = libbpf_num_possible_cpus();
+
+    if (cpus <= 0) {
+        return NULL;
+    }
+    // Values of per-CPU map are 8 bytes aligned for each CPU, sli_histo_s is aligned already.
+    return map_batch_new(map_fd, sizeof(struct sli_histo_key_s), sizeof(struct sli_histo_s) * cpus);
+}
+
+/* Sum up the histograms of all CPUs, the value of a per-CPU map */
+void sli_histo_merge(struct sli_histo_s *merged, const struct sli_histo_s *percpu, int cpus)
+{
+    (void)memset(merged, 0, sizeof(struct sli_histo_s));
+    for (int cpu = 0; cpu < cpus; cpu++) {
+        merged->count += percpu[cpu].count;
+        merged->sum += percpu[cpu].sum;
+        merged->max = max(merged->max, percpu[cpu].max);
+        for (int i = 0; i < SLI_HISTO_BUCKETS; i++) {
+            merged->buckets[i] += percpu[cpu].buckets[i];
+        }
+    }
+}
+
+static int __merge_histo(const void *key, const void *value, void *ctx)
+{
+    struct sli_histo_drain_s *drain = (struct sli_histo_drain_s *)ctx;
+    struct sli_histo_s *merged = &drain->merged;
+
+    sli_histo_merge(merged, (const struct sli_histo_s *)value, drain->cpus);
+    if (merged->count > 0) {
+        drain->fn((const struct sli_histo_key_s *)key, merged, drain->ctx);
+    }
+    return MAP_BATCH_DEL;
+}
+
+/* Merge and hand over the histograms of the period, then clear them in kernel. */
+int sli_histo_drain(struct map_batch_s *batch, sli_histo_fn fn, void *ctx)
+{
+    static struct sli_histo_drain_s drain;
+
+    drain.cpus = libbpf_num_possible_cpus();
+    if (drain.cpus <= 0 || batch == NULL) {
+        return -1;
+    }
+    drain.fn = fn;
+    drain.ctx = ctx;
+    return map_batch_drain(batch, __merge_histo, &drain);
+}
+
+static __u64 __bucket_low(__u32 idx)
+{
+    __u32 group, sub;
+
+    if (idx < SLI_HISTO_SUB_NUM) {
+        return idx;
+    }
+    group = idx / SLI_HISTO_SUB_NUM;
+    sub = idx % SLI_HISTO_SUB_NUM;
+    return (__u64)(SLI_HISTO_SUB_NUM + sub) << (group - 1);
+}
+
+static __u64 __bucket_width(__u32 idx)
+{
+    return (idx < SLI_HISTO_SUB_NUM) ? 1 : (1ULL << (idx / SLI_HISTO_SUB_NUM - 1));
+}
+
+/* Middle of the bucket holding the q-quantile, unit ns. Never above the max recorded. */
+__u64 sli_histo_quantile(const struct sli_histo_s *histo, double q)
+{
+    __u64 rank, seen = 0, nsec;
+
+    if (histo->count == 0) {
+        return 0;
+    }
+    rank = (__u64)(q * (double)histo->count);
+    if (rank >= histo->count) {
+        rank = histo->count - 1;
+    }
+
+    for (__u32 i = 0; i < SLI_HISTO_BUCKETS; i++) {
+        seen += histo->buckets[i];
+        if (seen > rank) {
+            nsec = (__bucket_low(i) << SLI_HISTO_UNIT_SHIFT) + ((__bucket_width(i) << SLI_HISTO_UNIT_SHIFT) >> 1);
+            return min(nsec, histo->max);
+        }
+    }
+    return histo->max;
+}
+
+void sli_histo_output(const char *tbl, const char *app, const struct sli_histo_key_s *key,
+    const struct sli_histo_s *histo)
+{
+    unsigned char ser_ip_str[INET6_ADDRSTRLEN];
+    char command[SLI_CMD_CLASS_LEN + 1];
+
+    ip_str(key->family, (unsigned char *)key->server_ip, ser_ip_str, INET6_ADDRSTRLEN);
+    (void)memcpy(command, key->command, SLI_CMD_CLASS_LEN);
+    command[SLI_CMD_CLASS_LEN] = 0;
+
+    (void)fprintf(stdout, SLI_HISTO_TBL_FMT,
+        tbl,
+        key->tgid,
+        app,
+        command,
+        ser_ip_str,
+        key->server_port,
+        histo->count,
+        histo->sum,
+        sli_histo_quantile(histo, 0.5),
+        sli_histo_quantile(histo, 0.9),
+        sli_histo_quantile(histo, 0.99),
+        sli_histo_quantile(histo, 0.999));
+    (void)fflush(stdout);
+}
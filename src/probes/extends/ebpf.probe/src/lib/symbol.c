@@ -32,6 +32,7 @@
 #include "elf_symb.h"
 #include "container.h"
 #include "symbol.h"
+#include "symb_cache.h"
 #include "java_support.h"
 
 #ifdef symbs
@@ -323,6 +324,7 @@ static void proc_symbs_destroy(struct proc_symbs_s *proc_symbs)
             proc_symbs->mods[i] = NULL;
         }
     }
+    symb_cache_free(&proc_symbs->cache);
     return;
 }
 #endif
@@ -581,7 +583,7 @@ static int get_mod_elf_so_offset(struct mod_s* mod)
         return 0;
     }
 
-    if (gopher_get_elf_text_section((const char *)mod->mod_path,
+    if (get_elf_symb_text_section(mod->mod_symbs, (const char *)mod->mod_path,
         &mod->mod_elf_so_addr, &mod->mod_elf_so_offset)) {
         ERROR("[SYMBOL]: Get elf offset failed(%s).\n", mod->mod_path);
         return GET_ELF_OFFSET;
@@ -991,6 +993,7 @@ struct proc_symbs_s* proc_load_all_symbs(void *elf_reader, int proc_id)
     }
     (void)memset(proc_symbs, 0, sizeof(struct proc_symbs_s));
     __get_proc_info(proc_symbs, proc_id);
+    proc_symbs->cache = symb_cache_new(PROC_SYMB_CACHE_BITS);    // Runs without cache if failed
 
     maps_file[0] = 0;
     (void)snprintf(maps_file, PATH_LEN, "/proc/%d/maps", proc_id);
@@ -1034,7 +1037,7 @@ void proc_delete_all_symbs(struct proc_symbs_s *proc_symbs)
     return;
 }
 
-int proc_search_addr_symb(struct proc_symbs_s *proc_symbs,
+static int __proc_search_addr_symb(struct proc_symbs_s *proc_symbs,
         u64 addr, struct addr_symb_s *addr_symb, char *comm)
 {
     int ret = -1, is_contain_range = 0;
@@ -1085,4 +1088,32 @@ int proc_search_addr_symb(struct proc_symbs_s *proc_symbs,
 
     return ret;
 }
+
+/*
+ * The module of a symbol is the 'comm' of caller except for JVM, the cache keeps NULL for it
+ * and fills in 'comm' of each caller on hit.
+ */
+int proc_search_addr_symb(struct proc_symbs_s *proc_symbs,
+        u64 addr, struct addr_symb_s *addr_symb, char *comm)
+{
+    struct addr_symb_s cached;
+    int ret;
+
+    if (proc_symbs->cache && symb_cache_lookup(proc_symbs->cache, addr, addr_symb, &ret)) {
+        if (ret == 0 && addr_symb->mod == NULL) {
+            addr_symb->mod = comm;
+        }
+        return ret;
+    }
+
+    ret = __proc_search_addr_symb(proc_symbs, addr, addr_symb, comm);
+    if (proc_symbs->cache) {
+        cached = *addr_symb;
+        if (cached.mod == comm) {
+            cached.mod = NULL;
+        }
+        symb_cache_update(proc_symbs->cache, addr, &cached, ret);
+    }
+    return ret;
+}
 #endif
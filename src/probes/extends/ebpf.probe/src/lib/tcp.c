@@ -16,196 +16,624 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include <dirent.h>
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
 #include "bpf.h"
+#include "hash.h"
 #include "tcp.h"
 
 /*
-127.0.0.1:38338users:(("lubanagent",pid=1709,fd=4))
-0.0.0.0:30467users:(("kube-proxy",pid=1528,fd=18))
-0.0.0.0:31075users:(("kube-proxy",pid=1528,fd=17))
-127.0.0.1:38339users:(("lubanagent",pid=1710,fd=4))
-127.0.0.1:10248users:(("kubelet",pid=1954,fd=24))
-0.0.0.0:32136users:(("kube-proxy",pid=1528,fd=21))
-*:10250users:(("kubelet",pid=1954,fd=25))
-[::]:111users:(("rpcbind",pid=1493,fd=9))
-*:10256users:(("kube-proxy",pid=1528,fd=13))
-[::]:22users:(("sshd",pid=1952,fd=4))
-*/
-#define SS_LISTEN_PORTS_COMMAND "ss -anptl | awk '{if (NR >1) print $4 $6}'"
+ * Established and listening tcp sockets are dumped in-process through NETLINK_SOCK_DIAG
+ * (inet_diag) from the current netns. The owner (pid, fd, comm) of each socket is
+ * resolved through a socket inode index built from /proc/<pid>/fd. Socket inodes are
+ * unique across netns, so one index serves all netns (containers) of a lookup round.
+ * Only the sockets of the latest dump of each state(listening or established) are indexed, and the
+ * index of a state is rebuilt when one of them is missed, so it never holds more than the tcp sockets
+ * of the dumps. A socket nobody owns
+ * (e.g. of a kernel service) is indexed without owners, so it does not rebuild it again.
+ * Each process keeps the socket fds found at its last scan, a rebuild only reads the link
+ * of the fds which are new or whose socket is no longer in the dump(the fd may be reused).
+ */
+#define TCP_ESTABLISHED_STATE   1
+#define TCP_LISTEN_STATE        10
+#define SOCK_DIAG_BUF_SIZE      (32 * 1024)
+#define SOCK_DIAG_ENTS_INIT     256
+#define SOCK_INDEX_OWNER_MAX    TCP_ESTAB_COMM_MAX
+#define SOCK_INDEX_FDS_INIT     16
+
+struct sock_owner {
+    unsigned int pid;
+    unsigned int fd;
+};
+
+struct sock_index_s {
+    H_HANDLE;
+    unsigned long ino;                  // key
+    unsigned int states;                // of the dump the socket is in
+    int owner_num;
+    struct sock_owner owners[SOCK_INDEX_OWNER_MAX];
+};
+
+struct sock_index_fd_s {
+    unsigned int fd;
+    unsigned long ino;
+};
+
+struct sock_index_fds_s {
+    int num;
+    int capacity;
+    struct sock_index_fd_s *fds;        // sorted by fd
+};
+
+struct sock_index_pid_s {
+    H_HANDLE;
+    unsigned int pid;                   // key
+    char seen;                          // process still exists at the latest /proc walk
+    char comm_loaded;
+    char comm[TASK_COMM_LEN];
+    struct sock_index_fds_s sock_fds;   // socket fds found at the latest scan
+};
+
+struct sock_diag_ent {
+    unsigned long ino;
+    int family;
+    unsigned char src[IP6_LEN];
+    unsigned char dst[IP6_LEN];
+    unsigned short sport;
+    unsigned short dport;
+};
+
+typedef int (*sock_diag_cb)(const struct sock_diag_ent *ent, void *ctx);
+
+struct sock_diag_ents {
+    struct sock_diag_ent *ents;
+    int num;
+    int capacity;
+    unsigned long *inos;                // sorted inodes of ents, the sockets to index
+    unsigned int states;
+};
+
+struct sock_diag_ctx {
+    char index_refreshed;
+    const struct sock_diag_ents *diag_ents;
+    void *tbl;
+};
+
+static struct sock_index_s *g_sock_index = NULL;
+static struct sock_index_pid_s *g_sock_index_pids = NULL;
+
+static int __read_link_sock_ino(const char *path, unsigned long *ino)
+{
+    char link[PATH_LEN];
+    ssize_t len;
 
-/*
-7.183.6.160:49552|10.32.0.1:443@users:(("kube-rbac-proxy",pid=8302,fd=8))
-7.183.6.160:57239|10.243.116.55:179@users:(("bird",pid=8769,fd=21))
-7.183.6.160:35605|10.247.120.26:179@users:(("bird",pid=8769,fd=10))
-7.183.6.160:22|10.136.115.208:56802@users:(("sshd",pid=1264958,fd=3),("sshd",pid=1264945,fd=3))
-[::ffff:7.183.6.160]:10250|[::ffff:10.28.19.57]:35859@users:(("kubelet",pid=1954,fd=32))
-[::ffff:7.183.6.160]:10250|[::ffff:10.28.18.95]:51694@users:(("kubelet",pid=1954,fd=33))
-*/
-#define SS_ESTAB_COMMAND "ss -anpt | grep ESTAB |  awk '{print $4 \"|\" $5 \"@\" $6}'"
+    len = readlink(path, link, PATH_LEN - 1);
+    if (len <= 0) {
+        return -1;
+    }
+    link[len] = 0;
+    if (sscanf(link, "socket:[%lu]", ino) != 1) {
+        return -1;
+    }
+    return 0;
+}
 
-#define PORT_LEN 11
-#define PID_LEN 32
-#define FID_LEN 32
+static char __is_sock_owner_valid(unsigned long ino, const struct sock_owner *owner)
+{
+    char path[PATH_LEN];
+    unsigned long cur_ino;
 
+    path[0] = 0;
+    (void)snprintf(path, PATH_LEN, "/proc/%u/fd/%u", owner->pid, owner->fd);
+    if (__read_link_sock_ino(path, &cur_ino) < 0) {
+        return 0;
+    }
+    return (cur_ino == ino);
+}
 
-static char __is_digit_str(const char *s)
+static struct sock_index_s *__sock_index_get_item(unsigned long ino, unsigned int states)
 {
-    int len = (int)strlen(s);
-    for (int i = 0; i < len; i++) {
-        if (!(isdigit(s[i])))
-            return 0;
+    struct sock_index_s *item = NULL;
+
+    H_FIND(g_sock_index, &ino, sizeof(unsigned long), item);
+    if (item != NULL) {
+        return item;
+    }
+
+    item = (struct sock_index_s *)malloc(sizeof(struct sock_index_s));
+    if (item == NULL) {
+        return NULL;
     }
-    return 1;
+    (void)memset(item, 0, sizeof(struct sock_index_s));
+    item->ino = ino;
+    item->states = states;
+    H_ADD(g_sock_index, ino, sizeof(unsigned long), item);
+    return item;
 }
 
-static int __get_next_str_offset(const char *s, const char* target)
+static void __sock_index_add(unsigned long ino, unsigned int states, unsigned int pid, unsigned int fd)
 {
-    char *p;
+    struct sock_index_s *item = __sock_index_get_item(ino, states);
 
-    p = strstr(s, target);
-    if ((p != NULL) && (p > s))
-        return p - s;
+    if (item == NULL) {
+        return;
+    }
 
-    return -1;
+    for (int i = 0; i < item->owner_num; i++) {
+        if (item->owners[i].pid == pid && item->owners[i].fd == fd) {
+            return;
+        }
+    }
+    if (item->owner_num >= SOCK_INDEX_OWNER_MAX) {
+        return;
+    }
+    item->owners[item->owner_num].pid = pid;
+    item->owners[item->owner_num].fd = fd;
+    item->owner_num++;
 }
 
-static int __get_sub_str(const char *s, const char* start, const char *end,
-                                 char* sub_str_buf, unsigned int buf_len)
+static int __cmp_ino(const void *a, const void *b)
 {
-    const char *p2, *p1;
-    int len;
+    unsigned long ino_a = *(const unsigned long *)a;
+    unsigned long ino_b = *(const unsigned long *)b;
 
-    if (s == NULL)
-        return -1;
+    return (ino_a > ino_b) - (ino_a < ino_b);
+}
 
-    // Point to end, if no terminator is specified
-    if (end == NULL) {
-        p2 = s + strlen(s);
-    } else {
-        p2 = strstr(s, end);
-        if (p2 == NULL)
-            return -1;
+static char __is_ino_wanted(const struct sock_diag_ents *diag_ents, unsigned long ino)
+{
+    return bsearch(&ino, diag_ents->inos, diag_ents->num, sizeof(unsigned long), __cmp_ino) != NULL;
+}
+
+// The sockets of other states are left, the listening and established ones are dumped in turn
+static void __sock_index_clear(unsigned int states)
+{
+    struct sock_index_s *item, *tmp;
+
+    H_ITER(g_sock_index, item, tmp) {
+        if (item->states & states) {
+            H_DEL(g_sock_index, item);
+            (void)free(item);
+        }
     }
+}
 
-    // Point to start, if no start character is specified
-    if (start == NULL) {
-        p1 = s;
-    } else {
-        p1 = strstr(s, start);
-        if (p1 == NULL)
+static int __cmp_sock_fd(const void *a, const void *b)
+{
+    unsigned int fd_a = ((const struct sock_index_fd_s *)a)->fd;
+    unsigned int fd_b = ((const struct sock_index_fd_s *)b)->fd;
+
+    return (fd_a > fd_b) - (fd_a < fd_b);
+}
+
+static int __sock_fds_append(struct sock_index_fds_s *sock_fds, unsigned int fd, unsigned long ino)
+{
+    struct sock_index_fd_s *new_fds;
+    int new_capacity;
+
+    if (sock_fds->num >= sock_fds->capacity) {
+        new_capacity = (sock_fds->capacity == 0) ? SOCK_INDEX_FDS_INIT : sock_fds->capacity * 2;
+        new_fds = (struct sock_index_fd_s *)realloc(sock_fds->fds, new_capacity * sizeof(struct sock_index_fd_s));
+        if (new_fds == NULL) {
             return -1;
+        }
+        sock_fds->fds = new_fds;
+        sock_fds->capacity = new_capacity;
+    }
+    sock_fds->fds[sock_fds->num].fd = fd;
+    sock_fds->fds[sock_fds->num].ino = ino;
+    sock_fds->num++;
+    return 0;
+}
+
+/*
+ * An fd found with a socket still in the dump is not read again: it could only have been reused if the
+ * socket was shared and closed by this process alone. Other fds are read, new sockets are there.
+ */
+static int __sock_fd_ino(const struct sock_index_pid_s *proc, const struct sock_diag_ents *diag_ents,
+    const char *fd_name, unsigned long *ino)
+{
+    char path[PATH_LEN];
+    struct sock_index_fd_s key = {.fd = (unsigned int)atoi(fd_name)};
+    const struct sock_index_fd_s *cached = NULL;
 
-        p1 += strlen(start);
+    if (proc->sock_fds.num > 0) {
+        cached = bsearch(&key, proc->sock_fds.fds, proc->sock_fds.num, sizeof(struct sock_index_fd_s),
+            __cmp_sock_fd);
+    }
+    if (cached != NULL && __is_ino_wanted(diag_ents, cached->ino)) {
+        *ino = cached->ino;
+        return 0;
     }
 
-    len = p2 - p1;
-    if ((len <= 0) || (len >= buf_len))
-        return -1;
+    path[0] = 0;
+    (void)snprintf(path, PATH_LEN, "/proc/%u/fd/%s", proc->pid, fd_name);
+    return __read_link_sock_ino(path, ino);
+}
 
-    (void)memcpy(sub_str_buf, p1, len);
-    sub_str_buf[len] = 0;
-    return 0;
+static void __sock_index_scan_proc(struct sock_index_pid_s *proc, const struct sock_diag_ents *diag_ents)
+{
+    DIR *dir;
+    struct dirent *entry;
+    char path[PATH_LEN];
+    unsigned long ino;
+    unsigned int fd;
+    struct sock_index_fds_s sock_fds = {0};
+
+    path[0] = 0;
+    (void)snprintf(path, PATH_LEN, "/proc/%u/fd", proc->pid);
+    dir = opendir(path);
+    if (dir == NULL) {
+        return;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        if (__sock_fd_ino(proc, diag_ents, entry->d_name, &ino) < 0) {
+            continue;
+        }
+        // sockets of other netns or protocols are kept too, their fds are read again anyway
+        fd = (unsigned int)atoi(entry->d_name);
+        (void)__sock_fds_append(&sock_fds, fd, ino);
+        if (__is_ino_wanted(diag_ents, ino)) {
+            __sock_index_add(ino, diag_ents->states, proc->pid, fd);
+        }
+    }
+    (void)closedir(dir);
+
+    if (sock_fds.num > 1) {
+        qsort(sock_fds.fds, sock_fds.num, sizeof(struct sock_index_fd_s), __cmp_sock_fd);
+    }
+    (void)free(proc->sock_fds.fds);
+    proc->sock_fds = sock_fds;
 }
 
-static int __erase_square_brackets(const char* s, char *buf, unsigned int buf_len)
+static struct sock_index_pid_s *__sock_index_get_proc(unsigned int pid)
 {
-    char *p1, *p2;
-    int len;
-    char tmp[LINE_BUF_LEN];
+    struct sock_index_pid_s *proc = NULL;
 
-    p1 = strchr(s, '[');
-    p2 = strchr(s, ']');
-    if ((p1 == NULL) || (p2 == NULL))
-        return -1;
+    H_FIND(g_sock_index_pids, &pid, sizeof(unsigned int), proc);
+    if (proc != NULL) {
+        return proc;
+    }
 
-    if (p2 <= p1)
-        return -1;
+    proc = (struct sock_index_pid_s *)malloc(sizeof(struct sock_index_pid_s));
+    if (proc == NULL) {
+        return NULL;
+    }
+    (void)memset(proc, 0, sizeof(struct sock_index_pid_s));
+    proc->pid = pid;
+    H_ADD(g_sock_index_pids, pid, sizeof(unsigned int), proc);
+    return proc;
+}
 
-    if (__get_sub_str(s, "[", "]", tmp, LINE_BUF_LEN) < 0)
-        return -1;
+/*
+ * Rebuild the index from the socket fds of all processes, the sockets not in the dump are skipped.
+ * The sockets of the dump without any owner are indexed too.
+ */
+static void __sock_index_refresh(const struct sock_diag_ents *diag_ents)
+{
+    DIR *dir;
+    struct dirent *entry;
+    struct sock_index_pid_s *proc, *tmp;
 
-    len = (int)strlen(tmp);
-    if (len >= buf_len)
-        return -1;
+    dir = opendir("/proc");
+    if (dir == NULL) {
+        return;
+    }
 
-    (void)memcpy(buf, tmp, len);
-    buf[len] = 0;
-    return 0;
+    __sock_index_clear(diag_ents->states);
+
+    H_ITER(g_sock_index_pids, proc, tmp) {
+        proc->seen = 0;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (!isdigit(entry->d_name[0])) {
+            continue;
+        }
+        proc = __sock_index_get_proc((unsigned int)atoi(entry->d_name));
+        if (proc == NULL) {
+            continue;
+        }
+        proc->seen = 1;
+        __sock_index_scan_proc(proc, diag_ents);
+    }
+    (void)closedir(dir);
+
+    H_ITER(g_sock_index_pids, proc, tmp) {
+        if (!proc->seen) {
+            H_DEL(g_sock_index_pids, proc);
+            (void)free(proc->sock_fds.fds);
+            (void)free(proc);
+        }
+    }
+
+    for (int i = 0; i < diag_ents->num; i++) {
+        (void)__sock_index_get_item(diag_ents->inos[i], diag_ents->states);
+    }
 }
 
 /*
-input : [::ffff:7.183.6.160]:10250
-7.183.6.160:57239
-*/
-static int __get_estab_addr(const char *s, struct ip_addr* ip_addr,
-               const char *addr_buf)
+ * Drop the owners which closed the socket(or exited) since they were indexed. A socket of one owner
+ * still in the dump is still held by it, only the owners of a shared one(e.g. a listening socket
+ * inherited by workers) are checked.
+ */
+static struct sock_index_s *__sock_index_lkup(unsigned long ino)
 {
-    char *p;
-    int local_len, port_len, ip_len;
-    char port_str[PORT_LEN];
+    struct sock_index_s *item = NULL;
+    int i = 0;
 
-    p = strrchr(addr_buf, ':');
-    if (p == NULL)
-        goto err;
+    H_FIND(g_sock_index, &ino, sizeof(unsigned long), item);
+    if (item == NULL || item->owner_num <= 1) {
+        return item;
+    }
 
-    local_len = (int)strlen(addr_buf);
-    ip_len = p - addr_buf;
-    if ((ip_len >= local_len) || (ip_len <= 0))
-        goto err;
+    while (i < item->owner_num) {
+        if (__is_sock_owner_valid(ino, &item->owners[i])) {
+            i++;
+            continue;
+        }
+        item->owners[i] = item->owners[item->owner_num - 1];
+        item->owner_num--;
+    }
 
-    (void)memcpy(ip_addr->ip, addr_buf, ip_len);
-    ip_addr->ip[ip_len] = 0;
+    if (item->owner_num == 0) {
+        H_DEL(g_sock_index, item);
+        (void)free(item);
+        return NULL;
+    }
+    return item;
+}
 
-    if (__erase_square_brackets((const char*)ip_addr->ip, ip_addr->ip, IP_STR_LEN) == 0) {
-        ip_addr->ipv4 = 0;
+static struct sock_index_s *__sock_index_get(unsigned long ino, const struct sock_diag_ents *diag_ents,
+    char *refreshed)
+{
+    struct sock_index_s *item;
+
+    item = __sock_index_lkup(ino);
+    if (item == NULL && !(*refreshed)) {
+        /* Index miss, e.g. a socket opened since the last walk, walk /proc at most once for one dump */
+        __sock_index_refresh(diag_ents);
+        *refreshed = 1;
+        item = __sock_index_lkup(ino);
+    }
+    return (item != NULL && item->owner_num > 0) ? item : NULL;
+}
+
+static void __read_proc_comm(unsigned int pid, char comm[], unsigned int size)
+{
+    FILE *f;
+    char path[PATH_LEN];
+
+    comm[0] = 0;
+    path[0] = 0;
+    (void)snprintf(path, PATH_LEN, "/proc/%u/comm", pid);
+    f = fopen(path, "r");
+    if (f == NULL) {
+        return;
+    }
+    if (fgets(comm, size, f) == NULL) {
+        comm[0] = 0;
+    }
+    SPLIT_NEWLINE_SYMBOL(comm);
+    (void)fclose(f);
+}
+
+/* comm is only read for the processes which really own a reported socket */
+static const char *__sock_index_comm(unsigned int pid)
+{
+    struct sock_index_pid_s *proc = NULL;
+
+    H_FIND(g_sock_index_pids, &pid, sizeof(unsigned int), proc);
+    if (proc == NULL) {
+        return "";
+    }
+    if (!proc->comm_loaded) {
+        __read_proc_comm(pid, proc->comm, TASK_COMM_LEN);
+        proc->comm_loaded = 1;
+    }
+    return proc->comm;
+}
+
+static int __sock_diag_send(int nl_fd, unsigned char family, unsigned int states)
+{
+    struct sockaddr_nl nladdr = {.nl_family = AF_NETLINK};
+    struct {
+        struct nlmsghdr nlh;
+        struct inet_diag_req_v2 req;
+    } msg;
+
+    (void)memset(&msg, 0, sizeof(msg));
+    msg.nlh.nlmsg_len = sizeof(msg);
+    msg.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    msg.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    msg.req.sdiag_family = family;
+    msg.req.sdiag_protocol = IPPROTO_TCP;
+    msg.req.idiag_states = states;
+
+    if (sendto(nl_fd, &msg, sizeof(msg), 0, (struct sockaddr *)&nladdr, sizeof(nladdr)) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static void __sock_diag_parse(const struct inet_diag_msg *diag_msg, struct sock_diag_ent *ent)
+{
+    (void)memset(ent, 0, sizeof(struct sock_diag_ent));
+    ent->ino = diag_msg->idiag_inode;
+    ent->family = diag_msg->idiag_family;
+    ent->sport = ntohs(diag_msg->id.idiag_sport);
+    ent->dport = ntohs(diag_msg->id.idiag_dport);
+    if (ent->family == AF_INET) {
+        (void)memcpy(ent->src, diag_msg->id.idiag_src, IP_LEN);
+        (void)memcpy(ent->dst, diag_msg->id.idiag_dst, IP_LEN);
     } else {
-        ip_addr->ipv4 = 1;
+        (void)memcpy(ent->src, diag_msg->id.idiag_src, IP6_LEN);
+        (void)memcpy(ent->dst, diag_msg->id.idiag_dst, IP6_LEN);
+    }
+}
+
+static int __sock_diag_recv(int nl_fd, sock_diag_cb cb, void *ctx)
+{
+    char *buf;
+    ssize_t len;
+    struct nlmsghdr *nlh;
+    struct sock_diag_ent ent;
+    int ret = -1;
+
+    buf = (char *)malloc(SOCK_DIAG_BUF_SIZE);
+    if (buf == NULL) {
+        return -1;
+    }
+
+    while (1) {
+        len = recv(nl_fd, buf, SOCK_DIAG_BUF_SIZE, 0);
+        if (len <= 0) {
+            goto out;
+        }
+
+        for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len); nlh = NLMSG_NEXT(nlh, len)) {
+            if (nlh->nlmsg_type == NLMSG_DONE) {
+                ret = 0;
+                goto out;
+            }
+            if (nlh->nlmsg_type == NLMSG_ERROR) {
+                goto out;
+            }
+            if (nlh->nlmsg_type != SOCK_DIAG_BY_FAMILY) {
+                continue;
+            }
+            __sock_diag_parse((const struct inet_diag_msg *)NLMSG_DATA(nlh), &ent);
+            if (ent.ino == 0) {
+                continue;   // orphan or time-wait socket, no owner
+            }
+            (void)cb((const struct sock_diag_ent *)&ent, ctx);
+        }
     }
 
-    port_len = local_len - ip_len - 1;
-    if ((port_len <= 0) || (port_len >= PORT_LEN))
-        goto err;
+out:
+    (void)free(buf);
+    return ret;
+}
 
-    (void)memcpy(port_str, p + 1, port_len);
-    port_str[port_len] = 0;
-    if (__is_digit_str((const char *)port_str) == 0)
-        goto err;
+/* Dump tcp sockets of the current netns matching the 'states' bitmap, for both AF_INET and AF_INET6 */
+static int __sock_diag_dump(unsigned int states, sock_diag_cb cb, void *ctx)
+{
+    int nl_fd;
+    int ret = 0;
+    const unsigned char families[] = {AF_INET, AF_INET6};
+
+    nl_fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+    if (nl_fd < 0) {
+        ERROR("[TCP] Create sock diag netlink failed.\n");
+        return -1;
+    }
 
-    ip_addr->port = (unsigned int)atoi(port_str);
+    for (size_t i = 0; i < sizeof(families) / sizeof(families[0]); i++) {
+        if (__sock_diag_send(nl_fd, families[i], states) < 0 || __sock_diag_recv(nl_fd, cb, ctx) < 0) {
+            ERROR("[TCP] Dump tcp sockets by sock diag failed(family = %u).\n", families[i]);
+            ret = -1;
+            break;
+        }
+    }
+
+    (void)close(nl_fd);
+    return ret;
+}
+
+static int __sock_diag_collect(const struct sock_diag_ent *ent, void *ctx)
+{
+    struct sock_diag_ents *diag_ents = ctx;
+    struct sock_diag_ent *new_ents;
+    int new_capacity;
+
+    if (diag_ents->num >= diag_ents->capacity) {
+        new_capacity = (diag_ents->capacity == 0) ? SOCK_DIAG_ENTS_INIT : diag_ents->capacity * 2;
+        new_ents = (struct sock_diag_ent *)realloc(diag_ents->ents, new_capacity * sizeof(struct sock_diag_ent));
+        if (new_ents == NULL) {
+            return -1;
+        }
+        diag_ents->ents = new_ents;
+        diag_ents->capacity = new_capacity;
+    }
+    diag_ents->ents[diag_ents->num++] = *ent;
     return 0;
-err:
-    return -1;
 }
 
-static struct tcp_estab_comm* __get_estab_comm(const char *start, unsigned int len)
+static void __free_sock_diag_ents(struct sock_diag_ents *diag_ents)
 {
-    /* ("sshd",pid=1264958,fd=3) */
+    (void)free(diag_ents->ents);
+    (void)free(diag_ents->inos);
+    (void)memset(diag_ents, 0, sizeof(struct sock_diag_ents));
+}
+
+/*
+ * Dump the sockets first and resolve their owners after, so the index only takes the inodes
+ * of the sockets dumped.
+ */
+static int __sock_diag_resolve(unsigned int states, sock_diag_cb cb, void *tbl)
+{
+    struct sock_diag_ents diag_ents = {.states = states};
+    struct sock_diag_ctx ctx = {.index_refreshed = 0, .diag_ents = &diag_ents, .tbl = tbl};
     int ret;
-    char comm[TASK_COMM_LEN];
-    char pid_s[PID_LEN];
-    char fd_s[FID_LEN];
-    char tmp[LINE_BUF_LEN];
-    const char *s = tmp;
-    struct tcp_estab_comm *te_comm;
 
-    if ((start == NULL) || (len >= LINE_BUF_LEN))
-        return NULL;
+    ret = __sock_diag_dump(states, __sock_diag_collect, &diag_ents);
+    if (ret < 0 || diag_ents.num == 0) {
+        __free_sock_diag_ents(&diag_ents);
+        return ret;
+    }
 
-    (void)memcpy(tmp, start, len);
-    tmp[len] = 0;
+    diag_ents.inos = (unsigned long *)malloc(diag_ents.num * sizeof(unsigned long));
+    if (diag_ents.inos == NULL) {
+        __free_sock_diag_ents(&diag_ents);
+        return -1;
+    }
+    for (int i = 0; i < diag_ents.num; i++) {
+        diag_ents.inos[i] = diag_ents.ents[i].ino;
+    }
+    qsort(diag_ents.inos, diag_ents.num, sizeof(unsigned long), __cmp_ino);
 
-    ret = __get_sub_str(s, "(\"", "\",", comm, TASK_COMM_LEN);
-    ret |= __get_sub_str(s, "pid=", ",fd", pid_s, PID_LEN);
-    ret |= __get_sub_str(s, ",fd=", ")", fd_s, FID_LEN);
-    if (ret < 0 || !__is_digit_str((const char *)pid_s)
-           || !__is_digit_str((const char *)fd_s))
-        return NULL;
+    for (int i = 0; i < diag_ents.num; i++) {
+        (void)cb((const struct sock_diag_ent *)&diag_ents.ents[i], &ctx);
+    }
+    __free_sock_diag_ents(&diag_ents);
+    return 0;
+}
+
+/*
+ * Same form as ss prints: "7.183.6.160", or "::ffff:7.183.6.160" for v4-mapped address.
+ */
+static void __get_estab_addr(const struct sock_diag_ent *ent, const unsigned char *ip, unsigned short port,
+                             struct ip_addr* ip_addr)
+{
+    ip_addr->ip[0] = 0;
+    ip_addr->port = port;
+    if (ent->family == AF_INET) {
+        ip_addr->ipv4 = 1;
+        (void)inet_ntop(AF_INET, ip, ip_addr->ip, IP_STR_LEN);
+    } else {
+        ip_addr->ipv4 = 0;
+        (void)inet_ntop(AF_INET6, ip, ip_addr->ip, IP_STR_LEN);
+    }
+}
+
+static struct tcp_estab_comm* __get_estab_comm(const struct sock_owner *owner)
+{
+    struct tcp_estab_comm *te_comm;
 
     te_comm = (struct tcp_estab_comm *)malloc(sizeof(struct tcp_estab_comm));
+    if (te_comm == NULL)
+        return NULL;
+
     te_comm->comm[0] = 0;
-    (void)strcpy(te_comm->comm, comm);
-    te_comm->pid = (unsigned int)atoi(pid_s);
-    te_comm->fd = (unsigned int)atoi(fd_s);
+    (void)snprintf(te_comm->comm, TASK_COMM_LEN, "%s", __sock_index_comm(owner->pid));
+    te_comm->pid = owner->pid;
+    te_comm->fd = owner->fd;
     return te_comm;
 }
 
@@ -284,221 +712,63 @@ static void __free_estabs(struct tcp_estabs** ptes)
 }
 
 
-/*
-    input : 7.183.6.160:22|10.136.115.208:56802@users:(("sshd",pid=1264958,fd=3),("sshd",pid=1264945,fd=3))
-*/
-static int __get_estab(const char *s, struct tcp_estab* te)
+static int __get_estab(const struct sock_diag_ent *ent, void *ctx)
 {
-    int ret;
-    int offset;
-    char *start, *end;
-    char addr_str[IP_STR_LEN];
-    char comms_str[LINE_BUF_LEN];
+    struct sock_diag_ctx *diag_ctx = ctx;
+    struct tcp_estabs* tes = diag_ctx->tbl;
+    struct sock_index_s *owners;
     struct tcp_estab_comm *te_comm;
-
-    // get establish tcp local address and port
-    addr_str[0] = 0;
-    ret = __get_sub_str(s, NULL, "|", addr_str, IP_STR_LEN);
-    ret |= __get_estab_addr(s, &(te->local), addr_str);
-    if (ret < 0)
-        goto err;
-
-    // get establish tcp remote address and port
-    addr_str[0] = 0;
-    ret = __get_sub_str(s, "|", "@", addr_str, IP_STR_LEN);
-    ret |= __get_estab_addr(s, &(te->remote), addr_str);
-    if (ret < 0)
-        goto err;
-
-    // get all comm, pid, fd of establish tcp
-    ret = __get_sub_str(s, "@users:(", NULL, comms_str, LINE_BUF_LEN);
-    if (ret < 0)
-        goto err;
-
-    comms_str[strlen(comms_str) - 1] = 0; // Delete last character ')'
-
-    // one by one
-    start = comms_str;
-    end = start + strlen(comms_str);
-    do {
-        if (start >= end)
-            break;
-
-        offset = __get_next_str_offset((const char *)start, ",(");
-        if (offset < 0)
-            break;
-
-        // get one comm, pid, fd of establish tcp
-        te_comm = __get_estab_comm((const char*)start, offset);
-        if (te_comm != NULL) {
-            if (__add_estab_comm(te, te_comm) < 0)
-               (void)free(te_comm);
-        }
-        start += offset + 1;
-    } while (1);
-
-    // get last(or only one) comm, pid, fd of establish tcp
-    te_comm = __get_estab_comm((const char*)start, strlen(start));
-    if (te_comm != NULL) {
-        if (__add_estab_comm(te, te_comm) < 0)
-            (void)free(te_comm);
-    }
-
-    return 0;
-err:
-    return -1;
-}
-
-
-static int __get_estabs(struct tcp_estabs* tes)
-{
-    char line[LINE_BUF_LEN];
-    FILE *f;
-    const char *command = SS_ESTAB_COMMAND;
     struct tcp_estab* te;
-    int ret;
 
-    f = popen(command, "r");
-    if (f == NULL)
+    // sockets without any owner process are not reported, the same as 'ss -p | grep users'
+    owners = __sock_index_get(ent->ino, diag_ctx->diag_ents, &diag_ctx->index_refreshed);
+    if (owners == NULL)
         return -1;
 
-    while (!feof(f)) {
-        (void)memset(line, 0, LINE_BUF_LEN);
-        if (fgets(line, LINE_BUF_LEN, f) == NULL)
-            break;
+    te = __new_estab();
+    if (te == NULL)
+        return -1;
 
-        te = __new_estab();
-        if (te == NULL)
-            break;
+    __get_estab_addr(ent, ent->src, ent->sport, &(te->local));
+    __get_estab_addr(ent, ent->dst, ent->dport, &(te->remote));
 
-        ret = __get_estab((const char *)line, te);
-        if (ret < 0) {
-            __free_estab(&te);
-            continue;
+    for (int i = 0; i < owners->owner_num; i++) {
+        te_comm = __get_estab_comm((const struct sock_owner *)&owners->owners[i]);
+        if (te_comm != NULL) {
+            if (__add_estab_comm(te, te_comm) < 0)
+                (void)free(te_comm);
         }
-
-        ret = __add_estab(tes, te);
-        if (ret < 0)
-            __free_estab(&te);
-    }
-    (void)pclose(f);
-    return 0;
-}
-
-/*
-                       _______
-                       |     |
-   s example: 127.0.0.1:38338users:(("lubanagent",pid=1709,fd=4))
-*/
-static int __get_listen_port(const char *s, unsigned int *port)
-{
-    int ret;
-    char port_str[PORT_LEN];
-    unsigned int port_num;
-
-    if (strstr(s, "]:")) {
-        ret = __get_sub_str(s, "]:", "users:", port_str, PORT_LEN);
-        if (ret < 0)
-            return -1;
-    } else {
-        ret = __get_sub_str(s, ":", "users:", port_str, PORT_LEN);
-        if (ret < 0)
-            return -1;
     }
 
-    if (__is_digit_str((const char *)port_str) == 0)
-        return -1;
-
-    port_num = (unsigned int)atoi(port_str);
-    if (port_num >= PORT_MAX_NUM)
-        return -1;
-
-    *port = port_num;
-    return 0;
-}
-
-/*
-                                     ____________
-                                     |          |
-   s example: 127.0.0.1:38338users:(("lubanagent",pid=1709,fd=4))
-*/
-static int __get_listen_comm(const char *s, char *comm_buf, unsigned int buf_len)
-{
-    return __get_sub_str(s, "((\"", "\",pid", comm_buf, buf_len);
-}
-
-/*
-                                                     ______
-                                                     |    |
-   s example: 127.0.0.1:38338users:(("lubanagent",pid=1709,fd=4))
-*/
-static int __get_listen_pid(const char *s, unsigned int *pid)
-{
-    int ret;
-    char pid_str[PID_LEN];
-
-    ret = __get_sub_str(s, "pid=", ",fd=", pid_str, PID_LEN);
-    if (ret < 0)
+    if (__add_estab(tes, te) < 0) {
+        __free_estab(&te);
         return -1;
-
-    if (__is_digit_str((const char *)pid_str) == 0)
-        return -1;
-
-    *pid = (unsigned int)atoi(pid_str);
+    }
     return 0;
 }
 
-/*
-   s example: 127.0.0.1:38338users:(("lubanagent",pid=1709,fd=4))
-*/
-static int __get_listen_fd(const char *s, int *fd)
+static int __get_estabs(struct tcp_estabs* tes)
 {
-    int ret;
-    char fd_str[FID_LEN];
-
-    ret = __get_sub_str(s, "fd=", "))", fd_str, FID_LEN);
-    if (ret < 0)
-        return -1;
-
-    if (__is_digit_str((const char *)fd_str) == 0)
-        return -1;
-
-    *fd = atoi(fd_str);
-    return 0;
+    return __sock_diag_resolve(1 << TCP_ESTABLISHED_STATE, __get_estab, tes);
 }
 
-static struct tcp_listen_port* __new_tlp(const char *s)
+static struct tcp_listen_port* __new_tlp(const struct sock_diag_ent *ent, const struct sock_index_s *owners)
 {
-    int ret;
-    unsigned int port, pid;
-    int fd;
-    char comm[TASK_COMM_LEN];
     struct tcp_listen_port* tlp;
+    const struct sock_owner *owner = &owners->owners[0];
 
-    ret = __get_listen_port(s, &port);
-    if (ret < 0)
-        return NULL;
-
-    ret = __get_listen_comm(s, comm, TASK_COMM_LEN);
-    if (ret < 0)
-        return NULL;
-
-    ret = __get_listen_pid(s, &pid);
-    if (ret < 0)
-        return NULL;
-
-    ret = __get_listen_fd(s, &fd);
-    if (ret < 0)
+    if (ent->sport >= PORT_MAX_NUM)
         return NULL;
 
     tlp = (struct tcp_listen_port *)malloc(sizeof(struct tcp_listen_port));
     if (tlp == NULL)
         return NULL;
 
-    tlp->pid = pid;
-    tlp->port = port;
-    tlp->fd = fd;
-    memcpy(tlp->comm, comm, TASK_COMM_LEN);
+    tlp->pid = owner->pid;
+    tlp->port = ent->sport;
+    tlp->fd = owner->fd;
+    tlp->comm[0] = 0;
+    (void)snprintf(tlp->comm, TASK_COMM_LEN, "%s", __sock_index_comm(owner->pid));
     return tlp;
 }
 
@@ -531,7 +801,7 @@ static void __free_tlps(struct tcp_listen_ports** ptlps)
 
 static int __add_tlp(struct tcp_listen_ports* tlps, const struct tcp_listen_port* tlp)
 {
-    // Already judge legal of 'tlp->port' in function __get_listen_port
+    // Already judge legal of 'tlp->port' in function __new_tlp
     if (tlps->tlp_hash[tlp->port] == 1)
         return -1;
 
@@ -544,35 +814,33 @@ static int __add_tlp(struct tcp_listen_ports* tlps, const struct tcp_listen_port
     return 0;
 }
 
-static int __get_tlps(struct tcp_listen_ports* tlps)
+static int __get_tlp(const struct sock_diag_ent *ent, void *ctx)
 {
-    char line[LINE_BUF_LEN];
-    FILE *f;
-    const char *command = SS_LISTEN_PORTS_COMMAND;
+    struct sock_diag_ctx *diag_ctx = ctx;
+    struct tcp_listen_ports* tlps = diag_ctx->tbl;
+    struct sock_index_s *owners;
     struct tcp_listen_port* tlp;
-    int ret;
 
-    f = popen(command, "r");
-    if (f == NULL)
+    owners = __sock_index_get(ent->ino, diag_ctx->diag_ents, &diag_ctx->index_refreshed);
+    if (owners == NULL)
         return -1;
 
-    while (feof(f) == 0) {
-        (void)memset(line, 0, LINE_BUF_LEN);
-        if (fgets(line, LINE_BUF_LEN, f) == NULL)
-            break;
-
-        tlp = __new_tlp((const char *)line);
-        if (tlp == NULL)
-            continue;
+    tlp = __new_tlp(ent, (const struct sock_index_s *)owners);
+    if (tlp == NULL)
+        return -1;
 
-        ret = __add_tlp(tlps, tlp);
-        if (ret < 0)
-            (void)free(tlp);
+    if (__add_tlp(tlps, tlp) < 0) {
+        (void)free(tlp);
+        return -1;
     }
-    (void)pclose(f);
     return 0;
 }
 
+static int __get_tlps(struct tcp_listen_ports* tlps)
+{
+    return __sock_diag_resolve(1 << TCP_LISTEN_STATE, __get_tlp, tlps);
+}
+
 char is_listen_port(unsigned int port, struct tcp_listen_ports* tlps)
 {
     if (port >= PORT_MAX_NUM)
@@ -28,6 +28,7 @@
 
 #include "bpf.h"
 #include "args.h"
+#include "map_batch.h"
 #include "trace_lvs.h"
 
 #ifdef KERNEL_SUPPORT_LVS
@@ -70,10 +71,11 @@ static void update_ipvs_collect_data(struct collect_value *dd)
     return;
 }
 
-static void update_ipvs_collect_map(const struct link_key *k, unsigned short protocol, const struct ip *laddr, int map_fd)
+static void update_ipvs_collect(const struct link_key *k, unsigned short protocol, const struct ip *laddr,
+    struct map_agg_s *collect)
 {
     struct collect_key      key = {0};
-    struct collect_value    val = {0};
+    struct collect_value    *val;
 
     /* build key */
     key.family = k->family;
@@ -84,107 +86,104 @@ static void update_ipvs_collect_map(const struct link_key *k, unsigned short pro
     key.v_port = k->v_port;
     key.s_port = k->s_port;
 
-    (void)bpf_map_lookup_elem(map_fd, &key, &val);
-    update_ipvs_collect_data(&val);
-    val.protocol = protocol;
-    (void)bpf_map_update_elem(map_fd, &key, &val, BPF_ANY);
+    val = (struct collect_value *)map_agg_lookup_or_init(collect, &key);
+    if (val == NULL) {
+        return;
+    }
+    update_ipvs_collect_data(val);
+    val->protocol = protocol;
 
     return;
 }
 
-static void pull_probe_data(int fd, int collect_fd)
+static int pull_link(const void *k, const void *v, void *ctx)
 {
-    int ret = 0;
-    struct link_key   key = {0};
-    struct link_key   next_key = {0};
-    struct link_value value;
+    const struct link_key *key = (const struct link_key *)k;
+    const struct link_value *value = (const struct link_value *)v;
     unsigned char ip_pro_str[INET6_ADDRSTRLEN];
     unsigned char cli_ip_str[INET6_ADDRSTRLEN];
     unsigned char vir_ip_str[INET6_ADDRSTRLEN];
     unsigned char loc_ip_str[INET6_ADDRSTRLEN];
     unsigned char src_ip_str[INET6_ADDRSTRLEN];
 
-    while (bpf_map_get_next_key(fd, &key, &next_key) == 0) {
-        ret = bpf_map_lookup_elem(fd, &next_key, &value);
-        if (ret == 0) {
-            ippro_to_str(value.protocol, ip_pro_str);
-            ip_str(next_key.family, (unsigned char *)&(next_key.c_addr), cli_ip_str, INET6_ADDRSTRLEN);
-            ip_str(next_key.family, (unsigned char *)&(next_key.v_addr), vir_ip_str, INET6_ADDRSTRLEN);
-            ip_str(next_key.family, (unsigned char *)&(value.l_addr), loc_ip_str, INET6_ADDRSTRLEN);
-            ip_str(next_key.family, (unsigned char *)&(next_key.s_addr), src_ip_str, INET6_ADDRSTRLEN);
-            printf("LVS new connect protocol[%s] type[%s] c[%s:%d]--v[%s:%d]--l[%s:%d]--s[%s:%d] state[%d]. \n",
-                ip_pro_str,
-                (next_key.family == AF_INET) ? "IPv4" : "IPv6",
-                cli_ip_str,
-                ntohs(next_key.c_port),
-                vir_ip_str,
-                ntohs(next_key.v_port),
-                loc_ip_str,
-                ntohs(value.l_port),
-                src_ip_str,
-                ntohs(next_key.s_port),
-                value.state);
-            /* update collect map */
-            update_ipvs_collect_map(&next_key, value.protocol, &value.l_addr, collect_fd);
-        }
-        if (value.state == IP_VS_TCP_S_CLOSE) {
-            (void)bpf_map_delete_elem(fd, &next_key);
-        } else {
-            key = next_key;
-        }
-    }
+    ippro_to_str(value->protocol, ip_pro_str);
+    ip_str(key->family, (unsigned char *)&(key->c_addr), cli_ip_str, INET6_ADDRSTRLEN);
+    ip_str(key->family, (unsigned char *)&(key->v_addr), vir_ip_str, INET6_ADDRSTRLEN);
+    ip_str(key->family, (unsigned char *)&(value->l_addr), loc_ip_str, INET6_ADDRSTRLEN);
+    ip_str(key->family, (unsigned char *)&(key->s_addr), src_ip_str, INET6_ADDRSTRLEN);
+    printf("LVS new connect protocol[%s] type[%s] c[%s:%d]--v[%s:%d]--l[%s:%d]--s[%s:%d] state[%d]. \n",
+        ip_pro_str,
+        (key->family == AF_INET) ? "IPv4" : "IPv6",
+        cli_ip_str,
+        ntohs(key->c_port),
+        vir_ip_str,
+        ntohs(key->v_port),
+        loc_ip_str,
+        ntohs(value->l_port),
+        src_ip_str,
+        ntohs(key->s_port),
+        value->state);
+    /* update collect table */
+    update_ipvs_collect(key, value->protocol, &value->l_addr, (struct map_agg_s *)ctx);
+
+    return (value->state == IP_VS_TCP_S_CLOSE) ? MAP_BATCH_DEL : MAP_BATCH_KEEP;
 }
 
-static void print_ipvs_collect(int map_fd)
+static void pull_probe_data(struct map_batch_s *batch, struct map_agg_s *collect)
 {
-    int ret = 0;
-    struct collect_key  key = {0};
-    struct collect_key  next_key = {0};
-    struct collect_value    value = {0};
+    (void)map_batch_walk(batch, pull_link, (void *)collect);
+}
+
+static void print_ipvs_collect(struct map_agg_s *collect)
+{
+    struct collect_key  *key;
+    struct collect_value    *value;
 
     unsigned char cli_ip_str[INET6_ADDRSTRLEN];
     unsigned char vir_ip_str[INET6_ADDRSTRLEN];
     unsigned char loc_ip_str[INET6_ADDRSTRLEN];
     unsigned char src_ip_str[INET6_ADDRSTRLEN];
 
-    while (bpf_map_get_next_key(map_fd, &key, &next_key) != -1) {
-        ret = bpf_map_lookup_elem(map_fd, &next_key, &value);
-        if (ret == 0) {
-            ip_str(next_key.family, (unsigned char *)&(next_key.c_addr), cli_ip_str, INET6_ADDRSTRLEN);
-            ip_str(next_key.family, (unsigned char *)&(next_key.v_addr), vir_ip_str, INET6_ADDRSTRLEN);
-            ip_str(next_key.family, (unsigned char *)&(next_key.s_addr), src_ip_str, INET6_ADDRSTRLEN);
-            ip_str(next_key.family, (unsigned char *)&(next_key.l_addr), loc_ip_str, INET6_ADDRSTRLEN);
-            fprintf(stdout,
-                "|%s|%s|%s|%s|%s|%s|%u|%u|%u|%llu|\n",
-                METRIC_NAME_LVS_LINK,
-                "ipvs",
-                cli_ip_str,
-                vir_ip_str,
-                loc_ip_str,
-                src_ip_str,
-                ntohs(next_key.v_port),
-                ntohs(next_key.s_port),
-                value.protocol,
-                value.link_count);
-
-            DEBUG("collect c_ip[%s], v_ip[%s:%d] l_ip[%s] s_ip[%s:%d] link_count[%lld]. \n",
-                cli_ip_str,
-                vir_ip_str,
-                ntohs(next_key.v_port),
-                loc_ip_str,
-                src_ip_str,
-                ntohs(next_key.s_port),
-                value.link_count);
-        }
-        (void)bpf_map_delete_elem(map_fd, &next_key);
+    for (__u32 i = 0; i < collect->num; i++) {
+        key = (struct collect_key *)map_agg_key(collect, i);
+        value = (struct collect_value *)map_agg_value(collect, i);
+
+        ip_str(key->family, (unsigned char *)&(key->c_addr), cli_ip_str, INET6_ADDRSTRLEN);
+        ip_str(key->family, (unsigned char *)&(key->v_addr), vir_ip_str, INET6_ADDRSTRLEN);
+        ip_str(key->family, (unsigned char *)&(key->s_addr), src_ip_str, INET6_ADDRSTRLEN);
+        ip_str(key->family, (unsigned char *)&(key->l_addr), loc_ip_str, INET6_ADDRSTRLEN);
+        fprintf(stdout,
+            "|%s|%s|%s|%s|%s|%s|%u|%u|%u|%llu|\n",
+            METRIC_NAME_LVS_LINK,
+            "ipvs",
+            cli_ip_str,
+            vir_ip_str,
+            loc_ip_str,
+            src_ip_str,
+            ntohs(key->v_port),
+            ntohs(key->s_port),
+            value->protocol,
+            value->link_count);
+
+        DEBUG("collect c_ip[%s], v_ip[%s:%d] l_ip[%s] s_ip[%s:%d] link_count[%lld]. \n",
+            cli_ip_str,
+            vir_ip_str,
+            ntohs(key->v_port),
+            loc_ip_str,
+            src_ip_str,
+            ntohs(key->s_port),
+            value->link_count);
     }
     (void)fflush(stdout);
+    map_agg_reset(collect);
     return;
 }
 #endif
 int main(int argc, char **argv)
 {
 #ifdef KERNEL_SUPPORT_LVS
+    struct map_batch_s *batch = NULL;
+    struct map_agg_s *collect = NULL;
     int err = args_parse(argc, argv, &params);
     if (err != 0)
         return -1;
@@ -199,30 +198,24 @@ int main(int argc, char **argv)
         goto err;
     }
 
-    /* create collect hash map */
-#if (CURRENT_LIBBPF_VERSION  >= LIBBPF_VERSION(0, 8))
-    int collect_map_fd =
-        bpf_map_create(BPF_MAP_TYPE_HASH, NULL, sizeof(struct collect_key),
-                        sizeof(struct collect_value), IPVS_MAX_ENTRIES, NULL);
-#else
-    int collect_map_fd =
-        bpf_create_map(BPF_MAP_TYPE_HASH, sizeof(struct collect_key),
-                        sizeof(struct collect_value), IPVS_MAX_ENTRIES, 0);
-#endif
-    if (collect_map_fd < 0) {
-        fprintf(stderr, "bpf_create_map collect map fd failed.\n");
+    batch = map_batch_new(GET_MAP_FD(trace_lvs, lvs_link_map), sizeof(struct link_key), sizeof(struct link_value));
+    collect = map_agg_new(sizeof(struct collect_key), sizeof(struct collect_value), IPVS_MAX_ENTRIES);
+    if (batch == NULL || collect == NULL) {
+        fprintf(stderr, "Create collect table failed.\n");
         goto err;
     }
 
     printf("Successfully started! \n");
 
     while (stop == 0) {
-        pull_probe_data(GET_MAP_FD(trace_lvs, lvs_link_map), collect_map_fd);
-        print_ipvs_collect(collect_map_fd);
+        pull_probe_data(batch, collect);
+        print_ipvs_collect(collect);
         sleep(params.period);
     }
 
 err:
+    map_batch_free(&batch);
+    map_agg_free(&collect);
     UNLOAD(trace_lvs);
 #else
     printf("Kernel not support lvs.\n");
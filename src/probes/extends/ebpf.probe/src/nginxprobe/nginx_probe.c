@@ -28,6 +28,7 @@
 
 #include "bpf.h"
 #include "args.h"
+#include "map_batch.h"
 #include "nginx_probe.skel.h"
 #include "nginx_probe.h"
 
@@ -39,10 +40,25 @@ static void sig_handler(int sig)
     stop = true;
 }
 
-static void update_statistic_map(int map_fd, const struct ngx_metric *data)
+static int update_statistic(const void *key, const void *value, void *ctx)
 {
+    const struct ngx_metric *data = (const struct ngx_metric *)value;
+    struct map_agg_s *stats = (struct map_agg_s *)ctx;
     struct ngx_statistic_key k = {0};
-    struct ngx_statistic v = {0};
+    struct ngx_statistic *v;
+    unsigned char c_ip_str[INET6_ADDRSTRLEN];
+    unsigned char c_local_ip_str[INET6_ADDRSTRLEN];
+
+    ip_str(data->src_ip.family, (unsigned char *)&data->src_ip, c_ip_str, INET6_ADDRSTRLEN);
+    ip_str(data->ngx_ip.family, (unsigned char *)&data->ngx_ip, c_local_ip_str, INET6_ADDRSTRLEN);
+
+    DEBUG("===ngx[%s]: %s:%d --> %s:%d --> %s\n",
+        (data->is_l7 == 1 ? "7 LB" : "4 LB"),
+        c_ip_str,
+        ntohs(data->src_ip.port),
+        c_local_ip_str,
+        ntohs(data->ngx_ip.port),
+        data->dst_ip_str);
 
     /* build key */
     memcpy(&k.cip, &(data->src_ip.ipaddr), sizeof(struct ip));
@@ -50,100 +66,66 @@ static void update_statistic_map(int map_fd, const struct ngx_metric *data)
     k.is_l7 = data->is_l7;
     memcpy(k.sip_str, data->dst_ip_str, INET6_ADDRSTRLEN);
 
-    (void)bpf_map_lookup_elem(map_fd, &k, &v);
-    if (v.link_count == 0)
-        memcpy(&(v.ngx_ip), &(data->ngx_ip), sizeof(struct ip_addr));
+    v = (struct ngx_statistic *)map_agg_lookup_or_init(stats, &k);
+    if (v != NULL) {
+        if (v->link_count == 0)
+            memcpy(&(v->ngx_ip), &(data->ngx_ip), sizeof(struct ip_addr));
 
-    v.link_count++;
+        v->link_count++;
+    }
 
-    (void)bpf_map_update_elem(map_fd, &k, &v, BPF_ANY);
-    return;
+    return data->is_finish ? MAP_BATCH_DEL : MAP_BATCH_KEEP;
 }
 
-static void pull_probe_data(int map_fd, int statistic_map_fd)
+static void pull_probe_data(struct map_batch_s *batch, struct map_agg_s *stats)
 {
-    int ret = -1;
-    struct ip_addr key = {0};
-    struct ip_addr next_key = {0};
-    struct ngx_metric data;
-    unsigned char c_ip_str[INET6_ADDRSTRLEN];
-    unsigned char c_local_ip_str[INET6_ADDRSTRLEN];
-
-    while (bpf_map_get_next_key(map_fd, &key, &next_key) != -1) {
-        ret = bpf_map_lookup_elem(map_fd, &next_key, &data);
-        if (ret == 0) {
-            ip_str(data.src_ip.family, (unsigned char *)&data.src_ip, c_ip_str, INET6_ADDRSTRLEN);
-            ip_str(data.ngx_ip.family, (unsigned char *)&data.ngx_ip, c_local_ip_str, INET6_ADDRSTRLEN);
-
-            DEBUG("===ngx[%s]: %s:%d --> %s:%d --> %s\n",
-                (data.is_l7 == 1 ? "7 LB" : "4 LB"),
-                c_ip_str,
-                ntohs(data.src_ip.port),
-                c_local_ip_str,
-                ntohs(data.ngx_ip.port),
-                data.dst_ip_str);
-
-            update_statistic_map(statistic_map_fd, &data);
-        }
-
-        if (data.is_finish) {
-            (void)bpf_map_delete_elem(map_fd, &next_key);
-        } else {
-            key = next_key;
-        }
-    }
-
+    (void)map_batch_walk(batch, update_statistic, (void *)stats);
     return;
 }
 
 #define METRIC_STATISTIC_NAME "nginx_link"
-static void print_statistic_map(int fd)
+static void print_statistic(struct map_agg_s *stats)
 {
-    int ret = 0;
-    struct ngx_statistic_key k = {0};
-    struct ngx_statistic_key nk = {0};
-    struct ngx_statistic d = {0};
+    struct ngx_statistic_key *k;
+    struct ngx_statistic *d;
 
     unsigned char cip_str[INET6_ADDRSTRLEN];
     unsigned char ngxip_str[INET6_ADDRSTRLEN];
-    // unsigned char sip_str[INET6_ADDRSTRLEN];
 
     char *colon = NULL;
 
-    while (bpf_map_get_next_key(fd, &k, &nk) != -1) {
-        ret = bpf_map_lookup_elem(fd, &nk, &d);
-        if (ret == 0) {
-            ip_str(nk.family, (unsigned char *)&(nk.cip), cip_str, INET6_ADDRSTRLEN);
-            ip_str(d.ngx_ip.family, (unsigned char *)&(d.ngx_ip.ipaddr), ngxip_str, INET6_ADDRSTRLEN);
-
-            colon = strrchr(nk.sip_str, ':');
-            if (colon != NULL)
-                *colon = '\0';
-
-            fprintf(stdout,
-                "|%s|%s|%s|%s|%u|%s|%u|%u|\n",
-                METRIC_STATISTIC_NAME,
-                cip_str,
-                ngxip_str,
-                nk.sip_str,
-                ntohs(d.ngx_ip.port),
-                (colon ? (colon + 1) : "0"),
-                nk.is_l7,
-                d.link_count);
-
-            if (colon != NULL)
-                *colon = ':';
-        }
-        (void)bpf_map_delete_elem(fd, &nk);
+    for (__u32 i = 0; i < stats->num; i++) {
+        k = (struct ngx_statistic_key *)map_agg_key(stats, i);
+        d = (struct ngx_statistic *)map_agg_value(stats, i);
+
+        ip_str(k->family, (unsigned char *)&(k->cip), cip_str, INET6_ADDRSTRLEN);
+        ip_str(d->ngx_ip.family, (unsigned char *)&(d->ngx_ip.ipaddr), ngxip_str, INET6_ADDRSTRLEN);
+
+        colon = strrchr(k->sip_str, ':');
+        if (colon != NULL)
+            *colon = '\0';
+
+        fprintf(stdout,
+            "|%s|%s|%s|%s|%u|%s|%u|%u|\n",
+            METRIC_STATISTIC_NAME,
+            cip_str,
+            ngxip_str,
+            k->sip_str,
+            ntohs(d->ngx_ip.port),
+            (colon ? (colon + 1) : "0"),
+            k->is_l7,
+            d->link_count);
     }
     (void)fflush(stdout);
+    map_agg_reset(stats);
     return;
 }
 
 int main(int argc, char **argv)
 {
     int err = -1;
-    int map_fd = -1;
+    struct map_batch_s *batch = NULL;
+    struct map_agg_s *stats = NULL;
     char *elf[PATH_NUM] = {0};
     int elf_num = -1;
     int attach_flag = 0;
@@ -188,29 +170,23 @@ int main(int argc, char **argv)
     if (attach_flag == 0)
         goto err;
 
-    /* create ngx statistic map_fd */
-#if (CURRENT_LIBBPF_VERSION  >= LIBBPF_VERSION(0, 8))
-    map_fd = bpf_map_create(
-        BPF_MAP_TYPE_HASH, NULL, sizeof(struct ngx_statistic_key), sizeof(struct ngx_statistic), STATISTIC_MAX_ENTRIES, NULL);
-#else
-    map_fd = bpf_create_map(
-        BPF_MAP_TYPE_HASH, sizeof(struct ngx_statistic_key), sizeof(struct ngx_statistic), STATISTIC_MAX_ENTRIES, 0);
-#endif
-    if (map_fd < 0) {
-        printf("Failed to create statistic map fd.\n");
+    batch = map_batch_new(GET_MAP_FD(nginx_probe, hs), sizeof(struct ip_addr), sizeof(struct ngx_metric));
+    stats = map_agg_new(sizeof(struct ngx_statistic_key), sizeof(struct ngx_statistic), STATISTIC_MAX_ENTRIES);
+    if (batch == NULL || stats == NULL) {
+        printf("Failed to create statistic table.\n");
         goto err;
     }
     printf("Successfully started!\n");
 
     /* try to hit probe info */
     while (!stop) {
-        pull_probe_data(GET_MAP_FD(nginx_probe, hs), map_fd);
-        print_statistic_map(map_fd);
+        pull_probe_data(batch, stats);
+        print_statistic(stats);
         sleep(params.period);
     }
 err:
-    if (map_fd > 0)
-        close(map_fd);
+    map_batch_free(&batch);
+    map_agg_free(&stats);
 
     UNLOAD(nginx_probe);
     return 0;
@@ -136,6 +136,12 @@ KPROBE(__close_fd, pt_regs)
         return 0;
     }
 
+    // The last request is finished without a next read, it still goes into the histogram.
+    struct conn_samp_data_t *csd = (struct conn_samp_data_t *)bpf_map_lookup_elem(&conn_samp_map, &conn_data->sk);
+    if (csd != NULL && csd->status == SAMP_FINISHED) {
+        record_sli_histo(conn_data, csd);
+    }
+
     bpf_map_delete_elem(&conn_samp_map, &conn_data->sk);
     bpf_map_delete_elem(&conn_map, &conn_key);
 
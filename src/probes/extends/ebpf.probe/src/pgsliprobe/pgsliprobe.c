@@ -35,10 +35,12 @@
 #include "tc_loader.h"
 #include "container.h"
 #include "pgsliprobe.h"
+#include "sli_histo.h"
 
 #define OO_NAME "sli"
 #define SLI_TBL_NAME "pg_sli"
 #define MAX_SLI_TBL_NAME "pg_max_sli"
+#define PCT_SLI_TBL_NAME "pg_sli_percentile"
 #define GUASSDB_COMM "gaussdb"
 
 #define PID_COMM_COMMAND "ps -e -o pid,comm | grep %s | awk '{print $1}'"
@@ -49,6 +51,7 @@
 #define PGSLI_CONN_PATH          "/sys/fs/bpf/gala-gopher/__pgsli_conn"
 #define PGSLI_CONN_SAMP_PATH     "/sys/fs/bpf/gala-gopher/__pgsli_conn_samp"
 #define PGSLI_OUTPUT_PATH        "/sys/fs/bpf/gala-gopher/__pgsli_output"
+#define PGSLI_HISTO_PATH         "/sys/fs/bpf/gala-gopher/__pgsli_histo"
 
 #define RM_PGSLI_PATH "/usr/bin/rm -rf /sys/fs/bpf/gala-gopher/__pgsli*"
 
@@ -58,6 +61,7 @@
     MAP_SET_PIN_PATH(probe_name, conn_map, PGSLI_CONN_PATH, load); \
     MAP_SET_PIN_PATH(probe_name, conn_samp_map, PGSLI_CONN_SAMP_PATH, load); \
     MAP_SET_PIN_PATH(probe_name, output, PGSLI_OUTPUT_PATH, load); \
+    MAP_SET_PIN_PATH(probe_name, sli_histo_map, PGSLI_HISTO_PATH, load); \
     LOAD_ATTACH(probe_name, end, load)
 
 static volatile sig_atomic_t stop;
@@ -179,16 +183,16 @@ static void msg_event_handler(void *ctx, int cpu, void *data, unsigned int size)
 static void *msg_event_receiver(void *arg)
 {
     int fd = *(int *)arg;
-    struct perf_buffer *pb;
+    struct bpf_buffer_s *buffer;
 
-    pb = create_pref_buffer(fd, msg_event_handler);
-    if (pb == NULL) {
-        fprintf(stderr, "Failed to create perf buffer.\n");
+    buffer = create_bpf_buffer(fd, msg_event_handler);
+    if (buffer == NULL) {
+        fprintf(stderr, "Failed to create output buffer.\n");
         stop = 1;
         return NULL;
     }
 
-    poll_pb(pb, params.period * 1000);
+    poll_bpf_buffer(buffer, params.period * 1000);
     stop = 1;
     return NULL;
 }
@@ -215,10 +219,18 @@ static void load_args(int args_fd, struct probe_params* params)
     struct ogsli_args_s args = {0};
 
     args.period = NS(params->period);
+    args.latency_thr = MS2NS(params->latency_thr);
+    args.raw_sli_flag = (params->metrics_flags & SUPPORT_METRICS_RAW) ? 1 : 0;
+    args.histo_flag = (params->metrics_flags & SUPPORT_METRICS_TELEM) ? 1 : 0;
 
     (void)bpf_map_update_elem(args_fd, &key, &args, BPF_ANY);
 }
 
+static void output_sli_histo(const struct sli_histo_key_s *key, const struct sli_histo_s *histo, void *ctx)
+{
+    sli_histo_output(PCT_SLI_TBL_NAME, "POSTGRE", key, histo);
+}
+
 
 static struct bpf_link_hash_t* find_bpf_link(unsigned int pid)
 {
@@ -360,6 +372,7 @@ int main(int argc, char **argv)
     FILE *fp = NULL;
     int init = 0;
     struct bpf_link_hash_t *item, *tmp;
+    struct map_batch_s *histo_batch = NULL;
 
     err = args_parse(argc, argv, &params);
     if (err != 0) {
@@ -388,8 +401,20 @@ int main(int argc, char **argv)
         goto init_err;
     }
 
+    if (params.metrics_flags & SUPPORT_METRICS_TELEM) {
+        histo_batch = sli_histo_batch_new(GET_MAP_FD(pgsli_kprobe, sli_histo_map));
+        if (histo_batch == NULL) {
+            fprintf(stderr, "Failed to create batch of sli histograms.\n");
+            goto init_err;
+        }
+    }
+
     while (!stop) {
         sleep(params.period);
+        // 每个周期合并各CPU的时延直方图，输出分位数
+        if (histo_batch != NULL) {
+            (void)sli_histo_drain(histo_batch, output_sli_histo, NULL);
+        }
         if (noDependLibssl) {
             continue;
         }
@@ -439,6 +464,7 @@ int main(int argc, char **argv)
     }
 
 init_err:
+    map_batch_free(&histo_batch);
     clear_all_bpf_link();
     UNLOAD(pgsli_uprobe);
 init_k_err:
@@ -26,6 +26,9 @@
 
 struct ogsli_args_s {
     __u64 period; // Sampling period, unit ns
+    __u64 latency_thr; // unit ns, sli above it is always reported
+    char raw_sli_flag; // Report sli of each connection every period, otherwise only those above latency_thr
+    char histo_flag; // Record the latency histograms of each server and command
 };
 
 struct ip {
@@ -15,6 +15,8 @@
 #ifndef __PGSLIPROBE_BPF_H__
 #define __PGSLIPROBE_BPF_H__
 
+#include "sli_histo.h"
+
 #ifndef __PERIOD
 #define __PERIOD NS(30)
 #endif
@@ -23,13 +25,6 @@
 #define MAX_COMMAND_REQ_SIZE (32 - 1)
 #define MAX_CONN_LEN            8192
 
-#define BPF_F_INDEX_MASK    0xffffffffULL
-#define BPF_F_ALL_CPU   BPF_F_INDEX_MASK
-
-#ifndef __PERF_OUT_MAX
-#define __PERF_OUT_MAX (64)
-#endif
-
 enum samp_status_t {
     SAMP_INIT = 0,
     SAMP_READ_READY,
@@ -86,15 +81,49 @@ struct {
     __uint(max_entries, MAX_CONN_LEN);
 } conn_samp_map SEC(".maps");
 
-struct {
-    __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
-    __uint(key_size, sizeof(u32));
-    __uint(value_size, sizeof(u32));
-    __uint(max_entries, __PERF_OUT_MAX);
-} output SEC(".maps");
+BPF_OUTPUT_MAP(output, BPF_OUTPUT_BUF_SIZE);
+BPF_OUTPUT_SCRATCH_MAP(output_scratch, struct msg_event_data_t);
+
+SLI_HISTO_MAPS(sli_histo_map);
+
+static __always_inline struct ogsli_args_s *get_args()
+{
+    u32 key = 0;
+    return (struct ogsli_args_s *)bpf_map_lookup_elem(&args_map, &key);
+}
+
+static __always_inline void record_sli_histo(struct conn_data_t *conn_data, struct conn_samp_data_t *csd)
+{
+    struct sli_histo_key_s histo_key = {0};
+    struct ogsli_args_s *args = get_args();
+
+    if (args == NULL || !args->histo_flag) {
+        return;
+    }
+
+    histo_key.tgid = bpf_get_current_pid_tgid() >> INT_LEN;
+    histo_key.family = (u16)conn_data->conn_info.client_ip_info.family;
+    histo_key.server_port = conn_data->conn_info.server_ip_info.port;
+    __builtin_memcpy(histo_key.server_ip, conn_data->conn_info.server_ip_info.ipaddr.ip6, IP6_LEN);
+    histo_key.command[0] = csd->req_cmd;
+    sli_histo_record(sli_histo_map, &histo_key, csd->rtt_ts_nsec);
+}
+
+// Without raw sli, a connection is only reported when its sli is above the threshold.
+static __always_inline int report_raw_sli(struct conn_data_t *conn_data)
+{
+    struct ogsli_args_s *args = get_args();
+
+    if (args == NULL || args->period == 0 || args->raw_sli_flag) {
+        return 1;
+    }
+    return (args->latency_thr > 0) &&
+           (conn_data->latency.rtt_nsec > args->latency_thr || conn_data->max.rtt_nsec > args->latency_thr);
+}
 
 static __always_inline void sample_finished(struct conn_data_t *conn_data, struct conn_samp_data_t *csd)
 {
+    record_sli_histo(conn_data, csd);
     if (conn_data->latency.rtt_nsec == 0) {
         conn_data->latency.rtt_nsec = csd->rtt_ts_nsec;
         conn_data->latency.req_cmd = csd->req_cmd;
@@ -146,7 +175,6 @@ static __always_inline char read_first_byte_from_buf(const char *ori_buf, int or
 static __always_inline void periodic_report(u64 ts_nsec, struct conn_data_t *conn_data,
     struct conn_key_t *conn_key, struct pt_regs *ctx)
 {
-    long err;
     u64 period = get_period();
     // 表示没有任何采样数据，不上报
     if (conn_data->latency.rtt_nsec == 0) {
@@ -156,17 +184,19 @@ static __always_inline void periodic_report(u64 ts_nsec, struct conn_data_t *con
     if (ts_nsec > conn_data->last_report_ts_nsec &&
         ts_nsec - conn_data->last_report_ts_nsec >= period) {
         // rtt larger than period is considered an invalid value
-        if (conn_data->latency.rtt_nsec < period * 2 && conn_data->max.rtt_nsec < period * 2) {
-            struct msg_event_data_t msg_evt_data = {0};
-            msg_evt_data.tgid = conn_key->tgid;
-            msg_evt_data.fd = conn_key->fd;
-            msg_evt_data.conn_info = conn_data->conn_info;
-            msg_evt_data.latency = conn_data->latency;
-            msg_evt_data.max = conn_data->max;
-            err = bpf_perf_event_output(ctx, &output, BPF_F_ALL_CPU,
-                                        &msg_evt_data, sizeof(struct msg_event_data_t));
-            if (err < 0) {
+        if (conn_data->latency.rtt_nsec < period * 2 && conn_data->max.rtt_nsec < period * 2 &&
+            report_raw_sli(conn_data)) {
+            struct msg_event_data_t *msg_evt_data;
+            msg_evt_data = bpf_output_reserve(&output, &output_scratch, struct msg_event_data_t);
+            if (msg_evt_data == NULL) {
                 bpf_printk("message event sent failed.\n");
+            } else {
+                msg_evt_data->tgid = conn_key->tgid;
+                msg_evt_data->fd = conn_key->fd;
+                msg_evt_data->conn_info = conn_data->conn_info;
+                msg_evt_data->latency = conn_data->latency;
+                msg_evt_data->max = conn_data->max;
+                bpf_output_submit(ctx, &output, msg_evt_data);
             }
         }
         conn_data->latency.rtt_nsec = 0;
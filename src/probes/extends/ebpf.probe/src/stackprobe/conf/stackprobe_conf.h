@@ -25,6 +25,8 @@
 #define PERIOD_MIN          30
 #define SAMPLE_PERIOD_MAX   1000
 #define SAMPLE_PERIOD_MIN   10
+#define MEMLEAK_SAMPLE_MAX  (64 * 1024 * 1024)
+#define MEMLEAK_BUDGET_DEF  10000
 
 typedef enum {
     SWITCH_ON = 0,
@@ -40,6 +42,9 @@ typedef struct {
     char debugDir[PATH_LEN];
     char pyroscopeServer[PATH_LEN];
     u32 whitelistEnable; // 0:disable 1:enable
+    u32 memleakSampleBytes; // 0: memleak traces page faults, others: sample glibc allocations
+    u32 memleakBudget; // max sampled allocations traced per second, 0: unlimited
+    u32 dwarfUnwind; // 0: user stacks walked by frame pointer only 1: dwarf unwinding of oncpu/offcpu
 } GeneralConfig;
 
 typedef struct {
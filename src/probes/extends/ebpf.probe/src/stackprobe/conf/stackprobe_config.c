@@ -229,6 +229,33 @@ static int configLoadGeneral(void *config, config_setting_t *settings)
     }
     (void)strncpy(generalConfig->pyroscopeServer, strVal, PATH_LEN - 1);
 
+    ret = config_setting_lookup_int(settings, "memleak_sample_bytes", &intVal);
+    if (ret == 0) {
+        intVal = 0; // memleak traces page faults
+    }
+    if (intVal < 0 || intVal > MEMLEAK_SAMPLE_MAX) {
+        ERROR("[STACKPROBE]: Please check config for general memleak_sample_bytes, val shold inside 0~%d.\n",
+            MEMLEAK_SAMPLE_MAX);
+        return -1;
+    }
+    generalConfig->memleakSampleBytes = (u32)intVal;
+
+    ret = config_setting_lookup_int(settings, "memleak_budget", &intVal);
+    if (ret == 0) {
+        intVal = MEMLEAK_BUDGET_DEF;
+    }
+    if (intVal < 0) {
+        ERROR("[STACKPROBE]: Please check config for general memleak_budget, val shold not be negative.\n");
+        return -1;
+    }
+    generalConfig->memleakBudget = (u32)intVal;
+
+    ret = config_setting_lookup_bool(settings, "dwarf_unwind", &intVal);
+    if (ret == 0) {
+        intVal = 1; // dwarf unwinding, falls back to frame pointer if not supported
+    }
+    generalConfig->dwarfUnwind = (u32)intVal;
+
     return 0;
 }
 
@@ -37,11 +37,9 @@
 #include "bpf.h"
 #include "flame_graph.h"
 
-extern int g_post_max;
-
-struct MemoryStruct {
-  char *memory;
-  size_t size;
+struct pprof_type_s {
+    const char *type;
+    const char *unit;
 };
 
 static char *appname[STACK_SVG_MAX] = {
@@ -51,6 +49,14 @@ static char *appname[STACK_SVG_MAX] = {
     "gala-gopher-memleak"
 };
 
+/* Sample types known by the pprof ingestion of Pyroscope */
+static struct pprof_type_s pprof_types[STACK_SVG_MAX] = {
+    {"samples", "count"},
+    {"samples", "count"},
+    {"samples", "count"},
+    {"inuse_space", "bytes"}
+};
+
 #if 1
 
 static char __test_flame_graph_flags(struct stack_svg_mng_s *svg_mng, u32 flags)
@@ -101,15 +107,7 @@ static FILE *__open_flame_graph_fp(struct stack_svg_mng_s *svg_mng)
 
 static void __mkdir_flame_graph_path(struct stack_svg_mng_s *svg_mng)
 {
-    FILE *fp;
-    char commad[COMMAND_LEN];
-
-    commad[0] = 0;
-    (void)snprintf(commad, COMMAND_LEN, "/usr/bin/mkdir -p %s", svg_mng->flame_graph.flame_graph_dir ?: "/");
-    fp = popen(commad, "r");
-    if (fp != NULL) {
-        (void)pclose(fp);
-    }
+    (void)mkdir_svg_path(svg_mng->flame_graph.flame_graph_dir ?: "/");
     return;
 }
 
@@ -145,22 +143,11 @@ static void __set_flame_graph_file(struct stack_svg_mng_s *svg_mng)
 
 static void __rm_flame_graph_file(struct stack_svg_mng_s *svg_mng)
 {
-#define __COMMAND_LEN   (2 * PATH_LEN)
-    FILE *fp;
-    char commad[__COMMAND_LEN];
     struct stack_flamegraph_s *sfg;
 
     sfg = &(svg_mng->flame_graph);
 
-    if (!access(sfg->flame_graph_file, 0)) {
-        commad[0] = 0;
-        (void)snprintf(commad, __COMMAND_LEN, "/usr/bin/rm -f %s", sfg->flame_graph_file);
-        fp = popen(commad, "r");
-        if (fp != NULL) {
-            (void)pclose(fp);
-            fp = NULL;
-        }
-    }
+    (void)unlink(sfg->flame_graph_file);
     if (sfg->fp) {
         (void)fclose(sfg->fp);
         sfg->fp = NULL;
@@ -177,152 +164,308 @@ static void __reopen_flame_graph_file(struct stack_svg_mng_s *svg_mng)
 
 
 
-static size_t __write_memory_cb(void *contents, size_t size, size_t nmemb, void *userp)
+static size_t __discard_resp_cb(void *contents, size_t size, size_t nmemb, void *userp)
 {
-    size_t realsize = size * nmemb;
-    struct MemoryStruct *mem = (struct MemoryStruct *)userp;
-    
-    char *ptr = realloc(mem->memory, mem->size + realsize + 1);
-    if(!ptr) {
-        /* out of memory! */
-        printf("not enough memory (realloc returned NULL)\n");
-        return 0;
-    }
-    
-    mem->memory = ptr;
-    memcpy(&(mem->memory[mem->size]), contents, realsize);
-    mem->size += realsize;
-    mem->memory[mem->size] = 0;
-    
-    return realsize;
+    return size * nmemb;
 }
- 
-// http://localhost:4040/ingest?name=gala-gopher-oncpu&from=1671189474&until=1671189534
-static int __build_url(char *url, struct post_server_s *post_server, int en_type)
+
+// http://localhost:4040/ingest?name=gala-gopher-oncpu&from=1671189474&until=1671189534&format=pprof
+static void __build_url(struct post_job_s *job, struct post_server_s *post_server, int en_type,
+    time_t *from, time_t *until)
 {
     time_t now, before;
     (void)time(&now);
-    if (post_server->last_post_ts == 0) {
+    if (post_server->last_post_ts[en_type] == 0) {
         before = now - TMOUT_PERIOD;
     } else {
-        before = post_server->last_post_ts + 1;
+        before = post_server->last_post_ts[en_type] + 1;
     }
-    post_server->last_post_ts = now;
+    post_server->last_post_ts[en_type] = now;
 
-    (void)snprintf(url, LINE_BUF_LEN, 
-        "http://%s/ingest?name=%s-%s&from=%ld&until=%ld&units=%s",
+    (void)snprintf(job->url, LINE_BUF_LEN,
+        "http://%s/ingest?name=%s-%s&from=%ld&until=%ld&format=pprof",
         post_server->host,
         appname[en_type],
         post_server->app_suffix,
         (long)before,
-        (long)now,
-        en_type == STACK_SVG_MEMLEAK ? "bytes" : "samples");
-    return 0;
+        (long)now);
+    *from = before;
+    *until = now;
 }
 
+static void __free_post_job(struct post_job_s *job)
+{
+    if (job->curl != NULL) {
+        curl_easy_cleanup(job->curl);
+    }
+    if (job->data != NULL) {
+        (void)free(job->data);
+    }
+    (void)free(job);
+}
 
-static void __curl_post(struct post_server_s *post_server, struct post_info_s *post_info, int en_type)
+static void __append_post_job(struct post_job_s **head, struct post_job_s *job)
 {
-    CURLcode res;
-    CURL *curl = post_info->curl;
-    if (curl == NULL) {
-        goto end2;
+    struct post_job_s **pos = head;
+
+    while (*pos != NULL) {
+        pos = &(*pos)->next;
     }
+    job->next = NULL;
+    *pos = job;
+}
 
-    long post_len = (long)strlen(post_info->buf_start);
-    if (post_len == 0) {
-        DEBUG("[FLAMEGRAPH]: buf is null. No need to curl post post to %s\n", appname[en_type]);
-        goto end1;
+/* Called by the collecting thread, never blocks on network. */
+static void __queue_post_job(struct post_server_s *post_server, struct post_job_s *job)
+{
+    struct post_job_s *dropped = NULL;
+
+    (void)pthread_mutex_lock(&post_server->mutex);
+    if (post_server->queue_len >= POST_QUEUE_MAX) {
+        dropped = post_server->queue;
+        post_server->queue = dropped->next;
+        post_server->queue_len--;
+    }
+    __append_post_job(&post_server->queue, job);
+    post_server->queue_len++;
+    (void)pthread_cond_signal(&post_server->cond);
+    (void)pthread_mutex_unlock(&post_server->mutex);
+
+    if (dropped != NULL) {
+        WARN("[FLAMEGRAPH]: upload queue is full, drop profile of %s\n", dropped->url);
+        __free_post_job(dropped);
     }
+}
 
-    char url[LINE_BUF_LEN] = {0};
-    __build_url(url, post_server, en_type);
-    struct MemoryStruct chunk;
-    chunk.memory = malloc(1);  /* will be grown as needed by realloc above */
-    chunk.size = 0;    /* no data at this point */
+static int __start_post_job(struct post_server_s *post_server, struct post_job_s *job)
+{
+    CURL *curl = job->curl;
 
-    //curl_easy_setopt(curl, CURLOPT_URL, post_server->host);
-    curl_easy_setopt(curl, CURLOPT_URL, url);
+    if (curl == NULL) {
+        curl = curl_easy_init();
+        if (curl == NULL) {
+            return -1;
+        }
+        job->curl = curl;
+    }
 
+    curl_easy_setopt(curl, CURLOPT_URL, job->url);
     curl_easy_setopt(curl, CURLOPT_TIMEOUT, post_server->timeout);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, __discard_resp_cb);
+    /* some servers do not like requests that are made without a user-agent field */
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, post_server->headers);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, job->data);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, (long)job->len);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, (void *)job);
 
-    /* send all data to this function */
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, __write_memory_cb);
+    if (curl_multi_add_handle(post_server->multi, curl) != CURLM_OK) {
+        return -1;
+    }
+    return 0;
+}
+
+static void __start_ready_jobs(struct post_server_s *post_server)
+{
+    struct post_job_s **pos, *job;
+    time_t now = time(NULL);
+
+    (void)pthread_mutex_lock(&post_server->mutex);
+    pos = &post_server->queue;
+    while (*pos != NULL && post_server->running_len < POST_RUNNING_MAX) {
+        job = *pos;
+        if (job->next_try > now) {
+            pos = &job->next;
+            continue;
+        }
+        *pos = job->next;
+        post_server->queue_len--;
 
-    /* we pass our 'chunk' struct to the callback function */
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)&chunk);
+        if (__start_post_job(post_server, job)) {
+            ERROR("[FLAMEGRAPH]: start curl post to %s failed\n", job->url);
+            __free_post_job(job);
+            continue;
+        }
+        job->next = post_server->running;
+        post_server->running = job;
+        post_server->running_len++;
+    }
+    (void)pthread_mutex_unlock(&post_server->mutex);
+}
 
-    /* some servers do not like requests that are made without a user-agent
-    field, so we provide one */
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, "libcurl-agent/1.0");
+static void __retry_post_job(struct post_server_s *post_server, struct post_job_s *job)
+{
+    if (job->retries >= POST_RETRY_MAX) {
+        ERROR("[FLAMEGRAPH]: curl post to %s dropped after %u retries\n", job->url, job->retries);
+        __free_post_job(job);
+        return;
+    }
 
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post_info->buf_start);
+    job->retries++;
+    job->next_try = time(NULL) + min(1L << job->retries, (long)POST_BACKOFF_MAX);
 
-    /* if we do not provide POSTFIELDSIZE, libcurl will strlen() by
-    itself */
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, post_len);
+    (void)pthread_mutex_lock(&post_server->mutex);
+    if (post_server->queue_len >= POST_QUEUE_MAX) {
+        /* Newer profiles take precedence over a failed one */
+        (void)pthread_mutex_unlock(&post_server->mutex);
+        __free_post_job(job);
+        return;
+    }
+    __append_post_job(&post_server->queue, job);
+    post_server->queue_len++;
+    (void)pthread_mutex_unlock(&post_server->mutex);
+}
 
-    /* Perform the request, res will get the return code */
-    res = curl_easy_perform(curl);
-    /* Check for errors */
-    if(res != CURLE_OK) {
-        ERROR("[FLAMEGRAPH]: curl post to %s failed: %s\n", url, curl_easy_strerror(res));
-    } else {
-        INFO("[FLAMEGRAPH]: curl post post to %s success\n", url);
+static void __rm_running_job(struct post_server_s *post_server, struct post_job_s *job)
+{
+    struct post_job_s **pos = &post_server->running;
+
+    while (*pos != NULL) {
+        if (*pos == job) {
+            *pos = job->next;
+            post_server->running_len--;
+            return;
+        }
+        pos = &(*pos)->next;
+    }
+}
+
+static void __finish_post_jobs(struct post_server_s *post_server)
+{
+    CURLMsg *msg;
+    CURL *curl;
+    CURLcode res;
+    struct post_job_s *job;
+    long code;
+    int left;
+
+    while ((msg = curl_multi_info_read(post_server->multi, &left)) != NULL) {
+        if (msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+        curl = msg->easy_handle;
+        res = msg->data.result;     // 'msg' is invalid once the handle is removed
+
+        job = NULL;
+        code = 0;
+        (void)curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&job);
+        (void)curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+        (void)curl_multi_remove_handle(post_server->multi, curl);
+        if (job == NULL) {
+            continue;
+        }
+
+        (void)pthread_mutex_lock(&post_server->mutex);
+        __rm_running_job(post_server, job);
+        (void)pthread_mutex_unlock(&post_server->mutex);
+
+        if (res == CURLE_OK && code >= 200 && code < 300) {
+            INFO("[FLAMEGRAPH]: curl post post to %s success\n", job->url);
+            __free_post_job(job);
+            continue;
+        }
+
+        ERROR("[FLAMEGRAPH]: curl post to %s failed: %s(http %ld)\n", job->url, curl_easy_strerror(res), code);
+        __retry_post_job(post_server, job);
+    }
+}
+
+static void __wait_post_jobs(struct post_server_s *post_server)
+{
+    struct timespec ts;
+    struct post_job_s *job;
+    time_t now = time(NULL);
+
+    (void)pthread_mutex_lock(&post_server->mutex);
+    for (job = post_server->queue; job != NULL; job = job->next) {
+        if (job->next_try <= now) {
+            break;
+        }
+    }
+    if (job == NULL && !post_server->stop) {
+        (void)clock_gettime(CLOCK_REALTIME, &ts);
+        ts.tv_sec += 1;
+        (void)pthread_cond_timedwait(&post_server->cond, &post_server->mutex, &ts);
+    }
+    (void)pthread_mutex_unlock(&post_server->mutex);
+}
+
+static void *__post_running(void *arg)
+{
+    struct post_server_s *post_server = arg;
+    int running = 0;
+
+    while (!post_server->stop) {
+        __start_ready_jobs(post_server);
+        (void)curl_multi_perform(post_server->multi, &running);
+        __finish_post_jobs(post_server);
+
+        if (post_server->running_len > 0) {
+            (void)curl_multi_wait(post_server->multi, NULL, 0, POST_WAIT_MS, NULL);
+        } else {
+            __wait_post_jobs(post_server);
+        }
+    }
+    return NULL;
+}
+
+static void __post_pprof(struct post_server_s *post_server, struct post_info_s *post_info, int en_type)
+{
+    struct post_job_s *job;
+    time_t from, until;
+
+    if (post_info->pprof->samples_count == 0) {
+        DEBUG("[FLAMEGRAPH]: profile is empty. No need to curl post post to %s\n", appname[en_type]);
+        goto end;
     }
 
-    if (chunk.memory) {
-        free(chunk.memory);
+    job = (struct post_job_s *)calloc(1, sizeof(struct post_job_s));
+    if (job == NULL) {
+        goto end;
     }
-end1:
-    /* always cleanup */
-    curl_easy_cleanup(curl);
-    post_info->curl = NULL;
-end2:
-    if (post_info->buf_start != NULL) {
-        free(post_info->buf_start);
-        post_info->buf_start = NULL;
+
+    __build_url(job, post_server, en_type, &from, &until);
+    if (pprof_encode(post_info->pprof, (s64)from * NSEC_PER_SEC, (s64)(until - from) * NSEC_PER_SEC,
+        &job->data, &job->len)) {
+        ERROR("[FLAMEGRAPH]: encode pprof profile of %s failed\n", appname[en_type]);
+        __free_post_job(job);
+        goto end;
     }
+    __queue_post_job(post_server, job);
+
+end:
+    pprof_free(&post_info->pprof);
+    post_info->post_flag = 0;
     return;
 }
 
-static void __init_curl_handle(struct post_server_s *post_server, struct post_info_s *post_info)
+static void __init_post_info(struct post_server_s *post_server, struct post_info_s *post_info, int en_type)
 {
     if (post_server == NULL || post_server->post_enable == 0) {
         return;
     }
 
-    if (post_info->curl != NULL) {
-        ERROR("[FLAMEGRAPH]: curl was not freed normally\n");
-    } else {
-        post_info->curl = curl_easy_init();
-    }
-
-    if(post_info->curl) {
-        post_info->buf = (char *)malloc(g_post_max);
-        post_info->buf_start = post_info->buf;
-        if (post_info->buf != NULL) {
-            post_info->buf[0] = 0;
-            post_info->post_flag = 1;
-        }
+    post_info->pprof = pprof_new(pprof_types[en_type].type, pprof_types[en_type].unit);
+    if (post_info->pprof != NULL) {
+        post_info->post_flag = 1;
     }
 }
 
 static void __do_wr_flamegraph(struct stack_svg_mng_s *svg_mng, struct post_server_s *post_server, int en_type)
 {
     int first_flag = 0;
-    struct post_info_s post_info = {.remain_size = g_post_max, .post_flag = 0};
+    struct post_info_s post_info = {.post_flag = 0};
 
     if (__test_flame_graph_flags(svg_mng, FLAME_GRAPH_NEW)) {
         first_flag = 1;
     }
 
-    __init_curl_handle(post_server, &post_info);
+    __init_post_info(post_server, &post_info, en_type);
 
     iter_histo_tbl(svg_mng, en_type, &first_flag, &post_info);
 
     if (post_info.post_flag) {
-        __curl_post(post_server, &post_info, en_type);
+        __post_pprof(post_server, &post_info, en_type);
     }
     
     __flush_flame_graph_file(svg_mng);
@@ -383,14 +526,67 @@ int set_post_server(struct post_server_s *post_server, const char *server_str)
     }
 
     curl_global_init(CURL_GLOBAL_ALL);
-    post_server->post_enable = 1;
+    post_server->multi = curl_multi_init();
+    post_server->headers = curl_slist_append(NULL, "Content-Type: application/octet-stream");
+    if (post_server->multi == NULL || post_server->headers == NULL) {
+        goto err;
+    }
+    (void)pthread_mutex_init(&post_server->mutex, NULL);
+    (void)pthread_cond_init(&post_server->cond, NULL);
+
     post_server->timeout = 3;
     (void)strcpy(post_server->host, server_str);
 
+    if (pthread_create(&post_server->upload_thd, NULL, __post_running, (void *)post_server) != 0) {
+        ERROR("[FLAMEGRAPH]: Failed to create upload pthread.\n");
+        (void)pthread_mutex_destroy(&post_server->mutex);
+        (void)pthread_cond_destroy(&post_server->cond);
+        goto err;
+    }
+    post_server->post_enable = 1;
     return 0;
+
+err:
+    if (post_server->headers != NULL) {
+        curl_slist_free_all(post_server->headers);
+        post_server->headers = NULL;
+    }
+    if (post_server->multi != NULL) {
+        (void)curl_multi_cleanup(post_server->multi);
+        post_server->multi = NULL;
+    }
+    curl_global_cleanup();
+    return -1;
 }
 
-void clean_post_server()
+void clean_post_server(struct post_server_s *post_server)
 {
+    struct post_job_s *job;
+
+    (void)pthread_mutex_lock(&post_server->mutex);
+    post_server->stop = 1;
+    (void)pthread_cond_signal(&post_server->cond);
+    (void)pthread_mutex_unlock(&post_server->mutex);
+    (void)pthread_join(post_server->upload_thd, NULL);
+
+    while ((job = post_server->running) != NULL) {
+        post_server->running = job->next;
+        (void)curl_multi_remove_handle(post_server->multi, job->curl);
+        __free_post_job(job);
+    }
+    while ((job = post_server->queue) != NULL) {
+        post_server->queue = job->next;
+        __free_post_job(job);
+    }
+    post_server->running_len = 0;
+    post_server->queue_len = 0;
+
+    (void)curl_multi_cleanup(post_server->multi);
+    post_server->multi = NULL;
+    curl_slist_free_all(post_server->headers);
+    post_server->headers = NULL;
+    (void)pthread_mutex_destroy(&post_server->mutex);
+    (void)pthread_cond_destroy(&post_server->cond);
+    post_server->post_enable = 0;
     curl_global_cleanup();
 }
@@ -0,0 +1,449 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: folded stacks to flame graph svg
+ ******************************************************************************/
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef BPF_PROG_KERN
+#undef BPF_PROG_KERN
+#endif
+
+#ifdef BPF_PROG_USER
+#undef BPF_PROG_USER
+#endif
+
+#include "bpf.h"
+#include "flame_svg.h"
+
+/* Same layout as the defaults of flamegraph.pl, so the graphs look as before. */
+#define FLAME_IMAGE_WIDTH   1200
+#define FLAME_FRAME_HEIGHT  16
+#define FLAME_FRAME_PAD     1
+#define FLAME_FONT_SIZE     12
+#define FLAME_FONT_WIDTH    0.59
+#define FLAME_MIN_WIDTH     0.1     // frames narrower than this(in pixels) are not drawn
+#define FLAME_XPAD          10
+#define FLAME_YPAD1         (FLAME_FONT_SIZE * 3)
+#define FLAME_YPAD2         (FLAME_FONT_SIZE * 2 + 10)
+#define FLAME_ROOT_NAME     "all"
+
+struct flame_render_s {
+    FILE *fp;
+    const struct flame_svg_opt_s *opt;
+    u64 total;
+    double width_per_sample;
+    u32 image_height;
+};
+
+#if 1
+static struct flame_node_s *__new_node(const char *name, size_t len)
+{
+    struct flame_node_s *node = (struct flame_node_s *)malloc(sizeof(struct flame_node_s) + len + 1);
+    if (node == NULL) {
+        return NULL;
+    }
+    (void)memset(node, 0, sizeof(struct flame_node_s));
+    (void)memcpy(node->name, name, len);
+    node->name[len] = 0;
+    return node;
+}
+
+static void __free_node(struct flame_node_s *node, char sorted)
+{
+    struct flame_node_s *child, *tmp;
+
+    if (sorted) {
+        child = node->children;
+        while (child != NULL) {
+            tmp = child->next;
+            __free_node(child, sorted);
+            child = tmp;
+        }
+    } else {
+        H_ITER(node->children, child, tmp) {
+            H_DEL(node->children, child);
+            __free_node(child, sorted);
+        }
+    }
+    (void)free(node);
+}
+
+static struct flame_node_s *__get_child(struct flame_tree_s *tree, struct flame_node_s *parent,
+    const char *name, size_t len)
+{
+    struct flame_node_s *child = NULL;
+
+    H_FIND(parent->children, name, len, child);
+    if (child != NULL) {
+        return child;
+    }
+
+    child = __new_node(name, len);
+    if (child == NULL) {
+        return NULL;
+    }
+    H_ADD_KEYPTR(parent->children, child->name, len, child);
+    tree->nodes_count++;
+    return child;
+}
+
+static int __cmp_node(const void *a, const void *b)
+{
+    const struct flame_node_s *node_a = *(const struct flame_node_s **)a;
+    const struct flame_node_s *node_b = *(const struct flame_node_s **)b;
+
+    return strcmp(node_a->name, node_b->name);
+}
+
+/* Frames are drawn in alphabetical order, as flamegraph.pl does. 'buf' holds all nodes of the tree. */
+static void __sort_children(struct flame_node_s *node, struct flame_node_s **buf)
+{
+    struct flame_node_s *child, *tmp;
+    u32 num = 0;
+
+    H_ITER(node->children, child, tmp) {
+        buf[num++] = child;
+    }
+    if (num == 0) {
+        return;
+    }
+    HASH_CLEAR(hh, node->children);
+    qsort(buf, num, sizeof(struct flame_node_s *), __cmp_node);
+
+    for (u32 i = 0; i + 1 < num; i++) {
+        buf[i]->next = buf[i + 1];
+    }
+    buf[num - 1]->next = NULL;
+    node->children = buf[0];
+
+    for (child = node->children; child != NULL; child = child->next) {
+        __sort_children(child, buf);
+    }
+}
+
+static u32 __max_depth(struct flame_node_s *node, double width_per_sample)
+{
+    struct flame_node_s *child;
+    u32 depth, max_depth = 0;
+
+    for (child = node->children; child != NULL; child = child->next) {
+        if ((double)child->value * width_per_sample < FLAME_MIN_WIDTH) {
+            continue;
+        }
+        depth = __max_depth(child, width_per_sample) + 1;
+        max_depth = max(max_depth, depth);
+    }
+    return max_depth;
+}
+#endif
+
+#if 1
+static void __wr_escaped(FILE *fp, const char *str, size_t len)
+{
+    for (size_t i = 0; i < len && str[i] != 0; i++) {
+        switch (str[i]) {
+            case '&':
+                (void)fputs("&amp;", fp);
+                break;
+            case '<':
+                (void)fputs("&lt;", fp);
+                break;
+            case '>':
+                (void)fputs("&gt;", fp);
+                break;
+            case '"':
+                (void)fputs("&quot;", fp);
+                break;
+            default:
+                (void)fputc(str[i], fp);
+                break;
+        }
+    }
+}
+
+/* Hash of the first chars of a name in [0, 1], the namehash() of flamegraph.pl. */
+static double __name_hash(const char *name, char reverse)
+{
+    size_t len = strlen(name);
+    double vector = 0, weight = 1, max_vector = 1;
+    unsigned int mod = 10;
+    unsigned char c;
+
+    for (size_t i = 0; i < len && mod <= 12; i++) {
+        c = (unsigned char)(reverse ? name[len - 1 - i] : name[i]);
+        vector += ((double)(c % mod) / (double)(mod - 1)) * weight;
+        mod++;
+        max_vector += weight;
+        weight *= 0.70;
+    }
+    return 1 - vector / max_vector;
+}
+
+/* Colors derive from the frame name, so a function keeps its color between graphs. */
+static void __frame_color(const char *name, enum flame_color_e color, int *r, int *g, int *b)
+{
+    double v1 = __name_hash(name, 0);
+    double v2 = __name_hash(name, 1);
+
+    switch (color) {
+        case FLAME_COLOR_IO:
+            *r = 80 + (int)(60 * v1);
+            *g = *r;
+            *b = 190 + (int)(55 * v2);
+            break;
+        case FLAME_COLOR_MEM:
+            *r = 0;
+            *g = 190 + (int)(50 * v2);
+            *b = (int)(210 * v1);
+            break;
+        case FLAME_COLOR_HOT:
+        default:
+            *r = 205 + (int)(50 * v2);
+            *g = (int)(230 * v1);
+            *b = (int)(55 * v2);
+            break;
+    }
+}
+
+static void __wr_header(struct flame_render_s *render)
+{
+    FILE *fp = render->fp;
+    u32 height = render->image_height;
+
+    (void)fprintf(fp, "<?xml version=\"1.0\" standalone=\"no\"?>\n"
+        "<!DOCTYPE svg PUBLIC \"-//W3C//DTD SVG 1.1//EN\" \"http://www.w3.org/Graphics/SVG/1.1/DTD/svg11.dtd\">\n");
+    (void)fprintf(fp, "<svg version=\"1.1\" width=\"%d\" height=\"%u\" viewBox=\"0 0 %d %u\" "
+        "xmlns=\"http://www.w3.org/2000/svg\" xmlns:xlink=\"http://www.w3.org/1999/xlink\">\n",
+        FLAME_IMAGE_WIDTH, height, FLAME_IMAGE_WIDTH, height);
+    (void)fprintf(fp, "<defs>\n\t<linearGradient id=\"background\" y1=\"0\" y2=\"1\" x1=\"0\" x2=\"0\" >\n"
+        "\t\t<stop stop-color=\"#eeeeee\" offset=\"5%%\" />\n"
+        "\t\t<stop stop-color=\"#eeeeb0\" offset=\"95%%\" />\n"
+        "\t</linearGradient>\n</defs>\n");
+    (void)fprintf(fp, "<style type=\"text/css\">\n"
+        "\ttext { font-family:Verdana; font-size:%dpx; fill:rgb(0,0,0); }\n"
+        "\t#title { text-anchor:middle; font-size:%dpx; }\n"
+        "\tg:hover { stroke:black; stroke-width:0.5; cursor:pointer; }\n"
+        "</style>\n", FLAME_FONT_SIZE, FLAME_FONT_SIZE + 5);
+    (void)fprintf(fp, "<rect x=\"0.0\" y=\"0\" width=\"%d.0\" height=\"%u.0\" fill=\"url(#background)\" />\n",
+        FLAME_IMAGE_WIDTH, height);
+    (void)fprintf(fp, "<text id=\"title\" x=\"%.2f\" y=\"%d\" >", FLAME_IMAGE_WIDTH / 2.0, FLAME_FONT_SIZE * 2);
+    __wr_escaped(fp, render->opt->title ?: "", (size_t)-1);
+    (void)fprintf(fp, "</text>\n");
+}
+
+static void __wr_frame(struct flame_render_s *render, struct flame_node_s *node, u32 depth, u64 start)
+{
+    FILE *fp = render->fp;
+    double x1, x2, y1, y2;
+    size_t chars, len;
+    int r, g, b;
+
+    x1 = FLAME_XPAD + (double)start * render->width_per_sample;
+    x2 = FLAME_XPAD + (double)(start + node->value) * render->width_per_sample;
+    y1 = (double)render->image_height - FLAME_YPAD2 - (depth + 1) * FLAME_FRAME_HEIGHT + FLAME_FRAME_PAD;
+    y2 = (double)render->image_height - FLAME_YPAD2 - depth * FLAME_FRAME_HEIGHT;
+    __frame_color(node->name, render->opt->color, &r, &g, &b);
+
+    (void)fputs("<g>\n<title>", fp);
+    __wr_escaped(fp, node->name, (size_t)-1);
+    (void)fprintf(fp, " (%llu %s, %.2f%%)</title>", node->value, render->opt->count_name ?: "samples",
+        100.0 * (double)node->value / (double)render->total);
+    (void)fprintf(fp, "<rect x=\"%.1f\" y=\"%.1f\" width=\"%.1f\" height=\"%.1f\" fill=\"rgb(%d,%d,%d)\" rx=\"2\" ry=\"2\" />\n",
+        x1, y1, x2 - x1, y2 - y1, r, g, b);
+
+    /* Names are cut to the width of the frame, frames too narrow for 3 chars have no text */
+    chars = (size_t)((x2 - x1) / (FLAME_FONT_SIZE * FLAME_FONT_WIDTH));
+    (void)fprintf(fp, "<text x=\"%.2f\" y=\"%.1f\" >", x1 + 3, 3 + (y1 + y2) / 2);
+    if (chars >= 3) {
+        len = strlen(node->name);
+        if (len <= chars) {
+            __wr_escaped(fp, node->name, len);
+        } else {
+            __wr_escaped(fp, node->name, chars - 2);
+            (void)fputs("..", fp);
+        }
+    }
+    (void)fputs("</text>\n</g>\n", fp);
+}
+
+static void __wr_frames(struct flame_render_s *render, struct flame_node_s *node, u32 depth, u64 start)
+{
+    struct flame_node_s *child;
+
+    __wr_frame(render, node, depth, start);
+
+    for (child = node->children; child != NULL; child = child->next) {
+        if ((double)child->value * render->width_per_sample >= FLAME_MIN_WIDTH) {
+            __wr_frames(render, child, depth + 1, start);
+        }
+        start += child->value;
+    }
+}
+#endif
+
+struct flame_tree_s *flame_tree_new(void)
+{
+    struct flame_tree_s *tree = (struct flame_tree_s *)calloc(1, sizeof(struct flame_tree_s));
+    if (tree == NULL) {
+        return NULL;
+    }
+
+    tree->root = __new_node(FLAME_ROOT_NAME, strlen(FLAME_ROOT_NAME));
+    if (tree->root == NULL) {
+        (void)free(tree);
+        return NULL;
+    }
+    return tree;
+}
+
+void flame_tree_free(struct flame_tree_s **ptr_tree)
+{
+    struct flame_tree_s *tree = *ptr_tree;
+
+    *ptr_tree = NULL;
+    if (tree == NULL) {
+        return;
+    }
+    __free_node(tree->root, tree->sorted);
+    (void)free(tree);
+}
+
+/* Add a folded stack "a; b; c", frames are split in place. */
+int flame_tree_add(struct flame_tree_s *tree, char *stack_str, u64 count)
+{
+    struct flame_node_s *node = tree->root;
+    char *frame, *end, *next;
+
+    if (tree->sorted || count == 0) {
+        return -1;
+    }
+
+    for (frame = stack_str; frame != NULL; frame = next) {
+        next = strchr(frame, ';');
+        end = (next != NULL) ? next : frame + strlen(frame);
+        if (next != NULL) {
+            next++;
+        }
+
+        while (frame < end && *frame == ' ') {
+            frame++;
+        }
+        while (end > frame && end[-1] == ' ') {
+            end--;
+        }
+        if (frame == end) {
+            continue;
+        }
+
+        node = __get_child(tree, node, frame, (size_t)(end - frame));
+        if (node == NULL) {
+            return -1;
+        }
+        node->value += count;
+    }
+
+    tree->root->value += count;
+    return 0;
+}
+
+/* Load the folded stacks of a file, each line is "a; b; c count". */
+int flame_tree_load(struct flame_tree_s *tree, FILE *folded)
+{
+    char *line = NULL, *sep, *end;
+    size_t size = 0;
+    ssize_t len;
+    u64 count;
+    int ret = 0;
+
+    while ((len = getline(&line, &size, folded)) > 0) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r' || line[len - 1] == ' ')) {
+            line[--len] = 0;
+        }
+
+        sep = strrchr(line, ' ');
+        if (sep == NULL) {
+            continue;
+        }
+        count = strtoull(sep + 1, &end, 10);
+        if (end == sep + 1 || *end != 0 || count == 0) {
+            continue;
+        }
+        *sep = 0;
+
+        if (flame_tree_add(tree, line, count)) {
+            ret = -1;
+            break;
+        }
+    }
+
+    if (line != NULL) {
+        (void)free(line);
+    }
+    return ret;
+}
+
+/*
+ * Lay out the tree and stream it as svg. Frames are sorted and the tree is read-only since then,
+ * it can be rendered again, e.g. once to file and once to a http response.
+ */
+int flame_tree_render(struct flame_tree_s *tree, FILE *svg, const struct flame_svg_opt_s *opt)
+{
+    struct flame_render_s render = {.fp = svg, .opt = opt};
+    struct flame_node_s **buf;
+
+    if (tree->root->value == 0) {
+        return -1;
+    }
+
+    if (!tree->sorted) {
+        buf = (struct flame_node_s **)malloc(tree->nodes_count * sizeof(struct flame_node_s *));
+        if (buf == NULL) {
+            return -1;
+        }
+        __sort_children(tree->root, buf);
+        (void)free(buf);
+        tree->sorted = 1;
+    }
+
+    render.total = tree->root->value;
+    render.width_per_sample = (double)(FLAME_IMAGE_WIDTH - 2 * FLAME_XPAD) / (double)render.total;
+    tree->max_depth = __max_depth(tree->root, render.width_per_sample);
+    render.image_height = (tree->max_depth + 1) * FLAME_FRAME_HEIGHT + FLAME_YPAD1 + FLAME_YPAD2;
+
+    __wr_header(&render);
+    __wr_frames(&render, tree->root, 0, 0);
+    (void)fputs("</svg>\n", svg);
+
+    return ferror(svg) ? -1 : 0;
+}
+
+int flame_svg_render(FILE *folded, FILE *svg, const struct flame_svg_opt_s *opt)
+{
+    struct flame_tree_s *tree;
+    int ret = -1;
+
+    tree = flame_tree_new();
+    if (tree == NULL) {
+        return -1;
+    }
+
+    if (flame_tree_load(tree, folded) == 0) {
+        ret = flame_tree_render(tree, svg, opt);
+    }
+
+    flame_tree_free(&tree);
+    return ret;
+}
@@ -0,0 +1,58 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: folded stacks to flame graph svg
+ ******************************************************************************/
+#ifndef __GOPHER_FLAME_SVG_H__
+#define __GOPHER_FLAME_SVG_H__
+
+#pragma once
+
+#include <stdio.h>
+#include "hash.h"
+
+enum flame_color_e {
+    FLAME_COLOR_HOT = 0,
+    FLAME_COLOR_IO,
+    FLAME_COLOR_MEM
+};
+
+struct flame_svg_opt_s {
+    const char *title;
+    const char *count_name;
+    enum flame_color_e color;
+};
+
+struct flame_node_s {
+    H_HANDLE;                       // keyed by name, in the children table of parent
+    u64 value;                      // samples of the node and all its children
+    struct flame_node_s *children;  // table of children, turned to a sorted list by layout
+    struct flame_node_s *next;      // next sibling in the sorted list
+    char name[];
+};
+
+struct flame_tree_s {
+    struct flame_node_s *root;
+    u32 nodes_count;
+    u32 max_depth;                  // depth of the deepest frame wide enough to be drawn
+    char sorted;
+};
+
+struct flame_tree_s *flame_tree_new(void);
+void flame_tree_free(struct flame_tree_s **ptr_tree);
+int flame_tree_add(struct flame_tree_s *tree, char *stack_str, u64 count);
+int flame_tree_load(struct flame_tree_s *tree, FILE *folded);
+int flame_tree_render(struct flame_tree_s *tree, FILE *svg, const struct flame_svg_opt_s *opt);
+
+int flame_svg_render(FILE *folded, FILE *svg, const struct flame_svg_opt_s *opt);
+
+#endif
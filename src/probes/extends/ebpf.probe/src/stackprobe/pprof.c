@@ -0,0 +1,440 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: pprof profile encoder
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#ifdef BPF_PROG_KERN
+#undef BPF_PROG_KERN
+#endif
+
+#ifdef BPF_PROG_USER
+#undef BPF_PROG_USER
+#endif
+
+#include "bpf.h"
+#include "pprof.h"
+
+#define PB_BUF_STEP_SIZE    4096
+#define PPROF_TBL_STEP_COUNT    1024
+
+/* Wire types of protobuf */
+#define PB_VARINT   0
+#define PB_LEN      2
+#define PB_TAG(field, type)     (((field) << 3) | (type))
+
+/* Fields of the messages in profile.proto */
+#define PROFILE_SAMPLE_TYPE     1
+#define PROFILE_SAMPLE          2
+#define PROFILE_LOCATION        4
+#define PROFILE_FUNCTION        5
+#define PROFILE_STRING_TABLE    6
+#define PROFILE_TIME_NANOS      9
+#define PROFILE_DURATION_NANOS  10
+#define PROFILE_PERIOD_TYPE     11
+#define PROFILE_PERIOD          12
+
+#define VALUE_TYPE_TYPE         1
+#define VALUE_TYPE_UNIT         2
+
+#define SAMPLE_LOCATION_ID      1
+#define SAMPLE_VALUE            2
+
+#define LOCATION_ID             1
+#define LOCATION_LINE           4
+#define LINE_FUNCTION_ID        1
+
+#define FUNCTION_ID             1
+#define FUNCTION_NAME           2
+#define FUNCTION_SYSTEM_NAME    3
+
+#if 1
+static int __pb_reserve(struct pb_buf_s *buf, size_t size)
+{
+    unsigned char *data;
+    size_t capability;
+
+    if (buf->len + size <= buf->capability) {
+        return 0;
+    }
+
+    capability = max(buf->len + size, buf->capability + PB_BUF_STEP_SIZE);
+    capability = max(capability, buf->capability * 2);
+    data = (unsigned char *)realloc(buf->data, capability);
+    if (data == NULL) {
+        return -1;
+    }
+    buf->data = data;
+    buf->capability = capability;
+    return 0;
+}
+
+static void __pb_free(struct pb_buf_s *buf)
+{
+    if (buf->data != NULL) {
+        (void)free(buf->data);
+    }
+    (void)memset(buf, 0, sizeof(struct pb_buf_s));
+}
+
+static size_t __varint_len(u64 value)
+{
+    size_t len = 1;
+
+    while (value >= 0x80) {
+        value >>= 7;
+        len++;
+    }
+    return len;
+}
+
+/* The caller reserves the space. */
+static void __put_varint(struct pb_buf_s *buf, u64 value)
+{
+    while (value >= 0x80) {
+        buf->data[buf->len++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    buf->data[buf->len++] = (unsigned char)value;
+}
+
+static int __pb_varint(struct pb_buf_s *buf, u32 field, u64 value)
+{
+    if (__pb_reserve(buf, __varint_len(field << 3) + __varint_len(value))) {
+        return -1;
+    }
+    __put_varint(buf, PB_TAG(field, PB_VARINT));
+    __put_varint(buf, value);
+    return 0;
+}
+
+static int __pb_bytes(struct pb_buf_s *buf, u32 field, const void *data, size_t len)
+{
+    if (__pb_reserve(buf, __varint_len(field << 3) + __varint_len(len) + len)) {
+        return -1;
+    }
+    __put_varint(buf, PB_TAG(field, PB_LEN));
+    __put_varint(buf, len);
+    if (len > 0) {
+        (void)memcpy(buf->data + buf->len, data, len);
+        buf->len += len;
+    }
+    return 0;
+}
+
+static int __pb_packed(struct pb_buf_s *buf, u32 field, const u64 values[], u32 num)
+{
+    size_t len = 0;
+
+    for (u32 i = 0; i < num; i++) {
+        len += __varint_len(values[i]);
+    }
+
+    if (__pb_reserve(buf, __varint_len(field << 3) + __varint_len(len) + len)) {
+        return -1;
+    }
+    __put_varint(buf, PB_TAG(field, PB_LEN));
+    __put_varint(buf, len);
+    for (u32 i = 0; i < num; i++) {
+        __put_varint(buf, values[i]);
+    }
+    return 0;
+}
+
+/* Embed 'msg' as field 'field' of 'buf', 'msg' is reset for the next message. */
+static int __pb_message(struct pb_buf_s *buf, u32 field, struct pb_buf_s *msg)
+{
+    int ret = __pb_bytes(buf, field, msg->data, msg->len);
+    msg->len = 0;
+    return ret;
+}
+#endif
+
+#if 1
+static int __grow_array(void **array, u32 *capability, u32 count, size_t elem_size)
+{
+    void *new_array;
+    u32 new_capability;
+
+    if (count < *capability) {
+        return 0;
+    }
+
+    new_capability = *capability + PPROF_TBL_STEP_COUNT;
+    new_array = realloc(*array, (size_t)new_capability * elem_size);
+    if (new_array == NULL) {
+        return -1;
+    }
+    *array = new_array;
+    *capability = new_capability;
+    return 0;
+}
+
+static struct pprof_str_s *__intern_str(struct pprof_s *pprof, const char *str, size_t len)
+{
+    struct pprof_str_s *item = NULL;
+
+    H_FIND(pprof->str_head, str, len, item);
+    if (item != NULL) {
+        return item;
+    }
+
+    if (__grow_array((void **)&pprof->strs, &pprof->strs_capability, pprof->strs_count,
+        sizeof(struct pprof_str_s *))) {
+        return NULL;
+    }
+
+    item = (struct pprof_str_s *)malloc(sizeof(struct pprof_str_s) + len + 1);
+    if (item == NULL) {
+        return NULL;
+    }
+    (void)memset(item, 0, sizeof(struct pprof_str_s));
+    (void)memcpy(item->str, str, len);
+    item->str[len] = 0;
+    item->len = (u32)len;
+    item->idx = pprof->strs_count;
+
+    pprof->strs[pprof->strs_count++] = item;
+    H_ADD_KEYPTR(pprof->str_head, item->str, len, item);
+    return item;
+}
+
+/* Each frame name has one location and one function, both of them share the same id. */
+static int __frame_loc_id(struct pprof_s *pprof, const char *name, size_t len, u64 *loc_id)
+{
+    struct pprof_str_s *item = __intern_str(pprof, name, len);
+
+    if (item == NULL) {
+        return -1;
+    }
+
+    if (item->loc_id == 0) {
+        if (__grow_array((void **)&pprof->locs, &pprof->locs_capability, pprof->locs_count, sizeof(u32))) {
+            return -1;
+        }
+        pprof->locs[pprof->locs_count++] = item->idx;
+        item->loc_id = pprof->locs_count;
+    }
+    *loc_id = item->loc_id;
+    return 0;
+}
+
+static int __encode_value_type(struct pprof_s *pprof, struct pb_buf_s *buf, u32 field)
+{
+    struct pb_buf_s *msg = &pprof->scratch;
+
+    if (__pb_varint(msg, VALUE_TYPE_TYPE, pprof->sample_type)
+        || __pb_varint(msg, VALUE_TYPE_UNIT, pprof->sample_unit)) {
+        return -1;
+    }
+    return __pb_message(buf, field, msg);
+}
+
+static int __encode_tables(struct pprof_s *pprof, struct pb_buf_s *buf)
+{
+    struct pb_buf_s *msg = &pprof->scratch;
+    struct pb_buf_s line = {0};
+    int ret = 0;
+
+    for (u32 i = 0; i < pprof->locs_count && ret == 0; i++) {
+        u64 id = (u64)i + 1;
+        ret = __pb_varint(&line, LINE_FUNCTION_ID, id);
+        ret = ret ?: __pb_varint(msg, LOCATION_ID, id);
+        ret = ret ?: __pb_message(msg, LOCATION_LINE, &line);
+        ret = ret ?: __pb_message(buf, PROFILE_LOCATION, msg);
+    }
+
+    for (u32 i = 0; i < pprof->locs_count && ret == 0; i++) {
+        ret = __pb_varint(msg, FUNCTION_ID, (u64)i + 1);
+        ret = ret ?: __pb_varint(msg, FUNCTION_NAME, pprof->locs[i]);
+        ret = ret ?: __pb_varint(msg, FUNCTION_SYSTEM_NAME, pprof->locs[i]);
+        ret = ret ?: __pb_message(buf, PROFILE_FUNCTION, msg);
+    }
+
+    for (u32 i = 0; i < pprof->strs_count && ret == 0; i++) {
+        ret = __pb_bytes(buf, PROFILE_STRING_TABLE, pprof->strs[i]->str, pprof->strs[i]->len);
+    }
+
+    __pb_free(&line);
+    return ret;
+}
+
+static int __gzip(const unsigned char *data, size_t len, char **out, size_t *out_len)
+{
+    z_stream zs = {0};
+    uLong bound;
+    char *buf;
+
+    /* windowBits + 16 writes a gzip header and trailer */
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return -1;
+    }
+
+    bound = deflateBound(&zs, (uLong)len);
+    buf = (char *)malloc(bound);
+    if (buf == NULL) {
+        (void)deflateEnd(&zs);
+        return -1;
+    }
+
+    zs.next_in = (Bytef *)data;
+    zs.avail_in = (uInt)len;
+    zs.next_out = (Bytef *)buf;
+    zs.avail_out = (uInt)bound;
+    if (deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+        (void)deflateEnd(&zs);
+        (void)free(buf);
+        return -1;
+    }
+
+    *out = buf;
+    *out_len = (size_t)zs.total_out;
+    (void)deflateEnd(&zs);
+    return 0;
+}
+#endif
+
+struct pprof_s *pprof_new(const char *sample_type, const char *sample_unit)
+{
+    struct pprof_str_s *type, *unit;
+    struct pprof_s *pprof = (struct pprof_s *)calloc(1, sizeof(struct pprof_s));
+    if (pprof == NULL) {
+        return NULL;
+    }
+
+    /* string_table[0] must be "" */
+    if (__intern_str(pprof, "", 0) == NULL) {
+        goto err;
+    }
+    type = __intern_str(pprof, sample_type, strlen(sample_type));
+    unit = __intern_str(pprof, sample_unit, strlen(sample_unit));
+    if (type == NULL || unit == NULL) {
+        goto err;
+    }
+    pprof->sample_type = type->idx;
+    pprof->sample_unit = unit->idx;
+    return pprof;
+
+err:
+    pprof_free(&pprof);
+    return NULL;
+}
+
+void pprof_free(struct pprof_s **ptr_pprof)
+{
+    struct pprof_s *pprof = *ptr_pprof;
+
+    *ptr_pprof = NULL;
+    if (pprof == NULL) {
+        return;
+    }
+
+    HASH_CLEAR(hh, pprof->str_head);
+    for (u32 i = 0; i < pprof->strs_count; i++) {
+        (void)free(pprof->strs[i]);
+    }
+    if (pprof->strs != NULL) {
+        (void)free(pprof->strs);
+    }
+    if (pprof->locs != NULL) {
+        (void)free(pprof->locs);
+    }
+    if (pprof->loc_ids != NULL) {
+        (void)free(pprof->loc_ids);
+    }
+    __pb_free(&pprof->samples);
+    __pb_free(&pprof->scratch);
+    (void)free(pprof);
+}
+
+/* Add a folded stack "a; b; c", the root frame first. */
+int pprof_add_sample(struct pprof_s *pprof, const char *stack_str, s64 value)
+{
+    struct pb_buf_s *msg = &pprof->scratch;
+    const char *frame, *end, *next;
+    u32 num = 0;
+    u64 tmp;
+
+    for (frame = stack_str; frame != NULL; frame = next) {
+        next = strchr(frame, ';');
+        end = (next != NULL) ? next : frame + strlen(frame);
+        if (next != NULL) {
+            next++;
+        }
+
+        while (frame < end && *frame == ' ') {
+            frame++;
+        }
+        if (frame == end) {
+            continue;
+        }
+
+        if (__grow_array((void **)&pprof->loc_ids, &pprof->loc_ids_capability, num, sizeof(u64))) {
+            return -1;
+        }
+        if (__frame_loc_id(pprof, frame, (size_t)(end - frame), &pprof->loc_ids[num])) {
+            return -1;
+        }
+        num++;
+    }
+
+    if (num == 0) {
+        return 0;
+    }
+
+    /* pprof lists the leaf frame first */
+    for (u32 i = 0; i < num / 2; i++) {
+        tmp = pprof->loc_ids[i];
+        pprof->loc_ids[i] = pprof->loc_ids[num - 1 - i];
+        pprof->loc_ids[num - 1 - i] = tmp;
+    }
+
+    tmp = (u64)value;
+    msg->len = 0;
+    if (__pb_packed(msg, SAMPLE_LOCATION_ID, pprof->loc_ids, num)
+        || __pb_packed(msg, SAMPLE_VALUE, &tmp, 1)
+        || __pb_message(&pprof->samples, PROFILE_SAMPLE, msg)) {
+        return -1;
+    }
+    pprof->samples_count++;
+    return 0;
+}
+
+/* Encode the profile gzip compressed, as pprof tools and servers expect. '*out' is freed by caller. */
+int pprof_encode(struct pprof_s *pprof, s64 time_nanos, s64 duration_nanos, char **out, size_t *out_len)
+{
+    struct pb_buf_s buf = {0};
+    int ret;
+
+    pprof->scratch.len = 0;
+    ret = __encode_value_type(pprof, &buf, PROFILE_SAMPLE_TYPE);
+    if (ret == 0 && pprof->samples.len > 0) {
+        ret = __pb_reserve(&buf, pprof->samples.len);
+        if (ret == 0) {
+            (void)memcpy(buf.data + buf.len, pprof->samples.data, pprof->samples.len);
+            buf.len += pprof->samples.len;
+        }
+    }
+    ret = ret ?: __encode_tables(pprof, &buf);
+    ret = ret ?: __pb_varint(&buf, PROFILE_TIME_NANOS, (u64)time_nanos);
+    ret = ret ?: __pb_varint(&buf, PROFILE_DURATION_NANOS, (u64)duration_nanos);
+    ret = ret ?: __encode_value_type(pprof, &buf, PROFILE_PERIOD_TYPE);
+    ret = ret ?: __pb_varint(&buf, PROFILE_PERIOD, 1);
+    ret = ret ?: __gzip(buf.data, buf.len, out, out_len);
+
+    __pb_free(&buf);
+    return ret;
+}
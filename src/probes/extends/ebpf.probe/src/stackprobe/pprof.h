@@ -0,0 +1,67 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: pprof profile encoder
+ ******************************************************************************/
+#ifndef __GOPHER_PPROF_H__
+#define __GOPHER_PPROF_H__
+
+#pragma once
+
+#include "hash.h"
+
+/* Bytes of an encoded protobuf message */
+struct pb_buf_s {
+    unsigned char *data;
+    size_t len;
+    size_t capability;
+};
+
+/* Entry of the string table, a frame name also owns a location and a function of the same id. */
+struct pprof_str_s {
+    H_HANDLE;
+    u32 idx;
+    u32 loc_id;     // 0 if the string is not a frame name
+    u32 len;
+    char str[];
+};
+
+/*
+ * Profile message of pprof(github.com/google/pprof/proto/profile.proto), built sample by sample.
+ * Samples are encoded as they are added, the tables are encoded once by pprof_encode().
+ */
+struct pprof_s {
+    struct pprof_str_s *str_head;
+    struct pprof_str_s **strs;      // idx -> string
+    u32 strs_count;
+    u32 strs_capability;
+
+    u32 *locs;                      // location id - 1 -> idx of frame name
+    u32 locs_count;
+    u32 locs_capability;
+
+    u64 *loc_ids;                   // location ids of the sample being added, leaf first
+    u32 loc_ids_capability;
+
+    u32 sample_type;
+    u32 sample_unit;
+    u32 samples_count;
+    struct pb_buf_s samples;
+    struct pb_buf_s scratch;
+};
+
+struct pprof_s *pprof_new(const char *sample_type, const char *sample_unit);
+void pprof_free(struct pprof_s **ptr_pprof);
+int pprof_add_sample(struct pprof_s *pprof, const char *stack_str, s64 value);
+int pprof_encode(struct pprof_s *pprof, s64 time_nanos, s64 duration_nanos, char **out, size_t *out_len);
+
+#endif
@@ -48,4 +48,81 @@ struct raw_trace_s {
     struct stack_id_s stack_id;
 };
 
+/*
+ * Sampling mode of memleak(glibc uprobes). On average one allocation is sampled every 'sample_bytes'
+ * allocated bytes, userspace scales the sampled sizes back to the estimated allocated bytes.
+ */
+#define MEMLEAK_ALLOCS_MAX          65536   // outstanding sampled allocations
+#define MEMLEAK_BUDGET_WINDOW_NS    1000000000ULL
+
+struct memleak_args_s {
+    u64 sample_bytes;       // 0: every allocation is traced
+    u64 budget;             // max allocations traced per second, 0: unlimited
+};
+
+struct memleak_budget_s {
+    u64 window_ts;
+    u64 hits;
+    u64 drops;              // sampled allocations skipped since the budget was exhausted
+};
+
+/*
+ * DWARF unwinding of user stacks(x86_64). The .eh_frame of each binary is compiled by userspace into
+ * rows sorted by pc, telling how to find the CFA and the saved rbp from that pc on. BPF walks the user
+ * stack with them, so binaries built without frame pointers still give complete stacks.
+ */
+#define UNWIND_ROWS_MAX         (512 * 1024)
+#define UNWIND_TABLES_MAX       1024
+#define UNWIND_MAPS_MAX         128     // executable mappings of one proc
+#define UNWIND_PROCS_MAX        PROC_CACHE_MAX_COUNT
+#define UNWIND_STACKID_FLAG     (1 << 30)   // user stack id of ustackmap, never set by bpf_get_stackid()
+
+enum unwind_cfa_e {
+    UNWIND_CFA_NONE = 0,        // no frame info, fall back to frame pointer
+    UNWIND_CFA_END,             // return address undefined, the outermost frame
+    UNWIND_CFA_RSP,             // cfa = rsp + cfa_offset
+    UNWIND_CFA_RBP,             // cfa = rbp + cfa_offset
+    UNWIND_CFA_PLT              // cfa = rsp + 8 + ((rip & 15) >= 11 ? 8 : 0), the expression of .plt
+};
+
+enum unwind_rbp_e {
+    UNWIND_RBP_SAME = 0,        // rbp of caller is unchanged
+    UNWIND_RBP_CFA              // rbp of caller is saved at cfa + rbp_offset
+};
+
+struct unwind_row_s {
+    u64 pc;                     // virtual address in elf
+    u8 cfa_type;
+    u8 rbp_type;
+    s16 rbp_offset;
+    int cfa_offset;
+};
+
+/* Rows of one binary in unwind_rows, keyed by table id */
+struct unwind_table_s {
+    u32 first_row;
+    u32 rows_count;
+};
+
+struct unwind_map_s {
+    u64 start;
+    u64 end;
+    u64 bias;                   // pc in elf = ip - bias
+    u32 tbl_id;                 // unwind_tables key of the binary
+    u32 reserve;
+};
+
+/* Executable mappings of one proc sorted by start, keyed by tgid */
+struct unwind_proc_s {
+    u32 maps_count;
+    u32 reserve;
+    struct unwind_map_s maps[UNWIND_MAPS_MAX];
+};
+
+#define UNWIND_THREAD_SIZE_DEF  (4096 << 2)     // THREAD_SIZE of x86_64 without KASAN
+
+struct unwind_args_s {
+    u32 thread_size;            // the user regs are saved at the top of the kernel stack
+};
+
 #endif
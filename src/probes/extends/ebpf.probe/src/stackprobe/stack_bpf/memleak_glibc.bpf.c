@@ -63,13 +63,36 @@ struct {
     __uint(max_entries, 10000);
 } memalign_allocate SEC(".maps");
 
+// Outstanding allocations, the oldest are evicted first when full.
 struct {
-    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
     __uint(key_size, sizeof(struct pid_addr_t));
     __uint(value_size, sizeof(struct mmap_info_t));
-    __uint(max_entries, 10000);
+    __uint(max_entries, MEMLEAK_ALLOCS_MAX);
 } allocs SEC(".maps");
 
+// bytes to allocate by the thread before its next sample
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __uint(key_size, sizeof(u64));  // pid
+    __uint(value_size, sizeof(s64));
+    __uint(max_entries, 10240);
+} sample_bytes_left SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(key_size, sizeof(u32)); // const value 0
+    __uint(value_size, sizeof(struct memleak_args_s));
+    __uint(max_entries, 1);
+} memleak_args SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(key_size, sizeof(u32)); // const value 0
+    __uint(value_size, sizeof(struct memleak_budget_s));
+    __uint(max_entries, 1);
+} memleak_budget SEC(".maps");
+
 static __always_inline char is_stackmap_a(void)
 {
     const u32 zero = 0;
@@ -149,12 +172,108 @@ static __always_inline int alloc_exit(struct pt_regs *ctx, u64 addr)
     return 0;
 }
 
+/*
+ * Exponentially distributed intervals make the samples a poisson process over the allocated bytes,
+ * as tcmalloc does. -ln(U) is computed from log2 of a random u32 in 16.16 fixed point.
+ */
+static __always_inline s64 next_sample_interval(u64 mean)
+{
+    u32 r = bpf_get_prandom_u32() | 1;
+    u32 x = r, msb = 0;
+    u64 frac, neg_log2;
+
+    if (x >= (1U << 16)) {
+        msb += 16;
+        x >>= 16;
+    }
+    if (x >= (1U << 8)) {
+        msb += 8;
+        x >>= 8;
+    }
+    if (x >= (1U << 4)) {
+        msb += 4;
+        x >>= 4;
+    }
+    if (x >= (1U << 2)) {
+        msb += 2;
+        x >>= 2;
+    }
+    if (x >= (1U << 1)) {
+        msb += 1;
+    }
+
+    // r = 2^msb * (1 + f), log2(1 + f) ~= f + 0.346 * f * (1 - f)
+    frac = (((u64)r << (32 - msb)) & 0xffffffffULL) >> 16;
+    neg_log2 = ((u64)(32 - msb) << 16) - frac - ((((frac * (65536 - frac)) >> 16) * 22675) >> 16);
+
+    // ln(2) = 45426 / 65536
+    return (s64)((((mean * neg_log2) >> 16) * 45426) >> 16) + 1;
+}
+
+static __always_inline char is_sampled(u64 pid, u64 size, u64 sample_bytes)
+{
+    s64 left;
+    s64 *cur;
+
+    if (sample_bytes == 0) {
+        return 1;
+    }
+
+    cur = (s64 *)bpf_map_lookup_elem(&sample_bytes_left, &pid);
+    if (cur == NULL) {
+        left = next_sample_interval(sample_bytes) - (s64)size;
+        if (left > 0) {
+            (void)bpf_map_update_elem(&sample_bytes_left, &pid, &left, BPF_ANY);
+            return 0;
+        }
+    } else if (*cur > (s64)size) {
+        *cur -= (s64)size;
+        return 0;
+    }
+
+    left = next_sample_interval(sample_bytes);
+    (void)bpf_map_update_elem(&sample_bytes_left, &pid, &left, BPF_ANY);
+    return 1;
+}
+
+// Returns 0 if the allocations traced in the current second exceed the budget.
+static __always_inline char consume_budget(u64 budget)
+{
+    const u32 zero = 0;
+    u64 now;
+    struct memleak_budget_s *b;
+
+    if (budget == 0) {
+        return 1;
+    }
+
+    b = (struct memleak_budget_s *)bpf_map_lookup_elem(&memleak_budget, &zero);
+    if (b == NULL) {
+        return 1;
+    }
+
+    now = bpf_ktime_get_ns();
+    if (now - b->window_ts >= MEMLEAK_BUDGET_WINDOW_NS) {
+        // Racing CPUs may both reset the window, which only lets a few more hits through.
+        b->window_ts = now;
+        b->hits = 0;
+    }
+
+    if (__sync_fetch_and_add(&b->hits, 1) >= budget) {
+        __sync_fetch_and_add(&b->drops, 1);
+        return 0;
+    }
+    return 1;
+}
+
 static __always_inline int alloc_enter(u64 size)
 {
+    const u32 zero = 0;
     u64 pid = bpf_get_current_pid_tgid();
     u32 tgid = pid >> INT_LEN;
+    struct memleak_args_s *args;
+
     if (tgid > 1) {
-        const u32 zero = 0;
         struct convert_data_t *convert_data = (struct convert_data_t *)bpf_map_lookup_elem(&convert_map, &zero);
         if (!convert_data) {
             return -1;
@@ -166,6 +285,14 @@ static __always_inline int alloc_enter(u64 size)
             }
         }
     }
+
+    args = (struct memleak_args_s *)bpf_map_lookup_elem(&memleak_args, &zero);
+    if (args != NULL) {
+        // Only the sampled allocations take the stacks, they are what the budget caps.
+        if (!is_sampled(pid, size, args->sample_bytes) || !consume_budget(args->budget)) {
+            return 0;
+        }
+    }
     bpf_map_update_elem(&to_allocate, &pid, &size, BPF_ANY);
 
     return 0;
@@ -182,10 +309,15 @@ static __always_inline int free_enter(struct pt_regs *ctx, u64 addr)
         return 0;
     }
 
-    bpf_map_delete_elem(&allocs, &pa);
+    // The element is freed by the delete, copy out what is reported first.
+    s64 size = mmap_info->size;
+    struct stack_id_s stack_id = mmap_info->stack_id;
+    if (bpf_map_delete_elem(&allocs, &pa)) {
+        return 0;   // deleted by a racing free, which reports it
+    }
 
     char stackmap_cur = is_stackmap_a();
-    update_statistics(ctx, stackmap_cur, -mmap_info->size, mmap_info->stack_id);
+    update_statistics(ctx, stackmap_cur, -size, stack_id);
     return 0;
 }
 
@@ -262,13 +394,15 @@ UPROBE(posix_memalign, pt_regs)
 URETPROBE(posix_memalign, pt_regs)
 {
     u64 pid = bpf_get_current_pid_tgid();
-    u64 addr;
-    u64 *memptr = (u64 *)bpf_map_lookup_elem(&memalign_allocate, &pid);
-    if (memptr == 0)
+    u64 addr, memptr;
+    u64 *ptr = (u64 *)bpf_map_lookup_elem(&memalign_allocate, &pid);
+    if (ptr == 0)
         return 0;
+    memptr = *ptr;
     bpf_map_delete_elem(&memalign_allocate, &pid);
 
-    if (bpf_probe_read_user(&addr, sizeof(u64), &memptr))
+    // posix_memalign() returns the address through its first argument.
+    if (bpf_probe_read_user(&addr, sizeof(u64), (void *)memptr))
         return 0;
 
     alloc_exit(ctx, addr);
@@ -333,15 +467,15 @@ URETPROBE(aligned_alloc, pt_regs)
 
 UPROBE(free, pt_regs)
 {
-    u64 size = (u64)PT_REGS_PARM2(ctx);
-    free_enter(ctx, size);
+    u64 addr = (u64)PT_REGS_PARM1(ctx);
+    free_enter(ctx, addr);
     return 0;
 }
 
 UPROBE(munmap, pt_regs)
 {
-    u64 size = (u64)PT_REGS_PARM1(ctx);
-    free_enter(ctx, size);
+    u64 addr = (u64)PT_REGS_PARM1(ctx);
+    free_enter(ctx, addr);
     return 0;
 }
 
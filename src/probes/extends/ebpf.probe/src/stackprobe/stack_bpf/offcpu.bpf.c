@@ -19,6 +19,7 @@
 #include "bpf.h"
 #include "../stack.h"
 #include "stackprobe_bpf.h"
+#include "unwind_bpf.h"
 
 char g_linsence[] SEC("license") = "GPL";
 
@@ -128,12 +129,18 @@ int bpf_trace_sched_switch_func(struct trace_event_raw_sched_switch *ctx)
         stack_id->pid.proc_id = prev_tgid;
         stack_id->pid.real_start_time = get_real_start_time();
         (void)bpf_get_current_comm(&stack_id->comm, sizeof(stack_id->comm));
-        if (((convert_data->convert_counter % 2) == 0)) { // % 2 代表对stackmap_a和stackmap_b的选择
+        char is_stackmap_a = ((convert_data->convert_counter % 2) == 0); // % 2 代表对stackmap_a和stackmap_b的选择
+        stack_id->user_stack_id = unwind_user_stack(prev_tgid, is_stackmap_a);
+        if (is_stackmap_a) {
             stack_id->kern_stack_id = bpf_get_stackid(ctx, &stackmap_a, KERN_STACKID_FLAGS);
-            stack_id->user_stack_id = bpf_get_stackid(ctx, &stackmap_a, USER_STACKID_FLAGS);
+            if (stack_id->user_stack_id < 0) {
+                stack_id->user_stack_id = bpf_get_stackid(ctx, &stackmap_a, USER_STACKID_FLAGS);
+            }
         } else {
             stack_id->kern_stack_id = bpf_get_stackid(ctx, &stackmap_b, KERN_STACKID_FLAGS);
-            stack_id->user_stack_id = bpf_get_stackid(ctx, &stackmap_b, USER_STACKID_FLAGS);
+            if (stack_id->user_stack_id < 0) {
+                stack_id->user_stack_id = bpf_get_stackid(ctx, &stackmap_b, USER_STACKID_FLAGS);
+            }
         }
         if (stack_id->kern_stack_id < 0 && stack_id->user_stack_id < 0) {
             return -1;
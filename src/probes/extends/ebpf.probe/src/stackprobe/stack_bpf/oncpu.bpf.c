@@ -19,6 +19,7 @@
 #include "bpf.h"
 #include "../stack.h"
 #include "stackprobe_bpf.h"
+#include "unwind_bpf.h"
 
 char g_linsence[] SEC("license") = "GPL";
 
@@ -77,12 +78,17 @@ int function_stack_trace(struct bpf_perf_event_data *ctx)
     // test found that the comm is thread command
     (void)bpf_get_current_comm(&raw_trace.stack_id.comm, sizeof(raw_trace.stack_id.comm));
 
+    raw_trace.stack_id.user_stack_id = unwind_user_stack(raw_trace.stack_id.pid.proc_id, is_stackmap_a);
     if (is_stackmap_a) {
         raw_trace.stack_id.kern_stack_id = bpf_get_stackid(ctx, &stackmap_a, KERN_STACKID_FLAGS);
-        raw_trace.stack_id.user_stack_id = bpf_get_stackid(ctx, &stackmap_a, USER_STACKID_FLAGS);
+        if (raw_trace.stack_id.user_stack_id < 0) {
+            raw_trace.stack_id.user_stack_id = bpf_get_stackid(ctx, &stackmap_a, USER_STACKID_FLAGS);
+        }
     } else {
         raw_trace.stack_id.kern_stack_id = bpf_get_stackid(ctx, &stackmap_b, KERN_STACKID_FLAGS);
-        raw_trace.stack_id.user_stack_id = bpf_get_stackid(ctx, &stackmap_b, USER_STACKID_FLAGS);
+        if (raw_trace.stack_id.user_stack_id < 0) {
+            raw_trace.stack_id.user_stack_id = bpf_get_stackid(ctx, &stackmap_b, USER_STACKID_FLAGS);
+        }
     }
     if (raw_trace.stack_id.kern_stack_id < 0 && raw_trace.stack_id.user_stack_id < 0) {
         // error.
@@ -0,0 +1,322 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: dwarf unwinding of user stacks
+ ******************************************************************************/
+#ifndef __STACK_UNWIND_BPF_H__
+#define __STACK_UNWIND_BPF_H__
+
+#pragma once
+
+/*
+ * Bounded loops, global functions and bpf_probe_read_user() are all required.
+ * STACK_NO_UNWIND builds the frame pointer only objects(*_fp.bpf.o), see dwarf_unwind of stackprobe.conf.
+ */
+#if defined(__TARGET_ARCH_x86) && (CURRENT_KERNEL_VERSION >= KERNEL_VERSION(5, 10, 0)) && !defined(STACK_NO_UNWIND)
+
+#define UNWIND_ROWS_SEARCH      20          // > log2(UNWIND_ROWS_MAX)
+#define UNWIND_MAPS_SEARCH      8           // > log2(UNWIND_MAPS_MAX)
+#define UNWIND_PLT_OFFSET       11
+
+#if (CURRENT_KERNEL_VERSION >= KERNEL_VERSION(5, 15, 0)) && (CURRENT_LIBBPF_VERSION >= LIBBPF_VERSION(0, 6))
+#define UNWIND_TASK_PT_REGS
+#endif
+
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(key_size, sizeof(u32));
+    __uint(value_size, sizeof(struct unwind_row_s));
+    __uint(max_entries, UNWIND_ROWS_MAX);
+} unwind_rows SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(key_size, sizeof(u32));  // table id
+    __uint(value_size, sizeof(struct unwind_table_s));
+    __uint(max_entries, UNWIND_TABLES_MAX);
+} unwind_tables SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(key_size, sizeof(u32));  // tgid
+    __uint(value_size, sizeof(struct unwind_proc_s));
+    __uint(max_entries, UNWIND_PROCS_MAX);
+} unwind_procs SEC(".maps");
+
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(key_size, sizeof(u32));
+    __uint(value_size, PERF_MAX_STACK_DEPTH * sizeof(u64));
+    __uint(max_entries, 1);
+} unwind_ips SEC(".maps");
+
+/* User stacks unwound with DWARF, values are laid out as stackmap. Data channel A */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(key_size, sizeof(u32));
+    __uint(value_size, PERF_MAX_STACK_DEPTH * sizeof(u64));
+    __uint(max_entries, MAX_PERCPU_SAMPLE_COUNT);
+} ustackmap_a SEC(".maps");
+
+/* Data channel B */
+struct {
+    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(key_size, sizeof(u32));
+    __uint(value_size, PERF_MAX_STACK_DEPTH * sizeof(u64));
+    __uint(max_entries, MAX_PERCPU_SAMPLE_COUNT);
+} ustackmap_b SEC(".maps");
+
+/* THREAD_SIZE of the running kernel, set by userspace. Unused if bpf_task_pt_regs() is supported. */
+struct {
+    __uint(type, BPF_MAP_TYPE_ARRAY);
+    __uint(key_size, sizeof(u32));
+    __uint(value_size, sizeof(struct unwind_args_s));
+    __uint(max_entries, 1);
+} unwind_args SEC(".maps");
+
+struct unwind_regs_s {
+    u64 ip;
+    u64 sp;
+    u64 bp;
+};
+
+/*
+ * The searches are global functions, the verifier checks them once instead of once per frame.
+ * Return the index of the mapping containing 'ip', or -1.
+ */
+__noinline int unwind_find_map(u32 tgid, u64 ip)
+{
+    u32 lo = 0, hi, mid;
+    struct unwind_proc_s *proc = (struct unwind_proc_s *)bpf_map_lookup_elem(&unwind_procs, &tgid);
+
+    if (proc == NULL) {
+        return -1;
+    }
+
+    hi = proc->maps_count;
+    for (int i = 0; i < UNWIND_MAPS_SEARCH && lo < hi; i++) {
+        mid = (lo + hi) / 2;
+        if (mid >= UNWIND_MAPS_MAX) {
+            return -1;
+        }
+        if (proc->maps[mid].start <= ip) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    // The last mapping starting at or before ip
+    if (lo == 0 || lo > UNWIND_MAPS_MAX) {
+        return -1;
+    }
+    lo--;
+    if (ip >= proc->maps[lo].end) {
+        return -1;
+    }
+    return (int)lo;
+}
+
+/* Return the index of the last row at or before 'pc' in the table, or -1. */
+__noinline int unwind_find_row(u32 first_row, u32 rows_count, u64 pc)
+{
+    u32 lo = first_row, hi = first_row + rows_count, mid;
+    struct unwind_row_s *row;
+
+    for (int i = 0; i < UNWIND_ROWS_SEARCH && lo < hi; i++) {
+        mid = lo + (hi - lo) / 2;
+        row = (struct unwind_row_s *)bpf_map_lookup_elem(&unwind_rows, &mid);
+        if (row == NULL) {
+            return -1;
+        }
+        if (row->pc <= pc) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo == first_row) {
+        return -1;
+    }
+    return (int)(lo - 1);
+}
+
+/* task_pt_regs(), the context of a sample may be kernel mode while the user regs are needed. */
+static __always_inline struct pt_regs *__unwind_task_regs(struct task_struct *task)
+{
+#ifdef UNWIND_TASK_PT_REGS
+    return (struct pt_regs *)bpf_task_pt_regs(bpf_get_current_task_btf());
+#else
+    const u32 zero = 0;
+    void *stack = _(task->stack);
+    struct unwind_args_s *args = (struct unwind_args_s *)bpf_map_lookup_elem(&unwind_args, &zero);
+
+    // The user regs are saved at the top of the kernel stack, its size depends on the kernel config(e.g. KASAN).
+    if (stack == NULL || args == NULL || args->thread_size == 0) {
+        return NULL;
+    }
+    return (struct pt_regs *)(stack + args->thread_size) - 1;
+#endif
+}
+
+static __always_inline int __unwind_user_regs(struct unwind_regs_s *regs)
+{
+    struct pt_regs *user_regs;
+    struct task_struct *task = (struct task_struct *)bpf_get_current_task();
+
+    if (task == NULL || _(task->mm) == NULL) {
+        return -1;  // kernel thread
+    }
+
+    user_regs = __unwind_task_regs(task);
+    if (user_regs == NULL) {
+        return -1;
+    }
+    regs->ip = _(user_regs->ip);
+    regs->sp = _(user_regs->sp);
+    regs->bp = _(user_regs->bp);
+    return (regs->ip == 0) ? -1 : 0;
+}
+
+static __always_inline struct unwind_row_s *__unwind_lookup_row(struct unwind_proc_s *proc, u32 tgid, u64 pc)
+{
+    int map_idx, row_idx;
+    u32 key;
+    struct unwind_table_s *tbl;
+
+    map_idx = unwind_find_map(tgid, pc);
+    if (map_idx < 0 || map_idx >= UNWIND_MAPS_MAX) {
+        return NULL;
+    }
+    tbl = (struct unwind_table_s *)bpf_map_lookup_elem(&unwind_tables, &(proc->maps[map_idx].tbl_id));
+    if (tbl == NULL) {
+        return NULL;
+    }
+    row_idx = unwind_find_row(tbl->first_row, tbl->rows_count, pc - proc->maps[map_idx].bias);
+    if (row_idx < 0) {
+        return NULL;
+    }
+    key = (u32)row_idx;
+    return (struct unwind_row_s *)bpf_map_lookup_elem(&unwind_rows, &key);
+}
+
+/*
+ * Stack ids are hashes of the ips, an id already taken by another stack must not be overwritten,
+ * the caller then falls back to bpf_get_stackid().
+ */
+static __always_inline int __unwind_save_stack(void *stackmap, u32 stack_id, const u64 *ips)
+{
+    u64 *saved;
+
+    if (bpf_map_update_elem(stackmap, &stack_id, ips, BPF_NOEXIST) == 0) {
+        return 0;
+    }
+
+    saved = (u64 *)bpf_map_lookup_elem(stackmap, &stack_id);
+    if (saved == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < PERF_MAX_STACK_DEPTH; i++) {
+        if (saved[i] != ips[i]) {
+            return -1;
+        }
+        if (ips[i] == 0) {
+            break;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Unwind the user stack of current task with the tables of its binaries, frames without frame info
+ * (e.g. JIT code) are walked by frame pointer. Return the stack id in ustackmap, or -1 if the proc has
+ * no tables, then the caller falls back to bpf_get_stackid().
+ */
+static __always_inline int unwind_user_stack(u32 tgid, char is_stackmap_a)
+{
+    const u32 zero = 0;
+    u32 stack_id;
+    u64 cfa, ra, pc, hash = 0xcbf29ce484222325ULL;
+    u64 *ips;
+    struct unwind_regs_s regs;
+    struct unwind_row_s *row;
+    struct unwind_proc_s *proc;
+
+    proc = (struct unwind_proc_s *)bpf_map_lookup_elem(&unwind_procs, &tgid);
+    if (proc == NULL) {
+        return -1;
+    }
+    ips = (u64 *)bpf_map_lookup_elem(&unwind_ips, &zero);
+    if (ips == NULL) {
+        return -1;
+    }
+    if (__unwind_user_regs(&regs)) {
+        return -1;
+    }
+    __builtin_memset(ips, 0, PERF_MAX_STACK_DEPTH * sizeof(u64));
+
+    for (int i = 0; i < PERF_MAX_STACK_DEPTH; i++) {
+        ips[i] = regs.ip;
+        hash = (hash ^ regs.ip) * 0x100000001b3ULL;
+
+        // A return address follows the call, which may be the last instruction of the function.
+        pc = (i == 0) ? regs.ip : regs.ip - 1;
+        row = __unwind_lookup_row(proc, tgid, pc);
+        if (row == NULL || row->cfa_type == UNWIND_CFA_NONE) {
+            if (regs.bp == 0) {
+                break;
+            }
+            cfa = regs.bp + 16;
+            if (bpf_probe_read_user(&regs.bp, sizeof(u64), (void *)(cfa - 16))) {
+                break;
+            }
+        } else if (row->cfa_type == UNWIND_CFA_END) {
+            break;
+        } else {
+            if (row->cfa_type == UNWIND_CFA_RSP) {
+                cfa = regs.sp + row->cfa_offset;
+            } else if (row->cfa_type == UNWIND_CFA_RBP) {
+                cfa = regs.bp + row->cfa_offset;
+            } else {
+                cfa = regs.sp + 8 + (((regs.ip & 15) >= UNWIND_PLT_OFFSET) ? 8 : 0);
+            }
+            if (row->rbp_type == UNWIND_RBP_CFA &&
+                bpf_probe_read_user(&regs.bp, sizeof(u64), (void *)(cfa + row->rbp_offset))) {
+                break;
+            }
+        }
+
+        if (bpf_probe_read_user(&ra, sizeof(u64), (void *)(cfa - 8)) || ra == 0) {
+            break;
+        }
+        regs.ip = ra;
+        regs.sp = cfa;
+    }
+
+    stack_id = ((u32)(hash ^ (hash >> 32)) & (UNWIND_STACKID_FLAG - 1)) | UNWIND_STACKID_FLAG;
+    if (__unwind_save_stack(is_stackmap_a ? (void *)&ustackmap_a : (void *)&ustackmap_b, stack_id, ips)) {
+        return -1;
+    }
+    return (int)stack_id;
+}
+
+#else
+
+static __always_inline int unwind_user_stack(u32 tgid, char is_stackmap_a)
+{
+    return -1;
+}
+
+#endif
+
+#endif
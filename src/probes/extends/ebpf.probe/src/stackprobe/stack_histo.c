@@ -0,0 +1,411 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: stack histogram
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef BPF_PROG_KERN
+#undef BPF_PROG_KERN
+#endif
+
+#ifdef BPF_PROG_USER
+#undef BPF_PROG_USER
+#endif
+
+#include "bpf.h"
+#include "stack_histo.h"
+
+#define FRAME_TBL_STEP_COUNT    1024
+#define FOLD_BUF_STEP_SIZE      4096
+
+#if 1
+/* Return 1 if the sample is folded into an existing item, 0 if new, -1 if failed. */
+int add_stack_id_histo(struct stack_id_histo_s **head, struct stack_id_s *stack_id, s64 count)
+{
+    struct stack_id_key_s key;
+    struct stack_id_histo_s *item = NULL;
+
+    (void)memset(&key, 0, sizeof(key));
+    key.pid.real_start_time = stack_id->pid.real_start_time;
+    key.pid.proc_id = stack_id->pid.proc_id;
+    key.kern_stack_id = stack_id->kern_stack_id;
+    key.user_stack_id = stack_id->user_stack_id;
+
+    H_FIND(*head, &key, sizeof(struct stack_id_key_s), item);
+    if (item) {
+        item->count += count;
+        return 1;
+    }
+
+    item = (struct stack_id_histo_s *)malloc(sizeof(struct stack_id_histo_s));
+    if (!item) {
+        return -1;
+    }
+    (void)memset(item, 0, sizeof(struct stack_id_histo_s));
+    (void)memcpy(&item->k, &key, sizeof(struct stack_id_key_s));
+    (void)memcpy(item->comm, stack_id->comm, TASK_COMM_LEN);
+    item->comm[TASK_COMM_LEN - 1] = 0;
+    item->count = count;
+    H_ADD(*head, k, sizeof(struct stack_id_key_s), item);
+    return 0;
+}
+
+void clear_stack_id_histo(struct stack_id_histo_s **head)
+{
+    struct stack_id_histo_s *item, *tmp;
+
+    H_ITER(*head, item, tmp) {
+        H_DEL(*head, item);
+        if (item->frames) {
+            (void)free(item->frames);
+        }
+        (void)free(item);
+    }
+    *head = NULL;
+}
+#endif
+
+#if 1
+struct stack_frame_tbl_s *create_frame_tbl(void)
+{
+    struct stack_frame_tbl_s *tbl = (struct stack_frame_tbl_s *)malloc(sizeof(struct stack_frame_tbl_s));
+    if (!tbl) {
+        return NULL;
+    }
+    (void)memset(tbl, 0, sizeof(struct stack_frame_tbl_s));
+    return tbl;
+}
+
+void clear_frame_tbl(struct stack_frame_tbl_s *tbl)
+{
+    struct stack_frame_s *frame, *tmp;
+
+    if (!tbl) {
+        return;
+    }
+
+    H_ITER(tbl->head, frame, tmp) {
+        H_DEL(tbl->head, frame);
+        (void)free(frame);
+    }
+    tbl->head = NULL;
+    tbl->count = 0;
+}
+
+void destroy_frame_tbl(struct stack_frame_tbl_s **ptr_tbl)
+{
+    struct stack_frame_tbl_s *tbl = *ptr_tbl;
+
+    *ptr_tbl = NULL;
+    if (!tbl) {
+        return;
+    }
+
+    clear_frame_tbl(tbl);
+    if (tbl->frames) {
+        (void)free(tbl->frames);
+    }
+    (void)free(tbl);
+}
+
+int intern_frame(struct stack_frame_tbl_s *tbl, const char *name, u32 *id)
+{
+    size_t len;
+    u32 new_capa;
+    struct stack_frame_s **new_frames;
+    struct stack_frame_s *frame = NULL;
+
+    H_FIND_S(tbl->head, name, frame);
+    if (frame) {
+        *id = frame->id;
+        return 0;
+    }
+
+    if (tbl->count >= tbl->capability) {
+        new_capa = (tbl->capability == 0) ? FRAME_TBL_STEP_COUNT : (tbl->capability * 2);
+        new_frames = (struct stack_frame_s **)realloc(tbl->frames, new_capa * sizeof(struct stack_frame_s *));
+        if (!new_frames) {
+            return -1;
+        }
+        tbl->frames = new_frames;
+        tbl->capability = new_capa;
+    }
+
+    len = strlen(name);
+    frame = (struct stack_frame_s *)malloc(sizeof(struct stack_frame_s) + len + 1);
+    if (!frame) {
+        return -1;
+    }
+    (void)memset(frame, 0, sizeof(struct stack_frame_s));
+    (void)memcpy(frame->name, name, len + 1);
+    frame->id = tbl->count;
+    tbl->frames[tbl->count++] = frame;
+    H_ADD_KEYPTR(tbl->head, frame->name, len, frame);
+
+    *id = frame->id;
+    return 0;
+}
+#endif
+
+#if 1
+struct stack_trie_s *create_stack_trie(void)
+{
+    struct stack_trie_s *trie = (struct stack_trie_s *)malloc(sizeof(struct stack_trie_s));
+    if (!trie) {
+        return NULL;
+    }
+    (void)memset(trie, 0, sizeof(struct stack_trie_s));
+    return trie;
+}
+
+void clear_stack_trie(struct stack_trie_s *trie)
+{
+    struct stack_node_s *node, *tmp;
+    struct stack_anchor_s *anchor, *anchor_tmp;
+
+    if (!trie) {
+        return;
+    }
+
+    H_ITER(trie->anchors, anchor, anchor_tmp) {
+        H_DEL(trie->anchors, anchor);
+        (void)free(anchor);
+    }
+    H_ITER(trie->nodes, node, tmp) {
+        H_DEL(trie->nodes, node);
+        (void)free(node);
+    }
+    (void)memset(trie, 0, sizeof(struct stack_trie_s));
+}
+
+void destroy_stack_trie(struct stack_trie_s **ptr_trie)
+{
+    struct stack_trie_s *trie = *ptr_trie;
+
+    *ptr_trie = NULL;
+    if (!trie) {
+        return;
+    }
+    clear_stack_trie(trie);
+    (void)free(trie);
+}
+
+static struct stack_node_s *__get_child(struct stack_trie_s *trie, struct stack_node_s *parent, u32 frame,
+    char create, char *is_new)
+{
+    struct stack_node_key_s key = {.parent = parent->id, .frame = frame};
+    struct stack_node_s *child = NULL;
+
+    *is_new = 0;
+    H_FIND(trie->nodes, &key, sizeof(struct stack_node_key_s), child);
+    if (child || !create) {
+        return child;
+    }
+
+    child = (struct stack_node_s *)malloc(sizeof(struct stack_node_s));
+    if (!child) {
+        return NULL;
+    }
+    (void)memset(child, 0, sizeof(struct stack_node_s));
+    child->k = key;
+    child->id = ++trie->nodes_count;
+    child->proc = parent->proc;
+    child->sibling = parent->child;
+    parent->child = child;
+    H_ADD(trie->nodes, k, sizeof(struct stack_node_key_s), child);
+
+    *is_new = 1;
+    return child;
+}
+
+static void __add_anchor(struct stack_trie_s *trie, u32 proc, u32 frame_a, struct stack_node_s *node)
+{
+    struct stack_anchor_key_s key = {.proc = proc, .frame_a = frame_a, .frame_b = node->k.frame};
+    struct stack_anchor_s *anchor = NULL;
+
+    H_FIND(trie->anchors, &key, sizeof(struct stack_anchor_key_s), anchor);
+    if (anchor) {
+        return;
+    }
+
+    anchor = (struct stack_anchor_s *)malloc(sizeof(struct stack_anchor_s));
+    if (!anchor) {
+        return;     // Only fewer incomplete stacks are merged.
+    }
+    (void)memset(anchor, 0, sizeof(struct stack_anchor_s));
+    anchor->k = key;
+    anchor->node = node;
+    H_ADD(trie->anchors, k, sizeof(struct stack_anchor_key_s), anchor);
+}
+
+/*
+ * Add a complete stack, the first 'proc_depth' frames identify the process.
+ * Return 1 if the stack is folded into an existing path, 0 if new, -1 if failed.
+ */
+int stack_trie_add(struct stack_trie_s *trie, const u32 frames[], u32 num, u32 proc_depth, s64 count)
+{
+    char is_new, folded = 1;
+    struct stack_node_s *node = &trie->root, *child;
+
+    if (num == 0 || proc_depth == 0 || proc_depth > num) {
+        return -1;
+    }
+
+    for (u32 i = 0; i < num; i++) {
+        child = __get_child(trie, node, frames[i], 1, &is_new);
+        if (!child) {
+            return -1;
+        }
+        if (is_new) {
+            folded = 0;
+            if (i == proc_depth - 1) {
+                child->proc = child->id;
+            } else if (i > proc_depth) {
+                __add_anchor(trie, child->proc, frames[i - 1], child);
+            }
+        }
+        node = child;
+    }
+
+    node->count += count;
+    return folded;
+}
+
+/*
+ * Merge an incomplete stack, whose outermost frames are lost. Its first two user frames are
+ * looked up in the complete stacks of the same process and the rest is grafted there.
+ * Return -1 if no complete stack contains them, the sample is dropped then.
+ */
+int stack_trie_merge(struct stack_trie_s *trie, const u32 frames[], u32 num, u32 proc_depth, s64 count)
+{
+    char is_new;
+    struct stack_anchor_key_s key;
+    struct stack_anchor_s *anchor = NULL;
+    struct stack_node_s *node = &trie->root, *child;
+
+    if (proc_depth == 0 || num < proc_depth + 2) {
+        return -1;
+    }
+
+    for (u32 i = 0; i < proc_depth; i++) {
+        node = __get_child(trie, node, frames[i], 0, &is_new);
+        if (!node) {
+            return -1;
+        }
+    }
+
+    (void)memset(&key, 0, sizeof(key));
+    key.proc = node->id;
+    key.frame_a = frames[proc_depth];
+    key.frame_b = frames[proc_depth + 1];
+    H_FIND(trie->anchors, &key, sizeof(struct stack_anchor_key_s), anchor);
+    if (!anchor) {
+        return -1;
+    }
+
+    node = anchor->node;
+    for (u32 i = proc_depth + 2; i < num; i++) {
+        child = __get_child(trie, node, frames[i], 1, &is_new);
+        if (!child) {
+            return -1;
+        }
+        node = child;
+    }
+
+    node->count += count;
+    return 0;
+}
+
+struct stack_fold_s {
+    struct stack_frame_tbl_s *tbl;
+    char *buf;
+    size_t size;
+    stack_fold_cb cb;
+    void *ctx;
+};
+
+static int __reserve_fold_buf(struct stack_fold_s *fold, size_t size)
+{
+    char *new_buf;
+    size_t new_size;
+
+    if (size <= fold->size) {
+        return 0;
+    }
+
+    new_size = max(size, fold->size + FOLD_BUF_STEP_SIZE);
+    new_buf = (char *)realloc(fold->buf, new_size);
+    if (!new_buf) {
+        return -1;
+    }
+    fold->buf = new_buf;
+    fold->size = new_size;
+    return 0;
+}
+
+static int __fold_node(struct stack_fold_s *fold, struct stack_node_s *node, size_t len)
+{
+    size_t name_len, pos;
+    const char *name;
+    struct stack_node_s *child;
+
+    for (child = node->child; child != NULL; child = child->sibling) {
+        if (child->k.frame >= fold->tbl->count) {
+            continue;
+        }
+        name = fold->tbl->frames[child->k.frame]->name;
+        name_len = strlen(name);
+
+        // The path is built in place, each child overwrites the tail of its siblings.
+        if (__reserve_fold_buf(fold, len + name_len + 3)) {
+            return -1;
+        }
+        pos = len;
+        if (pos > 0) {
+            fold->buf[pos++] = ';';
+            fold->buf[pos++] = ' ';
+        }
+        (void)memcpy(fold->buf + pos, name, name_len);
+        pos += name_len;
+        fold->buf[pos] = 0;
+
+        if (child->count > 0) {
+            (void)fold->cb(fold->buf, (u64)child->count, fold->ctx);
+        }
+
+        if (__fold_node(fold, child, pos)) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* Convert the trie to folded stacks, 'cb' is called for each stack with samples. */
+int stack_trie_fold(struct stack_trie_s *trie, struct stack_frame_tbl_s *tbl, stack_fold_cb cb, void *ctx)
+{
+    int ret;
+    struct stack_fold_s fold = {.tbl = tbl, .cb = cb, .ctx = ctx};
+
+    if (!trie || !tbl) {
+        return -1;
+    }
+
+    ret = __fold_node(&fold, &trie->root, 0);
+    if (fold.buf) {
+        (void)free(fold.buf);
+    }
+    return ret;
+}
+#endif
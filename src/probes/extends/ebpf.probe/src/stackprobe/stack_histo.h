@@ -0,0 +1,113 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: stack histogram defined
+ ******************************************************************************/
+#ifndef __GOPHER_STACK_HISTO_H__
+#define __GOPHER_STACK_HISTO_H__
+
+#pragma once
+
+#include "hash.h"
+#include "stack.h"
+
+/*
+ * Raw samples of one period, aggregated by stack id. A stack id is only valid within the
+ * stackmap of its period, so the histogram is dropped once converted.
+ */
+struct stack_id_key_s {
+    struct stack_pid_s pid;
+    int kern_stack_id;
+    int user_stack_id;
+};
+
+struct stack_id_histo_s {
+    H_HANDLE;
+    struct stack_id_key_s k;
+    char comm[TASK_COMM_LEN];   // thread comm of the first sample
+    s64 count;
+    u32 frames_num;
+    u32 proc_depth;
+    u32 *frames;                // frames of an incomplete stack, merged after the complete ones
+};
+
+/* Frame names interned in one table, shared by all histograms of a period. */
+struct stack_frame_s {
+    H_HANDLE;
+    u32 id;
+    char name[];
+};
+
+struct stack_frame_tbl_s {
+    struct stack_frame_s *head;
+    struct stack_frame_s **frames;  // id -> frame
+    u32 count;
+    u32 capability;
+};
+
+/*
+ * Prefix trie of frame ids. A path from the root is a stack, as [Pod]; [Con]; [pid]comm; user frames.
+ * Identical stacks share one path, so a flush is linear in the number of nodes.
+ */
+struct stack_node_key_s {
+    u32 parent;     // id of parent node, 0 is the root
+    u32 frame;
+};
+
+struct stack_node_s {
+    H_HANDLE;
+    struct stack_node_key_s k;
+    u32 id;
+    u32 proc;                   // id of the process node, 0 above it
+    s64 count;                  // samples whose stack ends here
+    struct stack_node_s *child;
+    struct stack_node_s *sibling;
+};
+
+/* Indexes where two successive frames first appear in a process, used to merge incomplete stacks. */
+struct stack_anchor_key_s {
+    u32 proc;
+    u32 frame_a;
+    u32 frame_b;
+};
+
+struct stack_anchor_s {
+    H_HANDLE;
+    struct stack_anchor_key_s k;
+    struct stack_node_s *node;
+};
+
+struct stack_trie_s {
+    struct stack_node_s root;
+    struct stack_node_s *nodes;
+    struct stack_anchor_s *anchors;
+    u32 nodes_count;
+};
+
+int add_stack_id_histo(struct stack_id_histo_s **head, struct stack_id_s *stack_id, s64 count);
+void clear_stack_id_histo(struct stack_id_histo_s **head);
+
+struct stack_frame_tbl_s *create_frame_tbl(void);
+void clear_frame_tbl(struct stack_frame_tbl_s *tbl);
+void destroy_frame_tbl(struct stack_frame_tbl_s **ptr_tbl);
+int intern_frame(struct stack_frame_tbl_s *tbl, const char *name, u32 *id);
+
+struct stack_trie_s *create_stack_trie(void);
+void clear_stack_trie(struct stack_trie_s *trie);
+void destroy_stack_trie(struct stack_trie_s **ptr_trie);
+int stack_trie_add(struct stack_trie_s *trie, const u32 frames[], u32 num, u32 proc_depth, s64 count);
+int stack_trie_merge(struct stack_trie_s *trie, const u32 frames[], u32 num, u32 proc_depth, s64 count);
+
+typedef int (*stack_fold_cb)(const char *stack_str, u64 count, void *ctx);
+int stack_trie_fold(struct stack_trie_s *trie, struct stack_frame_tbl_s *tbl, stack_fold_cb cb, void *ctx);
+
+#endif
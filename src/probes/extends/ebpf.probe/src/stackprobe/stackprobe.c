@@ -20,6 +20,7 @@
 #include <ctype.h>
 #include <string.h>
 #include <time.h>
+#include <math.h>
 
 #include <linux/perf_event.h>
 #include <linux/unistd.h>
@@ -43,29 +44,38 @@
 #include "logs.h"
 #include "syscall.h"
 #include "symbol.h"
+#include "symb_cache.h"
 #include "flame_graph.h"
 #include "debug_elf_reader.h"
 #include "elf_symb.h"
 #include "container.h"
 #include "conf/stackprobe_conf.h"
 #include "stackprobe.h"
+#include "unwind.h"
 #include "java_support.h"
 
 #define ON_CPU_PROG    "/opt/gala-gopher/extend_probes/stack_bpf/oncpu.bpf.o"
 #define OFF_CPU_PROG   "/opt/gala-gopher/extend_probes/stack_bpf/offcpu.bpf.o"
+#define ON_CPU_FP_PROG  "/opt/gala-gopher/extend_probes/stack_bpf/oncpu_fp.bpf.o"
+#define OFF_CPU_FP_PROG "/opt/gala-gopher/extend_probes/stack_bpf/offcpu_fp.bpf.o"
 #define IO_PROG        "/opt/gala-gopher/extend_probes/stack_bpf/io.bpf.o"
 #define MEMLEAK_PROG   "/opt/gala-gopher/extend_probes/stack_bpf/memleak.bpf.o"
+#define MEMLEAK_GLIBC_PROG  "/opt/gala-gopher/extend_probes/stack_bpf/memleak_glibc.bpf.o"
 
 #define RM_STACK_PATH "/usr/bin/rm -rf /sys/fs/bpf/gala-gopher/__stack*"
 #define STACK_CONVERT_PATH      "/sys/fs/bpf/gala-gopher/__stack_convert"
 #define STACK_STACKMAPA_PATH    "/sys/fs/bpf/gala-gopher/__stack_stackmap_a"
 #define STACK_STACKMAPB_PATH    "/sys/fs/bpf/gala-gopher/__stack_stackmap_b"
+#define STACK_USTACKMAPA_PATH   "/sys/fs/bpf/gala-gopher/__stack_ustackmap_a"
+#define STACK_USTACKMAPB_PATH   "/sys/fs/bpf/gala-gopher/__stack_ustackmap_b"
+#define STACK_UNWIND_ROWS_PATH  "/sys/fs/bpf/gala-gopher/__stack_unwind_rows"
+#define STACK_UNWIND_TBLS_PATH  "/sys/fs/bpf/gala-gopher/__stack_unwind_tables"
+#define STACK_UNWIND_PROCS_PATH "/sys/fs/bpf/gala-gopher/__stack_unwind_procs"
+#define STACK_UNWIND_ARGS_PATH  "/sys/fs/bpf/gala-gopher/__stack_unwind_args"
 
 #define IS_IEG_ADDR(addr)     ((addr) != 0xcccccccccccccccc && (addr) != 0xffffffffffffffff)
 
 #define MEMLEAK_SEC_NUM 4
-#define HISTO_TMP_LEN   (2 * STACK_SYMBS_LEN)
-#define POST_MAX_STEP_SIZE 1048576 // 1M
 
 typedef int (*AttachFunc)(struct svg_stack_trace_s *svg_st, StackprobeConfig *conf);
 typedef int (*PerfProcessFunc)(void *ctx, int cpu, void *data, u32 size);
@@ -81,6 +91,7 @@ typedef struct {
     enum stack_svg_type_e en_type;
     char *flame_name;
     char *prog_name;
+    char *fp_prog_name; // user stacks walked by frame pointer only, NULL if prog_name does not unwind
     AttachFunc func;
     perf_buffer_sample_fn cb;
 } FlameProc;
@@ -99,8 +110,6 @@ struct bpf_link_hash_t {
 };
 
 
-static char __histo_tmp_str[HISTO_TMP_LEN];
-int g_post_max = POST_MAX_STEP_SIZE;
 static struct probe_params params = {.period = DEFAULT_PERIOD};
 static volatile sig_atomic_t g_stop;
 static struct stack_trace_s *g_st = NULL;
@@ -152,6 +161,15 @@ static int get_stack_map_fd(struct stack_trace_s *st)
     }
 }
 
+static int get_ustack_map_fd(struct stack_trace_s *st)
+{
+    if (st->is_stackmap_a) {
+        return st->ustackmap_a_fd;
+    } else {
+        return st->ustackmap_b_fd;
+    }
+}
+
 static struct perf_buffer* get_pb(struct stack_trace_s *st, struct svg_stack_trace_s *svg_st)
 {
     if (st->is_stackmap_a) {
@@ -184,6 +202,7 @@ static void destroy_proc_cache_tbl(struct stack_trace_s *st)
 
     struct proc_cache_s *item, *tmp;
     H_ITER(st->proc_cache, item, tmp) {
+        unwind_del_proc(st->unwind, &item->k);
         __destroy_proc_cache(item);
         H_DEL(st->proc_cache, item);
         (void)free(item);
@@ -199,6 +218,7 @@ static int __aging_proc_cache(struct stack_trace_s *st, struct proc_cache_s *agi
     H_FIND(st->proc_cache, &(aging_item->k), sizeof(struct stack_pid_s), item);
     if (item) {
         st->stats.count[STACK_STATS_PCACHE_DEL]++;
+        unwind_del_proc(st->unwind, &item->k);
         __destroy_proc_cache(item);
         H_DEL(st->proc_cache, item);
         (void)free(item);
@@ -252,6 +272,11 @@ static struct proc_cache_s* __create_proc_cache(struct stack_trace_s *st, struct
     H_ADD_KEYPTR(st->proc_cache, &new_item->k, sizeof(struct stack_pid_s), new_item);
     st->stats.count[STACK_STATS_PCACHE_CRT]++;
 
+    // Samples of the proc are unwound with dwarf from now on, if the bpf prog supports it.
+    if (st->unwind && unwind_add_proc(st->unwind, stack_pid, proc_symbs)) {
+        DEBUG("[STACKPROBE]: Failed to queue unwind tables of proc %d.\n", stack_pid->proc_id);
+    }
+
     if (__add_proc_cache_mirro(st, new_item)) {
         // The program continues.
         ERROR("[STACKPROBE]: Proc cache add failed.\n");
@@ -270,6 +295,7 @@ static void __update_proc_cache(struct proc_symbs_s *proc_symbs)
             if (mod->mod_symbs != NULL && mod->mod_symbs->symbs_count != 0) {
                 proc_symbs->need_update = 0;
             }
+            symb_cache_reset(proc_symbs->cache);
             break;
         }
     }
@@ -335,195 +361,121 @@ static int add_raw_stack_id(struct raw_stack_trace_s *raw_st, struct raw_trace_s
 
 #endif
 
-#define STACK_LAYER_ELSE 0
-#define STACK_LAYER_1ST 1
-#define STACK_LAYER_2ND 2 // only for Java
-#define STACK_LAYER_3RD 3 // only for Java
+#define STACK_PROC_FRAMES_MAX   3   // [Pod], [Con], [pid]comm
+#define STACK_FRAMES_MAX        (STACK_PROC_FRAMES_MAX + PERF_MAX_STACK_DEPTH)
 
-// For deep call stacks (especially prone to Java programs), it is easy to sample incomplete call stacks.
-// If the function name at the first layer of the call stack contains ".",
-// it means that this is must be an incomplete call stack.
-// We query whether the first two layers of this call stack are contained in other call stacks (eg. A),
-// and then count this call on the A call stack.
 #if 1
-static int stack_addrsymbs2string_incomplete(struct proc_symbs_s *proc_symbs, struct addr_symb_s *addr_symb,
-                                             int *layer, char *p, int size)
-{
-    int ret;
-    char *symb;
-    if (size <= 0) {
-        return -1;
-    }
-
-    char *cur_p = p;
-    int len = size;
-
-    if (addr_symb->sym == NULL) {
-        return 0;
-    }
-    symb = addr_symb->sym;
-
-    ret = __snprintf(&cur_p, len, &len, "; %s", symb);
-    if (*layer == STACK_LAYER_1ST) {
-        *layer = STACK_LAYER_2ND;
-    } else if (*layer == STACK_LAYER_2ND) {
-        *layer = STACK_LAYER_3RD;
-    } else {
-        return -1;
-    }
-
-    if (ret < 0) {
-        return -1;
-    }
-    return size > len ? (size - len) : -1;
-}
-
-static int stack_addrsymbs2string(struct proc_symbs_s *proc_symbs, struct addr_symb_s *addr_symb,
-                                  int *layer, char *p, int size)
-{
-    int ret;
-    char *symb;
-    if (size <= 0) {
-        return -1;
-    }
-
-    char *cur_p = p;
-    int len = size;
-
-    if (addr_symb->sym == NULL) {
-        return 0;
-    }
-    symb = addr_symb->sym;
+/*
+ * Convert a stack to interned frames, the process frames go first and user frames follow from the
+ * outermost. Return the number of frames, 0 if the stack has no user symbol, -1 if failed.
+ */
+static int stack_symbs2frames(struct stack_trace_s *st, struct stack_symbs_s *stack_symbs,
+                              struct proc_symbs_s *proc_symbs, u32 frames[], u32 *proc_depth)
+{
+    char name[LINE_BUF_LEN];
+    u32 num = 0;
+    struct addr_symb_s *addr_symb;
 
-    if (*layer == STACK_LAYER_1ST) {
-        if (proc_symbs->pod[0] != 0) {
-            ret = __snprintf(&cur_p, len, &len, "[Pod]%s; ", proc_symbs->pod);
+    if (proc_symbs->pod[0] != 0) {
+        (void)snprintf(name, LINE_BUF_LEN, "[Pod]%s", proc_symbs->pod);
+        if (intern_frame(st->frame_tbl, name, &frames[num++])) {
+            return -1;
         }
-        if (proc_symbs->container_name[0] != 0) {
-            ret = __snprintf(&cur_p, len, &len, "[Con]%s; ", proc_symbs->container_name);
+    }
+    if (proc_symbs->container_name[0] != 0) {
+        (void)snprintf(name, LINE_BUF_LEN, "[Con]%s", proc_symbs->container_name);
+        if (intern_frame(st->frame_tbl, name, &frames[num++])) {
+            return -1;
         }
-        ret = __snprintf(&cur_p, len, &len, "[%d]%s; %s", proc_symbs->proc_id, proc_symbs->comm, symb);
-        *layer = STACK_LAYER_2ND;
-    } else {
-        ret = __snprintf(&cur_p, len, &len, "; %s", symb);
     }
-
-    if (ret < 0) {
+    (void)snprintf(name, LINE_BUF_LEN, "[%d]%s", proc_symbs->proc_id, proc_symbs->comm);
+    if (intern_frame(st->frame_tbl, name, &frames[num++])) {
         return -1;
     }
-    return size > len ? (size - len) : -1;
-}
-
-static int __stack_symbs2string(struct stack_symbs_s *stack_symbs, struct proc_symbs_s *proc_symbs,
-                                char symbos_str[], size_t size, int incomplete_stack_flag)
-{
-    int len;
-    int layer = STACK_LAYER_1ST;
-    int remain_len = size;
-    char *pos = symbos_str;
-    struct addr_symb_s *addr_symb;
+    *proc_depth = num;
 
     for (int i = 0; i < PERF_MAX_STACK_DEPTH; i++) {
         addr_symb = &(stack_symbs->user_stack_symbs[i]);
-        if (addr_symb->orign_addr == 0) {
+        if (addr_symb->orign_addr == 0 || addr_symb->sym == NULL) {
             continue;
         }
-        if (incomplete_stack_flag) {
-            len = stack_addrsymbs2string_incomplete(proc_symbs, addr_symb, &layer, pos, remain_len);
-            if (layer == STACK_LAYER_3RD) {
-                return -1;
-            }
-        } else {
-            len = stack_addrsymbs2string(proc_symbs, addr_symb, &layer, pos, remain_len);
-        }
-        if (len < 0) {
+        if (intern_frame(st->frame_tbl, addr_symb->sym, &frames[num++])) {
             return -1;
         }
-        remain_len -= len;
-        pos += len;
     }
 
-    symbos_str[size - 1] = 0;
-    return 0;
+    return (num > *proc_depth) ? (int)num : 0;
 }
 
+// For deep call stacks (especially prone to Java programs), it is easy to sample incomplete call stacks.
+// If the call stack fills the whole depth, its outermost frames must be lost. Such a stack is kept
+// aside and merged after all complete stacks of the period, see stack_trie_merge().
 static int add_stack_histo(struct stack_trace_s *st, struct stack_symbs_s *stack_symbs,
-    struct proc_symbs_s *proc_symbs, enum stack_svg_type_e en_type, s64 count)
+    struct proc_symbs_s *proc_symbs, enum stack_svg_type_e en_type, struct stack_id_histo_s *id_histo)
 {
-    char str[STACK_SYMBS_LEN];
-    struct stack_trace_histo_s *item = NULL, *new_item = NULL;
-    struct stack_trace_histo_s *tmp;
-    int incomplete_stack_flag = 0;
-
-    str[0] = 0;
-
-    if (stack_symbs->user_stack_symbs[PERF_MAX_STACK_DEPTH - 1].orign_addr != 0) {
-        incomplete_stack_flag = 1;
-    }
+    int ret;
+    u32 proc_depth = 0;
+    u32 frames[STACK_FRAMES_MAX];
+    struct svg_stack_trace_s *svg_st = st->svg_stack_traces[en_type];
 
-    if (__stack_symbs2string(stack_symbs, proc_symbs, str, STACK_SYMBS_LEN, incomplete_stack_flag)) {
+    ret = stack_symbs2frames(st, stack_symbs, proc_symbs, frames, &proc_depth);
+    if (ret < 0) {
         // Statistic error, but program continues
         st->stats.count[STACK_STATS_HISTO_ERR]++;
+        return -1;
     }
-
-    if (str[0] == 0) {
+    if (ret == 0) {
 #ifdef GOPHER_DEBUG
-        ERROR("[STACKPROBE]: symbs2str is null(proc = %d).\n",
+        ERROR("[STACKPROBE]: symbs2frames is null(proc = %d).\n",
                 stack_symbs->pid.proc_id);
 #endif
         return -1;
     }
 
-    if (st->svg_stack_traces[en_type] == NULL) {
+    if (svg_st == NULL || svg_st->trie == NULL) {
         return 0;
     }
 
-    // incomplete call stack merge
-    if (incomplete_stack_flag) {
-        char tmp_str[__FUNC_NAME_LEN] = {0};
-        (void)snprintf(tmp_str, __FUNC_NAME_LEN, "[%d]", proc_symbs->proc_id);
-        H_ITER(st->svg_stack_traces[en_type]->histo_tbl, item, tmp) {
-            if (strstr(item->stack_symbs_str, tmp_str) && strstr(item->stack_symbs_str, str)) {
-                st->stats.count[STACK_STATS_HISTO_FOLDED]++;
-                item->count = item->count + count;
-                return 0;
-            }
+    if (stack_symbs->user_stack_symbs[PERF_MAX_STACK_DEPTH - 1].orign_addr != 0) {
+        id_histo->frames = (u32 *)malloc(ret * sizeof(u32));
+        if (!id_histo->frames) {
+            return -1;
         }
-        return -1;
+        (void)memcpy(id_histo->frames, frames, ret * sizeof(u32));
+        id_histo->frames_num = (u32)ret;
+        id_histo->proc_depth = proc_depth;
+        return 0;
     }
 
-    H_FIND_S(st->svg_stack_traces[en_type]->histo_tbl, str, item); // TODO: use stack_id as key?
-    if (item) {
+    ret = stack_trie_add(svg_st->trie, frames, (u32)ret, proc_depth, id_histo->count);
+    if (ret > 0) {
         st->stats.count[STACK_STATS_HISTO_FOLDED]++;
-        item->count = (s64)item->count + count;
-        return 0;
     }
+    return (ret < 0) ? -1 : 0;
+}
 
-    new_item = (struct stack_trace_histo_s *)malloc(sizeof(struct stack_trace_histo_s));
-    if (!new_item) {
-        return -1;
-    }
-    new_item->stack_symbs_str[0] = 0;
-    (void)strncpy(new_item->stack_symbs_str, str, STACK_SYMBS_LEN - 1);
-    new_item->stack_symbs_str[STACK_SYMBS_LEN - 1] = 0;
-    new_item->count = count < 0 ? 0 : count;
-    H_ADD_S(st->svg_stack_traces[en_type]->histo_tbl, stack_symbs_str, new_item);
+static void merge_incomplete_stack_histo(struct stack_trace_s *st, struct svg_stack_trace_s *svg_st)
+{
+    struct stack_id_histo_s *item, *tmp;
 
-    return 0;
+    H_ITER(svg_st->id_histo, item, tmp) {
+        if (item->frames == NULL) {
+            continue;
+        }
+        if (stack_trie_merge(svg_st->trie, item->frames, item->frames_num, item->proc_depth, item->count) == 0) {
+            st->stats.count[STACK_STATS_HISTO_FOLDED]++;
+        }
+    }
 }
 
 static void clear_stack_histo(struct svg_stack_trace_s *svg_st)
 {
-    if (!svg_st || !svg_st->histo_tbl) {
+    if (!svg_st) {
         return;
     }
 
-    struct stack_trace_histo_s *item, *tmp;
-    H_ITER(svg_st->histo_tbl, item, tmp) {
-        H_DEL(svg_st->histo_tbl, item);
-        (void)free(item);
-    }
-    svg_st->histo_tbl = NULL;
+    clear_stack_id_histo(&svg_st->id_histo);
+    clear_stack_trie(svg_st->trie);
 }
 
 #endif
@@ -536,6 +488,11 @@ static int stack_id2symbs_user(struct stack_trace_s *st, struct stack_id_s *stac
     u64 ip[PERF_MAX_STACK_DEPTH] = {0};
     int fd = get_stack_map_fd(st);
 
+    if (stack_id->user_stack_id & UNWIND_STACKID_FLAG) {
+        fd = get_ustack_map_fd(st);
+        st->stats.count[STACK_STATS_USR_DWARF]++;
+    }
+
     if (bpf_map_lookup_elem(fd, &(stack_id->user_stack_id), ip) != 0) {
 #ifdef GOPHER_DEBUG
         ERROR("[STACKPROBE]: Failed to id2symbs user stack(map_lkup).\n");
@@ -662,6 +619,21 @@ static u64 __stack_count_symb(struct stack_trace_s *st)
     return count;
 }
 
+static void __stack_take_symb_cache_stats(struct stack_trace_s *st)
+{
+    struct proc_cache_s *item, *tmp;
+
+    symb_cache_take_stats(st->ksymbs ? st->ksymbs->cache : NULL,
+        &st->stats.count[STACK_STATS_KSYMB_HIT], &st->stats.count[STACK_STATS_KSYMB_MISS]);
+
+    H_ITER(st->proc_cache, item, tmp) {
+        if (item->proc_symbs) {
+            symb_cache_take_stats(item->proc_symbs->cache,
+                &st->stats.count[STACK_STATS_USYMB_HIT], &st->stats.count[STACK_STATS_USYMB_MISS]);
+        }
+    }
+}
+
 static struct proc_cache_s* __get_proc_cache(struct stack_trace_s *st, struct stack_pid_s *stack_pid)
 {
     struct proc_cache_s* proc_cache;
@@ -679,42 +651,64 @@ static struct proc_cache_s* __get_proc_cache(struct stack_trace_s *st, struct st
 static int stack_id2histogram(struct stack_trace_s *st, enum stack_svg_type_e en_type, char is_stackmap_a)
 {
     int ret;
-    struct stack_id_s *stack_id;
+    struct stack_id_s stack_id;
     struct stack_symbs_s stack_symbs;
     struct raw_stack_trace_s *raw_st;
     struct proc_cache_s* proc_cache;
-    if (!st->svg_stack_traces[en_type]) {
+    struct svg_stack_trace_s *svg_st = st->svg_stack_traces[en_type];
+    struct stack_id_histo_s *item, *tmp;
+
+    if (!svg_st) {
         return -1;
     }
     if (is_stackmap_a) {
-        raw_st = st->svg_stack_traces[en_type]->raw_stack_trace_a;
+        raw_st = svg_st->raw_stack_trace_a;
     } else {
-        raw_st = st->svg_stack_traces[en_type]->raw_stack_trace_b;
+        raw_st = svg_st->raw_stack_trace_b;
     }
     if (raw_st == NULL) {
         return -1;
     }
+
+    // Samples of the same stack are aggregated first, each stack is symbolized once.
     int rt_count = raw_st->raw_trace_count;
     for (int i = 0; i < rt_count; i++) {
+        ret = add_stack_id_histo(&svg_st->id_histo, &(raw_st->raw_traces[i].stack_id), raw_st->raw_traces[i].count);
+        if (ret > 0) {
+            st->stats.count[STACK_STATS_HISTO_FOLDED]++;
+        } else if (ret < 0) {
+            st->stats.count[STACK_STATS_HISTO_ERR]++;
+        }
+    }
+
+    H_ITER(svg_st->id_histo, item, tmp) {
         if (g_stop) {
             break;
         }
-        stack_id = &(raw_st->raw_traces[i].stack_id);
-        proc_cache = __get_proc_cache(st, &(stack_id->pid));
+        (void)memcpy(stack_id.comm, item->comm, TASK_COMM_LEN);
+        (void)memcpy(&(stack_id.pid), &(item->k.pid), sizeof(struct stack_pid_s));
+        stack_id.kern_stack_id = item->k.kern_stack_id;
+        stack_id.user_stack_id = item->k.user_stack_id;
+
+        proc_cache = __get_proc_cache(st, &(stack_id.pid));
         if (!proc_cache) {
             continue;
         }
         (void)memset(&stack_symbs, 0, sizeof(stack_symbs));
-        ret = stack_id2symbs(st, stack_id, proc_cache, &stack_symbs);
+        ret = stack_id2symbs(st, &stack_id, proc_cache, &stack_symbs);
         if (ret != 0) {
             continue;
         }
         st->stats.count[STACK_STATS_ID2SYMBS]++;
-        (void)add_stack_histo(st, &stack_symbs, proc_cache->proc_symbs, en_type, raw_st->raw_traces[i].count);
+        (void)add_stack_histo(st, &stack_symbs, proc_cache->proc_symbs, en_type, item);
     }
 
+    merge_incomplete_stack_histo(st, svg_st);
+    clear_stack_id_histo(&svg_st->id_histo);
+
     st->stats.count[STACK_STATS_P_CACHE] = H_COUNT(st->proc_cache);
     st->stats.count[STACK_STATS_SYMB_CACHE] = __stack_count_symb(st);
+    __stack_take_symb_cache_stats(st);
     return 0;
 }
 
@@ -796,9 +790,28 @@ static void process_offcpu_raw_stack_trace(void *ctx, int cpu, void *data, u32 s
 }
 
 
+/*
+ * In sampling mode an allocation of size s is sampled with probability 1 - exp(-s / sample_bytes),
+ * dividing by it gives the unbiased estimation of the allocated bytes. Allocs and frees of the same
+ * allocation are scaled equally, so they still cancel out.
+ */
+static s64 __memleak_scale_count(s64 count, u32 sample_bytes)
+{
+    double size, scaled;
+
+    if (sample_bytes == 0 || count == 0) {
+        return count;
+    }
+
+    size = (double)((count > 0) ? count : -count);
+    scaled = size / (1.0 - exp(-size / (double)sample_bytes));
+    return (count > 0) ? (s64)scaled : -(s64)scaled;
+}
+
 static void process_memleak_raw_stack_trace(void *ctx, int cpu, void *data, u32 size)
 {
     struct raw_stack_trace_s *raw_st;
+    struct raw_trace_s raw_trace;
     if (!g_st || !data) {
         return;
     }
@@ -813,7 +826,9 @@ static void process_memleak_raw_stack_trace(void *ctx, int cpu, void *data, u32
         return;
     }
 
-    if (add_raw_stack_id(raw_st, (struct raw_trace_s *)data)) {
+    (void)memcpy(&raw_trace, data, sizeof(raw_trace));
+    raw_trace.count = __memleak_scale_count(raw_trace.count, g_st->memleak_sample_bytes);
+    if (add_raw_stack_id(raw_st, &raw_trace)) {
         g_st->stats.count[STACK_STATS_LOSS]++;
     } else {
         g_st->stats.count[STACK_STATS_RAW]++;
@@ -858,6 +873,7 @@ static void destroy_svg_stack_trace(struct svg_stack_trace_s **ptr_svg_st)
         svg_st->raw_stack_trace_b = NULL;
     }
     clear_stack_histo(svg_st);
+    destroy_stack_trie(&svg_st->trie);
 
     (void)free(svg_st);
     return;
@@ -872,7 +888,7 @@ static void destroy_stack_trace(struct stack_trace_s **ptr_st)
     }
 
     if (st->post_server.post_enable) {
-        clean_post_server();
+        clean_post_server(&st->post_server);
     }
 
     for (int cpu = 0; cpu < st->cpus_num; cpu++) {
@@ -894,8 +910,12 @@ static void destroy_stack_trace(struct stack_trace_s **ptr_st)
         (void)free(st->ksymbs);
     }
 
+    destroy_frame_tbl(&st->frame_tbl);
+
     destroy_proc_cache_tbl(st);
 
+    destroy_unwind_mng(&st->unwind);
+
     if (st->elf_reader) {
         destroy_elf_reader(st->elf_reader);
     }
@@ -938,6 +958,11 @@ static struct svg_stack_trace_s *create_svg_stack_trace(StackprobeConfig *conf,
         goto cleanup;
     }
 
+    svg_st->trie = create_stack_trie();
+    if (!svg_st->trie) {
+        goto cleanup;
+    }
+
     INFO("[STACKPROBE]: create %s svg stack trace succeed.\n", flame_name);
     return svg_st;
 cleanup:
@@ -984,6 +1009,11 @@ static struct stack_trace_s *create_stack_trace(StackprobeConfig *conf)
         goto err;
     }
 
+    st->frame_tbl = create_frame_tbl();
+    if (!st->frame_tbl) {
+        goto err;
+    }
+
     if (load_kern_syms(st->ksymbs)) {
         ERROR("[STACKPROBE]: Failed to load kern symbols.\n");
         goto err;
@@ -994,6 +1024,7 @@ static struct stack_trace_s *create_stack_trace(StackprobeConfig *conf)
     st->running_times = (time_t)time(NULL);
     st->is_stackmap_a = ((st->convert_stack_count % 2) == 0);
     st->whitelist_enable = conf->generalConfig->whitelistEnable;
+    st->memleak_sample_bytes = conf->generalConfig->memleakSampleBytes;
     INFO("[STACKPROBE]: whitelist %s\n", st->whitelist_enable ? "enable" : "disable");
     INFO("[STACKPROBE]: create stack trace succeed(cpus_num = %d, kern_symbols = %u).\n",
         st->cpus_num, st->ksymbs->ksym_size);
@@ -1059,6 +1090,20 @@ static int load_bpf_prog(StackprobeConfig *conf, struct svg_stack_trace_s *svg_s
         goto err;
     }
 
+    // Only built in progs which support dwarf unwinding.
+    if (bpf_object__find_map_by_name(svg_st->obj, "unwind_rows") != NULL) {
+        ret = BPF_OBJ_PIN_MAP_PATH(svg_st->obj, "ustackmap_a", STACK_USTACKMAPA_PATH);
+        ret |= BPF_OBJ_PIN_MAP_PATH(svg_st->obj, "ustackmap_b", STACK_USTACKMAPB_PATH);
+        ret |= BPF_OBJ_PIN_MAP_PATH(svg_st->obj, "unwind_rows", STACK_UNWIND_ROWS_PATH);
+        ret |= BPF_OBJ_PIN_MAP_PATH(svg_st->obj, "unwind_tables", STACK_UNWIND_TBLS_PATH);
+        ret |= BPF_OBJ_PIN_MAP_PATH(svg_st->obj, "unwind_procs", STACK_UNWIND_PROCS_PATH);
+        ret |= BPF_OBJ_PIN_MAP_PATH(svg_st->obj, "unwind_args", STACK_UNWIND_ARGS_PATH);
+        if (ret) {
+            ERROR("[STACKPROBE]: Failed to pin unwind maps(err = %d).\n", ret);
+            goto err;
+        }
+    }
+
     ret = bpf_object__load(svg_st->obj);
     if (ret) {
         ERROR("[STACKPROBE]: Failed to load bpf prog(err = %d).\n", ret);
@@ -1082,6 +1127,17 @@ static int load_bpf_prog(StackprobeConfig *conf, struct svg_stack_trace_s *svg_s
         g_st->stackmap_b_fd = BPF_OBJ_GET_MAP_FD(svg_st->obj, "stackmap_b");
         init_convert_counter(conf);
     }
+    if (g_st->unwind == NULL && bpf_object__find_map_by_name(svg_st->obj, "unwind_rows") != NULL) {
+        g_st->ustackmap_a_fd = BPF_OBJ_GET_MAP_FD(svg_st->obj, "ustackmap_a");
+        g_st->ustackmap_b_fd = BPF_OBJ_GET_MAP_FD(svg_st->obj, "ustackmap_b");
+        g_st->unwind = create_unwind_mng(BPF_OBJ_GET_MAP_FD(svg_st->obj, "unwind_rows"),
+                                         BPF_OBJ_GET_MAP_FD(svg_st->obj, "unwind_tables"),
+                                         BPF_OBJ_GET_MAP_FD(svg_st->obj, "unwind_procs"),
+                                         BPF_OBJ_GET_MAP_FD(svg_st->obj, "unwind_args"));
+        if (g_st->unwind == NULL) {
+            WARN("[STACKPROBE]: Failed to create unwind manager, user stacks fall back to frame pointer.\n");
+        }
+    }
     svg_st->stackmap_perf_a_fd = BPF_OBJ_GET_MAP_FD(svg_st->obj, "stackmap_perf_a");
     svg_st->stackmap_perf_b_fd = BPF_OBJ_GET_MAP_FD(svg_st->obj, "stackmap_perf_b");
 
@@ -1178,7 +1234,7 @@ cleanup:
     bpf_link__destroy(links);
     return -1;
 }
-#if 0
+#if 1   // glibc uprobes of memleak sampling mode
 static struct bpf_link_hash_t *bpf_link_head = NULL;
 static void set_pids_inactive()
 {
@@ -1307,9 +1363,9 @@ static void unload_bpf_progs(struct svg_stack_trace_s *svg_st)
             for (int i = 0; i < pid_bpf_links->v.bpf_link_num; i++) {
                 bpf_link__destroy(pid_bpf_links->v.bpf_links[i]);
             }
+            INFO("[STACKPROBE]: detach memleak bpf to pid %u success\n", pid_bpf_links->pid);
             H_DEL(bpf_link_head, pid_bpf_links);
             (void)free(pid_bpf_links);
-            INFO("[STACKPROBE]: detach memleak bpf to pid %u success\n", pid_bpf_links->pid);
         }
     }
 }
@@ -1377,38 +1433,60 @@ static void *__uprobe_attach_check(void *arg)
 }
 #endif
 
+static int __set_memleak_args(struct svg_stack_trace_s *svg_st, StackprobeConfig *conf)
+{
+    u32 key = 0;
+    int fd = BPF_OBJ_GET_MAP_FD(svg_st->obj, "memleak_args");
+    struct memleak_args_s args = {
+        .sample_bytes = conf->generalConfig->memleakSampleBytes,
+        .budget = conf->generalConfig->memleakBudget};
+
+    if (fd < 0) {
+        return -1;
+    }
+    g_st->memleak_budget_fd = BPF_OBJ_GET_MAP_FD(svg_st->obj, "memleak_budget");
+    return bpf_map_update_elem(fd, &key, &args, BPF_ANY);
+}
+
 static int attach_memleak_bpf_prog(struct svg_stack_trace_s *svg_st, StackprobeConfig *conf)
 {
     int err;
-#if 1
-    // this is for memleak.bpf.c and memleak_fp.bpf.c
-    int i = 0;
-    struct bpf_program *prog;
-    struct bpf_link *links[MEMLEAK_SEC_NUM] = {0};
 
-    bpf_object__for_each_program(prog, svg_st->obj) {
-        links[i] = bpf_program__attach(prog);
-        err = libbpf_get_error(links[i]);
-        if (err) {
-            ERROR("[STACKPROBE]: attach memleak bpf failed %d\n", err);
-            links[i] = NULL;
-            goto cleanup;
+    if (conf->generalConfig->memleakSampleBytes == 0) {
+        // this is for memleak.bpf.c and memleak_fp.bpf.c
+        int i = 0;
+        struct bpf_program *prog;
+        struct bpf_link *links[MEMLEAK_SEC_NUM] = {0};
+
+        bpf_object__for_each_program(prog, svg_st->obj) {
+            links[i] = bpf_program__attach(prog);
+            err = libbpf_get_error(links[i]);
+            if (err) {
+                ERROR("[STACKPROBE]: attach memleak bpf failed %d\n", err);
+                links[i] = NULL;
+                goto cleanup;
+            }
+            i++;
         }
-        i++;
-    }
 
-    INFO("[STACKPROBE]: attach memleak bpf succeed.\n");
-    return 0;
+        INFO("[STACKPROBE]: attach memleak bpf succeed.\n");
+        return 0;
 cleanup:
-    for (i--; i >= 0; i--) {
-        bpf_link__destroy(links[i]);
+        for (i--; i >= 0; i--) {
+            bpf_link__destroy(links[i]);
+        }
+
+        return -1;
     }
 
-    return -1;
-#else
-    // this is for memleak_glibc.bpf.c
+    // this is for memleak_glibc.bpf.c, uprobes are attached to libc of whitelisted procs
     pthread_t uprobe_attach_thd;
 
+    if (__set_memleak_args(svg_st, conf)) {
+        ERROR("[STACKPROBE]: Failed to set memleak sampling args.\n");
+        return -1;
+    }
+
     err = pthread_create(&uprobe_attach_thd, NULL, __uprobe_attach_check, (void *)svg_st);
     if (err != 0) {
         ERROR("[STACKPROBE]: attach memleak bpf failed %d\n", err);
@@ -1416,9 +1494,9 @@ cleanup:
     }
     (void)pthread_detach(uprobe_attach_thd);
 
-    INFO("[STACKPROBE]: attach memleak bpf succeed.\n");
+    INFO("[STACKPROBE]: attach memleak bpf succeed(sample every %u bytes, budget %u/s).\n",
+        conf->generalConfig->memleakSampleBytes, conf->generalConfig->memleakBudget);
     return 0;
-#endif
 }
 
 static void clear_stackmap(int stackmap_fd)
@@ -1434,12 +1512,16 @@ static void clear_running_ctx(struct stack_trace_s *st)
 {
     u64 pcache_crt, pcache_del;
     clear_stackmap(get_stack_map_fd(st));
+    if (st->ustackmap_a_fd > 0) {
+        clear_stackmap(get_ustack_map_fd(st));
+    }
     for (int i = 0; i < STACK_SVG_MAX; i++) {
         if (st->svg_stack_traces[i] == NULL) {
             continue;
         }
         clear_stack_histo(st->svg_stack_traces[i]);
     }
+    clear_frame_tbl(st->frame_tbl);
 
     pcache_del = st->stats.count[STACK_STATS_PCACHE_DEL];
     pcache_crt = st->stats.count[STACK_STATS_PCACHE_CRT];
@@ -1448,6 +1530,23 @@ static void clear_running_ctx(struct stack_trace_s *st)
     st->stats.count[STACK_STATS_PCACHE_CRT] = pcache_crt;
 }
 
+static void __stack_take_memleak_drops(struct stack_trace_s *st)
+{
+    u32 key = 0;
+    struct memleak_budget_s budget;
+
+    if (st->memleak_budget_fd <= 0 || bpf_map_lookup_elem(st->memleak_budget_fd, &key, &budget) != 0) {
+        return;
+    }
+
+    st->stats.count[STACK_STATS_MEMLEAK_DROP] = budget.drops;
+    if (budget.drops != 0) {
+        WARN("[STACKPROBE]: memleak budget exhausted, %llu sampled allocations dropped.\n", budget.drops);
+        budget.drops = 0;
+        (void)bpf_map_update_elem(st->memleak_budget_fd, &key, &budget, BPF_ANY);
+    }
+}
+
 static void record_running_ctx(struct stack_trace_s *st)
 {
 #if 1 //GOPHER_DEBUG
@@ -1457,8 +1556,10 @@ static void record_running_ctx(struct stack_trace_s *st)
 
     const char *col[STACK_STATS_MAX] = {"RAW", "LOSS", "HISTO_ERR", "HISTO_FOLD", "ID2SYMBS",
         "PCACHE_DEL", "PCACHE_CRT", "KERN_ERR", "USER_ERR", "MAP_LKUP_ERR",
-        "KERN_OK", "USER_OK", "KERN_USER", "P_CACHE", "SYMB_CACHE"};
-    const int offset[STACK_STATS_MAX] = {-8, -8, -10, -12, -10, -12, -12, -10, -10, -14, -9, -9, -11, -9, 12};
+        "KERN_OK", "USER_OK", "KERN_USER", "P_CACHE", "SYMB_CACHE", "KSYMB_HIT", "KSYMB_MISS",
+        "USYMB_HIT", "USYMB_MISS", "USR_DWARF", "ML_DROP"};
+    const int offset[STACK_STATS_MAX] = {-8, -8, -10, -12, -10, -12, -12, -10, -10, -14, -9, -9, -11, -9, -12,
+        -11, -12, -11, -12, -11, 9};
 
     printf("\n========================================================================================\n");
 
@@ -1514,54 +1615,43 @@ static FILE *__get_flame_graph_fp(struct stack_svg_mng_s *svg_mng)
 }
 
 int __do_wr_stack_histo(struct stack_svg_mng_s *svg_mng,
-                      struct stack_trace_histo_s *stack_trace_histo, int first, struct post_info_s *post_info)
+                      const char *stack_str, u64 count, int first, struct post_info_s *post_info)
 {
+    const char *fmt = first ? "%s %llu" : "\n%s %llu";
     FILE *fp = __get_flame_graph_fp(svg_mng);
     if (!fp) {
         ERROR("[STACKPROBE]: Invalid fp.\n");
         return -1;
     }
 
-    __histo_tmp_str[0] = 0;
-
-    if (first) {
-        (void)snprintf(__histo_tmp_str, HISTO_TMP_LEN, "%s %llu",
-                stack_trace_histo->stack_symbs_str, stack_trace_histo->count);
-    } else {
-        (void)snprintf(__histo_tmp_str, HISTO_TMP_LEN, "\n%s %llu",
-                stack_trace_histo->stack_symbs_str, stack_trace_histo->count);
-    }
     if (post_info->post_flag) {
-        int written = post_info->buf - post_info->buf_start;
-        int ret = __snprintf(&post_info->buf, post_info->remain_size, &post_info->remain_size, "%s", __histo_tmp_str);
-        if (ret < 0) {
-            int new_post_max = g_post_max + POST_MAX_STEP_SIZE;
-            char *temp = (char *)realloc(post_info->buf_start, new_post_max);
-            if(temp == NULL) {
-                ERROR("[STACKPROBE]: Not enough post memory (realloc failed), current capacity is %d.\n",
-                    g_post_max);
-            } else {
-                post_info->buf_start = temp;
-                post_info->buf = post_info->buf_start + written;
-                post_info->remain_size += POST_MAX_STEP_SIZE;
-                g_post_max = new_post_max;
-                INFO("[STACKPROBE]: post memory realloc to %d\n", g_post_max);
-                (void)__snprintf(&post_info->buf, post_info->remain_size, &post_info->remain_size, "%s", __histo_tmp_str);
-            }
-        }
+        (void)pprof_add_sample(post_info->pprof, stack_str, (s64)count);
     }
 
-    (void)fputs(__histo_tmp_str, fp);
+    (void)fprintf(fp, fmt, stack_str, count);
+    return 0;
+}
+
+struct histo_wr_ctx_s {
+    struct stack_svg_mng_s *svg_mng;
+    int *first_flag;
+    struct post_info_s *post_info;
+};
+
+static int __wr_stack_histo(const char *stack_str, u64 count, void *ctx)
+{
+    struct histo_wr_ctx_s *wr_ctx = ctx;
+
+    (void)__do_wr_stack_histo(wr_ctx->svg_mng, stack_str, count, *wr_ctx->first_flag, wr_ctx->post_info);
+    *wr_ctx->first_flag = 0;
     return 0;
 }
 
 void iter_histo_tbl(struct stack_svg_mng_s *svg_mng, int en_type, int *first_flag, struct post_info_s *post_info)
 {
-    struct stack_trace_histo_s *item, *tmp;
-    H_ITER(g_st->svg_stack_traces[en_type]->histo_tbl, item, tmp) {
-        (void)__do_wr_stack_histo(svg_mng, item, *first_flag, post_info);
-        *first_flag = 0;
-    }
+    struct histo_wr_ctx_s wr_ctx = {.svg_mng = svg_mng, .first_flag = first_flag, .post_info = post_info};
+
+    (void)stack_trie_fold(g_st->svg_stack_traces[en_type]->trie, g_st->frame_tbl, __wr_stack_histo, &wr_ctx);
     return;
 }
 
@@ -1588,6 +1678,7 @@ static void switch_stackmap()
         wr_flamegraph(st->svg_stack_traces[i]->svg_mng , i, &st->post_server);
         clear_raw_stack_trace(st->svg_stack_traces[i], st->is_stackmap_a);
     }
+    __stack_take_memleak_drops(st);
     record_running_ctx(st);
     // Clear the context information of the running environment.
     clear_running_ctx(st);
@@ -1611,16 +1702,43 @@ static void init_wr_flame_pthreads(struct svg_stack_trace_s *svg_st, const char
     return;
 }
 
+/*
+ * The unwinding prog is the largest one the verifier checks, if it is rejected(e.g. by an older verifier)
+ * the frame pointer only prog is loaded instead, the flame graph is still generated.
+ */
+static int load_bpf_prog_fallback(StackprobeConfig *conf, struct svg_stack_trace_s *svg_st, FlameProc *flame_proc)
+{
+    if (flame_proc->fp_prog_name == NULL) {
+        return load_bpf_prog(conf, svg_st, flame_proc->prog_name);
+    }
+    if (!conf->generalConfig->dwarfUnwind) {
+        return load_bpf_prog(conf, svg_st, flame_proc->fp_prog_name);
+    }
+
+    if (load_bpf_prog(conf, svg_st, flame_proc->prog_name) == 0) {
+        return 0;
+    }
+    WARN("[STACKPROBE]: Failed to load %s, user stacks of %s fall back to frame pointer.\n",
+        flame_proc->prog_name, flame_proc->flame_name);
+    bpf_object__close(svg_st->obj);
+    svg_st->obj = NULL;
+    return load_bpf_prog(conf, svg_st, flame_proc->fp_prog_name);
+}
+
 static int init_enabled_svg_stack_traces(StackprobeConfig *conf)
 {
     struct svg_stack_trace_s *svg_st;
 
     FlameProc flameProcs[] = {
         // This array order must be the same as the order of enum stack_svg_type_e
-        { conf->flameTypesConfig->oncpu, STACK_SVG_ONCPU, "oncpu", ON_CPU_PROG, attach_oncpu_bpf_prog, process_oncpu_raw_stack_trace},
-        { conf->flameTypesConfig->offcpu, STACK_SVG_OFFCPU, "offcpu", OFF_CPU_PROG, attach_offcpu_bpf_prog, process_offcpu_raw_stack_trace},
-        { conf->flameTypesConfig->io, STACK_SVG_IO, "io", IO_PROG, NULL, NULL},
-        { conf->flameTypesConfig->memleak, STACK_SVG_MEMLEAK, "memleak", MEMLEAK_PROG, attach_memleak_bpf_prog, process_memleak_raw_stack_trace},
+        { conf->flameTypesConfig->oncpu, STACK_SVG_ONCPU, "oncpu", ON_CPU_PROG, ON_CPU_FP_PROG,
+          attach_oncpu_bpf_prog, process_oncpu_raw_stack_trace},
+        { conf->flameTypesConfig->offcpu, STACK_SVG_OFFCPU, "offcpu", OFF_CPU_PROG, OFF_CPU_FP_PROG,
+          attach_offcpu_bpf_prog, process_offcpu_raw_stack_trace},
+        { conf->flameTypesConfig->io, STACK_SVG_IO, "io", IO_PROG, NULL, NULL, NULL},
+        { conf->flameTypesConfig->memleak, STACK_SVG_MEMLEAK, "memleak",
+          conf->generalConfig->memleakSampleBytes ? MEMLEAK_GLIBC_PROG : MEMLEAK_PROG, NULL,
+          attach_memleak_bpf_prog, process_memleak_raw_stack_trace},
     };
 
     for (int i = 0; i < STACK_SVG_MAX; i++) {
@@ -1634,7 +1752,7 @@ static int init_enabled_svg_stack_traces(StackprobeConfig *conf)
         }
         g_st->svg_stack_traces[i] = svg_st;
 
-        if (load_bpf_prog(conf, svg_st, flameProcs[i].prog_name)) {
+        if (load_bpf_prog_fallback(conf, svg_st, &flameProcs[i])) {
             return -1;
         }
 
@@ -17,10 +17,13 @@
 
 #pragma once
 
+#include <pthread.h>
+#include <curl/curl.h>
 #include "hash.h"
 #include "symbol.h"
 #include "svg.h"
 #include "stack.h"
+#include "stack_histo.h"
 
 #define STACKPROBE_CONF_PATH_DEFAULT "/etc/gala-gopher/extend_probes/stackprobe.conf"
 #define BPF_FUNC_NAME_LEN 32
@@ -38,14 +41,6 @@ struct raw_stack_trace_s {
     struct raw_trace_s raw_traces[];
 };
 
-#define __FUNC_NAME_LEN     64
-#define STACK_SYMBS_LEN     (2 * (PERF_MAX_STACK_DEPTH * __FUNC_NAME_LEN))  // KERN + USER
-struct stack_trace_histo_s {
-    H_HANDLE;
-    char stack_symbs_str[STACK_SYMBS_LEN];
-    u64 count;
-};
-
 struct proc_cache_s {
     H_HANDLE;
     struct stack_pid_s k;
@@ -68,6 +63,12 @@ enum stack_stats_e {
     STACK_STATS_USR_KERN_ADDR,
     STACK_STATS_P_CACHE,
     STACK_STATS_SYMB_CACHE,
+    STACK_STATS_KSYMB_HIT,
+    STACK_STATS_KSYMB_MISS,
+    STACK_STATS_USYMB_HIT,
+    STACK_STATS_USYMB_MISS,
+    STACK_STATS_USR_DWARF,
+    STACK_STATS_MEMLEAK_DROP,
 
     STACK_STATS_MAX
 };
@@ -100,15 +101,47 @@ struct svg_stack_trace_s {
     struct raw_stack_trace_s *raw_stack_trace_b;
 
     struct stack_svg_mng_s *svg_mng;
-    struct stack_trace_histo_s *histo_tbl;
+    struct stack_id_histo_s *id_histo;
+    struct stack_trie_s *trie;
+};
+
+#define POST_QUEUE_MAX      16      // profiles waiting for upload, the oldest is dropped if full
+#define POST_RUNNING_MAX    4       // concurrent uploads
+#define POST_RETRY_MAX      5
+#define POST_BACKOFF_MAX    60      // sec
+#define POST_WAIT_MS        1000
+
+struct post_job_s {
+    struct post_job_s *next;
+    CURL *curl;
+    char *data;                     // gzip compressed pprof profile
+    size_t len;
+    u32 retries;
+    time_t next_try;
+    char url[LINE_BUF_LEN];
 };
 
+/*
+ * Profiles are queued by the collecting thread and uploaded by a dedicated thread through
+ * a curl multi handle, which keeps the connections to the server alive between uploads.
+ */
 struct post_server_s {
     char post_enable;
+    char stop;
     long timeout; // sec
     char host[PATH_LEN];
     char app_suffix[APP_SUFFIX_LEN];
-    time_t last_post_ts;
+    time_t last_post_ts[STACK_SVG_MAX];
+
+    pthread_t upload_thd;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    CURLM *multi;
+    struct curl_slist *headers;
+    u32 queue_len;
+    u32 running_len;
+    struct post_job_s *queue;       // waiting jobs, the oldest first
+    struct post_job_s *running;     // jobs added to the multi handle
 };
 
 struct stack_trace_s {
@@ -120,17 +153,23 @@ struct stack_trace_s {
     int proc_obj_map_fd;
     int stackmap_a_fd;
     int stackmap_b_fd;
+    int ustackmap_a_fd;
+    int ustackmap_b_fd;
+    int memleak_budget_fd;
+    u32 memleak_sample_bytes;   // memleak samples glibc allocations if not 0
     u64 convert_stack_count;
     time_t running_times;
     struct post_server_s post_server;
 
     struct svg_stack_trace_s *svg_stack_traces[STACK_SVG_MAX];
     struct ksymb_tbl_s *ksymbs;
+    struct stack_frame_tbl_s *frame_tbl;
     struct proc_cache_s *proc_cache;
     u32 proc_cache_mirro_count;
     struct proc_cache_s *proc_cache_mirro[PROC_CACHE_MAX_COUNT]; // No release is required.
 
     struct elf_reader_s *elf_reader;
+    struct unwind_mng_s *unwind;
 
     struct stack_stats_s stats;
 
@@ -24,6 +24,7 @@
 #include <sys/ioctl.h>
 #include <sys/wait.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <fcntl.h>
 
 #ifdef BPF_PROG_KERN
@@ -37,76 +38,88 @@
 #include "bpf.h"
 #include "stack.h"
 #include "svg.h"
+#include "flame_svg.h"
 
-#define __COMMAND_LEN       (2 * COMMAND_LEN)
-#define FAMEGRAPH_BIN       "/usr/bin/flamegraph.pl"
-#define SVG_COMMAND   "%s --title=\" %s \" %s %s > %s 2>/dev/null"
+#define SVG_LATEST_NAME     "latest.svg"
 
 struct svg_param_s {
     char *file_name;
-    char *params;
     char *titile;
+    char *count_name;
+    enum flame_color_e color;
 };
 
 static struct svg_param_s svg_params[STACK_SVG_MAX] =
-    {{"oncpu", "--countname=us", "On-CPU Time Flame Graph"},
-    {"offcpu", "--colors=io --countname=us", "Off-CPU Time Flame Graph"},
-    {"io", "--colors=io --countname=us", "IO Time Flame Graph"},
-    {"memleak", "--colors=mem --countname=Bytes", "Memory Leak Flame Graph"}};
+    {{"oncpu", "On-CPU Time Flame Graph", "us", FLAME_COLOR_HOT},
+    {"offcpu", "Off-CPU Time Flame Graph", "us", FLAME_COLOR_IO},
+    {"io", "IO Time Flame Graph", "us", FLAME_COLOR_IO},
+    {"memleak", "Memory Leak Flame Graph", "Bytes", FLAME_COLOR_MEM}};
 
 #if 1
 static void __rm_svg(const char *svg_file)
 {
-    FILE *fp;
-    char commad[__COMMAND_LEN];
-    const char *fmt = "rm -rf %s";
-
-    if (access(svg_file, 0) != 0) {
-        return;
-    }
-
-    commad[0] = 0;
-    (void)snprintf(commad, __COMMAND_LEN, fmt, svg_file);
-    fp = popen(commad, "r");
-    if (fp != NULL) {
-        (void)pclose(fp);
-        fp = NULL;
+    if (unlink(svg_file) == 0) {
         INFO("[SVG]: Delete svg file(%s)\n", svg_file);
     }
 }
 
+/* Render to a temporary file first, readers of the svg never see a partial file. */
 static int __new_svg(const char *flame_graph, const char *svg_file, int en_type)
 {
-    const char *flamegraph_bin = FAMEGRAPH_BIN;
-    char commad[__COMMAND_LEN];
-    FILE *fp;
-
-    if (access(flamegraph_bin, 0) != 0) {
-        ERROR("[SVG]: Please install flame graph rpm.\n");
+    char tmp_file[LINE_BUF_LEN];
+    FILE *folded, *svg;
+    int ret;
+    struct flame_svg_opt_s opt = {.title = svg_params[en_type].titile,
+                                  .count_name = svg_params[en_type].count_name,
+                                  .color = svg_params[en_type].color};
+
+    folded = fopen(flame_graph, "r");
+    if (folded == NULL) {
+        ERROR("[SVG]: %s is not exist.\n", flame_graph);
         return -1;
     }
 
-    if (access(flame_graph, 0) != 0) {
-        ERROR("[SVG]: %s is not exist.\n", flame_graph);
+    tmp_file[0] = 0;
+    (void)snprintf(tmp_file, LINE_BUF_LEN, "%s.tmp", svg_file);
+    svg = fopen(tmp_file, "w");
+    if (svg == NULL) {
+        ERROR("[SVG]: Create %s failed(%s).\n", tmp_file, strerror(errno));
+        (void)fclose(folded);
         return -1;
     }
 
-    commad[0] = 0;
-    (void)snprintf(commad, __COMMAND_LEN, SVG_COMMAND,
-        flamegraph_bin, svg_params[en_type].titile,
-        svg_params[en_type].params, flame_graph, svg_file);
+    ret = flame_svg_render(folded, svg, &opt);
+    (void)fclose(folded);
+    if (fclose(svg) != 0) {
+        ret = -1;
+    }
 
-    fp = popen(commad, "r");
-    if (fp != NULL) {
-        (void)pclose(fp);
-        fp = NULL;
+    if (ret == 0 && rename(tmp_file, svg_file) == 0) {
         INFO("[SVG]: Create svg file(%s)\n", svg_file);
         return 0;
     }
-
+    (void)unlink(tmp_file);
     return -1;
 }
 
+/* <svg_dir>/latest.svg links to the newest svg, it is served by the web server of gala-gopher. */
+static void __link_latest_svg(struct stack_svgs_s *svgs, const char *svg_file)
+{
+    char link_file[PATH_LEN];
+    char tmp_link[PATH_LEN];
+
+    link_file[0] = 0;
+    tmp_link[0] = 0;
+    (void)snprintf(link_file, PATH_LEN, "%s/%s", svgs->svg_dir, SVG_LATEST_NAME);
+    (void)snprintf(tmp_link, PATH_LEN, "%s/.%s", svgs->svg_dir, SVG_LATEST_NAME);
+
+    (void)unlink(tmp_link);
+    if (symlink(svg_file, tmp_link) != 0 || rename(tmp_link, link_file) != 0) {
+        ERROR("[SVG]: Link %s to %s failed(%s).\n", link_file, svg_file, strerror(errno));
+        (void)unlink(tmp_link);
+    }
+}
+
 static void __destroy_flamegraph(struct stack_flamegraph_s *flame_graph)
 {
     if (flame_graph->fp) {
@@ -165,22 +178,11 @@ int __mkdir_with_svg_date(const char *svg_dir, char *svg_date_dir, size_t size)
     }
 
     (void)snprintf(svg_date_dir, size, "%s/%s", svg_dir, day);
-    if (access(svg_date_dir, F_OK) != 0) {
-        FILE *fp;
-        char command[COMMAND_LEN] = {0};
-        (void)snprintf(command, COMMAND_LEN, "/usr/bin/mkdir -p %s", svg_date_dir);
-        fp = popen(command, "r");
-        if (fp != NULL) {
-            (void)pclose(fp);
-        }
-    }
-
-    return 0;
+    return mkdir_svg_path(svg_date_dir);
 }
 
 static int stack_get_next_svg_file(struct stack_svgs_s* svgs, char svg_file[], size_t size, int en_type)
 {
-    int next;
     char svg_name[PATH_LEN];
     char svg_date_dir[PATH_LEN] = {0};
 
@@ -192,13 +194,6 @@ static int stack_get_next_svg_file(struct stack_svgs_s* svgs, char svg_file[], s
         return -1;
     }
 
-    next = svgs->svg_files.next;
-    if (svgs->svg_files.files[next] != NULL) {
-        __rm_svg(svgs->svg_files.files[next]);
-        (void)free(svgs->svg_files.files[next]);
-        svgs->svg_files.files[next] = NULL;
-    }
-
     if (__mkdir_with_svg_date(svgs->svg_dir, svg_date_dir, PATH_LEN) < 0) {
         return -1;
     }
@@ -208,12 +203,29 @@ static int stack_get_next_svg_file(struct stack_svgs_s* svgs, char svg_file[], s
 
     svg_file[0] = 0;
     (void)snprintf(svg_file, size, "%s/%s", svg_date_dir, svg_name);
-    __rm_svg(svg_file);
+    return 0;
+}
+
+/*
+ * Called after latest.svg is linked to the new svg: the oldest svg goes out only now,
+ * so the link never points to a deleted file, also when rendering the new one fails.
+ */
+static void stack_rotate_svg_file(struct stack_svgs_s* svgs, const char *svg_file)
+{
+    int next = svgs->svg_files.next;
+    char *oldest = svgs->svg_files.files[next];
+
+    if (oldest != NULL) {
+        // The new svg replaced a file of the same name, it is not the oldest one any more.
+        if (strcmp(oldest, svg_file) != 0) {
+            __rm_svg(oldest);
+        }
+        (void)free(oldest);
+        svgs->svg_files.files[next] = NULL;
+    }
 
     svgs->svg_files.files[next] = strdup(svg_file);
-    next = (next + 1) % svgs->svg_files.capacity;
-    svgs->svg_files.next = next;
-    return 0;
+    svgs->svg_files.next = (next + 1) % svgs->svg_files.capacity;
 }
 #endif
 
@@ -244,7 +256,12 @@ int create_svg_file(struct stack_svg_mng_s* svg_mng, const char *flame_graph, in
         return -1;
     }
 
-    return __new_svg(flame_graph, (const char *)svg_file, en_type);
+    if (__new_svg(flame_graph, (const char *)svg_file, en_type)) {
+        return -1;
+    }
+    __link_latest_svg(svgs, (const char *)svg_file);
+    stack_rotate_svg_file(svgs, (const char *)svg_file);
+    return 0;
 }
 
 struct stack_svg_mng_s* create_svg_mng(u32 default_period)
@@ -284,18 +301,39 @@ void destroy_svg_mng(struct stack_svg_mng_s* svg_mng)
     return;
 }
 
-static void __mkdir_svg_dir(struct stack_svgs_s *svg)
+/* mkdir -p, without forking a shell */
+int mkdir_svg_path(const char *dir)
 {
-    FILE *fp;
-    char commad[LINE_BUF_LEN];
-
-    commad[0] = 0;
-    
-    (void)snprintf(commad, LINE_BUF_LEN, "/usr/bin/mkdir -p %s", svg->svg_dir ?: "/");
-    fp = popen(commad, "r");
-    if (fp != NULL) {
-        (void)pclose(fp);
+    char path[PATH_LEN];
+    size_t len = strlen(dir);
+
+    if (len == 0 || len >= PATH_LEN) {
+        return -1;
     }
+    (void)memcpy(path, dir, len + 1);
+
+    for (char *p = path + 1; *p != 0; p++) {
+        if (*p != '/') {
+            continue;
+        }
+        *p = 0;
+        if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+            ERROR("[SVG]: mkdir %s failed(%s).\n", path, strerror(errno));
+            return -1;
+        }
+        *p = '/';
+    }
+
+    if (mkdir(path, 0755) != 0 && errno != EEXIST) {
+        ERROR("[SVG]: mkdir %s failed(%s).\n", path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+static void __mkdir_svg_dir(struct stack_svgs_s *svg)
+{
+    (void)mkdir_svg_path(svg->svg_dir);
     return;
 }
 
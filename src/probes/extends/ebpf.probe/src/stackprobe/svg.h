@@ -19,14 +19,11 @@
 
 #include <time.h>
 #include "stack.h"
-#include <curl/curl.h>
+#include "pprof.h"
 
 struct post_info_s {
     int post_flag;
-    int remain_size;
-    char *buf_start;
-    char *buf;
-    CURL *curl;
+    struct pprof_s *pprof;      // profile of this period, posted to the server
 };
 
 #define DAYS_TIME           (24 * 60 *60)   // 1 DAY
@@ -71,5 +68,6 @@ void destroy_svg_mng(struct stack_svg_mng_s* svg_mng);
 int set_svg_dir(struct stack_svgs_s *svg, const char *dir, const char *flame_name);
 int create_svg_file(struct stack_svg_mng_s* svg_mng, const char *flame_graph, int en_type);
 char is_svg_tmout(struct stack_svg_mng_s* svg_mng);
+int mkdir_svg_path(const char *dir);
 
 #endif
@@ -0,0 +1,1352 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: dwarf unwind tables of user binaries
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+
+#ifdef BPF_PROG_KERN
+#undef BPF_PROG_KERN
+#endif
+
+#ifdef BPF_PROG_USER
+#undef BPF_PROG_USER
+#endif
+
+#include "bpf.h"
+#include "gopher_elf.h"
+#include "unwind.h"
+
+/* DWARF register numbers of x86_64 */
+#define DW_REG_RBP          6
+#define DW_REG_RSP          7
+#define DW_REG_RA           16
+
+#define DW_EH_PE_omit       0xff
+#define DW_EH_PE_absptr     0x00
+#define DW_EH_PE_uleb128    0x01
+#define DW_EH_PE_udata2     0x02
+#define DW_EH_PE_udata4     0x03
+#define DW_EH_PE_udata8     0x04
+#define DW_EH_PE_sleb128    0x09
+#define DW_EH_PE_sdata2     0x0a
+#define DW_EH_PE_sdata4     0x0b
+#define DW_EH_PE_sdata8     0x0c
+#define DW_EH_PE_pcrel      0x10
+#define DW_EH_PE_indirect   0x80
+
+#define DW_CFA_advance_loc          0x40
+#define DW_CFA_offset               0x80
+#define DW_CFA_restore              0xc0
+#define DW_CFA_nop                  0x00
+#define DW_CFA_set_loc              0x01
+#define DW_CFA_advance_loc1         0x02
+#define DW_CFA_advance_loc2         0x03
+#define DW_CFA_advance_loc4         0x04
+#define DW_CFA_offset_extended      0x05
+#define DW_CFA_restore_extended     0x06
+#define DW_CFA_undefined            0x07
+#define DW_CFA_same_value           0x08
+#define DW_CFA_register             0x09
+#define DW_CFA_remember_state       0x0a
+#define DW_CFA_restore_state        0x0b
+#define DW_CFA_def_cfa              0x0c
+#define DW_CFA_def_cfa_register     0x0d
+#define DW_CFA_def_cfa_offset       0x0e
+#define DW_CFA_def_cfa_expression   0x0f
+#define DW_CFA_expression           0x10
+#define DW_CFA_offset_extended_sf   0x11
+#define DW_CFA_def_cfa_sf           0x12
+#define DW_CFA_def_cfa_offset_sf    0x13
+#define DW_CFA_val_offset           0x14
+#define DW_CFA_val_offset_sf        0x15
+#define DW_CFA_val_expression       0x16
+#define DW_CFA_GNU_args_size        0x2e
+#define DW_CFA_GNU_negative_offset_extended 0x2f
+
+#define CFA_STATES_MAX      16
+#define ROWS_STEP_COUNT     4096
+
+#if 1   // Reader of .eh_frame/.debug_frame
+
+struct dw_reader_s {
+    const u8 *data;         // start of section
+    const u8 *pos;
+    const u8 *end;
+    u64 sec_addr;
+    char err;
+};
+
+static char __dw_left(struct dw_reader_s *r, size_t size)
+{
+    if (r->err || r->pos > r->end || (size_t)(r->end - r->pos) < size) {
+        r->err = 1;
+        return 0;
+    }
+    return 1;
+}
+
+static u64 __dw_read(struct dw_reader_s *r, size_t size)
+{
+    u64 val = 0;
+
+    if (!__dw_left(r, size)) {
+        return 0;
+    }
+    // Both x86_64 and the section are little endian.
+    (void)memcpy(&val, r->pos, size);
+    r->pos += size;
+    return val;
+}
+
+static u64 __dw_uleb(struct dw_reader_s *r)
+{
+    u64 val = 0;
+    u32 shift = 0;
+    u8 byte;
+
+    do {
+        if (!__dw_left(r, 1)) {
+            return 0;
+        }
+        byte = *r->pos++;
+        if (shift < 64) {
+            val |= (u64)(byte & 0x7f) << shift;
+        }
+        shift += 7;
+    } while (byte & 0x80);
+    return val;
+}
+
+static s64 __dw_sleb(struct dw_reader_s *r)
+{
+    u64 val = 0;
+    u32 shift = 0;
+    u8 byte;
+
+    do {
+        if (!__dw_left(r, 1)) {
+            return 0;
+        }
+        byte = *r->pos++;
+        if (shift < 64) {
+            val |= (u64)(byte & 0x7f) << shift;
+        }
+        shift += 7;
+    } while (byte & 0x80);
+
+    if (shift < 64 && (byte & 0x40)) {
+        val |= ~(u64)0 << shift;
+    }
+    return (s64)val;
+}
+
+static u64 __dw_ptr(struct dw_reader_s *r, u8 enc)
+{
+    u64 val, base = 0;
+    const u8 *field = r->pos;
+
+    if (enc == DW_EH_PE_omit) {
+        return 0;
+    }
+
+    switch (enc & 0x0f) {
+        case DW_EH_PE_absptr:
+        case DW_EH_PE_udata8:
+        case DW_EH_PE_sdata8:
+            val = __dw_read(r, sizeof(u64));
+            break;
+        case DW_EH_PE_uleb128:
+            val = __dw_uleb(r);
+            break;
+        case DW_EH_PE_sleb128:
+            val = (u64)__dw_sleb(r);
+            break;
+        case DW_EH_PE_udata2:
+            val = __dw_read(r, sizeof(u16));
+            break;
+        case DW_EH_PE_sdata2:
+            val = (u64)(s64)(s16)__dw_read(r, sizeof(u16));
+            break;
+        case DW_EH_PE_udata4:
+            val = __dw_read(r, sizeof(u32));
+            break;
+        case DW_EH_PE_sdata4:
+            val = (u64)(s64)(int)__dw_read(r, sizeof(u32));
+            break;
+        default:
+            r->err = 1;
+            return 0;
+    }
+
+    switch (enc & 0x70) {
+        case 0:
+            break;
+        case DW_EH_PE_pcrel:
+            base = r->sec_addr + (u64)(field - r->data);
+            break;
+        default:
+            // datarel, textrel and funcrel are not used by pc of x86_64
+            r->err = 1;
+            return 0;
+    }
+
+    if (enc & DW_EH_PE_indirect) {
+        r->err = 1;
+        return 0;
+    }
+    return base + val;
+}
+
+/* Read the length of an entry, set 'end' to the end of the entry. Return 0 if the entry is empty. */
+static u64 __dw_entry_len(struct dw_reader_s *r, char *is_64, const u8 **end)
+{
+    u64 len = __dw_read(r, sizeof(u32));
+
+    *is_64 = 0;
+    if (len == 0xffffffff) {
+        *is_64 = 1;
+        len = __dw_read(r, sizeof(u64));
+    }
+    if (r->err || len > (u64)(r->end - r->pos)) {
+        r->err = 1;
+        return 0;
+    }
+    *end = r->pos + len;
+    return len;
+}
+
+#endif
+
+#if 1   // CFA program
+
+struct dw_cie_s {
+    u64 code_align;
+    s64 data_align;
+    u64 ra_reg;
+    u8 fde_enc;
+    char has_aug_data;
+    const u8 *insns;
+    const u8 *insns_end;
+};
+
+enum cfa_rule_e {
+    CFA_RULE_REG = 0,
+    CFA_RULE_PLT,               // the expression of .plt entries
+    CFA_RULE_EXPR               // other expressions, not supported
+};
+
+struct cfa_state_s {
+    u8 cfa_rule;
+    u8 rbp_type;                // unwind_rbp_e
+    u8 ra_undef;
+    u64 cfa_reg;
+    s64 cfa_offset;
+    s64 rbp_offset;
+};
+
+struct build_row_s {
+    struct unwind_row_s row;
+    u32 seq;
+};
+
+struct rows_builder_s {
+    struct build_row_s *rows;
+    u32 count;
+    u32 capability;
+    char err;
+};
+
+struct cfa_ctx_s {
+    struct rows_builder_s *b;   // NULL while running the initial instructions of CIE
+    const struct dw_cie_s *cie;
+    const struct cfa_state_s *init;
+    struct cfa_state_s state;
+    struct cfa_state_s states[CFA_STATES_MAX];
+    u32 states_count;
+    u64 loc;
+};
+
+static int __parse_cie(const struct dw_reader_s *sec, const u8 *cie_pos, char is_eh_frame, struct dw_cie_s *cie)
+{
+    char is_64;
+    u8 version, enc;
+    u64 aug_len;
+    const char *aug;
+    const u8 *end, *aug_end;
+    struct dw_reader_s r = *sec;
+
+    if (cie_pos < sec->data || cie_pos >= sec->end) {
+        return -1;
+    }
+    r.pos = cie_pos;
+    if (__dw_entry_len(&r, &is_64, &end) == 0) {
+        return -1;
+    }
+    r.end = end;
+    (void)__dw_read(&r, is_64 ? sizeof(u64) : sizeof(u32));     // CIE id
+
+    version = (u8)__dw_read(&r, sizeof(u8));
+    aug = (const char *)r.pos;
+    while (__dw_left(&r, 1) && *r.pos != 0) {
+        r.pos++;
+    }
+    (void)__dw_read(&r, sizeof(u8));
+    if (r.err) {
+        return -1;
+    }
+    if (strstr(aug, "eh") != NULL) {
+        (void)__dw_read(&r, sizeof(u64));
+    }
+    if (!is_eh_frame && version >= 4) {
+        (void)__dw_read(&r, sizeof(u8));    // address_size
+        (void)__dw_read(&r, sizeof(u8));    // segment_size
+    }
+
+    (void)memset(cie, 0, sizeof(struct dw_cie_s));
+    cie->code_align = __dw_uleb(&r);
+    cie->data_align = __dw_sleb(&r);
+    cie->ra_reg = (version == 1) ? __dw_read(&r, sizeof(u8)) : __dw_uleb(&r);
+    cie->fde_enc = DW_EH_PE_absptr;
+
+    if (aug[0] == 'z') {
+        cie->has_aug_data = 1;
+        aug_len = __dw_uleb(&r);
+        if (r.err || aug_len > (u64)(end - r.pos)) {
+            return -1;
+        }
+        aug_end = r.pos + aug_len;
+        for (const char *c = aug + 1; *c != 0 && !r.err; c++) {
+            if (*c == 'R') {
+                cie->fde_enc = (u8)__dw_read(&r, sizeof(u8));
+            } else if (*c == 'L') {
+                (void)__dw_read(&r, sizeof(u8));
+            } else if (*c == 'P') {
+                // Only the size matters, the personality routine is not resolved.
+                enc = (u8)__dw_read(&r, sizeof(u8));
+                (void)__dw_ptr(&r, enc & 0x0f);
+            } else if (*c != 'S' && *c != 'B') {
+                break;
+            }
+        }
+        r.pos = aug_end;
+    } else if (aug[0] != 0) {
+        return -1;  // unknown augmentation, the layout after it is unknown
+    }
+
+    if (r.err) {
+        return -1;
+    }
+    cie->insns = r.pos;
+    cie->insns_end = end;
+    return 0;
+}
+
+static char __is_s16(s64 val)
+{
+    return (val >= -32768 && val <= 32767);
+}
+
+static char __is_int(s64 val)
+{
+    return (val >= -2147483648LL && val <= 2147483647LL);
+}
+
+/* Add the row of 'state' from 'pc' on, a NULL 'state' ends the frame info. */
+static int __push_row(struct rows_builder_s *b, const struct cfa_state_s *state, u64 pc)
+{
+    u32 capability;
+    struct build_row_s *new_rows;
+    struct unwind_row_s *row;
+
+    if (b->count >= b->capability) {
+        // Rows are compacted at last, allow some more than the table can hold.
+        if (b->capability >= 2 * UNWIND_ROWS_MAX) {
+            b->err = 1;
+            return -1;
+        }
+        capability = b->capability + ROWS_STEP_COUNT;
+        new_rows = (struct build_row_s *)realloc(b->rows, capability * sizeof(struct build_row_s));
+        if (new_rows == NULL) {
+            b->err = 1;
+            return -1;
+        }
+        b->rows = new_rows;
+        b->capability = capability;
+    }
+
+    row = &b->rows[b->count].row;
+    (void)memset(row, 0, sizeof(struct unwind_row_s));
+    b->rows[b->count].seq = b->count;
+    b->count++;
+
+    row->pc = pc;
+    if (state == NULL) {
+        row->cfa_type = UNWIND_CFA_NONE;
+        return 0;
+    }
+    if (state->ra_undef) {
+        row->cfa_type = UNWIND_CFA_END;
+        return 0;
+    }
+
+    if (state->cfa_rule == CFA_RULE_PLT) {
+        row->cfa_type = UNWIND_CFA_PLT;
+    } else if (state->cfa_rule != CFA_RULE_REG || !__is_int(state->cfa_offset)) {
+        row->cfa_type = UNWIND_CFA_NONE;
+        return 0;
+    } else if (state->cfa_reg == DW_REG_RSP) {
+        row->cfa_type = UNWIND_CFA_RSP;
+        row->cfa_offset = (int)state->cfa_offset;
+    } else if (state->cfa_reg == DW_REG_RBP) {
+        row->cfa_type = UNWIND_CFA_RBP;
+        row->cfa_offset = (int)state->cfa_offset;
+    } else {
+        row->cfa_type = UNWIND_CFA_NONE;
+        return 0;
+    }
+
+    if (state->rbp_type == UNWIND_RBP_CFA && __is_s16(state->rbp_offset)) {
+        row->rbp_type = UNWIND_RBP_CFA;
+        row->rbp_offset = (s16)state->rbp_offset;
+    }
+    return 0;
+}
+
+static void __set_reg_offset(struct cfa_state_s *state, u64 reg, s64 offset)
+{
+    if (reg == DW_REG_RBP) {
+        state->rbp_type = UNWIND_RBP_CFA;
+        state->rbp_offset = offset;
+    } else if (reg == DW_REG_RA) {
+        state->ra_undef = 0;
+    }
+}
+
+/* Rules other than offset(N) are not followed, rbp is taken as unchanged then. */
+static void __set_reg_same(struct cfa_state_s *state, u64 reg)
+{
+    if (reg == DW_REG_RBP) {
+        state->rbp_type = UNWIND_RBP_SAME;
+        state->rbp_offset = 0;
+    }
+}
+
+static void __set_reg_undef(struct cfa_state_s *state, u64 reg)
+{
+    if (reg == DW_REG_RA) {
+        state->ra_undef = 1;
+    } else {
+        __set_reg_same(state, reg);
+    }
+}
+
+static void __restore_reg(struct cfa_ctx_s *ctx, u64 reg)
+{
+    if (ctx->init == NULL) {
+        return;
+    }
+    if (reg == DW_REG_RBP) {
+        ctx->state.rbp_type = ctx->init->rbp_type;
+        ctx->state.rbp_offset = ctx->init->rbp_offset;
+    } else if (reg == DW_REG_RA) {
+        ctx->state.ra_undef = ctx->init->ra_undef;
+    }
+}
+
+static void __dw_skip(struct dw_reader_s *r, u64 len)
+{
+    if (__dw_left(r, len)) {
+        r->pos += len;
+    }
+}
+
+/* DW_OP_breg7 8; DW_OP_breg16 0; DW_OP_lit15; DW_OP_and; DW_OP_lit11; DW_OP_ge; DW_OP_lit3; DW_OP_shl; DW_OP_plus */
+static const u8 g_plt_expr[] = {0x77, 0x08, 0x80, 0x00, 0x3f, 0x1a, 0x3b, 0x2a, 0x33, 0x24, 0x22};
+
+static u8 __cfa_expr_rule(struct dw_reader_s *r, u64 len)
+{
+    u8 rule = CFA_RULE_EXPR;
+
+    if (len == sizeof(g_plt_expr) && __dw_left(r, len) && !memcmp(r->pos, g_plt_expr, len)) {
+        rule = CFA_RULE_PLT;
+    }
+    __dw_skip(r, len);
+    return rule;
+}
+
+static int __advance_loc(struct cfa_ctx_s *ctx, u64 delta)
+{
+    if (ctx->b != NULL && __push_row(ctx->b, &ctx->state, ctx->loc)) {
+        return -1;
+    }
+    ctx->loc += delta * ctx->cie->code_align;
+    return 0;
+}
+
+static int __exec_cfa(struct cfa_ctx_s *ctx, struct dw_reader_s *r)
+{
+    u8 op;
+    u64 reg, len;
+    s64 data_align = ctx->cie->data_align;
+    struct cfa_state_s *state = &ctx->state;
+
+    while (r->pos < r->end && !r->err) {
+        op = (u8)__dw_read(r, sizeof(u8));
+        switch (op & 0xc0) {
+            case DW_CFA_advance_loc:
+                if (__advance_loc(ctx, op & 0x3f)) {
+                    return -1;
+                }
+                continue;
+            case DW_CFA_offset:
+                __set_reg_offset(state, op & 0x3f, (s64)__dw_uleb(r) * data_align);
+                continue;
+            case DW_CFA_restore:
+                __restore_reg(ctx, op & 0x3f);
+                continue;
+            default:
+                break;
+        }
+
+        switch (op) {
+            case DW_CFA_nop:
+                break;
+            case DW_CFA_set_loc:
+                if (ctx->b != NULL && __push_row(ctx->b, state, ctx->loc)) {
+                    return -1;
+                }
+                ctx->loc = __dw_ptr(r, ctx->cie->fde_enc);
+                break;
+            case DW_CFA_advance_loc1:
+                if (__advance_loc(ctx, __dw_read(r, sizeof(u8)))) {
+                    return -1;
+                }
+                break;
+            case DW_CFA_advance_loc2:
+                if (__advance_loc(ctx, __dw_read(r, sizeof(u16)))) {
+                    return -1;
+                }
+                break;
+            case DW_CFA_advance_loc4:
+                if (__advance_loc(ctx, __dw_read(r, sizeof(u32)))) {
+                    return -1;
+                }
+                break;
+            case DW_CFA_offset_extended:
+                reg = __dw_uleb(r);
+                __set_reg_offset(state, reg, (s64)__dw_uleb(r) * data_align);
+                break;
+            case DW_CFA_offset_extended_sf:
+                reg = __dw_uleb(r);
+                __set_reg_offset(state, reg, __dw_sleb(r) * data_align);
+                break;
+            case DW_CFA_GNU_negative_offset_extended:
+                reg = __dw_uleb(r);
+                __set_reg_offset(state, reg, -(s64)__dw_uleb(r) * data_align);
+                break;
+            case DW_CFA_restore_extended:
+                __restore_reg(ctx, __dw_uleb(r));
+                break;
+            case DW_CFA_undefined:
+                __set_reg_undef(state, __dw_uleb(r));
+                break;
+            case DW_CFA_same_value:
+                __set_reg_same(state, __dw_uleb(r));
+                break;
+            case DW_CFA_register:
+                reg = __dw_uleb(r);
+                (void)__dw_uleb(r);
+                __set_reg_same(state, reg);
+                break;
+            case DW_CFA_val_offset:
+                reg = __dw_uleb(r);
+                (void)__dw_uleb(r);
+                __set_reg_same(state, reg);
+                break;
+            case DW_CFA_val_offset_sf:
+                reg = __dw_uleb(r);
+                (void)__dw_sleb(r);
+                __set_reg_same(state, reg);
+                break;
+            case DW_CFA_expression:
+            case DW_CFA_val_expression:
+                reg = __dw_uleb(r);
+                len = __dw_uleb(r);
+                __dw_skip(r, len);
+                __set_reg_same(state, reg);
+                break;
+            case DW_CFA_remember_state:
+                if (ctx->states_count >= CFA_STATES_MAX) {
+                    return -1;
+                }
+                ctx->states[ctx->states_count++] = *state;
+                break;
+            case DW_CFA_restore_state:
+                if (ctx->states_count == 0) {
+                    return -1;
+                }
+                *state = ctx->states[--ctx->states_count];
+                break;
+            case DW_CFA_def_cfa:
+                state->cfa_rule = CFA_RULE_REG;
+                state->cfa_reg = __dw_uleb(r);
+                state->cfa_offset = (s64)__dw_uleb(r);
+                break;
+            case DW_CFA_def_cfa_sf:
+                state->cfa_rule = CFA_RULE_REG;
+                state->cfa_reg = __dw_uleb(r);
+                state->cfa_offset = __dw_sleb(r) * data_align;
+                break;
+            case DW_CFA_def_cfa_register:
+                state->cfa_rule = CFA_RULE_REG;
+                state->cfa_reg = __dw_uleb(r);
+                break;
+            case DW_CFA_def_cfa_offset:
+                state->cfa_offset = (s64)__dw_uleb(r);
+                break;
+            case DW_CFA_def_cfa_offset_sf:
+                state->cfa_offset = __dw_sleb(r) * data_align;
+                break;
+            case DW_CFA_def_cfa_expression:
+                len = __dw_uleb(r);
+                state->cfa_rule = __cfa_expr_rule(r, len);
+                break;
+            case DW_CFA_GNU_args_size:
+                (void)__dw_uleb(r);
+                break;
+            default:
+                return -1;
+        }
+    }
+    return r->err ? -1 : 0;
+}
+
+/* 'r' is positioned after the CIE pointer of the FDE. */
+static int __parse_fde(struct rows_builder_s *b, const struct dw_reader_s *sec, struct dw_reader_s *r,
+    const u8 *cie_pos, char is_eh_frame)
+{
+    int ret;
+    u64 pc_begin, pc_range;
+    struct dw_cie_s cie;
+    struct dw_reader_s cie_r;
+    struct cfa_state_s init;
+    struct cfa_ctx_s ctx;
+
+    if (__parse_cie(sec, cie_pos, is_eh_frame, &cie)) {
+        return -1;
+    }
+
+    pc_begin = __dw_ptr(r, cie.fde_enc);
+    pc_range = __dw_ptr(r, cie.fde_enc & 0x0f);
+    if (cie.has_aug_data) {
+        __dw_skip(r, __dw_uleb(r));
+    }
+    if (r->err || pc_range == 0) {
+        return -1;
+    }
+
+    (void)memset(&ctx, 0, sizeof(ctx));
+    ctx.cie = &cie;
+    cie_r = *sec;
+    cie_r.pos = cie.insns;
+    cie_r.end = cie.insns_end;
+    if (__exec_cfa(&ctx, &cie_r)) {
+        return -1;
+    }
+
+    init = ctx.state;
+    ctx.init = &init;
+    ctx.states_count = 0;
+    ctx.loc = pc_begin;
+    ctx.b = b;
+    ret = __exec_cfa(&ctx, r);
+    if (b->err) {
+        return -1;
+    }
+
+    // Nothing is known after a broken instruction.
+    if (__push_row(b, (ret == 0) ? &ctx.state : NULL, ctx.loc)) {
+        return -1;
+    }
+    return __push_row(b, NULL, pc_begin + pc_range);
+}
+
+static int __build_rows_cb(const char *data, size_t len, u64 sec_addr, char is_eh_frame, void *ctx)
+{
+    char is_64;
+    u64 id;
+    const u8 *entry_end, *id_pos, *cie_pos;
+    struct dw_reader_s r;
+    struct dw_reader_s sec = {.data = (const u8 *)data, .pos = (const u8 *)data,
+                              .end = (const u8 *)data + len, .sec_addr = sec_addr};
+    struct rows_builder_s *b = (struct rows_builder_s *)ctx;
+
+    while (sec.pos < sec.end) {
+        if (__dw_entry_len(&sec, &is_64, &entry_end) == 0) {
+            if (sec.err || is_eh_frame) {
+                break;  // .eh_frame ends with a zero terminator
+            }
+            continue;
+        }
+
+        r = sec;
+        r.end = entry_end;
+        sec.pos = entry_end;
+
+        id_pos = r.pos;
+        id = __dw_read(&r, is_64 ? sizeof(u64) : sizeof(u32));
+        if (r.err) {
+            continue;
+        }
+        if (is_eh_frame) {
+            // CIE pointer of .eh_frame is relative to itself
+            if (id == 0 || id > (u64)(id_pos - sec.data)) {
+                continue;
+            }
+            cie_pos = id_pos - id;
+        } else {
+            if (id == (is_64 ? ~(u64)0 : 0xffffffff) || id >= len) {
+                continue;
+            }
+            cie_pos = sec.data + id;
+        }
+
+        // A broken FDE is skipped, its pc range falls back to frame pointer.
+        (void)__parse_fde(b, &sec, &r, cie_pos, is_eh_frame);
+        if (b->err) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+#endif
+
+#if 1   // Unwind rows
+
+static int __row_cmp(const void *a, const void *b)
+{
+    const struct build_row_s *row_a = (const struct build_row_s *)a;
+    const struct build_row_s *row_b = (const struct build_row_s *)b;
+    char info_a = (row_a->row.cfa_type != UNWIND_CFA_NONE);
+    char info_b = (row_b->row.cfa_type != UNWIND_CFA_NONE);
+
+    if (row_a->row.pc != row_b->row.pc) {
+        return (row_a->row.pc < row_b->row.pc) ? -1 : 1;
+    }
+    // At the same pc, the start of an FDE wins over the end of another one, then the later row wins.
+    if (info_a != info_b) {
+        return info_a ? 1 : -1;
+    }
+    return (row_a->seq < row_b->seq) ? -1 : (row_a->seq > row_b->seq);
+}
+
+static char __is_same_rule(const struct unwind_row_s *a, const struct unwind_row_s *b)
+{
+    return (a->cfa_type == b->cfa_type && a->rbp_type == b->rbp_type &&
+            a->cfa_offset == b->cfa_offset && a->rbp_offset == b->rbp_offset);
+}
+
+/* Compile the frame info of the elf to rows sorted by pc, the caller frees '*rows'. */
+int unwind_build_rows(const char *elf_file, struct unwind_row_s **rows, u32 *rows_count)
+{
+    u32 i, count = 0;
+    struct unwind_row_s *out, *row;
+    struct rows_builder_s b = {0};
+
+    *rows = NULL;
+    *rows_count = 0;
+    if (gopher_get_elf_frame(elf_file, __build_rows_cb, &b) || b.err) {
+        goto err;
+    }
+    if (b.count == 0) {
+        goto err;
+    }
+
+    qsort(b.rows, b.count, sizeof(struct build_row_s), __row_cmp);
+
+    out = (struct unwind_row_s *)malloc(b.count * sizeof(struct unwind_row_s));
+    if (out == NULL) {
+        goto err;
+    }
+    for (i = 0; i < b.count; i++) {
+        row = &b.rows[i].row;
+        if (i + 1 < b.count && b.rows[i + 1].row.pc == row->pc) {
+            continue;
+        }
+        if (count == 0 && row->cfa_type == UNWIND_CFA_NONE) {
+            continue;
+        }
+        if (count > 0 && __is_same_rule(&out[count - 1], row)) {
+            continue;
+        }
+        out[count++] = *row;
+    }
+    (void)free(b.rows);
+
+    if (count == 0 || count > UNWIND_ROWS_MAX) {
+        (void)free(out);
+        return -1;
+    }
+    *rows = out;
+    *rows_count = count;
+    return 0;
+
+err:
+    if (b.rows) {
+        (void)free(b.rows);
+    }
+    return -1;
+}
+
+#endif
+
+#if 1   // Unwind tables in BPF maps
+
+#define KERN_CONFIG_FMT         "/boot/config-%s"
+#define KERN_CONFIG_KASAN       "CONFIG_KASAN=y"
+
+/* KASAN doubles the kernel stack of x86_64(KASAN_STACK_ORDER), the user regs are saved at its top. */
+static u32 __get_thread_size(void)
+{
+    char line[LINE_BUF_LEN];
+    char path[PATH_LEN];
+    struct utsname uts;
+    u32 thread_size = UNWIND_THREAD_SIZE_DEF;
+    FILE *f;
+
+    if (uname(&uts) != 0) {
+        return thread_size;
+    }
+    (void)snprintf(path, sizeof(path), KERN_CONFIG_FMT, uts.release);
+    f = fopen(path, "r");
+    if (f == NULL) {
+        return thread_size;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, KERN_CONFIG_KASAN, strlen(KERN_CONFIG_KASAN)) == 0) {
+            thread_size <<= 1;
+            break;
+        }
+    }
+    (void)fclose(f);
+    return thread_size;
+}
+
+static void __free_unwind_req(struct unwind_req_s *req)
+{
+    for (u32 i = 0; i < req->mods_count; i++) {
+        if (req->mods[i].path != NULL) {
+            (void)free(req->mods[i].path);
+        }
+    }
+    (void)free(req);
+}
+
+static void __proc_unwind_req(struct unwind_mng_s *mng, struct unwind_req_s *req);
+
+/* Parsing .eh_frame of big binaries takes long, it is done here instead of on the stack converting path. */
+static void *__unwind_loader(void *arg)
+{
+    struct unwind_mng_s *mng = arg;
+    struct unwind_req_s *req;
+
+    while (1) {
+        (void)pthread_mutex_lock(&mng->mutex);
+        while (mng->reqs == NULL && !mng->stop) {
+            (void)pthread_cond_wait(&mng->cond, &mng->mutex);
+        }
+        if (mng->stop) {
+            (void)pthread_mutex_unlock(&mng->mutex);
+            break;
+        }
+        req = mng->reqs;
+        mng->reqs = req->next;
+        if (mng->reqs == NULL) {
+            mng->reqs_tail = NULL;
+        }
+        mng->reqs_count--;
+        (void)pthread_mutex_unlock(&mng->mutex);
+
+        __proc_unwind_req(mng, req);
+        __free_unwind_req(req);
+    }
+    return NULL;
+}
+
+/* Requests are processed in order, a del never overtakes the add of the same proc. */
+static int __queue_unwind_req(struct unwind_mng_s *mng, struct unwind_req_s *req)
+{
+    (void)pthread_mutex_lock(&mng->mutex);
+    if (!req->is_del && mng->reqs_count >= UNWIND_REQS_MAX) {
+        (void)pthread_mutex_unlock(&mng->mutex);
+        return -1;
+    }
+    req->next = NULL;
+    if (mng->reqs_tail != NULL) {
+        mng->reqs_tail->next = req;
+    } else {
+        mng->reqs = req;
+    }
+    mng->reqs_tail = req;
+    mng->reqs_count++;
+    (void)pthread_cond_signal(&mng->cond);
+    (void)pthread_mutex_unlock(&mng->mutex);
+    return 0;
+}
+
+struct unwind_mng_s *create_unwind_mng(int rows_fd, int tables_fd, int procs_fd, int args_fd)
+{
+    const u32 zero = 0;
+    struct unwind_args_s args = {0};
+    struct unwind_mng_s *mng;
+
+    if (rows_fd <= 0 || tables_fd <= 0 || procs_fd <= 0 || args_fd <= 0) {
+        return NULL;
+    }
+
+    args.thread_size = __get_thread_size();
+    if (bpf_map_update_elem(args_fd, &zero, &args, BPF_ANY)) {
+        return NULL;
+    }
+
+    mng = (struct unwind_mng_s *)malloc(sizeof(struct unwind_mng_s));
+    if (mng == NULL) {
+        return NULL;
+    }
+    (void)memset(mng, 0, sizeof(struct unwind_mng_s));
+    mng->rows_fd = rows_fd;
+    mng->tables_fd = tables_fd;
+    mng->procs_fd = procs_fd;
+    (void)pthread_mutex_init(&mng->mutex, NULL);
+    (void)pthread_cond_init(&mng->cond, NULL);
+
+    if (pthread_create(&mng->loader_thd, NULL, __unwind_loader, (void *)mng) != 0) {
+        ERROR("[STACKPROBE]: Failed to create unwind loader pthread.\n");
+        (void)pthread_mutex_destroy(&mng->mutex);
+        (void)pthread_cond_destroy(&mng->cond);
+        (void)free(mng);
+        return NULL;
+    }
+    return mng;
+}
+
+void destroy_unwind_mng(struct unwind_mng_s **ptr_mng)
+{
+    struct unwind_mng_s *mng = *ptr_mng;
+    struct unwind_proc_item_s *proc, *proc_tmp;
+    struct unwind_tbl_s *tbl, *tbl_tmp;
+    struct unwind_req_s *req;
+
+    *ptr_mng = NULL;
+    if (mng == NULL) {
+        return;
+    }
+
+    (void)pthread_mutex_lock(&mng->mutex);
+    mng->stop = 1;
+    (void)pthread_cond_signal(&mng->cond);
+    (void)pthread_mutex_unlock(&mng->mutex);
+    (void)pthread_join(mng->loader_thd, NULL);
+    (void)pthread_mutex_destroy(&mng->mutex);
+    (void)pthread_cond_destroy(&mng->cond);
+
+    while ((req = mng->reqs) != NULL) {
+        mng->reqs = req->next;
+        __free_unwind_req(req);
+    }
+    H_ITER(mng->procs, proc, proc_tmp) {
+        H_DEL(mng->procs, proc);
+        (void)free(proc);
+    }
+    H_ITER(mng->tbls, tbl, tbl_tmp) {
+        H_DEL(mng->tbls, tbl);
+        (void)free(tbl);
+    }
+    (void)free(mng);
+}
+
+static int __tbl_first_row_cmp(const void *a, const void *b)
+{
+    const struct unwind_tbl_s *tbl_a = *(const struct unwind_tbl_s **)a;
+    const struct unwind_tbl_s *tbl_b = *(const struct unwind_tbl_s **)b;
+
+    return (tbl_a->tbl.first_row < tbl_b->tbl.first_row) ? -1 : (tbl_a->tbl.first_row > tbl_b->tbl.first_row);
+}
+
+/* First fit in unwind_rows, the rows of released tables are reused. */
+static int __alloc_rows(struct unwind_mng_s *mng, u32 count, u32 *first_row)
+{
+    u32 i, used = 0, next = 0;
+    struct unwind_tbl_s *tbl, *tmp;
+    struct unwind_tbl_s *used_tbls[UNWIND_TABLES_MAX];
+
+    H_ITER(mng->tbls, tbl, tmp) {
+        if (tbl->tbl.rows_count > 0 && used < UNWIND_TABLES_MAX) {
+            used_tbls[used++] = tbl;
+        }
+    }
+    qsort(used_tbls, used, sizeof(struct unwind_tbl_s *), __tbl_first_row_cmp);
+
+    for (i = 0; i < used; i++) {
+        if (used_tbls[i]->tbl.first_row - next >= count) {
+            break;
+        }
+        next = used_tbls[i]->tbl.first_row + used_tbls[i]->tbl.rows_count;
+    }
+    if (i == used && UNWIND_ROWS_MAX - next < count) {
+        return -1;
+    }
+    *first_row = next;
+    return 0;
+}
+
+/*
+ * Return the number of rows loaded by one batch update, the rest are loaded one by one.
+ * Batch ops of array map are supported since kernel 5.7.
+ */
+static u32 __load_rows_batch(struct unwind_mng_s *mng, u32 first_row, struct unwind_row_s *rows, u32 count)
+{
+#if (CURRENT_KERNEL_VERSION >= KERNEL_VERSION(5, 7, 0))
+    u32 loaded = count;
+    u32 *keys;
+
+    keys = (u32 *)malloc(count * sizeof(u32));
+    if (keys == NULL) {
+        return 0;
+    }
+    for (u32 i = 0; i < count; i++) {
+        keys[i] = first_row + i;
+    }
+    if (bpf_map_update_batch(mng->rows_fd, keys, rows, &loaded, NULL) != 0 && loaded > count) {
+        loaded = 0;
+    }
+    free(keys);
+    return loaded;
+#else
+    return 0;
+#endif
+}
+
+static int __load_rows(struct unwind_mng_s *mng, struct unwind_tbl_s *tbl, struct unwind_row_s *rows, u32 count)
+{
+    u32 key;
+    struct unwind_table_s value;
+
+    if (__alloc_rows(mng, count, &value.first_row)) {
+        WARN("[STACKPROBE]: No room for %u unwind rows, table %u falls back to frame pointer.\n",
+            count, tbl->id);
+        return -1;
+    }
+    value.rows_count = count;
+
+    for (u32 i = __load_rows_batch(mng, value.first_row, rows, count); i < count; i++) {
+        key = value.first_row + i;
+        if (bpf_map_update_elem(mng->rows_fd, &key, &rows[i], BPF_ANY)) {
+            return -1;
+        }
+    }
+    // Published after its rows, BPF never reads a partial table.
+    if (bpf_map_update_elem(mng->tables_fd, &tbl->id, &value, BPF_ANY)) {
+        return -1;
+    }
+    tbl->tbl = value;
+    return 0;
+}
+
+static int __get_unwind_tbl_key(struct mod_s *mod, struct elf_symb_key_s *key)
+{
+    struct stat f_stat;
+
+    if (mod->mod_symbs != NULL) {
+        (void)memcpy(key, &mod->mod_symbs->key, sizeof(struct elf_symb_key_s));
+        return 0;
+    }
+
+    if (stat((const char *)mod->mod_path, &f_stat) != 0) {
+        return -1;
+    }
+    (void)memset(key, 0, sizeof(struct elf_symb_key_s));
+    key->file_id.dev = (u64)f_stat.st_dev;
+    key->file_id.inode = (u64)f_stat.st_ino;
+    key->file_id.mtime = (s64)f_stat.st_mtime;
+    return 0;
+}
+
+/* Ids of live tables are unique, there are UNWIND_TABLES_MAX tables at most. */
+static u32 __alloc_tbl_id(struct unwind_mng_s *mng)
+{
+    u32 id;
+    struct unwind_tbl_s *tbl, *tmp;
+    char used;
+
+    do {
+        id = ++mng->next_tbl_id;
+        used = 0;
+        H_ITER(mng->tbls, tbl, tmp) {
+            if (tbl->id == id) {
+                used = 1;
+                break;
+            }
+        }
+    } while (id == 0 || used);
+    return id;
+}
+
+static struct unwind_tbl_s *__get_unwind_tbl(struct unwind_mng_s *mng, struct unwind_req_mod_s *mod)
+{
+    u32 rows_count = 0;
+    struct unwind_row_s *rows = NULL;
+    struct unwind_tbl_s *tbl = NULL;
+
+    H_FIND(mng->tbls, &mod->key, sizeof(struct elf_symb_key_s), tbl);
+    if (tbl != NULL) {
+        return tbl;
+    }
+    if (H_COUNT(mng->tbls) >= UNWIND_TABLES_MAX) {
+        return NULL;
+    }
+
+    tbl = (struct unwind_tbl_s *)malloc(sizeof(struct unwind_tbl_s));
+    if (tbl == NULL) {
+        return NULL;
+    }
+    (void)memset(tbl, 0, sizeof(struct unwind_tbl_s));
+    (void)memcpy(&tbl->key, &mod->key, sizeof(struct elf_symb_key_s));
+    tbl->id = __alloc_tbl_id(mng);
+
+    // A binary without frame info is kept too, so it is not parsed again.
+    if (unwind_build_rows((const char *)mod->path, &rows, &rows_count) == 0) {
+        if (__load_rows(mng, tbl, rows, rows_count)) {
+            (void)memset(&tbl->tbl, 0, sizeof(struct unwind_table_s));
+        }
+        (void)free(rows);
+    }
+
+    H_ADD(mng->tbls, key, sizeof(struct elf_symb_key_s), tbl);
+    return tbl;
+}
+
+static void __put_unwind_tbl(struct unwind_mng_s *mng, struct unwind_tbl_s *tbl)
+{
+    if (tbl->refcnt > 1) {
+        tbl->refcnt--;
+        return;
+    }
+
+    if (tbl->tbl.rows_count > 0) {
+        (void)bpf_map_delete_elem(mng->tables_fd, &tbl->id);
+    }
+    H_DEL(mng->tbls, tbl);
+    (void)free(tbl);
+}
+
+static char __is_same_pid(const struct stack_pid_s *a, const struct stack_pid_s *b)
+{
+    return (a->proc_id == b->proc_id && a->real_start_time == b->real_start_time);
+}
+
+static void __put_unwind_proc(struct unwind_mng_s *mng, struct unwind_proc_item_s *proc)
+{
+    (void)bpf_map_delete_elem(mng->procs_fd, &proc->tgid);
+    for (u32 i = 0; i < proc->tbls_count; i++) {
+        __put_unwind_tbl(mng, proc->tbls[i]);
+    }
+    H_DEL(mng->procs, proc);
+    (void)free(proc);
+}
+
+static int __unwind_map_cmp(const void *a, const void *b)
+{
+    const struct unwind_map_s *map_a = (const struct unwind_map_s *)a;
+    const struct unwind_map_s *map_b = (const struct unwind_map_s *)b;
+
+    return (map_a->start < map_b->start) ? -1 : (map_a->start > map_b->start);
+}
+
+static void __add_unwind_maps(struct unwind_req_s *req, struct mod_s *mod, struct unwind_req_mod_s *req_mod)
+{
+    struct unwind_map_s *map;
+    struct mod_addr_rage_s *range;
+
+    req_mod->first_map = req->value.maps_count;
+    for (u32 i = 0; i < mod->addr_ranges_count && req->value.maps_count < UNWIND_MAPS_MAX; i++) {
+        range = &mod->addr_ranges[i];
+        map = &req->value.maps[req->value.maps_count++];
+        map->start = range->start;
+        map->end = range->end;
+        // The same translation as symbolization, see __get_mod_target_addr().
+        if (mod->mod_type == MODULE_SO) {
+            map->bias = (range->start - range->f_offset) - (mod->mod_elf_so_addr - mod->mod_elf_so_offset);
+        } else {
+            map->bias = 0;
+        }
+    }
+    req_mod->maps_count = req->value.maps_count - req_mod->first_map;
+}
+
+/* Runs in the loader thread, which owns tbls and procs. */
+static int __add_unwind_proc(struct unwind_mng_s *mng, struct unwind_req_s *req)
+{
+    u32 tgid = (u32)req->pid.proc_id;
+    u32 maps_count = 0;
+    struct unwind_req_mod_s *mod;
+    struct unwind_tbl_s *tbl;
+    struct unwind_proc_s *value = &req->value;
+    struct unwind_proc_item_s *proc = NULL;
+
+    H_FIND(mng->procs, &tgid, sizeof(u32), proc);
+    if (proc != NULL) {
+        if (__is_same_pid(&proc->pid, &req->pid)) {
+            return 0;
+        }
+        __put_unwind_proc(mng, proc);   // The pid is reused.
+    }
+
+    proc = (struct unwind_proc_item_s *)calloc(1, sizeof(struct unwind_proc_item_s));
+    if (proc == NULL) {
+        return -1;
+    }
+    proc->tgid = tgid;
+    proc->pid.proc_id = req->pid.proc_id;
+    proc->pid.real_start_time = req->pid.real_start_time;
+
+    // Maps of binaries without rows are dropped, the rest are moved forward in place.
+    for (u32 i = 0; i < req->mods_count; i++) {
+        mod = &req->mods[i];
+        tbl = __get_unwind_tbl(mng, mod);
+        if (tbl == NULL) {
+            continue;
+        }
+        tbl->refcnt++;
+        proc->tbls[proc->tbls_count++] = tbl;
+        if (tbl->tbl.rows_count == 0) {
+            continue;
+        }
+        for (u32 j = 0; j < mod->maps_count; j++) {
+            value->maps[maps_count] = value->maps[mod->first_map + j];
+            value->maps[maps_count++].tbl_id = tbl->id;
+        }
+    }
+    value->maps_count = maps_count;
+
+    if (value->maps_count == 0) {
+        for (u32 i = 0; i < proc->tbls_count; i++) {
+            __put_unwind_tbl(mng, proc->tbls[i]);
+        }
+        (void)free(proc);
+        return -1;
+    }
+    qsort(value->maps, value->maps_count, sizeof(struct unwind_map_s), __unwind_map_cmp);
+
+    H_ADD(mng->procs, tgid, sizeof(u32), proc);
+    if (bpf_map_update_elem(mng->procs_fd, &tgid, value, BPF_ANY)) {
+        __put_unwind_proc(mng, proc);
+        return -1;
+    }
+    return 0;
+}
+
+static void __del_unwind_proc(struct unwind_mng_s *mng, struct unwind_req_s *req)
+{
+    u32 tgid = (u32)req->pid.proc_id;
+    struct unwind_proc_item_s *proc = NULL;
+
+    H_FIND(mng->procs, &tgid, sizeof(u32), proc);
+    if (proc != NULL && __is_same_pid(&proc->pid, &req->pid)) {
+        __put_unwind_proc(mng, proc);
+    }
+}
+
+static void __proc_unwind_req(struct unwind_mng_s *mng, struct unwind_req_s *req)
+{
+    if (req->is_del) {
+        __del_unwind_proc(mng, req);
+    } else if (__add_unwind_proc(mng, req)) {
+        DEBUG("[STACKPROBE]: Failed to load unwind tables of proc %d.\n", req->pid.proc_id);
+    }
+}
+
+/*
+ * Queue loading unwind tables of all binaries mapped by the proc, its user stacks are unwound by BPF
+ * once they are loaded. Only what is needed is copied out of proc_symbs, which may be freed meanwhile.
+ */
+int unwind_add_proc(struct unwind_mng_s *mng, struct stack_pid_s *pid, struct proc_symbs_s *proc_symbs)
+{
+    struct mod_s *mod;
+    struct unwind_req_mod_s *req_mod;
+    struct unwind_req_s *req;
+
+    if (mng == NULL || proc_symbs == NULL) {
+        return -1;
+    }
+
+    req = (struct unwind_req_s *)calloc(1, sizeof(struct unwind_req_s));
+    if (req == NULL) {
+        return -1;
+    }
+    req->pid.proc_id = pid->proc_id;
+    req->pid.real_start_time = pid->real_start_time;
+
+    for (int i = 0; i < proc_symbs->mods_count && req->mods_count < UNWIND_MAPS_MAX; i++) {
+        mod = proc_symbs->mods[i];
+        if (mod == NULL || mod->mod_path == NULL || mod->mod_inode == 0) {
+            continue;
+        }
+        if (mod->mod_type != MODULE_SO && mod->mod_type != MODULE_EXEC) {
+            continue;
+        }
+
+        req_mod = &req->mods[req->mods_count];
+        if (__get_unwind_tbl_key(mod, &req_mod->key)) {
+            continue;
+        }
+        req_mod->path = strdup((const char *)mod->mod_path);
+        if (req_mod->path == NULL) {
+            break;
+        }
+        req->mods_count++;
+        __add_unwind_maps(req, mod, req_mod);
+    }
+
+    if (req->value.maps_count == 0 || __queue_unwind_req(mng, req)) {
+        __free_unwind_req(req);
+        return -1;
+    }
+    return 0;
+}
+
+void unwind_del_proc(struct unwind_mng_s *mng, struct stack_pid_s *pid)
+{
+    struct unwind_req_s *req;
+
+    if (mng == NULL) {
+        return;
+    }
+
+    req = (struct unwind_req_s *)calloc(1, sizeof(struct unwind_req_s));
+    if (req == NULL) {
+        return;
+    }
+    req->is_del = 1;
+    req->pid.proc_id = pid->proc_id;
+    req->pid.real_start_time = pid->real_start_time;
+    (void)__queue_unwind_req(mng, req);
+}
+
+#endif
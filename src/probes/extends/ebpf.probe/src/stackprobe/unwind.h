@@ -0,0 +1,91 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: dwarf unwind tables of user binaries
+ ******************************************************************************/
+#ifndef __GOPHER_UNWIND_H__
+#define __GOPHER_UNWIND_H__
+
+#pragma once
+
+#include <pthread.h>
+#include "hash.h"
+#include "symbol.h"
+#include "stack.h"
+
+/*
+ * Rows of one binary loaded in unwind_rows, shared by all procs mapping it. Binaries are told apart
+ * the same way as symbols, by build-id or else dev + inode + mtime, an inode alone is not unique
+ * across the filesystems of containers.
+ */
+struct unwind_tbl_s {
+    H_HANDLE;
+    struct elf_symb_key_s key;
+    u32 id;                     // key of unwind_tables
+    u32 refcnt;
+    struct unwind_table_s tbl;  // rows_count is 0 if the binary has no frame info
+};
+
+struct unwind_proc_item_s {
+    H_HANDLE;
+    u32 tgid;
+    struct stack_pid_s pid;
+    u32 tbls_count;
+    struct unwind_tbl_s *tbls[UNWIND_MAPS_MAX];
+};
+
+/* A binary mapped by the proc, copied out of its mod_s for the loader thread. */
+struct unwind_req_mod_s {
+    char *path;
+    struct elf_symb_key_s key;
+    u32 first_map;              // maps of the binary in unwind_req_s.value
+    u32 maps_count;
+};
+
+#define UNWIND_REQS_MAX         PROC_CACHE_MAX_COUNT
+
+/* Adding or deleting a proc, queued for the loader thread. */
+struct unwind_req_s {
+    struct unwind_req_s *next;
+    char is_del;
+    struct stack_pid_s pid;
+    u32 mods_count;
+    struct unwind_req_mod_s mods[UNWIND_MAPS_MAX];
+    struct unwind_proc_s value; // tbl_id of maps is set by the loader thread
+};
+
+/* tbls and procs are owned by the loader thread, the mutex only guards the request queue. */
+struct unwind_mng_s {
+    int rows_fd;
+    int tables_fd;
+    int procs_fd;
+    u32 next_tbl_id;
+    struct unwind_tbl_s *tbls;
+    struct unwind_proc_item_s *procs;
+
+    pthread_t loader_thd;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    char stop;
+    u32 reqs_count;
+    struct unwind_req_s *reqs;
+    struct unwind_req_s *reqs_tail;
+};
+
+struct unwind_mng_s *create_unwind_mng(int rows_fd, int tables_fd, int procs_fd, int args_fd);
+void destroy_unwind_mng(struct unwind_mng_s **ptr_mng);
+int unwind_add_proc(struct unwind_mng_s *mng, struct stack_pid_s *pid, struct proc_symbs_s *proc_symbs);
+void unwind_del_proc(struct unwind_mng_s *mng, struct stack_pid_s *pid);
+
+int unwind_build_rows(const char *elf_file, struct unwind_row_s **rows, u32 *rows_count);
+
+#endif
@@ -99,9 +99,8 @@ static __always_inline void update_migration(void *ctx, int pid, u32 cpu)
 }
 #endif
 
-KPROBE(finish_task_switch, pt_regs)
+KPROBE_FENTRY(finish_task_switch, struct task_struct *prev)
 {
-    struct task_struct* prev = (struct task_struct *)PT_REGS_PARM1(ctx);
     int prev_pid = _(prev->pid);
 
     int pid = (int)bpf_get_current_pid_tgid();
@@ -22,7 +22,8 @@
 
 char g_linsence[] SEC("license") = "GPL";
 
-KPROBE_FS_OP(ext4_file_read_iter, ext4, read, TASK_PROBE_EXT4_OP)
-KPROBE_FS_OP(ext4_file_write_iter, ext4, write, TASK_PROBE_EXT4_OP)
-KPROBE_FS_OP(ext4_file_open, ext4, open, TASK_PROBE_EXT4_OP)
-KPROBE_FS_OP(ext4_sync_file, ext4, flush, TASK_PROBE_EXT4_OP)
+KPROBE_FS_OP(ext4_file_read_iter, ext4, read, TASK_PROBE_EXT4_OP, struct kiocb *iocb, struct iov_iter *iter)
+KPROBE_FS_OP(ext4_file_write_iter, ext4, write, TASK_PROBE_EXT4_OP, struct kiocb *iocb, struct iov_iter *iter)
+KPROBE_FS_OP(ext4_file_open, ext4, open, TASK_PROBE_EXT4_OP, struct inode *inode, struct file *file)
+KPROBE_FS_OP(ext4_sync_file, ext4, flush, TASK_PROBE_EXT4_OP,
+    struct file *file, loff_t start, loff_t end, int datasync)
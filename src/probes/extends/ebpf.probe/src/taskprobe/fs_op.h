@@ -60,8 +60,9 @@ static __always_inline __maybe_unused void store_start_ts(void)
     proc->fs_op_start_ts = bpf_ktime_get_ns();
 }
 
-#define KPROBE_FS_OP(func, fs, field, flags) \
-    KRETPROBE(func, pt_regs)\
+// 'params' are all the parameters of 'func', fexit needs the number of them
+#define KPROBE_FS_OP(func, fs, field, flags, params...) \
+    KRETPROBE_FEXIT(func, ##params) \
     { \
         u64 res; \
         struct proc_data_s *proc = get_delta(&res); \
@@ -73,7 +74,7 @@ static __always_inline __maybe_unused void store_start_ts(void)
         return 0; \
     } \
     \
-    KPROBE(func, pt_regs) \
+    KPROBE_FENTRY(func) \
     { \
         store_start_ts(); \
         return 0; \
@@ -22,8 +22,9 @@
 
 char g_linsence[] SEC("license") = "GPL";
 
-KPROBE_FS_OP(ovl_read_iter, overlay, read, TASK_PROBE_OVERLAY_OP)
-KPROBE_FS_OP(ovl_write_iter, overlay, write, TASK_PROBE_OVERLAY_OP)
-KPROBE_FS_OP(ovl_open, overlay, open, TASK_PROBE_OVERLAY_OP)
-KPROBE_FS_OP(ovl_fsync, overlay, flush, TASK_PROBE_OVERLAY_OP)
+KPROBE_FS_OP(ovl_read_iter, overlay, read, TASK_PROBE_OVERLAY_OP, struct kiocb *iocb, struct iov_iter *iter)
+KPROBE_FS_OP(ovl_write_iter, overlay, write, TASK_PROBE_OVERLAY_OP, struct kiocb *iocb, struct iov_iter *iter)
+KPROBE_FS_OP(ovl_open, overlay, open, TASK_PROBE_OVERLAY_OP, struct inode *inode, struct file *file)
+KPROBE_FS_OP(ovl_fsync, overlay, flush, TASK_PROBE_OVERLAY_OP,
+    struct file *file, loff_t start, loff_t end, int datasync)
 
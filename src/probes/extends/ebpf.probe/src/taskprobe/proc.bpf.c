@@ -20,6 +20,7 @@
 #include "args_map.h"
 #include "thread_map.h"
 #include "proc_map.h"
+#include "wl_map.h"
 #include "output_proc.h"
 
 char g_linsence[] SEC("license") = "GPL";
@@ -37,16 +38,47 @@ struct {
     __uint(max_entries, __PERF_OUT_MAX);
 } proc_exec_channel_map SEC(".maps");
 
+/*
+ * exec replaces the image of the process, it is whitelisted again by the new comm. Patterns the
+ * kernel can not decide (regex, cmdline) are sent to user space with the filename.
+ */
+static __always_inline int proc_exec_wl(struct task_struct *task, struct proc_exec_evt *event)
+{
+    struct proc_wl_key_s key = {0};
+    struct proc_wl_val_s *wl;
+    u32 pid = (u32)_(task->pid);
+
+    (void)proc_put_entry(pid);
+    (void)thread_put((int)pid);
+
+    wl = match_proc_wl(&key);
+    if (wl == NULL) {
+        return 0;
+    }
+
+    if (wl->flags & PROC_WL_USER_MATCH) {
+        event->pid = pid;
+        return 1;
+    }
+
+    (void)proc_add_entry(pid, (const char *)key.comm);
+    (void)thread_add_task(task);
+    return 0;
+}
+
 #if (CURRENT_KERNEL_VERSION > KERNEL_VERSION(4, 18, 0))
 KRAWTRACE(sched_process_exec, bpf_raw_tracepoint_args)
 {
     struct proc_exec_evt event = {0};
     struct task_struct* task = (struct task_struct *)ctx->args[0];
     struct linux_binprm *bprm = (struct linux_binprm *)ctx->args[2];
-    pid_t pid = _(task->pid);
-    const char *filename = _(bprm->filename);
+    const char *filename;
+
+    if (!proc_exec_wl(task, &event)) {
+        return 0;
+    }
 
-    event.pid = (u32)pid;
+    filename = _(bprm->filename);
     bpf_probe_read(&event.filename, PATH_LEN, filename);
 
     bpf_perf_event_output(ctx, &proc_exec_channel_map, BPF_F_ALL_CPU,
@@ -59,11 +91,16 @@ int bpf_trace_sched_process_exec_func(struct trace_event_raw_sched_process_exec
 {
     struct proc_exec_evt event = {0};
     unsigned fname_off = ctx->__data_loc_filename & 0xFFFF;
+    struct task_struct* task = (struct task_struct *)bpf_get_current_task();
+
+    if (!proc_exec_wl(task, &event)) {
+        return 0;
+    }
 
-    event.pid = bpf_get_current_pid_tgid() >> 32;
     bpf_probe_read_str(&event.filename, sizeof(event.filename), (void *)ctx + fname_off);
 
     bpf_perf_event_output(ctx, &proc_exec_channel_map, BPF_F_ALL_CPU,
                           &event, sizeof(event));
+    return 0;
 }
 #endif
@@ -117,4 +117,16 @@ struct proc_exec_evt {
     u32 pid;
 };
 
+#define PROC_WL_USER_MATCH  (u32)(1)    // the rest of the match is done in user space
+
+// Whitelist comm patterns in g_proc_wl_map, "^java$" is "java\0" and "^java" is "java" matched as a prefix
+struct proc_wl_key_s {
+    u32 prefixlen;                      // bits
+    char comm[TASK_COMM_LEN];
+};
+
+struct proc_wl_val_s {
+    u32 flags;
+};
+
 #endif
@@ -30,6 +30,14 @@ struct {
     __uint(max_entries, __PROC_MAX);
 } g_proc_map SEC(".maps");
 
+// struct proc_data_s does not fit in the bpf stack with the callers' locals
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(key_size, sizeof(u32));
+    __uint(value_size, sizeof(struct proc_data_s));
+    __uint(max_entries, 1);
+} g_proc_scratch_map SEC(".maps");
+
 
 static __always_inline __maybe_unused struct proc_data_s* get_proc_entry(u32 proc_id)
 {
@@ -38,10 +46,17 @@ static __always_inline __maybe_unused struct proc_data_s* get_proc_entry(u32 pro
 
 static __always_inline __maybe_unused int proc_add_entry(u32 proc_id, const char *comm)
 {
-    struct proc_data_s proc_data = {.proc_id = proc_id};
-    __builtin_memcpy(proc_data.comm, comm, TASK_COMM_LEN);
+    u32 key = 0;
+    struct proc_data_s *proc_data = bpf_map_lookup_elem(&g_proc_scratch_map, &key);
+    if (proc_data == NULL) {
+        return -1;
+    }
+
+    __builtin_memset(proc_data, 0, sizeof(struct proc_data_s));
+    proc_data->proc_id = proc_id;
+    __builtin_memcpy(proc_data->comm, comm, TASK_COMM_LEN);
 
-    return bpf_map_update_elem(&g_proc_map, &proc_id, &proc_data, BPF_ANY);
+    return bpf_map_update_elem(&g_proc_map, &proc_id, proc_data, BPF_ANY);
 }
 
 static __always_inline __maybe_unused int proc_put_entry(u32 proc_id)
@@ -78,28 +78,11 @@ static struct task_probe_s *tp_probe = NULL;
     MAP_SET_PIN_PATH(probe_name, g_proc_output, PROC_OUTPUT_PATH, load); \
     LOAD_ATTACH(probe_name, end, load)
 
-static char is_wl_range(const char *comm, ApplicationsConfig *conf)
-{
-    ApplicationConfig *appc;
-    if (conf == NULL) {
-        return 0;
-    }
-
-    for (int i = 0; i < conf->apps_num; i++) {
-        appc = conf->apps[i];
-        if (appc) {
-            if (comm && (is_str_match_pattern(comm, appc->comm) == 1)) {
-                return 1;
-            }
-        }
-    }
-    return 0;
-}
-
 static void rcv_proc_exec_evt(void *ctx, int cpu, void *data, __u32 size)
 {
     struct proc_exec_evt *evt = data;
     char comm[TASK_COMM_LEN];
+    char cmdline[PROC_CMDLINE_LEN];
 
     comm[0] = 0;
     char *p = strrchr(evt->filename, '/');
@@ -109,7 +92,9 @@ static void rcv_proc_exec_evt(void *ctx, int cpu, void *data, __u32 size)
         strncpy(comm, evt->filename, TASK_COMM_LEN - 1);
     }
 
-    if (is_wl_range((const char *)comm, tp_probe->conf)) {
+    // the process may have exited, the cmdline is empty then
+    (void)read_proc_str(evt->pid, "cmdline", cmdline, PROC_CMDLINE_LEN);
+    if (is_wl_proc((const char *)comm, (const char *)cmdline, tp_probe->conf)) {
         DEBUG("[TASKPROBE]: create new proc '[proc_id=%d,comm=%s]'.\n", evt->pid, comm);
 
         load_proc2bpf(evt->pid, (const char *)comm, tp_probe->proc_map_fd);
@@ -383,7 +368,7 @@ static int load_proc_create_pb(struct bpf_prog_s* prog, int fd)
     struct perf_buffer *pb;
 
     if (prog->pb == NULL) {
-        pb = create_pref_buffer(fd, output_proc_metrics);
+        pb = create_pref_buffer3(fd, output_proc_metrics, &prog->pb_lost);
         if (pb == NULL) {
             fprintf(stderr, "ERROR: crate perf buffer failed\n");
             return -1;
@@ -589,13 +574,21 @@ static int load_proc_prog(struct bpf_prog_s *prog, char is_load)
     int ret = 0;
     struct perf_buffer *pb;
 
-    __LOAD_PROBE(proc, err, is_load);
+    OPEN(proc, err, is_load);
+    MAP_SET_PIN_PATH(proc, args_map, ARGS_PATH, is_load);
+    MAP_SET_PIN_PATH(proc, g_proc_map, PROC_PATH, is_load);
+    MAP_SET_PIN_PATH(proc, g_thread_map, THREAD_PATH, is_load);
+    MAP_SET_PIN_PATH(proc, g_proc_output, PROC_OUTPUT_PATH, is_load);
+    LOAD_ATTACH(proc, err, is_load);
     if (is_load) {
         prog->skels[prog->num].skel = proc_skel;
         prog->skels[prog->num].fn = (skel_destroy_fn)proc_bpf__destroy;
         prog->num++;
 
-        pb = create_pref_buffer(GET_MAP_FD(proc, proc_exec_channel_map), rcv_proc_exec_evt);
+        (void)load_proc_wl2bpf(tp_probe->conf, GET_MAP_FD(proc, g_proc_wl_map));
+
+        pb = create_pref_buffer3(GET_MAP_FD(proc, proc_exec_channel_map), rcv_proc_exec_evt,
+                                 &prog->pbs_lost[prog->num]);
         if (pb == NULL) {
             fprintf(stderr, "ERROR: crate perf buffer failed\n");
             return -1;
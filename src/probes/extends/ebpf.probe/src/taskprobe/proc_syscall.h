@@ -63,8 +63,9 @@ static __always_inline __maybe_unused struct proc_data_s* get_syscall_op_us(u64
     }
 }
 
+// The syscall wrappers take the registers of user space only
 #define KPROBE_SYSCALL(arch, func, field, flags) \
-        KRETPROBE(arch##func, pt_regs) \
+        KRETPROBE_FEXIT(arch##func, const struct pt_regs *regs) \
         { \
             u64 res; \
             struct proc_data_s *proc = get_syscall_op_us(&res); \
@@ -76,7 +77,7 @@ static __always_inline __maybe_unused struct proc_data_s* get_syscall_op_us(u64
             return 0; \
         } \
         \
-        KPROBE(arch##func, pt_regs) \
+        KPROBE_FENTRY(arch##func) \
         { \
             store_syscall_op_start_ts(); \
             return 0; \
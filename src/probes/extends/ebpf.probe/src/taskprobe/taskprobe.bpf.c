@@ -37,6 +37,28 @@ KRAWTRACE(sched_process_exit, bpf_raw_tracepoint_args)
     (void)thread_put(pid);
     return 0;
 }
+
+// A child process runs the image of the parent until exec, it inherits the whitelist of the parent.
+KRAWTRACE(sched_process_fork, bpf_raw_tracepoint_args)
+{
+    struct task_struct* parent = (struct task_struct*)ctx->args[0];
+    struct task_struct* child = (struct task_struct*)ctx->args[1];
+    struct proc_data_s *proc;
+    u32 tgid = (u32)_(child->tgid);
+
+    if (tgid != (u32)_(child->pid)) {
+        return 0;
+    }
+
+    proc = get_proc_entry((u32)_(parent->tgid));
+    if (proc == NULL) {
+        return 0;
+    }
+
+    (void)proc_add_entry(tgid, (const char *)proc->comm);
+    (void)thread_add_task(child);
+    return 0;
+}
 #else
 SEC("tracepoint/sched/sched_process_exit")
 int bpf_trace_sched_process_exit_func(struct trace_event_raw_sched_process_template *ctx)
@@ -29,6 +29,7 @@
 #endif
 
 #include "bpf.h"
+#include "evt_loop.h"
 #include "args.h"
 #include "taskprobe.skel.h"
 #include "taskprobe.h"
@@ -69,34 +70,6 @@ static void add_proc_item(u32 proc_id, const char *comm, struct task_probe_s* pr
     H_ADD_I(probep->procs, id, proc);
 }
 
-static char is_wl_range(const char *comm, const char* cmdline, ApplicationsConfig *conf)
-{
-    ApplicationConfig *appc;
-    if (conf == NULL) {
-        return 0;
-    }
-
-    for (int i = 0; i < conf->apps_num; i++) {
-        appc = conf->apps[i];
-        if (appc) {
-            // only match comm
-            if ((appc->comm[0] != 0) && (appc->cmd_line[0] == 0)) {
-                if ((comm[0] != 0) && (is_str_match_pattern(comm, appc->comm) == 1)) {
-                    return 1;
-                }
-            }
-            // match comm and cmdline
-            if ((appc->comm[0] != 0) && (appc->cmd_line[0] != 0)) {
-                if (((comm[0] != 0) && (is_str_match_pattern(comm, appc->comm) == 1)) &&
-                    ((cmdline[0] != 0) && strstr(cmdline, appc->cmd_line))) {
-                    return 1;
-                }
-            }
-        }
-    }
-    return 0;
-}
-
 static void get_wl_proc(struct task_probe_s* probep)
 {
     u32 proc_id;
@@ -104,9 +77,6 @@ static void get_wl_proc(struct task_probe_s* probep)
     struct dirent *entry = NULL;
     char comm[TASK_COMM_LEN];
     char cmdline[PROC_CMDLINE_LEN];
-    char command[COMMAND_LEN];
-    const char *get_comm_fmt = "/usr/bin/cat /proc/%u/comm 2>/dev/null";
-    const char *get_cmdline_fmt = "/usr/bin/cat /proc/%u/cmdline 2>/dev/null";
 
     dir = opendir("/proc");
     if (dir == NULL) {
@@ -124,21 +94,15 @@ static void get_wl_proc(struct task_probe_s* probep)
 
         proc_id = (u32)atoi(entry->d_name);
 
-        comm[0] = 0;
-        command[0] = 0;
-        (void)snprintf(command, COMMAND_LEN, get_comm_fmt, proc_id);
-        if (exec_cmd((const char *)command, comm, TASK_COMM_LEN)) {
+        if (read_proc_str(proc_id, "comm", comm, TASK_COMM_LEN)) {
             continue;
         }
 
-        cmdline[0] = 0;
-        command[0] = 0;
-        (void)snprintf(command, COMMAND_LEN, get_cmdline_fmt, proc_id);
-        if (exec_cmd((const char *)command, cmdline, PROC_CMDLINE_LEN)) {
+        if (read_proc_str(proc_id, "cmdline", cmdline, PROC_CMDLINE_LEN)) {
             continue;
         }
 
-        if (!is_wl_range((const char *)comm, (const char *)command, probep->conf)) {
+        if (!is_wl_proc((const char *)comm, (const char *)cmdline, probep->conf)) {
             continue;
         }
 
@@ -198,6 +162,7 @@ int main(int argc, char **argv)
     struct bpf_prog_s* thread_bpf_progs = NULL;
     struct bpf_prog_s* proc_bpf_progs = NULL;
     struct bpf_prog_s* glibc_bpf_progs = NULL;
+    struct evt_loop_s *loop = NULL;
 
     if (signal(SIGINT, sig_int) == SIG_ERR) {
         fprintf(stderr, "can't set signal handler: %s\n", strerror(errno));
@@ -236,50 +201,45 @@ int main(int argc, char **argv)
     // Set task probe collection period
     load_task_args(probe.args_fd, &(probe.params));
 
-    // load wl proc
-    get_wl_proc(&probe);
-
-    // load daemon thread and proc
-    load_wl2bpf(&probe);
-
     // Load thread bpf prog
     thread_bpf_progs = load_thread_bpf_prog(&(probe.params));
     if (thread_bpf_progs == NULL) {
         goto err;
     }
 
-    // Load proc bpf prog
+    // Load proc bpf prog, whitelist procs are added by exec/fork in kernel from now on
     proc_bpf_progs = load_proc_bpf_prog(&probe);
     if (proc_bpf_progs == NULL) {
         goto err;
     }
 
+    // load wl proc started before
+    get_wl_proc(&probe);
+
+    // load daemon thread and proc
+    load_wl2bpf(&probe);
+
     // Load glibc bpf prog
     glibc_bpf_progs = load_glibc_bpf_prog(&(probe.params));
 
+    loop = evt_loop_new();
+    if (loop == NULL) {
+        goto err;
+    }
+    if (evt_loop_add_prog(loop, thread_bpf_progs, "thread") || evt_loop_add_prog(loop, proc_bpf_progs, "proc")) {
+        goto err;
+    }
+
     printf("Successfully started!\n");
 
     while (!stop) {
-        if (thread_bpf_progs->pb != NULL) {
-            if ((ret = perf_buffer__poll(thread_bpf_progs->pb, THOUSAND)) < 0) {
-                break;
-            }
-        }
-        if (proc_bpf_progs->pb != NULL) {
-            if ((ret = perf_buffer__poll(proc_bpf_progs->pb, THOUSAND)) < 0) {
-                break;
-            }
-        }
-        for (int i = 0; i < proc_bpf_progs->num; i++) {
-            if (proc_bpf_progs->pbs[i] != NULL) {
-                if ((ret = perf_buffer__poll(proc_bpf_progs->pbs[i], THOUSAND)) < 0) {
-                    break;
-                }
-            }
+        if ((ret = evt_loop_poll(loop, THOUSAND)) < 0) {
+            break;
         }
     }
 
 err:
+    evt_loop_free(&loop);
     unload_bpf_prog(&glibc_bpf_progs);
     unload_bpf_prog(&proc_bpf_progs);
     unload_bpf_prog(&thread_bpf_progs);
@@ -36,5 +36,8 @@ struct task_probe_s {
 
 void load_thread2bpf(u32 proc_id, int fd);
 void load_proc2bpf(u32 proc_id, const char *comm, int fd);
+int load_proc_wl2bpf(ApplicationsConfig *conf, int fd);
+char is_wl_proc(const char *comm, const char *cmdline, ApplicationsConfig *conf);
+int read_proc_str(u32 proc_id, const char *fname, char *buf, u32 buf_len);
 
 #endif
@@ -17,124 +17,225 @@
 #include <ctype.h>
 #include <string.h>
 #include <unistd.h>
+#include <dirent.h>
 
 #include "bpf.h"
+#include "args.h"
 #include "proc.h"
 #include "thread.h"
+#include "taskprobe.h"
 
-#define TASK_PID_COMMAND \
-    "ps -T -p %d | awk 'NR > 1 {print $2}'"
+#define PROC_FILE_PATH  "/proc/%u/%s"
+#define PROC_TASK_PATH  "/proc/%u/task"
 
-#define TASK_ID_COMMAND \
-    "ps -o pid,tid,ppid,pgid,comm -p %u | awk '{print $1 \"|\" $2 \"|\" $3 \"|\" $4 \"|\" $5}'"
+// regex special characters, a pattern with them is matched in user space
+#define WL_REGEX_CHARS  ".[]()*+?{}|\\^$"
 
-enum ps_type {
-    PS_TYPE_PID = 0,
-    PS_TYPE_TID,
-    PS_TYPE_PPID,
-    PS_TYPE_PGID,
-    PS_TYPE_COMM,
+int read_proc_str(u32 proc_id, const char *fname, char *buf, u32 buf_len)
+{
+    FILE *f;
+    char path[PATH_LEN];
+    size_t len;
+
+    buf[0] = 0;
+    path[0] = 0;
+    (void)snprintf(path, PATH_LEN, PROC_FILE_PATH, proc_id, fname);
+    f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    len = fread(buf, 1, buf_len - 1, f);
+    (void)fclose(f);
 
-    PS_TYPE_MAX,
-};
+    // arguments in cmdline are separated by '\0'
+    for (size_t i = 0; i < len; i++) {
+        if (buf[i] == 0) {
+            buf[i] = ' ';
+        }
+    }
+    while (len > 0 && (buf[len - 1] == ' ' || buf[len - 1] == '\n')) {
+        len--;
+    }
+    buf[len] = 0;
+    return 0;
+}
 
-void load_proc2bpf(u32 proc_id, const char *comm, int fd)
+char is_wl_proc(const char *comm, const char *cmdline, ApplicationsConfig *conf)
 {
-    struct proc_data_s proci = {0};
+    ApplicationConfig *appc;
+    if (conf == NULL || comm[0] == 0) {
+        return 0;
+    }
 
-    proci.proc_id = proc_id;
-    memcpy(proci.comm, comm, TASK_COMM_LEN);
+    for (int i = 0; i < conf->apps_num; i++) {
+        appc = conf->apps[i];
+        if (appc == NULL || appc->comm[0] == 0) {
+            continue;
+        }
+        if (is_str_match_pattern(comm, appc->comm) != 1) {
+            continue;
+        }
+        // only match comm
+        if (appc->cmd_line[0] == 0) {
+            return 1;
+        }
+        // match comm and cmdline
+        if ((cmdline[0] != 0) && strstr(cmdline, appc->cmd_line)) {
+            return 1;
+        }
+    }
+    return 0;
+}
 
-    (void)bpf_map_update_elem(fd, &proc_id, &proci, BPF_ANY);
+/*
+ * The kernel matches comm by the longest prefix, so only "^lit", "^lit.*" and "^lit$" are compiled
+ * into g_proc_wl_map, lit without regex special characters.
+ */
+static int get_wl_key(const char *pattern, struct proc_wl_key_s *key)
+{
+    const char *p = pattern;
+    u32 len = 0;
 
-    DEBUG("[TASKPROBE]: load daemon proc '[proc=%u,comm=%s]'.\n", proc_id, comm);
+    (void)memset(key, 0, sizeof(struct proc_wl_key_s));
+    if (*p != '^') {
+        return -1;
+    }
+    p++;
+
+    while (*p != 0 && strchr(WL_REGEX_CHARS, *p) == NULL) {
+        if (len >= TASK_COMM_LEN - 1) {
+            return -1;
+        }
+        key->comm[len++] = *p++;
+    }
+
+    if (strcmp(p, "$") == 0) {
+        len++;      // the terminating '\0' of comm
+    } else if (*p != 0 && strcmp(p, ".*") != 0 && strcmp(p, ".*$") != 0) {
+        return -1;
+    }
+
+    key->prefixlen = len * 8;
+    return 0;
 }
 
-static void do_load_thread2bpf(int fd, struct thread_id *id)
+/*
+ * Patterns with cmdline are checked again in user space when the comm matches. If any pattern can not
+ * be compiled, a zero-length prefix sends all the other execs to user space.
+ */
+int load_proc_wl2bpf(ApplicationsConfig *conf, int fd)
 {
-    FILE *f = NULL;
-    int pid;
-    char cmd[COMMAND_LEN];
-    char line[LINE_BUF_LEN];
-    struct thread_data thr = {0};
+    int num = 0;
+    char user_match = 0;
+    ApplicationConfig *appc;
+    struct proc_wl_key_s key;
+    struct proc_wl_val_s val = {.flags = PROC_WL_USER_MATCH};
+
+    if (conf == NULL) {
+        return 0;
+    }
 
-    cmd[0] = 0;
-    (void)snprintf(cmd, COMMAND_LEN, TASK_PID_COMMAND, id->tgid);
-    f = popen(cmd, "r");
-    if (f == NULL) {
-        return;
+    for (int i = 0; i < conf->apps_num; i++) {
+        appc = conf->apps[i];
+        if (appc == NULL || appc->comm[0] == 0) {
+            continue;
+        }
+        if (get_wl_key(appc->comm, &key)) {
+            user_match = 1;
+            continue;
+        }
+        if (appc->cmd_line[0] != 0) {
+            (void)bpf_map_update_elem(fd, &key, &val, BPF_ANY);
+        }
+    }
+    if (user_match) {
+        (void)memset(&key, 0, sizeof(key));
+        (void)bpf_map_update_elem(fd, &key, &val, BPF_ANY);
     }
-    while (!feof(f)) {
-        line[0] = 0;
-        if (fgets(line, LINE_BUF_LEN, f) == NULL) {
-            break;
+
+    // a pattern without cmdline wins over the same one with cmdline
+    val.flags = 0;
+    for (int i = 0; i < conf->apps_num; i++) {
+        appc = conf->apps[i];
+        if (appc == NULL || appc->comm[0] == 0 || appc->cmd_line[0] != 0) {
+            continue;
+        }
+        if (get_wl_key(appc->comm, &key) == 0) {
+            (void)bpf_map_update_elem(fd, &key, &val, BPF_ANY);
+            num++;
         }
-        SPLIT_NEWLINE_SYMBOL(line);
-        pid = atoi(line);
-        thr.id.pid  = pid;
-        thr.id.tgid = id->tgid;
-        thr.id.pgid = id->pgid;
-        thr.id.ppid = id->ppid;
-        (void)strncpy(thr.id.comm, id->comm, TASK_COMM_LEN - 1);
-        /* update task map and daemon task map */
-        (void)bpf_map_update_elem(fd, &pid, &thr, BPF_ANY);
-        DEBUG("[TASKPROBE]: load daemon thread '[pid=%d,tgid=%d,pgid=%d,ppid=%d,comm=%s]'.\n",
-              pid, id->tgid, id->pgid, id->ppid, id->comm);
     }
 
-    pclose(f);
-    return;
+    INFO("[TASKPROBE]: %d whitelist patterns are matched in kernel.\n", num);
+    return num;
 }
 
-static void get_thr_id(char *ps, struct thread_id *id)
+void load_proc2bpf(u32 proc_id, const char *comm, int fd)
 {
-    int index = 0;
-    char *ptoken = NULL;
-    char *psave = NULL;
-    char *id_str[PS_TYPE_MAX];
+    struct proc_data_s proci = {0};
+
+    proci.proc_id = proc_id;
+    memcpy(proci.comm, comm, TASK_COMM_LEN);
+
+    (void)bpf_map_update_elem(fd, &proc_id, &proci, BPF_ANY);
+
+    DEBUG("[TASKPROBE]: load daemon proc '[proc=%u,comm=%s]'.\n", proc_id, comm);
+}
 
-    ptoken = strtok_r(ps, "|", &psave);
-    while (ptoken != NULL && index < PS_TYPE_MAX) {
-        id_str[index++] = ptoken;
-        ptoken = strtok_r(NULL, "|", &psave);
+// "pid (comm) state ppid pgrp ...", comm may have spaces and parentheses
+static int get_thr_id(u32 proc_id, struct thread_id *id)
+{
+    char stat[LINE_BUF_LEN];
+    char *comm, *p;
+
+    if (read_proc_str(proc_id, "stat", stat, LINE_BUF_LEN)) {
+        return -1;
     }
-    *(id_str[PS_TYPE_COMM] + TASK_COMM_LEN - 1) = '\0';
 
-    id->tgid = atoi(id_str[PS_TYPE_PID]);
-    id->pid  = atoi(id_str[PS_TYPE_TID]);
-    id->ppid = atoi(id_str[PS_TYPE_PPID]);
-    id->pgid = atoi(id_str[PS_TYPE_PGID]);
-    (void)strncpy(id->comm, id_str[PS_TYPE_COMM], TASK_COMM_LEN - 1);
+    comm = strchr(stat, '(');
+    p = strrchr(stat, ')');
+    if (comm == NULL || p == NULL || p < comm) {
+        return -1;
+    }
+    *p = 0;
+    if (sscanf(p + 1, " %*c %d %d", &id->ppid, &id->pgid) != 2) {
+        return -1;
+    }
 
-    return;
+    id->tgid = (int)proc_id;
+    (void)strncpy(id->comm, comm + 1, TASK_COMM_LEN - 1);
+    return 0;
 }
 
 void load_thread2bpf(u32 proc_id, int fd)
 {
-    FILE *f = NULL;
-    char cmd[COMMAND_LEN];
-    char line[LINE_BUF_LEN];
-    struct thread_id id;
-
-    cmd[0] = 0;
-    (void)snprintf(cmd, COMMAND_LEN, TASK_ID_COMMAND, proc_id);
-    f = popen(cmd, "r");
-    if (f == NULL) {
+    DIR *dir;
+    struct dirent *entry;
+    char path[PATH_LEN];
+    struct thread_data thr = {0};
+
+    if (get_thr_id(proc_id, &thr.id)) {
         return;
     }
-    while (!feof(f)) {
-        line[0] = 0;
-        if (fgets(line, LINE_BUF_LEN, f) == NULL) {
-            break;
-        }
-        SPLIT_NEWLINE_SYMBOL(line);
-        get_thr_id((char *)line, &id);
-        if (id.tgid > 0) {
-            do_load_thread2bpf(fd, &id);
+
+    path[0] = 0;
+    (void)snprintf(path, PATH_LEN, PROC_TASK_PATH, proc_id);
+    dir = opendir(path);
+    if (dir == NULL) {
+        return;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        if (!is_digit_str(entry->d_name)) {
+            continue;
         }
+        thr.id.pid = atoi(entry->d_name);
+        /* update task map and daemon task map */
+        (void)bpf_map_update_elem(fd, &thr.id.pid, &thr, BPF_ANY);
+        DEBUG("[TASKPROBE]: load daemon thread '[pid=%d,tgid=%d,pgid=%d,ppid=%d,comm=%s]'.\n",
+              thr.id.pid, thr.id.tgid, thr.id.pgid, thr.id.ppid, thr.id.comm);
     }
 
-    pclose(f);
+    closedir(dir);
     return;
 }
-
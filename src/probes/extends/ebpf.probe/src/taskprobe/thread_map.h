@@ -46,5 +46,55 @@ static __always_inline __maybe_unused int thread_put(int pid)
     return bpf_map_delete_elem(&g_thread_map, &pid);
 }
 
+static __always_inline __maybe_unused int get_task_pgid(const struct task_struct *cur_task)
+{
+    int pgid = 0;
+
+    /* ns info from thread_pid */
+#if (CURRENT_KERNEL_VERSION < KERNEL_VERSION(4, 13, 0))
+    struct pid *thread_pid = _(cur_task->pids[PIDTYPE_PID].pid);
+#else
+    struct pid *thread_pid = _(cur_task->thread_pid);
+#endif
+    struct pid_namespace *ns_info = (struct pid_namespace *)0;
+    if (thread_pid != 0) {
+        int l = _(thread_pid->level);
+        struct upid thread_upid = _(thread_pid->numbers[l]);
+        ns_info = thread_upid.ns;
+    }
+
+    /* upid info from signal */
+    struct pid *pid_p = (struct pid *)0;
+#if (CURRENT_KERNEL_VERSION < KERNEL_VERSION(4, 13, 0))
+    bpf_probe_read(&pid_p, sizeof(struct pid *), &cur_task->group_leader->pids[PIDTYPE_PGID].pid);
+#else
+    struct signal_struct* signal = _(cur_task->signal);
+    bpf_probe_read(&pid_p, sizeof(struct pid *), &signal->pids[PIDTYPE_PGID]);
+#endif
+    int level = _(pid_p->level);
+    struct upid upid = _(pid_p->numbers[level]);
+    if (upid.ns == ns_info) {
+        pgid = upid.nr;
+    }
+
+    return pgid;
+}
+
+static __always_inline __maybe_unused int thread_add_task(struct task_struct *task)
+{
+    struct thread_data thr = {0};
+    struct task_struct* parent;
+
+    thr.id.pid = _(task->pid);
+    thr.id.tgid = _(task->tgid);
+    parent = _(task->parent);
+    if (parent) {
+        thr.id.ppid = _(parent->pid);
+    }
+    thr.id.pgid = get_task_pgid(task);
+    bpf_probe_read(thr.id.comm, sizeof(thr.id.comm), task->comm);
+    return thread_add(thr.id.pid, &thr);
+}
+
 
 #endif
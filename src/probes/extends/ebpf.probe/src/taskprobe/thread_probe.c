@@ -113,7 +113,7 @@ static int load_thread_create_pb(struct bpf_prog_s* prog, int fd)
     struct perf_buffer *pb;
 
     if (prog->pb == NULL) {
-        pb = create_pref_buffer(fd, output_thread_metrics);
+        pb = create_pref_buffer3(fd, output_thread_metrics, &prog->pb_lost);
         if (pb == NULL) {
             fprintf(stderr, "ERROR: crate perf buffer failed\n");
             return -1;
@@ -22,7 +22,8 @@
 
 char g_linsence[] SEC("license") = "GPL";
 
-KPROBE_FS_OP(generic_file_read_iter, tmpfs, read, TASK_PROBE_TMPFS_OP)
-KPROBE_FS_OP(generic_file_write_iter, tmpfs, write, TASK_PROBE_TMPFS_OP)
-KPROBE_FS_OP(noop_fsync, tmpfs, flush, TASK_PROBE_TMPFS_OP)
+KPROBE_FS_OP(generic_file_read_iter, tmpfs, read, TASK_PROBE_TMPFS_OP, struct kiocb *iocb, struct iov_iter *iter)
+KPROBE_FS_OP(generic_file_write_iter, tmpfs, write, TASK_PROBE_TMPFS_OP, struct kiocb *iocb, struct iov_iter *iter)
+KPROBE_FS_OP(noop_fsync, tmpfs, flush, TASK_PROBE_TMPFS_OP,
+    struct file *file, loff_t start, loff_t end, int datasync)
 
@@ -0,0 +1,42 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2023. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: process whitelist map defined
+ ******************************************************************************/
+#ifndef __WL_MAP_H__
+#define __WL_MAP_H__
+
+#pragma once
+
+#include <bpf/bpf_helpers.h>
+#include <bpf/bpf_tracing.h>
+#include <bpf/bpf_core_read.h>
+#include "proc.h"
+
+#define __PROC_WL_MAX   64  // PROC_MAX_RANGE, and one entry for the patterns matched in user space
+struct {
+    __uint(type, BPF_MAP_TYPE_LPM_TRIE);
+    __uint(key_size, sizeof(struct proc_wl_key_s));
+    __uint(value_size, sizeof(struct proc_wl_val_s));
+    __uint(max_entries, __PROC_WL_MAX + 1);
+    __uint(map_flags, BPF_F_NO_PREALLOC);
+} g_proc_wl_map SEC(".maps");
+
+// The longest pattern matched by the comm of current task, NULL if none.
+static __always_inline __maybe_unused struct proc_wl_val_s* match_proc_wl(struct proc_wl_key_s *key)
+{
+    key->prefixlen = TASK_COMM_LEN * 8;
+    (void)bpf_get_current_comm(key->comm, sizeof(key->comm));
+    return (struct proc_wl_val_s *)bpf_map_lookup_elem(&g_proc_wl_map, key);
+}
+
+#endif
@@ -0,0 +1,119 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: tcp abnormal probe
+ ******************************************************************************/
+#ifndef __TCP_ABN_H__
+#define __TCP_ABN_H__
+
+#pragma once
+
+#include "tcp_link.h"
+
+static __always_inline void report_abn(struct tcp_hook_s *hook, char immed)
+{
+    struct sock_stats_s *sock_stats = hook->sock_stats;
+
+    if (!immed) {
+        if (!is_tcp_tmout(&(sock_stats->ts_stats.abn_ts), hook->ts, hook->period)) {
+            return;
+        }
+    }
+    sock_stats->metrics.report_flags |= TCP_PROBE_ABN;
+}
+
+// Called after the metrics is output
+static __always_inline void reset_tcp_abn_stats(struct tcp_abn *stats)
+{
+    u32 last_time_sk_drops = stats->sk_drops;
+    u32 last_time_lost_out = stats->lost_out;
+    u32 last_time_sacked_out = stats->sacked_out;
+
+    __builtin_memset(stats, 0x0, sizeof(struct tcp_abn));
+    stats->last_time_sk_drops = last_time_sk_drops;
+    stats->last_time_lost_out = last_time_lost_out;
+    stats->last_time_sacked_out = last_time_sacked_out;
+}
+
+static int get_tcp_abn_stats(struct sock *sk, struct tcp_abn* stats)
+{
+    struct tcp_sock *tcp_sk = (struct tcp_sock *)sk;
+
+    stats->sk_err = _(sk->sk_err);
+    stats->sk_err_soft = _(sk->sk_err_soft);
+    stats->sk_drops = _(sk->sk_drops.counter);
+    stats->lost_out = _(tcp_sk->lost_out);
+    stats->sacked_out = _(tcp_sk->sacked_out);
+
+    if ((stats->sk_drops > stats->last_time_sk_drops)
+        || (stats->lost_out > stats->last_time_lost_out)
+        || (stats->sacked_out > stats->last_time_sacked_out)) {
+        return 1;
+    }
+
+    return 0;
+}
+
+static void tcp_abn_stats_probe_func(struct sock *sk, struct tcp_hook_s *hook)
+{
+    struct sock_stats_s *sock_stats = hook->sock_stats;
+
+    // Avoid high performance costs
+    if (!is_tcp_tmout(&(sock_stats->ts_stats.abn_ts), hook->ts, hook->period)) {
+        return;
+    }
+
+    if (get_tcp_abn_stats(sk, &(sock_stats->metrics.abn_stats))) {
+        report_abn(hook, 1);
+    }
+}
+
+#if (CURRENT_KERNEL_VERSION < KERNEL_VERSION(4, 13, 0))
+static __always_inline unsigned char *__skb_transport_header(struct sk_buff *skb)
+{
+    return _(skb->head) + _(skb->transport_header);
+}
+
+static __always_inline struct tcphdr *__tcp_hdr(struct sk_buff *skb)
+{
+    return (struct tcphdr *)__skb_transport_header(skb);
+}
+
+static __always_inline int tcp_abn_snd_rsts_probe_precheck(struct sock *sk, struct sk_buff *skb)
+{
+    struct tcphdr *th;
+    __u16 rst_flag = 0;
+
+    if (sk == NULL || skb == NULL) {
+        return 0;
+    }
+
+    th = __tcp_hdr(skb);
+    /* rst is the llth bit of the byte after tcphdr:ack_seq */
+    bpf_probe_read(&rst_flag, sizeof(rst_flag), (char *)&(th->ack_seq) + sizeof(th->ack_seq));
+    rst_flag = (rst_flag >> 10) & 0x1;
+
+    /* Will not send a reset in response to a reset. */
+    if (rst_flag) {
+        return 0;
+    }
+
+    /* only probe full socket(not a timewait or request socket) */
+    if ((1 << _(sk->sk_state)) & ~(TCPF_TIME_WAIT | TCPF_NEW_SYN_RECV)) {
+        return 1;
+    }
+
+    return 0;
+}
+#endif
+
+#endif
@@ -67,7 +67,7 @@ static void load_tcp_fd(u32 tgid)
     (void)bpf_map_delete_elem(&tcp_fd_map, &tgid);
 }
 
-KPROBE(tcp_sendmsg, pt_regs)
+KPROBE_FENTRY(tcp_sendmsg)
 {
     /* create tcp sock from tcp fd */
     u32 tgid = bpf_get_current_pid_tgid() >> INT_LEN;
@@ -75,7 +75,7 @@ KPROBE(tcp_sendmsg, pt_regs)
     return 0;
 }
 
-KPROBE(tcp_recvmsg, pt_regs)
+KPROBE_FENTRY(tcp_recvmsg)
 {
     /* create tcp sock from tcp fd */
     u32 tgid = bpf_get_current_pid_tgid() >> INT_LEN;
@@ -19,35 +19,42 @@
 #include <bpf/bpf_endian.h>
 #include "bpf.h"
 #include "tcp_link.h"
+#include "tcp_abn.h"
+#include "tcp_rtt.h"
+#include "tcp_windows.h"
+#include "tcp_rate.h"
+#include "tcp_sockbuf.h"
+#include "tcp_tx_rx.h"
 
 char g_linsence[] SEC("license") = "GPL";
 
 static __always_inline void report_srtt(void *ctx, struct tcp_metrics_s *metrics)
 {
     metrics->report_flags |= TCP_PROBE_SRTT;
-    (void)bpf_perf_event_output(ctx, &tcp_output, BPF_F_CURRENT_CPU, metrics, sizeof(struct tcp_metrics_s));
+    (void)bpf_output(ctx, &tcp_output, metrics, sizeof(struct tcp_metrics_s));
     metrics->report_flags &= ~TCP_PROBE_SRTT;
 }
 
-static __always_inline struct sock_info_s* is_exist_tcp_link(struct sock *sk, char *is_exist)
+static __always_inline void count_tcp_evict(void)
 {
-    struct sock_info_s *sock_info = bpf_map_lookup_elem(&sock_map, &sk);
-    if (sock_info) {
-        *is_exist = (char)sock_info->tcp_link_ok;
-        return sock_info;
+    u32 key = 0;
+    u64 *evicted = (u64 *)bpf_map_lookup_elem(&tcp_evict_map, &key);
+
+    if (evicted) {
+        (*evicted)++;
     }
-    return NULL;
 }
 
 static __always_inline int add_tcp_link(struct sock *sk, struct sock_info_s *info, u32 tgid)
 {
     struct tcp_link_s link = {0};
+    char is_evicted = (info->link_state == TCP_LINK_OK);
 
     if (!is_valid_tgid(tgid)) {
         return -1;
     }
 
-    info->tcp_link_ok = 1;
+    info->link_state = TCP_LINK_OK;
     info->proc_id = tgid;
 
     /* update c_port_flag */
@@ -87,6 +94,12 @@ static __always_inline int add_tcp_link(struct sock *sk, struct sock_info_s *inf
     link.role = info->role;
     link.tgid = tgid;
     (void)bpf_get_current_comm(&link.comm, sizeof(link.comm));
+    // The bytes of an evicted link are kept, user space goes on outputting deltas from them.
+    if (is_evicted) {
+        count_tcp_evict();
+    } else {
+        init_tcp_bytes(sk);
+    }
     return create_tcp_link(sk, &link, info->syn_srtt);
 }
 
@@ -115,20 +128,22 @@ KPROBE(tcp_set_state, pt_regs)
         struct tcp_metrics_s *metrics;
         metrics = get_tcp_metrics(sk);
         if (metrics) {
-            metrics->report_flags |= (TCP_PROBE_ABN | TCP_PROBE_WINDOWS \
-                | TCP_PROBE_RTT | TCP_PROBE_TXRX | TCP_PROBE_SOCKBUF | TCP_PROBE_RATE);
+            metrics->report_flags |= (TCP_PROBE_ABN | TCP_HARVEST_PROBES);
             report_srtt(ctx, metrics);
         }
 
+        struct sock_info_s *info = bpf_map_lookup_elem(&sock_map, &sk);
+        if (info) {
+            info->link_state = TCP_LINK_CLOSED;
+        }
         (void)delete_tcp_link(sk);
     }
     return 0;
 }
 
 #if (CURRENT_KERNEL_VERSION > KERNEL_VERSION(4, 18, 0))
-KRAWTRACE(tcp_destroy_sock, bpf_raw_tracepoint_args)
+KRAWTRACE_BTF(tcp_destroy_sock, struct sock *sk)
 {
-    struct sock *sk = (struct sock *)ctx->args[0];
     delete_sock_obj(sk);
     return 0;
 }
@@ -148,16 +163,18 @@ void bpf_trace_tcp_destroy_sock_func(struct trace_event_raw_tcp_event_sk *ctx)
 }
 #endif
 
-KPROBE(tcp_sendmsg, pt_regs)
+/*
+ * Called if the sock is not in tcp_link_map. tcp_link_map is LRU, a live link evicted by it is re-created
+ * here, only closed links are not.
+ */
+static __always_inline void try_add_tcp_link(void *ctx, struct sock *sk)
 {
-    struct sock *sk = (struct sock *)PT_REGS_PARM1(ctx);
     struct sock_info_s *info;
     struct tcp_metrics_s *metrics;
-    char tcp_link_exist = 0;
 
-    info = is_exist_tcp_link(sk, &tcp_link_exist);
-    if (tcp_link_exist || !info) {
-        return 0;
+    info = bpf_map_lookup_elem(&sock_map, &sk);
+    if (!info || info->link_state == TCP_LINK_CLOSED) {
+        return;
     }
 
     /* create tcp sock from tcp fd */
@@ -168,29 +185,317 @@ KPROBE(tcp_sendmsg, pt_regs)
     if (metrics) {
         report_srtt(ctx, metrics);
     }
+}
+
+// Output the metrics once for all abnormal events of the hook, other sub probes are harvested by user space.
+static __always_inline void tcp_hook_exit(void *ctx, struct tcp_hook_s *hook)
+{
+    struct tcp_metrics_s *metrics = &(hook->sock_stats->metrics);
+
+    if ((metrics->report_flags & TCP_PROBE_ABN) == 0) {
+        return;
+    }
+
+    (void)bpf_output(ctx, &tcp_output, metrics, sizeof(struct tcp_metrics_s));
+    metrics->report_flags &= ~TCP_PROBE_ABN;
+    reset_tcp_abn_stats(&(metrics->abn_stats));
+}
+
+KPROBE_FENTRY(tcp_sendmsg, struct sock *sk, struct msghdr *msg, size_t size)
+{
+    struct tcp_hook_s hook;
+
+    if (tcp_hook_enter(&hook, sk, TCP_PROBE_TXRX)) {
+        tcp_tx_probe_func(sk, size);
+    } else if (hook.sock_stats == NULL) {
+        try_add_tcp_link(ctx, sk);
+    }
+    return 0;
+}
+
+KPROBE_FENTRY(tcp_recvmsg, struct sock *sk)
+{
+    if (get_tcp_metrics(sk) == NULL) {
+        try_add_tcp_link(ctx, sk);
+    }
+    return 0;
+}
+
+KPROBE_FENTRY(tcp_cleanup_rbuf, struct sock *sk, int copied)
+{
+    struct tcp_hook_s hook;
+
+    if (copied <= 0) {
+        return 0;
+    }
+
+    if (tcp_hook_enter(&hook, sk, TCP_PROBE_TXRX)) {
+        tcp_rx_probe_func(sk, &hook, copied);
+    }
+    return 0;
+}
+
+static void tcp_rcv_probe_func(void *ctx, struct sock *sk)
+{
+    struct tcp_hook_s hook;
+
+    if (!tcp_hook_enter(&hook, sk, TCP_RCV_PROBES)) {
+        return;
+    }
+
+    if (hook.probes & TCP_PROBE_ABN) {
+        tcp_abn_stats_probe_func(sk, &hook);
+    }
+    if (hook.probes & TCP_PROBE_RTT) {
+        tcp_rtt_probe_func(sk, &hook);
+    } else if (hook.probes & TCP_PROBE_RTT2) {
+        tcp_rtt2_probe_func(sk, &hook);
+    }
+    if (hook.probes & TCP_PROBE_SOCKBUF) {
+        tcp_sockbuf_probe_func(sk, &hook);
+    }
+    tcp_hook_exit(ctx, &hook);
+}
+
+#if (CURRENT_KERNEL_VERSION > KERNEL_VERSION(4, 18, 0))
+KRAWTRACE_BTF(tcp_probe, struct sock *sk, struct sk_buff *skb)
+{
+    tcp_rcv_probe_func(ctx, sk);
+    return 0;
+}
+#else
+KPROBE(tcp_rcv_established, pt_regs)
+{
+    struct sock *sk = (struct sock*)PT_REGS_PARM1(ctx);
+    tcp_rcv_probe_func(ctx, sk);
     return 0;
 }
+#endif
+
+static void tcp_rcv_space_probe_func(void *ctx, struct sock *sk)
+{
+    struct tcp_hook_s hook;
+
+    if (!tcp_hook_enter(&hook, sk, TCP_RCV_SPACE_PROBES)) {
+        return;
+    }
+
+    if (hook.probes & TCP_PROBE_RATE) {
+        tcp_rate_probe_func(sk, &hook);
+    }
+    if (hook.probes & TCP_PROBE_WINDOWS) {
+        tcp_wnd_probe_func(sk, &hook);
+    }
+}
 
-KPROBE(tcp_recvmsg, pt_regs)
+#if (CURRENT_KERNEL_VERSION > KERNEL_VERSION(4, 18, 0))
+KRAWTRACE_BTF(tcp_rcv_space_adjust, struct sock *sk)
+{
+    tcp_rcv_space_probe_func(ctx, sk);
+    return 0;
+}
+#elif (CURRENT_KERNEL_VERSION < KERNEL_VERSION(4, 13, 0))
+KPROBE(tcp_rcv_space_adjust, pt_regs)
 {
     struct sock *sk = (struct sock *)PT_REGS_PARM1(ctx);
-    struct tcp_metrics_s *metrics;
-    struct sock_info_s *info;
-    char tcp_link_exist = 0;
+    tcp_rcv_space_probe_func(ctx, sk);
+    return 0;
+}
+#else
+SEC("tracepoint/tcp/tcp_rcv_space_adjust")
+int bpf_trace_tcp_rcv_space_adjust_func(struct trace_event_raw_tcp_event_sk_skb *ctx)
+{
+    struct sock *sk = (struct sock*)ctx->skaddr;
+    tcp_rcv_space_probe_func(ctx, sk);
+    return 0;
+}
+#endif
+
+#if 1 // Abnormal events, only tcp_abn takes them
+
+KPROBE_RET_FEXIT(tcp_add_backlog, CTX_KERNEL, bool discard, struct sock *sk, struct sk_buff *skb)
+{
+    struct tcp_hook_s hook;
+
+    if (discard && tcp_hook_enter(&hook, sk, TCP_PROBE_ABN)) {
+        TCP_BACKLOG_DROPS_INC(hook.sock_stats->metrics.abn_stats);
+        report_abn(&hook, 0);
+        tcp_hook_exit(ctx, &hook);
+    }
+    return 0;
+}
+
+KPROBE_RET_FEXIT(tcp_filter, CTX_KERNEL, int discard, struct sock *sk, struct sk_buff *skb)
+{
+    struct tcp_hook_s hook;
+
+    if (discard && tcp_hook_enter(&hook, sk, TCP_PROBE_ABN)) {
+        TCP_FILTER_DROPS_INC(hook.sock_stats->metrics.abn_stats);
+        report_abn(&hook, 0);
+        tcp_hook_exit(ctx, &hook);
+    }
+    return 0;
+}
+
+#ifndef TCP_WRITE_ERR_PROBE_OFF
+KPROBE(tcp_write_err, pt_regs)
+{
+    struct sock *sk = (struct sock *)PT_REGS_PARM1(ctx);
+    struct tcp_hook_s hook;
+
+    if (tcp_hook_enter(&hook, sk, TCP_PROBE_ABN)) {
+        TCP_TMOUT_INC(hook.sock_stats->metrics.abn_stats);
+        report_abn(&hook, 1);
+        tcp_hook_exit(ctx, &hook);
+    }
+    return 0;
+}
+#endif
+
+KRAWTRACE_BTF(sock_exceed_buf_limit, struct sock *sk)
+{
+    struct tcp_hook_s hook;
+
+    if (tcp_hook_enter(&hook, sk, TCP_PROBE_ABN)) {
+        TCP_SNDBUF_LIMIT_INC(hook.sock_stats->metrics.abn_stats);
+        report_abn(&hook, 0);
+        tcp_hook_exit(ctx, &hook);
+    }
+    return 0;
+}
+
+static int tcp_abn_snd_rsts_probe_func(void *ctx, struct sock *sk)
+{
+    struct tcp_hook_s hook;
+
+    if (tcp_hook_enter(&hook, sk, TCP_PROBE_ABN)) {
+        TCP_SEND_RSTS_INC(hook.sock_stats->metrics.abn_stats);
+        report_abn(&hook, 1);
+        tcp_hook_exit(ctx, &hook);
+    }
+    return 0;
+}
+
+static int tcp_abn_rcv_rsts_probe_func(void *ctx, struct sock *sk)
+{
+    struct tcp_hook_s hook;
+
+    if (tcp_hook_enter(&hook, sk, TCP_PROBE_ABN)) {
+        TCP_RECEIVE_RSTS_INC(hook.sock_stats->metrics.abn_stats);
+        report_abn(&hook, 1);
+        tcp_hook_exit(ctx, &hook);
+    }
+    return 0;
+}
+
+#if (CURRENT_KERNEL_VERSION > KERNEL_VERSION(4, 18, 0))
+KRAWTRACE_BTF(tcp_send_reset, struct sock *sk)
+{
+    return tcp_abn_snd_rsts_probe_func(ctx, sk);
+}
+
+KRAWTRACE_BTF(tcp_receive_reset, struct sock *sk)
+{
+    return tcp_abn_rcv_rsts_probe_func(ctx, sk);
+}
+#elif (CURRENT_KERNEL_VERSION < KERNEL_VERSION(4, 13, 0))
+/*
+ * Tcp tracepoint does not exist in this version, so use kprobe as hook instead.
+ *    tcp_send_reset --> tcp_v4_send_reset()/tcp_v6_send_reset()/tcp_send_active_reset()
+ *    tcp_receive_reset --> tcp_reset()
+ */
+KPROBE(tcp_v4_send_reset, pt_regs)
+{
+    struct sock *sk = (struct sock *)PT_REGS_PARM1(ctx);
+    struct sk_buff *skb = (struct sk_buff *)PT_REGS_PARM2(ctx);
+    if (tcp_abn_snd_rsts_probe_precheck(sk, skb)) {
+        tcp_abn_snd_rsts_probe_func(ctx, sk);
+    }
+    return 0;
+}
+
+KPROBE(tcp_v6_send_reset, pt_regs)
+{
+    struct sock *sk = (struct sock *)PT_REGS_PARM1(ctx);
+    struct sk_buff *skb = (struct sk_buff *)PT_REGS_PARM2(ctx);
+    if (tcp_abn_snd_rsts_probe_precheck(sk, skb)) {
+        tcp_abn_snd_rsts_probe_func(ctx, sk);
+    }
+    return 0;
+}
+
+KPROBE(tcp_send_active_reset, pt_regs)
+{
+    struct sock *sk = (struct sock *)PT_REGS_PARM1(ctx);
+    tcp_abn_snd_rsts_probe_func(ctx, sk);
+    return 0;
+}
+
+KPROBE(tcp_reset, pt_regs)
+{
+    struct sock *sk = (struct sock *)PT_REGS_PARM1(ctx);
+    tcp_abn_rcv_rsts_probe_func(ctx, sk);
+    return 0;
+}
+#else
+SEC("tracepoint/tcp/tcp_send_reset")
+int bpf_trace_tcp_send_reset_func(struct trace_event_raw_tcp_event_sk_skb *ctx)
+{
+    struct sock *sk = (struct sock *)ctx->skaddr;
+    return tcp_abn_snd_rsts_probe_func(ctx, sk);
+}
+
+SEC("tracepoint/tcp/tcp_receive_reset")
+int bpf_trace_tcp_receive_reset_func(struct trace_event_raw_tcp_event_sk_skb *ctx)
+{
+    struct sock *sk = (struct sock *)ctx->skaddr;
+    return tcp_abn_rcv_rsts_probe_func(ctx, sk);
+}
+#endif
+
+KPROBE_FENTRY(tcp_retransmit_skb, struct sock *sk, struct sk_buff *skb, int segs)
+{
+    struct tcp_hook_s hook;
 
-    info = is_exist_tcp_link(sk, &tcp_link_exist);
-    if (tcp_link_exist || !info) {
+    if (tcp_hook_enter(&hook, sk, TCP_PROBE_ABN)) {
+        TCP_RETRANS_INC(hook.sock_stats->metrics.abn_stats, segs);
+        report_abn(&hook, 0);
+        tcp_hook_exit(ctx, &hook);
+    }
+    return 0;
+}
+
+KPROBE_RET_FEXIT(tcp_try_rmem_schedule, CTX_KERNEL, int ret, struct sock *sk, struct sk_buff *skb,
+                 unsigned int size)
+{
+    struct tcp_hook_s hook;
+
+    if (ret == 0 || sk == (void *)0) {
         return 0;
     }
 
-    /* create tcp sock from tcp fd */
-    u32 tgid = bpf_get_current_pid_tgid() >> INT_LEN;
+    if (tcp_hook_enter(&hook, sk, TCP_PROBE_ABN)) {
+        TCP_RMEM_SCHEDULS_INC(hook.sock_stats->metrics.abn_stats);
+        report_abn(&hook, 0);
+        tcp_hook_exit(ctx, &hook);
+    }
+    return 0;
+}
 
-    (void)add_tcp_link(sk, info, tgid);
-    metrics = get_tcp_metrics(sk);
-    if (metrics) {
-        report_srtt(ctx, metrics);
+KPROBE_RET_FEXIT(tcp_check_oom, CTX_KERNEL, bool ret, struct sock *sk, int shift)
+{
+    struct tcp_hook_s hook;
+
+    if (!ret || sk == (void *)0) {
+        return 0;
+    }
+
+    if (tcp_hook_enter(&hook, sk, TCP_PROBE_ABN)) {
+        TCP_OOM_INC(hook.sock_stats->metrics.abn_stats);
+        report_abn(&hook, 0);
+        tcp_hook_exit(ctx, &hook);
     }
     return 0;
 }
 
+#endif
@@ -27,14 +27,22 @@
 
 #define __TCP_LINK_MAX (10 * 1024)
 // Used to identifies the TCP link(including multiple establish tcp connection)
-// and save TCP statistics.
+// and save TCP statistics. User space harvests it every period, links never closed are evicted by LRU.
 struct {
-    __uint(type, BPF_MAP_TYPE_HASH);
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
     __uint(key_size, sizeof(struct sock *));
     __uint(value_size, sizeof(struct sock_stats_s));
     __uint(max_entries, __TCP_LINK_MAX);
 } tcp_link_map SEC(".maps");
 
+// Live links evicted from tcp_link_map and re-created, user space warns if it grows.
+struct {
+    __uint(type, BPF_MAP_TYPE_PERCPU_ARRAY);
+    __uint(key_size, sizeof(u32));
+    __uint(value_size, sizeof(u64));
+    __uint(max_entries, 1);
+} tcp_evict_map SEC(".maps");
+
 
 #define __TCP_TUPLE_MAX (10 * 1024)
 // Used to identifies the TCP sock object, and role of the SOCK object.
@@ -54,12 +62,7 @@ struct {
     __uint(max_entries, 1);
 } args_map SEC(".maps");
 
-struct {
-    __uint(type, BPF_MAP_TYPE_PERF_EVENT_ARRAY);
-    __uint(key_size, sizeof(u32));
-    __uint(value_size, sizeof(u32));
-    __uint(max_entries, 64);
-} tcp_output SEC(".maps");
+BPF_OUTPUT_MAP(tcp_output, BPF_OUTPUT_BUF_SIZE);
 
 #define __PERIOD    NS(30)
 static __always_inline __maybe_unused u64 get_period()
@@ -120,20 +123,19 @@ static __always_inline __maybe_unused char is_valid_tgid(u32 tgid)
 
 #define REPORT_START_DELAY_2    2
 #define REPORT_START_DELAY_4    4
-#define REPORT_START_DELAY_6    6
 #define REPORT_START_DELAY_8    8
 #define REPORT_START_DELAY_10   10
 static __always_inline __maybe_unused int create_tcp_link(struct sock *sk, struct tcp_link_s *link, u32 syn_srtt)
 {
     struct sock_stats_s sock_stats = {0};
 
+    sock_stats.metrics.sk = (u64)sk;
     sock_stats.metrics.srtt_stats.syn_srtt = syn_srtt;
     __builtin_memcpy(&(sock_stats.metrics.link), link, sizeof(struct tcp_link_s));
     u64 ts = bpf_ktime_get_ns();
     sock_stats.ts_stats.abn_ts = ts;
     sock_stats.ts_stats.win_ts = ts + NS(REPORT_START_DELAY_2);
     sock_stats.ts_stats.rtt_ts = ts + NS(REPORT_START_DELAY_4);
-    sock_stats.ts_stats.txrx_ts = ts + NS(REPORT_START_DELAY_6);
     sock_stats.ts_stats.sockbuf_ts = ts + NS(REPORT_START_DELAY_8);
     sock_stats.ts_stats.rate_ts = ts + NS(REPORT_START_DELAY_10);
 
@@ -156,6 +158,51 @@ static __always_inline __maybe_unused struct tcp_metrics_s *get_tcp_metrics(stru
     return NULL;
 }
 
+static __always_inline __maybe_unused char is_tcp_tmout(u64 *last_ts, u64 ts, u64 period)
+{
+    if ((ts > *last_ts) && ((ts - *last_ts) >= period)) {
+        *last_ts = ts;
+        return 1;
+    }
+    return 0;
+}
+
+/*
+ * All sub probes hooked on a kernel function run in one program, the args and the link are looked up
+ * once for them. Sub probes only update the metrics, tcp_abn sets report_flags and the metrics is output once
+ * when the hook exits.
+ */
+struct tcp_hook_s {
+    struct sock_stats_s *sock_stats;
+    u64 ts;
+    u64 period;
+    u32 probes;             // sub probes enabled on this hook, refer to TCP_PROBE_xxx
+};
+
+static __always_inline __maybe_unused char tcp_hook_enter(struct tcp_hook_s *hook, struct sock *sk, u32 probes)
+{
+    u32 key = 0;
+    struct tcp_args_s *args;
+
+    hook->sock_stats = NULL;
+    hook->probes = 0;
+
+    args = (struct tcp_args_s *)bpf_map_lookup_elem(&args_map, &key);
+    if (args == NULL) {
+        return 0;
+    }
+
+    hook->sock_stats = (struct sock_stats_s *)bpf_map_lookup_elem(&tcp_link_map, &sk);
+    if (hook->sock_stats == NULL) {
+        return 0;
+    }
+
+    hook->probes = args->load_probe & probes;
+    hook->period = args->period;
+    hook->ts = bpf_ktime_get_ns();
+    return (hook->probes != 0);
+}
+
 static __always_inline __maybe_unused int create_sock_obj(u32 tgid, struct sock *sk, struct sock_info_s *info)
 {
     if (is_gopher_comm()) {
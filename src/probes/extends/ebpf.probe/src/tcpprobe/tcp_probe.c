@@ -15,6 +15,7 @@
 #include <errno.h>
 #include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <sys/resource.h>
@@ -29,29 +30,37 @@
 
 #include "bpf.h"
 #include "args.h"
+#include "hash.h"
+#include "map_batch.h"
 #include "tcpprobe.h"
 #include "tcp_event.h"
-#include "tcp_tx_rx.skel.h"
-#include "tcp_windows.skel.h"
-#include "tcp_sockbuf.skel.h"
-#include "tcp_rtt.skel.h"
-#include "tcp_rate.skel.h"
-#include "tcp_abn.skel.h"
 #include "tcp_link.skel.h"
-#include "tcp_rtt2.skel.h"
 
 #define TCP_TBL_ABN     "tcp_abn"
 #define TCP_TBL_SYNRTT  "tcp_srtt"
-#define TCP_TBL_RTT     "tcp_rtt"
-#define TCP_TBL_WIN     "tcp_windows"
-#define TCP_TBL_RATE    "tcp_rate"
-#define TCP_TBL_SOCKBUF "tcp_sockbuf"
-#define TCP_TBL_TXRX    "tcp_tx_rx"
+#define TCP_TBL_LINK    "tcp_link"
+
+// Link in tcp_link_map seen by the last harvest
+struct tcp_link_hist_s {
+    H_HANDLE;
+    u64 sk;                         // key in tcp_link_map
+    u32 gen;                        // harvest round it is seen last
+    struct tcp_ts ts_stats;
+    struct tcp_tx_rx tx_rx_stats;   // output deltas from it
+    struct tcp_bytes_s bytes;       // summed up from tcp_bytes_map by this harvest
+};
 
 static struct probe_params *g_args = NULL;
-
-static void output_tcp_metrics(void *ctx, int cpu, void *data, u32 size);
-static unsigned int is_load_probe(struct probe_params *args, u32 probe);
+static u32 g_load_probe;
+static u32 g_harvest_gen;
+static int g_cpus;
+static int g_bytes_fd = -1;
+static int g_evict_fd = -1;
+static u64 g_evicted;                               // live links re-created after LRU eviction
+static struct tcp_bytes_s *g_bytes_values = NULL;  // values of all CPUs in tcp_bytes_map
+static struct map_batch_s *g_bytes_batch = NULL;
+static struct map_batch_s *g_link_batch = NULL;
+static struct tcp_link_hist_s *g_link_hist = NULL;
 
 static void output_tcp_abn(void *ctx, int cpu, void *data, __u32 size)
 {
@@ -118,8 +127,6 @@ static void output_tcp_syn_rtt(void *ctx, int cpu, void *data, __u32 size)
 
     report_tcp_syn_rtt_evt(g_args, metrics);
 
-    output_tcp_metrics(ctx, cpu, data, size);
-
     link = &(metrics->link);
     ip_str(link->family, (unsigned char *)&(link->c_ip), src_ip_str, INET6_ADDRSTRLEN);
     ip_str(link->family, (unsigned char *)&(link->s_ip), dst_ip_str, INET6_ADDRSTRLEN);
@@ -140,484 +147,412 @@ static void output_tcp_syn_rtt(void *ctx, int cpu, void *data, __u32 size)
     (void)fflush(stdout);
 }
 
-static void output_tcp_rtt(void *ctx, int cpu, void *data, __u32 size)
+#define TCP_DELTA(cur, last)    (((cur) >= (last)) ? ((cur) - (last)) : (cur))
+
+static void output_tcp_link(struct tcp_metrics_s *metrics, const struct tcp_tx_rx *last_tx_rx)
 {
     struct tcp_link_s *link;
+    struct tcp_tx_rx *tx_rx = &(metrics->tx_rx_stats);
     unsigned char src_ip_str[INET6_ADDRSTRLEN];
     unsigned char dst_ip_str[INET6_ADDRSTRLEN];
 
-    struct tcp_metrics_s *metrics  = (struct tcp_metrics_s *)data;
-
     link = &(metrics->link);
     ip_str(link->family, (unsigned char *)&(link->c_ip), src_ip_str, INET6_ADDRSTRLEN);
     ip_str(link->family, (unsigned char *)&(link->s_ip), dst_ip_str, INET6_ADDRSTRLEN);
 
     (void)fprintf(stdout,
-        "|%s|%u|%u|%s|%s|%u|%u|%u"
-        "|%u|%u|||\n",
-        TCP_TBL_RTT,
+        "|%s|%u|%u|%s|%s|%u|%u|%u",
+        TCP_TBL_LINK,
         link->tgid,
         link->role,
         src_ip_str,
         dst_ip_str,
         link->c_port,
         link->s_port,
-        link->family,
-
-        metrics->rtt_stats.tcpi_srtt,
-        metrics->rtt_stats.tcpi_rcv_rtt);
-    (void)fflush(stdout);
-}
+        link->family);
+
+    // 未开启的子探针输出空字段
+    if (g_load_probe & TCP_PROBE_TXRX) {
+        (void)fprintf(stdout, "|%llu|%llu|%u|%u",
+            TCP_DELTA(tx_rx->rx, last_tx_rx->rx),
+            TCP_DELTA(tx_rx->tx, last_tx_rx->tx),
+            TCP_DELTA(tx_rx->segs_in, last_tx_rx->segs_in),
+            TCP_DELTA(tx_rx->segs_out, last_tx_rx->segs_out));
+    } else {
+        (void)fputs("||||", stdout);
+    }
 
-static void output_tcp_rtt2(void *ctx, int cpu, void *data, __u32 size)
-{
-    struct tcp_link_s *link;
-    unsigned char src_ip_str[INET6_ADDRSTRLEN];
-    unsigned char dst_ip_str[INET6_ADDRSTRLEN];
+    if (g_load_probe & TCP_PROBE_RTT) {
+        (void)fprintf(stdout, "|%u|%u||",
+            metrics->rtt_stats.tcpi_srtt,
+            metrics->rtt_stats.tcpi_rcv_rtt);
+    } else if (g_load_probe & TCP_PROBE_RTT2) {
+        (void)fprintf(stdout, "|||%u|%u",
+            metrics->rtt_stats.tcpi_srtt_max,
+            metrics->rtt_stats.tcpi_rcv_rtt_max);
+    } else {
+        (void)fputs("||||", stdout);
+    }
 
-    struct tcp_metrics_s *metrics  = (struct tcp_metrics_s *)data;
+    if (g_load_probe & TCP_PROBE_WINDOWS) {
+        report_tcp_win_evt(g_args, metrics);
+        (void)fprintf(stdout, "|%u|%u|%u|%u|%u|%u|%u",
+            metrics->win_stats.tcpi_snd_cwnd,
+            metrics->win_stats.tcpi_notsent_bytes,
+            metrics->win_stats.tcpi_notack_bytes,
+            metrics->win_stats.tcpi_reordering,
+            metrics->win_stats.tcpi_snd_wnd,
+            metrics->win_stats.tcpi_rcv_wnd,
+            metrics->win_stats.tcpi_avl_snd_wnd);
+    } else {
+        (void)fputs("|||||||", stdout);
+    }
 
-    link = &(metrics->link);
-    ip_str(link->family, (unsigned char *)&(link->c_ip), src_ip_str, INET6_ADDRSTRLEN);
-    ip_str(link->family, (unsigned char *)&(link->s_ip), dst_ip_str, INET6_ADDRSTRLEN);
+    if (g_load_probe & TCP_PROBE_RATE) {
+        (void)fprintf(stdout, "|%u|%u|%u|%u|%u|%u|%llu|%u|%u|%u|%u|%u",
+            metrics->rate_stats.tcpi_rto,
+            metrics->rate_stats.tcpi_ato,
+            metrics->rate_stats.tcpi_snd_ssthresh,
+            metrics->rate_stats.tcpi_rcv_ssthresh,
+            metrics->rate_stats.tcpi_advmss,
+            metrics->rate_stats.tcpi_rcv_space,
+            metrics->rate_stats.tcpi_delivery_rate,
+            metrics->rate_stats.tcpi_busy_time,
+            metrics->rate_stats.tcpi_rwnd_limited,
+            metrics->rate_stats.tcpi_sndbuf_limited,
+            metrics->rate_stats.tcpi_pacing_rate,
+            metrics->rate_stats.tcpi_max_pacing_rate);
+    } else {
+        (void)fputs("||||||||||||", stdout);
+    }
 
-    (void)fprintf(stdout,
-        "|%s|%u|%u|%s|%s|%u|%u|%u||"
-        "|%u|%u|\n",
-        TCP_TBL_RTT,
-        link->tgid,
-        link->role,
-        src_ip_str,
-        dst_ip_str,
-        link->c_port,
-        link->s_port,
-        link->family,
+    if (g_load_probe & TCP_PROBE_SOCKBUF) {
+        (void)fprintf(stdout, "|%u|%u|%u|%u|%u|%u|%u|%d|%d",
+            metrics->sockbuf_stats.tcpi_sk_err_que_size,
+            metrics->sockbuf_stats.tcpi_sk_rcv_que_size,
+            metrics->sockbuf_stats.tcpi_sk_wri_que_size,
+            metrics->sockbuf_stats.tcpi_sk_backlog_size,
+            metrics->sockbuf_stats.tcpi_sk_omem_size,
+            metrics->sockbuf_stats.tcpi_sk_forward_size,
+            metrics->sockbuf_stats.tcpi_sk_wmem_size,
+            metrics->sockbuf_stats.sk_rcvbuf,
+            metrics->sockbuf_stats.sk_sndbuf);
+    } else {
+        (void)fputs("|||||||||", stdout);
+    }
 
-        metrics->rtt_stats.tcpi_srtt_max,
-        metrics->rtt_stats.tcpi_rcv_rtt_max);
-    (void)fflush(stdout);
+    (void)fputs("|\n", stdout);
 }
 
-static void output_tcp_txrx(void *ctx, int cpu, void *data, __u32 size)
+// A link is output again only if it has traffic or sub probes sampled it since last harvest.
+static char is_tcp_link_updated(const struct sock_stats_s *sock_stats, const struct tcp_link_hist_s *hist)
 {
-    u32 segs_out_delta, segs_in_delta;
-    struct tcp_link_s *link;
-    unsigned char src_ip_str[INET6_ADDRSTRLEN];
-    unsigned char dst_ip_str[INET6_ADDRSTRLEN];
-
-    struct tcp_metrics_s *metrics  = (struct tcp_metrics_s *)data;
-
-    link = &(metrics->link);
-    ip_str(link->family, (unsigned char *)&(link->c_ip), src_ip_str, INET6_ADDRSTRLEN);
-    ip_str(link->family, (unsigned char *)&(link->s_ip), dst_ip_str, INET6_ADDRSTRLEN);
+    const struct tcp_tx_rx *tx_rx = &(sock_stats->metrics.tx_rx_stats);
 
-    segs_in_delta = (metrics->tx_rx_stats.segs_in >= metrics->tx_rx_stats.last_time_segs_in) ?
-        (metrics->tx_rx_stats.segs_in - metrics->tx_rx_stats.last_time_segs_in) : metrics->tx_rx_stats.segs_in;
-    segs_out_delta = (metrics->tx_rx_stats.segs_out >= metrics->tx_rx_stats.last_time_segs_out) ?
-        (metrics->tx_rx_stats.segs_out - metrics->tx_rx_stats.last_time_segs_out) : metrics->tx_rx_stats.segs_out;
-
-    (void)fprintf(stdout,
-        "|%s|%u|%u|%s|%s|%u|%u|%u"
-        "|%llu|%llu|%u|%u|\n",
-        TCP_TBL_TXRX,
-        link->tgid,
-        link->role,
-        src_ip_str,
-        dst_ip_str,
-        link->c_port,
-        link->s_port,
-        link->family,
-
-        metrics->tx_rx_stats.rx,
-        metrics->tx_rx_stats.tx,
-        segs_in_delta,
-        segs_out_delta);
-    (void)fflush(stdout);
+    if (tx_rx->rx != hist->tx_rx_stats.rx || tx_rx->tx != hist->tx_rx_stats.tx) {
+        return 1;
+    }
+    return (memcmp(&(sock_stats->ts_stats), &(hist->ts_stats), sizeof(struct tcp_ts)) != 0);
 }
 
-static void output_tcp_win(void *ctx, int cpu, void *data, __u32 size)
+static struct tcp_link_hist_s *get_tcp_link_hist(u64 sk)
 {
-    struct tcp_link_s *link;
-    unsigned char src_ip_str[INET6_ADDRSTRLEN];
-    unsigned char dst_ip_str[INET6_ADDRSTRLEN];
-
-    struct tcp_metrics_s *metrics  = (struct tcp_metrics_s *)data;
+    struct tcp_link_hist_s *hist = NULL;
 
-    report_tcp_win_evt(g_args, metrics);
-
-    link = &(metrics->link);
-    ip_str(link->family, (unsigned char *)&(link->c_ip), src_ip_str, INET6_ADDRSTRLEN);
-    ip_str(link->family, (unsigned char *)&(link->s_ip), dst_ip_str, INET6_ADDRSTRLEN);
-
-    (void)fprintf(stdout,
-        "|%s|%u|%u|%s|%s|%u|%u|%u"
-        "|%u|%u|%u|%u|%u|%u|%u|\n",
-        TCP_TBL_WIN,
-        link->tgid,
-        link->role,
-        src_ip_str,
-        dst_ip_str,
-        link->c_port,
-        link->s_port,
-        link->family,
+    H_FIND(g_link_hist, &sk, sizeof(u64), hist);
+    if (hist != NULL) {
+        return hist;
+    }
 
-        metrics->win_stats.tcpi_snd_cwnd,
-        metrics->win_stats.tcpi_notsent_bytes,
-        metrics->win_stats.tcpi_notack_bytes,
-        metrics->win_stats.tcpi_reordering,
-        metrics->win_stats.tcpi_snd_wnd,
-        metrics->win_stats.tcpi_rcv_wnd,
-        metrics->win_stats.tcpi_avl_snd_wnd);
-    (void)fflush(stdout);
+    hist = (struct tcp_link_hist_s *)calloc(1, sizeof(struct tcp_link_hist_s));
+    if (hist == NULL) {
+        return NULL;
+    }
+    hist->sk = sk;
+    H_ADD(g_link_hist, sk, sizeof(u64), hist);
+    return hist;
 }
 
-static void output_tcp_rate(void *ctx, int cpu, void *data, __u32 size)
+static void sum_tcp_bytes(const struct tcp_bytes_s *values, struct tcp_bytes_s *bytes)
 {
-    struct tcp_link_s *link;
-    unsigned char src_ip_str[INET6_ADDRSTRLEN];
-    unsigned char dst_ip_str[INET6_ADDRSTRLEN];
-
-    struct tcp_metrics_s *metrics  = (struct tcp_metrics_s *)data;
-
-    link = &(metrics->link);
-    ip_str(link->family, (unsigned char *)&(link->c_ip), src_ip_str, INET6_ADDRSTRLEN);
-    ip_str(link->family, (unsigned char *)&(link->s_ip), dst_ip_str, INET6_ADDRSTRLEN);
-
-    (void)fprintf(stdout,
-        "|%s|%u|%u|%s|%s|%u|%u|%u"
-        "|%u|%u|%u|%u|%u|%u|%llu|%u|%u|%u|%u|%u|\n",
-        TCP_TBL_RATE,
-        link->tgid,
-        link->role,
-        src_ip_str,
-        dst_ip_str,
-        link->c_port,
-        link->s_port,
-        link->family,
-
-        metrics->rate_stats.tcpi_rto,
-        metrics->rate_stats.tcpi_ato,
-        metrics->rate_stats.tcpi_snd_ssthresh,
-        metrics->rate_stats.tcpi_rcv_ssthresh,
-        metrics->rate_stats.tcpi_advmss,
-        metrics->rate_stats.tcpi_rcv_space,
-        metrics->rate_stats.tcpi_delivery_rate,
-        metrics->rate_stats.tcpi_busy_time,
-        metrics->rate_stats.tcpi_rwnd_limited,
-        metrics->rate_stats.tcpi_sndbuf_limited,
-        metrics->rate_stats.tcpi_pacing_rate,
-        metrics->rate_stats.tcpi_max_pacing_rate);
-    (void)fflush(stdout);
+    bytes->rx = 0;
+    bytes->tx = 0;
+    for (int i = 0; i < g_cpus; i++) {
+        bytes->rx += values[i].rx;
+        bytes->tx += values[i].tx;
+    }
 }
 
-static void output_tcp_sockbuf(void *ctx, int cpu, void *data, __u32 size)
+static int pull_tcp_bytes(const void *key, const void *value, void *ctx)
 {
-    struct tcp_link_s *link;
-    unsigned char src_ip_str[INET6_ADDRSTRLEN];
-    unsigned char dst_ip_str[INET6_ADDRSTRLEN];
-
-    struct tcp_metrics_s *metrics  = (struct tcp_metrics_s *)data;
-
-    link = &(metrics->link);
-    ip_str(link->family, (unsigned char *)&(link->c_ip), src_ip_str, INET6_ADDRSTRLEN);
-    ip_str(link->family, (unsigned char *)&(link->s_ip), dst_ip_str, INET6_ADDRSTRLEN);
+    struct tcp_link_hist_s *hist = get_tcp_link_hist(*(const u64 *)key);
 
-    (void)fprintf(stdout,
-        "|%s|%u|%u|%s|%s|%u|%u|%u"
-        "|%u|%u|%u|%u|%u|%u|%u|%d|%d|\n",
-        TCP_TBL_SOCKBUF,
-        link->tgid,
-        link->role,
-        src_ip_str,
-        dst_ip_str,
-        link->c_port,
-        link->s_port,
-        link->family,
-
-        metrics->sockbuf_stats.tcpi_sk_err_que_size,
-        metrics->sockbuf_stats.tcpi_sk_rcv_que_size,
-        metrics->sockbuf_stats.tcpi_sk_wri_que_size,
-        metrics->sockbuf_stats.tcpi_sk_backlog_size,
-        metrics->sockbuf_stats.tcpi_sk_omem_size,
-        metrics->sockbuf_stats.tcpi_sk_forward_size,
-        metrics->sockbuf_stats.tcpi_sk_wmem_size,
-        metrics->sockbuf_stats.sk_rcvbuf,
-        metrics->sockbuf_stats.sk_sndbuf);
-    (void)fflush(stdout);
+    // The hist of an evicted link is kept with its bytes, deltas go on when the link is re-created.
+    if (hist != NULL) {
+        sum_tcp_bytes((const struct tcp_bytes_s *)value, &(hist->bytes));
+        hist->gen = g_harvest_gen;
+    }
+    return MAP_BATCH_KEEP;
 }
 
-// 由于目前各个子探针数据周期性上报，如果连接down以后会导致部分数据不上报
-// 因而在tcp_link中会捕捉TCP down并上报数据，同时在用户态检查其他flag，有数据则一起上报
-static void output_tcp_metrics(void *ctx, int cpu, void *data, u32 size)
+static int pull_tcp_link(const void *key, const void *value, void *ctx)
 {
-    struct tcp_metrics_s *metrics  = (struct tcp_metrics_s *)data;
-
-    char is_load_txrx, is_load_abn, is_load_win, is_load_rate, is_load_rtt, is_load_sockbuf;
-    short is_load_rtt2;
+    struct sock_stats_s *sock_stats = (struct sock_stats_s *)value;
+    struct tcp_link_hist_s *hist = get_tcp_link_hist(*(const u64 *)key);
 
-    is_load_txrx = (char)is_load_probe(g_args, TCP_PROBE_TXRX);
-    is_load_abn = (char)is_load_probe(g_args, TCP_PROBE_ABN);
-    is_load_rate = (char)is_load_probe(g_args, TCP_PROBE_RATE);
-    is_load_win = (char)is_load_probe(g_args, TCP_PROBE_WINDOWS);
-    is_load_rtt = (char)is_load_probe(g_args, TCP_PROBE_RTT);
-    is_load_sockbuf = (char)is_load_probe(g_args, TCP_PROBE_SOCKBUF);
-
-    is_load_rtt2 = (is_load_rtt == 0) ? (short)is_load_probe(g_args, TCP_PROBE_RTT2) : 0;
-
-    u32 flags = metrics->report_flags & TCP_PROBE_ALL;
-
-    if ((flags & TCP_PROBE_ABN) && is_load_abn) {
-        output_tcp_abn(ctx, cpu, data, size);
+    if (hist == NULL) {
+        return MAP_BATCH_KEEP;
     }
+    hist->gen = g_harvest_gen;
 
-    if ((flags & TCP_PROBE_WINDOWS) && is_load_win) {
-        output_tcp_win(ctx, cpu, data, size);
+    sock_stats->metrics.tx_rx_stats.rx = hist->bytes.rx;
+    sock_stats->metrics.tx_rx_stats.tx = hist->bytes.tx;
+    if (!is_tcp_link_updated(sock_stats, hist)) {
+        return MAP_BATCH_KEEP;
     }
 
+    output_tcp_link(&(sock_stats->metrics), &(hist->tx_rx_stats));
+    hist->ts_stats = sock_stats->ts_stats;
+    hist->tx_rx_stats = sock_stats->metrics.tx_rx_stats;
+    return MAP_BATCH_KEEP;
+}
 
-    if ((flags & TCP_PROBE_RTT) && is_load_rtt) {
-        output_tcp_rtt(ctx, cpu, data, size);
-    }
-
+static void check_tcp_evict(void)
+{
+    u32 key = 0;
+    u64 evicted = 0;
+    u64 *values;
 
-    if ((flags & TCP_PROBE_TXRX) && is_load_txrx) {
-        output_tcp_txrx(ctx, cpu, data, size);
+    if (g_evict_fd < 0 || g_cpus <= 0) {
+        return;
     }
-
-
-    if ((flags & TCP_PROBE_SOCKBUF) && is_load_sockbuf) {
-        output_tcp_sockbuf(ctx, cpu, data, size);
+    values = (u64 *)calloc(g_cpus, sizeof(u64));
+    if (values == NULL) {
+        return;
     }
-
-
-    if ((flags & TCP_PROBE_RATE) && is_load_rate) {
-        output_tcp_rate(ctx, cpu, data, size);
+    if (bpf_map_lookup_elem(g_evict_fd, &key, values) == 0) {
+        for (int i = 0; i < g_cpus; i++) {
+            evicted += values[i];
+        }
     }
+    free(values);
 
-    if ((flags & TCP_PROBE_RTT2) && is_load_rtt2) {
-        output_tcp_rtt2(ctx, cpu, data, size);
+    if (evicted > g_evicted) {
+        WARN("[TCPPROBE] %llu live links were evicted from tcp_link_map since last harvest, "
+            "they are re-created on next send/recv.\n", evicted - g_evicted);
+        g_evicted = evicted;
     }
-
 }
 
-static unsigned int is_load_probe(struct probe_params *args, u32 probe)
+/*
+ * 周期性地批量读取tcp_link_map，每条连接输出一行tcp_link记录；不再出现在tcp_link_map和tcp_bytes_map中的连接
+ * （已关闭或被LRU淘汰）从历史表中删除；LRU淘汰的活跃连接在下次收发时重建，并告警淘汰次数。
+ */
+void tcp_harvest_links(void *ctx)
 {
-    return args->load_probe & probe;
-}
-
-static void load_args(int args_fd, struct probe_params* params)
-{
-    u32 key = 0;
-    struct tcp_args_s args = {0};
+    struct tcp_link_hist_s *hist, *tmp;
 
-    args.cport_flag = (u32)params->cport_flag;
-    args.period = NS(params->period);
-    args.filter_by_task = (u32)params->filter_task_probe;
-    args.filter_by_tgid = (u32)params->filter_pid;
+    if (g_link_batch == NULL) {
+        return;
+    }
 
-    (void)bpf_map_update_elem(args_fd, &key, &args, BPF_ANY);
-}
+    g_harvest_gen++;
+    if (g_bytes_batch != NULL) {
+        (void)map_batch_walk(g_bytes_batch, pull_tcp_bytes, NULL);
+    }
+    (void)map_batch_walk(g_link_batch, pull_tcp_link, NULL);
+    (void)fflush(stdout);
+    check_tcp_evict();
 
-static int tcp_load_probe_sockbuf(struct bpf_prog_s *prog, char is_load)
-{
-    int fd;
-    struct perf_buffer *pb = NULL;
-
-    __LOAD_PROBE(tcp_sockbuf, err, is_load);
-    if (is_load) {
-        prog->skels[prog->num].skel = tcp_sockbuf_skel;
-        prog->skels[prog->num].fn = (skel_destroy_fn)tcp_sockbuf_bpf__destroy;
-
-        fd = GET_MAP_FD(tcp_sockbuf, tcp_output);
-        pb = create_pref_buffer(fd, output_tcp_sockbuf);
-        if (pb == NULL) {
-            ERROR("[TCPPROBE] Crate 'tcp_sockbuf' perf buffer failed.\n");
-            goto err;
+    H_ITER(g_link_hist, hist, tmp) {
+        if (hist->gen != g_harvest_gen) {
+            H_DEL(g_link_hist, hist);
+            free(hist);
         }
-        prog->pbs[prog->num] = pb;
-        prog->num++;
     }
-
-    return 0;
-err:
-    UNLOAD(tcp_sockbuf);
-    return -1;
 }
 
-static int tcp_load_probe_rtt(struct bpf_prog_s *prog, char is_load)
+void tcp_free_links(void)
 {
-    int fd;
-    struct perf_buffer *pb = NULL;
-
-    __LOAD_PROBE(tcp_rtt, err, is_load);
-    if (is_load) {
-        prog->skels[prog->num].skel = tcp_rtt_skel;
-        prog->skels[prog->num].fn = (skel_destroy_fn)tcp_rtt_bpf__destroy;
-
-        fd = GET_MAP_FD(tcp_rtt, tcp_output);
-        pb = create_pref_buffer(fd, output_tcp_rtt);
-        if (pb == NULL) {
-            ERROR("[TCPPROBE] Crate 'tcp_rtt' perf buffer failed.\n");
-            goto err;
-        }
-        prog->pbs[prog->num] = pb;
-        prog->num++;
-    }
+    struct tcp_link_hist_s *hist, *tmp;
 
-    return 0;
-err:
-    UNLOAD(tcp_rtt);
-    return -1;
+    H_ITER(g_link_hist, hist, tmp) {
+        H_DEL(g_link_hist, hist);
+        free(hist);
+    }
+    map_batch_free(&g_link_batch);
+    map_batch_free(&g_bytes_batch);
+    if (g_bytes_values != NULL) {
+        free(g_bytes_values);
+        g_bytes_values = NULL;
+    }
 }
 
-static int tcp_load_probe_rtt2(struct bpf_prog_s *prog, short is_load)
+// Output the final metrics of a closed link, it is deleted from tcp_link_map before next harvest.
+static void output_tcp_link_close(struct tcp_metrics_s *metrics)
 {
-    int fd;
-    struct perf_buffer *pb = NULL;
-
-    __LOAD_PROBE(tcp_rtt2, err, is_load);
-    if (is_load) {
-        prog->skels[prog->num].skel = tcp_rtt2_skel;
-        prog->skels[prog->num].fn = (skel_destroy_fn)tcp_rtt2_bpf__destroy;
-
-        fd = GET_MAP_FD(tcp_rtt2, tcp_output);
-        pb = create_pref_buffer(fd, output_tcp_rtt2);
-        if (pb == NULL) {
-            ERROR("[TCPPROBE] Crate 'tcp_rtt2' perf buffer failed.\n");
-            goto err;
-        }
-        prog->pbs[prog->num] = pb;
-        prog->num++;
+    struct tcp_tx_rx last_tx_rx = {0};
+    struct tcp_bytes_s bytes;
+    struct tcp_link_hist_s *hist = NULL;
+    u64 sk = metrics->sk;
+
+    // tcp_link deletes the link only, the bytes are deleted after they are read.
+    if (g_bytes_values != NULL && bpf_map_lookup_elem(g_bytes_fd, &sk, g_bytes_values) == 0) {
+        sum_tcp_bytes(g_bytes_values, &bytes);
+        metrics->tx_rx_stats.rx = bytes.rx;
+        metrics->tx_rx_stats.tx = bytes.tx;
+        (void)bpf_map_delete_elem(g_bytes_fd, &sk);
     }
 
-    return 0;
-err:
-    UNLOAD(tcp_rtt2);
-    return -1;
+    H_FIND(g_link_hist, &sk, sizeof(u64), hist);
+    if (hist != NULL) {
+        last_tx_rx = hist->tx_rx_stats;
+        H_DEL(g_link_hist, hist);
+        free(hist);
+    }
+    output_tcp_link(metrics, &last_tx_rx);
+    (void)fflush(stdout);
 }
 
-static int tcp_load_probe_win(struct bpf_prog_s *prog, char is_load)
+// 所有子探针共用一个输出通道，只有异常事件与连接down会上报；连接down时tcp_link会置上各子探针flag一起上报
+static void output_tcp_metrics(void *ctx, int cpu, void *data, u32 size)
 {
-    int fd;
-    struct perf_buffer *pb = NULL;
-
-    __LOAD_PROBE(tcp_windows, err, is_load);
-    if (is_load) {
-        prog->skels[prog->num].skel = tcp_windows_skel;
-        prog->skels[prog->num].fn = (skel_destroy_fn)tcp_windows_bpf__destroy;
-
-        fd = GET_MAP_FD(tcp_windows, tcp_output);
-        pb = create_pref_buffer(fd, output_tcp_win);
-        if (pb == NULL) {
-            ERROR("[TCPPROBE] Crate 'tcp_windows' perf buffer failed.\n");
-            goto err;
-        }
-        prog->pbs[prog->num] = pb;
-        prog->num++;
+    struct tcp_metrics_s *metrics  = (struct tcp_metrics_s *)data;
+    u32 flags = metrics->report_flags & TCP_PROBE_ALL;
+
+    if ((flags & TCP_PROBE_ABN) && (g_load_probe & TCP_PROBE_ABN)) {
+        output_tcp_abn(ctx, cpu, data, size);
     }
 
-    return 0;
-err:
-    UNLOAD(tcp_windows);
-    return -1;
+    if ((flags & TCP_HARVEST_PROBES) && (g_load_probe & TCP_HARVEST_PROBES)) {
+        output_tcp_link_close(metrics);
+    }
+
+    if (flags & TCP_PROBE_SRTT) {
+        output_tcp_syn_rtt(ctx, cpu, data, size);
+    }
 }
 
-static int tcp_load_probe_rate(struct bpf_prog_s *prog, char is_load)
+// tcp_rtt and tcp_rtt2 only one takes effect at same time, default tcp_rtt takes effect
+static u32 get_load_probe(struct probe_params *args)
 {
-    int fd;
-    struct perf_buffer *pb = NULL;
-
-    __LOAD_PROBE(tcp_rate, err, is_load);
-    if (is_load) {
-        prog->skels[prog->num].skel = tcp_rate_skel;
-        prog->skels[prog->num].fn = (skel_destroy_fn)tcp_rate_bpf__destroy;
-
-        fd = GET_MAP_FD(tcp_rate, tcp_output);
-        pb = create_pref_buffer(fd, output_tcp_rate);
-        if (pb == NULL) {
-            ERROR("[TCPPROBE] Crate 'tcp_rate' perf buffer failed.\n");
-            goto err;
-        }
-        prog->pbs[prog->num] = pb;
-        prog->num++;
-    }
+    u32 load_probe = args->load_probe & TCP_PROBE_ALL;
 
-    return 0;
-err:
-    UNLOAD(tcp_rate);
-    return -1;
+    if (load_probe & TCP_PROBE_RTT) {
+        load_probe &= ~TCP_PROBE_RTT2;
+    }
+    return load_probe;
 }
 
-static int tcp_load_probe_abn(struct bpf_prog_s *prog, char is_load)
+static void load_args(int args_fd, struct probe_params* params)
 {
-    int fd;
-    struct perf_buffer *pb = NULL;
-
-    __LOAD_PROBE(tcp_abn, err, is_load);
-    if (is_load) {
-        prog->skels[prog->num].skel = tcp_abn_skel;
-        prog->skels[prog->num].fn = (skel_destroy_fn)tcp_abn_bpf__destroy;
-
-        fd = GET_MAP_FD(tcp_abn, tcp_output);
-        pb = create_pref_buffer(fd, output_tcp_abn);
-        if (pb == NULL) {
-            ERROR("[TCPPROBE] Crate 'tcp_abn' perf buffer failed.\n");
-            goto err;
-        }
-        prog->pbs[prog->num] = pb;
-        prog->num++;
-    }
+    u32 key = 0;
+    struct tcp_args_s args = {0};
 
-    return 0;
-err:
-    UNLOAD(tcp_abn);
-    return -1;
+    args.cport_flag = (u32)params->cport_flag;
+    args.period = NS(params->period);
+    args.filter_by_task = (u32)params->filter_task_probe;
+    args.filter_by_tgid = (u32)params->filter_pid;
+    args.load_probe = get_load_probe(params);
+
+    (void)bpf_map_update_elem(args_fd, &key, &args, BPF_ANY);
 }
 
-static int tcp_load_probe_txrx(struct bpf_prog_s *prog, char is_load)
+#if (CURRENT_LIBBPF_VERSION >= LIBBPF_VERSION(0, 8))
+struct tcp_hook_s {
+    const char *func;       // kernel function or tracepoint
+    u32 probes;             // sub probes using it
+};
+
+static struct tcp_hook_s tcp_hooks[] = {
+    {"tcp_probe",               TCP_RCV_PROBES},
+    {"tcp_rcv_established",     TCP_RCV_PROBES},
+    {"tcp_rcv_space_adjust",    TCP_RCV_SPACE_PROBES},
+    {"tcp_cleanup_rbuf",        TCP_PROBE_TXRX},
+    {"tcp_add_backlog",         TCP_PROBE_ABN},
+    {"tcp_filter",              TCP_PROBE_ABN},
+    {"tcp_write_err",           TCP_PROBE_ABN},
+    {"sock_exceed_buf_limit",   TCP_PROBE_ABN},
+    {"tcp_send_reset",          TCP_PROBE_ABN},
+    {"tcp_receive_reset",       TCP_PROBE_ABN},
+    {"tcp_v4_send_reset",       TCP_PROBE_ABN},
+    {"tcp_v6_send_reset",       TCP_PROBE_ABN},
+    {"tcp_send_active_reset",   TCP_PROBE_ABN},
+    {"tcp_reset",               TCP_PROBE_ABN},
+    {"tcp_retransmit_skb",      TCP_PROBE_ABN},
+    {"tcp_try_rmem_schedule",   TCP_PROBE_ABN},
+    {"tcp_check_oom",           TCP_PROBE_ABN}
+};
+
+/*
+ * All sub probes are in one bpf object, programs hooked only for the sub probes not enabled are not
+ * loaded. Otherwise(old libbpf) they are attached and return at once by the sub probes mask in args_map.
+ */
+static void tcp_unload_hooks(struct bpf_object *obj, u32 load_probe)
 {
-    int fd;
-    struct perf_buffer *pb = NULL;
-
-    __LOAD_PROBE(tcp_tx_rx, err, is_load);
-    if (is_load) {
-        prog->skels[prog->num].skel = tcp_tx_rx_skel;
-        prog->skels[prog->num].fn = (skel_destroy_fn)tcp_tx_rx_bpf__destroy;
-
-        fd = GET_MAP_FD(tcp_tx_rx, tcp_output);
-        pb = create_pref_buffer(fd, output_tcp_txrx);
-        if (pb == NULL) {
-            ERROR("[TCPPROBE] Crate 'tcp_tx_rx' perf buffer failed.\n");
-            goto err;
+    struct bpf_program *prog;
+    const char *sec, *func;
+
+    bpf_object__for_each_program(prog, obj) {
+        sec = bpf_program__section_name(prog);
+        func = strrchr(sec, '/');
+        func = (func == NULL) ? sec : func + 1;
+
+        for (int i = 0; i < sizeof(tcp_hooks) / sizeof(tcp_hooks[0]); i++) {
+            if (strcmp(func, tcp_hooks[i].func) == 0 && (tcp_hooks[i].probes & load_probe) == 0) {
+                (void)bpf_program__set_autoload(prog, false);
+                break;
+            }
         }
-        prog->pbs[prog->num] = pb;
-        prog->num++;
     }
-
-    return 0;
-err:
-    UNLOAD(tcp_tx_rx);
-    return -1;
 }
+#endif
 
 static int tcp_load_probe_link(struct probe_params *args, struct bpf_prog_s *prog)
 {
     int fd;
-    struct perf_buffer *pb = NULL;
-
-    __LOAD_PROBE(tcp_link, err, 1);
+    struct bpf_buffer_s *buffer = NULL;
+
+    OPEN(tcp_link, err, 1);
+    MAP_SET_PIN_PATH(tcp_link, args_map, TCP_LINK_ARGS_PATH, 1);
+    MAP_SET_PIN_PATH(tcp_link, tcp_link_map, TCP_LINK_TCP_PATH, 1);
+    MAP_SET_PIN_PATH(tcp_link, sock_map, TCP_LINK_SOCKS_PATH, 1);
+#if (CURRENT_LIBBPF_VERSION >= LIBBPF_VERSION(0, 8))
+    tcp_unload_hooks(tcp_link_skel->obj, g_load_probe);
+#endif
+    LOAD_ATTACH(tcp_link, err, 1);
     prog->skels[prog->num].skel = tcp_link_skel;
     prog->skels[prog->num].fn = (skel_destroy_fn)tcp_link_bpf__destroy;
 
     fd = GET_MAP_FD(tcp_link, tcp_output);
-    pb = create_pref_buffer(fd, output_tcp_syn_rtt);
-    if (pb == NULL) {
-        ERROR("[TCPPROBE] Crate 'tcp_link' perf buffer failed.\n");
+    buffer = create_bpf_buffer(fd, output_tcp_metrics);
+    if (buffer == NULL) {
+        ERROR("[TCPPROBE] Crate 'tcp_link' output buffer failed.\n");
         goto err;
     }
-    prog->pbs[prog->num] = pb;
+    prog->buffers[prog->num] = buffer;
     prog->num++;
 
+    g_link_batch = map_batch_new(GET_MAP_FD(tcp_link, tcp_link_map), sizeof(u64), sizeof(struct sock_stats_s));
+    if (g_link_batch == NULL) {
+        ERROR("[TCPPROBE] Create 'tcp_link' harvest batch failed.\n");
+        return -1;
+    }
+
+    g_cpus = libbpf_num_possible_cpus();
+    g_evict_fd = GET_MAP_FD(tcp_link, tcp_evict_map);
+    if (g_load_probe & TCP_PROBE_TXRX) {
+        g_bytes_fd = GET_MAP_FD(tcp_link, tcp_bytes_map);
+        if (g_cpus > 0) {
+            g_bytes_values = (struct tcp_bytes_s *)calloc(g_cpus, sizeof(struct tcp_bytes_s));
+            g_bytes_batch = map_batch_new(g_bytes_fd, sizeof(u64), sizeof(struct tcp_bytes_s) * g_cpus);
+        }
+        if (g_bytes_values == NULL || g_bytes_batch == NULL) {
+            ERROR("[TCPPROBE] Create 'tcp_bytes' harvest batch failed.\n");
+            return -1;
+        }
+    }
+
     load_args(GET_MAP_FD(tcp_link, args_map), args);
 
     return 0;
@@ -629,19 +564,9 @@ err:
 struct bpf_prog_s* tcp_load_probe(struct probe_params *args)
 {
     struct bpf_prog_s *prog;
-    char is_load_txrx, is_load_abn, is_load_win, is_load_rate, is_load_rtt, is_load_sockbuf;
-    short is_load_rtt2;
-
-    is_load_txrx = (char)is_load_probe(args, TCP_PROBE_TXRX);
-    is_load_abn = (char)is_load_probe(args, TCP_PROBE_ABN);
-    is_load_rate = (char)is_load_probe(args, TCP_PROBE_RATE);
-    is_load_win = (char)is_load_probe(args, TCP_PROBE_WINDOWS);
-    is_load_rtt = (char)is_load_probe(args, TCP_PROBE_RTT);
-    is_load_sockbuf = (char)is_load_probe(args, TCP_PROBE_SOCKBUF);
-    // tcp_rtt and tcp_rtt2 only one takes effect at same time, default tcp_rtt takes effect
-    is_load_rtt2 = (is_load_rtt == 0) ? (short)is_load_probe(args, TCP_PROBE_RTT2) : 0;
 
     g_args = args;
+    g_load_probe = get_load_probe(args);
 
     prog = alloc_bpf_prog();
     if (prog == NULL) {
@@ -652,34 +577,6 @@ struct bpf_prog_s* tcp_load_probe(struct probe_params *args)
         goto err;
     }
 
-    if (tcp_load_probe_txrx(prog, is_load_txrx)) {
-        goto err;
-    }
-
-    if (tcp_load_probe_abn(prog, is_load_abn)) {
-        goto err;
-    }
-
-    if (tcp_load_probe_rate(prog, is_load_rate)) {
-        goto err;
-    }
-
-    if (tcp_load_probe_win(prog, is_load_win)) {
-        goto err;
-    }
-
-    if (tcp_load_probe_rtt(prog, is_load_rtt)) {
-        goto err;
-    }
-
-    if (tcp_load_probe_sockbuf(prog, is_load_sockbuf)) {
-        goto err;
-    }
-
-    if (tcp_load_probe_rtt2(prog, is_load_rtt2)) {
-        goto err;
-    }
-
     return prog;
 
 err:
@@ -687,4 +584,3 @@ err:
     unload_bpf_prog(&prog);
     return NULL;
 }
-
@@ -8,43 +8,16 @@
  * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
  * PURPOSE.
  * See the Mulan PSL v2 for more details.
- * Author: luzhihao
- * Create: 2022-07-28
+ * Author: agent
+ * Create: 2026-10-18
  * Description: tcp rate probe
  ******************************************************************************/
-#ifdef BPF_PROG_USER
-#undef BPF_PROG_USER
-#endif
-#define BPF_PROG_KERN
-#include <bpf/bpf_endian.h>
-#include "bpf.h"
-#include "tcp_link.h"
-
-char g_linsence[] SEC("license") = "GPL";
-
-static __always_inline char is_tmout_rate(struct sock *sk)
-{
-    struct sock_stats_s *sock_stats = bpf_map_lookup_elem(&tcp_link_map, &sk);
-    if (!sock_stats) {
-        return 0;
-    }
+#ifndef __TCP_RATE_H__
+#define __TCP_RATE_H__
 
-    u64 ts = bpf_ktime_get_ns();
-    u64 period = get_period();
-    if ((ts > sock_stats->ts_stats.rate_ts) && ((ts - sock_stats->ts_stats.rate_ts) >= period)) {
-        sock_stats->ts_stats.rate_ts = ts;
-        return 1;
-    }
-    return 0;
-}
+#pragma once
 
-static __always_inline void report_rate(void *ctx, struct tcp_metrics_s *metrics)
-{
-    metrics->report_flags |= TCP_PROBE_RATE;
-    (void)bpf_perf_event_output(ctx, &tcp_output, BPF_F_CURRENT_CPU, metrics, sizeof(struct tcp_metrics_s));
-    metrics->report_flags &= ~TCP_PROBE_RATE;
-    //__builtin_memset(&(metrics->rate_stats), 0x0, sizeof(metrics->rate_stats));
-}
+#include "tcp_link.h"
 
 static void tcp_compute_busy_time(struct tcp_sock *tcp_sk, struct tcp_rate* rate_stats)
 {
@@ -131,42 +104,16 @@ static void get_tcp_rate(struct sock *sk, struct tcp_rate* stats)
     }
 }
 
-static void tcp_rate_probe_func(void *ctx, struct sock *sk)
+static void tcp_rate_probe_func(struct sock *sk, struct tcp_hook_s *hook)
 {
-    struct tcp_metrics_s *metrics;
+    struct sock_stats_s *sock_stats = hook->sock_stats;
 
     // Avoid high performance costs
-    if (!is_tmout_rate(sk)) {
+    if (!is_tcp_tmout(&(sock_stats->ts_stats.rate_ts), hook->ts, hook->period)) {
         return;
     }
 
-    metrics = get_tcp_metrics(sk);
-    if (metrics) {
-        get_tcp_rate(sk, &(metrics->rate_stats));
-        report_rate(ctx, metrics);
-    }
-}
-#if (CURRENT_KERNEL_VERSION > KERNEL_VERSION(4, 18, 0))
-KRAWTRACE(tcp_rcv_space_adjust, bpf_raw_tracepoint_args)
-{
-    struct sock *sk = (struct sock*)ctx->args[0];
-    tcp_rate_probe_func(ctx, sk);
-    return 0;
-}
-#elif (CURRENT_KERNEL_VERSION < KERNEL_VERSION(4, 13, 0))
-KPROBE(tcp_rcv_space_adjust, pt_regs)
-{
-    struct sock *sk = (struct sock *)PT_REGS_PARM1(ctx);
-    tcp_rate_probe_func(ctx, sk);
-    return 0;
-}
-#else
-SEC("tracepoint/tcp/tcp_rcv_space_adjust")
-int bpf_trace_tcp_rcv_space_adjust_func(struct trace_event_raw_tcp_event_sk_skb *ctx)
-{
-    struct sock *sk = (struct sock*)ctx->skaddr;
-    tcp_rate_probe_func(ctx, sk);
-    return 0;
+    get_tcp_rate(sk, &(sock_stats->metrics.rate_stats));
 }
-#endif
 
+#endif
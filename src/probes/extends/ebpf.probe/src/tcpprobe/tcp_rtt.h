@@ -0,0 +1,64 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: tcp rtt probe
+ ******************************************************************************/
+#ifndef __TCP_RTT_H__
+#define __TCP_RTT_H__
+
+#pragma once
+
+#include "tcp_link.h"
+
+static void get_tcp_rtt(struct sock *sk, struct tcp_rtt* stats)
+{
+    u32 tmp;
+    struct tcp_sock *tcp_sk = (struct tcp_sock *)sk;
+
+    tmp = _(tcp_sk->srtt_us) >> 3;  // microseconds to milliseconds
+    stats->tcpi_srtt = tmp;
+
+    tmp = _(tcp_sk->rcv_rtt_est.rtt_us);
+    tmp = tmp >> 3; // microseconds to milliseconds
+    stats->tcpi_rcv_rtt = tmp;
+    return;
+}
+
+static void tcp_rtt_probe_func(struct sock *sk, struct tcp_hook_s *hook)
+{
+    struct sock_stats_s *sock_stats = hook->sock_stats;
+
+    // Avoid high performance costs
+    if (!is_tcp_tmout(&(sock_stats->ts_stats.rtt_ts), hook->ts, hook->period)) {
+        return;
+    }
+
+    get_tcp_rtt(sk, &(sock_stats->metrics.rtt_stats));
+}
+
+// tcp_rtt2 samples every segment for the max rtt, the max restarts from the current rtt every period.
+static void tcp_rtt2_probe_func(struct sock *sk, struct tcp_hook_s *hook)
+{
+    struct sock_stats_s *sock_stats = hook->sock_stats;
+    struct tcp_rtt *stats = &(sock_stats->metrics.rtt_stats);
+
+    get_tcp_rtt(sk, stats);
+    if (is_tcp_tmout(&(sock_stats->ts_stats.rtt_ts), hook->ts, hook->period)) {
+        stats->tcpi_srtt_max = stats->tcpi_srtt;
+        stats->tcpi_rcv_rtt_max = stats->tcpi_rcv_rtt;
+        return;
+    }
+    CALC_MAX_VAL(stats->tcpi_srtt, stats->tcpi_srtt_max);
+    CALC_MAX_VAL(stats->tcpi_rcv_rtt, stats->tcpi_rcv_rtt_max);
+}
+
+#endif
@@ -0,0 +1,54 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: tcp sockbuf probe
+ ******************************************************************************/
+#ifndef __TCP_SOCKBUF_H__
+#define __TCP_SOCKBUF_H__
+
+#pragma once
+
+#include "tcp_link.h"
+
+static void get_tcp_sock_buf(struct sock *sk, struct tcp_sockbuf* stats)
+{
+    stats->tcpi_sk_err_que_size = _(sk->sk_error_queue.qlen);
+    stats->tcpi_sk_rcv_que_size = _(sk->sk_receive_queue.qlen);
+    stats->tcpi_sk_wri_que_size = _(sk->sk_write_queue.qlen);
+    stats->tcpi_sk_backlog_size = (u32)_(sk->sk_backlog.len);
+    stats->tcpi_sk_omem_size    = (u32)_(sk->sk_omem_alloc.counter);
+    stats->tcpi_sk_forward_size = (u32)_(sk->sk_forward_alloc);
+#if (CURRENT_KERNEL_VERSION < KERNEL_VERSION(4, 14, 0))
+    /* 4.13-rc1 convert sock.sk_wmem_alloc from atomic_t to refcount_t*/
+    stats->tcpi_sk_wmem_size    = (u32)_(sk->sk_wmem_alloc.counter);
+#else
+    stats->tcpi_sk_wmem_size    = (u32)_(sk->sk_wmem_alloc.refs.counter);
+#endif
+
+    stats->sk_rcvbuf    = (int)_(sk->sk_rcvbuf);
+    stats->sk_sndbuf    = (int)_(sk->sk_sndbuf);
+
+}
+
+static void tcp_sockbuf_probe_func(struct sock *sk, struct tcp_hook_s *hook)
+{
+    struct sock_stats_s *sock_stats = hook->sock_stats;
+
+    // Avoid high performance costs
+    if (!is_tcp_tmout(&(sock_stats->ts_stats.sockbuf_ts), hook->ts, hook->period)) {
+        return;
+    }
+
+    get_tcp_sock_buf(sk, &(sock_stats->metrics.sockbuf_stats));
+}
+
+#endif
@@ -0,0 +1,68 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: tcp tx/rx statistics probe
+ ******************************************************************************/
+#ifndef __TCP_TX_RX_H__
+#define __TCP_TX_RX_H__
+
+#pragma once
+
+#include "tcp_link.h"
+
+// Bytes of the links on every CPU, user space sums them up into tcp_tx_rx when harvesting tcp_link_map.
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_PERCPU_HASH);
+    __uint(key_size, sizeof(struct sock *));
+    __uint(value_size, sizeof(struct tcp_bytes_s));
+    __uint(max_entries, __TCP_LINK_MAX);
+} tcp_bytes_map SEC(".maps");
+
+// The sock may be reused by a new link before user space deletes the bytes of the old one.
+static __always_inline void init_tcp_bytes(struct sock *sk)
+{
+    struct tcp_bytes_s bytes = {0};
+
+    (void)bpf_map_delete_elem(&tcp_bytes_map, &sk);
+    (void)bpf_map_update_elem(&tcp_bytes_map, &sk, &bytes, BPF_NOEXIST);
+}
+
+static void get_tcp_tx_rx_segs(struct sock *sk, struct tcp_tx_rx* stats)
+{
+    struct tcp_sock *tcp_sk = (struct tcp_sock *)sk;
+
+    stats->segs_in = _(tcp_sk->segs_in);
+
+    stats->segs_out = _(tcp_sk->segs_out);
+}
+
+// tx/rx are totals of the link on this CPU, user space outputs the deltas every period.
+static __always_inline void tcp_tx_probe_func(struct sock *sk, size_t size)
+{
+    struct tcp_bytes_s *bytes = (struct tcp_bytes_s *)bpf_map_lookup_elem(&tcp_bytes_map, &sk);
+
+    if (bytes) {
+        bytes->tx += size;
+    }
+}
+
+static __always_inline void tcp_rx_probe_func(struct sock *sk, struct tcp_hook_s *hook, int copied)
+{
+    struct tcp_bytes_s *bytes = (struct tcp_bytes_s *)bpf_map_lookup_elem(&tcp_bytes_map, &sk);
+
+    get_tcp_tx_rx_segs(sk, &(hook->sock_stats->metrics.tx_rx_stats));
+    if (bytes) {
+        bytes->rx += (u64)copied;
+    }
+}
+
+#endif
@@ -0,0 +1,61 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: tcp windows probe
+ ******************************************************************************/
+#ifndef __TCP_WINDOWS_H__
+#define __TCP_WINDOWS_H__
+
+#pragma once
+
+#include "tcp_link.h"
+
+static void get_tcp_wnd(struct sock *sk, struct tcp_windows* stats)
+{
+    struct tcp_sock *tcp_sk = (struct tcp_sock *)sk;
+
+    u32 write_seq = _(tcp_sk->write_seq);
+    u32 snd_nxt = _(tcp_sk->snd_nxt);
+    u32 snd_wnd = _(tcp_sk->snd_wnd);
+    u32 snd_una = _(tcp_sk->snd_una);
+    u32 rcv_wnd = _(tcp_sk->rcv_wnd);
+
+    if (write_seq > snd_nxt) {
+        stats->tcpi_notsent_bytes = write_seq - snd_nxt;
+    }
+
+    if (snd_nxt > snd_una) {
+        stats->tcpi_notack_bytes = snd_nxt - snd_una;
+    }
+
+    stats->tcpi_snd_wnd = snd_wnd;
+    stats->tcpi_avl_snd_wnd = snd_una + snd_wnd - snd_nxt;
+    stats->tcpi_rcv_wnd = rcv_wnd;
+    stats->tcpi_reordering = _(tcp_sk->reordering);
+    stats->tcpi_snd_cwnd = _(tcp_sk->snd_cwnd);
+
+    return;
+}
+
+static void tcp_wnd_probe_func(struct sock *sk, struct tcp_hook_s *hook)
+{
+    struct sock_stats_s *sock_stats = hook->sock_stats;
+
+    // Avoid high performance costs
+    if (!is_tcp_tmout(&(sock_stats->ts_stats.win_ts), hook->ts, hook->period)) {
+        return;
+    }
+
+    get_tcp_wnd(sk, &(sock_stats->metrics.win_stats));
+}
+
+#endif
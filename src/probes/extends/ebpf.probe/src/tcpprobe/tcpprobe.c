@@ -34,6 +34,7 @@
 #endif
 
 #include "bpf.h"
+#include "evt_loop.h"
 #include "args.h"
 #include "object.h"
 #include "tcpprobe.h"
@@ -51,12 +52,29 @@ static void sig_int(int signo)
     g_stop = 1;
 }
 
+struct tcp_fd_timer_s {
+    int fd;
+    int start_time_second;
+};
+
+static void load_established_tcps_timer(void *ctx)
+{
+    struct tcp_fd_timer_s *timer = ctx;
+
+    timer->start_time_second++;
+    if (timer->start_time_second > UNLOAD_TCP_FD_PROBE) {
+        tcp_unload_fd_probe();
+    }
+
+    load_established_tcps(&params, timer->fd);
+}
+
 int main(int argc, char **argv)
 {
     int err = -1;
-    int fd;
-    int start_time_second;
+    struct tcp_fd_timer_s fd_timer = {0};
     struct bpf_prog_s *tcp_progs = NULL;
+    struct evt_loop_s *loop = NULL;
     FILE *fp = NULL;
 
     if (signal(SIGINT, sig_int) == SIG_ERR) {
@@ -85,33 +103,33 @@ int main(int argc, char **argv)
         goto err;
     }
 
-    fd = tcp_load_fd_probe();
+    fd_timer.fd = tcp_load_fd_probe();
+
+    loop = evt_loop_new();
+    if (loop == NULL) {
+        goto err;
+    }
+    if (evt_loop_add_prog(loop, tcp_progs, "tcp") ||
+        evt_loop_add_timer(loop, THOUSAND, load_established_tcps_timer, &fd_timer) ||
+        evt_loop_add_timer(loop, params.period * THOUSAND, tcp_harvest_links, NULL)) {
+        goto err;
+    }
+    load_established_tcps(&params, fd_timer.fd);
 
     printf("Successfully started!\n");
 
-    start_time_second = 0;
     while (!g_stop) {
-        start_time_second++;
-        if (start_time_second > UNLOAD_TCP_FD_PROBE) {
-            tcp_unload_fd_probe();
-        }
-
-        load_established_tcps(&params, fd);
-
-        //if (tcp_progs->pb && ((err = perf_buffer__poll(tcp_progs->pb, THOUSAND)) < 0)) {
-        //    ERROR("[TCPPROBE]: perf poll failed.\n");
-        //    break;
-        //}
-        for (int i = 0; i < tcp_progs->num; i++) {
-            if (tcp_progs->pbs[i] && (err = perf_buffer__poll(tcp_progs->pbs[i], THOUSAND) < 0)) {
-                ERROR("[TCPPROBE]: perf poll prog_%d failed.\n", i);
-                break;
-            }
+        if ((err = evt_loop_poll(loop, THOUSAND)) < 0) {
+            ERROR("[TCPPROBE]: perf poll failed.\n");
+            break;
         }
     }
+    err = (err < 0) ? err : 0;
 
 err:
+    evt_loop_free(&loop);
     unload_bpf_prog(&tcp_progs);
+    tcp_free_links();
 
     tcp_unload_fd_probe();
     destroy_established_tcps();
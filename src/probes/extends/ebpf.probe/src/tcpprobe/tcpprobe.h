@@ -39,6 +39,14 @@
                 | TCP_PROBE_RTT | TCP_PROBE_TXRX | TCP_PROBE_SOCKBUF \
                 | TCP_PROBE_RATE | TCP_PROBE_SRTT | TCP_PROBE_RTT2)
 
+// Sub probes sharing a hook point, tcp_rtt and tcp_rtt2 never take effect at the same time
+#define TCP_RCV_PROBES          (TCP_PROBE_ABN | TCP_PROBE_RTT | TCP_PROBE_RTT2 | TCP_PROBE_SOCKBUF)
+#define TCP_RCV_SPACE_PROBES    (TCP_PROBE_RATE | TCP_PROBE_WINDOWS)
+
+// Sub probes harvested from tcp_link_map every period, the others are output by events(abnormal, close)
+#define TCP_HARVEST_PROBES      (TCP_PROBE_TXRX | TCP_PROBE_RTT | TCP_PROBE_RTT2 | TCP_PROBE_WINDOWS \
+                | TCP_PROBE_RATE | TCP_PROBE_SOCKBUF)
+
 #if (CURRENT_KERNEL_VERSION < KERNEL_VERSION(5, 10, 0))
 #define TCP_FD_PER_PROC_MAX (10)
 #else
@@ -84,14 +92,17 @@ struct tcp_abn {
 };
 
 struct tcp_tx_rx {
-    __u64 rx;               // FROM tcp_cleanup_rbuf
-    __u64 tx;               // FROM tcp_sendmsg
-    __u32 last_time_segs_out;
+    __u64 rx;               // FROM tcp_cleanup_rbuf, summed up from tcp_bytes_map by user space
+    __u64 tx;               // FROM tcp_sendmsg, summed up from tcp_bytes_map by user space
     __u32 segs_out;         // total number of segments sent
-    __u32 last_time_segs_in;
     __u32 segs_in;          // total number of segments in
 };
 
+struct tcp_bytes_s {
+    __u64 rx;
+    __u64 tx;
+};
+
 struct tcp_sockbuf {
     __u32   tcpi_sk_err_que_size;   // FROM sock.sk_error_queue.qlen
     __u32   tcpi_sk_rcv_que_size;   // FROM sock.sk_receive_queue.qlen
@@ -154,9 +165,6 @@ struct tcp_rtt {
 #define TCP_RMEM_SCHEDULS_INC(data) __sync_fetch_and_add(&((data).rmem_scheduls), 1)
 #define TCP_OOM_INC(data) __sync_fetch_and_add(&((data).tcp_oom), 1)
 
-#define TCP_RX_XADD(data, delta) __sync_fetch_and_add(&((data).rx), (__u64)(delta))
-#define TCP_TX_XADD(data, delta) __sync_fetch_and_add(&((data).tx), (__u64)(delta))
-
 #define CALC_MAX_VAL(cur_data, max_data) \
 do { \
     max_data = (cur_data > max_data) ? cur_data : max_data; \
@@ -182,6 +190,7 @@ struct tcp_link_s {
 
 struct tcp_metrics_s {
     u32 report_flags;       // Refer to TCP_PROBE_xxx
+    u64 sk;                 // key in tcp_link_map
     struct tcp_link_s link;
 
     struct tcp_tx_rx tx_rx_stats;
@@ -193,18 +202,23 @@ struct tcp_metrics_s {
     struct tcp_sockbuf sockbuf_stats;
 };
 
+enum tcp_link_state_e {
+    TCP_LINK_NONE = 0,
+    TCP_LINK_OK,        // created in tcp_link_map, re-created if it is evicted by LRU while alive
+    TCP_LINK_CLOSED     // final metrics output, never re-created
+};
+
 struct sock_info_s {
     u32 role;           // client:1/server:0
     u32 syn_srtt;       // rtt from SYN/ACK to ACK
     u32 proc_id;        // PID
-    u32 tcp_link_ok;
+    u32 link_state;     // refer to enum tcp_link_state_e
 };
 
 struct tcp_ts {
     u64 abn_ts;
     u64 win_ts;
     u64 rtt_ts;
-    u64 txrx_ts;
     u64 sockbuf_ts;
     u64 rate_ts;
 };
@@ -219,12 +233,15 @@ struct tcp_args_s {
     __u32 cport_flag;           // Indicates whether the probes(such as tcp) identifies the client port
     __u32 filter_by_task;       // Filtering PID monitoring ranges by task probe
     __u32 filter_by_tgid;       // Filtering PID monitoring ranges by specific pid
+    __u32 load_probe;           // Sub probes enabled, refer to TCP_PROBE_xxx
 };
 
 void load_established_tcps(struct probe_params *args, int map_fd);
 void lkup_established_tcp(void);
 void destroy_established_tcps(void);
 struct bpf_prog_s* tcp_load_probe(struct probe_params *args);
+void tcp_harvest_links(void *ctx);
+void tcp_free_links(void);
 int tcp_load_fd_probe(void);
 void tcp_unload_fd_probe(void);
 
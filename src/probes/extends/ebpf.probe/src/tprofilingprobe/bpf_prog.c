@@ -55,7 +55,7 @@ static int load_syscall_create_pb(struct bpf_prog_s *prog, int fd)
     struct perf_buffer *pb;
 
     if (prog->pb == NULL) {
-        pb = create_pref_buffer(fd, perf_event_handler);
+        pb = create_pref_buffer3(fd, perf_event_handler, &prog->pb_lost);
         if (pb == NULL) {
             fprintf(stderr, "ERROR: create perf buffer failed\n");
             return -1;
@@ -119,7 +119,7 @@ static int load_oncpu_create_pb(struct bpf_prog_s *prog, int fd)
     struct perf_buffer *pb;
 
     if (prog->pb == NULL) {
-        pb = create_pref_buffer(fd, perf_event_handler);
+        pb = create_pref_buffer3(fd, perf_event_handler, &prog->pb_lost);
         if (pb == NULL) {
             fprintf(stderr, "ERROR: create perf buffer failed\n");
             return -1;
@@ -31,6 +31,7 @@
 #define STACK_MAP_PATH         "/sys/fs/bpf/gala-gopher/__tprofiling_stack"
 #define SYSCALL_ENTER_MAP_PATH "/sys/fs/bpf/gala-gopher/__tprofiling_syscall_enter"
 #define SYSCALL_STASH_MAP_PATH "/sys/fs/bpf/gala-gopher/__tprofiling_syscall_stash"
+#define SYSCALL_AGGR_MAP_PATH  "/sys/fs/bpf/gala-gopher/__tprofiling_syscall_aggr"
 #define SYSCALL_EVENT_MAP_PATH "/sys/fs/bpf/gala-gopher/__tprofiling_syscall_event"
 
 #define ONCPU_EVENT_MAP_PATH   "/sys/fs/bpf/gala-gopher/__tprofiling_oncpu_event"
@@ -58,6 +59,7 @@
     MAP_SET_PIN_PATH(probe_name, stack_map, STACK_MAP_PATH, load); \
     MAP_SET_PIN_PATH(probe_name, syscall_enter_map, SYSCALL_ENTER_MAP_PATH, load); \
     MAP_SET_PIN_PATH(probe_name, syscall_stash_map, SYSCALL_STASH_MAP_PATH, load); \
+    MAP_SET_PIN_PATH(probe_name, syscall_aggr_map, SYSCALL_AGGR_MAP_PATH, load); \
     LOAD_ATTACH(probe_name, end, load)
 
 #define LOAD_ONCPU_PROBE(probe_name, end, load) \
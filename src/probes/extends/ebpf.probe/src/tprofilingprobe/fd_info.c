@@ -16,12 +16,14 @@
 #include <unistd.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
 #include "common.h"
 #include "fd_info.h"
 
 void HASH_add_fd_info(fd_info_t **fd_table, fd_info_t *fd_info)
 {
-    HASH_ADD_INT(*fd_table, fd, fd_info);
+    HASH_ADD(hh, *fd_table, key, sizeof(fd_key_t), fd_info);
 }
 
 void HASH_del_fd_info(fd_info_t **fd_table, fd_info_t *fd_info)
@@ -29,11 +31,11 @@ void HASH_del_fd_info(fd_info_t **fd_table, fd_info_t *fd_info)
     HASH_DEL(*fd_table, fd_info);
 }
 
-fd_info_t *HASH_find_fd_info(fd_info_t **fd_table, int fd)
+fd_info_t *HASH_find_fd_info(fd_info_t **fd_table, fd_key_t *key)
 {
     fd_info_t *fi;
 
-    HASH_FIND_INT(*fd_table, &fd, fi);
+    HASH_FIND(hh, *fd_table, key, sizeof(fd_key_t), fi);
     return fi;
 }
 
@@ -57,11 +59,11 @@ void HASH_add_fd_info_with_LRU(fd_info_t **fd_table, fd_info_t *fd_info)
     HASH_add_fd_info(fd_table, fd_info);
 }
 
-fd_info_t *HASH_find_fd_info_with_LRU(fd_info_t **fd_table, int fd)
+fd_info_t *HASH_find_fd_info_with_LRU(fd_info_t **fd_table, fd_key_t *key)
 {
     fd_info_t *fi;
 
-    fi = HASH_find_fd_info(fd_table, fd);
+    fi = HASH_find_fd_info(fd_table, key);
     if (fi) {
         HASH_del_fd_info(fd_table, fi);
         HASH_add_fd_info(fd_table, fi);
@@ -70,10 +72,19 @@ fd_info_t *HASH_find_fd_info_with_LRU(fd_info_t **fd_table, int fd)
     return fi;
 }
 
-static int fill_reg_file_info(fd_info_t *fd_info, const char *fd_path)
+// 文件路径仍需从 `/proc/<tgid>/fd/<fd>` 读取，读取后校验 inode，避免 fd 已被复用时缓存错误的路径
+static int fill_reg_file_info(fd_info_t *fd_info, int tgid)
 {
+    char fd_path[MAX_PATH_SIZE];
+    struct stat st;
     int ret;
 
+    ret = snprintf(fd_path, sizeof(fd_path), "/proc/%d/fd/%d", tgid, fd_info->fd);
+    if (ret < 0 || ret >= sizeof(fd_path)) {
+        fprintf(stderr, "ERROR: Failed to get fd path.\n");
+        return -1;
+    }
+
     fd_info->type = FD_TYPE_REG;
     ret = readlink(fd_path, fd_info->reg_info.name, sizeof(fd_info->reg_info.name));
     if (ret < 0 || ret >= sizeof(fd_info->reg_info.name)) {
@@ -82,111 +93,92 @@ static int fill_reg_file_info(fd_info_t *fd_info, const char *fd_path)
     }
     fd_info->reg_info.name[ret] = '\0';
 
-    return 0;
-}
-
-static enum sock_type get_sock_type(char *sock_type_s)
-{
-    if (strcmp(sock_type_s, SOCK_TYPE_IPV4_STR) == 0) {
-        return SOCK_TYPE_IPV4;
-    } else if (strcmp(sock_type_s, SOCK_TYPE_IPV6_STR) == 0) {
-        return SOCK_TYPE_IPV6;
-    }
-
-    return SOCK_TYPE_UNSUPPORTED;
-}
-
-static enum proto_type get_proto_type(char *proto_type_s)
-{
-    if (strcmp(proto_type_s, SOCK_PROTO_TYPE_TCP_STR) == 0) {
-        return SOCK_PROTO_TYPE_TCP;
-    } else if (strcmp(proto_type_s, SOCK_PROTO_TYPE_UDP_STR) == 0) {
-        return SOCK_PROTO_TYPE_UDP;
+    if (stat(fd_path, &st) || st.st_ino != fd_info->key.ino) {
+        return -1;
     }
 
-    return SOCK_PROTO_TYPE_UNSUPPORTED;
+    return 0;
 }
 
-static int fill_sock_info(fd_info_t *fd_info, int tgid)
+// socket 的地址信息全部由内核态读取，无需再通过 lsof 查询
+static int fill_sock_info(fd_info_t *fd_info, const fd_ident_t *ident)
 {
-    char cmd[MAX_CMD_SIZE];
-    char buf[64];
-    char conn[64] = {0};
-    char sock_type[8] = {0};
-    char proto_type[8] = {0};
-    FILE *file;
+    unsigned char sip[INET6_ADDRSTRLEN];
+    unsigned char dip[INET6_ADDRSTRLEN];
     sock_info_t *si = &fd_info->sock_info;
     int ret;
 
     fd_info->type = FD_TYPE_SOCK;
 
-    ret = snprintf(cmd, sizeof(cmd), CMD_LSOF_SOCK_INFO, fd_info->fd, tgid);
-    if (ret < 0 || ret >= sizeof(cmd)) {
-        fprintf(stderr, "ERROR: Failed to set lsof command.\n");
-        return -1;
+    if (ident->family == AF_INET) {
+        si->type = SOCK_TYPE_IPV4;
+    } else if (ident->family == AF_INET6) {
+        si->type = SOCK_TYPE_IPV6;
+    } else {
+        si->type = SOCK_TYPE_UNSUPPORTED;
+        return 0;
     }
 
-    file = popen(cmd, "r");
-    if (file == NULL) {
-        fprintf(stderr, "ERROR: Failed to execute lsof command:%s\n", cmd);
-        return -1;
+    if (ident->sock_type == SOCK_STREAM) {
+        si->ip_info.proto = SOCK_PROTO_TYPE_TCP;
+    } else if (ident->sock_type == SOCK_DGRAM) {
+        si->ip_info.proto = SOCK_PROTO_TYPE_UDP;
+    } else {
+        si->ip_info.proto = SOCK_PROTO_TYPE_UNSUPPORTED;
     }
 
-    while (fgets(buf, sizeof(buf), file) != NULL) {
-        SPLIT_NEWLINE_SYMBOL(buf);
-        switch (buf[0]) {
-            case 't':
-                strncpy(sock_type, buf + 1, sizeof(sock_type) - 1);
-                break;
-            case 'P':
-                strncpy(proto_type, buf + 1, sizeof(proto_type) - 1);
-                break;
-            case 'n':
-                strncpy(conn, buf + 1, sizeof(conn) - 1);
-                break;
-            default:
-                continue;
-        }
+    si->ip_info.sport = ident->sport;
+    si->ip_info.dport = ident->dport;
+    memcpy(si->ip_info.saddr, ident->saddr, FD_IP6_LEN);
+    memcpy(si->ip_info.daddr, ident->daddr, FD_IP6_LEN);
+
+    ip_str(ident->family, (unsigned char *)ident->saddr, sip, sizeof(sip));
+    if (ident->dport == 0) {
+        // listening or unconnected socket
+        ret = snprintf(si->ip_info.conn, sizeof(si->ip_info.conn), "%s:%u", sip, ident->sport);
+    } else {
+        ip_str(ident->family, (unsigned char *)ident->daddr, dip, sizeof(dip));
+        ret = snprintf(si->ip_info.conn, sizeof(si->ip_info.conn), "%s:%u->%s:%u",
+                       sip, ident->sport, dip, ident->dport);
     }
-
-    si->type = get_sock_type(sock_type);
-    if (si->type == SOCK_TYPE_IPV4 || si->type == SOCK_TYPE_IPV6) {
-        si->ip_info.proto = get_proto_type(proto_type);
-        strncpy(si->ip_info.conn, conn, sizeof(si->ip_info.conn) - 1);
+    if (ret < 0 || ret >= sizeof(si->ip_info.conn)) {
+        fprintf(stderr, "ERROR: Failed to set sock conn info.\n");
+        return -1;
     }
 
-    pclose(file);
     return 0;
 }
 
-int fill_fd_info(fd_info_t *fd_info, int tgid)
+int fill_fd_info(fd_info_t *fd_info, int tgid, const fd_ident_t *ident)
 {
-    char fd_path[MAX_PATH_SIZE];
-    struct stat st;
-    int ret;
-
-    ret = snprintf(fd_path, sizeof(fd_path), "/proc/%d/fd/%d", tgid, fd_info->fd);
-    if (ret < 0 || ret >= sizeof(fd_path)) {
-        fprintf(stderr, "ERROR: Failed to get fd path.\n");
-        return -1;
-    }
-
-    if (stat(fd_path, &st)) {
-        return -1;
-    }
-
-    switch (st.st_mode & S_IFMT) {
+    switch (ident->mode & S_IFMT) {
         case S_IFREG:
-            return fill_reg_file_info(fd_info, fd_path);
+            return fill_reg_file_info(fd_info, tgid);
         case S_IFSOCK:
-            return fill_sock_info(fd_info, tgid);
+            return fill_sock_info(fd_info, ident);
         default:
-            fprintf(stderr, "WARN: Unsupported file type of fd %s.\n", fd_path);
             fd_info->type = FD_TYPE_UNSUPPORTED;
             return 0;
     }
 }
 
+// 缓存的 socket 地址与本次内核态读取的不一致时（如 connect 前已被缓存）重新生成，返回非 0 表示失败
+int update_sock_info(fd_info_t *fd_info, const fd_ident_t *ident)
+{
+    sock_info_t *si = &fd_info->sock_info;
+
+    if (si->type == SOCK_TYPE_UNSUPPORTED) {
+        return 0;
+    }
+    if (si->ip_info.sport == ident->sport && si->ip_info.dport == ident->dport &&
+        memcmp(si->ip_info.saddr, ident->saddr, FD_IP6_LEN) == 0 &&
+        memcmp(si->ip_info.daddr, ident->daddr, FD_IP6_LEN) == 0) {
+        return 0;
+    }
+
+    return fill_sock_info(fd_info, ident);
+}
+
 void free_fd_info(fd_info_t *fd_info)
 {
     free(fd_info);
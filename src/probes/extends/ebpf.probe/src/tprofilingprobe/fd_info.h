@@ -15,20 +15,29 @@
 #ifndef __FD_INFO_H__
 #define __FD_INFO_H__
 
+#define FD_IP6_LEN 16
+
+// 系统调用入口处通过 fd 表读取的 struct file 标识，用户态以此作为 fd 信息缓存的 key
+typedef struct {
+    unsigned long long ino;     // inode 号
+    unsigned int name_hash;     // 文件名的 dentry 哈希，区分不同文件系统上相同的 inode 号
+    unsigned short mode;        // 文件类型（i_mode & S_IFMT），为 0 表示 fd 无效
+    unsigned short family;      // socket 地址族
+    unsigned short sock_type;   // socket 类型（SOCK_STREAM/SOCK_DGRAM）
+    unsigned short sport;       // 本端端口（主机字节序）
+    unsigned short dport;       // 对端端口（主机字节序）
+    unsigned short reserve;
+    unsigned char saddr[FD_IP6_LEN];
+    unsigned char daddr[FD_IP6_LEN];
+} fd_ident_t;
+
+#if !defined(BPF_PROG_KERN) && !defined(BPF_PROG_USER)
 #include <uthash.h>
 
 #define MAX_CACHE_FD_NUM 1024
 #define MAX_PATH_SIZE 128
 #define MAX_NET_CONN_INFO_SIZE 128
 
-#define CMD_LSOF_SOCK_INFO "lsof -a -nP -d %d -p %d -FnPt"
-#define MAX_CMD_SIZE 64
-
-#define SOCK_TYPE_IPV4_STR "IPv4"
-#define SOCK_TYPE_IPV6_STR "IPv6"
-#define SOCK_PROTO_TYPE_TCP_STR "TCP"
-#define SOCK_PROTO_TYPE_UDP_STR "UDP"
-
 enum fd_type {
     FD_TYPE_REG,
     FD_TYPE_SOCK,
@@ -56,12 +65,25 @@ typedef struct {
     union {
         struct {
             enum proto_type proto;
+            // conn 由这组地址生成，socket 以 inode 为 key 缓存，地址变化（如先缓存后 connect）时需重新生成
+            unsigned short sport;
+            unsigned short dport;
+            unsigned char saddr[FD_IP6_LEN];
+            unsigned char daddr[FD_IP6_LEN];
             char conn[MAX_NET_CONN_INFO_SIZE];
         } ip_info;
     };
 } sock_info_t;
 
+// fd 复用后文件标识随之改变，因此以文件标识而不是 fd 作为缓存的 key
+typedef struct {
+    unsigned long long ino;
+    unsigned int name_hash;
+    unsigned int reserve;
+} fd_key_t;
+
 typedef struct {
+    fd_key_t key;
     int fd;
     enum fd_type type;
     union {
@@ -73,15 +95,17 @@ typedef struct {
 
 void HASH_add_fd_info(fd_info_t **fd_table, fd_info_t *fd_info);
 void HASH_del_fd_info(fd_info_t **fd_table, fd_info_t *fd_info);
-fd_info_t *HASH_find_fd_info(fd_info_t **fd_table, int fd);
+fd_info_t *HASH_find_fd_info(fd_info_t **fd_table, fd_key_t *key);
 unsigned int HASH_count_fd_table(fd_info_t **fd_table);
 
 void HASH_add_fd_info_with_LRU(fd_info_t **fd_table, fd_info_t *fd_info);
-fd_info_t *HASH_find_fd_info_with_LRU(fd_info_t **fd_table, int fd);
+fd_info_t *HASH_find_fd_info_with_LRU(fd_info_t **fd_table, fd_key_t *key);
 
-int fill_fd_info(fd_info_t *fd_info, int tgid);
+int fill_fd_info(fd_info_t *fd_info, int tgid, const fd_ident_t *ident);
+int update_sock_info(fd_info_t *fd_info, const fd_ident_t *ident);
 
 void free_fd_info(fd_info_t *fd_info);
 void free_fd_table(fd_info_t **fd_table);
+#endif
 
 #endif
\ No newline at end of file
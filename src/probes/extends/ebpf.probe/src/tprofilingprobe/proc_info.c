@@ -20,6 +20,7 @@
 #include "elf_symb.h"
 #include "container.h"
 #include "java_support.h"
+#include "symb_cache.h"
 #include "proc_info.h"
 
 void HASH_add_proc_info(proc_info_t **proc_table, proc_info_t *proc_info)
@@ -216,8 +217,8 @@ proc_info_t *get_proc_info(proc_info_t **proc_table, int tgid)
     return pi;
 }
 
-// get fd info from `/proc/<tgid>/fd/<fd>`
-fd_info_t *add_fd_info(proc_info_t *proc_info, int fd)
+// fill fd info by the file identity captured in kernel
+fd_info_t *add_fd_info(proc_info_t *proc_info, int fd, const fd_ident_t *ident)
 {
     fd_info_t *fi;
     int ret;
@@ -229,8 +230,10 @@ fd_info_t *add_fd_info(proc_info_t *proc_info, int fd)
     }
     memset(fi, 0, sizeof(fd_info_t));
 
+    fi->key.ino = ident->ino;
+    fi->key.name_hash = ident->name_hash;
     fi->fd = fd;
-    ret = fill_fd_info(fi, proc_info->tgid);
+    ret = fill_fd_info(fi, proc_info->tgid, ident);
     if (ret) {
         free(fi);
         return NULL;
@@ -240,13 +243,24 @@ fd_info_t *add_fd_info(proc_info_t *proc_info, int fd)
     return fi;
 }
 
-fd_info_t *get_fd_info(proc_info_t *proc_info, int fd)
+fd_info_t *get_fd_info(proc_info_t *proc_info, int fd, const fd_ident_t *ident)
 {
     fd_info_t *fi;
+    fd_key_t key = {0};
 
-    fi = HASH_find_fd_info_with_LRU(proc_info->fd_table, fd);
+    if (ident->mode == 0) {
+        return NULL;
+    }
+
+    key.ino = ident->ino;
+    key.name_hash = ident->name_hash;
+    fi = HASH_find_fd_info_with_LRU(proc_info->fd_table, &key);
     if (fi == NULL) {
-        fi = add_fd_info(proc_info, fd);
+        fi = add_fd_info(proc_info, fd, ident);
+    } else if (fi->type == FD_TYPE_SOCK && update_sock_info(fi, ident)) {
+        HASH_del_fd_info(proc_info->fd_table, fi);
+        free_fd_info(fi);
+        fi = NULL;
     }
 
     return fi;
@@ -275,6 +289,7 @@ static void update_proc_symbs(struct proc_symbs_s *symbs)
         mod = symbs->mods[i];
         if (mod && mod->mod_type == MODULE_JVM) {
             mod->mod_symbs = update_symb_from_jvm_sym_file((const char *)mod->__mod_info.name);
+            symb_cache_reset(symbs->cache);
             break;
         }
     }
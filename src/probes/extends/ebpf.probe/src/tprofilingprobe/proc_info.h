@@ -53,8 +53,8 @@ proc_info_t *HASH_find_proc_info_with_LRU(proc_info_t **proc_table, int tgid);
 
 proc_info_t *add_proc_info(proc_info_t **proc_table, int tgid);
 proc_info_t *get_proc_info(proc_info_t **proc_table, int tgid);
-fd_info_t *add_fd_info(proc_info_t *proc_info, int fd);
-fd_info_t *get_fd_info(proc_info_t *proc_info, int fd);
+fd_info_t *add_fd_info(proc_info_t *proc_info, int fd, const fd_ident_t *ident);
+fd_info_t *get_fd_info(proc_info_t *proc_info, int fd, const fd_ident_t *ident);
 struct proc_symbs_s *add_symb_info(proc_info_t *proc_info);
 struct proc_symbs_s *get_symb_info(proc_info_t *proc_info);
 
@@ -13,6 +13,8 @@
  * Description: handling thread profiling event
  ******************************************************************************/
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <linux/futex.h>
 
@@ -30,6 +32,7 @@
 #include "proc_info.h"
 #include "profiling_event.h"
 #include "kern_symb.h"
+#include "map_batch.h"
 
 #define LEN_OF_RESOURCE 1024
 #define LEN_OF_ATTRS    8192
@@ -312,7 +315,7 @@ static int append_fd_attrs(strbuf_t *attrs_buf, trace_event_data_t *evt_data)
         return -1;
     }
 
-    fi = get_fd_info(pi, fd);
+    fi = get_fd_info(pi, fd, &evt_data->syscall_d.fd_ident);
     if (fi == NULL) {
         return -1;
     }
@@ -430,8 +433,8 @@ static int append_syscall_common_attrs(strbuf_t *attrs_buf, trace_event_data_t *
 {
     syscall_data_t *syscall_d = &evt_data->syscall_d;
     char evt_name[EVENT_NAME_LEN] = {0};
-    __u64 start_time, end_time;
-    double duration;
+    __u64 start_time, end_time, max_start_time;
+    double duration, max_duration;
     int ret;
 
     set_syscall_name(syscall_d->nr, evt_name);
@@ -443,10 +446,14 @@ static int append_syscall_common_attrs(strbuf_t *attrs_buf, trace_event_data_t *
         return -1;
     }
     duration = (double)syscall_d->duration / NSEC_PER_MSEC;
+    // 执行时间最长的事件作为聚合事件的样例
+    max_start_time = get_unix_time_from_uptime(syscall_d->max_start_time) / NSEC_PER_MSEC;
+    max_duration = (double)syscall_d->max_duration / NSEC_PER_MSEC;
 
     ret = snprintf(attrs_buf->buf, attrs_buf->size,
-                   "\"event.name\":\"%s\",\"start_time\":%llu,\"end_time\":%llu,\"duration\":%.3lf,\"count\":%d",
-                   evt_name, start_time, end_time, duration, syscall_d->count);
+                   "\"event.name\":\"%s\",\"start_time\":%llu,\"end_time\":%llu,\"duration\":%.3lf,\"count\":%d"
+                   ",\"max_duration\":%.3lf,\"exemplar.start_time\":%llu",
+                   evt_name, start_time, end_time, duration, syscall_d->count, max_duration, max_start_time);
     if (ret < 0 || ret >= attrs_buf->size) {
         fprintf(stderr, "ERROR: attributes size not large enough.\n");
         return -1;
@@ -572,4 +579,44 @@ static int filter_by_thread_bl(trace_event_data_t *evt_data)
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+static int output_syscall_aggr_event(const void *key, const void *value, void *ctx)
+{
+    const syscall_m_aggr_key_t *aggr_key = (const syscall_m_aggr_key_t *)key;
+    const syscall_m_aggr_val_t *val = (const syscall_m_aggr_val_t *)value;
+    trace_event_data_t evt_data;
+
+    memset(&evt_data, 0, sizeof(evt_data));
+    evt_data.type = EVT_TYPE_SYSCALL;
+    evt_data.timestamp = val->data.start_time;
+    evt_data.pid = aggr_key->pid;
+    evt_data.tgid = aggr_key->tgid;
+    (void)snprintf(evt_data.comm, sizeof(evt_data.comm), "%s", val->comm);
+    evt_data.syscall_d = val->data;
+    output_profiling_event(&evt_data);
+    return MAP_BATCH_DEL;
+}
+
+/*
+ * 聚合模式下，每个窗口读取并清空内核态的累加器，每个累加器输出一条聚合事件。
+ * 累加器由 lookup_and_delete 批量取出，读取与删除之间内核态的累加不会丢失。
+ */
+void flush_syscall_aggr_events(void *ctx)
+{
+    static struct map_batch_s *batch = NULL;
+    int map_fd = tprofiler.syscallAggrMapFd;
+
+    if (map_fd <= 0) {
+        return;
+    }
+    if (batch == NULL) {
+        batch = map_batch_new(map_fd, sizeof(syscall_m_aggr_key_t), sizeof(syscall_m_aggr_val_t));
+        if (batch == NULL) {
+            fprintf(stderr, "ERROR: Failed to alloc syscall aggregation batch.\n");
+            return;
+        }
+    }
+
+    (void)map_batch_drain(batch, output_syscall_aggr_event, NULL);
+}
@@ -28,5 +28,6 @@
 
 int init_sys_boot_time(__u64 *sysBootTime);
 void output_profiling_event(trace_event_data_t *evt_data);
+void flush_syscall_aggr_events(void *ctx);
 
 #endif
\ No newline at end of file
@@ -31,26 +31,102 @@ struct {
     __uint(max_entries, MAX_SIZE_OF_STASH_EVENT);
 } syscall_stash_map SEC(".maps");
 
-static __always_inline void init_syscall_data(syscall_data_t *scd, syscall_m_enter_t *sce,
-                                              syscall_m_meta_t *scm, void *ctx)
+// 聚合模式下的累加器，由用户态每个窗口读取并清空
+struct {
+    __uint(type, BPF_MAP_TYPE_LRU_HASH);
+    __uint(key_size, sizeof(syscall_m_aggr_key_t));
+    __uint(value_size, sizeof(syscall_m_aggr_val_t));
+    __uint(max_entries, MAX_SIZE_OF_AGGR_EVENT);
+} syscall_aggr_map SEC(".maps");
+
+#ifndef S_IFMT
+#define S_IFMT      00170000
+#define S_IFSOCK    0140000
+#endif
+
+// 从当前进程的 fd 表中读取 struct file，记录文件标识及 socket 的五元组
+static __always_inline void get_fd_ident(int fd, fd_ident_t *ident)
+{
+    struct task_struct *task = (struct task_struct *)bpf_get_current_task();
+    struct file *f;
+    struct inode *inode;
+    struct dentry *dentry;
+    struct socket *sock;
+    struct sock *sk;
+
+    f = file_get_by_fd(fd, task);
+    if (f == (void *)0) {
+        return;
+    }
+    inode = _(f->f_inode);
+    ident->ino = _(inode->i_ino);
+    ident->mode = _(inode->i_mode) & S_IFMT;
+
+    if (ident->mode != S_IFSOCK) {
+        dentry = _(f->f_path.dentry);
+        ident->name_hash = _(dentry->d_name.hash);
+        return;
+    }
+
+    sock = _(f->private_data);
+    ident->sock_type = _(sock->type);
+    sk = _(sock->sk);
+    if (sk == (void *)0) {
+        return;
+    }
+    ident->family = _(sk->sk_family);
+    ident->sport = _(sk->sk_num);
+    ident->dport = bpf_ntohs(_(sk->sk_dport));
+    if (ident->family == AF_INET) {
+        (void)bpf_probe_read(ident->saddr, sizeof(u32), &sk->sk_rcv_saddr);
+        (void)bpf_probe_read(ident->daddr, sizeof(u32), &sk->sk_daddr);
+    } else if (ident->family == AF_INET6) {
+        (void)bpf_probe_read(ident->saddr, IP6_LEN, &sk->sk_v6_rcv_saddr);
+        (void)bpf_probe_read(ident->daddr, IP6_LEN, &sk->sk_v6_daddr);
+    }
+}
+
+static __always_inline void __init_syscall_data(syscall_data_t *scd, syscall_m_enter_t *sce, syscall_m_meta_t *scm)
 {
     scd->nr = scm->nr;
     scd->start_time = sce->start_time;
     scd->end_time = sce->end_time;
     scd->duration = scd->end_time - scd->start_time;
+    scd->max_duration = scd->duration;
+    scd->max_start_time = scd->start_time;
     scd->count = 1;
 
     if (scm->flag & SYSCALL_FLAG_FD) {
         scd->ext_info.fd_info.fd = sce->ext_info.fd_info.fd;
+        scd->fd_ident = sce->fd_ident;
     }
 
+    if (scm->nr == SYSCALL_FUTEX_ID) {
+        scd->ext_info.futex_info.op = sce->ext_info.futex_info.op;
+    }
+}
+
+static __always_inline void init_syscall_data(syscall_data_t *scd, syscall_m_enter_t *sce,
+                                              syscall_m_meta_t *scm, void *ctx)
+{
+    __init_syscall_data(scd, sce, scm);
+
     // stack trace
     if (scm->flag & SYSCALL_FLAG_STACK) {
         scd->stack_info.uid = bpf_get_stackid(ctx, &stack_map, USER_STACKID_FLAGS);
     }
+}
 
-    if (scm->nr == SYSCALL_FUTEX_ID) {
-        scd->ext_info.futex_info.op = sce->ext_info.futex_info.op;
+static __always_inline void merge_syscall_data(syscall_data_t *scd, syscall_m_enter_t *sce)
+{
+    u64 duration = sce->end_time - sce->start_time;
+
+    scd->end_time = sce->end_time;
+    scd->count++;
+    scd->duration += duration;
+    if (duration > scd->max_duration) {
+        scd->max_duration = duration;
+        scd->max_start_time = sce->start_time;
     }
 }
 
@@ -96,10 +172,54 @@ static __always_inline void stash_incomming_syscall_event(syscall_m_enter_t *sce
     bpf_map_update_elem(&syscall_stash_map, &sc_stash_key, &sc_stash, BPF_ANY);
 }
 
+/*
+ * 聚合模式：事件只累加到所属的累加器中，不再逐个通过 perf 上报。
+ * 累加器的 key 包含线程号，同一时刻只有一个 CPU 更新它，因此无需原子操作。
+ */
+static __always_inline void aggr_syscall_event(syscall_m_enter_t *sce, syscall_m_meta_t *scm, void *ctx)
+{
+    syscall_m_aggr_key_t key = {0};
+    syscall_m_aggr_val_t *val;
+    syscall_m_aggr_val_t new_val = {0};
+    u64 ptid = bpf_get_current_pid_tgid();
+
+    key.tgid = (int)(ptid >> INT_LEN);
+    key.pid = (int)(u32)ptid;
+    key.nr = scm->nr;
+    if (scm->flag & SYSCALL_FLAG_FD) {
+        key.ext = sce->ext_info.fd_info.fd;
+        key.ino = sce->fd_ident.ino;
+    }
+    if (scm->nr == SYSCALL_FUTEX_ID) {
+        key.ext = sce->ext_info.futex_info.op;
+    }
+    if (scm->flag & SYSCALL_FLAG_STACK) {
+        key.stack_uid = bpf_get_stackid(ctx, &stack_map, USER_STACKID_FLAGS);
+    }
+
+    val = (syscall_m_aggr_val_t *)bpf_map_lookup_elem(&syscall_aggr_map, &key);
+    if (val != (void *)0) {
+        merge_syscall_data(&val->data, sce);
+        return;
+    }
+
+    (void)bpf_get_current_comm(new_val.comm, sizeof(new_val.comm));
+    __init_syscall_data(&new_val.data, sce, scm);
+    new_val.data.stack_info.uid = key.stack_uid;
+    (void)bpf_map_update_elem(&syscall_aggr_map, &key, &new_val, BPF_ANY);
+}
+
 static __always_inline void process_syscall_event(syscall_m_enter_t *sce, syscall_m_meta_t *scm, void *ctx)
 {
     syscall_m_stash_key_t sc_stash_key = {0};
     syscall_m_stash_val_t *sc_stash;
+    profiling_setting_t *setting;
+
+    setting = get_tp_setting();
+    if (setting != (void *)0 && setting->aggr_enable) {
+        aggr_syscall_event(sce, scm, ctx);
+        return;
+    }
 
     sc_stash_key.pid = sce->pid;
     sc_stash_key.nr = scm->nr;
@@ -125,9 +245,7 @@ static __always_inline void process_syscall_event(syscall_m_enter_t *sce, syscal
         }
     } else {
         // merge event
-        sc_stash->end_time = sce->end_time;
-        sc_stash->count++;
-        sc_stash->duration += sce->end_time - sce->start_time;
+        merge_syscall_data(sc_stash, sce);
     }
 }
 
@@ -135,6 +253,7 @@ static __always_inline void process_syscall_event(syscall_m_enter_t *sce, syscal
     do \
     { \
         syscall_m_enter_t sce; \
+        syscall_m_meta_t scm; \
         profiling_setting_t *setting; \
         \
         setting = get_tp_setting(); \
@@ -149,6 +268,12 @@ static __always_inline void process_syscall_event(syscall_m_enter_t *sce, syscal
         sce.pid = (u32)bpf_get_current_pid_tgid(); \
         sce.start_time = bpf_ktime_get_ns(); \
         __SET_##probe_type##_SYSCALL_PARAMS(name, sce, ctx); \
+        \
+        __builtin_memset(&scm, 0, sizeof(scm)); \
+        set_syscall_meta_##name(&scm); \
+        if (scm.flag & SYSCALL_FLAG_FD) { \
+            get_fd_ident(sce.ext_info.fd_info.fd, &sce.fd_ident); \
+        } \
         (void)bpf_map_update_elem(&syscall_enter_map, &sce.pid, &sce, BPF_ANY); \
         return 0; \
     } while(0)
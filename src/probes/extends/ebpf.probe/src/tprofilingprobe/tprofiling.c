@@ -29,6 +29,7 @@
 #endif
 
 #include "bpf.h"
+#include "evt_loop.h"
 #include "args.h"
 #include "profiling_event.h"
 #include "java_support.h"
@@ -90,6 +91,7 @@ int main(int argc, char **argv)
     int err = -1;
     struct bpf_prog_s *syscall_bpf_progs = NULL;
     struct bpf_prog_s *oncpu_bpf_progs = NULL;
+    struct evt_loop_s *loop = NULL;
 
     if (signal(SIGINT, sig_handling) == SIG_ERR) {
         fprintf(stderr, "can't set signal handler: %s\n", strerror(errno));
@@ -146,20 +148,28 @@ int main(int argc, char **argv)
         init_java_symb_mgmt(tprofiler.procFilterMapFd);
     }
 
-    while (!stop) {
-        if (syscall_bpf_progs->pb != NULL) {
-            if (perf_buffer__poll(syscall_bpf_progs->pb, THOUSAND) < 0) {
-                goto cleanup;
-            }
+    loop = evt_loop_new();
+    if (loop == NULL) {
+        goto cleanup;
+    }
+    if (evt_loop_add_prog(loop, syscall_bpf_progs, "syscall") || evt_loop_add_prog(loop, oncpu_bpf_progs, "oncpu")) {
+        goto cleanup;
+    }
+    if (tprofiler.aggrWindow > 0 && tprofiler.syscallAggrMapFd > 0) {
+        if (evt_loop_add_timer(loop, tprofiler.aggrWindow * THOUSAND, flush_syscall_aggr_events, NULL)) {
+            goto cleanup;
         }
-        if (oncpu_bpf_progs->pb != NULL) {
-            if (perf_buffer__poll(oncpu_bpf_progs->pb, THOUSAND) < 0) {
-                goto cleanup;
-            }
+        printf("INFO: syscall events are aggregated every %us.\n", tprofiler.aggrWindow);
+    }
+
+    while (!stop) {
+        if (evt_loop_poll(loop, THOUSAND) < 0) {
+            goto cleanup;
         }
     }
 
 cleanup:
+    evt_loop_free(&loop);
     unload_bpf_prog(&syscall_bpf_progs);
     unload_bpf_prog(&oncpu_bpf_progs);
     clean_tprofiler();
@@ -179,6 +189,8 @@ static int init_tprofiler()
         return -1;
     }
 
+    tprofiler.aggrWindow = g_params.aggr_window;
+
     if (init_sys_boot_time(&tprofiler.sysBootTime)) {
         fprintf(stderr, "ERROR: get system boot time failed.\n");
         return -1;
@@ -221,6 +233,12 @@ static int init_tprofiler_map_fds()
             fprintf(stderr, "ERROR: get bpf prog stack map failed.\n");
             return -1;
         }
+
+        tprofiler.syscallAggrMapFd = bpf_obj_get(SYSCALL_AGGR_MAP_PATH);
+        if (tprofiler.syscallAggrMapFd < 0) {
+            fprintf(stderr, "ERROR: get bpf prog syscall aggregation map failed.\n");
+            return -1;
+        }
     }
 
     return 0;
@@ -235,6 +253,7 @@ static int init_setting_map(int setting_map_fd)
 
     ps.inited = 1;
     ps.filter_local = tprofiler.filterLocal;
+    ps.aggr_enable = (tprofiler.aggrWindow > 0) ? 1 : 0;
 
     ret = bpf_map_update_elem(setting_map_fd, &key, &ps, BPF_ANY);
     if (ret) {
@@ -15,6 +15,7 @@
 #ifndef __TPROFILING_H__
 #define __TPROFILING_H__
 #include "syscall_table.h"
+#include "fd_info.h"
 
 #ifndef __u64
 typedef unsigned long long __u64;
@@ -27,6 +28,7 @@ typedef unsigned int __u32;
 #define EVENT_NAME_LEN  16
 #define MAX_SIZE_OF_THREAD 1024
 #define MAX_SIZE_OF_STASH_EVENT 10240
+#define MAX_SIZE_OF_AGGR_EVENT 10240
 #define THREAD_COMM_LEN 16
 
 #define DFT_AGGR_DURATION (1000 * NSEC_PER_MSEC)
@@ -35,6 +37,7 @@ typedef unsigned int __u32;
 typedef struct {
     int inited;
     int filter_local;
+    int aggr_enable;    // 聚合模式：系统调用事件在内核态按窗口聚合，由用户态周期性读取
 } profiling_setting_t;
 
 typedef enum {
@@ -72,6 +75,7 @@ typedef struct {
     __u64 start_time;
     __u64 end_time;
     syscall_ext_info_t ext_info;
+    fd_ident_t fd_ident;    // 系统调用入口处 fd 对应的文件标识
 } syscall_m_enter_t;
 
 typedef struct {
@@ -79,8 +83,11 @@ typedef struct {
     __u64 start_time;   // 系统调用的开始时间（若为多个系统调用事件聚合，则表示第一个事件的开始时间）
     __u64 end_time;     // 系统调用的结束时间（若为多个系统调用事件聚合，则表示最后一个事件的结束时间）
     __u64 duration;     // 系统调用的执行时间（若为多个系统调用事件聚合，则表示累计的执行时间）
+    __u64 max_duration;     // 聚合的系统调用事件中最长的执行时间
+    __u64 max_start_time;   // 执行时间最长的事件（样例事件）的开始时间
     int count;          // 聚合的系统调用事件的数量
     syscall_ext_info_t ext_info;    // 不同系统调用类型的扩展信息
+    fd_ident_t fd_ident;            // fd 对应的文件标识
     stack_trace_t stack_info;       // 函数调用栈信息
 } syscall_data_t;
 
@@ -90,6 +97,21 @@ typedef struct {
 } syscall_m_stash_key_t;
 typedef syscall_data_t syscall_m_stash_val_t;
 
+// 聚合模式下的累加器，按线程、系统调用、fd（或 futex 操作）和用户栈区分
+typedef struct {
+    int tgid;
+    int pid;
+    unsigned long nr;
+    int ext;            // fd 或 futex 操作
+    int stack_uid;      // 用户栈ID
+    __u64 ino;          // fd 对应文件的 inode 号，fd 被复用时区分不同的文件
+} syscall_m_aggr_key_t;
+
+typedef struct {
+    char comm[THREAD_COMM_LEN];
+    syscall_data_t data;
+} syscall_m_aggr_val_t;
+
 typedef struct {
     int pid;
     __u64 start_time;
@@ -122,9 +144,11 @@ typedef struct {
 typedef struct {
     int settingMapFd;           /* ebpf map，用于bpf程序配置 */
     int stackMapFd;             /* ebpf map，用于获取调用栈信息 */
+    int syscallAggrMapFd;       /* ebpf map，用于读取内核态聚合的系统调用事件 */
     int procFilterMapFd;        /* ebpf map，用于更新进程白名单 */
     int threadBlMapFd;          /* ebpf map，用于更新线程黑名单 */
     int filterLocal;            /* 是否启用本地配置进行进程过滤。若值为 1 则启用，否则使用全局共享的进程白名单进行过滤 */
+    unsigned int aggrWindow;    /* 聚合模式的窗口，单位：秒（s），为 0 时不启用聚合模式 */
     syscall_meta_t *scmTable;   /* 系统调用元数据表，是一个 hash 表 */
     __u64 sysBootTime;          /* 系统启动时间，单位：纳秒（ns） */
     proc_info_t *procTable;     /* 缓存的进程信息表，是一个 hash 表 */
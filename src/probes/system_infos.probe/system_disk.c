@@ -16,31 +16,238 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/statvfs.h>
+#include <sys/sysmacros.h>
 #include "event.h"
 #include "nprobe_fprintf.h"
 #include "system_disk.h"
+#include "blk_dev.h"
 
 #define METRICS_DF_NAME         "system_df"
 #define METRICS_IOSTAT_NAME     "system_iostat"
 #define ENTITY_FS_NAME          "fs"
 #define ENTITY_DISK_NAME        "disk"
-#define SYSTEM_INODE_COMMAND    "/usr/bin/df -T -i | /usr/bin/awk 'NR>1 {print $0}'"
-#define SYSTEM_BLOCK_CMD        "/usr/bin/df -T | /usr/bin/awk '{if($7==\"%s\"){print $0}}'"
-#define SYSTEM_DISKSTATS_CMD    "/usr/bin/cat /proc/diskstats"
-#define SYSTEM_DISK_DEV_NUM     "/usr/bin/cat /proc/diskstats | wc -l"
+#define SYSTEM_MOUNTINFO_PATH   "/proc/self/mountinfo"
+#define SYSTEM_DISKSTATS_PATH   "/proc/diskstats"
+#define MNT_INFO_INIT_NUM       64
+#define FULL_PER                100
 
-#define DF_FIELD_NUM            7
-static int get_df_fields(char *line, df_stats *stats)
+/*
+ * Filesystems which df does not show by default (no backing blocks) and
+ * container rootfs overlays, which only duplicate the usage of the
+ * underlying filesystem.
+ */
+static const char *g_ignored_fstypes[] = {
+    "proc", "sysfs", "cgroup", "cgroup2", "devpts", "mqueue", "debugfs", "tracefs",
+    "securityfs", "pstore", "bpf", "configfs", "fusectl", "hugetlbfs", "autofs",
+    "binfmt_misc", "rpc_pipefs", "nsfs", "selinuxfs", "efivarfs", "overlay", "aufs"
+};
+
+static FILE *g_mntinfo_fp = NULL;
+static mnt_info *g_mnt_infos = NULL;
+static int g_mnt_num;
+static int g_mnt_capacity;
+
+static char is_ignored_fstype(const char *fstype)
+{
+    int i;
+    int num = sizeof(g_ignored_fstypes) / sizeof(g_ignored_fstypes[0]);
+
+    for (i = 0; i < num; i++) {
+        if (strcmp(fstype, g_ignored_fstypes[i]) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* mountinfo escapes ' ', '\t', '\n' and '\\' as octal sequences like "\040" */
+static void unescape_mnt_path(char *path)
+{
+    char *src = path;
+    char *dst = path;
+
+    while (*src != 0) {
+        if (src[0] == '\\' && src[1] >= '0' && src[1] <= '3' &&
+            src[2] >= '0' && src[2] <= '7' && src[3] >= '0' && src[3] <= '7') {
+            *dst++ = (char)(((src[1] - '0') << 6) | ((src[2] - '0') << 3) | (src[3] - '0'));
+            src += 4;
+            continue;
+        }
+        *dst++ = *src++;
+    }
+    *dst = 0;
+}
+
+static char is_dev_recorded(dev_t dev)
+{
+    int i;
+
+    for (i = 0; i < g_mnt_num; i++) {
+        if (g_mnt_infos[i].dev == dev) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* A filesystem mounted over the mount point hides the one below, statvfs() only sees the top-most */
+static void del_hidden_mnt(const char *mount_on)
+{
+    int i;
+
+    for (i = 0; i < g_mnt_num; i++) {
+        if (strcmp(g_mnt_infos[i].mount_on, mount_on) == 0) {
+            (void)memmove(&g_mnt_infos[i], &g_mnt_infos[i + 1], (g_mnt_num - i - 1) * sizeof(mnt_info));
+            g_mnt_num--;
+            return;
+        }
+    }
+}
+
+static int add_mnt_info(const mnt_info *info)
+{
+    mnt_info *new_infos;
+
+    if (g_mnt_num >= g_mnt_capacity) {
+        int new_capacity = (g_mnt_capacity == 0) ? MNT_INFO_INIT_NUM : g_mnt_capacity * 2;
+        new_infos = realloc(g_mnt_infos, new_capacity * sizeof(mnt_info));
+        if (new_infos == NULL) {
+            return -1;
+        }
+        g_mnt_infos = new_infos;
+        g_mnt_capacity = new_capacity;
+    }
+    (void)memcpy(&g_mnt_infos[g_mnt_num], info, sizeof(mnt_info));
+    g_mnt_num++;
+    return 0;
+}
+
+/*
+ [root@localhost ~]# cat /proc/self/mountinfo
+ 22 96 0:21 / /sys rw,nosuid,nodev,noexec,relatime shared:2 - sysfs sysfs rw
+ 96 1 253:0 / / rw,relatime shared:1 - xfs /dev/mapper/openeuler-root rw,attr2,inode64,noquota
+ (1)(2) (3) (4)(5)  (6)                (7)  (8) (9)    (10)                 (11)
+ */
+static int get_mntinfo_fields(char *line, mnt_info *info)
 {
+    unsigned int major, minor;
+    char mount_on[PATH_LEN];
+    char fstype[FSTYPE_LEN];
+    char fsname[PATH_LEN];
+    char *sep;
     int ret;
 
-    ret = sscanf(line, "%s %s %ld %ld %ld %ld%*s %s",
-        &stats->fsname, &stats->fstype, &stats->inode_or_blk_sum, &stats->inode_or_blk_used,
-        &stats->inode_or_blk_free, &stats->inode_or_blk_used_per, &stats->mount_on);
-    if (ret < DF_FIELD_NUM) {
-        DEBUG("[SYSTEM_DISK] get df stats fields fail.\n");
+    ret = sscanf(line, "%*d %*d %u:%u %*s %255s", &major, &minor, mount_on);
+    if (ret < 3) {
         return -1;
     }
+    /* optional fields (7) are terminated by a single hyphen */
+    sep = strstr(line, " - ");
+    if (sep == NULL) {
+        return -1;
+    }
+    ret = sscanf(sep + 3, "%63s %255s", fstype, fsname);
+    if (ret < 2) {
+        return -1;
+    }
+    unescape_mnt_path(mount_on);
+
+    info->dev = makedev(major, minor);
+    (void)snprintf(info->mount_on, sizeof(info->mount_on), "%s", mount_on);
+    (void)snprintf(info->fstype, sizeof(info->fstype), "%s", fstype);
+    (void)snprintf(info->fsname, sizeof(info->fsname), "%s", fsname);
+    return 0;
+}
+
+static int load_mnt_infos(void)
+{
+    char line[LINE_BUF_LEN * 2];
+    mnt_info info;
+
+    rewind(g_mntinfo_fp);
+    g_mnt_num = 0;
+    while (fgets(line, sizeof(line), g_mntinfo_fp) != NULL) {
+        if (get_mntinfo_fields(line, &info) < 0) {
+            continue;
+        }
+        /*
+         * mountinfo lists mounts in the order they are mounted, so the last one of stacked mounts
+         * is the top-most; bind mounts share the device id of the real filesystem, keep the first.
+         */
+        del_hidden_mnt(info.mount_on);
+        if (is_ignored_fstype(info.fstype)) {
+            continue;
+        }
+        if (is_dev_recorded(info.dev)) {
+            continue;
+        }
+        if (add_mnt_info(&info) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* The kernel signals POLLPRI|POLLERR on mountinfo whenever the mount table changes */
+static char is_mnt_table_changed(void)
+{
+    struct pollfd pfd = {0};
+
+    pfd.fd = fileno(g_mntinfo_fp);
+    pfd.events = POLLPRI;
+    if (poll(&pfd, 1, 0) <= 0) {
+        return 0;
+    }
+    return (pfd.revents & (POLLPRI | POLLERR)) ? 1 : 0;
+}
+
+static void fill_df_stats(const mnt_info *info, df_stats *stats)
+{
+    (void)snprintf(stats->fsname, sizeof(stats->fsname), "%s", info->fsname);
+    (void)snprintf(stats->fstype, sizeof(stats->fstype), "%s", info->fstype);
+    (void)snprintf(stats->mount_on, sizeof(stats->mount_on), "%s", info->mount_on);
+}
+
+/* Round up like df does, so a barely used filesystem is never reported as 0% */
+static long calc_used_per(unsigned long long used, unsigned long long total)
+{
+    if (total == 0) {
+        return 0;
+    }
+    return (long)((used * FULL_PER + total - 1) / total);
+}
+
+static int get_mnt_stats(const mnt_info *info, df_stats *inode_stats, df_stats *blk_stats)
+{
+    struct statvfs vfs;
+    unsigned long long blk_used, blk_avail, unit;
+
+    if (statvfs(info->mount_on, &vfs) < 0) {
+        DEBUG("[SYSTEM_DISK] statvfs %s fail.\n", info->mount_on);
+        return -1;
+    }
+    /* skip dummy filesystems which have no blocks/inodes, as df does */
+    if (vfs.f_blocks == 0 || vfs.f_files == 0) {
+        return -1;
+    }
+
+    fill_df_stats(info, inode_stats);
+    inode_stats->inode_or_blk_sum = (long)vfs.f_files;
+    inode_stats->inode_or_blk_free = (long)vfs.f_ffree;
+    inode_stats->inode_or_blk_used = (long)(vfs.f_files - vfs.f_ffree);
+    inode_stats->inode_or_blk_used_per = calc_used_per(vfs.f_files - vfs.f_ffree, vfs.f_files);
+
+    /* block numbers are reported in 1K-blocks, the same unit as df */
+    unit = (vfs.f_frsize != 0) ? vfs.f_frsize : vfs.f_bsize;
+    blk_used = vfs.f_blocks - vfs.f_bfree;
+    blk_avail = vfs.f_bavail;
+    fill_df_stats(info, blk_stats);
+    blk_stats->inode_or_blk_sum = (long)(vfs.f_blocks * unit / 1024);
+    blk_stats->inode_or_blk_used = (long)(blk_used * unit / 1024);
+    blk_stats->inode_or_blk_free = (long)(blk_avail * unit / 1024);
+    blk_stats->inode_or_blk_used_per = calc_used_per(blk_used, blk_used + blk_avail);
     return 0;
 }
 
@@ -81,63 +288,54 @@ static void report_disk_status(df_stats inode_stats, df_stats blk_stats, struct
     }
 }
 
-static int get_mnt_block_info(const char *mounted_on, df_stats *blk_stats)
+int system_disk_init(void)
 {
-    FILE *f = NULL;
-    char cmd[LINE_BUF_LEN];
-    char line[LINE_BUF_LEN];
-
-    cmd[0] = 0;
-    (void)snprintf(cmd, LINE_BUF_LEN, SYSTEM_BLOCK_CMD, mounted_on);
-    f = popen(cmd, "r");
-    if (f == NULL) {
+    g_mntinfo_fp = fopen(SYSTEM_MOUNTINFO_PATH, "r");
+    if (g_mntinfo_fp == NULL) {
+        ERROR("[SYSTEM_DISK] open %s fail.\n", SYSTEM_MOUNTINFO_PATH);
         return -1;
     }
-    line[0] = 0;
-    if (fgets(line, LINE_BUF_LEN, f) == NULL) {
-        pclose(f);
-        return -1;
+    return load_mnt_infos();
+}
+
+void system_disk_destroy(void)
+{
+    if (g_mntinfo_fp != NULL) {
+        (void)fclose(g_mntinfo_fp);
+        g_mntinfo_fp = NULL;
     }
-    SPLIT_NEWLINE_SYMBOL(line);
-    if (get_df_fields(line, blk_stats) < 0) {
-        pclose(f);
-        return -1;
+    if (g_mnt_infos != NULL) {
+        free(g_mnt_infos);
+        g_mnt_infos = NULL;
     }
-
-    pclose(f);
-    return 0;
+    g_mnt_num = 0;
+    g_mnt_capacity = 0;
 }
 
 /*
- [root@localhost ~]# df -i | awk 'NR>1 {print $1"%"$2"%"$3"%"$4"%"$5"%"$6}'
- devtmpfs%949375%377%948998%1%%/dev
- tmpfs%952869%1%952868%1%%/dev/shm
- tmpfs%952869%631%952238%1%%/run
- [root@localhost ~]# df | awk '{if($6==/dev){print $1"%"$2"%"$3"%"$4"%"$5"%"$6}}'
- devtmpfs%3797500%0%3797500%0%%/dev
+ [root@localhost ~]# df -T -i /dev
+ Filesystem     Type     Inodes IUsed  IFree IUse% Mounted on
+ devtmpfs       devtmpfs 949375   377 948998    1% /dev
+ [root@localhost ~]# df -T /dev
+ Filesystem     Type     1K-blocks  Used Available Use% Mounted on
+ devtmpfs       devtmpfs   3797500     0   3797500   0% /dev
  */
 int system_disk_probe(struct probe_params *params)
 {
-    FILE *f = NULL;
-    char line[LINE_BUF_LEN];
     df_stats inode_stats;
     df_stats block_stats;
+    int i;
 
-    /* get every disk filesystem's inode infos */
-    f = popen(SYSTEM_INODE_COMMAND, "r");
-    if (f == NULL) {
+    if (g_mntinfo_fp == NULL) {
         return -1;
     }
-    while (!feof(f)) {
-        line[0] = 0;
-        if (fgets(line, LINE_BUF_LEN, f) == NULL) {
-            break;
-        }
-        SPLIT_NEWLINE_SYMBOL(line);
-        if (get_df_fields(line, &inode_stats) < 0) {
-            continue;
-        }
-        if (get_mnt_block_info(inode_stats.mount_on, &block_stats) < 0) {
+    if (is_mnt_table_changed() && load_mnt_infos() < 0) {
+        ERROR("[SYSTEM_DISK] reload mount infos fail.\n");
+        return -1;
+    }
+
+    for (i = 0; i < g_mnt_num; i++) {
+        if (get_mnt_stats(&g_mnt_infos[i], &inode_stats, &block_stats) < 0) {
             continue;
         }
         /* output */
@@ -157,7 +355,6 @@ int system_disk_probe(struct probe_params *params)
         /* output event */
         report_disk_status(inode_stats, block_stats, params);
     }
-    (void)pclose(f);
     return 0;
 }
 
@@ -245,6 +442,31 @@ static void report_disk_iostat(const char *disk_name, disk_io_stats *io_info, st
 static disk_stats *g_disk_stats = NULL;
 static int g_disk_dev_num;
 static int g_first_flag;
+static struct blk_dev_tbl_s *g_blk_devs = NULL;
+
+static int get_diskdev_num(int *num);
+
+// The lines of diskstats are shifted when a disk is added or removed, start over from the new lines
+static int system_iostat_resize(void)
+{
+    int num = 0;
+    disk_stats *stats;
+
+    if (get_diskdev_num(&num) < 0 || num <= 0) {
+        return -1;
+    }
+    if (num != g_disk_dev_num) {
+        stats = realloc(g_disk_stats, num * sizeof(disk_stats));
+        if (stats == NULL) {
+            return -1;
+        }
+        g_disk_stats = stats;
+        g_disk_dev_num = num;
+    }
+    (void)memset(g_disk_stats, 0, g_disk_dev_num * sizeof(disk_stats));
+    g_first_flag = 1;
+    return 0;
+}
 
 int system_iostat_probe(struct probe_params *params)
 {
@@ -254,7 +476,11 @@ int system_iostat_probe(struct probe_params *params)
     disk_io_stats io_datas;
     int index;
 
-    f = popen(SYSTEM_DISKSTATS_CMD, "r");
+    if ((g_blk_devs != NULL) && blk_dev_tbl_sync(g_blk_devs) && system_iostat_resize() < 0) {
+        return -1;
+    }
+
+    f = fopen(SYSTEM_DISKSTATS_PATH, "r");
     if (f == NULL) {
         return -1;
     }
@@ -263,7 +489,7 @@ int system_iostat_probe(struct probe_params *params)
     while (!feof(f) && index < g_disk_dev_num) {
         line[0] = 0;
         if (fgets(line, LINE_BUF_LEN, f) == NULL) {
-            (void)pclose(f);
+            (void)fclose(f);
             return -1;
         }
         (void)memcpy(&temp, &g_disk_stats[index], sizeof(disk_stats));
@@ -297,7 +523,7 @@ int system_iostat_probe(struct probe_params *params)
         index++;
     }
     g_first_flag = 0;
-    (void)pclose(f);
+    (void)fclose(f);
     return 0;
 }
 
@@ -306,18 +532,15 @@ static int get_diskdev_num(int *num)
     FILE *f = NULL;
     char line[LINE_BUF_LEN];
 
-    f = popen(SYSTEM_DISK_DEV_NUM, "r");
+    f = fopen(SYSTEM_DISKSTATS_PATH, "r");
     if (f == NULL) {
         return -1;
     }
-    line[0] = 0;
-    if (fgets(line, LINE_BUF_LEN, f) == NULL) {
-        (void)pclose(f);
-        return -1;
+    *num = 0;
+    while (fgets(line, LINE_BUF_LEN, f) != NULL) {
+        (*num)++;
     }
-    SPLIT_NEWLINE_SYMBOL(line);
-    *num = atoi(line);
-    (void)pclose(f);
+    (void)fclose(f);
     return 0;
 }
 
@@ -335,6 +558,9 @@ int system_iostat_init(void)
 
     g_first_flag = 1;
 
+    // only to know when disks are added or removed
+    g_blk_devs = blk_dev_tbl_new();
+
     return 0;
 }
 
@@ -344,5 +570,6 @@ void system_iostat_destroy(void)
         (void)free(g_disk_stats);
         g_disk_stats = NULL;
     }
+    blk_dev_tbl_free(&g_blk_devs);
     return;
 }
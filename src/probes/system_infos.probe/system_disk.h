@@ -17,6 +17,7 @@
 
 #pragma once
 
+#include <sys/types.h>
 #include "args.h"
 #include "common.h"
 
@@ -35,6 +36,13 @@ typedef struct {
     long inode_or_blk_used_per;
 } df_stats;
 
+typedef struct {
+    dev_t dev;
+    char fsname[PATH_LEN];
+    char fstype[FSTYPE_LEN];
+    char mount_on[PATH_LEN];
+} mnt_info;
+
 typedef struct {
     // u32 major;
     // u32 minor;
@@ -69,6 +77,8 @@ typedef struct {
     float aqu_sz;
 } disk_io_stats;
 
+int system_disk_init(void);
+void system_disk_destroy(void);
 int system_disk_probe(struct probe_params *params);
 int system_iostat_probe(struct probe_params *params);
 int system_iostat_init(void);
@@ -46,6 +46,11 @@ static int system_probe_init(struct probe_params * params)
     /* system proc init */
     system_proc_init(params->task_whitelist);
 
+    /* system_disk init */
+    if (system_disk_init() < 0) {
+        return -1;
+    }
+
     /* system_iostat init */
     if (system_iostat_init() < 0) {
         return -1;
@@ -65,6 +70,9 @@ static void system_probe_destroy(void)
     /* system net destroy */
     system_net_destroy();
 
+    /* system disk destroy */
+    system_disk_destroy();
+
     /* system iostat destroy */
     system_iostat_destroy();
 
@@ -546,7 +546,8 @@ static int WebServerInit(ResourceMgr *resourceMgr)
         INFO("[RESOURCE] metirc out channel isn't web_server, skip create webServer.\n");
         return 0;
     }
-    webServer = WebServerCreate(configMgr->webServerConfig->port);
+    webServer = WebServerCreate(configMgr->webServerConfig->port,
+                                configMgr->webServerConfig->flamegraphDir);
     if (webServer == NULL) {
         ERROR("[RESOURCE] create webServer failed.\n");
         return -1;
@@ -33,6 +33,23 @@ static MHD_Result WebRequestCallback(void *cls,
                               void **ptr);
 #endif
 
+static int WebFlamegraphFile(const WebServer *webServer, const char *url, char *file, size_t size)
+{
+    const char *name = url + strlen(FLAMEGRAPH_URL_PREFIX);
+
+    if (webServer == NULL || webServer->flamegraphDir[0] == 0) {
+        return -1;
+    }
+
+    /* flame graph name, e.g. oncpu, must not escape from flamegraphDir */
+    if (name[0] == 0 || strspn(name, "abcdefghijklmnopqrstuvwxyz") != strlen(name)) {
+        return -1;
+    }
+
+    (void)snprintf(file, size, "%s/%s/%s", webServer->flamegraphDir, name, FLAMEGRAPH_LATEST_SVG);
+    return 0;
+}
+
 static MHD_Result WebRequestCallback(void *cls,
                               struct MHD_Connection *connection,
                               const char *url,
@@ -44,6 +61,8 @@ static MHD_Result WebRequestCallback(void *cls,
 {
     static int dummy;
     char log_file_name[256];
+    const char *contentType = "text/plain";
+    char isFlamegraph = 0;
     struct MHD_Response *response;
     int ret, fd;
     struct stat buf;
@@ -62,7 +81,13 @@ static MHD_Result WebRequestCallback(void *cls,
         return MHD_NO;
     }
 
-    if (ReadMetricsLogs(log_file_name) < 0) {
+    if (url != NULL && strncmp(url, FLAMEGRAPH_URL_PREFIX, strlen(FLAMEGRAPH_URL_PREFIX)) == 0) {
+        if (WebFlamegraphFile((const WebServer *)cls, url, log_file_name, sizeof(log_file_name)) < 0) {
+            return MHD_NO;
+        }
+        contentType = "image/svg+xml";
+        isFlamegraph = 1;
+    } else if (ReadMetricsLogs(log_file_name) < 0) {
         return MHD_NO;
     }
 
@@ -82,9 +107,12 @@ static MHD_Result WebRequestCallback(void *cls,
         return MHD_NO;
     }
 
-    RemoveMetricsLogs(log_file_name);
+    /* svg files are kept by stackprobe, only metrics logs are consumed */
+    if (!isFlamegraph) {
+        RemoveMetricsLogs(log_file_name);
+    }
 
-    ret = MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, "text/plain");
+    ret = MHD_add_response_header(response, MHD_HTTP_HEADER_CONTENT_TYPE, contentType);
     if (ret == MHD_NO) {
         MHD_destroy_response(response);
         return MHD_NO;
@@ -100,7 +128,7 @@ static MHD_Result WebRequestCallback(void *cls,
     return ret;
 }
 
-WebServer *WebServerCreate(uint16_t port)
+WebServer *WebServerCreate(uint16_t port, const char *flamegraphDir)
 {
     WebServer *server = NULL;
     server = (WebServer *)malloc(sizeof(WebServer));
@@ -110,6 +138,9 @@ WebServer *WebServerCreate(uint16_t port)
     memset(server, 0, sizeof(WebServer));
 
     server->port = port;
+    if (flamegraphDir != NULL) {
+        (void)strncpy(server->flamegraphDir, flamegraphDir, PATH_LEN - 1);
+    }
     return server;
 }
 
@@ -138,7 +169,7 @@ int WebServerStartDaemon(WebServer *webServer)
                                          NULL,
                                          NULL,
                                          &WebRequestCallback,
-                                         NULL,
+                                         webServer,
                                          MHD_OPTION_END);
     if (webServer->daemon == NULL) {
         return -1;
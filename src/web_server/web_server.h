@@ -30,13 +30,17 @@
 #define MHD_Result   enum MHD_Result
 #endif
 
+#define FLAMEGRAPH_URL_PREFIX   "/flamegraph/"
+#define FLAMEGRAPH_LATEST_SVG   "latest.svg"
+
 typedef struct {
     uint16_t port;
+    char flamegraphDir[PATH_LEN];   // svg dir of stackprobe, flame graphs are served if set
 
     struct MHD_Daemon *daemon;
 } WebServer;
 
-WebServer *WebServerCreate(uint16_t port);
+WebServer *WebServerCreate(uint16_t port, const char *flamegraphDir);
 void WebServerDestroy(WebServer *webServer);
 int WebServerStartDaemon(WebServer *webServer);
 
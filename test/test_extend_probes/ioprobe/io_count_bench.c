@@ -0,0 +1,157 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: direct I/O from threads on every CPU to check the per-CPU io_count of ioprobe
+ ******************************************************************************/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+#define BENCH_ALIGN         4096
+#define BENCH_MB            (1024UL * 1024UL)
+
+struct bench_arg_s {
+    int fd;
+    int cpu;
+    int is_read;
+    size_t io_size;
+    off_t offset;
+    unsigned long long bytes;   // to do
+    unsigned long long done;
+};
+
+static void *bench_thread(void *arg)
+{
+    struct bench_arg_s *bench = (struct bench_arg_s *)arg;
+    cpu_set_t set;
+    ssize_t ret;
+    void *buf = NULL;
+
+    CPU_ZERO(&set);
+    CPU_SET(bench->cpu, &set);
+    (void)pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+
+    if (posix_memalign(&buf, BENCH_ALIGN, bench->io_size) != 0) {
+        return NULL;
+    }
+    (void)memset(buf, bench->cpu & 0xff, bench->io_size);
+
+    while (bench->done < bench->bytes) {
+        if (bench->is_read) {
+            ret = pread(bench->fd, buf, bench->io_size, bench->offset + (off_t)bench->done);
+        } else {
+            ret = pwrite(bench->fd, buf, bench->io_size, bench->offset + (off_t)bench->done);
+        }
+        if (ret != (ssize_t)bench->io_size) {
+            break;
+        }
+        bench->done += (unsigned long long)ret;
+    }
+    free(buf);
+    return NULL;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int run_phase(int fd, int is_read, int threads, unsigned long long bytes, size_t io_size,
+    unsigned long long *done)
+{
+    int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    pthread_t *tids;
+    struct bench_arg_s *args;
+    double start, cost;
+
+    tids = (pthread_t *)calloc(threads, sizeof(pthread_t));
+    args = (struct bench_arg_s *)calloc(threads, sizeof(struct bench_arg_s));
+    if (tids == NULL || args == NULL || cpus <= 0) {
+        free(tids);
+        free(args);
+        return -1;
+    }
+
+    start = now_sec();
+    for (int i = 0; i < threads; i++) {
+        args[i].fd = fd;
+        args[i].cpu = i % cpus;
+        args[i].is_read = is_read;
+        args[i].io_size = io_size;
+        args[i].offset = (off_t)(bytes * (unsigned long long)i);
+        args[i].bytes = bytes;
+        (void)pthread_create(&tids[i], NULL, bench_thread, &args[i]);
+    }
+    *done = 0;
+    for (int i = 0; i < threads; i++) {
+        (void)pthread_join(tids[i], NULL);
+        *done += args[i].done;
+    }
+    cost = now_sec() - start;
+
+    printf("%s: threads %d, bytes %llu, %.3f s, %.1f MB/s\n", is_read ? "read" : "write",
+        threads, *done, cost, (double)*done / BENCH_MB / cost);
+    free(tids);
+    free(args);
+    return 0;
+}
+
+/*
+ * Usage: io_count_bench <block dev> [threads] [MB per thread] [KB per I/O]
+ * The last line is "generated <read bytes> <write bytes>", the totals io_count should report.
+ */
+int main(int argc, char **argv)
+{
+    int threads = (argc > 2) ? atoi(argv[2]) : (int)sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned long long bytes = ((argc > 3) ? strtoull(argv[3], NULL, 10) : 64ULL) * BENCH_MB;
+    size_t io_size = (size_t)((argc > 4) ? strtoul(argv[4], NULL, 10) : 64UL) * 1024;
+    unsigned long long dev_size = 0, read_bytes = 0, write_bytes = 0;
+    int fd;
+
+    if (argc < 2 || threads <= 0 || bytes == 0 || io_size == 0 || (io_size % BENCH_ALIGN) != 0 ||
+        (bytes % io_size) != 0) {
+        fprintf(stderr, "Usage: %s <block dev> [threads] [MB per thread] [KB per I/O, 4K aligned]\n", argv[0]);
+        return -1;
+    }
+
+    fd = open(argv[1], O_RDWR | O_DIRECT);
+    if (fd < 0) {
+        fprintf(stderr, "Open %s failed.\n", argv[1]);
+        return -1;
+    }
+    if (ioctl(fd, BLKGETSIZE64, &dev_size) != 0 || dev_size < bytes * (unsigned long long)threads) {
+        fprintf(stderr, "%s is smaller than %llu bytes.\n", argv[1], bytes * (unsigned long long)threads);
+        (void)close(fd);
+        return -1;
+    }
+
+    if (run_phase(fd, 0, threads, bytes, io_size, &write_bytes) || run_phase(fd, 1, threads, bytes, io_size, &read_bytes)) {
+        (void)close(fd);
+        return -1;
+    }
+    (void)close(fd);
+
+    printf("generated %llu %llu\n", read_bytes, write_bytes);
+    return 0;
+}
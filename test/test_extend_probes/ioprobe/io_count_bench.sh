@@ -0,0 +1,72 @@
+#!/bin/bash
+# Accuracy and overhead of the per-CPU io_count of ioprobe under I/O from every CPU.
+# Direct I/O is issued on a loop device only the bench uses, once without ioprobe as the baseline and
+# once with it. The read/write bytes ioprobe reports for the device must equal the bytes generated.
+# The I/O size is kept below the max sectors of the device, a split bio is queued twice.
+# Run as root: io_count_bench.sh [threads] [MB per thread] [KB per I/O]
+
+PROJECT_FOLDER=$(dirname $(readlink -f "$0"))
+BENCH=${PROJECT_FOLDER}/io_count_bench
+IOPROBE=${IOPROBE:-/opt/gala-gopher/extend_probes/ioprobe}
+THREADS=${1:-$(nproc)}
+MB=${2:-64}
+IO_KB=${3:-64}
+IMG=/tmp/io_count_bench.img
+OUT=/tmp/io_count_bench.out
+LOOP_DEV=""
+
+function compile_bench()
+{
+    gcc -O2 -pthread ${PROJECT_FOLDER}/io_count_bench.c -o ${BENCH}
+}
+
+function setup_dev()
+{
+    truncate -s $(( (THREADS * MB + 64) * 1024 * 1024 )) ${IMG} || return 1
+    LOOP_DEV=$(losetup -f --show ${IMG}) || return 1
+    # udev reads a new device, let it finish before ioprobe counts
+    udevadm settle 2>/dev/null
+    return 0
+}
+
+function cleanup()
+{
+    [ -n "${PROBE_PID}" ] && kill ${PROBE_PID} 2>/dev/null
+    [ -n "${LOOP_DEV}" ] && losetup -d ${LOOP_DEV}
+    rm -f ${IMG}
+}
+
+function run_bench()
+{
+    local dev_id major minor generated reported
+
+    echo "==== Begin to bench io_count, baseline ===="
+    ${BENCH} ${LOOP_DEV} ${THREADS} ${MB} ${IO_KB} || return 1
+
+    echo "==== Begin to bench io_count, with ioprobe ===="
+    ${IOPROBE} -t 1 -P 4 > ${OUT} 2>&1 &
+    PROBE_PID=$!
+    sleep 5
+    generated=$(${BENCH} ${LOOP_DEV} ${THREADS} ${MB} ${IO_KB} | tee /dev/stderr | awk '/^generated/ {print $2, $3}')
+    sleep 3
+    kill ${PROBE_PID} 2>/dev/null
+    wait ${PROBE_PID} 2>/dev/null
+    PROBE_PID=""
+
+    dev_id=$(cat /sys/block/$(basename ${LOOP_DEV})/dev)
+    major=${dev_id%%:*}
+    minor=${dev_id##*:}
+    reported=$(awk -F'|' -v major=${major} -v minor=${minor} \
+        '$2 == "io_count" && $3 == major && $4 == minor {r += $7; w += $8} END {printf "%.0f %.0f", r, w}' ${OUT})
+
+    echo "generated read/write bytes: ${generated}, reported: ${reported}"
+    if [ -z "${generated}" ] || [ "${generated}" != "${reported}" ]; then
+        echo "==== io_count FAILED ===="
+        return 1
+    fi
+    echo "==== io_count PASSED ===="
+    return 0
+}
+
+trap cleanup EXIT
+compile_bench && setup_dev && run_bench
@@ -0,0 +1,112 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-19
+ * Description: render time of the flame graph svg of stackprobe
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bpf.h"
+#include "flame_svg.h"
+
+#define BENCH_FUNCS         4096
+#define BENCH_MIN_DEPTH     4
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/*
+ * Folded stacks in the format stackprobe writes: "<comm>;<frame>;...;<frame> <count>".
+ * Callers are picked from a small set near the root and a large one near the leaf, like a real
+ * profile, and the counts fall off with the rank of the stack.
+ */
+static int gen_folded(const char *file, unsigned int stacks, unsigned int max_depth)
+{
+    FILE *fp = fopen(file, "w");
+    unsigned int depth, width;
+
+    if (fp == NULL) {
+        return -1;
+    }
+    srand(1);
+    for (unsigned int i = 0; i < stacks; i++) {
+        depth = BENCH_MIN_DEPTH + (unsigned int)rand() % (max_depth - BENCH_MIN_DEPTH + 1);
+        fprintf(fp, "proc_%u", (unsigned int)rand() % 16);
+        for (unsigned int d = 0; d < depth; d++) {
+            width = (d + 1) * BENCH_FUNCS / depth;
+            fprintf(fp, ";func_%u_[%s]", (unsigned int)rand() % width, (d % 3) ? "u" : "k");
+        }
+        fprintf(fp, " %u\n", 1 + 100000 / (i + 1));
+    }
+    return fclose(fp);
+}
+
+static int render_folded(const char *file, const char *svg_file, int loops)
+{
+    struct flame_svg_opt_s opt = {.title = "On-CPU Time Flame Graph", .count_name = "us", .color = FLAME_COLOR_HOT};
+    FILE *folded, *svg;
+    double start, cost;
+    int ret = 0;
+
+    start = now_sec();
+    for (int i = 0; i < loops && ret == 0; i++) {
+        folded = fopen(file, "r");
+        svg = fopen(svg_file, "w");
+        if (folded == NULL || svg == NULL) {
+            ret = -1;
+        } else {
+            ret = flame_svg_render(folded, svg, &opt);
+        }
+        if (folded != NULL) {
+            (void)fclose(folded);
+        }
+        if (svg != NULL) {
+            (void)fclose(svg);
+        }
+    }
+    cost = now_sec() - start;
+    if (ret == 0) {
+        printf("flame_svg: %s, %.1f ms per svg\n", file, cost * 1000 / loops);
+    }
+    return ret;
+}
+
+/*
+ * Usage: flame_svg_bench gen <folded file> [stacks] [max depth]
+ *        flame_svg_bench render <folded file> <svg file> [loops]
+ */
+int main(int argc, char **argv)
+{
+    if (argc >= 3 && strcmp(argv[1], "gen") == 0) {
+        unsigned int stacks = (argc > 3) ? (unsigned int)strtoul(argv[3], NULL, 10) : 100000;
+        unsigned int max_depth = (argc > 4) ? (unsigned int)strtoul(argv[4], NULL, 10) : 32;
+
+        if (stacks > 0 && max_depth >= BENCH_MIN_DEPTH) {
+            return gen_folded(argv[2], stacks, max_depth);
+        }
+    } else if (argc >= 4 && strcmp(argv[1], "render") == 0) {
+        int loops = (argc > 4) ? atoi(argv[4]) : 5;
+
+        if (loops > 0) {
+            return render_folded(argv[2], argv[3], loops);
+        }
+    }
+    fprintf(stderr, "Usage: %s gen <folded file> [stacks] [max depth]\n"
+        "       %s render <folded file> <svg file> [loops]\n", argv[0], argv[0]);
+    return -1;
+}
@@ -0,0 +1,49 @@
+#!/bin/bash
+# Render time of the flame graph svg, the native renderer of stackprobe (stackprobe/flame_svg.c) against
+# flamegraph.pl it replaced, on the same folded stacks. Set FOLDED to a folded file stackprobe wrote, e.g. a
+# real oncpu profile from its flame_dir, otherwise a synthetic one is generated. Set FLAMEGRAPH to the path
+# of flamegraph.pl, the run is skipped if it is not installed.
+# Run: [FOLDED=<folded file>] [FLAMEGRAPH=/usr/bin/flamegraph.pl] flame_svg_bench.sh [stacks] [max depth] [loops]
+
+PROJECT_FOLDER=$(dirname $(readlink -f "$0"))
+SRC_FOLDER=${PROJECT_FOLDER}/../../../src
+EBPF_SRC_FOLDER=${SRC_FOLDER}/probes/extends/ebpf.probe/src
+BENCH=${PROJECT_FOLDER}/flame_svg_bench
+FLAMEGRAPH=${FLAMEGRAPH:-/usr/bin/flamegraph.pl}
+STACKS=${1:-100000}
+MAX_DEPTH=${2:-32}
+LOOPS=${3:-5}
+SVG=/tmp/flame_svg_bench.svg
+
+function compile_bench()
+{
+    gcc -O2 -I${EBPF_SRC_FOLDER}/include -I${SRC_FOLDER}/common -I${EBPF_SRC_FOLDER}/stackprobe \
+        ${PROJECT_FOLDER}/flame_svg_bench.c ${EBPF_SRC_FOLDER}/stackprobe/flame_svg.c -o ${BENCH}
+}
+
+function run_bench()
+{
+    local folded=${FOLDED:-/tmp/flame_svg_bench.folded}
+    local start end
+
+    if [ -z "${FOLDED}" ]; then
+        ${BENCH} gen ${folded} ${STACKS} ${MAX_DEPTH} || return 1
+    fi
+    echo "==== Begin to bench flame graph render, $(wc -l < ${folded}) stacks ===="
+    ${BENCH} render ${folded} ${SVG} ${LOOPS} || return 1
+
+    if [ ! -x ${FLAMEGRAPH} ]; then
+        echo "${FLAMEGRAPH} is not installed, skip it."
+        return 0
+    fi
+    start=$(date +%s%N)
+    for i in $(seq ${LOOPS})
+    do
+        ${FLAMEGRAPH} --title=" On-CPU Time Flame Graph " --countname=us ${folded} > ${SVG}.pl || return 1
+    done
+    end=$(date +%s%N)
+    echo "flamegraph.pl: ${folded}, $(( (end - start) / LOOPS / 1000000 )) ms per svg"
+    return 0
+}
+
+compile_bench && run_bench
@@ -0,0 +1,108 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: malloc heavy workload to measure the overhead of stackprobe memleak
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#define BENCH_SLOTS         1024
+#define BENCH_MIN_SIZE      16
+#define BENCH_MAX_SIZE      4096
+#define BENCH_LEAK_PERIOD   1000    // one allocation of every 1000 is never freed
+
+struct bench_arg_s {
+    unsigned long loops;
+    unsigned int seed;
+    unsigned long leaked;
+};
+
+static void *bench_thread(void *arg)
+{
+    struct bench_arg_s *bench = (struct bench_arg_s *)arg;
+    void *slots[BENCH_SLOTS] = {0};
+    unsigned int seed = bench->seed;
+    unsigned long i;
+    size_t size;
+    int idx;
+
+    for (i = 0; i < bench->loops; i++) {
+        idx = rand_r(&seed) % BENCH_SLOTS;
+        if (slots[idx] != NULL) {
+            if ((i % BENCH_LEAK_PERIOD) == 0) {
+                bench->leaked++;
+            } else {
+                free(slots[idx]);
+            }
+        }
+        size = BENCH_MIN_SIZE + rand_r(&seed) % (BENCH_MAX_SIZE - BENCH_MIN_SIZE);
+        slots[idx] = malloc(size);
+        if (slots[idx] != NULL) {
+            ((char *)slots[idx])[0] = (char)i;
+        }
+    }
+
+    for (idx = 0; idx < BENCH_SLOTS; idx++) {
+        free(slots[idx]);
+    }
+    return NULL;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* Usage: memleak_bench [threads] [loops per thread] */
+int main(int argc, char **argv)
+{
+    int threads = (argc > 1) ? atoi(argv[1]) : 4;
+    unsigned long loops = (argc > 2) ? strtoul(argv[2], NULL, 10) : 10000000UL;
+    unsigned long leaked = 0;
+    pthread_t *tids;
+    struct bench_arg_s *args;
+    double start, cost;
+
+    if (threads <= 0 || loops == 0) {
+        fprintf(stderr, "Usage: %s [threads] [loops per thread]\n", argv[0]);
+        return -1;
+    }
+
+    tids = (pthread_t *)calloc(threads, sizeof(pthread_t));
+    args = (struct bench_arg_s *)calloc(threads, sizeof(struct bench_arg_s));
+    if (tids == NULL || args == NULL) {
+        return -1;
+    }
+
+    start = now_sec();
+    for (int i = 0; i < threads; i++) {
+        args[i].loops = loops;
+        args[i].seed = (unsigned int)i + 1;
+        (void)pthread_create(&tids[i], NULL, bench_thread, &args[i]);
+    }
+    for (int i = 0; i < threads; i++) {
+        (void)pthread_join(tids[i], NULL);
+        leaked += args[i].leaked;
+    }
+    cost = now_sec() - start;
+
+    printf("threads %d, loops %lu, leaked %lu, %.3f s, %.1f ns per malloc/free\n",
+        threads, loops, leaked, cost, cost * 1e9 / ((double)loops * threads));
+    free(tids);
+    free(args);
+    return 0;
+}
@@ -0,0 +1,26 @@
+#!/bin/bash
+# Overhead of stackprobe memleak on a malloc heavy workload.
+# Run it once without stackprobe as the baseline, then again with memleak enabled in stackprobe.conf
+# (memleak_sample_bytes > 0 for sampling mode) and the bench process in the whitelist, then compare
+# the ns per malloc/free.
+
+PROJECT_FOLDER=$(dirname $(readlink -f "$0"))
+BENCH=${PROJECT_FOLDER}/memleak_bench
+THREADS=${1:-4}
+LOOPS=${2:-10000000}
+
+function compile_bench()
+{
+    gcc -O2 -pthread ${PROJECT_FOLDER}/memleak_bench.c -o ${BENCH}
+}
+
+function run_bench()
+{
+    echo "==== Begin to bench memleak overhead ===="
+    for i in 1 2 3
+    do
+        ${BENCH} ${THREADS} ${LOOPS}
+    done
+}
+
+compile_bench && run_bench
@@ -0,0 +1,173 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-19
+ * Description: flush time of stackprobe kernel stacks with and without the symbol cache
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "common.h"
+#include "kern_symb.h"
+#include "symb_cache.h"
+
+#define BENCH_LINE_LEN      4096
+#define BENCH_MAX_DEPTH     127     // PERF_MAX_STACK_DEPTH of stackprobe
+
+struct bench_stack_s {
+    u32 depth;
+    u64 ips[BENCH_MAX_DEPTH];
+};
+
+struct bench_profile_s {
+    u32 num;
+    u32 capacity;
+    u64 frames;
+    struct bench_stack_s *stacks;
+};
+
+// kern_symb.c logs errors through it, the probe links the real one
+void error_logs(const char* format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    (void)vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+/* One distinct stack per line, the hex addresses of its frames separated by spaces. */
+static int load_profile(const char *file, struct bench_profile_s *profile)
+{
+    char line[BENCH_LINE_LEN];
+    struct bench_stack_s *stack;
+    char *pos, *end;
+    FILE *fp = fopen(file, "r");
+
+    if (fp == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (profile->num == profile->capacity) {
+            u32 capacity = profile->capacity ? profile->capacity * 2 : 1024;
+            stack = (struct bench_stack_s *)realloc(profile->stacks, capacity * sizeof(struct bench_stack_s));
+            if (stack == NULL) {
+                (void)fclose(fp);
+                return -1;
+            }
+            profile->stacks = stack;
+            profile->capacity = capacity;
+        }
+        stack = &profile->stacks[profile->num];
+        stack->depth = 0;
+        pos = line;
+        while (stack->depth < BENCH_MAX_DEPTH) {
+            u64 ip = strtoull(pos, &end, 16);
+            if (end == pos) {
+                break;
+            }
+            stack->ips[stack->depth++] = ip;
+            pos = end;
+        }
+        if (stack->depth > 0) {
+            profile->frames += stack->depth;
+            profile->num++;
+        }
+    }
+    (void)fclose(fp);
+    return 0;
+}
+
+/* Each flush symbolizes every distinct stack once, as stack_id2histogram() does. */
+static double flush_profile(struct ksymb_tbl_s *ksymbs, const struct bench_profile_s *profile, u64 *unknown)
+{
+    struct addr_symb_s addr_symb;
+    double start = now_sec();
+
+    for (u32 i = 0; i < profile->num; i++) {
+        for (u32 j = 0; j < profile->stacks[i].depth; j++) {
+            if (search_kern_addr_symb(ksymbs, profile->stacks[i].ips[j], &addr_symb) != 0) {
+                (*unknown)++;
+            }
+        }
+    }
+    return now_sec() - start;
+}
+
+static void run_flushes(struct ksymb_tbl_s *ksymbs, const struct bench_profile_s *profile, int flushes)
+{
+    double first, steady = 0;
+    u64 hits = 0, misses = 0, unknown = 0;
+
+    first = flush_profile(ksymbs, profile, &unknown);
+    for (int i = 1; i < flushes; i++) {
+        steady += flush_profile(ksymbs, profile, &unknown);
+    }
+    symb_cache_take_stats(ksymbs->cache, &hits, &misses);
+
+    printf("%-8s first flush %8.3f ms, next flushes %8.3f ms", ksymbs->cache ? "cache" : "no cache",
+        first * 1000, (flushes > 1) ? steady * 1000 / (flushes - 1) : 0);
+    if (ksymbs->cache) {
+        printf(", hits %.1f%%", (hits + misses) ? (double)hits * 100 / (hits + misses) : 0);
+    }
+    printf(", unknown %llu\n", (unsigned long long)unknown / flushes);
+}
+
+/*
+ * Usage: symb_cache_bench <profile> [flushes]
+ * The kernel symbols are loaded from /proc/kallsyms, the profile must be recorded on the same boot.
+ */
+int main(int argc, char **argv)
+{
+    struct bench_profile_s profile = {0};
+    struct ksymb_tbl_s *ksymbs;
+    int flushes = (argc > 2) ? atoi(argv[2]) : 10;
+
+    if (argc < 2 || flushes <= 0) {
+        fprintf(stderr, "Usage: %s <profile> [flushes]\n", argv[0]);
+        return -1;
+    }
+    if (load_profile(argv[1], &profile) || profile.num == 0) {
+        fprintf(stderr, "Load profile %s failed.\n", argv[1]);
+        free(profile.stacks);
+        return -1;
+    }
+
+    ksymbs = create_ksymbs_tbl();
+    if (ksymbs == NULL || load_kern_syms(ksymbs) || sort_kern_syms(ksymbs)) {
+        fprintf(stderr, "Load kernel symbols failed.\n");
+        destroy_ksymbs_tbl(ksymbs);
+        free(ksymbs);
+        free(profile.stacks);
+        return -1;
+    }
+    printf("stacks %u, frames %llu, kernel symbols %u\n", profile.num, (unsigned long long)profile.frames,
+        ksymbs->ksym_size);
+
+    run_flushes(ksymbs, &profile, flushes);
+    symb_cache_free(&ksymbs->cache);
+    run_flushes(ksymbs, &profile, flushes);
+
+    destroy_ksymbs_tbl(ksymbs);
+    free(ksymbs);
+    free(profile.stacks);
+    return 0;
+}
@@ -0,0 +1,48 @@
+#!/bin/bash
+# Flush time of the kernel stacks of stackprobe with and without the symbol cache (common/symb_cache.h).
+# An oncpu profile is recorded system wide by perf while WORKLOAD runs, its distinct kernel stacks are then
+# symbolized once per flush, as stackprobe does every period, first with the cache, then with it dropped.
+# Set PROFILE to reuse a profile, one distinct stack per line, hex addresses separated by spaces.
+# Run as root: [PROFILE=<file>] [WORKLOAD="<command>"] symb_cache_bench.sh [seconds to record] [flushes]
+
+PROJECT_FOLDER=$(dirname $(readlink -f "$0"))
+SRC_FOLDER=${PROJECT_FOLDER}/../../../src
+BENCH=${PROJECT_FOLDER}/symb_cache_bench
+WORKLOAD=${WORKLOAD:-"find / -xdev -type f -newer /etc/hostname -exec cat {} +"}
+SECS=${1:-10}
+FLUSHES=${2:-10}
+PERF_DATA=/tmp/symb_cache_bench.data
+
+function compile_bench()
+{
+    gcc -O2 -I${SRC_FOLDER}/common ${PROJECT_FOLDER}/symb_cache_bench.c ${SRC_FOLDER}/common/kern_symb.c \
+        -o ${BENCH}
+}
+
+function record_profile()
+{
+    [ -n "${PROFILE}" ] && return 0
+    if ! which perf > /dev/null 2>&1; then
+        echo "perf is not installed, set PROFILE to a recorded profile."
+        return 1
+    fi
+
+    PROFILE=/tmp/symb_cache_bench.profile
+    timeout ${SECS} bash -c "while true; do ${WORKLOAD}; done" > /dev/null 2>&1 &
+    perf record -a -g -F 999 -o ${PERF_DATA} -- sleep ${SECS} > /dev/null 2>&1 || return 1
+    wait
+    # one address per line under each sample, a blank line ends the sample; keep the kernel frames
+    perf script -i ${PERF_DATA} -F ip 2>/dev/null | \
+        awk '/^[ \t]*ffff[0-9a-f]+$/ {stack = stack " " $1; next} /^[ \t]*$/ {if (stack != "") print stack; stack = ""}' | \
+        sort -u > ${PROFILE}
+    rm -f ${PERF_DATA}
+    [ -s ${PROFILE} ]
+}
+
+function run_bench()
+{
+    echo "==== Begin to bench symbol cache flush time ===="
+    ${BENCH} ${PROFILE} ${FLUSHES}
+}
+
+compile_bench && record_profile && run_bench
@@ -0,0 +1,150 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-19
+ * Description: time the tcp socket lookup of lib/tcp.c against the number of sockets
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#include "bpf.h"
+#include "tcp.h"
+
+#define BENCH_STEP_MIN      256
+#define BENCH_NEW_PERCENT   1       // connections opened between two lookups of a round
+
+static int g_listen_fd = -1;
+static struct sockaddr_in g_addr;
+
+// lib/tcp.c logs errors through it, the probe links the real one
+void error_logs(const char* format, ...)
+{
+    va_list args;
+
+    va_start(args, format);
+    (void)vfprintf(stderr, format, args);
+    va_end(args);
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec * 1e3 + (double)ts.tv_nsec / 1e6;
+}
+
+static int listen_loopback(void)
+{
+    socklen_t len = sizeof(struct sockaddr_in);
+
+    g_listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (g_listen_fd < 0) {
+        return -1;
+    }
+    (void)memset(&g_addr, 0, sizeof(g_addr));
+    g_addr.sin_family = AF_INET;
+    g_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(g_listen_fd, (struct sockaddr *)&g_addr, len) || listen(g_listen_fd, SOMAXCONN) ||
+        getsockname(g_listen_fd, (struct sockaddr *)&g_addr, &len)) {
+        return -1;
+    }
+    return 0;
+}
+
+// Both ends are kept open by this process, 2 sockets for each connection
+static int open_conns(int num)
+{
+    int fd;
+
+    for (int i = 0; i < num; i++) {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0 || connect(fd, (const struct sockaddr *)&g_addr, sizeof(g_addr)) ||
+            accept(g_listen_fd, NULL, NULL) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// The same calls as tcpprobe makes in each round
+static double lookup_ms(unsigned int *found)
+{
+    struct tcp_listen_ports *tlps;
+    struct tcp_estabs *tes;
+    double start = now_ms();
+
+    *found = 0;
+    tlps = get_listen_ports();
+    if (tlps == NULL) {
+        return -1;
+    }
+    tes = get_estab_tcps(tlps);
+    if (tes != NULL) {
+        *found = tes->te_num;
+        free_estab_tcps(&tes);
+    }
+    free_listen_ports(&tlps);
+    return now_ms() - start;
+}
+
+/*
+ * Usage: sock_index_bench [max connections]
+ * For each number of connections prints the time of a round after they are all opened (cold), of a
+ * round without any new socket (steady), and of a round after 1% more are opened (new).
+ */
+int main(int argc, char **argv)
+{
+    int max_conns = (argc > 1) ? atoi(argv[1]) : 16384;
+    struct rlimit rlim;
+    unsigned int found;
+    int conns = 0, step, new_conns;
+    double cold, steady, new_ms;
+
+    if (max_conns <= 0) {
+        fprintf(stderr, "Usage: %s [max connections]\n", argv[0]);
+        return -1;
+    }
+    if (getrlimit(RLIMIT_NOFILE, &rlim) == 0) {
+        rlim.rlim_cur = rlim.rlim_max;
+        (void)setrlimit(RLIMIT_NOFILE, &rlim);
+    }
+    if (listen_loopback()) {
+        fprintf(stderr, "Listen on loopback failed.\n");
+        return -1;
+    }
+
+    printf("%10s %10s %12s %12s %12s\n", "sockets", "reported", "cold(ms)", "steady(ms)", "new(ms)");
+    for (step = BENCH_STEP_MIN; step <= max_conns; step *= 2) {
+        if (open_conns(step - conns)) {
+            fprintf(stderr, "Open connections failed at %d, raise the fd limit.\n", conns);
+            return -1;
+        }
+        conns = step;
+        cold = lookup_ms(&found);
+        steady = lookup_ms(&found);
+
+        new_conns = (conns * BENCH_NEW_PERCENT + 99) / 100;
+        if (open_conns(new_conns)) {
+            fprintf(stderr, "Open connections failed at %d, raise the fd limit.\n", conns);
+            return -1;
+        }
+        conns += new_conns;
+        new_ms = lookup_ms(&found);
+        printf("%10d %10u %12.1f %12.1f %12.1f\n", 2 * conns, found, cold, steady, new_ms);
+        (void)fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,36 @@
+#!/bin/bash
+# Time of the tcp socket lookup (lib/tcp.c, owners resolved through /proc/<pid>/fd) against the number of
+# sockets. Loopback connections are opened by the bench itself, each round dumps the listening and
+# established sockets like tcpprobe does. Set BASE_TCP_C to another version of tcp.c to compare with, e.g.
+#   git show <commit>:src/probes/extends/ebpf.probe/src/lib/tcp.c > /tmp/tcp_base.c
+# Run as root: [BASE_TCP_C=/tmp/tcp_base.c] sock_index_bench.sh [max connections]
+
+PROJECT_FOLDER=$(dirname $(readlink -f "$0"))
+SRC_FOLDER=${PROJECT_FOLDER}/../../../src
+EBPF_SRC_FOLDER=${SRC_FOLDER}/probes/extends/ebpf.probe/src
+BENCH=${PROJECT_FOLDER}/sock_index_bench
+MAX_CONNS=${1:-16384}
+
+function compile_bench()
+{
+    local tcp_c=$1
+    local out=$2
+
+    gcc -O2 -I${EBPF_SRC_FOLDER}/include -I${SRC_FOLDER}/common ${PROJECT_FOLDER}/sock_index_bench.c \
+        ${tcp_c} ${SRC_FOLDER}/common/util.c -o ${out}
+}
+
+function run_bench()
+{
+    echo "==== Begin to bench socket lookup, lib/tcp.c ===="
+    compile_bench ${EBPF_SRC_FOLDER}/lib/tcp.c ${BENCH} || return 1
+    ${BENCH} ${MAX_CONNS} || return 1
+
+    [ -z "${BASE_TCP_C}" ] && return 0
+    echo "==== Begin to bench socket lookup, ${BASE_TCP_C} ===="
+    compile_bench ${BASE_TCP_C} ${BENCH}_base || return 1
+    ${BENCH}_base ${MAX_CONNS} || return 1
+    return 0
+}
+
+run_bench
@@ -0,0 +1,197 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: loopback tcp traffic from threads on every CPU to check the per-CPU tx/rx of tcpprobe
+ ******************************************************************************/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define BENCH_BUF_SIZE      (16 * 1024)
+#define BENCH_MB            (1024UL * 1024UL)
+
+struct bench_arg_s {
+    int fd;
+    int cpu;
+    int is_recv;
+    unsigned long long bytes;   // to send
+    unsigned long long done;
+};
+
+static void bind_cpu(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    (void)pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void *bench_thread(void *arg)
+{
+    struct bench_arg_s *bench = (struct bench_arg_s *)arg;
+    char buf[BENCH_BUF_SIZE];
+    size_t len;
+    ssize_t ret;
+
+    bind_cpu(bench->cpu);
+    (void)memset(buf, bench->cpu & 0xff, sizeof(buf));
+
+    if (bench->is_recv) {
+        while ((ret = recv(bench->fd, buf, sizeof(buf), 0)) > 0) {
+            bench->done += (unsigned long long)ret;
+        }
+    } else {
+        while (bench->done < bench->bytes) {
+            len = sizeof(buf);
+            if (bench->bytes - bench->done < len) {
+                len = (size_t)(bench->bytes - bench->done);
+            }
+            ret = send(bench->fd, buf, len, 0);
+            if (ret <= 0) {
+                break;
+            }
+            bench->done += (unsigned long long)ret;
+        }
+        (void)shutdown(bench->fd, SHUT_WR);
+    }
+    return NULL;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int listen_loopback(struct sockaddr_in *addr)
+{
+    socklen_t len = sizeof(struct sockaddr_in);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (fd < 0) {
+        return -1;
+    }
+    (void)memset(addr, 0, sizeof(struct sockaddr_in));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)addr, len) || listen(fd, SOMAXCONN) ||
+        getsockname(fd, (struct sockaddr *)addr, &len)) {
+        (void)close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * One pair of threads per connection, the sender and the receiver run on different CPUs.
+ * Return 0 if all the connections are set up.
+ */
+static int setup_conns(int listen_fd, const struct sockaddr_in *addr, struct bench_arg_s *args, int conns, int cpus,
+    unsigned long long bytes)
+{
+    for (int i = 0; i < conns; i++) {
+        struct bench_arg_s *sender = &args[2 * i];
+        struct bench_arg_s *receiver = &args[2 * i + 1];
+
+        sender->fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (sender->fd < 0 || connect(sender->fd, (const struct sockaddr *)addr, sizeof(struct sockaddr_in))) {
+            return -1;
+        }
+        receiver->fd = accept(listen_fd, NULL, NULL);
+        if (receiver->fd < 0) {
+            return -1;
+        }
+        sender->cpu = (2 * i) % cpus;
+        sender->bytes = bytes;
+        receiver->cpu = (2 * i + 1) % cpus;
+        receiver->is_recv = 1;
+    }
+    return 0;
+}
+
+/*
+ * Usage: tcp_bytes_bench [connections] [MB per connection]
+ * The last line is "generated <pid> <rx bytes> <tx bytes>", the totals tcp_link should report for the pid.
+ */
+int main(int argc, char **argv)
+{
+    int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int conns = (argc > 1) ? atoi(argv[1]) : cpus;
+    unsigned long long bytes = ((argc > 2) ? strtoull(argv[2], NULL, 10) : 256ULL) * BENCH_MB;
+    unsigned long long tx = 0, rx = 0;
+    struct sockaddr_in addr;
+    struct bench_arg_s *args;
+    pthread_t *tids;
+    double start, cost;
+    int listen_fd, ret = -1;
+
+    if (conns <= 0 || bytes == 0 || cpus <= 0) {
+        fprintf(stderr, "Usage: %s [connections] [MB per connection]\n", argv[0]);
+        return -1;
+    }
+
+    listen_fd = listen_loopback(&addr);
+    tids = (pthread_t *)calloc(2 * conns, sizeof(pthread_t));
+    args = (struct bench_arg_s *)calloc(2 * conns, sizeof(struct bench_arg_s));
+    if (listen_fd < 0 || tids == NULL || args == NULL) {
+        goto out;
+    }
+    for (int i = 0; i < 2 * conns; i++) {
+        args[i].fd = -1;
+    }
+    if (setup_conns(listen_fd, &addr, args, conns, cpus, bytes)) {
+        fprintf(stderr, "Setup connections failed.\n");
+        goto out;
+    }
+
+    start = now_sec();
+    for (int i = 0; i < 2 * conns; i++) {
+        (void)pthread_create(&tids[i], NULL, bench_thread, &args[i]);
+    }
+    for (int i = 0; i < 2 * conns; i++) {
+        (void)pthread_join(tids[i], NULL);
+        if (args[i].is_recv) {
+            rx += args[i].done;
+        } else {
+            tx += args[i].done;
+        }
+    }
+    cost = now_sec() - start;
+
+    printf("connections %d, bytes %llu, %.3f s, %.1f MB/s\n", conns, tx, cost, (double)tx / BENCH_MB / cost);
+    printf("generated %d %llu %llu\n", (int)getpid(), rx, tx);
+    ret = 0;
+out:
+    for (int i = 0; args != NULL && i < 2 * conns; i++) {
+        if (args[i].fd >= 0) {
+            (void)close(args[i].fd);
+        }
+    }
+    if (listen_fd >= 0) {
+        (void)close(listen_fd);
+    }
+    free(tids);
+    free(args);
+    return ret;
+}
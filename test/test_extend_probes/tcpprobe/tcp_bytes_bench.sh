@@ -0,0 +1,58 @@
+#!/bin/bash
+# Accuracy and overhead of the per-CPU tx/rx bytes of tcpprobe under traffic from every CPU.
+# Loopback connections are driven by threads bound to all CPUs, once without tcpprobe as the baseline and
+# once with it. The rx/tx bytes tcp_link reports for the bench process, including the final metrics output
+# when the links close, must equal the bytes generated.
+# Run as root: tcp_bytes_bench.sh [connections] [MB per connection]
+
+PROJECT_FOLDER=$(dirname $(readlink -f "$0"))
+BENCH=${PROJECT_FOLDER}/tcp_bytes_bench
+TCPPROBE=${TCPPROBE:-/opt/gala-gopher/extend_probes/tcpprobe}
+CONNS=${1:-$(nproc)}
+MB=${2:-256}
+OUT=/tmp/tcp_bytes_bench.out
+
+function compile_bench()
+{
+    gcc -O2 -pthread ${PROJECT_FOLDER}/tcp_bytes_bench.c -o ${BENCH}
+}
+
+function cleanup()
+{
+    [ -n "${PROBE_PID}" ] && kill ${PROBE_PID} 2>/dev/null
+}
+
+function run_bench()
+{
+    local generated pid reported
+
+    echo "==== Begin to bench tcp bytes, baseline ===="
+    ${BENCH} ${CONNS} ${MB} || return 1
+
+    echo "==== Begin to bench tcp bytes, with tcpprobe ===="
+    # -P 8: tx/rx only
+    ${TCPPROBE} -t 1 -P 8 > ${OUT} 2>&1 &
+    PROBE_PID=$!
+    sleep 5
+    generated=$(${BENCH} ${CONNS} ${MB} | tee /dev/stderr | awk '/^generated/ {print $2, $3, $4}')
+    sleep 3
+    kill ${PROBE_PID} 2>/dev/null
+    wait ${PROBE_PID} 2>/dev/null
+    PROBE_PID=""
+
+    pid=${generated%% *}
+    generated=${generated#* }
+    reported=$(awk -F'|' -v pid=${pid} \
+        '$2 == "tcp_link" && $3 == pid {rx += $10; tx += $11} END {printf "%.0f %.0f", rx, tx}' ${OUT})
+
+    echo "generated rx/tx bytes: ${generated}, reported: ${reported}"
+    if [ -z "${generated}" ] || [ "${generated}" != "${reported}" ]; then
+        echo "==== tcp bytes FAILED ===="
+        return 1
+    fi
+    echo "==== tcp bytes PASSED ===="
+    return 0
+}
+
+trap cleanup EXIT
+compile_bench && run_bench
@@ -0,0 +1,91 @@
+#!/bin/bash
+# Overhead of tcpprobe with all the sub-probes on, loopback traffic in the style of netperf TCP_RR and iperf.
+# tcp_rr_bench ping-pongs 64 bytes messages, one segment each, so the per-packet cost of the hooks shows;
+# tcp_bytes_bench streams bulk data. Each runs once without tcpprobe as the baseline, once with TCPPROBE and,
+# if BASE_TCPPROBE is given, once with it, e.g. a tcpprobe built from the layout with one bpf object per
+# sub-probe. The single object must not cost more than the old layout by over TOLERANCE percent.
+# Run as root: tcp_overhead_bench.sh [connections] [seconds per TCP_RR run] [MB per connection]
+
+PROJECT_FOLDER=$(dirname $(readlink -f "$0"))
+RR_BENCH=${PROJECT_FOLDER}/tcp_rr_bench
+BYTES_BENCH=${PROJECT_FOLDER}/tcp_bytes_bench
+TCPPROBE=${TCPPROBE:-/opt/gala-gopher/extend_probes/tcpprobe}
+BASE_TCPPROBE=${BASE_TCPPROBE:-}
+TOLERANCE=${TOLERANCE:-2}
+CONNS=${1:-$(nproc)}
+SECONDS_RR=${2:-10}
+MB=${3:-256}
+# abn | windows | rtt | txrx | sockbuf | rate | srtt | rtt2, TCP_PROBE_ALL
+PROBE_ALL=383
+OUT=/tmp/tcp_overhead_bench.out
+
+function compile_bench()
+{
+    gcc -O2 -pthread ${PROJECT_FOLDER}/tcp_rr_bench.c -o ${RR_BENCH} && \
+    gcc -O2 -pthread ${PROJECT_FOLDER}/tcp_bytes_bench.c -o ${BYTES_BENCH}
+}
+
+function cleanup()
+{
+    [ -n "${PROBE_PID}" ] && kill ${PROBE_PID} 2>/dev/null
+}
+
+# run_once <probe or empty>, sets RR (transactions/s) and BW (MB/s)
+function run_once()
+{
+    if [ -n "$1" ]; then
+        $1 -t 1 -P ${PROBE_ALL} > ${OUT} 2>&1 &
+        PROBE_PID=$!
+        sleep 5
+    fi
+    RR=$(${RR_BENCH} ${CONNS} ${SECONDS_RR} | awk '/^transactions/ {print $3}')
+    BW=$(${BYTES_BENCH} ${CONNS} ${MB} | awk '/^connections/ {print $(NF - 1)}')
+    if [ -n "$1" ]; then
+        kill ${PROBE_PID} 2>/dev/null
+        wait ${PROBE_PID} 2>/dev/null
+        PROBE_PID=""
+    fi
+    [ -n "${RR}" ] && [ -n "${BW}" ]
+}
+
+# overhead <baseline> <value>, in percent
+function overhead()
+{
+    awk -v b=$1 -v v=$2 'BEGIN {printf "%.1f", (b - v) * 100 / b}'
+}
+
+function run_bench()
+{
+    local base_rr base_bw rr_ovh bw_ovh old_rr_ovh old_bw_ovh
+
+    echo "==== Begin to bench tcpprobe overhead, baseline ===="
+    run_once "" || return 1
+    base_rr=${RR}
+    base_bw=${BW}
+    echo "TCP_RR ${base_rr} trans/s, stream ${base_bw} MB/s"
+
+    if [ -n "${BASE_TCPPROBE}" ]; then
+        echo "==== Begin to bench tcpprobe overhead, with ${BASE_TCPPROBE} ===="
+        run_once ${BASE_TCPPROBE} || return 1
+        old_rr_ovh=$(overhead ${base_rr} ${RR})
+        old_bw_ovh=$(overhead ${base_bw} ${BW})
+        echo "TCP_RR ${RR} trans/s (${old_rr_ovh}%), stream ${BW} MB/s (${old_bw_ovh}%)"
+    fi
+
+    echo "==== Begin to bench tcpprobe overhead, with ${TCPPROBE} ===="
+    run_once ${TCPPROBE} || return 1
+    rr_ovh=$(overhead ${base_rr} ${RR})
+    bw_ovh=$(overhead ${base_bw} ${BW})
+    echo "TCP_RR ${RR} trans/s (${rr_ovh}%), stream ${BW} MB/s (${bw_ovh}%)"
+
+    if [ -n "${BASE_TCPPROBE}" ] && \
+        awk -v n=${rr_ovh} -v o=${old_rr_ovh} -v t=${TOLERANCE} 'BEGIN {exit !(n > o + t)}'; then
+        echo "==== tcpprobe overhead FAILED ===="
+        return 1
+    fi
+    echo "==== tcpprobe overhead PASSED ===="
+    return 0
+}
+
+trap cleanup EXIT
+compile_bench && run_bench
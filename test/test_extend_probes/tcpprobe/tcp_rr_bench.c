@@ -0,0 +1,215 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2022. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-19
+ * Description: loopback tcp request/response ping-pong to measure the per-packet overhead of tcpprobe
+ ******************************************************************************/
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define BENCH_MSG_SIZE      64
+
+struct bench_arg_s {
+    int fd;
+    int cpu;
+    int is_server;
+    double duration;            // seconds the client runs
+    unsigned long long trans;   // request/response pairs done
+};
+
+static void bind_cpu(int cpu)
+{
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    (void)pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    (void)clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static int recv_msg(int fd, char *buf)
+{
+    size_t done = 0;
+    ssize_t ret;
+
+    while (done < BENCH_MSG_SIZE) {
+        ret = recv(fd, buf + done, BENCH_MSG_SIZE - done, 0);
+        if (ret <= 0) {
+            return -1;
+        }
+        done += (size_t)ret;
+    }
+    return 0;
+}
+
+/* The server echoes every request until the client shuts down, the client checks the clock every 1024 requests. */
+static void *bench_thread(void *arg)
+{
+    struct bench_arg_s *bench = (struct bench_arg_s *)arg;
+    char buf[BENCH_MSG_SIZE];
+    double end;
+
+    bind_cpu(bench->cpu);
+    (void)memset(buf, bench->cpu & 0xff, sizeof(buf));
+
+    if (bench->is_server) {
+        while (recv_msg(bench->fd, buf) == 0) {
+            if (send(bench->fd, buf, sizeof(buf), 0) != (ssize_t)sizeof(buf)) {
+                break;
+            }
+            bench->trans++;
+        }
+        return NULL;
+    }
+
+    end = now_sec() + bench->duration;
+    while ((bench->trans & 0x3ff) != 0 || now_sec() < end) {
+        if (send(bench->fd, buf, sizeof(buf), 0) != (ssize_t)sizeof(buf) || recv_msg(bench->fd, buf)) {
+            break;
+        }
+        bench->trans++;
+    }
+    (void)shutdown(bench->fd, SHUT_WR);
+    return NULL;
+}
+
+static int listen_loopback(struct sockaddr_in *addr)
+{
+    socklen_t len = sizeof(struct sockaddr_in);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+
+    if (fd < 0) {
+        return -1;
+    }
+    (void)memset(addr, 0, sizeof(struct sockaddr_in));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *)addr, len) || listen(fd, SOMAXCONN) ||
+        getsockname(fd, (struct sockaddr *)addr, &len)) {
+        (void)close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * One pair of threads per connection, the client and the server run on different CPUs.
+ * Nagle is off on both ends, every message is a segment of its own.
+ * Return 0 if all the connections are set up.
+ */
+static int setup_conns(int listen_fd, const struct sockaddr_in *addr, struct bench_arg_s *args, int conns, int cpus,
+    double duration)
+{
+    int on = 1;
+
+    for (int i = 0; i < conns; i++) {
+        struct bench_arg_s *client = &args[2 * i];
+        struct bench_arg_s *server = &args[2 * i + 1];
+
+        client->fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (client->fd < 0 || connect(client->fd, (const struct sockaddr *)addr, sizeof(struct sockaddr_in))) {
+            return -1;
+        }
+        server->fd = accept(listen_fd, NULL, NULL);
+        if (server->fd < 0) {
+            return -1;
+        }
+        (void)setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        (void)setsockopt(server->fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        client->cpu = (2 * i) % cpus;
+        client->duration = duration;
+        server->cpu = (2 * i + 1) % cpus;
+        server->is_server = 1;
+    }
+    return 0;
+}
+
+/*
+ * Usage: tcp_rr_bench [connections] [seconds]
+ * The last line is "transactions <total> <per second>".
+ */
+int main(int argc, char **argv)
+{
+    int cpus = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int conns = (argc > 1) ? atoi(argv[1]) : cpus;
+    double duration = (argc > 2) ? atof(argv[2]) : 10.0;
+    unsigned long long trans = 0;
+    struct sockaddr_in addr;
+    struct bench_arg_s *args;
+    pthread_t *tids;
+    double start, cost;
+    int listen_fd, ret = -1;
+
+    if (conns <= 0 || duration <= 0 || cpus <= 0) {
+        fprintf(stderr, "Usage: %s [connections] [seconds]\n", argv[0]);
+        return -1;
+    }
+
+    listen_fd = listen_loopback(&addr);
+    tids = (pthread_t *)calloc(2 * conns, sizeof(pthread_t));
+    args = (struct bench_arg_s *)calloc(2 * conns, sizeof(struct bench_arg_s));
+    if (listen_fd < 0 || tids == NULL || args == NULL) {
+        goto out;
+    }
+    for (int i = 0; i < 2 * conns; i++) {
+        args[i].fd = -1;
+    }
+    if (setup_conns(listen_fd, &addr, args, conns, cpus, duration)) {
+        fprintf(stderr, "Setup connections failed.\n");
+        goto out;
+    }
+
+    start = now_sec();
+    for (int i = 0; i < 2 * conns; i++) {
+        (void)pthread_create(&tids[i], NULL, bench_thread, &args[i]);
+    }
+    for (int i = 0; i < 2 * conns; i++) {
+        (void)pthread_join(tids[i], NULL);
+        if (!args[i].is_server) {
+            trans += args[i].trans;
+        }
+    }
+    cost = now_sec() - start;
+
+    printf("connections %d, %.3f s\n", conns, cost);
+    printf("transactions %llu %.0f\n", trans, (double)trans / cost);
+    ret = 0;
+out:
+    for (int i = 0; args != NULL && i < 2 * conns; i++) {
+        if (args[i].fd >= 0) {
+            (void)close(args[i].fd);
+        }
+    }
+    if (listen_fd >= 0) {
+        (void)close(listen_fd);
+    }
+    free(tids);
+    free(args);
+    return ret;
+}
@@ -24,6 +24,8 @@
 #include "test_probe.h"
 #include "test_imdb.h"
 #include "test_logs.h"
+#include "test_qsketch.h"
+#include "test_sli_histo.h"
 
 typedef struct {
     char *suiteName;
@@ -36,7 +38,9 @@ TestSuite gTestSuites[] = {
     TEST_SUITE_META,
     TEST_SUITE_PROBE,
     TEST_SUITE_IMDB,
-    TEST_SUITE_LOGS
+    TEST_SUITE_LOGS,
+    TEST_SUITE_QSKETCH,
+    TEST_SUITE_SLI_HISTO
 };
 
 int main(int argc, char *argv[])
@@ -0,0 +1,262 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2023. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-18
+ * Description: provide gala-gopher test
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <CUnit/Basic.h>
+
+#include "qsketch.h"
+#include "test_qsketch.h"
+
+#define VALUE_NUM       100000
+#define MERGE_NUM       100
+
+static const double g_quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+// relative error bound at the current scale of the sketch: (base - 1) / (base + 1)
+static double QsketchErrBound(const struct qsketch_s *sk)
+{
+    double base = qsketch_bucket_lower(sk->scale, 1);
+    return (base - 1) / (base + 1) + 1e-9;
+}
+
+static double RelErr(double v, double expect)
+{
+    double diff = (v > expect) ? (v - expect) : (expect - v);
+    return diff / expect;
+}
+
+static void TestQsketchNew(void)
+{
+    struct qsketch_s *sk = qsketch_new(QSKETCH_SCALE_DEFAULT, 0);
+
+    CU_ASSERT(sk != NULL);
+    CU_ASSERT(sk->scale == QSKETCH_SCALE_DEFAULT);
+    CU_ASSERT(sk->max_buckets == QSKETCH_BUCKETS_DEFAULT);
+    CU_ASSERT(sk->count == 0);
+    CU_ASSERT(sk->len == 0);
+    CU_ASSERT(qsketch_quantile(sk, 0.5) == 0);
+    qsketch_free(sk);
+
+    sk = qsketch_new(QSKETCH_SCALE_MAX + 1, 1);
+    CU_ASSERT(sk != NULL);
+    CU_ASSERT(sk->scale == QSKETCH_SCALE_MAX);
+    CU_ASSERT(sk->max_buckets == QSKETCH_BUCKETS_MIN);
+    qsketch_free(sk);
+}
+
+static void TestQsketchBucket(void)
+{
+    struct qsketch_s *sk = qsketch_new(0, 0);
+
+    // scale 0: bucket i is (2^i, 2^(i+1)], a power of 2 is the upper bound
+    CU_ASSERT(qsketch_bucket_lower(0, 3) == 8.0);
+    CU_ASSERT(qsketch_bucket_lower(2, 4) == 2.0);
+    CU_ASSERT(qsketch_bucket_lower(-1, 1) == 4.0);
+    qsketch_add(sk, 8.0);
+    CU_ASSERT(sk->offset == 2);
+    qsketch_add(sk, 8.5);
+    CU_ASSERT(sk->offset == 2);
+    CU_ASSERT(sk->len == 2);
+    CU_ASSERT(sk->counts[0] == 1);
+    CU_ASSERT(sk->counts[1] == 1);
+    qsketch_free(sk);
+}
+
+static void TestQsketchQuantile(void)
+{
+    struct qsketch_s *sk = qsketch_new(QSKETCH_SCALE_DEFAULT, 0);
+    double expect, err;
+
+    CU_ASSERT(sk != NULL);
+    for (int i = 1; i <= VALUE_NUM; i++) {
+        qsketch_add(sk, (double)i * 1000);
+    }
+
+    CU_ASSERT(sk->count == VALUE_NUM);
+    CU_ASSERT(sk->min == 1000);
+    CU_ASSERT(sk->max == (double)VALUE_NUM * 1000);
+    CU_ASSERT(sk->len <= sk->max_buckets);
+    // 17 powers of 2 do not fit in at scale 6, so it is reduced
+    CU_ASSERT(sk->scale < QSKETCH_SCALE_DEFAULT);
+
+    err = QsketchErrBound(sk);
+    for (int i = 0; i < sizeof(g_quantiles) / sizeof(g_quantiles[0]); i++) {
+        expect = (1 + g_quantiles[i] * (VALUE_NUM - 1)) * 1000;
+        CU_ASSERT(RelErr(qsketch_quantile(sk, g_quantiles[i]), expect) <= err);
+    }
+    CU_ASSERT(qsketch_quantile(sk, 0) == 1000);
+    CU_ASSERT(qsketch_quantile(sk, 1) == (double)VALUE_NUM * 1000);
+
+    qsketch_reset(sk);
+    CU_ASSERT(sk->count == 0);
+    CU_ASSERT(sk->len == 0);
+    CU_ASSERT(sk->scale == QSKETCH_SCALE_DEFAULT);
+    qsketch_free(sk);
+}
+
+static void TestQsketchZero(void)
+{
+    struct qsketch_s *sk = qsketch_new(QSKETCH_SCALE_DEFAULT, 0);
+
+    qsketch_add_n(sk, 0, 90);
+    qsketch_add_n(sk, -1, 5);
+    qsketch_add_n(sk, 1000, 5);
+    qsketch_add(sk, 1.0 / 0.0);
+    CU_ASSERT(sk->count == 100);
+    CU_ASSERT(sk->zero_count == 95);
+    CU_ASSERT(qsketch_quantile(sk, 0.5) == 0);
+    CU_ASSERT(RelErr(qsketch_quantile(sk, 0.99), 1000) <= QsketchErrBound(sk));
+
+    CU_ASSERT(qsketch_count_le(sk, 0) == 95);
+    CU_ASSERT(qsketch_count_le(sk, 999) == 95);
+    CU_ASSERT(qsketch_count_le(sk, 1000) == 100);
+    CU_ASSERT(qsketch_count_le(sk, -1) == 0);
+    qsketch_free(sk);
+}
+
+static void TestQsketchMerge(void)
+{
+    struct qsketch_s *all = qsketch_new(QSKETCH_SCALE_DEFAULT, 0);
+    struct qsketch_s *a = qsketch_new(QSKETCH_SCALE_MAX, 0);
+    struct qsketch_s *b = qsketch_new(QSKETCH_SCALE_DEFAULT, 0);
+    u64 sum_a = 0, sum_all = 0;
+
+    for (int i = 1; i <= VALUE_NUM; i++) {
+        qsketch_add(all, (double)i * 1000);
+        qsketch_add(((i & 1) != 0) ? a : b, (double)i * 1000);
+    }
+    // a keeps the odd values in a narrower range at a finer scale before they are merged
+    CU_ASSERT(qsketch_merge(a, b) == 0);
+
+    CU_ASSERT(a->count == all->count);
+    CU_ASSERT(a->sum == all->sum);
+    CU_ASSERT(a->min == all->min);
+    CU_ASSERT(a->max == all->max);
+    CU_ASSERT(a->len <= a->max_buckets);
+    for (u32 i = 0; i < a->len; i++) {
+        sum_a += a->counts[i];
+    }
+    for (u32 i = 0; i < all->len; i++) {
+        sum_all += all->counts[i];
+    }
+    CU_ASSERT(sum_a == sum_all);
+
+    for (int i = 0; i < sizeof(g_quantiles) / sizeof(g_quantiles[0]); i++) {
+        double expect = (1 + g_quantiles[i] * (VALUE_NUM - 1)) * 1000;
+        CU_ASSERT(RelErr(qsketch_quantile(a, g_quantiles[i]), expect) <= QsketchErrBound(a));
+    }
+
+    // merging an empty sketch changes nothing
+    qsketch_reset(b);
+    CU_ASSERT(qsketch_merge(a, b) == 0);
+    CU_ASSERT(a->count == all->count);
+
+    qsketch_free(all);
+    qsketch_free(a);
+    qsketch_free(b);
+}
+
+static void TestQsketchSerialize(void)
+{
+    struct qsketch_s *sk = qsketch_new(QSKETCH_SCALE_DEFAULT, 0);
+    struct qsketch_s *dup;
+    unsigned char buf[QSKETCH_SER_MAX(QSKETCH_BUCKETS_DEFAULT)];
+    char str[QSKETCH_STR_MAX(QSKETCH_BUCKETS_DEFAULT)];
+    int len;
+
+    for (int i = 1; i <= VALUE_NUM; i++) {
+        qsketch_add(sk, (double)i * 1000);
+    }
+    qsketch_add(sk, 0);
+
+    len = qsketch_serialize(sk, buf, sizeof(buf));
+    CU_ASSERT(len > 0);
+    // varint counts, much smaller than the buckets in memory
+    CU_ASSERT(len < sk->len * sizeof(u64));
+    CU_ASSERT(qsketch_serialize(sk, buf, 10) == -1);
+
+    dup = qsketch_deserialize(buf, (size_t)len, 0);
+    CU_ASSERT(dup != NULL);
+    CU_ASSERT(dup->scale == sk->scale);
+    CU_ASSERT(dup->offset == sk->offset);
+    CU_ASSERT(dup->len == sk->len);
+    CU_ASSERT(dup->count == sk->count);
+    CU_ASSERT(dup->zero_count == sk->zero_count);
+    CU_ASSERT(dup->sum == sk->sum);
+    CU_ASSERT(dup->min == sk->min);
+    CU_ASSERT(dup->max == sk->max);
+    CU_ASSERT(memcmp(dup->counts, sk->counts, sk->len * sizeof(u64)) == 0);
+    qsketch_free(dup);
+
+    CU_ASSERT(qsketch_deserialize(buf, (size_t)len / 2, 0) == NULL);
+
+    len = qsketch_to_str(sk, str, sizeof(str));
+    CU_ASSERT(len > 0);
+    CU_ASSERT(strchr(str, '|') == NULL);
+    dup = qsketch_from_str(str, 0);
+    CU_ASSERT(dup != NULL);
+    CU_ASSERT(dup->count == sk->count);
+    CU_ASSERT(qsketch_quantile(dup, 0.99) == qsketch_quantile(sk, 0.99));
+    qsketch_free(dup);
+
+    CU_ASSERT(qsketch_from_str("not|base64", 0) == NULL);
+    qsketch_free(sk);
+}
+
+// Wide range of values added and merged many times, the bucket limit holds and the quantiles stay
+static void TestQsketchAddMerge(void)
+{
+    struct qsketch_s *sk = qsketch_new(QSKETCH_SCALE_DEFAULT, 0);
+    struct qsketch_s *dst = qsketch_new(QSKETCH_SCALE_DEFAULT, 0);
+    u64 v = 88172645463325252ULL;
+
+    CU_ASSERT_FATAL(sk != NULL && dst != NULL);
+
+    for (int i = 0; i < VALUE_NUM; i++) {
+        // xorshift, latencies of 1us ~ 1s
+        v ^= v << 13;
+        v ^= v >> 7;
+        v ^= v << 17;
+        qsketch_add(sk, (double)(1000 + v % 1000000000));
+    }
+    CU_ASSERT(sk->count == VALUE_NUM);
+    CU_ASSERT(sk->len <= sk->max_buckets);
+
+    for (int i = 0; i < MERGE_NUM; i++) {
+        CU_ASSERT(qsketch_merge(dst, sk) == 0);
+    }
+    CU_ASSERT(dst->count == sk->count * MERGE_NUM);
+    CU_ASSERT(dst->scale == sk->scale);
+    CU_ASSERT(dst->min == sk->min);
+    CU_ASSERT(dst->max == sk->max);
+    for (int i = 0; i < sizeof(g_quantiles) / sizeof(g_quantiles[0]); i++) {
+        CU_ASSERT(qsketch_quantile(dst, g_quantiles[i]) == qsketch_quantile(sk, g_quantiles[i]));
+    }
+
+    qsketch_free(sk);
+    qsketch_free(dst);
+}
+
+void TestQsketchMain(CU_pSuite suite)
+{
+    CU_ADD_TEST(suite, TestQsketchNew);
+    CU_ADD_TEST(suite, TestQsketchBucket);
+    CU_ADD_TEST(suite, TestQsketchQuantile);
+    CU_ADD_TEST(suite, TestQsketchZero);
+    CU_ADD_TEST(suite, TestQsketchMerge);
+    CU_ADD_TEST(suite, TestQsketchSerialize);
+    CU_ADD_TEST(suite, TestQsketchAddMerge);
+}
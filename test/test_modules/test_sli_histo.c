@@ -0,0 +1,133 @@
+/******************************************************************************
+ * Copyright (c) Huawei Technologies Co., Ltd. 2023. All rights reserved.
+ * gala-gopher licensed under the Mulan PSL v2.
+ * You can use this software according to the terms and conditions of the Mulan PSL v2.
+ * You may obtain a copy of Mulan PSL v2 at:
+ *     http://license.coscl.org.cn/MulanPSL2
+ * THIS SOFTWARE IS PROVIDED ON AN "AS IS" BASIS, WITHOUT WARRANTIES OF ANY KIND, EITHER EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO NON-INFRINGEMENT, MERCHANTABILITY OR FIT FOR A PARTICULAR
+ * PURPOSE.
+ * See the Mulan PSL v2 for more details.
+ * Author: agent
+ * Create: 2026-10-19
+ * Description: provide gala-gopher test
+ ******************************************************************************/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <CUnit/Basic.h>
+
+#include "bpf.h"
+#include "sli_histo.h"
+#include "test_sli_histo.h"
+
+#define VALUE_NUM       10000
+#define VALUE_STEP      10000   // unit ns, values of 10us ~ 100ms
+#define UNIT            (1ULL << SLI_HISTO_UNIT_SHIFT)
+
+static const double g_quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+static struct sli_histo_s g_histo;
+static struct sli_histo_s g_percpu[2];
+
+// the same as sli_histo_record() in kernel
+static void HistoRecord(struct sli_histo_s *histo, __u64 nsec)
+{
+    histo->count++;
+    histo->sum += nsec;
+    if (histo->max < nsec) {
+        histo->max = nsec;
+    }
+    histo->buckets[sli_histo_bucket(nsec)]++;
+}
+
+static double RelErr(double v, double expect)
+{
+    double diff = (v > expect) ? (v - expect) : (expect - v);
+    return diff / expect;
+}
+
+static void TestSliHistoBucket(void)
+{
+    // one bucket for each unit below SLI_HISTO_SUB_NUM units
+    CU_ASSERT(sli_histo_bucket(0) == 0);
+    CU_ASSERT(sli_histo_bucket(UNIT - 1) == 0);
+    CU_ASSERT(sli_histo_bucket(UNIT) == 1);
+    CU_ASSERT(sli_histo_bucket(7 * UNIT) == 7);
+
+    // then SLI_HISTO_SUB_NUM buckets for each power of 2
+    CU_ASSERT(sli_histo_bucket(8 * UNIT) == 8);
+    CU_ASSERT(sli_histo_bucket(15 * UNIT) == 15);
+    CU_ASSERT(sli_histo_bucket(16 * UNIT) == 16);
+    CU_ASSERT(sli_histo_bucket(17 * UNIT) == 16);
+    CU_ASSERT(sli_histo_bucket(18 * UNIT) == 17);
+    CU_ASSERT(sli_histo_bucket(31 * UNIT) == 23);
+    CU_ASSERT(sli_histo_bucket(32 * UNIT) == 24);
+
+    // the last bucket holds everything above
+    CU_ASSERT(sli_histo_bucket(((1ULL << SLI_HISTO_MAX_BITS) - 1) * UNIT) == SLI_HISTO_BUCKETS - 1);
+    CU_ASSERT(sli_histo_bucket((1ULL << SLI_HISTO_MAX_BITS) * UNIT) == SLI_HISTO_BUCKETS - 1);
+    CU_ASSERT(sli_histo_bucket(~0ULL) == SLI_HISTO_BUCKETS - 1);
+
+    // monotone
+    for (__u64 v = 1; v < (1ULL << SLI_HISTO_MAX_BITS); v <<= 1) {
+        CU_ASSERT(sli_histo_bucket(v * UNIT - 1) <= sli_histo_bucket(v * UNIT));
+    }
+}
+
+static void TestSliHistoQuantile(void)
+{
+    double expect;
+    __u64 prev = 0, cur;
+
+    (void)memset(&g_histo, 0, sizeof(g_histo));
+    CU_ASSERT(sli_histo_quantile(&g_histo, 0.5) == 0);
+
+    // middle of the bucket, capped at the max recorded
+    HistoRecord(&g_histo, 100000);
+    CU_ASSERT(sli_histo_quantile(&g_histo, 0.5) == 100000);
+    CU_ASSERT(sli_histo_quantile(&g_histo, 1) == 100000);
+
+    (void)memset(&g_histo, 0, sizeof(g_histo));
+    for (int i = 1; i <= VALUE_NUM; i++) {
+        HistoRecord(&g_histo, (__u64)i * VALUE_STEP);
+    }
+    CU_ASSERT(g_histo.count == VALUE_NUM);
+    CU_ASSERT(g_histo.max == (__u64)VALUE_NUM * VALUE_STEP);
+
+    for (int i = 0; i < sizeof(g_quantiles) / sizeof(g_quantiles[0]); i++) {
+        expect = g_quantiles[i] * VALUE_NUM * VALUE_STEP;
+        cur = sli_histo_quantile(&g_histo, g_quantiles[i]);
+        CU_ASSERT(RelErr((double)cur, expect) <= 1.0 / SLI_HISTO_SUB_NUM);
+        CU_ASSERT(cur >= prev);
+        prev = cur;
+    }
+    cur = sli_histo_quantile(&g_histo, 1);
+    CU_ASSERT(cur <= g_histo.max);
+    CU_ASSERT(RelErr((double)cur, (double)g_histo.max) <= 1.0 / SLI_HISTO_SUB_NUM);
+}
+
+static void TestSliHistoMerge(void)
+{
+    (void)memset(g_percpu, 0, sizeof(g_percpu));
+    for (int i = 1; i <= VALUE_NUM; i++) {
+        HistoRecord(&g_percpu[i & 1], (__u64)i * VALUE_STEP);
+    }
+
+    sli_histo_merge(&g_histo, g_percpu, 2);
+    CU_ASSERT(g_histo.count == VALUE_NUM);
+    CU_ASSERT(g_histo.sum == g_percpu[0].sum + g_percpu[1].sum);
+    CU_ASSERT(g_histo.max == (__u64)VALUE_NUM * VALUE_STEP);
+    for (int i = 0; i < SLI_HISTO_BUCKETS; i++) {
+        CU_ASSERT_FATAL(g_histo.buckets[i] == g_percpu[0].buckets[i] + g_percpu[1].buckets[i]);
+    }
+    CU_ASSERT(RelErr((double)sli_histo_quantile(&g_histo, 0.5), 0.5 * VALUE_NUM * VALUE_STEP) <=
+        1.0 / SLI_HISTO_SUB_NUM);
+}
+
+void TestSliHistoMain(CU_pSuite suite)
+{
+    CU_ADD_TEST(suite, TestSliHistoBucket);
+    CU_ADD_TEST(suite, TestSliHistoQuantile);
+    CU_ADD_TEST(suite, TestSliHistoMerge);
+}